@@ -0,0 +1,120 @@
+#ifndef CERES_ERROR_TERMS_BATCHED_VISUAL_ERROR_TERM_H_
+#define CERES_ERROR_TERMS_BATCHED_VISUAL_ERROR_TERM_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/cameras/camera.h>
+#include <ceres/cost_function.h>
+
+#include "ceres-error-terms/common.h"
+
+namespace ceres_error_terms {
+
+// Reprojection errors of several observations of the same landmark combined
+// into a single residual block. Every observation contributes two residuals
+// and is evaluated like VisualReprojectionError, but the transformations on
+// the landmark side are only computed once per evaluation and the parameter
+// blocks shared by the observations (e.g. the camera extrinsics and
+// intrinsics) are only added once to the block. Only the parameter blocks that
+// are actually used by the observations are part of the block, so no dummy
+// blocks are needed. The landmark position is always the first parameter
+// block, such that the block doesn't interfere with the Schur elimination of
+// the landmarks.
+//
+// As a single loss function would act on the norm of all residuals of the
+// block, the Huber loss of every observation is applied inside of the cost
+// function by scaling the residuals of the observation such that their
+// squared norm equals the robustified cost.
+//
+// Evaluate(..) works on scratch space that is preallocated in the cost
+// function, so a cost function must only be used by a single residual block.
+//
+// Note: rotations are expected as quaternions in JPL convention [x, y, z, w].
+class BatchedVisualCostFunction : public ceres::CostFunction {
+ public:
+  // Parameter blocks used by a single observation. Blocks not needed by the
+  // error term type of the observation can be nullptr, see
+  // VisualReprojectionError for the meaning of the error term types.
+  struct ObservationParameterBlocks {
+    ObservationParameterBlocks()
+        : observer_mission_base_pose(nullptr),
+          observer_pose(nullptr),
+          camera_to_imu_orientation(nullptr),
+          camera_to_imu_position(nullptr),
+          camera_intrinsics(nullptr),
+          camera_distortion(nullptr) {}
+    double* observer_mission_base_pose;
+    double* observer_pose;
+    double* camera_to_imu_orientation;
+    double* camera_to_imu_position;
+    double* camera_intrinsics;
+    // Not used if the camera has no distortion.
+    double* camera_distortion;
+  };
+
+  // The landmark base pose and landmark mission base pose blocks are only
+  // added to the residual block if an observation needs them and can be
+  // nullptr if no such observation is added.
+  BatchedVisualCostFunction(
+      double* landmark_position, double* landmark_base_pose,
+      double* landmark_mission_base_pose);
+  virtual ~BatchedVisualCostFunction() {}
+
+  // Adds an observation of the landmark with the given pixel sigma. A Huber
+  // loss with the given threshold (on the residuals weighted with the pixel
+  // sigma) is applied if the threshold is positive. The camera has to be of
+  // the type this cost function was created for and must outlive it.
+  virtual void addObservation(
+      const Eigen::Vector2d& measurement, double pixel_sigma,
+      double huber_loss_threshold, visual::VisualErrorType error_term_type,
+      const aslam::Camera& camera,
+      const ObservationParameterBlocks& parameter_blocks) = 0;
+
+  inline size_t numObservations() const {
+    return static_cast<size_t>(num_residuals()) / visual::kResidualSize;
+  }
+
+  // Parameter blocks in the order expected by Evaluate(..), to be passed along
+  // with this cost function when adding the residual block.
+  inline const std::vector<double*>& getParameterBlocks() const {
+    return parameter_blocks_;
+  }
+
+  static constexpr int kInvalidBlockIndex = -1;
+
+ protected:
+  static constexpr int kLandmarkPositionBlockIndex = 0;
+
+  // Returns the index of the parameter block, adds the block if it was not
+  // part of the cost function yet.
+  int getOrAddParameterBlock(double* parameter_block, int block_size);
+
+  int getOrAddLandmarkBasePoseBlock();
+  int getOrAddLandmarkMissionBasePoseBlock();
+
+  inline int landmarkBasePoseBlockIndex() const {
+    return landmark_base_pose_index_;
+  }
+  inline int landmarkMissionBasePoseBlockIndex() const {
+    return landmark_mission_base_pose_index_;
+  }
+
+ private:
+  std::vector<double*> parameter_blocks_;
+
+  double* const landmark_base_pose_;
+  double* const landmark_mission_base_pose_;
+  int landmark_base_pose_index_;
+  int landmark_mission_base_pose_index_;
+};
+
+// Creates a batched cost function for observations made with cameras of the
+// same projection and distortion type as the given camera.
+BatchedVisualCostFunction* createBatchedVisualCostFunction(
+    const aslam::Camera& camera, double* landmark_position,
+    double* landmark_base_pose, double* landmark_mission_base_pose);
+
+}  // namespace ceres_error_terms
+
+#endif  // CERES_ERROR_TERMS_BATCHED_VISUAL_ERROR_TERM_H_
@@ -0,0 +1,116 @@
+#ifndef CERES_ERROR_TERMS_PREINTEGRATED_INERTIAL_ERROR_TERM_H_
+#define CERES_ERROR_TERMS_PREINTEGRATED_INERTIAL_ERROR_TERM_H_
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <ceres/sized_cost_function.h>
+#include <glog/logging.h>
+#include <imu-integrator/common.h>
+
+#include "ceres-error-terms/inertial-error-term.h"
+
+namespace ceres_error_terms {
+
+// IMU measurements between two keyframes preintegrated in the body frame of
+// the first keyframe, for a fixed linearization point of the biases.
+struct ImuPreintegration {
+  ImuPreintegration() : delta_t_seconds(0.0), valid(false) {}
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // Bias linearization point.
+  Eigen::Vector3d b_g;
+  Eigen::Vector3d b_a;
+
+  double delta_t_seconds;
+  // Preintegrated rotation R_Ii_Ij, velocity and position change.
+  Eigen::Matrix3d delta_R;
+  Eigen::Vector3d delta_v;
+  Eigen::Vector3d delta_p;
+
+  // First-order Jacobians of the preintegrated measurements w.r.t. the biases.
+  Eigen::Matrix3d d_R_d_b_g;
+  Eigen::Matrix3d d_v_d_b_g;
+  Eigen::Matrix3d d_v_d_b_a;
+  Eigen::Matrix3d d_p_d_b_g;
+  Eigen::Matrix3d d_p_d_b_a;
+
+  // Covariance of the residual, in the same order as the error state.
+  InertialStateCovariance covariance;
+  Eigen::LLT<InertialStateCovariance> L_cholesky_covariance;
+
+  bool valid;
+};
+
+// Inertial error term based on on-manifold preintegration, see Forster et al.,
+// "On-Manifold Preintegration for Real-Time Visual-Inertial Odometry",
+// TRO 2017. In contrast to InertialErrorTerm, the IMU measurements are only
+// integrated again if the bias of the begin keyframe moved further than a
+// threshold away from the bias used for the preintegration; smaller changes of
+// the bias are accounted for with first-order Jacobians. The measurements
+// don't depend on the rest of the begin state.
+//
+// Parameter blocks and residual layout are the same as for InertialErrorTerm,
+// so the two error terms can be used interchangeably. Note: rotations are
+// expected as quaternions in JPL convention [x, y, z, w].
+class PreintegratedInertialErrorTerm
+    : public ceres::SizedCostFunction<imu_integrator::kErrorStateSize,
+                                      imu_integrator::kStatePoseBlockSize,
+                                      imu_integrator::kGyroBiasBlockSize,
+                                      imu_integrator::kVelocityBlockSize,
+                                      imu_integrator::kAccelBiasBlockSize,
+                                      imu_integrator::kStatePoseBlockSize,
+                                      imu_integrator::kGyroBiasBlockSize,
+                                      imu_integrator::kVelocityBlockSize,
+                                      imu_integrator::kAccelBiasBlockSize> {
+ public:
+  static constexpr double kDefaultGyroBiasReintegrationThreshold = 1e-2;
+  static constexpr double kDefaultAccelBiasReintegrationThreshold = 1e-1;
+
+  PreintegratedInertialErrorTerm(
+      const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
+      const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
+      double gyro_noise_sigma, double gyro_bias_sigma, double acc_noise_sigma,
+      double acc_bias_sigma, double gravity_magnitude,
+      double gyro_bias_reintegration_threshold =
+          kDefaultGyroBiasReintegrationThreshold,
+      double accel_bias_reintegration_threshold =
+          kDefaultAccelBiasReintegrationThreshold);
+
+  virtual ~PreintegratedInertialErrorTerm() {}
+
+  virtual bool Evaluate(
+      double const* const* parameters, double* residuals_ptr,
+      double** jacobians) const;
+
+  // Preintegrates the IMU measurements with the given bias linearization
+  // point.
+  void preintegrate(
+      const Eigen::Vector3d& b_g, const Eigen::Vector3d& b_a,
+      ImuPreintegration* preintegration) const;
+
+  inline size_t getNumPreintegrations() const {
+    return num_preintegrations_;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  const Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps_;
+  const Eigen::Matrix<double, 6, Eigen::Dynamic> imu_data_;
+
+  const double gyro_noise_sigma_squared_;
+  const double gyro_bias_sigma_squared_;
+  const double acc_noise_sigma_squared_;
+  const double acc_bias_sigma_squared_;
+  const Eigen::Vector3d gravity_M_;
+
+  const double gyro_bias_reintegration_threshold_;
+  const double accel_bias_reintegration_threshold_;
+
+  mutable ImuPreintegration preintegration_;
+  mutable size_t num_preintegrations_;
+};
+
+}  // namespace ceres_error_terms
+
+#endif  // CERES_ERROR_TERMS_PREINTEGRATED_INERTIAL_ERROR_TERM_H_
@@ -0,0 +1,589 @@
+#include "ceres-error-terms/batched-visual-error-term.h"
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/cameras/camera-pinhole.h>
+#include <aslam/cameras/camera-unified-projection.h>
+#include <aslam/cameras/distortion-equidistant.h>
+#include <aslam/cameras/distortion-fisheye.h>
+#include <aslam/cameras/distortion-null.h>
+#include <aslam/cameras/distortion-radtan.h>
+#include <glog/logging.h>
+#include <maplab-common/geometry.h>
+#include <maplab-common/quaternion-math.h>
+
+#include "ceres-error-terms/parameterization/quaternion-param-jpl.h"
+
+namespace ceres_error_terms {
+
+constexpr int BatchedVisualCostFunction::kInvalidBlockIndex;
+constexpr int BatchedVisualCostFunction::kLandmarkPositionBlockIndex;
+
+BatchedVisualCostFunction::BatchedVisualCostFunction(
+    double* landmark_position, double* landmark_base_pose,
+    double* landmark_mission_base_pose)
+    : landmark_base_pose_(landmark_base_pose),
+      landmark_mission_base_pose_(landmark_mission_base_pose),
+      landmark_base_pose_index_(kInvalidBlockIndex),
+      landmark_mission_base_pose_index_(kInvalidBlockIndex) {
+  CHECK_NOTNULL(landmark_position);
+  set_num_residuals(0);
+  CHECK_EQ(
+      getOrAddParameterBlock(landmark_position, visual::kPositionBlockSize),
+      kLandmarkPositionBlockIndex);
+}
+
+int BatchedVisualCostFunction::getOrAddParameterBlock(
+    double* parameter_block, int block_size) {
+  CHECK_NOTNULL(parameter_block);
+  CHECK_GT(block_size, 0);
+  // The number of distinct blocks is small, so a linear search is cheaper than
+  // keeping a map around for the lifetime of the cost function.
+  const int num_blocks = static_cast<int>(parameter_blocks_.size());
+  for (int block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    if (parameter_blocks_[block_idx] == parameter_block) {
+      CHECK_EQ(parameter_block_sizes()[block_idx], block_size);
+      return block_idx;
+    }
+  }
+  parameter_blocks_.push_back(parameter_block);
+  mutable_parameter_block_sizes()->push_back(block_size);
+  return num_blocks;
+}
+
+int BatchedVisualCostFunction::getOrAddLandmarkBasePoseBlock() {
+  if (landmark_base_pose_index_ == kInvalidBlockIndex) {
+    landmark_base_pose_index_ = getOrAddParameterBlock(
+        landmark_base_pose_, visual::kPoseBlockSize);
+  }
+  return landmark_base_pose_index_;
+}
+
+int BatchedVisualCostFunction::getOrAddLandmarkMissionBasePoseBlock() {
+  if (landmark_mission_base_pose_index_ == kInvalidBlockIndex) {
+    landmark_mission_base_pose_index_ = getOrAddParameterBlock(
+        landmark_mission_base_pose_, visual::kPoseBlockSize);
+  }
+  return landmark_mission_base_pose_index_;
+}
+
+namespace {
+
+typedef Eigen::Matrix<double, visual::kResidualSize, 3> ResidualJacobian3;
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMajorMatrix;
+
+// Adds the Jacobian of the residuals of an observation w.r.t. a parameter
+// block to the rows of the observation in the Jacobian of the whole residual
+// block. Adding instead of assigning accounts for blocks that appear in
+// several roles of the same observation.
+template <typename Derived>
+inline void addToJacobianRows(
+    const Eigen::MatrixBase<Derived>& J_observation, const int row,
+    const int num_rows, const int block_size, double* jacobian) {
+  Eigen::Map<RowMajorMatrix> J(jacobian, num_rows, block_size);
+  J.block(row, 0, visual::kResidualSize, block_size).noalias() +=
+      J_observation;
+}
+
+// Converts the Jacobian w.r.t. a small rotation to the Jacobian w.r.t. the
+// JPL quaternion, in the same way as VisualReprojectionError.
+inline Eigen::Matrix<double, visual::kResidualSize, 4> toQuaternionJacobian(
+    const ResidualJacobian3& J_wrt_rotation, const double* q) {
+  const JplQuaternionParameterization quat_parameterization;
+  Eigen::Matrix<double, 4, 3, Eigen::RowMajor> J_quat_local_param;
+  quat_parameterization.ComputeJacobian(q, J_quat_local_param.data());
+  return J_wrt_rotation * 4.0 * J_quat_local_param.transpose();
+}
+
+template <typename CameraType, typename DistortionType>
+class BatchedVisualReprojectionError : public BatchedVisualCostFunction {
+ public:
+  BatchedVisualReprojectionError(
+      double* landmark_position, double* landmark_base_pose,
+      double* landmark_mission_base_pose)
+      : BatchedVisualCostFunction(
+            landmark_position, landmark_base_pose,
+            landmark_mission_base_pose),
+        J_keypoint_wrt_intrinsics_(
+            visual::kResidualSize, CameraType::parameterCount()),
+        J_keypoint_wrt_distortion_(
+            visual::kResidualSize, DistortionType::parameterCount()) {}
+
+  virtual ~BatchedVisualReprojectionError() {}
+
+  virtual void addObservation(
+      const Eigen::Vector2d& measurement, double pixel_sigma,
+      double huber_loss_threshold, visual::VisualErrorType error_term_type,
+      const aslam::Camera& camera,
+      const ObservationParameterBlocks& parameter_blocks);
+
+  virtual bool Evaluate(
+      double const* const* parameters, double* residuals,
+      double** jacobians) const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  struct CameraBlocks {
+    const CameraType* camera;
+    int orientation_index;
+    int position_index;
+    int intrinsics_index;
+    int distortion_index;
+  };
+
+  struct Observation {
+    Eigen::Vector2d measurement;
+    double pixel_sigma_inverse;
+    double huber_loss_threshold;
+    visual::VisualErrorType error_term_type;
+    int camera_index;
+    int observer_pose_index;
+    int observer_mission_base_pose_index;
+  };
+
+  int getOrAddCamera(
+      const CameraType* camera,
+      const ObservationParameterBlocks& parameter_blocks);
+
+  std::vector<CameraBlocks> cameras_;
+  std::vector<Observation, Eigen::aligned_allocator<Observation>>
+      observations_;
+
+  // Scratch space of Evaluate(..), sized when the cameras are added such that
+  // evaluating the block doesn't allocate. Hence, the cost function must not
+  // be shared by several residual blocks.
+  mutable std::vector<
+      Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d>>
+      R_C_I_per_camera_;
+  mutable std::vector<Eigen::VectorXd> intrinsics_per_camera_;
+  mutable std::vector<Eigen::VectorXd> distortion_per_camera_;
+  mutable Eigen::Matrix<double, visual::kResidualSize, Eigen::Dynamic>
+      J_keypoint_wrt_intrinsics_;
+  mutable Eigen::Matrix<double, visual::kResidualSize, Eigen::Dynamic>
+      J_keypoint_wrt_distortion_;
+};
+
+template <typename CameraType, typename DistortionType>
+int BatchedVisualReprojectionError<CameraType, DistortionType>::getOrAddCamera(
+    const CameraType* camera,
+    const ObservationParameterBlocks& parameter_blocks) {
+  CameraBlocks camera_blocks;
+  camera_blocks.camera = camera;
+  camera_blocks.orientation_index = getOrAddParameterBlock(
+      CHECK_NOTNULL(parameter_blocks.camera_to_imu_orientation),
+      visual::kOrientationBlockSize);
+  camera_blocks.position_index = getOrAddParameterBlock(
+      CHECK_NOTNULL(parameter_blocks.camera_to_imu_position),
+      visual::kPositionBlockSize);
+  camera_blocks.intrinsics_index = getOrAddParameterBlock(
+      CHECK_NOTNULL(parameter_blocks.camera_intrinsics),
+      CameraType::parameterCount());
+  camera_blocks.distortion_index = kInvalidBlockIndex;
+  if (DistortionType::parameterCount() > 0u) {
+    camera_blocks.distortion_index = getOrAddParameterBlock(
+        CHECK_NOTNULL(parameter_blocks.camera_distortion),
+        DistortionType::parameterCount());
+  }
+
+  const int num_cameras = static_cast<int>(cameras_.size());
+  for (int camera_idx = 0; camera_idx < num_cameras; ++camera_idx) {
+    const CameraBlocks& other = cameras_[camera_idx];
+    if (other.camera == camera_blocks.camera &&
+        other.orientation_index == camera_blocks.orientation_index &&
+        other.position_index == camera_blocks.position_index &&
+        other.intrinsics_index == camera_blocks.intrinsics_index &&
+        other.distortion_index == camera_blocks.distortion_index) {
+      return camera_idx;
+    }
+  }
+  cameras_.push_back(camera_blocks);
+  R_C_I_per_camera_.emplace_back();
+  intrinsics_per_camera_.emplace_back(CameraType::parameterCount());
+  distortion_per_camera_.emplace_back(DistortionType::parameterCount());
+  return num_cameras;
+}
+
+template <typename CameraType, typename DistortionType>
+void BatchedVisualReprojectionError<CameraType, DistortionType>::
+    addObservation(
+        const Eigen::Vector2d& measurement, double pixel_sigma,
+        double huber_loss_threshold, visual::VisualErrorType error_term_type,
+        const aslam::Camera& camera,
+        const ObservationParameterBlocks& parameter_blocks) {
+  CHECK_GT(pixel_sigma, 0.0);
+  CHECK(isValidVisualErrorTermType(error_term_type));
+  const CameraType* derived_camera = dynamic_cast<const CameraType*>(&camera);
+  CHECK(derived_camera != nullptr)
+      << "All observations of a batched visual cost function have to be made "
+      << "with cameras of the same type.";
+  CHECK(
+      dynamic_cast<const DistortionType*>(&camera.getDistortion()) != nullptr)
+      << "All observations of a batched visual cost function have to be made "
+      << "with cameras of the same distortion type.";
+
+  Observation observation;
+  observation.measurement = measurement;
+  observation.pixel_sigma_inverse = 1.0 / pixel_sigma;
+  observation.huber_loss_threshold = huber_loss_threshold;
+  observation.error_term_type = error_term_type;
+  observation.observer_pose_index = kInvalidBlockIndex;
+  observation.observer_mission_base_pose_index = kInvalidBlockIndex;
+
+  if (error_term_type != visual::VisualErrorType::kLocalKeyframe) {
+    getOrAddLandmarkBasePoseBlock();
+    observation.observer_pose_index = getOrAddParameterBlock(
+        CHECK_NOTNULL(parameter_blocks.observer_pose), visual::kPoseBlockSize);
+  }
+  if (error_term_type == visual::VisualErrorType::kGlobal) {
+    getOrAddLandmarkMissionBasePoseBlock();
+    observation.observer_mission_base_pose_index = getOrAddParameterBlock(
+        CHECK_NOTNULL(parameter_blocks.observer_mission_base_pose),
+        visual::kPoseBlockSize);
+  }
+  observation.camera_index = getOrAddCamera(derived_camera, parameter_blocks);
+
+  observations_.push_back(observation);
+  set_num_residuals(num_residuals() + visual::kResidualSize);
+}
+
+template <typename CameraType, typename DistortionType>
+bool BatchedVisualReprojectionError<CameraType, DistortionType>::Evaluate(
+    double const* const* parameters, double* residuals,
+    double** jacobians) const {
+  // Coordinate frames, see VisualReprojectionError:
+  //  G = global
+  //  M = mission of the keyframe vertex, expressed in G
+  //  LM = mission of the landmark-base vertex, expressed in G
+  //  B = base vertex of the landmark, expressed in LM
+  //  I = IMU position of the keyframe vertex, expressed in M
+  //  C = Camera position, expressed in I
+  const int num_rows = num_residuals();
+  const std::vector<int32_t>& block_sizes = parameter_block_sizes();
+  if (jacobians != nullptr) {
+    // Every observation only fills its own rows.
+    for (size_t block_idx = 0u; block_idx < block_sizes.size(); ++block_idx) {
+      if (jacobians[block_idx] != nullptr) {
+        Eigen::Map<RowMajorMatrix>(
+            jacobians[block_idx], num_rows, block_sizes[block_idx])
+            .setZero();
+      }
+    }
+  }
+
+  // The landmark side is shared by all observations.
+  Eigen::Map<const Eigen::Vector3d> p_B_fi(
+      parameters[kLandmarkPositionBlockIndex]);
+  Eigen::Matrix3d R_LM_B = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d p_LM_fi = Eigen::Vector3d::Zero();
+  const int landmark_base_pose_index = landmarkBasePoseBlockIndex();
+  if (landmark_base_pose_index != kInvalidBlockIndex) {
+    Eigen::Map<const Eigen::Vector4d> q_B_LM(
+        parameters[landmark_base_pose_index]);
+    Eigen::Map<const Eigen::Vector3d> p_LM_B(
+        parameters[landmark_base_pose_index] + visual::kOrientationBlockSize);
+    Eigen::Matrix3d R_B_LM;
+    common::toRotationMatrixJPL(q_B_LM, &R_B_LM);
+    R_LM_B = R_B_LM.transpose();
+    p_LM_fi = R_LM_B * p_B_fi + p_LM_B;
+  }
+  Eigen::Matrix3d R_G_LM = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d p_G_fi = Eigen::Vector3d::Zero();
+  const int landmark_mission_base_pose_index =
+      landmarkMissionBasePoseBlockIndex();
+  if (landmark_mission_base_pose_index != kInvalidBlockIndex) {
+    Eigen::Map<const Eigen::Vector4d> q_G_LM(
+        parameters[landmark_mission_base_pose_index]);
+    Eigen::Map<const Eigen::Vector3d> p_G_LM(
+        parameters[landmark_mission_base_pose_index] +
+        visual::kOrientationBlockSize);
+    common::toRotationMatrixJPL(q_G_LM, &R_G_LM);
+    p_G_fi = R_G_LM * p_LM_fi + p_G_LM;
+  }
+
+  // The camera parameters are shared by all observations of the same camera.
+  // They are copied into the preallocated scratch space, which keeps its size.
+  const size_t num_cameras = cameras_.size();
+  for (size_t camera_idx = 0u; camera_idx < num_cameras; ++camera_idx) {
+    const CameraBlocks& camera_blocks = cameras_[camera_idx];
+    Eigen::Map<const Eigen::Vector4d> q_C_I(
+        parameters[camera_blocks.orientation_index]);
+    common::toRotationMatrixJPL(q_C_I, &R_C_I_per_camera_[camera_idx]);
+    intrinsics_per_camera_[camera_idx] = Eigen::Map<
+        const Eigen::Matrix<double, CameraType::parameterCount(), 1>>(
+        parameters[camera_blocks.intrinsics_index]);
+    if (camera_blocks.distortion_index != kInvalidBlockIndex) {
+      distortion_per_camera_[camera_idx] = Eigen::Map<
+          const Eigen::Matrix<double, DistortionType::parameterCount(), 1>>(
+          parameters[camera_blocks.distortion_index]);
+    }
+  }
+
+  constexpr double kMaxDistanceFromOpticalAxisPxSquare = 1.0e5 * 1.0e5;
+  constexpr double kMinDistanceToCameraPlane = 0.05;
+
+  Eigen::Vector2d reprojected_landmark;
+  Eigen::Matrix<double, visual::kResidualSize, 3> J_keypoint_wrt_p_C_fi;
+
+  const size_t num_observations = observations_.size();
+  for (size_t observation_idx = 0u; observation_idx < num_observations;
+       ++observation_idx) {
+    const Observation& observation = observations_[observation_idx];
+    const CameraBlocks& camera_blocks = cameras_[observation.camera_index];
+    const Eigen::Matrix3d& R_C_I = R_C_I_per_camera_[observation.camera_index];
+    Eigen::Map<const Eigen::Vector3d> p_C_I(
+        parameters[camera_blocks.position_index]);
+    const int row = static_cast<int>(observation_idx) * visual::kResidualSize;
+
+    Eigen::Matrix3d R_I_M = Eigen::Matrix3d::Identity();
+    Eigen::Matrix3d R_M_G = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d p_I_fi;
+    switch (observation.error_term_type) {
+      case visual::VisualErrorType::kLocalKeyframe:
+        // The landmark baseframe is in fact our keyframe.
+        p_I_fi = p_B_fi;
+        break;
+      case visual::VisualErrorType::kLocalMission: {
+        // In this case M == LM.
+        const double* imu_pose = parameters[observation.observer_pose_index];
+        common::toRotationMatrixJPL(
+            Eigen::Map<const Eigen::Vector4d>(imu_pose), &R_I_M);
+        Eigen::Map<const Eigen::Vector3d> p_M_I(
+            imu_pose + visual::kOrientationBlockSize);
+        p_I_fi = R_I_M * (p_LM_fi - p_M_I);
+        break;
+      }
+      case visual::VisualErrorType::kGlobal: {
+        const double* mission_base_pose =
+            parameters[observation.observer_mission_base_pose_index];
+        Eigen::Matrix3d R_G_M;
+        common::toRotationMatrixJPL(
+            Eigen::Map<const Eigen::Vector4d>(mission_base_pose), &R_G_M);
+        R_M_G = R_G_M.transpose();
+        Eigen::Map<const Eigen::Vector3d> p_G_M(
+            mission_base_pose + visual::kOrientationBlockSize);
+        const double* imu_pose = parameters[observation.observer_pose_index];
+        common::toRotationMatrixJPL(
+            Eigen::Map<const Eigen::Vector4d>(imu_pose), &R_I_M);
+        Eigen::Map<const Eigen::Vector3d> p_M_I(
+            imu_pose + visual::kOrientationBlockSize);
+        p_I_fi = R_I_M * (R_M_G * (p_G_fi - p_G_M) - p_M_I);
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unknown visual error term type.";
+    }
+    const Eigen::Vector3d p_C_fi = R_C_I * p_I_fi + p_C_I;
+
+    const bool evaluate_camera_jacobians = (jacobians != nullptr);
+    const aslam::ProjectionResult projection_result =
+        camera_blocks.camera->project3Functional(
+            p_C_fi, &intrinsics_per_camera_[observation.camera_index],
+            &distortion_per_camera_[observation.camera_index],
+            &reprojected_landmark,
+            evaluate_camera_jacobians ? &J_keypoint_wrt_p_C_fi : nullptr,
+            evaluate_camera_jacobians ? &J_keypoint_wrt_intrinsics_ : nullptr,
+            (evaluate_camera_jacobians &&
+             DistortionType::parameterCount() > 0u)
+                ? &J_keypoint_wrt_distortion_
+                : nullptr);
+    const bool projection_failed =
+        (projection_result == aslam::ProjectionResult::POINT_BEHIND_CAMERA) ||
+        (projection_result == aslam::ProjectionResult::PROJECTION_INVALID) ||
+        (p_C_fi(2, 0) < kMinDistanceToCameraPlane) ||
+        (reprojected_landmark.squaredNorm() >
+         kMaxDistanceFromOpticalAxisPxSquare);
+
+    Eigen::Map<Eigen::Vector2d> residual(residuals + row);
+    if (projection_failed) {
+      // The residuals and Jacobians of failed projections are zero, the
+      // Jacobians are already zeroed.
+      residual.setZero();
+      continue;
+    }
+    residual =
+        (reprojected_landmark - observation.measurement) *
+        observation.pixel_sigma_inverse;
+
+    // Huber loss: the residual is scaled with f(s) = sqrt(rho(s) / s), where
+    // s is the squared norm of the residual, so that the squared norm of the
+    // scaled residual is rho(s). The Jacobian of the scaled residual is
+    // (f * I + 2 * f' * r * r^T) * J.
+    Eigen::Matrix2d J_robust = Eigen::Matrix2d::Identity();
+    const double s = residual.squaredNorm();
+    const double a = observation.huber_loss_threshold;
+    if (a > 0.0 && s > a * a) {
+      const double sqrt_s = std::sqrt(s);
+      const double rho = 2.0 * a * sqrt_s - a * a;
+      const double rho_derivative = a / sqrt_s;
+      const double f = std::sqrt(rho / s);
+      const double f_derivative =
+          (rho_derivative * s - rho) / (2.0 * s * s * f);
+      J_robust = f * Eigen::Matrix2d::Identity() +
+                 2.0 * f_derivative * residual * residual.transpose();
+      residual *= f;
+    }
+
+    if (jacobians == nullptr) {
+      continue;
+    }
+    J_robust *= observation.pixel_sigma_inverse;
+    const ResidualJacobian3 J_r_wrt_p_C_fi = J_robust * J_keypoint_wrt_p_C_fi;
+
+    // Camera extrinsics and intrinsics.
+    if (jacobians[camera_blocks.position_index] != nullptr) {
+      addToJacobianRows(
+          J_r_wrt_p_C_fi, row, num_rows, visual::kPositionBlockSize,
+          jacobians[camera_blocks.position_index]);
+    }
+    if (jacobians[camera_blocks.orientation_index] != nullptr) {
+      addToJacobianRows(
+          toQuaternionJacobian(
+              J_r_wrt_p_C_fi * common::skew(p_C_fi),
+              parameters[camera_blocks.orientation_index]),
+          row, num_rows, visual::kOrientationBlockSize,
+          jacobians[camera_blocks.orientation_index]);
+    }
+    if (jacobians[camera_blocks.intrinsics_index] != nullptr) {
+      addToJacobianRows(
+          J_robust * J_keypoint_wrt_intrinsics_, row, num_rows,
+          CameraType::parameterCount(),
+          jacobians[camera_blocks.intrinsics_index]);
+    }
+    if (camera_blocks.distortion_index != kInvalidBlockIndex &&
+        jacobians[camera_blocks.distortion_index] != nullptr) {
+      addToJacobianRows(
+          J_robust * J_keypoint_wrt_distortion_, row, num_rows,
+          DistortionType::parameterCount(),
+          jacobians[camera_blocks.distortion_index]);
+    }
+
+    if (observation.error_term_type ==
+        visual::VisualErrorType::kLocalKeyframe) {
+      if (jacobians[kLandmarkPositionBlockIndex] != nullptr) {
+        addToJacobianRows(
+            J_r_wrt_p_C_fi * R_C_I, row, num_rows, visual::kPositionBlockSize,
+            jacobians[kLandmarkPositionBlockIndex]);
+      }
+      continue;
+    }
+
+    // Jacobians of the residual w.r.t. the positions along the chain of
+    // transformations, see VisualReprojectionError.
+    const ResidualJacobian3 J_r_wrt_p_M_I = -J_r_wrt_p_C_fi * R_C_I * R_I_M;
+    ResidualJacobian3 J_r_wrt_p_LM_B;
+    if (observation.error_term_type == visual::VisualErrorType::kGlobal) {
+      const ResidualJacobian3 J_r_wrt_p_G_M = J_r_wrt_p_M_I * R_M_G;
+      J_r_wrt_p_LM_B = -J_r_wrt_p_G_M * R_G_LM;
+
+      const double* mission_base_pose =
+          parameters[observation.observer_mission_base_pose_index];
+      if (jacobians[observation.observer_mission_base_pose_index] !=
+          nullptr) {
+        Eigen::Matrix<double, visual::kResidualSize, visual::kPoseBlockSize> J;
+        J.leftCols<visual::kOrientationBlockSize>() = toQuaternionJacobian(
+            J_r_wrt_p_G_M * common::skew(p_G_fi), mission_base_pose);
+        J.rightCols<visual::kPositionBlockSize>() = J_r_wrt_p_G_M;
+        addToJacobianRows(
+            J, row, num_rows, visual::kPoseBlockSize,
+            jacobians[observation.observer_mission_base_pose_index]);
+      }
+      if (jacobians[landmark_mission_base_pose_index] != nullptr) {
+        Eigen::Matrix<double, visual::kResidualSize, visual::kPoseBlockSize> J;
+        J.leftCols<visual::kOrientationBlockSize>() = toQuaternionJacobian(
+            -J_r_wrt_p_G_M * common::skew(p_G_fi),
+            parameters[landmark_mission_base_pose_index]);
+        J.rightCols<visual::kPositionBlockSize>() = -J_r_wrt_p_G_M;
+        addToJacobianRows(
+            J, row, num_rows, visual::kPoseBlockSize,
+            jacobians[landmark_mission_base_pose_index]);
+      }
+    } else {
+      J_r_wrt_p_LM_B = -J_r_wrt_p_M_I;
+    }
+    const ResidualJacobian3 J_r_wrt_p_B_fi = J_r_wrt_p_LM_B * R_LM_B;
+
+    if (jacobians[kLandmarkPositionBlockIndex] != nullptr) {
+      addToJacobianRows(
+          J_r_wrt_p_B_fi, row, num_rows, visual::kPositionBlockSize,
+          jacobians[kLandmarkPositionBlockIndex]);
+    }
+    if (jacobians[landmark_base_pose_index] != nullptr) {
+      Eigen::Matrix<double, visual::kResidualSize, visual::kPoseBlockSize> J;
+      J.leftCols<visual::kOrientationBlockSize>() = toQuaternionJacobian(
+          -J_r_wrt_p_B_fi * common::skew(p_B_fi),
+          parameters[landmark_base_pose_index]);
+      J.rightCols<visual::kPositionBlockSize>() = J_r_wrt_p_LM_B;
+      addToJacobianRows(
+          J, row, num_rows, visual::kPoseBlockSize,
+          jacobians[landmark_base_pose_index]);
+    }
+    if (jacobians[observation.observer_pose_index] != nullptr) {
+      Eigen::Matrix<double, visual::kResidualSize, visual::kPoseBlockSize> J;
+      J.leftCols<visual::kOrientationBlockSize>() = toQuaternionJacobian(
+          J_r_wrt_p_C_fi * R_C_I * common::skew(p_I_fi),
+          parameters[observation.observer_pose_index]);
+      J.rightCols<visual::kPositionBlockSize>() = J_r_wrt_p_M_I;
+      addToJacobianRows(
+          J, row, num_rows, visual::kPoseBlockSize,
+          jacobians[observation.observer_pose_index]);
+    }
+  }
+  return true;
+}
+
+template <typename CameraType>
+BatchedVisualCostFunction* createForDistortion(
+    const aslam::Camera& camera, double* landmark_position,
+    double* landmark_base_pose, double* landmark_mission_base_pose) {
+  const aslam::Distortion::Type distortion_type =
+      camera.getDistortion().getType();
+  switch (distortion_type) {
+    case aslam::Distortion::Type::kNoDistortion:
+      return new BatchedVisualReprojectionError<
+          CameraType, aslam::NullDistortion>(
+          landmark_position, landmark_base_pose, landmark_mission_base_pose);
+    case aslam::Distortion::Type::kEquidistant:
+      return new BatchedVisualReprojectionError<
+          CameraType, aslam::EquidistantDistortion>(
+          landmark_position, landmark_base_pose, landmark_mission_base_pose);
+    case aslam::Distortion::Type::kRadTan:
+      return new BatchedVisualReprojectionError<
+          CameraType, aslam::RadTanDistortion>(
+          landmark_position, landmark_base_pose, landmark_mission_base_pose);
+    case aslam::Distortion::Type::kFisheye:
+      return new BatchedVisualReprojectionError<
+          CameraType, aslam::FisheyeDistortion>(
+          landmark_position, landmark_base_pose, landmark_mission_base_pose);
+    default:
+      LOG(FATAL) << "Invalid camera distortion type for ceres error term: "
+                 << static_cast<int>(distortion_type);
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+BatchedVisualCostFunction* createBatchedVisualCostFunction(
+    const aslam::Camera& camera, double* landmark_position,
+    double* landmark_base_pose, double* landmark_mission_base_pose) {
+  switch (camera.getType()) {
+    case aslam::Camera::Type::kPinhole:
+      return createForDistortion<aslam::PinholeCamera>(
+          camera, landmark_position, landmark_base_pose,
+          landmark_mission_base_pose);
+    case aslam::Camera::Type::kUnifiedProjection:
+      return createForDistortion<aslam::UnifiedProjectionCamera>(
+          camera, landmark_position, landmark_base_pose,
+          landmark_mission_base_pose);
+    default:
+      LOG(FATAL) << "Invalid camera projection type for ceres error term: "
+                 << static_cast<int>(camera.getType());
+  }
+  return nullptr;
+}
+
+}  // namespace ceres_error_terms
@@ -0,0 +1,400 @@
+#include "ceres-error-terms/preintegrated-inertial-error-term.h"
+
+#include <ceres-error-terms/parameterization/quaternion-param-jpl.h>
+#include <maplab-common/geometry.h>
+#include <maplab-common/quaternion-math.h>
+
+namespace ceres_error_terms {
+namespace {
+
+inline Eigen::Matrix3d expSO3(const Eigen::Vector3d& phi) {
+  return common::ExpMap(phi).toRotationMatrix();
+}
+
+inline Eigen::Vector3d logSO3(const Eigen::Matrix3d& R) {
+  return common::LogMap(Eigen::Quaterniond(R));
+}
+
+// Right Jacobian of SO(3); common::Gamma is the left Jacobian.
+inline Eigen::Matrix3d rightJacobianSO3(const Eigen::Vector3d& phi) {
+  const Eigen::Vector3d minus_phi = -phi;
+  return common::Gamma(minus_phi);
+}
+
+}  // namespace
+
+constexpr double
+    PreintegratedInertialErrorTerm::kDefaultGyroBiasReintegrationThreshold;
+constexpr double
+    PreintegratedInertialErrorTerm::kDefaultAccelBiasReintegrationThreshold;
+
+PreintegratedInertialErrorTerm::PreintegratedInertialErrorTerm(
+    const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
+    double gyro_noise_sigma, double gyro_bias_sigma, double acc_noise_sigma,
+    double acc_bias_sigma, double gravity_magnitude,
+    double gyro_bias_reintegration_threshold,
+    double accel_bias_reintegration_threshold)
+    : imu_timestamps_(imu_timestamps),
+      imu_data_(imu_data),
+      gyro_noise_sigma_squared_(gyro_noise_sigma * gyro_noise_sigma),
+      gyro_bias_sigma_squared_(gyro_bias_sigma * gyro_bias_sigma),
+      acc_noise_sigma_squared_(acc_noise_sigma * acc_noise_sigma),
+      acc_bias_sigma_squared_(acc_bias_sigma * acc_bias_sigma),
+      gravity_M_(0.0, 0.0, -gravity_magnitude),
+      gyro_bias_reintegration_threshold_(gyro_bias_reintegration_threshold),
+      accel_bias_reintegration_threshold_(accel_bias_reintegration_threshold),
+      num_preintegrations_(0u) {
+  CHECK_GT(imu_data.cols(), 1);
+  CHECK_EQ(imu_data.cols(), imu_timestamps.cols());
+
+  CHECK_GT(gyro_noise_sigma, 0.0);
+  CHECK_GT(gyro_bias_sigma, 0.0);
+  CHECK_GT(acc_noise_sigma, 0.0);
+  CHECK_GT(acc_bias_sigma, 0.0);
+  CHECK_GE(gyro_bias_reintegration_threshold, 0.0);
+  CHECK_GE(accel_bias_reintegration_threshold, 0.0);
+}
+
+void PreintegratedInertialErrorTerm::preintegrate(
+    const Eigen::Vector3d& b_g, const Eigen::Vector3d& b_a,
+    ImuPreintegration* preintegration) const {
+  CHECK_NOTNULL(preintegration);
+  ImuPreintegration& pre = *preintegration;
+  pre.b_g = b_g;
+  pre.b_a = b_a;
+  pre.delta_t_seconds = 0.0;
+  pre.delta_R.setIdentity();
+  pre.delta_v.setZero();
+  pre.delta_p.setZero();
+  pre.d_R_d_b_g.setZero();
+  pre.d_v_d_b_g.setZero();
+  pre.d_v_d_b_a.setZero();
+  pre.d_p_d_b_g.setZero();
+  pre.d_p_d_b_a.setZero();
+
+  // Covariance of the preintegrated rotation, velocity and position.
+  Eigen::Matrix<double, 9, 9> covariance_R_v_p;
+  covariance_R_v_p.setZero();
+  Eigen::Matrix<double, 9, 9> A;
+  A.setIdentity();
+  Eigen::Matrix<double, 9, 3> B_gyro;
+  B_gyro.setZero();
+  Eigen::Matrix<double, 9, 3> B_acc;
+  B_acc.setZero();
+
+  for (int i = 0; i < imu_data_.cols() - 1; ++i) {
+    CHECK_GE(imu_timestamps_(0, i + 1), imu_timestamps_(0, i))
+        << "IMU measurements not properly ordered";
+    const double dt = (imu_timestamps_(0, i + 1) - imu_timestamps_(0, i)) *
+                      imu_integrator::kNanoSecondsToSeconds;
+    if (dt <= 0.0) {
+      continue;
+    }
+    const double dt2 = dt * dt;
+
+    // Use the mean of two consecutive readings, as the RK4 integration
+    // interpolates linearly between them.
+    const Eigen::Vector3d acc =
+        0.5 * (imu_data_.col(i).segment<3>(
+                   imu_integrator::kAccelReadingOffset) +
+               imu_data_.col(i + 1).segment<3>(
+                   imu_integrator::kAccelReadingOffset)) -
+        b_a;
+    const Eigen::Vector3d gyro =
+        0.5 * (imu_data_.col(i).segment<3>(
+                   imu_integrator::kGyroReadingOffset) +
+               imu_data_.col(i + 1).segment<3>(
+                   imu_integrator::kGyroReadingOffset)) -
+        b_g;
+
+    const Eigen::Vector3d phi = gyro * dt;
+    const Eigen::Matrix3d delta_R_step = expSO3(phi);
+    const Eigen::Matrix3d J_r_step = rightJacobianSO3(phi);
+    const Eigen::Matrix3d acc_skew = common::skew(acc);
+    const Eigen::Matrix3d delta_R_acc_skew = pre.delta_R * acc_skew;
+
+    // Noise propagation, the error state is [rotation, velocity, position].
+    A.block<3, 3>(0, 0) = delta_R_step.transpose();
+    A.block<3, 3>(3, 0) = -delta_R_acc_skew * dt;
+    A.block<3, 3>(6, 0) = -0.5 * delta_R_acc_skew * dt2;
+    A.block<3, 3>(6, 3) = Eigen::Matrix3d::Identity() * dt;
+    B_gyro.block<3, 3>(0, 0) = J_r_step * dt;
+    B_acc.block<3, 3>(3, 0) = pre.delta_R * dt;
+    B_acc.block<3, 3>(6, 0) = 0.5 * pre.delta_R * dt2;
+    // The continuous-time noise densities are discretized with 1 / dt.
+    covariance_R_v_p = A * covariance_R_v_p * A.transpose() +
+                       (gyro_noise_sigma_squared_ / dt) * B_gyro *
+                           B_gyro.transpose() +
+                       (acc_noise_sigma_squared_ / dt) * B_acc *
+                           B_acc.transpose();
+
+    // Bias Jacobians; the order of the updates matters as each one uses the
+    // values of the previous step.
+    pre.d_p_d_b_a += pre.d_v_d_b_a * dt - 0.5 * pre.delta_R * dt2;
+    pre.d_p_d_b_g +=
+        pre.d_v_d_b_g * dt - 0.5 * delta_R_acc_skew * pre.d_R_d_b_g * dt2;
+    pre.d_v_d_b_a -= pre.delta_R * dt;
+    pre.d_v_d_b_g -= delta_R_acc_skew * pre.d_R_d_b_g * dt;
+    pre.d_R_d_b_g = delta_R_step.transpose() * pre.d_R_d_b_g - J_r_step * dt;
+
+    // Preintegrated measurements.
+    pre.delta_p += pre.delta_v * dt + 0.5 * pre.delta_R * acc * dt2;
+    pre.delta_v += pre.delta_R * acc * dt;
+    pre.delta_R = pre.delta_R * delta_R_step;
+    pre.delta_t_seconds += dt;
+  }
+  CHECK_GT(pre.delta_t_seconds, 0.0);
+
+  // Assemble the covariance in the order of the error state.
+  using imu_integrator::kErrorStateOrientationOffset;
+  using imu_integrator::kErrorStateGyroBiasOffset;
+  using imu_integrator::kErrorStateVelocityOffset;
+  using imu_integrator::kErrorStateAccelBiasOffset;
+  using imu_integrator::kErrorStatePositionOffset;
+  const int kOffsets[] = {kErrorStateOrientationOffset,
+                          kErrorStateVelocityOffset, kErrorStatePositionOffset};
+  pre.covariance.setZero();
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 3; ++col) {
+      pre.covariance.block<3, 3>(kOffsets[row], kOffsets[col]) =
+          covariance_R_v_p.block<3, 3>(3 * row, 3 * col);
+    }
+  }
+  pre.covariance.block<3, 3>(
+      kErrorStateGyroBiasOffset, kErrorStateGyroBiasOffset) =
+      Eigen::Matrix3d::Identity() * gyro_bias_sigma_squared_ *
+      pre.delta_t_seconds;
+  pre.covariance.block<3, 3>(
+      kErrorStateAccelBiasOffset, kErrorStateAccelBiasOffset) =
+      Eigen::Matrix3d::Identity() * acc_bias_sigma_squared_ *
+      pre.delta_t_seconds;
+  pre.L_cholesky_covariance.compute(pre.covariance);
+  CHECK(pre.L_cholesky_covariance.info() == Eigen::Success);
+  pre.valid = true;
+}
+
+bool PreintegratedInertialErrorTerm::Evaluate(
+    double const* const* parameters, double* residuals_ptr,
+    double** jacobians) const {
+  enum {
+    kIdxPoseFrom,
+    kIdxGyroBiasFrom,
+    kIdxVelocityFrom,
+    kIdxAccBiasFrom,
+    kIdxPoseTo,
+    kIdxGyroBiasTo,
+    kIdxVelocityTo,
+    kIdxAccBiasTo
+  };
+  using imu_integrator::kErrorStateOrientationOffset;
+  using imu_integrator::kErrorStateGyroBiasOffset;
+  using imu_integrator::kErrorStateVelocityOffset;
+  using imu_integrator::kErrorStateAccelBiasOffset;
+  using imu_integrator::kErrorStatePositionOffset;
+
+  // Keep Jacobians in row-major for Ceres, Eigen default is column-major.
+  typedef Eigen::Matrix<double, imu_integrator::kErrorStateSize,
+                        imu_integrator::kGyroBiasBlockSize, Eigen::RowMajor>
+      GyroBiasJacobian;
+  typedef Eigen::Matrix<double, imu_integrator::kErrorStateSize,
+                        imu_integrator::kVelocityBlockSize, Eigen::RowMajor>
+      VelocityJacobian;
+  typedef Eigen::Matrix<double, imu_integrator::kErrorStateSize,
+                        imu_integrator::kAccelBiasBlockSize, Eigen::RowMajor>
+      AccelBiasJacobian;
+  typedef Eigen::Matrix<double, imu_integrator::kErrorStateSize,
+                        imu_integrator::kStatePoseBlockSize, Eigen::RowMajor>
+      PoseJacobian;
+
+  Eigen::Map<const Eigen::Vector4d> q_I_M_from(parameters[kIdxPoseFrom]);
+  Eigen::Map<const Eigen::Vector3d> p_M_I_from(
+      parameters[kIdxPoseFrom] + imu_integrator::kStateOrientationBlockSize);
+  Eigen::Map<const Eigen::Vector3d> b_g_from(parameters[kIdxGyroBiasFrom]);
+  Eigen::Map<const Eigen::Vector3d> v_M_from(parameters[kIdxVelocityFrom]);
+  Eigen::Map<const Eigen::Vector3d> b_a_from(parameters[kIdxAccBiasFrom]);
+
+  Eigen::Map<const Eigen::Vector4d> q_I_M_to(parameters[kIdxPoseTo]);
+  Eigen::Map<const Eigen::Vector3d> p_M_I_to(
+      parameters[kIdxPoseTo] + imu_integrator::kStateOrientationBlockSize);
+  Eigen::Map<const Eigen::Vector3d> b_g_to(parameters[kIdxGyroBiasTo]);
+  Eigen::Map<const Eigen::Vector3d> v_M_to(parameters[kIdxVelocityTo]);
+  Eigen::Map<const Eigen::Vector3d> b_a_to(parameters[kIdxAccBiasTo]);
+
+  // Only integrate again if the bias moved too far from the linearization
+  // point of the preintegration.
+  if (!preintegration_.valid ||
+      (b_g_from - preintegration_.b_g).norm() >
+          gyro_bias_reintegration_threshold_ ||
+      (b_a_from - preintegration_.b_a).norm() >
+          accel_bias_reintegration_threshold_) {
+    preintegrate(b_g_from, b_a_from, &preintegration_);
+    ++num_preintegrations_;
+  }
+  const ImuPreintegration& pre = preintegration_;
+  const Eigen::Vector3d delta_b_g = b_g_from - pre.b_g;
+  const Eigen::Vector3d delta_b_a = b_a_from - pre.b_a;
+  const double dt = pre.delta_t_seconds;
+
+  // The JPL quaternion parameterization perturbs R_M_I from the right.
+  Eigen::Matrix3d R_I_M_from, R_I_M_to;
+  common::toRotationMatrixJPL(q_I_M_from, &R_I_M_from);
+  common::toRotationMatrixJPL(q_I_M_to, &R_I_M_to);
+  const Eigen::Matrix3d& R_Ii_M = R_I_M_from;
+  const Eigen::Matrix3d R_M_Ij = R_I_M_to.transpose();
+
+  // Bias-corrected preintegrated measurements.
+  const Eigen::Vector3d delta_R_correction = pre.d_R_d_b_g * delta_b_g;
+  const Eigen::Matrix3d corrected_delta_R =
+      pre.delta_R * expSO3(delta_R_correction);
+  const Eigen::Vector3d corrected_delta_v =
+      pre.delta_v + pre.d_v_d_b_g * delta_b_g + pre.d_v_d_b_a * delta_b_a;
+  const Eigen::Vector3d corrected_delta_p =
+      pre.delta_p + pre.d_p_d_b_g * delta_b_g + pre.d_p_d_b_a * delta_b_a;
+
+  const Eigen::Matrix3d R_error =
+      corrected_delta_R.transpose() * R_Ii_M * R_M_Ij;
+  const Eigen::Vector3d error_R = logSO3(R_error);
+  const Eigen::Vector3d Ii_delta_v =
+      R_Ii_M * (v_M_to - v_M_from - gravity_M_ * dt);
+  const Eigen::Vector3d Ii_delta_p =
+      R_Ii_M * (p_M_I_to - p_M_I_from - v_M_from * dt -
+                0.5 * gravity_M_ * dt * dt);
+
+  if (residuals_ptr) {
+    Eigen::Map<Eigen::Matrix<double, imu_integrator::kErrorStateSize, 1> >
+        residuals(residuals_ptr);
+    residuals.segment<3>(kErrorStateOrientationOffset) = error_R;
+    residuals.segment<3>(kErrorStateGyroBiasOffset) = b_g_to - b_g_from;
+    residuals.segment<3>(kErrorStateVelocityOffset) =
+        Ii_delta_v - corrected_delta_v;
+    residuals.segment<3>(kErrorStateAccelBiasOffset) = b_a_to - b_a_from;
+    residuals.segment<3>(kErrorStatePositionOffset) =
+        Ii_delta_p - corrected_delta_p;
+    pre.L_cholesky_covariance.matrixL().solveInPlace(residuals);
+  } else {
+    LOG(WARNING)
+        << "Skipped residual calculation, since residual pointer was NULL";
+  }
+
+  if (jacobians == NULL) {
+    return true;
+  }
+
+  // Jacobians w.r.t. the error state of the begin and end keyframe.
+  const Eigen::Matrix3d J_r_inv_error =
+      rightJacobianSO3(error_R).inverse();
+  InertialStateCovariance J_begin;
+  J_begin.setZero();
+  J_begin.block<3, 3>(
+      kErrorStateOrientationOffset, kErrorStateOrientationOffset) =
+      -J_r_inv_error * R_M_Ij.transpose() * R_Ii_M.transpose();
+  J_begin.block<3, 3>(kErrorStateOrientationOffset, kErrorStateGyroBiasOffset) =
+      -J_r_inv_error * R_error.transpose() *
+      rightJacobianSO3(delta_R_correction) * pre.d_R_d_b_g;
+  J_begin.block<3, 3>(kErrorStateGyroBiasOffset, kErrorStateGyroBiasOffset) =
+      -Eigen::Matrix3d::Identity();
+  J_begin.block<3, 3>(kErrorStateVelocityOffset, kErrorStateOrientationOffset) =
+      common::skew(Ii_delta_v);
+  J_begin.block<3, 3>(kErrorStateVelocityOffset, kErrorStateGyroBiasOffset) =
+      -pre.d_v_d_b_g;
+  J_begin.block<3, 3>(kErrorStateVelocityOffset, kErrorStateVelocityOffset) =
+      -R_Ii_M;
+  J_begin.block<3, 3>(kErrorStateVelocityOffset, kErrorStateAccelBiasOffset) =
+      -pre.d_v_d_b_a;
+  J_begin.block<3, 3>(kErrorStateAccelBiasOffset, kErrorStateAccelBiasOffset) =
+      -Eigen::Matrix3d::Identity();
+  J_begin.block<3, 3>(kErrorStatePositionOffset, kErrorStateOrientationOffset) =
+      common::skew(Ii_delta_p);
+  J_begin.block<3, 3>(kErrorStatePositionOffset, kErrorStateGyroBiasOffset) =
+      -pre.d_p_d_b_g;
+  J_begin.block<3, 3>(kErrorStatePositionOffset, kErrorStateVelocityOffset) =
+      -R_Ii_M * dt;
+  J_begin.block<3, 3>(kErrorStatePositionOffset, kErrorStateAccelBiasOffset) =
+      -pre.d_p_d_b_a;
+  J_begin.block<3, 3>(kErrorStatePositionOffset, kErrorStatePositionOffset) =
+      -R_Ii_M;
+
+  InertialStateCovariance J_end;
+  J_end.setZero();
+  J_end.block<3, 3>(
+      kErrorStateOrientationOffset, kErrorStateOrientationOffset) =
+      J_r_inv_error;
+  J_end.block<3, 3>(kErrorStateGyroBiasOffset, kErrorStateGyroBiasOffset) =
+      Eigen::Matrix3d::Identity();
+  J_end.block<3, 3>(kErrorStateVelocityOffset, kErrorStateVelocityOffset) =
+      R_Ii_M;
+  J_end.block<3, 3>(kErrorStateAccelBiasOffset, kErrorStateAccelBiasOffset) =
+      Eigen::Matrix3d::Identity();
+  J_end.block<3, 3>(kErrorStatePositionOffset, kErrorStatePositionOffset) =
+      R_Ii_M;
+
+  pre.L_cholesky_covariance.matrixL().solveInPlace(J_begin);
+  pre.L_cholesky_covariance.matrixL().solveInPlace(J_end);
+
+  // Since Ceres separates the actual Jacobian from the Jacobian of the local
+  // parameterization, we apply the pseudo-inverse of the local
+  // parameterization Jacobian to the Jacobian w.r.t. the rotation error.
+  JplQuaternionParameterization parameterization;
+  Eigen::Matrix<double, 4, 3, Eigen::RowMajor> theta_local_begin;
+  Eigen::Matrix<double, 4, 3, Eigen::RowMajor> theta_local_end;
+  parameterization.ComputeJacobian(q_I_M_from.data(), theta_local_begin.data());
+  parameterization.ComputeJacobian(q_I_M_to.data(), theta_local_end.data());
+
+  if (jacobians[kIdxPoseFrom] != NULL) {
+    Eigen::Map<PoseJacobian> J(jacobians[kIdxPoseFrom]);
+    J.leftCols<imu_integrator::kStateOrientationBlockSize>() =
+        4.0 *
+        J_begin.middleCols<imu_integrator::kErrorOrientationBlockSize>(
+            kErrorStateOrientationOffset) *
+        theta_local_begin.transpose();
+    J.rightCols<imu_integrator::kPositionBlockSize>() =
+        J_begin.middleCols<imu_integrator::kPositionBlockSize>(
+            kErrorStatePositionOffset);
+  }
+  if (jacobians[kIdxGyroBiasFrom] != NULL) {
+    Eigen::Map<GyroBiasJacobian> J(jacobians[kIdxGyroBiasFrom]);
+    J = J_begin.middleCols<imu_integrator::kGyroBiasBlockSize>(
+        kErrorStateGyroBiasOffset);
+  }
+  if (jacobians[kIdxVelocityFrom] != NULL) {
+    Eigen::Map<VelocityJacobian> J(jacobians[kIdxVelocityFrom]);
+    J = J_begin.middleCols<imu_integrator::kVelocityBlockSize>(
+        kErrorStateVelocityOffset);
+  }
+  if (jacobians[kIdxAccBiasFrom] != NULL) {
+    Eigen::Map<AccelBiasJacobian> J(jacobians[kIdxAccBiasFrom]);
+    J = J_begin.middleCols<imu_integrator::kAccelBiasBlockSize>(
+        kErrorStateAccelBiasOffset);
+  }
+
+  if (jacobians[kIdxPoseTo] != NULL) {
+    Eigen::Map<PoseJacobian> J(jacobians[kIdxPoseTo]);
+    J.leftCols<imu_integrator::kStateOrientationBlockSize>() =
+        4.0 *
+        J_end.middleCols<imu_integrator::kErrorOrientationBlockSize>(
+            kErrorStateOrientationOffset) *
+        theta_local_end.transpose();
+    J.rightCols<imu_integrator::kPositionBlockSize>() =
+        J_end.middleCols<imu_integrator::kPositionBlockSize>(
+            kErrorStatePositionOffset);
+  }
+  if (jacobians[kIdxGyroBiasTo] != NULL) {
+    Eigen::Map<GyroBiasJacobian> J(jacobians[kIdxGyroBiasTo]);
+    J = J_end.middleCols<imu_integrator::kGyroBiasBlockSize>(
+        kErrorStateGyroBiasOffset);
+  }
+  if (jacobians[kIdxVelocityTo] != NULL) {
+    Eigen::Map<VelocityJacobian> J(jacobians[kIdxVelocityTo]);
+    J = J_end.middleCols<imu_integrator::kVelocityBlockSize>(
+        kErrorStateVelocityOffset);
+  }
+  if (jacobians[kIdxAccBiasTo] != NULL) {
+    Eigen::Map<AccelBiasJacobian> J(jacobians[kIdxAccBiasTo]);
+    J = J_end.middleCols<imu_integrator::kAccelBiasBlockSize>(
+        kErrorStateAccelBiasOffset);
+  }
+  return true;
+}
+
+}  // namespace ceres_error_terms
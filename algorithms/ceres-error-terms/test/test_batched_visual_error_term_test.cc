@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <aslam/cameras/camera-pinhole.h>
+#include <aslam/cameras/distortion-radtan.h>
+#include <ceres/ceres.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/quaternion-math.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "ceres-error-terms/batched-visual-error-term.h"
+#include "ceres-error-terms/parameterization/quaternion-param-jpl.h"
+#include "ceres-error-terms/visual-error-term.h"
+
+namespace ceres_error_terms {
+
+class BatchedVisualErrorTermTest : public ::testing::Test {
+ protected:
+  typedef aslam::PinholeCamera CameraType;
+  typedef aslam::RadTanDistortion DistortionType;
+  typedef VisualReprojectionError<CameraType, DistortionType> ErrorTerm;
+  typedef Eigen::Matrix<double, 7, 1> PoseBlock;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      RowMajorMatrix;
+
+  static constexpr size_t kNumObserverPoses = 4u;
+  static constexpr double kPixelSigma = 0.8;
+
+  struct Observation {
+    visual::VisualErrorType error_term_type;
+    double* observer_pose;
+    double* observer_mission_base_pose;
+    Eigen::Vector2d measurement;
+  };
+
+  virtual void SetUp() {
+    Eigen::VectorXd distortion_parameters(4);
+    distortion_parameters << 0.02, -0.01, 0.001, 0.002;
+    aslam::Distortion::UniquePtr distortion(
+        new DistortionType(distortion_parameters));
+    Eigen::VectorXd intrinsics(4);
+    intrinsics << 300.0, 310.0, 320.0, 240.0;
+    camera_.reset(new CameraType(intrinsics, 640, 480, distortion));
+
+    landmark_position_ << 0.1, -0.2, 5.0;
+    landmark_base_pose_ = makePose(Eigen::Vector3d(0.02, -0.01, 0.03),
+                                   Eigen::Vector3d(0.1, 0.2, -0.1));
+    landmark_mission_base_pose_ = makePose(
+        Eigen::Vector3d(-0.01, 0.02, 0.05), Eigen::Vector3d(1.0, -0.5, 0.2));
+    observer_mission_base_pose_ = makePose(
+        Eigen::Vector3d(0.03, 0.01, -0.04), Eigen::Vector3d(0.8, -0.3, 0.1));
+    for (size_t i = 0u; i < kNumObserverPoses; ++i) {
+      const double offset = 0.1 * static_cast<double>(i);
+      observer_poses_.push_back(makePose(
+          Eigen::Vector3d(0.01 + 0.5 * offset, -0.02, offset),
+          Eigen::Vector3d(offset, -offset, 0.3 * offset)));
+    }
+    const PoseBlock camera_to_imu = makePose(
+        Eigen::Vector3d(0.01, 0.02, -0.01), Eigen::Vector3d(0.05, 0.0, 0.02));
+    camera_q_C_I_ = camera_to_imu.head<4>();
+    camera_p_C_I_ = camera_to_imu.tail<3>();
+    dummy_pose_ = makePose(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero());
+
+    addObservation(visual::VisualErrorType::kLocalKeyframe, nullptr, nullptr);
+    addObservation(
+        visual::VisualErrorType::kLocalMission, observer_poses_[0].data(),
+        nullptr);
+    addObservation(
+        visual::VisualErrorType::kLocalMission, observer_poses_[1].data(),
+        nullptr);
+    addObservation(
+        visual::VisualErrorType::kGlobal, observer_poses_[2].data(),
+        observer_mission_base_pose_.data());
+    addObservation(
+        visual::VisualErrorType::kGlobal, observer_poses_[3].data(),
+        observer_mission_base_pose_.data());
+  }
+
+  static PoseBlock makePose(
+      const Eigen::Vector3d& rotation_vector, const Eigen::Vector3d& position) {
+    const Eigen::Matrix3d R(Eigen::AngleAxisd(
+        rotation_vector.norm(), rotation_vector.normalized()));
+    Eigen::Vector4d q_JPL;
+    common::fromRotationMatrixJPL(R, &q_JPL);
+    if (q_JPL(3) < 0.0) {
+      q_JPL = -q_JPL;
+    }
+    PoseBlock pose;
+    pose << q_JPL, position;
+    return pose;
+  }
+
+  // Arguments of the individual error term in the order of its parameter
+  // blocks, unused blocks are replaced by a dummy pose.
+  std::vector<double*> getErrorTermArguments(const Observation& observation) {
+    std::vector<double*> arguments = {
+        landmark_position_.data(),
+        landmark_base_pose_.data(),
+        landmark_mission_base_pose_.data(),
+        observation.observer_mission_base_pose,
+        observation.observer_pose,
+        camera_q_C_I_.data(),
+        camera_p_C_I_.data(),
+        camera_->getParametersMutable(),
+        camera_->getDistortionMutable()->getParametersMutable()};
+    if (observation.error_term_type != visual::VisualErrorType::kGlobal) {
+      arguments[2] = dummy_pose_.data();
+      arguments[3] = dummy_pose_.data();
+    }
+    if (observation.error_term_type ==
+        visual::VisualErrorType::kLocalKeyframe) {
+      arguments[1] = dummy_pose_.data();
+      arguments[4] = dummy_pose_.data();
+    }
+    return arguments;
+  }
+
+  // The measurement is the noise-free projection shifted by a small offset.
+  void addObservation(
+      const visual::VisualErrorType error_term_type, double* observer_pose,
+      double* observer_mission_base_pose) {
+    Observation observation;
+    observation.error_term_type = error_term_type;
+    observation.observer_pose = observer_pose;
+    observation.observer_mission_base_pose = observer_mission_base_pose;
+
+    const ErrorTerm error_term(
+        Eigen::Vector2d::Zero(), kPixelSigma, error_term_type, camera_.get());
+    const std::vector<double*> arguments = getErrorTermArguments(observation);
+    Eigen::Vector2d residual;
+    error_term.Evaluate(arguments.data(), residual.data(), nullptr);
+    const double offset = 0.5 * static_cast<double>(observations_.size());
+    observation.measurement =
+        residual * kPixelSigma + Eigen::Vector2d(offset, -offset);
+    observations_.push_back(observation);
+  }
+
+  std::unique_ptr<BatchedVisualCostFunction> createBatchedCostFunction(
+      const double huber_loss_threshold) {
+    std::unique_ptr<BatchedVisualCostFunction> cost_function(
+        createBatchedVisualCostFunction(
+            *camera_, landmark_position_.data(), landmark_base_pose_.data(),
+            landmark_mission_base_pose_.data()));
+    for (const Observation& observation : observations_) {
+      BatchedVisualCostFunction::ObservationParameterBlocks blocks;
+      blocks.observer_mission_base_pose =
+          observation.observer_mission_base_pose;
+      blocks.observer_pose = observation.observer_pose;
+      blocks.camera_to_imu_orientation = camera_q_C_I_.data();
+      blocks.camera_to_imu_position = camera_p_C_I_.data();
+      blocks.camera_intrinsics = camera_->getParametersMutable();
+      blocks.camera_distortion =
+          camera_->getDistortionMutable()->getParametersMutable();
+      cost_function->addObservation(
+          observation.measurement, kPixelSigma, huber_loss_threshold,
+          observation.error_term_type, *camera_, blocks);
+    }
+    return cost_function;
+  }
+
+  void evaluate(
+      const BatchedVisualCostFunction& cost_function,
+      Eigen::VectorXd* residuals,
+      std::vector<RowMajorMatrix>* jacobians) const {
+    const std::vector<double*>& blocks = cost_function.getParameterBlocks();
+    residuals->resize(cost_function.num_residuals());
+    std::vector<double*> jacobian_ptrs;
+    if (jacobians != nullptr) {
+      jacobians->clear();
+      for (size_t i = 0u; i < blocks.size(); ++i) {
+        jacobians->emplace_back(
+            cost_function.num_residuals(),
+            cost_function.parameter_block_sizes()[i]);
+        jacobians->back().setConstant(
+            std::numeric_limits<double>::quiet_NaN());
+        jacobian_ptrs.push_back(jacobians->back().data());
+      }
+    }
+    ASSERT_TRUE(cost_function.Evaluate(
+        blocks.data(), residuals->data(),
+        jacobians != nullptr ? jacobian_ptrs.data() : nullptr));
+  }
+
+  std::shared_ptr<CameraType> camera_;
+  Eigen::Vector3d landmark_position_;
+  PoseBlock landmark_base_pose_;
+  PoseBlock landmark_mission_base_pose_;
+  PoseBlock observer_mission_base_pose_;
+  std::vector<PoseBlock, Eigen::aligned_allocator<PoseBlock>> observer_poses_;
+  Eigen::Vector4d camera_q_C_I_;
+  Eigen::Vector3d camera_p_C_I_;
+  PoseBlock dummy_pose_;
+
+  std::vector<Observation, Eigen::aligned_allocator<Observation>>
+      observations_;
+};
+
+TEST_F(BatchedVisualErrorTermTest, ParameterBlocksAreShared) {
+  constexpr double kNoHuberLoss = 0.0;
+  const std::unique_ptr<BatchedVisualCostFunction> cost_function =
+      createBatchedCostFunction(kNoHuberLoss);
+
+  EXPECT_EQ(cost_function->numObservations(), observations_.size());
+  EXPECT_EQ(
+      cost_function->num_residuals(),
+      static_cast<int>(visual::kResidualSize * observations_.size()));
+  // Landmark position, landmark base pose, landmark mission base pose, the
+  // observer mission base pose, the observer poses, the camera extrinsics
+  // orientation, position, intrinsics and distortion.
+  const std::vector<double*>& blocks = cost_function->getParameterBlocks();
+  EXPECT_EQ(blocks.size(), 4u + kNumObserverPoses + 4u);
+  EXPECT_EQ(blocks[0], landmark_position_.data());
+  EXPECT_EQ(
+      blocks.size(), cost_function->parameter_block_sizes().size());
+  EXPECT_EQ(
+      std::find(blocks.begin(), blocks.end(), dummy_pose_.data()),
+      blocks.end());
+}
+
+TEST_F(BatchedVisualErrorTermTest, MatchesIndividualErrorTerms) {
+  constexpr double kNoHuberLoss = 0.0;
+  const std::unique_ptr<BatchedVisualCostFunction> cost_function =
+      createBatchedCostFunction(kNoHuberLoss);
+  const std::vector<double*>& blocks = cost_function->getParameterBlocks();
+
+  Eigen::VectorXd batched_residuals;
+  std::vector<RowMajorMatrix> batched_jacobians;
+  evaluate(*cost_function, &batched_residuals, &batched_jacobians);
+
+  constexpr double kPrecision = 1e-9;
+  for (size_t observation_idx = 0u; observation_idx < observations_.size();
+       ++observation_idx) {
+    const Observation& observation = observations_[observation_idx];
+    const int row = static_cast<int>(observation_idx) * visual::kResidualSize;
+    const ErrorTerm error_term(
+        observation.measurement, kPixelSigma, observation.error_term_type,
+        camera_.get());
+    const std::vector<double*> arguments = getErrorTermArguments(observation);
+    const std::vector<int32_t>& sizes = error_term.parameter_block_sizes();
+
+    Eigen::Vector2d residual;
+    std::vector<RowMajorMatrix> jacobians;
+    std::vector<double*> jacobian_ptrs;
+    for (size_t i = 0u; i < sizes.size(); ++i) {
+      jacobians.emplace_back(visual::kResidualSize, sizes[i]);
+    }
+    for (RowMajorMatrix& jacobian : jacobians) {
+      jacobian_ptrs.push_back(jacobian.data());
+    }
+    error_term.Evaluate(
+        arguments.data(), residual.data(), jacobian_ptrs.data());
+
+    EXPECT_NEAR(
+        (batched_residuals.segment<2>(row) - residual).norm(), 0.0,
+        kPrecision);
+
+    std::vector<bool> is_block_used(blocks.size(), false);
+    for (size_t arg_idx = 0u; arg_idx < arguments.size(); ++arg_idx) {
+      if (arguments[arg_idx] == dummy_pose_.data()) {
+        continue;
+      }
+      const size_t block_idx =
+          std::find(blocks.begin(), blocks.end(), arguments[arg_idx]) -
+          blocks.begin();
+      ASSERT_LT(block_idx, blocks.size());
+      is_block_used[block_idx] = true;
+      EXPECT_NEAR(
+          (batched_jacobians[block_idx].middleRows(
+               row, visual::kResidualSize) -
+           jacobians[arg_idx])
+              .norm(),
+          0.0, kPrecision)
+          << "Jacobian of block " << arg_idx << " of observation "
+          << observation_idx;
+    }
+    for (size_t block_idx = 0u; block_idx < blocks.size(); ++block_idx) {
+      if (!is_block_used[block_idx]) {
+        EXPECT_EQ(
+            batched_jacobians[block_idx]
+                .middleRows(row, visual::kResidualSize)
+                .norm(),
+            0.0);
+      }
+    }
+  }
+}
+
+TEST_F(BatchedVisualErrorTermTest, HuberLossIsAppliedPerObservation) {
+  // Like VisualReprojectionError, the Jacobians w.r.t. the orientations of the
+  // camera extrinsics and of the mission baseframes are evaluated at the
+  // landmark position, which is only exact for zero translations.
+  camera_p_C_I_.setZero();
+  landmark_mission_base_pose_.tail<3>().setZero();
+  observer_mission_base_pose_.tail<3>().setZero();
+
+  // Turn the last observation into an outlier.
+  observations_.back().measurement += Eigen::Vector2d(40.0, -25.0);
+
+  constexpr double kHuberLossThreshold = 3.0;
+  const std::unique_ptr<BatchedVisualCostFunction> cost_function =
+      createBatchedCostFunction(kHuberLossThreshold);
+  const std::vector<double*>& blocks = cost_function->getParameterBlocks();
+
+  Eigen::VectorXd batched_residuals;
+  std::vector<RowMajorMatrix> batched_jacobians;
+  evaluate(*cost_function, &batched_residuals, &batched_jacobians);
+
+  // The squared norm of the residuals of every observation is the Huber cost
+  // of the unweighted residual.
+  bool has_outlier = false;
+  for (size_t observation_idx = 0u; observation_idx < observations_.size();
+       ++observation_idx) {
+    const Observation& observation = observations_[observation_idx];
+    const ErrorTerm error_term(
+        observation.measurement, kPixelSigma, observation.error_term_type,
+        camera_.get());
+    const std::vector<double*> arguments = getErrorTermArguments(observation);
+    Eigen::Vector2d residual;
+    error_term.Evaluate(arguments.data(), residual.data(), nullptr);
+
+    double rho[3];
+    ceres::HuberLoss(kHuberLossThreshold).Evaluate(residual.squaredNorm(), rho);
+    has_outlier |= (rho[0] < residual.squaredNorm());
+    EXPECT_NEAR(
+        batched_residuals
+            .segment<2>(observation_idx * visual::kResidualSize)
+            .squaredNorm(),
+        rho[0], 1e-9);
+  }
+  EXPECT_TRUE(has_outlier);
+
+  // Compare the Jacobians with numerical derivatives in the tangent space.
+  const JplQuaternionParameterization quaternion_parameterization;
+  constexpr double kDelta = 1e-6;
+  for (size_t block_idx = 0u; block_idx < blocks.size(); ++block_idx) {
+    double* block = blocks[block_idx];
+    const int block_size = cost_function->parameter_block_sizes()[block_idx];
+    const bool has_quaternion =
+        (block_size == visual::kPoseBlockSize || block == camera_q_C_I_.data());
+    const int local_size = has_quaternion ? block_size - 1 : block_size;
+
+    // Jacobian of the ambient w.r.t. the tangent space.
+    RowMajorMatrix J_plus = RowMajorMatrix::Zero(block_size, local_size);
+    if (has_quaternion) {
+      Eigen::Matrix<double, 4, 3, Eigen::RowMajor> J_quaternion;
+      quaternion_parameterization.ComputeJacobian(block, J_quaternion.data());
+      J_plus.topLeftCorner<4, 3>() = J_quaternion;
+      J_plus.bottomRightCorner(block_size - 4, local_size - 3).setIdentity();
+    } else {
+      J_plus.setIdentity();
+    }
+    const RowMajorMatrix J_analytical = batched_jacobians[block_idx] * J_plus;
+
+    const Eigen::VectorXd original_block =
+        Eigen::Map<Eigen::VectorXd>(block, block_size);
+    for (int local_idx = 0; local_idx < local_size; ++local_idx) {
+      Eigen::VectorXd residuals_plus, residuals_minus;
+      for (const double sign : {1.0, -1.0}) {
+        Eigen::VectorXd delta = Eigen::VectorXd::Zero(local_size);
+        delta(local_idx) = sign * kDelta;
+        Eigen::Map<Eigen::VectorXd> block_map(block, block_size);
+        block_map = original_block;
+        if (has_quaternion) {
+          quaternion_parameterization.Plus(
+              original_block.data(), delta.data(), block);
+          block_map.tail(block_size - 4) += delta.tail(local_size - 3);
+        } else {
+          block_map += delta;
+        }
+        evaluate(
+            *cost_function, sign > 0.0 ? &residuals_plus : &residuals_minus,
+            nullptr);
+        block_map = original_block;
+      }
+      const Eigen::VectorXd J_numerical =
+          (residuals_plus - residuals_minus) / (2.0 * kDelta);
+      EXPECT_LT(
+          (J_numerical - J_analytical.col(local_idx)).norm(),
+          1e-4 * std::max(1.0, J_numerical.norm()))
+          << "Block " << block_idx << ", tangent dimension " << local_idx;
+    }
+  }
+}
+
+}  // namespace ceres_error_terms
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,298 @@
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <ceres/ceres.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <ceres-error-terms/parameterization/pose-param-jpl.h>
+#include <ceres-error-terms/preintegrated-inertial-error-term.h>
+#include <maplab-common/gravity-provider.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <maplab-common/test/testing-predicates.h>
+
+using ceres_error_terms::PreintegratedInertialErrorTerm;
+
+class PreintegratedInertialErrorTermTest : public ::testing::Test {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ protected:
+  virtual void SetUp() {
+    rot0_.coeffs() << 0, 0, 0, 1;
+    rot1_.coeffs() << 0, 0, 0, 1;
+    pos0_ << 0, 0, 0;
+    pos1_ << 1.5, 0, 0;
+
+    accel_bias0_ << 0, 0, 0;
+    accel_bias1_ << 0, 0, 0;
+    gyro_bias0_ << 0, 0, 0;
+    gyro_bias1_ << 0, 0, 0;
+
+    velocity0_ << 1, 0, 0;
+    velocity1_ << 2, 0, 0;
+
+    common::GravityProvider gravity_provider(
+        common::locations::kAltitudeZurichMeters,
+        common::locations::kLatitudeZurichDegrees);
+    gravity_magnitude_ = gravity_provider.getGravityMagnitude();
+
+    imu_timestamps_ << 0, 0.5 * 1e9, 1.0 * 1e9;
+    imu_data_ << 1, 1, 1, 0, 0, 0, gravity_magnitude_, gravity_magnitude_,
+        gravity_magnitude_, 0, 0, 0, 0, 0, 0, 0, 0, 0;
+  }
+
+  void addResidual();
+  void solve();
+
+  std::vector<double*> getParameterBlocks() {
+    return {pose0_.data(),     gyro_bias0_.data(), velocity0_.data(),
+            accel_bias0_.data(), pose1_.data(),    gyro_bias1_.data(),
+            velocity1_.data(), accel_bias1_.data()};
+  }
+
+  ceres::Problem problem_;
+  ceres::Solver::Summary summary_;
+  PreintegratedInertialErrorTerm* inertial_term_cost_;
+
+  Eigen::Matrix<int64_t, 1, 3> imu_timestamps_;
+  Eigen::Matrix<double, 6, 3> imu_data_;
+
+  Eigen::Quaterniond rot0_;
+  Eigen::Quaterniond rot1_;
+  Eigen::Vector3d pos0_;
+  Eigen::Vector3d pos1_;
+  Eigen::Matrix<double, 7, 1> pose0_;
+  Eigen::Matrix<double, 7, 1> pose1_;
+
+  Eigen::Vector3d accel_bias0_;
+  Eigen::Vector3d accel_bias1_;
+  Eigen::Vector3d gyro_bias0_;
+  Eigen::Vector3d gyro_bias1_;
+  Eigen::Vector3d velocity0_;
+  Eigen::Vector3d velocity1_;
+
+  double gravity_magnitude_;
+};
+
+void PreintegratedInertialErrorTermTest::addResidual() {
+  rot0_.normalize();
+  rot1_.normalize();
+  pose0_ << rot0_.coeffs(), pos0_;
+  pose1_ << rot1_.coeffs(), pos1_;
+
+  inertial_term_cost_ = new PreintegratedInertialErrorTerm(
+      imu_data_, imu_timestamps_, 1, 1, 1, 1, gravity_magnitude_);
+
+  problem_.AddResidualBlock(
+      inertial_term_cost_, NULL, pose0_.data(), gyro_bias0_.data(),
+      velocity0_.data(), accel_bias0_.data(), pose1_.data(), gyro_bias1_.data(),
+      velocity1_.data(), accel_bias1_.data());
+
+  ceres::LocalParameterization* pose_parameterization =
+      new ceres_error_terms::JplPoseParameterization;
+  problem_.SetParameterization(pose0_.data(), pose_parameterization);
+  problem_.SetParameterization(pose1_.data(), pose_parameterization);
+}
+
+void PreintegratedInertialErrorTermTest::solve() {
+  ceres::Solver::Options options;
+  options.linear_solver_type = ceres::DENSE_SCHUR;
+  options.minimizer_progress_to_stdout = false;
+  options.max_num_iterations = 500;
+  options.gradient_tolerance = 1e-50;
+  options.function_tolerance = 1e-50;
+  options.parameter_tolerance = 1e-50;
+
+  ceres::Solve(options, &problem_, &summary_);
+
+  LOG(INFO) << summary_.message;
+  LOG(INFO) << summary_.BriefReport();
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, ZeroCost) {
+  addResidual();
+  solve();
+
+  EXPECT_LT(summary_.final_cost, 1e-15);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, FinalPositionOptimization) {
+  pos1_ << 1.43, -0.2, 0.175;
+  addResidual();
+
+  problem_.SetParameterBlockConstant(gyro_bias0_.data());
+  problem_.SetParameterBlockConstant(accel_bias0_.data());
+  problem_.SetParameterBlockConstant(gyro_bias1_.data());
+  problem_.SetParameterBlockConstant(accel_bias1_.data());
+  problem_.SetParameterBlockConstant(velocity0_.data());
+  problem_.SetParameterBlockConstant(velocity1_.data());
+  problem_.SetParameterBlockConstant(pose0_.data());
+
+  solve();
+  EXPECT_NEAR_EIGEN(pose1_.tail(3), Eigen::Vector3d(1.5, 0, 0), 1e-12);
+  EXPECT_NEAR_EIGEN(pose1_.head(4), Eigen::Vector4d(0, 0, 0, 1), 1e-12);
+  EXPECT_LT(summary_.final_cost, 1e-15);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, FinalRotationOptimization) {
+  rot1_.coeffs() << 0.024225143749034013, 0.04470367401201076,
+      0.04242220263937102, 0.9978051316080664;
+  addResidual();
+
+  problem_.SetParameterBlockConstant(gyro_bias0_.data());
+  problem_.SetParameterBlockConstant(accel_bias0_.data());
+  problem_.SetParameterBlockConstant(gyro_bias1_.data());
+  problem_.SetParameterBlockConstant(accel_bias1_.data());
+  problem_.SetParameterBlockConstant(velocity0_.data());
+  problem_.SetParameterBlockConstant(velocity1_.data());
+  problem_.SetParameterBlockConstant(pose0_.data());
+
+  solve();
+  EXPECT_NEAR_EIGEN(pose1_.tail(3), pos1_, 1e-12);
+  EXPECT_NEAR_EIGEN(pose1_.head(4), Eigen::Vector4d(0, 0, 0, 1), 1e-12);
+  EXPECT_LT(summary_.final_cost, 1e-15);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, StartPoseAndVelocityOptimization) {
+  pos0_ << 0.13, -0.2, 0.175;
+  rot0_.coeffs() << 0.024225143749034013, 0.04470367401201076,
+      0.04242220263937102, 0.9978051316080664;
+  velocity0_ << 1.1, -0.2, 0.1;
+  addResidual();
+
+  problem_.SetParameterBlockConstant(gyro_bias0_.data());
+  problem_.SetParameterBlockConstant(accel_bias0_.data());
+  problem_.SetParameterBlockConstant(gyro_bias1_.data());
+  problem_.SetParameterBlockConstant(accel_bias1_.data());
+  problem_.SetParameterBlockConstant(velocity1_.data());
+  problem_.SetParameterBlockConstant(pose1_.data());
+
+  solve();
+  EXPECT_ZERO_EIGEN(pose0_.tail(3), 1e-12);
+  EXPECT_NEAR_EIGEN(pose0_.head(4), Eigen::Vector4d(0, 0, 0, 1), 1e-12);
+  EXPECT_NEAR_EIGEN(velocity0_, Eigen::Vector3d(1, 0, 0), 1e-12);
+  EXPECT_LT(summary_.final_cost, 1e-15);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, StartAccelBiasOptimization) {
+  accel_bias0_ << 0.1, -0.2, 0.1;
+  accel_bias1_ = accel_bias0_;
+  addResidual();
+
+  problem_.SetParameterBlockConstant(gyro_bias0_.data());
+  problem_.SetParameterBlockConstant(gyro_bias1_.data());
+  problem_.SetParameterBlockConstant(velocity0_.data());
+  problem_.SetParameterBlockConstant(velocity1_.data());
+  problem_.SetParameterBlockConstant(pose0_.data());
+  problem_.SetParameterBlockConstant(pose1_.data());
+
+  solve();
+  EXPECT_ZERO_EIGEN(accel_bias0_, 1e-12);
+  EXPECT_ZERO_EIGEN(accel_bias1_, 1e-12);
+  EXPECT_LT(summary_.final_cost, 1e-15);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, SmallBiasChangesDontReintegrate) {
+  addResidual();
+  std::vector<double*> parameters = getParameterBlocks();
+  Eigen::Matrix<double, imu_integrator::kErrorStateSize, 1> residuals;
+
+  ASSERT_TRUE(
+      inertial_term_cost_->Evaluate(parameters.data(), residuals.data(), NULL));
+  EXPECT_EQ(inertial_term_cost_->getNumPreintegrations(), 1u);
+
+  gyro_bias0_ << 1e-3, -1e-3, 1e-3;
+  accel_bias0_ << 1e-2, 1e-2, -1e-2;
+  ASSERT_TRUE(
+      inertial_term_cost_->Evaluate(parameters.data(), residuals.data(), NULL));
+  EXPECT_EQ(inertial_term_cost_->getNumPreintegrations(), 1u);
+
+  gyro_bias0_ << 0.1, 0.0, 0.0;
+  ASSERT_TRUE(
+      inertial_term_cost_->Evaluate(parameters.data(), residuals.data(), NULL));
+  EXPECT_EQ(inertial_term_cost_->getNumPreintegrations(), 2u);
+}
+
+TEST_F(PreintegratedInertialErrorTermTest, JacobiansMatchNumericDifferentiation) {
+  // Use a rotating IMU and a generic state.
+  imu_data_.bottomRows<3>() << 0.1, 0.2, 0.3, -0.2, -0.1, 0.0, 0.3, 0.3, 0.2;
+  rot1_.coeffs() << 0.024225143749034013, 0.04470367401201076,
+      0.04242220263937102, 0.9978051316080664;
+  pos1_ << 1.43, -0.2, 0.175;
+  velocity0_ << 1.1, -0.2, 0.1;
+  gyro_bias0_ << 1e-3, -2e-3, 3e-3;
+  accel_bias0_ << 1e-2, 2e-2, -1e-2;
+  addResidual();
+
+  // Evaluate once to fix the linearization point of the biases.
+  std::vector<double*> parameters = getParameterBlocks();
+  typedef Eigen::Matrix<double, imu_integrator::kErrorStateSize, 1> Residuals;
+  Residuals residuals;
+  ASSERT_TRUE(
+      inertial_term_cost_->Evaluate(parameters.data(), residuals.data(), NULL));
+  gyro_bias0_ += Eigen::Vector3d(2e-3, 1e-3, -1e-3);
+  accel_bias0_ += Eigen::Vector3d(-1e-2, 1e-2, 2e-2);
+
+  ceres_error_terms::JplPoseParameterization pose_parameterization;
+  const std::vector<int32_t>& block_sizes =
+      inertial_term_cost_->parameter_block_sizes();
+  constexpr double kStep = 1e-6;
+  for (size_t block_idx = 0u; block_idx < parameters.size(); ++block_idx) {
+    const int block_size = block_sizes[block_idx];
+    const bool is_pose_block =
+        block_size == imu_integrator::kStatePoseBlockSize;
+    const int local_size = is_pose_block ? 6 : block_size;
+
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        jacobian(imu_integrator::kErrorStateSize, block_size);
+    std::vector<double*> jacobians(parameters.size(), nullptr);
+    jacobians[block_idx] = jacobian.data();
+    ASSERT_TRUE(
+        inertial_term_cost_->Evaluate(
+            parameters.data(), residuals.data(), jacobians.data()));
+
+    Eigen::MatrixXd local_jacobian = jacobian;
+    if (is_pose_block) {
+      Eigen::Matrix<double, 7, 6, Eigen::RowMajor> plus_jacobian;
+      pose_parameterization.ComputeJacobian(
+          parameters[block_idx], plus_jacobian.data());
+      local_jacobian = jacobian * plus_jacobian;
+    }
+
+    Eigen::MatrixXd numeric_jacobian(
+        imu_integrator::kErrorStateSize, local_size);
+    const Eigen::VectorXd original_block = Eigen::Map<const Eigen::VectorXd>(
+        parameters[block_idx], block_size);
+    for (int dim = 0; dim < local_size; ++dim) {
+      Eigen::VectorXd delta = Eigen::VectorXd::Zero(local_size);
+      Residuals residuals_plus, residuals_minus;
+      for (const double sign : {1.0, -1.0}) {
+        delta(dim) = sign * kStep;
+        Eigen::Map<Eigen::VectorXd> block(parameters[block_idx], block_size);
+        if (is_pose_block) {
+          Eigen::VectorXd perturbed_block(block_size);
+          pose_parameterization.Plus(
+              original_block.data(), delta.data(), perturbed_block.data());
+          block = perturbed_block;
+        } else {
+          block = original_block + delta;
+        }
+        ASSERT_TRUE(
+            inertial_term_cost_->Evaluate(
+                parameters.data(),
+                sign > 0.0 ? residuals_plus.data() : residuals_minus.data(),
+                NULL));
+        block = original_block;
+      }
+      numeric_jacobian.col(dim) =
+          (residuals_plus - residuals_minus) / (2.0 * kStep);
+    }
+    EXPECT_NEAR_EIGEN(local_jacobian, numeric_jacobian, 1e-5);
+  }
+}
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -34,6 +34,11 @@ namespace feature_tracking {
 /// already existing VIMap (i.e. with pose-graph, etc.).
 /// Visualization of keypoints, keypoint matches and feature tracks is
 /// available. See the flags at the top of the the source file.
+///
+/// The vertices of a mission are processed in a pipeline: the raw images of
+/// the next vertices are loaded and their features detected by a pool of
+/// workers while the current vertex is tracked. Tracking is sequential, the
+/// terminated feature tracks are collected and triangulated in batches.
 class FeatureTrackingPipeline {
  public:
   MAPLAB_POINTER_TYPEDEFS(FeatureTrackingPipeline);
@@ -66,16 +71,41 @@ class FeatureTrackingPipeline {
   virtual void trackFeaturesNFrame(
       const aslam::Transformation& T_Bk_Bkp1, aslam::VisualNFrame* nframe_k,
       aslam::VisualNFrame* nframe_kp1) = 0;
+  // Creates the detectors used by detectAndExtractFeaturesNFrame, one set for
+  // each detection worker.
+  virtual void initializeDetectionWorkers(const size_t num_workers) = 0;
+  // Detects keypoints and extracts descriptors in all frames of the given
+  // nframe. Called from the detection workers; calls with different
+  // detector_idx run concurrently, calls with the same index never do.
+  virtual void detectAndExtractFeaturesNFrame(
+      const size_t detector_idx, aslam::VisualNFrame* nframe) = 0;
 
   // Loads the raw-images specified in the resources table of the given map and
   // assigns them to the frames of the nframe of the given vertex.
   void assignRawImagesToNFrame(
       const pose_graph::VertexId& vertex_id, vi_map::VIMap* map) const;
 
-  // Looks for terminated feature tracks, triangulates them and adds them to the
-  // given map.
-  void extractAndTriangulateTerminatedFeatureTracks(
-      const aslam::VisualNFrame::ConstPtr& nframe, vi_map::VIMap* map);
+  // Assigns the raw images and detects new features on the given vertex. Runs
+  // on the detection workers, only touches the nframe of the given vertex.
+  void loadImagesAndDetectFeatures(
+      const size_t detector_idx, const pose_graph::VertexId& vertex_id,
+      vi_map::VIMap* map);
+
+  // Looks for terminated feature tracks and queues them for triangulation.
+  void extractTerminatedFeatureTracks(
+      const aslam::VisualNFrame::ConstPtr& nframe);
+
+  // Triangulates all queued feature tracks in parallel and adds the resulting
+  // landmarks to the given map.
+  void triangulateQueuedFeatureTracks(vi_map::VIMap* map);
+
+  // Triangulates the given track in the global frame. Returns false if the
+  // triangulation failed.
+  bool triangulateFeatureTrack(
+      const aslam::FeatureTrack& track, const vi_map::VIMap& map,
+      Eigen::Vector3d* G_landmark) const;
+  const pose_graph::VertexId& getVertexIdOfKeypoint(
+      const aslam::KeypointIdentifier& keypoint_identifier) const;
 
   aslam_cv_visualization::VisualNFrameFeatureTrackVisualizer
       feature_track_visualizer_;
@@ -86,6 +116,13 @@ class FeatureTrackingPipeline {
       NFrameIdToVertexIdMap;
   NFrameIdToVertexIdMap nframe_id_to_vertex_id_map_;
 
+  // Number of workers that load images and detect features ahead of the
+  // tracking.
+  const size_t num_detection_workers_;
+
+  // Terminated feature tracks waiting for triangulation.
+  aslam::FeatureTracks queued_feature_tracks_;
+
   bool processed_first_nframe_;
 
   statistics::Accumulator<size_t, size_t, statistics::kInfiniteWindowSize>
@@ -38,6 +38,9 @@ class VOFeatureTrackingPipeline : public FeatureTrackingPipeline {
   void trackFeaturesNFrame(
       const aslam::Transformation& T_Bk_Bkp1, aslam::VisualNFrame* nframe_k,
       aslam::VisualNFrame* nframe_kp1) override;
+  void initializeDetectionWorkers(const size_t num_workers) override;
+  void detectAndExtractFeaturesNFrame(
+      const size_t detector_idx, aslam::VisualNFrame* nframe) override;
 
   void trackFeaturesSingleCamera(
       const aslam::Quaternion& q_Bkp1_Bk, const size_t camera_idx,
@@ -49,6 +52,10 @@ class VOFeatureTrackingPipeline : public FeatureTrackingPipeline {
   /// Keypoint detector and descriptor extractors that detect keypoints in each
   /// frame and compute a descriptor for each one of them.
   std::vector<std::unique_ptr<FeatureDetectorExtractor>> detectors_extractors_;
+  /// Additional detectors and extractors for each worker that detects
+  /// features ahead of the tracking, indexed by [detector_idx][camera_idx].
+  std::vector<std::vector<std::unique_ptr<FeatureDetectorExtractor>>>
+      worker_detectors_extractors_;
   /// The actual frame-to-frame feature trackers that return a list of keypoint
   /// matches.
   std::vector<std::unique_ptr<aslam::FeatureTracker>> trackers_;
@@ -1,8 +1,14 @@
 #include "feature-tracking/feature-tracking-pipeline.h"
 
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+
 #include <aslam/cameras/camera.h>
 #include <aslam/common/pose-types.h>
 #include <aslam/common/statistics/statistics.h>
+#include <aslam/common/thread-pool.h>
 #include <aslam/common/timer.h>
 #include <aslam/frames/visual-frame.h>
 #include <aslam/frames/visual-nframe.h>
@@ -12,7 +18,9 @@
 #include <aslam/visualization/basic-visualization.h>
 #include <aslam/visualization/feature-track-visualizer.h>
 #include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/progress-bar.h>
+#include <maplab-common/threading-helpers.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <vi-map/check-map-consistency.h>
@@ -45,13 +53,32 @@ DEFINE_bool(
     "Flag indicating whether the map is checked for consistency after "
     "rerunning the feature tracking.");
 
+DEFINE_int32(
+    feature_tracker_num_detection_workers, 4,
+    "Number of threads that load the raw images and detect features ahead of "
+    "the feature tracking.");
+
+DEFINE_int32(
+    feature_tracker_detection_lookahead, 8,
+    "Maximum number of vertices whose raw images are loaded and whose "
+    "features are detected ahead of the feature tracking.");
+
+DEFINE_int32(
+    feature_tracker_triangulation_batch_size, 2000,
+    "Number of terminated feature tracks that are collected before they are "
+    "triangulated in parallel and added to the map.");
+
 namespace feature_tracking {
 
 FeatureTrackingPipeline::FeatureTrackingPipeline()
     : feature_tracking_ros_base_topic_("tracking/"),
       visualize_keypoint_matches_(
           FLAGS_feature_tracker_visualize_keypoint_matches),
-      processed_first_nframe_(false) {}
+      num_detection_workers_(
+          std::max(FLAGS_feature_tracker_num_detection_workers, 1)),
+      processed_first_nframe_(false) {
+  CHECK_GT(FLAGS_feature_tracker_triangulation_batch_size, 0);
+}
 
 void FeatureTrackingPipeline::runTrackingAndTriangulationForAllMissions(
     vi_map::VIMap* map) {
@@ -92,19 +119,31 @@ void FeatureTrackingPipeline::assignRawImagesToNFrame(
     CHECK(map->getRawImage(vertex, frame_idx, &image))
         << "Vertex " << vertex_id << " does not have a raw image for frame "
         << frame_idx;
-
-    if (FLAGS_feature_tracker_publish_raw_images) {
-      const std::string topic = feature_tracking_ros_base_topic_ +
-                                "camera_raw_" + std::to_string(frame_idx);
-      visualization::RVizVisualizationSink::publish(topic, image);
-    }
     nframe->getFrameShared(frame_idx)->setRawImage(image);
   }
 }
 
-void FeatureTrackingPipeline::extractAndTriangulateTerminatedFeatureTracks(
-    const aslam::VisualNFrame::ConstPtr& nframe, vi_map::VIMap* map) {
+void FeatureTrackingPipeline::loadImagesAndDetectFeatures(
+    const size_t detector_idx, const pose_graph::VertexId& vertex_id,
+    vi_map::VIMap* map) {
   CHECK_NOTNULL(map);
+  assignRawImagesToNFrame(vertex_id, map);
+  aslam::VisualNFrame::Ptr nframe =
+      map->getVertex(vertex_id).getVisualNFrameShared();
+  nframe->clearKeypointChannelsOfAllFrames();
+  detectAndExtractFeaturesNFrame(detector_idx, nframe.get());
+}
+
+const pose_graph::VertexId& FeatureTrackingPipeline::getVertexIdOfKeypoint(
+    const aslam::KeypointIdentifier& keypoint_identifier) const {
+  NFrameIdToVertexIdMap::const_iterator vertex_iterator =
+      nframe_id_to_vertex_id_map_.find(keypoint_identifier.getNFrameId());
+  CHECK(vertex_iterator != nframe_id_to_vertex_id_map_.end());
+  return vertex_iterator->second;
+}
+
+void FeatureTrackingPipeline::extractTerminatedFeatureTracks(
+    const aslam::VisualNFrame::ConstPtr& nframe) {
   CHECK(track_extractor_);
 
   aslam::FeatureTracksList terminated_tracks;
@@ -120,108 +159,128 @@ void FeatureTrackingPipeline::extractAndTriangulateTerminatedFeatureTracks(
     visualization::RVizVisualizationSink::publish(topic, image);
   }
 
-  // Iterate over all terminated feature tracks, triangulate them and add them
-  // to the map.
   for (const aslam::FeatureTracks& tracks : terminated_tracks) {
-    for (const aslam::FeatureTrack& track : tracks) {
-      VLOG(3) << "Triangulating track with length " << track.getTrackLength();
-      // Transformations between all vertices and the world frame.
-      Aligned<std::vector, aslam::Transformation> T_G_Is;
-
-      const aslam::KeypointIdentifierList& keypoint_identifiers =
-          track.getKeypointIdentifiers();
-
-      // Get the normalized measurements for all observations on the track.
-      Aligned<std::vector, Eigen::Vector2d> normalized_measurements;
-      normalized_measurements.reserve(track.getTrackLength());
-
-      const aslam::Camera::ConstPtr& track_camera =
-          track.getFirstKeypointIdentifier().getCamera();
-      CHECK(track_camera);
-
-      // Get the T_G_Is for all the observation vertices.
-      for (const aslam::KeypointIdentifier& keypoint_identifier :
-           keypoint_identifiers) {
-        NFrameIdToVertexIdMap::iterator vertex_iterator =
-            nframe_id_to_vertex_id_map_.find(keypoint_identifier.getNFrameId());
-        CHECK(vertex_iterator != nframe_id_to_vertex_id_map_.end());
-        const pose_graph::VertexId& vertex_id = vertex_iterator->second;
-        T_G_Is.emplace_back(map->getVertex_T_G_I(vertex_id));
-
-        // Obtain the normalized keypoint measurements.
-        const Eigen::Vector2d& keypoint_measurement =
-            keypoint_identifier.getKeypointMeasurement();
-        Eigen::Vector3d C_ray;
-        track_camera->backProject3(keypoint_measurement, &C_ray);
-        CHECK_GT(C_ray[2], 1e-8)
-            << "Keypoint backprojection has zero z-component.";
-        normalized_measurements.emplace_back(C_ray.head<2>() / C_ray[2]);
-      }
+    queued_feature_tracks_.insert(
+        queued_feature_tracks_.end(), tracks.begin(), tracks.end());
+  }
+}
+
+bool FeatureTrackingPipeline::triangulateFeatureTrack(
+    const aslam::FeatureTrack& track, const vi_map::VIMap& map,
+    Eigen::Vector3d* G_landmark) const {
+  CHECK_NOTNULL(G_landmark);
+  VLOG(3) << "Triangulating track with length " << track.getTrackLength();
+  // Transformations between all vertices and the world frame.
+  Aligned<std::vector, aslam::Transformation> T_G_Is;
+  T_G_Is.reserve(track.getTrackLength());
+
+  // Get the normalized measurements for all observations on the track.
+  Aligned<std::vector, Eigen::Vector2d> normalized_measurements;
+  normalized_measurements.reserve(track.getTrackLength());
+
+  const aslam::Camera::ConstPtr& track_camera =
+      track.getFirstKeypointIdentifier().getCamera();
+  CHECK(track_camera);
+
+  // Get the T_G_Is for all the observation vertices.
+  for (const aslam::KeypointIdentifier& keypoint_identifier :
+       track.getKeypointIdentifiers()) {
+    T_G_Is.emplace_back(
+        map.getVertex_T_G_I(getVertexIdOfKeypoint(keypoint_identifier)));
+
+    // Obtain the normalized keypoint measurements.
+    const Eigen::Vector2d& keypoint_measurement =
+        keypoint_identifier.getKeypointMeasurement();
+    Eigen::Vector3d C_ray;
+    track_camera->backProject3(keypoint_measurement, &C_ray);
+    CHECK_GT(C_ray[2], 1e-8) << "Keypoint backprojection has zero z-component.";
+    normalized_measurements.emplace_back(C_ray.head<2>() / C_ray[2]);
+  }
+
+  const aslam::TriangulationResult triangulation_result =
+      aslam::linearTriangulateFromNViews(
+          normalized_measurements, T_G_Is,
+          track.getFirstKeypointIdentifier().get_T_C_B().inverse(), G_landmark);
+  return triangulation_result.wasTriangulationSuccessful();
+}
 
-      // Triangulate the landmark.
-      Eigen::Vector3d G_landmark;
-      const aslam::TriangulationResult triangulation_result =
-          aslam::linearTriangulateFromNViews(
-              normalized_measurements, T_G_Is,
-              track.getFirstKeypointIdentifier().get_T_C_B().inverse(),
-              &G_landmark);
-
-      if (triangulation_result.wasTriangulationSuccessful()) {
-        // Transform the landmark from the global frame to the vertex frame of
-        // its first
-        // observation.
-        const aslam::KeypointIdentifier& first_observation_keypoint_identifier =
-            track.getFirstKeypointIdentifier();
-        NFrameIdToVertexIdMap::iterator first_observation_vertex_iterator =
-            nframe_id_to_vertex_id_map_.find(
-                first_observation_keypoint_identifier.getNFrameId());
-        CHECK(
-            first_observation_vertex_iterator !=
-            nframe_id_to_vertex_id_map_.end());
-        const pose_graph::VertexId& first_observation_vertex_id =
-            first_observation_vertex_iterator->second;
-
-        // Frames: Ib = Landmark base-frame.
-        //         G = Global frame.
-        const aslam::Transformation T_Ib_G =
-            map->getVertex_T_G_I(first_observation_vertex_id).inverse();
-
-        vi_map::Landmark landmark;
-        landmark.set_p_B(T_Ib_G * G_landmark);
-
-        // Create store landamrk ID and add the landmark to the map.
-        vi_map::LandmarkId landmark_id;
-        common::generateId(&landmark_id);
-        landmark.setId(landmark_id);
-        map->addNewLandmark(
-            landmark, first_observation_vertex_id,
-            first_observation_keypoint_identifier.getFrameIndex(),
-            first_observation_keypoint_identifier.getKeypointIndex());
-
-        // Add all observations to the map.
-        for (const aslam::KeypointIdentifier& keypoint_identifier :
-             keypoint_identifiers) {
-          NFrameIdToVertexIdMap::iterator vertex_iterator =
-              nframe_id_to_vertex_id_map_.find(
-                  keypoint_identifier.getNFrameId());
-          CHECK(vertex_iterator != nframe_id_to_vertex_id_map_.end());
-          const pose_graph::VertexId& vertex_id = vertex_iterator->second;
-
-          // Skip the base observation. This is already added above when we add
-          // the new landmark.
-          if (vertex_id == first_observation_vertex_id) {
-            continue;
-          }
-
-          map->associateKeypointWithExistingLandmark(
-              vertex_id, keypoint_identifier.getFrameIndex(),
-              keypoint_identifier.getKeypointIndex(), landmark_id);
+void FeatureTrackingPipeline::triangulateQueuedFeatureTracks(
+    vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  const size_t num_tracks = queued_feature_tracks_.size();
+  if (num_tracks == 0u) {
+    return;
+  }
+  timing::Timer timer("FeatureTrackingPipeline: triangulate tracks");
+
+  // The map is only read while triangulating, the landmarks are added
+  // afterwards in the order of the tracks.
+  Aligned<std::vector, Eigen::Vector3d> G_landmarks(num_tracks);
+  std::vector<unsigned char> is_triangulated(num_tracks, 0u);
+  const vi_map::VIMap& const_map = *map;
+  std::function<void(const std::vector<size_t>&)> triangulator =
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t track_idx : batch) {
+          is_triangulated[track_idx] = triangulateFeatureTrack(
+              queued_feature_tracks_[track_idx], const_map,
+              &G_landmarks[track_idx]);
         }
+      };
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      num_tracks, triangulator, kAlwaysParallelize,
+      common::getNumHardwareThreads());
+
+  for (size_t track_idx = 0u; track_idx < num_tracks; ++track_idx) {
+    successfully_triangulated_landmarks_accumulator_.Add(
+        is_triangulated[track_idx] ? 1u : 0u);
+    if (!is_triangulated[track_idx]) {
+      continue;
+    }
+    const aslam::FeatureTrack& track = queued_feature_tracks_[track_idx];
+
+    // Transform the landmark from the global frame to the vertex frame of its
+    // first observation.
+    const aslam::KeypointIdentifier& first_observation_keypoint_identifier =
+        track.getFirstKeypointIdentifier();
+    const pose_graph::VertexId& first_observation_vertex_id =
+        getVertexIdOfKeypoint(first_observation_keypoint_identifier);
+
+    // Frames: Ib = Landmark base-frame.
+    //         G = Global frame.
+    const aslam::Transformation T_Ib_G =
+        map->getVertex_T_G_I(first_observation_vertex_id).inverse();
+
+    vi_map::Landmark landmark;
+    landmark.set_p_B(T_Ib_G * G_landmarks[track_idx]);
+
+    // Create store landamrk ID and add the landmark to the map.
+    vi_map::LandmarkId landmark_id;
+    common::generateId(&landmark_id);
+    landmark.setId(landmark_id);
+    map->addNewLandmark(
+        landmark, first_observation_vertex_id,
+        first_observation_keypoint_identifier.getFrameIndex(),
+        first_observation_keypoint_identifier.getKeypointIndex());
+
+    // Add all observations to the map.
+    for (const aslam::KeypointIdentifier& keypoint_identifier :
+         track.getKeypointIdentifiers()) {
+      const pose_graph::VertexId& vertex_id =
+          getVertexIdOfKeypoint(keypoint_identifier);
+
+      // Skip the base observation. This is already added above when we add
+      // the new landmark.
+      if (vertex_id == first_observation_vertex_id) {
+        continue;
       }
-      successfully_triangulated_landmarks_accumulator_.Add(
-          triangulation_result.wasTriangulationSuccessful() ? 1u : 0u);
+
+      map->associateKeypointWithExistingLandmark(
+          vertex_id, keypoint_identifier.getFrameIndex(),
+          keypoint_identifier.getKeypointIndex(), landmark_id);
     }
   }
+  queued_feature_tracks_.clear();
 }
 
 void FeatureTrackingPipeline::runTrackingAndTriangulationForMission(
@@ -232,16 +291,19 @@ void FeatureTrackingPipeline::runTrackingAndTriangulationForMission(
   VLOG(1) << "Running tracking and triangulation for mission with ID "
           << mission_id;
   nframe_id_to_vertex_id_map_.clear();
+  queued_feature_tracks_.clear();
+  processed_first_nframe_ = false;
 
-  pose_graph::VertexIdList all_vertices;
-  map->getAllVertexIdsInMission(mission_id, &all_vertices);
+  pose_graph::VertexIdList vertex_ids;
+  map->getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
+  const size_t num_vertices = vertex_ids.size();
+  CHECK_GT(num_vertices, 0u);
 
-  VLOG(1) << "Processing a total of " << all_vertices.size() << " vertices.";
-  common::ProgressBar progress_bar(all_vertices.size());
+  VLOG(1) << "Processing a total of " << num_vertices << " vertices.";
+  common::ProgressBar progress_bar(num_vertices);
 
-  pose_graph::VertexId vertex_id_k =
-      map->getMission(mission_id).getRootVertexId();
-  vi_map::Vertex& root_vertex = map->getVertex(vertex_id_k);
+  const vi_map::Vertex& root_vertex = map->getVertex(vertex_ids.front());
+  CHECK_EQ(root_vertex.id(), map->getMission(mission_id).getRootVertexId());
   // Initialize pipeline.
   const size_t num_frames = root_vertex.numFrames();
   CHECK_GT(num_frames, 0u);
@@ -254,32 +316,70 @@ void FeatureTrackingPipeline::runTrackingAndTriangulationForMission(
   feature_track_visualizer_.setNumFrames(num_frames);
   track_extractor_.reset(new vio_common::FeatureTrackExtractor(ncamera));
   initialize(ncamera);
+  initializeDetectionWorkers(num_detection_workers_);
+
+  // The detection of vertex i always runs on worker slot i % num_workers.
+  // Tasks of the same slot are serialized by the thread pool, so every slot
+  // can use its own set of detectors.
+  CHECK_GT(num_detection_workers_, 0u);
+  const size_t detection_lookahead = std::max(
+      static_cast<size_t>(
+          std::max(FLAGS_feature_tracker_detection_lookahead, 1)),
+      num_detection_workers_);
+  aslam::ThreadPool detection_pool(num_detection_workers_);
+  std::deque<std::future<void>> pending_detections;
+  size_t num_vertices_enqueued = 0u;
+  auto enqueue_detections = [&]() {
+    while (num_vertices_enqueued < num_vertices &&
+           pending_detections.size() < detection_lookahead) {
+      const size_t detector_idx =
+          num_vertices_enqueued % num_detection_workers_;
+      pending_detections.emplace_back(
+          detection_pool.enqueueOrdered(
+              detector_idx,
+              &FeatureTrackingPipeline::loadImagesAndDetectFeatures, this,
+              detector_idx, vertex_ids[num_vertices_enqueued], map));
+      ++num_vertices_enqueued;
+    }
+  };
+  // Waits until the features of the next vertex are detected.
+  auto get_next_nframe = [&](const pose_graph::VertexId& vertex_id) {
+    enqueue_detections();
+    CHECK(!pending_detections.empty());
+    pending_detections.front().get();
+    pending_detections.pop_front();
+    enqueue_detections();
+
+    vi_map::Vertex& vertex = map->getVertex(vertex_id);
+    CHECK_EQ(vertex.numFrames(), num_frames);
+    aslam::VisualNFrame::Ptr nframe = vertex.getVisualNFrameShared();
+    CHECK(nframe);
+    nframe_id_to_vertex_id_map_.insert(
+        std::make_pair(nframe->getId(), vertex_id));
+    if (FLAGS_feature_tracker_publish_raw_images) {
+      for (size_t frame_idx = 0u; frame_idx < num_frames; ++frame_idx) {
+        const std::string topic = feature_tracking_ros_base_topic_ +
+                                  "camera_raw_" + std::to_string(frame_idx);
+        visualization::RVizVisualizationSink::publish(
+            topic, nframe->getFrame(frame_idx).getRawImage());
+      }
+    }
+    return nframe;
+  };
 
   // Process first nframe.
-  assignRawImagesToNFrame(vertex_id_k, map);
-  aslam::VisualNFrame::Ptr nframe_k = root_vertex.getVisualNFrameShared();
-  nframe_k->clearKeypointChannelsOfAllFrames();
-  nframe_id_to_vertex_id_map_.insert(
-      std::make_pair(nframe_k->getId(), vertex_id_k));
+  pose_graph::VertexId vertex_id_k = vertex_ids.front();
+  aslam::VisualNFrame::Ptr nframe_k = get_next_nframe(vertex_id_k);
   progress_bar.increment();
 
-  pose_graph::VertexId vertex_id_kp1;
-  while (map->getNextVertex(
-      vertex_id_k, map->getGraphTraversalEdgeType(mission_id),
-      &vertex_id_kp1)) {
+  for (size_t vertex_idx = 1u; vertex_idx < num_vertices; ++vertex_idx) {
+    const pose_graph::VertexId& vertex_id_kp1 = vertex_ids[vertex_idx];
     CHECK(vertex_id_k.isValid());
     CHECK(vertex_id_kp1.isValid());
     CHECK_NE(vertex_id_k, vertex_id_kp1);
     CHECK(nframe_k);
 
-    assignRawImagesToNFrame(vertex_id_kp1, map);
-
-    vi_map::Vertex& vertex_kp1 = map->getVertex(vertex_id_kp1);
-    CHECK_EQ(vertex_kp1.numFrames(), num_frames);
-    aslam::VisualNFrame::Ptr nframe_kp1 = vertex_kp1.getVisualNFrameShared();
-    nframe_kp1->clearKeypointChannelsOfAllFrames();
-    nframe_id_to_vertex_id_map_.insert(
-        std::make_pair(nframe_kp1->getId(), vertex_id_kp1));
+    aslam::VisualNFrame::Ptr nframe_kp1 = get_next_nframe(vertex_id_kp1);
 
     const aslam::Transformation T_Ik_Ikp1 =
         map->getVertex_T_G_I(vertex_id_k).inverse() *
@@ -288,11 +388,15 @@ void FeatureTrackingPipeline::runTrackingAndTriangulationForMission(
 
     if (!processed_first_nframe_) {
       map->getVertex(vertex_id_k).resetObservedLandmarkIdsToInvalid();
-      extractAndTriangulateTerminatedFeatureTracks(nframe_k, map);
+      extractTerminatedFeatureTracks(nframe_k);
       processed_first_nframe_ = true;
     }
     map->getVertex(vertex_id_kp1).resetObservedLandmarkIdsToInvalid();
-    extractAndTriangulateTerminatedFeatureTracks(nframe_kp1, map);
+    extractTerminatedFeatureTracks(nframe_kp1);
+    if (queued_feature_tracks_.size() >=
+        static_cast<size_t>(FLAGS_feature_tracker_triangulation_batch_size)) {
+      triangulateQueuedFeatureTracks(map);
+    }
 
     if (FLAGS_feature_tracker_visualize_keypoints) {
       cv::Mat image;
@@ -318,6 +422,10 @@ void FeatureTrackingPipeline::runTrackingAndTriangulationForMission(
     nframe_k = nframe_kp1;
     progress_bar.increment();
   }
+  nframe_k->releaseRawImagesOfAllFrames();
+  CHECK(pending_detections.empty());
+  detection_pool.stop();
+  triangulateQueuedFeatureTracks(map);
 
   VLOG(1) << "Successfully retracked features and triangulated new landmarks"
           << " for mission " << mission_id;
@@ -116,10 +116,15 @@ void VOFeatureTrackingPipeline::trackFeaturesSingleCamera(
   outlier_matches_kp1_k->clear();
 
   // Initialize keypoints and descriptors in frame_k, if there aren't any.
-  if (!has_feature_extraction_been_performed_on_first_nframe_) {
+  // The frames might already contain features detected ahead of time by
+  // detectAndExtractFeaturesNFrame.
+  if (!has_feature_extraction_been_performed_on_first_nframe_ &&
+      !frame_k->hasKeypointMeasurements()) {
     detectors_extractors_[camera_idx]->detectAndExtractFeatures(frame_k);
   }
-  detectors_extractors_[camera_idx]->detectAndExtractFeatures(frame_kp1);
+  if (!frame_kp1->hasKeypointMeasurements()) {
+    detectors_extractors_[camera_idx]->detectAndExtractFeatures(frame_kp1);
+  }
 
   if (FLAGS_detection_visualize_keypoints) {
     cv::Mat image;
@@ -208,6 +213,20 @@ void VOFeatureTrackingPipeline::trackFeaturesSingleCamera(
   timer_track_manager.Stop();
 }
 
+void VOFeatureTrackingPipeline::detectAndExtractFeaturesNFrame(
+    const size_t detector_idx, aslam::VisualNFrame* nframe) {
+  CHECK_NOTNULL(nframe);
+  CHECK_LT(detector_idx, worker_detectors_extractors_.size());
+  std::vector<std::unique_ptr<FeatureDetectorExtractor>>& detectors_extractors =
+      worker_detectors_extractors_[detector_idx];
+  const size_t num_cameras = nframe->getNumCameras();
+  CHECK_EQ(num_cameras, detectors_extractors.size());
+  for (size_t camera_idx = 0u; camera_idx < num_cameras; ++camera_idx) {
+    detectors_extractors[camera_idx]->detectAndExtractFeatures(
+        nframe->getFrameShared(camera_idx).get());
+  }
+}
+
 void VOFeatureTrackingPipeline::initialize(
     const aslam::NCamera::ConstPtr& ncamera) {
   CHECK(ncamera);
@@ -217,6 +236,9 @@ void VOFeatureTrackingPipeline::initialize(
   thread_pool_.reset(new aslam::ThreadPool(num_cameras));
 
   // Create a feature tracker.
+  detectors_extractors_.clear();
+  trackers_.clear();
+  track_managers_.clear();
   detectors_extractors_.reserve(num_cameras);
   trackers_.reserve(num_cameras);
   track_managers_.reserve(num_cameras);
@@ -234,4 +256,22 @@ void VOFeatureTrackingPipeline::initialize(
     track_managers_.emplace_back(new aslam::SimpleTrackManager);
   }
 }
+
+void VOFeatureTrackingPipeline::initializeDetectionWorkers(
+    const size_t num_workers) {
+  CHECK(ncamera_);
+  const size_t num_cameras = ncamera_->numCameras();
+  worker_detectors_extractors_.clear();
+  worker_detectors_extractors_.resize(num_workers);
+  for (std::vector<std::unique_ptr<FeatureDetectorExtractor>>&
+           detectors_extractors : worker_detectors_extractors_) {
+    detectors_extractors.reserve(num_cameras);
+    for (size_t cam_idx = 0u; cam_idx < num_cameras; ++cam_idx) {
+      detectors_extractors.emplace_back(
+          new FeatureDetectorExtractor(
+              ncamera_->getCamera(cam_idx), extractor_settings_,
+              detector_settings_));
+    }
+  }
+}
 }  // namespace feature_tracking
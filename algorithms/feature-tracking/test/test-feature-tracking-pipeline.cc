@@ -0,0 +1,135 @@
+#include <string>
+
+#include <Eigen/Core>
+#include <aslam/frames/visual-frame.h>
+#include <aslam/frames/visual-nframe.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vi-map/6dof-vi-map-gen.h>
+#include <vi-map/vi-map.h>
+
+#include "feature-tracking/feature-tracking-types.h"
+#include "feature-tracking/vo-feature-tracking-pipeline.h"
+
+DECLARE_int32(feature_tracker_num_detection_workers);
+
+namespace feature_tracking {
+
+class FeatureTrackingPipelineTest : public ::testing::Test {
+ protected:
+  static constexpr char kMapFolder[] = "./feature_tracking_pipeline_test_map";
+
+  virtual void SetUp() {
+    common::removePath(kMapFolder);
+    vimap_gen_.generateVIMap();
+    vi_map::VIMap& map = vimap_gen_.vi_map_;
+    map.setMapFolder(kMapFolder);
+
+    // Render the generated keypoints as bright squares, such that the
+    // detector finds corners at the projections of the landmarks.
+    pose_graph::VertexIdList vertex_ids;
+    map.getAllVertexIds(&vertex_ids);
+    for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+      vi_map::Vertex& vertex = map.getVertex(vertex_id);
+      for (size_t frame_idx = 0u; frame_idx < vertex.numFrames();
+           ++frame_idx) {
+        const aslam::VisualFrame& frame =
+            vertex.getVisualNFrame().getFrame(frame_idx);
+        const aslam::Camera::ConstPtr camera = frame.getCameraGeometry();
+        CHECK(camera);
+        cv::Mat image(
+            camera->imageHeight(), camera->imageWidth(), CV_8UC1,
+            cv::Scalar(0));
+        const Eigen::Matrix2Xd& keypoints = frame.getKeypointMeasurements();
+        for (int keypoint_idx = 0; keypoint_idx < keypoints.cols();
+             ++keypoint_idx) {
+          const cv::Point center(
+              static_cast<int>(keypoints(0, keypoint_idx)),
+              static_cast<int>(keypoints(1, keypoint_idx)));
+          cv::rectangle(
+              image, center - cv::Point(3, 3), center + cv::Point(3, 3),
+              cv::Scalar(255), CV_FILLED);
+        }
+        map.storeRawImage(image, frame_idx, &vertex);
+      }
+    }
+  }
+
+  virtual void TearDown() {
+    common::removePath(kMapFolder);
+  }
+
+  void runPipeline(const int num_detection_workers, vi_map::VIMap* map) {
+    CHECK_NOTNULL(map);
+    map->deepCopy(vimap_gen_.vi_map_);
+    const int original_num_detection_workers =
+        FLAGS_feature_tracker_num_detection_workers;
+    FLAGS_feature_tracker_num_detection_workers = num_detection_workers;
+    VOFeatureTrackingPipeline pipeline(
+        vimap_gen_.graph_gen_.cameras_, FeatureTrackingExtractorSettings(),
+        FeatureTrackingDetectorSettings());
+    pipeline.runTrackingAndTriangulationForAllMissions(map);
+    FLAGS_feature_tracker_num_detection_workers =
+        original_num_detection_workers;
+  }
+
+  vi_map::SixDofVIMapGenerator vimap_gen_;
+};
+
+constexpr char FeatureTrackingPipelineTest::kMapFolder[];
+
+TEST_F(FeatureTrackingPipelineTest, ResultDoesNotDependOnNumDetectionWorkers) {
+  vi_map::VIMap sequential_map;
+  runPipeline(1, &sequential_map);
+  vi_map::VIMap parallel_map;
+  runPipeline(4, &parallel_map);
+
+  EXPECT_EQ(sequential_map.numLandmarks(), parallel_map.numLandmarks());
+  pose_graph::VertexIdList vertex_ids;
+  sequential_map.getAllVertexIds(&vertex_ids);
+  size_t num_keypoints = 0u;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    const vi_map::Vertex& sequential_vertex =
+        sequential_map.getVertex(vertex_id);
+    const vi_map::Vertex& parallel_vertex = parallel_map.getVertex(vertex_id);
+    ASSERT_EQ(sequential_vertex.numFrames(), parallel_vertex.numFrames());
+    for (size_t frame_idx = 0u; frame_idx < sequential_vertex.numFrames();
+         ++frame_idx) {
+      const Eigen::Matrix2Xd& sequential_keypoints =
+          sequential_vertex.getVisualFrame(frame_idx)
+              .getKeypointMeasurements();
+      const Eigen::Matrix2Xd& parallel_keypoints =
+          parallel_vertex.getVisualFrame(frame_idx).getKeypointMeasurements();
+      ASSERT_EQ(sequential_keypoints.cols(), parallel_keypoints.cols());
+      EXPECT_EQ(sequential_keypoints, parallel_keypoints);
+      num_keypoints += sequential_keypoints.cols();
+
+      // The landmark ids are random, hence the landmarks are compared by
+      // their position.
+      for (int keypoint_idx = 0; keypoint_idx < sequential_keypoints.cols();
+           ++keypoint_idx) {
+        const vi_map::LandmarkId& sequential_landmark_id =
+            sequential_vertex.getObservedLandmarkId(frame_idx, keypoint_idx);
+        const vi_map::LandmarkId& parallel_landmark_id =
+            parallel_vertex.getObservedLandmarkId(frame_idx, keypoint_idx);
+        ASSERT_EQ(
+            sequential_landmark_id.isValid(), parallel_landmark_id.isValid());
+        if (sequential_landmark_id.isValid()) {
+          EXPECT_EQ(
+              sequential_map.getLandmark_G_p_fi(sequential_landmark_id),
+              parallel_map.getLandmark_G_p_fi(parallel_landmark_id));
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_keypoints, 0u);
+}
+
+}  // namespace feature_tracking
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -48,6 +48,15 @@ class PoseInterpolator {
       const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
       aslam::TransformationVector* poses) const;
 
+  // Batched version of the above for requests across several missions. One
+  // pose is returned for each pair of mission id and timestamp, in the order
+  // of the requests. The vertex intervals of all missions are integrated in
+  // parallel.
+  void getPosesAtTime(
+      const vi_map::VIMap& map, const vi_map::MissionIdList& mission_ids,
+      const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
+      aslam::TransformationVector* poses) const;
+
   // Returns interpolated poses and their associated timestamps across an entire
   // mission specified by emission_id.  Timestamps begin at the earliest IMU
   // measurement, then continue every timestep_seconds until the last possible
@@ -67,36 +76,33 @@ class PoseInterpolator {
       int64_t* max_timestamp_ns = nullptr) const;
 
  private:
-  typedef std::pair<int64_t, StateLinearizationPoint> state_buffer_value_type;
-  typedef common::TemporalBuffer<
-      StateLinearizationPoint,
-      Eigen::aligned_allocator<state_buffer_value_type> >
-      StateBuffer;
-
   // Determine the earliest and latest IMU measurements across an entire
   // mission.
   void getMissionTimeRange(
       const vi_map::VIMap& vi_map, const vi_map::MissionId mission_id,
       int64_t* mission_start_ns_ptr, int64_t* mission_end_ns_ptr) const;
 
-  void getImuDataInRange(
-      const vi_map::VIMap& map, pose_graph::EdgeId imu_edge_id,
+  // Returns the range [start_index, end_index] of the sorted timestamps lying
+  // within the given time range. Both indices are -1 if there are none.
+  void getTimestampIndicesInRange(
       const std::vector<int64_t>& sorted_timestamps, int64_t range_time_start,
-      int64_t range_time_end,
-      Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
-      Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_data) const;
+      int64_t range_time_end, int* start_index, int* end_index) const;
 
   void buildVertexToTimeList(
       const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
       std::vector<VertexInformation>* vertices_and_time) const;
 
+  // Integrates the IMU data starting at the state of the given vertex and
+  // returns the poses at the sorted timestamps [start_index, end_index], which
+  // must be part of the IMU timestamps. Only the state is propagated, the
+  // covariance is not needed to interpolate poses.
   void computeRequestedPosesInRange(
-      const vi_map::VIMap& map, const vi_map::VIMission& mission,
+      const vi_map::VIMap& map, const vi_map::Imu& imu_sensor,
       const pose_graph::VertexId& vertex_begin_id,
-      const pose_graph::EdgeId& imu_edge_id,
       const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
       const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
-      StateBuffer* state_buffer) const;
+      const std::vector<int64_t>& sorted_timestamps, int start_index,
+      int end_index, aslam::TransformationVector* poses) const;
 
   void getImuTimeStampsInRange(
       const std::vector<int64_t>& timestamps, int64_t range_time_start,
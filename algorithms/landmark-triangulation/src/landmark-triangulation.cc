@@ -20,95 +20,96 @@ typedef AlignedUnorderedMap<aslam::FrameId, aslam::Transformation>
 namespace {
 
 void interpolateVisualFramePoses(
-    const vi_map::MissionId& mission_id, const vi_map::VIMap& map,
+    const vi_map::MissionIdList& mission_ids, const vi_map::VIMap& map,
     FrameToPoseMap* interpolated_frame_poses) {
-  CHECK(map.hasMission(mission_id));
   CHECK_NOTNULL(interpolated_frame_poses)->clear();
-  // Loop over all missions, vertices and frames and add the interpolated poses
-  // to the map.
-  size_t total_num_frames = 0u;
-
-  // Check if there is IMU data.
-  VertexToTimeStampMap vertex_to_time_map;
-  PoseInterpolator imu_timestamp_collector;
-  imu_timestamp_collector.getVertexToTimeStampMap(
-      map, mission_id, &vertex_to_time_map);
-  if (vertex_to_time_map.empty()) {
-    VLOG(2) << "Couldn't find any IMU data to interpolate exact landmark "
-               "observer positions in "
-            << "mission " << mission_id;
-    return;
-  }
+  // Loop over all missions, vertices and frames and collect the timestamps of
+  // the frames whose poses need to be interpolated. The poses of all missions
+  // are interpolated in a single batch.
+  std::vector<aslam::FrameId> frame_ids;
+  vi_map::MissionIdList frame_mission_ids;
+  std::vector<int64_t> frame_timestamps;
+  PoseInterpolator pose_interpolator;
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    CHECK(map.hasMission(mission_id));
+
+    // Check if there is IMU data.
+    VertexToTimeStampMap vertex_to_time_map;
+    pose_interpolator.getVertexToTimeStampMap(
+        map, mission_id, &vertex_to_time_map);
+    if (vertex_to_time_map.empty()) {
+      VLOG(2) << "Couldn't find any IMU data to interpolate exact landmark "
+                 "observer positions in "
+              << "mission " << mission_id;
+      continue;
+    }
 
-  pose_graph::VertexIdList vertex_ids;
-  map.getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
-
-  // Compute upper bound for number of VisualFrames.
-  const aslam::NCamera& ncamera =
-      map.getSensorManager().getNCameraForMission(mission_id);
-  const unsigned int upper_bound_num_frames =
-      vertex_ids.size() * ncamera.numCameras();
-
-  // Extract the timestamps for all VisualFrames.
-  std::vector<aslam::FrameId> frame_ids(upper_bound_num_frames);
-  Eigen::Matrix<int64_t, 1, Eigen::Dynamic> pose_timestamps(
-      upper_bound_num_frames);
-  unsigned int frame_counter = 0u;
-  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
-    const vi_map::Vertex& vertex = map.getVertex(vertex_id);
-    for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
-         ++frame_idx) {
-      if (vertex.isFrameIndexValid(frame_idx)) {
-        CHECK_LT(frame_counter, upper_bound_num_frames);
-        const aslam::VisualFrame& visual_frame =
-            vertex.getVisualFrame(frame_idx);
-        const int64_t timestamp = visual_frame.getTimestampNanoseconds();
-        // Only interpolate if the VisualFrame timestamp and the vertex
-        // timestamp do not match.
-        VertexToTimeStampMap::const_iterator it =
-            vertex_to_time_map.find(vertex_id);
-        if (it != vertex_to_time_map.end() && it->second != timestamp) {
-          pose_timestamps(0, frame_counter) = timestamp;
-          frame_ids[frame_counter] = visual_frame.getId();
-          ++frame_counter;
+    pose_graph::VertexIdList vertex_ids;
+    map.getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
+
+    // Compute upper bound for number of VisualFrames.
+    const aslam::NCamera& ncamera =
+        map.getSensorManager().getNCameraForMission(mission_id);
+    const size_t upper_bound_num_frames =
+        frame_ids.size() + vertex_ids.size() * ncamera.numCameras();
+    frame_ids.reserve(upper_bound_num_frames);
+    frame_mission_ids.reserve(upper_bound_num_frames);
+    frame_timestamps.reserve(upper_bound_num_frames);
+
+    // Extract the timestamps for all VisualFrames.
+    size_t frame_counter = 0u;
+    for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+      const vi_map::Vertex& vertex = map.getVertex(vertex_id);
+      for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+           ++frame_idx) {
+        if (vertex.isFrameIndexValid(frame_idx)) {
+          const aslam::VisualFrame& visual_frame =
+              vertex.getVisualFrame(frame_idx);
+          const int64_t timestamp = visual_frame.getTimestampNanoseconds();
+          // Only interpolate if the VisualFrame timestamp and the vertex
+          // timestamp do not match.
+          VertexToTimeStampMap::const_iterator it =
+              vertex_to_time_map.find(vertex_id);
+          if (it != vertex_to_time_map.end() && it->second != timestamp) {
+            frame_timestamps.push_back(timestamp);
+            frame_ids.push_back(visual_frame.getId());
+            frame_mission_ids.push_back(mission_id);
+            ++frame_counter;
+          }
         }
       }
     }
-  }
-
-  // Shrink time stamp and frame id arrays if necessary.
-  if (upper_bound_num_frames > frame_counter) {
-    frame_ids.resize(frame_counter);
-    pose_timestamps.conservativeResize(Eigen::NoChange, frame_counter);
-  }
-
-  // Reserve enough space in the frame_to_pose_map to add the poses of the
-  // current mission.
-  total_num_frames += frame_counter;
-  interpolated_frame_poses->reserve(total_num_frames);
+    CHECK_LE(frame_ids.size(), upper_bound_num_frames);
 
-  // Interpolate poses for all the VisualFrames.
-  if (frame_counter > 0u) {
-    VLOG(1) << "Interpolating the exact visual frame poses for "
-            << frame_counter << " frames of mission " << mission_id;
-    PoseInterpolator pose_interpolator;
-    aslam::TransformationVector poses_M_I;
-    pose_interpolator.getPosesAtTime(
-        map, mission_id, pose_timestamps, &poses_M_I);
-    CHECK_EQ(poses_M_I.size(), frame_counter);
-    for (size_t frame_num = 0u; frame_num < frame_counter; ++frame_num) {
-      interpolated_frame_poses->emplace(
-          frame_ids[frame_num], poses_M_I.at(frame_num));
+    if (frame_counter > 0u) {
+      VLOG(1) << "Interpolating the exact visual frame poses for "
+              << frame_counter << " frames of mission " << mission_id;
+    } else {
+      VLOG(10) << "No frames found for mission " << mission_id
+               << " that need to be interpolated.";
     }
-    CHECK_EQ(interpolated_frame_poses->size(), total_num_frames);
-  } else {
-    VLOG(10) << "No frames found for mission " << mission_id
-             << " that need to be interpolated.";
   }
 
+  const size_t total_num_frames = frame_ids.size();
   if (total_num_frames == 0u) {
     VLOG(2) << "No frame pose in any of the missions needs interpolation!";
+    return;
   }
+
+  // Interpolate poses for all the VisualFrames.
+  const Eigen::Map<const Eigen::Matrix<int64_t, 1, Eigen::Dynamic> >
+      pose_timestamps(frame_timestamps.data(), total_num_frames);
+  aslam::TransformationVector poses_M_I;
+  pose_interpolator.getPosesAtTime(
+      map, frame_mission_ids, pose_timestamps, &poses_M_I);
+  CHECK_EQ(poses_M_I.size(), total_num_frames);
+
+  interpolated_frame_poses->reserve(total_num_frames);
+  for (size_t frame_num = 0u; frame_num < total_num_frames; ++frame_num) {
+    interpolated_frame_poses->emplace(
+        frame_ids[frame_num], poses_M_I[frame_num]);
+  }
+  CHECK_EQ(interpolated_frame_poses->size(), total_num_frames);
 }
 
 void retriangulateLandmarksOfVertex(
@@ -282,15 +283,18 @@ void retriangulateLandmarks(
     const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map) {
   CHECK_NOTNULL(map);
 
+  FrameToPoseMap interpolated_frame_poses;
+  interpolateVisualFramePoses(mission_ids, *map, &interpolated_frame_poses);
   for (const vi_map::MissionId& mission_id : mission_ids) {
-    retriangulateLandmarksOfMission(mission_id, map);
+    retriangulateLandmarksOfMission(mission_id, interpolated_frame_poses, map);
   }
 }
 
 void retriangulateLandmarksOfMission(
     const vi_map::MissionId& mission_id, vi_map::VIMap* map) {
   FrameToPoseMap interpolated_frame_poses;
-  interpolateVisualFramePoses(mission_id, *map, &interpolated_frame_poses);
+  interpolateVisualFramePoses(
+      vi_map::MissionIdList{mission_id}, *map, &interpolated_frame_poses);
   retriangulateLandmarksOfMission(mission_id, interpolated_frame_poses, map);
 }
 
@@ -1,13 +1,35 @@
 #include "landmark-triangulation/pose-interpolator.h"
 
+#include <algorithm>
 #include <limits>
 
 #include <aslam/common/time.h>
 #include <glog/logging.h>
 #include <imu-integrator/imu-integrator.h>
 #include <maplab-common/macros.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 
 namespace landmark_triangulation {
+namespace {
+
+// Pose requests of a single mission.
+struct MissionRequests {
+  vi_map::MissionId mission_id;
+  // Indices of the requests in the batch, sorted by their timestamps.
+  std::vector<size_t> request_indices;
+  std::vector<int64_t> sorted_timestamps;
+  std::vector<VertexInformation> vertices_and_time;
+  // Range [start, end] of the sorted timestamps within each vertex interval,
+  // both -1 if there are none.
+  std::vector<std::pair<int, int> > interval_index_ranges;
+  // Index of the vertex interval computing the pose of each sorted timestamp.
+  std::vector<int> interval_of_timestamp;
+  aslam::TransformationVector sorted_poses_M_I;
+};
+
+}  // namespace
+
 void PoseInterpolator::buildListOfAllRequiredIMUMeasurements(
     const vi_map::VIMap& map, const std::vector<int64_t>& timestamps,
     const pose_graph::EdgeId& imu_edge_id, int start_index, int end_index,
@@ -94,23 +116,22 @@ void PoseInterpolator::buildListOfAllRequiredIMUMeasurements(
 }
 
 void PoseInterpolator::computeRequestedPosesInRange(
-    const vi_map::VIMap& map, const vi_map::VIMission& mission,
+    const vi_map::VIMap& map, const vi_map::Imu& imu_sensor,
     const pose_graph::VertexId& vertex_begin_id,
-    const pose_graph::EdgeId& /*imu_edge_id*/,
     const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
     const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
-    StateBuffer* state_buffer) const {
-  CHECK_NOTNULL(state_buffer);
+    const std::vector<int64_t>& sorted_timestamps, int start_index,
+    int end_index, aslam::TransformationVector* poses) const {
+  CHECK_NOTNULL(poses)->clear();
   CHECK_EQ(imu_timestamps.cols(), imu_data.cols());
+  CHECK_GE(start_index, 0);
+  CHECK_LE(start_index, end_index);
+  CHECK_LT(end_index, static_cast<int>(sorted_timestamps.size()));
   if (imu_data.cols() == 0) {
     return;
   }
 
   using imu_integrator::ImuIntegratorRK4;
-  const vi_map::MissionId& mission_id = mission.id();
-  CHECK(mission_id.isValid());
-  const vi_map::Imu& imu_sensor =
-      map.getSensorManager().getSensorForMission<vi_map::Imu>(mission_id);
   const vi_map::ImuSigmas& imu_sigmas = imu_sensor.getImuSigmas();
 
   ImuIntegratorRK4 integrator(
@@ -122,7 +143,6 @@ void PoseInterpolator::computeRequestedPosesInRange(
 
   using imu_integrator::kAccelBiasBlockSize;
   using imu_integrator::kAccelReadingOffset;
-  using imu_integrator::kErrorStateSize;
   using imu_integrator::kGyroBiasBlockSize;
   using imu_integrator::kGyroReadingOffset;
   using imu_integrator::kImuReadingSize;
@@ -135,10 +155,6 @@ void PoseInterpolator::computeRequestedPosesInRange(
   using imu_integrator::kStateSize;
 
   Eigen::Matrix<double, 2 * kImuReadingSize, 1> debiased_imu_readings;
-  Eigen::Matrix<double, kErrorStateSize, kErrorStateSize> phi;
-  Eigen::Matrix<double, kErrorStateSize, kErrorStateSize> new_phi_accum;
-  Eigen::Matrix<double, kErrorStateSize, kErrorStateSize> Q;
-  Eigen::Matrix<double, kErrorStateSize, kErrorStateSize> new_Q_accum;
   Eigen::Matrix<double, kStateSize, 1> current_state;
   Eigen::Matrix<double, kStateSize, 1> next_state;
 
@@ -155,16 +171,21 @@ void PoseInterpolator::computeRequestedPosesInRange(
 
   current_state << q_I_M_from, b_g_from, v_M_I_from, b_a_from, p_M_I_from;
 
-  // Store the value where we start integration.
-  StateLinearizationPoint state_linearization_point_begin;
-  state_linearization_point_begin.timestamp = imu_timestamps(0, 0);
-  state_linearization_point_begin.q_M_I.coeffs() =
-      current_state.head<kStateOrientationBlockSize>();
-  state_linearization_point_begin.p_M_I =
-      current_state.segment<kPositionBlockSize>(kStatePositionOffset);
-  state_buffer->addValue(
-      state_linearization_point_begin.timestamp,
-      state_linearization_point_begin);
+  poses->reserve(end_index - start_index + 1);
+  int next_requested_index = start_index;
+  // Stores the pose of the current state for all requests at the given time.
+  auto add_requested_poses = [&](const int64_t timestamp) {
+    while (next_requested_index <= end_index &&
+           sorted_timestamps[next_requested_index] == timestamp) {
+      Eigen::Quaterniond q_M_I;
+      q_M_I.coeffs() = current_state.head<kStateOrientationBlockSize>();
+      const Eigen::Vector3d p_M_I =
+          current_state.segment<kPositionBlockSize>(kStatePositionOffset);
+      poses->emplace_back(q_M_I, p_M_I);
+      ++next_requested_index;
+    }
+  };
+  add_requested_poses(imu_timestamps(0, 0));
 
   // Now compute all the integrated values.
   for (int i = 0; i < imu_data.cols() - 1; ++i) {
@@ -186,21 +207,15 @@ void PoseInterpolator::computeRequestedPosesInRange(
     double delta_time_seconds =
         (imu_timestamps(0, i + 1) - imu_timestamps(0, i)) *
         kNanoSecondsToSeconds;
-    integrator.integrate(
-        current_state, debiased_imu_readings, delta_time_seconds, &next_state,
-        &phi, &Q);
-
-    StateLinearizationPoint state_linearization_point;
-    state_linearization_point.timestamp = imu_timestamps(0, i + 1);
-    state_linearization_point.q_M_I.coeffs() =
-        next_state.head<kStateOrientationBlockSize>();
-    state_linearization_point.p_M_I =
-        next_state.segment<kPositionBlockSize>(kStatePositionOffset);
-    state_buffer->addValue(
-        state_linearization_point.timestamp, state_linearization_point);
-
+    integrator.integrateStateOnly(
+        current_state, debiased_imu_readings, delta_time_seconds, &next_state);
     current_state = next_state;
+
+    add_requested_poses(imu_timestamps(0, i + 1));
   }
+  CHECK_GT(next_requested_index, end_index)
+      << "No IMU measurement at requested time "
+      << sorted_timestamps[next_requested_index];
 }
 
 void PoseInterpolator::getVertexToTimeStampMap(
@@ -292,14 +307,11 @@ void PoseInterpolator::buildVertexToTimeList(
   }
 }
 
-void PoseInterpolator::getImuDataInRange(
-    const vi_map::VIMap& map, pose_graph::EdgeId imu_edge_id,
+void PoseInterpolator::getTimestampIndicesInRange(
     const std::vector<int64_t>& sorted_timestamps, int64_t range_time_start,
-    int64_t range_time_end,
-    Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
-    Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_data) const {
-  CHECK_NOTNULL(imu_timestamps);
-  CHECK_NOTNULL(imu_data);
+    int64_t range_time_end, int* start_index_ptr, int* end_index_ptr) const {
+  CHECK_NOTNULL(start_index_ptr);
+  CHECK_NOTNULL(end_index_ptr);
 
   CHECK_LE(range_time_start, range_time_end);
 
@@ -351,96 +363,170 @@ void PoseInterpolator::getImuDataInRange(
         << start_index << "<->" << end_index;
     CHECK_LE(sorted_timestamps[end_index], range_time_end)
         << start_index << "<->" << end_index;
-
-    buildListOfAllRequiredIMUMeasurements(
-        map, sorted_timestamps, imu_edge_id, start_index, end_index,
-        imu_timestamps, imu_data);
   } else {
     // Both indices should be set to -1.
     CHECK_EQ(start_index, end_index);
   }
+  *start_index_ptr = start_index;
+  *end_index_ptr = end_index;
 }
 
 void PoseInterpolator::getPosesAtTime(
     const vi_map::VIMap& map, vi_map::MissionId mission_id,
     const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& pose_timestamps,
     aslam::TransformationVector* poses_M_I) const {
+  const vi_map::MissionIdList mission_ids(pose_timestamps.cols(), mission_id);
+  getPosesAtTime(map, mission_ids, pose_timestamps, poses_M_I);
+}
+
+void PoseInterpolator::getPosesAtTime(
+    const vi_map::VIMap& map, const vi_map::MissionIdList& mission_ids,
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& pose_timestamps,
+    aslam::TransformationVector* poses_M_I) const {
   CHECK_NOTNULL(poses_M_I)->clear();
   CHECK_GT(pose_timestamps.rows(), 0);
+  CHECK_EQ(static_cast<int>(mission_ids.size()), pose_timestamps.cols());
 
-  CHECK(
-      map.getGraphTraversalEdgeType(mission_id) ==
-      pose_graph::Edge::EdgeType::kViwls);
-
-  // Remember the initial ordering of the timestamps before we sort them.
-  std::vector<int64_t> timestamps;
-  timestamps.reserve(pose_timestamps.rows());
-  for (int i = 0; i < pose_timestamps.size(); ++i) {
-    timestamps.emplace_back(pose_timestamps(0, i));
+  // Group the requests by mission.
+  std::unordered_map<vi_map::MissionId, size_t> mission_indices;
+  std::vector<MissionRequests> missions;
+  for (int i = 0; i < pose_timestamps.cols(); ++i) {
+    const std::pair<std::unordered_map<vi_map::MissionId, size_t>::iterator,
+                    bool>
+        it_inserted = mission_indices.emplace(mission_ids[i], missions.size());
+    if (it_inserted.second) {
+      missions.emplace_back();
+      missions.back().mission_id = mission_ids[i];
+    }
+    missions[it_inserted.first->second].request_indices.push_back(i);
   }
 
-  std::sort(timestamps.begin(), timestamps.end(), std::less<int64_t>());
-
-  // Build up a list of vertex-information and the timestamps of the first imu
-  // measurement on a vertex' outgoing IMU edge.
-  std::vector<VertexInformation> vertices_and_time;
-  buildVertexToTimeList(map, mission_id, &vertices_and_time);
-  CHECK_GT(vertices_and_time.size(), 1u)
-      << "The Viwls edges of mission " << mission_id
-      << " include none at all or only a single IMU "
-      << "measurement. Interpolation is not possible!";
-
-  int64_t smallest_time = vertices_and_time.front().timestamp_ns;
-  int64_t largest_time = vertices_and_time.back().timestamp_ns_end;
-  CHECK_GE(timestamps.front(), smallest_time)
-      << "Requested sample out of bounds! First available time is "
-      << smallest_time << " but " << timestamps.front() << " was requested.";
-  CHECK_LE(timestamps.back(), largest_time)
-      << "Requested sample out of bounds! Last available time is "
-      << largest_time << " but " << timestamps.back() << " was requested.";
-  VLOGF(4) << "Interpolation range is valid: (" << timestamps.front()
-           << " >= " << smallest_time << ") and (" << timestamps.back()
-           << " <= " << largest_time << ")";
-
-  std::vector<VertexInformation>::const_iterator vertex_it =
-      vertices_and_time.begin();
-
-  const vi_map::VIMission& mission = map.getMission(mission_id);
-
-  StateBuffer state_buffer;
-
-  while (vertex_it != vertices_and_time.end()) {
-    int64_t range_time_start = vertex_it->timestamp_ns;
-    int64_t range_time_end = vertex_it->timestamp_ns_end;
-
-    const pose_graph::EdgeId& imu_edge_id = vertex_it->outgoing_imu_edge_id;
-    const pose_graph::VertexId& vertex_id = vertex_it->vertex_id;
-
-    Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps;
-    Eigen::Matrix<double, 6, Eigen::Dynamic> imu_data;
-
-    getImuDataInRange(
-        map, imu_edge_id, timestamps, range_time_start, range_time_end,
-        &imu_timestamps, &imu_data);
-
-    computeRequestedPosesInRange(
-        map, mission, vertex_id, imu_edge_id, imu_timestamps, imu_data,
-        &state_buffer);
-
-    ++vertex_it;
+  // List the vertex intervals of all missions containing requests.
+  std::vector<std::pair<size_t, size_t> > mission_and_interval_indices;
+  for (size_t mission_index = 0u; mission_index < missions.size();
+       ++mission_index) {
+    MissionRequests& mission = missions[mission_index];
+    const vi_map::MissionId& mission_id = mission.mission_id;
+    CHECK(
+        map.getGraphTraversalEdgeType(mission_id) ==
+        pose_graph::Edge::EdgeType::kViwls);
+
+    // Sort the timestamps, but remember their initial ordering.
+    std::sort(
+        mission.request_indices.begin(), mission.request_indices.end(),
+        [&pose_timestamps](const size_t lhs, const size_t rhs) {
+          return pose_timestamps(0, lhs) < pose_timestamps(0, rhs);
+        });
+    mission.sorted_timestamps.reserve(mission.request_indices.size());
+    for (const size_t request_index : mission.request_indices) {
+      mission.sorted_timestamps.emplace_back(pose_timestamps(0, request_index));
+    }
+    const std::vector<int64_t>& timestamps = mission.sorted_timestamps;
+
+    // Build up a list of vertex-information and the timestamps of the first
+    // imu measurement on a vertex' outgoing IMU edge.
+    buildVertexToTimeList(map, mission_id, &mission.vertices_and_time);
+    const std::vector<VertexInformation>& vertices_and_time =
+        mission.vertices_and_time;
+    CHECK_GT(vertices_and_time.size(), 1u)
+        << "The Viwls edges of mission " << mission_id
+        << " include none at all or only a single IMU "
+        << "measurement. Interpolation is not possible!";
+
+    int64_t smallest_time = vertices_and_time.front().timestamp_ns;
+    int64_t largest_time = vertices_and_time.back().timestamp_ns_end;
+    CHECK_GE(timestamps.front(), smallest_time)
+        << "Requested sample out of bounds! First available time is "
+        << smallest_time << " but " << timestamps.front() << " was requested.";
+    CHECK_LE(timestamps.back(), largest_time)
+        << "Requested sample out of bounds! Last available time is "
+        << largest_time << " but " << timestamps.back() << " was requested.";
+    VLOGF(4) << "Interpolation range is valid: (" << timestamps.front()
+             << " >= " << smallest_time << ") and (" << timestamps.back()
+             << " <= " << largest_time << ")";
+
+    // Timestamps on the border of two intervals are computed by the later
+    // interval, starting at the state of its vertex.
+    mission.interval_of_timestamp.resize(timestamps.size(), -1);
+    mission.interval_index_ranges.resize(vertices_and_time.size());
+    for (size_t interval_index = 0u; interval_index < vertices_and_time.size();
+         ++interval_index) {
+      int start_index;
+      int end_index;
+      getTimestampIndicesInRange(
+          timestamps, vertices_and_time[interval_index].timestamp_ns,
+          vertices_and_time[interval_index].timestamp_ns_end, &start_index,
+          &end_index);
+      mission.interval_index_ranges[interval_index] =
+          std::make_pair(start_index, end_index);
+      if (start_index == -1) {
+        continue;
+      }
+      for (int i = start_index; i <= end_index; ++i) {
+        mission.interval_of_timestamp[i] = static_cast<int>(interval_index);
+      }
+      mission_and_interval_indices.emplace_back(mission_index, interval_index);
+    }
+    mission.sorted_poses_M_I.resize(timestamps.size());
   }
 
-  // Copy the interpolated data to the output buffer.
-  poses_M_I->clear();
-  poses_M_I->reserve(pose_timestamps.cols());
-  for (int i = 0; i < pose_timestamps.cols(); ++i) {
-    StateLinearizationPoint state_linearization_point;
-    const bool buffer_has_state = state_buffer.getValueAtTime(
-        pose_timestamps(0, i), &state_linearization_point);
-    CHECK(buffer_has_state) << ": No value in state_buffer at time: "
-                            << pose_timestamps(0, i);
-    poses_M_I->emplace_back(
-        state_linearization_point.q_M_I, state_linearization_point.p_M_I);
+  // Integrate all intervals in parallel. Every interval starts at the state of
+  // its vertex, hence they are independent.
+  const size_t num_threads = common::getNumHardwareThreads();
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      mission_and_interval_indices.size(),
+      [&](const std::vector<size_t>& batch) {
+        Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps;
+        Eigen::Matrix<double, 6, Eigen::Dynamic> imu_data;
+        aslam::TransformationVector interval_poses_M_I;
+        for (const size_t job_index : batch) {
+          MissionRequests& mission =
+              missions[mission_and_interval_indices[job_index].first];
+          const size_t interval_index =
+              mission_and_interval_indices[job_index].second;
+          const VertexInformation& vertex_information =
+              mission.vertices_and_time[interval_index];
+          const int start_index =
+              mission.interval_index_ranges[interval_index].first;
+          const int end_index =
+              mission.interval_index_ranges[interval_index].second;
+
+          buildListOfAllRequiredIMUMeasurements(
+              map, mission.sorted_timestamps,
+              vertex_information.outgoing_imu_edge_id, start_index, end_index,
+              &imu_timestamps, &imu_data);
+          computeRequestedPosesInRange(
+              map,
+              map.getSensorManager().getSensorForMission<vi_map::Imu>(
+                  mission.mission_id),
+              vertex_information.vertex_id, imu_timestamps, imu_data,
+              mission.sorted_timestamps, start_index, end_index,
+              &interval_poses_M_I);
+          CHECK_EQ(
+              static_cast<int>(interval_poses_M_I.size()),
+              end_index - start_index + 1);
+
+          for (int i = start_index; i <= end_index; ++i) {
+            if (mission.interval_of_timestamp[i] ==
+                static_cast<int>(interval_index)) {
+              mission.sorted_poses_M_I[i] =
+                  interval_poses_M_I[i - start_index];
+            }
+          }
+        }
+      },
+      kAlwaysParallelize, num_threads);
+
+  // Copy the interpolated poses to the output in the order of the requests.
+  poses_M_I->resize(pose_timestamps.cols());
+  for (const MissionRequests& mission : missions) {
+    for (size_t i = 0u; i < mission.sorted_timestamps.size(); ++i) {
+      CHECK_GE(mission.interval_of_timestamp[i], 0)
+          << ": No interpolated pose at time: "
+          << mission.sorted_timestamps[i];
+      (*poses_M_I)[mission.request_indices[i]] = mission.sorted_poses_M_I[i];
+    }
   }
 }
 
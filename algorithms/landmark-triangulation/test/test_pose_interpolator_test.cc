@@ -139,6 +139,52 @@ TEST_F(ViwlsGraph, PoseInterpolationTestBetweenVertices) {
   }
 }
 
+TEST_F(ViwlsGraph, PoseInterpolationTestBatchedUnsortedRequests) {
+  vimap_gen_.generateVIMap();
+  vi_map::VIMap& vi_map = vimap_gen_.vi_map_;
+  const Eigen::VectorXd& imu_timestamps_seconds =
+      vimap_gen_.graph_gen_.imu_timestamps_seconds_;
+  ASSERT_GT(imu_timestamps_seconds.rows(), 2);
+
+  vi_map::MissionIdList mission_ids;
+  vi_map.getAllMissionIds(&mission_ids);
+  CHECK_EQ(mission_ids.size(), 1u);
+  const vi_map::MissionId& mission_id = mission_ids[0];
+
+  // Request the timestamps of the first half of the data twice, once in
+  // reverse order.
+  const int num_timestamps = imu_timestamps_seconds.rows() / 2;
+  Eigen::Matrix<int64_t, 1, Eigen::Dynamic> sorted_timestamps(num_timestamps);
+  Eigen::Matrix<int64_t, 1, Eigen::Dynamic> requested_timestamps(
+      2 * num_timestamps);
+  constexpr double kSecondsToNanoSeconds = 1e9;
+  for (int i = 0; i < num_timestamps; ++i) {
+    sorted_timestamps(0, i) =
+        kSecondsToNanoSeconds * imu_timestamps_seconds(i, 0);
+    requested_timestamps(0, num_timestamps - 1 - i) = sorted_timestamps(0, i);
+    requested_timestamps(0, num_timestamps + i) = sorted_timestamps(0, i);
+  }
+  const vi_map::MissionIdList requested_mission_ids(
+      requested_timestamps.cols(), mission_id);
+
+  PoseInterpolator pose_interpolator;
+  aslam::TransformationVector T_M_I_sorted;
+  pose_interpolator.getPosesAtTime(
+      vi_map, mission_id, sorted_timestamps, &T_M_I_sorted);
+  aslam::TransformationVector T_M_I_requested;
+  pose_interpolator.getPosesAtTime(
+      vi_map, requested_mission_ids, requested_timestamps, &T_M_I_requested);
+
+  ASSERT_EQ(static_cast<int>(T_M_I_sorted.size()), num_timestamps);
+  ASSERT_EQ(static_cast<int>(T_M_I_requested.size()), 2 * num_timestamps);
+  for (int i = 0; i < num_timestamps; ++i) {
+    EXPECT_NEAR_ASLAM_TRANSFORMATION(
+        T_M_I_sorted[i], T_M_I_requested[num_timestamps - 1 - i], 1e-12);
+    EXPECT_NEAR_ASLAM_TRANSFORMATION(
+        T_M_I_sorted[i], T_M_I_requested[num_timestamps + i], 1e-12);
+  }
+}
+
 }  // namespace landmark_triangulation
 
 MAPLAB_UNITTEST_ENTRYPOINT
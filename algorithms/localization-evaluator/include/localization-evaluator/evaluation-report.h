@@ -0,0 +1,147 @@
+#ifndef LOCALIZATION_EVALUATOR_EVALUATION_REPORT_H_
+#define LOCALIZATION_EVALUATOR_EVALUATION_REPORT_H_
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <posegraph/unique-id.h>
+#include <vi-map/unique-id.h>
+#include <yaml-cpp/yaml.h>
+
+namespace localization_evaluator {
+
+// Outcome of localizing a single query vertex against the database.
+struct QueryResult {
+  QueryResult()
+      : localized(false),
+        ransac_ok(false),
+        lc_matches_count(0u),
+        inliers_count(0u),
+        error_meters(std::numeric_limits<double>::infinity()),
+        latency_seconds(0.0),
+        p_G_I(Eigen::Vector3d::Zero()) {}
+
+  vi_map::MissionId mission_id;
+  pose_graph::VertexId vertex_id;
+  // RANSAC succeeded and the position error is below the threshold.
+  bool localized;
+  bool ransac_ok;
+  unsigned int lc_matches_count;
+  unsigned int inliers_count;
+  // Infinity if RANSAC failed.
+  double error_meters;
+  // Time spent in the loop detector query.
+  double latency_seconds;
+  // Localized position, not part of the report.
+  Eigen::Vector3d p_G_I;
+};
+typedef std::vector<QueryResult> QueryResultList;
+
+struct DistributionSummary {
+  DistributionSummary()
+      : num_samples(0u),
+        mean(0.0),
+        min(0.0),
+        p50(0.0),
+        p90(0.0),
+        p99(0.0),
+        max(0.0) {}
+
+  size_t num_samples;
+  double mean;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
+
+// The percentiles use the nearest-rank method, i.e. they are always one of
+// the samples. All values are zero if there are no samples.
+void summarizeDistribution(
+    const std::vector<double>& samples, DistributionSummary* summary);
+
+struct EvaluationSummary {
+  EvaluationSummary()
+      : num_queries(0u), num_localized(0u), num_ransac_ok(0u), recall(0.0) {}
+
+  // "all" or the id of the query mission.
+  std::string name;
+  size_t num_queries;
+  size_t num_localized;
+  size_t num_ransac_ok;
+  double recall;
+  DistributionSummary latency_milliseconds;
+  // Only over the queries for which RANSAC succeeded.
+  DistributionSummary error_meters;
+  DistributionSummary inliers_count;
+};
+
+struct LocalizationEvaluationReport {
+  LocalizationEvaluationReport()
+      : position_error_threshold_meters(0.0),
+        num_threads(0u),
+        wall_time_seconds(0.0) {}
+
+  double position_error_threshold_meters;
+  size_t num_threads;
+  double wall_time_seconds;
+  EvaluationSummary overall;
+  std::vector<EvaluationSummary> missions;
+  QueryResultList queries;
+};
+
+// Summarizes the results over all queries and per query mission, in the
+// order the missions first appear in the results.
+void createEvaluationReport(
+    const QueryResultList& results,
+    const double position_error_threshold_meters, const size_t num_threads,
+    const double wall_time_seconds, LocalizationEvaluationReport* report);
+
+void printEvaluationReport(const LocalizationEvaluationReport& report);
+
+// Returns false if the overall recall is below min_recall or the p99 latency
+// exceeds max_p99_latency_milliseconds. Thresholds <= 0 are not checked.
+bool checkEvaluationReport(
+    const LocalizationEvaluationReport& report, const double min_recall,
+    const double max_p99_latency_milliseconds);
+
+}  // namespace localization_evaluator
+
+namespace YAML {
+template <>
+struct convert<localization_evaluator::QueryResult> {
+  static Node encode(const localization_evaluator::QueryResult& rhs);
+  static bool decode(
+      const Node& node, localization_evaluator::QueryResult& rhs);  // NOLINT
+};
+
+template <>
+struct convert<localization_evaluator::DistributionSummary> {
+  static Node encode(const localization_evaluator::DistributionSummary& rhs);
+  static bool decode(
+      const Node& node,
+      localization_evaluator::DistributionSummary& rhs);  // NOLINT
+};
+
+template <>
+struct convert<localization_evaluator::EvaluationSummary> {
+  static Node encode(const localization_evaluator::EvaluationSummary& rhs);
+  static bool decode(
+      const Node& node,
+      localization_evaluator::EvaluationSummary& rhs);  // NOLINT
+};
+
+template <>
+struct convert<localization_evaluator::LocalizationEvaluationReport> {
+  static Node encode(
+      const localization_evaluator::LocalizationEvaluationReport& rhs);
+  static bool decode(
+      const Node& node,
+      localization_evaluator::LocalizationEvaluationReport& rhs);  // NOLINT
+};
+}  // namespace YAML
+
+#endif  // LOCALIZATION_EVALUATOR_EVALUATION_REPORT_H_
@@ -6,9 +6,14 @@
 
 #include <Eigen/Core>
 #include <aslam/common/memory.h>
+#include <gflags/gflags.h>
 #include <loop-closure-handler/loop-detector-node.h>
 #include <vi-map/vi-map.h>
 
+#include "localization-evaluator/evaluation-report.h"
+
+DECLARE_double(benchmark_position_error_threshold);
+
 namespace localization_evaluator {
 
 struct MissionEvaluationStats {
@@ -37,9 +42,20 @@ class LocalizationEvaluator {
       const pose_graph::VertexId& vertex_id, Eigen::Vector3d* p_G_I,
       unsigned int* lc_matches_count, unsigned int* inliers_count,
       double* error_meters, bool* ransac_ok);
+  // Returns true if the vertex was localized, i.e. if result->localized is
+  // set. The mission id of the result is not touched.
+  bool evaluateSingleKeyframe(
+      const pose_graph::VertexId& vertex_id, QueryResult* result);
   void evaluateMission(
       const vi_map::MissionId& mission_id, MissionEvaluationStats* statistics);
 
+  // Localizes every vertex of the query missions. The queries of all missions
+  // are split across the threads, which share the loop detector as it is only
+  // read. The results are in mission and vertex order.
+  void evaluateMissions(
+      const vi_map::MissionIdList& query_mission_ids, const size_t num_threads,
+      QueryResultList* results);
+
  private:
   vi_map::VIMap* map_;
   loop_detector_node::LoopDetectorNode loop_detector_node_;
@@ -0,0 +1,301 @@
+#include "localization-evaluator/evaluation-report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+namespace localization_evaluator {
+namespace {
+
+void summarizeQueries(
+    const std::string& name, const QueryResultList& results,
+    const std::vector<size_t>& query_indices, EvaluationSummary* summary) {
+  CHECK_NOTNULL(summary);
+  summary->name = name;
+  summary->num_queries = query_indices.size();
+  summary->num_localized = 0u;
+  summary->num_ransac_ok = 0u;
+
+  std::vector<double> latencies_milliseconds;
+  std::vector<double> errors_meters;
+  std::vector<double> inliers_counts;
+  latencies_milliseconds.reserve(query_indices.size());
+  for (const size_t query_index : query_indices) {
+    CHECK_LT(query_index, results.size());
+    const QueryResult& result = results[query_index];
+    latencies_milliseconds.push_back(result.latency_seconds * 1e3);
+    if (result.localized) {
+      ++summary->num_localized;
+    }
+    if (result.ransac_ok) {
+      ++summary->num_ransac_ok;
+      errors_meters.push_back(result.error_meters);
+      inliers_counts.push_back(result.inliers_count);
+    }
+  }
+  summary->recall = summary->num_queries > 0u
+                        ? static_cast<double>(summary->num_localized) /
+                              summary->num_queries
+                        : 0.0;
+  summarizeDistribution(latencies_milliseconds, &summary->latency_milliseconds);
+  summarizeDistribution(errors_meters, &summary->error_meters);
+  summarizeDistribution(inliers_counts, &summary->inliers_count);
+}
+
+void printSummary(const EvaluationSummary& summary, std::ostream* out) {
+  CHECK_NOTNULL(out);
+  *out << std::setw(34) << std::left << summary.name << std::right
+       << std::setw(8) << summary.num_queries << std::setw(10) << std::fixed
+       << std::setprecision(3) << summary.recall << std::setw(10)
+       << summary.latency_milliseconds.p50 << std::setw(10)
+       << summary.latency_milliseconds.p99 << std::setw(10)
+       << summary.error_meters.p50 << "\n";
+}
+
+}  // namespace
+
+void summarizeDistribution(
+    const std::vector<double>& samples, DistributionSummary* summary) {
+  CHECK_NOTNULL(summary);
+  *summary = DistributionSummary();
+  if (samples.empty()) {
+    return;
+  }
+  std::vector<double> sorted_samples = samples;
+  std::sort(sorted_samples.begin(), sorted_samples.end());
+  const size_t num_samples = sorted_samples.size();
+
+  auto percentile = [&sorted_samples, num_samples](const double fraction) {
+    const size_t rank = static_cast<size_t>(std::ceil(fraction * num_samples));
+    return sorted_samples[std::max<size_t>(rank, 1u) - 1u];
+  };
+
+  summary->num_samples = num_samples;
+  summary->mean =
+      std::accumulate(sorted_samples.begin(), sorted_samples.end(), 0.0) /
+      num_samples;
+  summary->min = sorted_samples.front();
+  summary->p50 = percentile(0.5);
+  summary->p90 = percentile(0.9);
+  summary->p99 = percentile(0.99);
+  summary->max = sorted_samples.back();
+}
+
+void createEvaluationReport(
+    const QueryResultList& results,
+    const double position_error_threshold_meters, const size_t num_threads,
+    const double wall_time_seconds, LocalizationEvaluationReport* report) {
+  CHECK_NOTNULL(report);
+  report->position_error_threshold_meters = position_error_threshold_meters;
+  report->num_threads = num_threads;
+  report->wall_time_seconds = wall_time_seconds;
+  report->queries = results;
+
+  std::vector<size_t> all_query_indices(results.size());
+  std::iota(all_query_indices.begin(), all_query_indices.end(), 0u);
+  summarizeQueries("all", results, all_query_indices, &report->overall);
+
+  vi_map::MissionIdList mission_ids;
+  std::unordered_map<vi_map::MissionId, std::vector<size_t>>
+      mission_query_indices;
+  for (size_t query_index = 0u; query_index < results.size(); ++query_index) {
+    const vi_map::MissionId& mission_id = results[query_index].mission_id;
+    std::vector<size_t>& query_indices = mission_query_indices[mission_id];
+    if (query_indices.empty()) {
+      mission_ids.push_back(mission_id);
+    }
+    query_indices.push_back(query_index);
+  }
+
+  report->missions.clear();
+  report->missions.resize(mission_ids.size());
+  for (size_t mission_idx = 0u; mission_idx < mission_ids.size();
+       ++mission_idx) {
+    const vi_map::MissionId& mission_id = mission_ids[mission_idx];
+    summarizeQueries(
+        mission_id.hexString(), results, mission_query_indices[mission_id],
+        &report->missions[mission_idx]);
+  }
+}
+
+void printEvaluationReport(const LocalizationEvaluationReport& report) {
+  std::stringstream out;
+  out << "\nLocalization evaluation with " << report.num_threads
+      << " threads took " << report.wall_time_seconds << " s.\n";
+  out << std::setw(34) << std::left << "query missions" << std::right
+      << std::setw(8) << "queries" << std::setw(10) << "recall"
+      << std::setw(10) << "p50 [ms]" << std::setw(10) << "p99 [ms]"
+      << std::setw(10) << "p50 [m]"
+      << "\n";
+  for (const EvaluationSummary& summary : report.missions) {
+    printSummary(summary, &out);
+  }
+  printSummary(report.overall, &out);
+  LOG(INFO) << out.str();
+}
+
+bool checkEvaluationReport(
+    const LocalizationEvaluationReport& report, const double min_recall,
+    const double max_p99_latency_milliseconds) {
+  bool passed = true;
+  if (min_recall > 0.0 && report.overall.recall < min_recall) {
+    LOG(ERROR) << "The recall of " << report.overall.recall
+               << " is below the required " << min_recall << ".";
+    passed = false;
+  }
+  if (max_p99_latency_milliseconds > 0.0 &&
+      report.overall.latency_milliseconds.p99 > max_p99_latency_milliseconds) {
+    LOG(ERROR) << "The p99 latency of "
+               << report.overall.latency_milliseconds.p99
+               << " ms exceeds the allowed " << max_p99_latency_milliseconds
+               << " ms.";
+    passed = false;
+  }
+  return passed;
+}
+
+}  // namespace localization_evaluator
+
+namespace YAML {
+
+Node convert<localization_evaluator::QueryResult>::encode(
+    const localization_evaluator::QueryResult& rhs) {
+  Node node;
+  node["mission_id"] = rhs.mission_id.hexString();
+  node["vertex_id"] = rhs.vertex_id.hexString();
+  node["localized"] = rhs.localized;
+  node["ransac_ok"] = rhs.ransac_ok;
+  node["lc_matches_count"] = rhs.lc_matches_count;
+  node["inliers_count"] = rhs.inliers_count;
+  // The error is only defined if RANSAC succeeded.
+  if (rhs.ransac_ok) {
+    node["error_meters"] = rhs.error_meters;
+  }
+  node["latency_seconds"] = rhs.latency_seconds;
+  return node;
+}
+
+bool convert<localization_evaluator::QueryResult>::decode(
+    const Node& node, localization_evaluator::QueryResult& rhs) {  // NOLINT
+  if (!node.IsMap()) {
+    return false;
+  }
+  rhs = localization_evaluator::QueryResult();
+  if (!rhs.mission_id.fromHexString(node["mission_id"].as<std::string>()) ||
+      !rhs.vertex_id.fromHexString(node["vertex_id"].as<std::string>())) {
+    return false;
+  }
+  rhs.localized = node["localized"].as<bool>();
+  rhs.ransac_ok = node["ransac_ok"].as<bool>();
+  rhs.lc_matches_count = node["lc_matches_count"].as<unsigned int>();
+  rhs.inliers_count = node["inliers_count"].as<unsigned int>();
+  if (node["error_meters"]) {
+    rhs.error_meters = node["error_meters"].as<double>();
+  }
+  rhs.latency_seconds = node["latency_seconds"].as<double>();
+  return true;
+}
+
+Node convert<localization_evaluator::DistributionSummary>::encode(
+    const localization_evaluator::DistributionSummary& rhs) {
+  Node node;
+  node["num_samples"] = rhs.num_samples;
+  node["mean"] = rhs.mean;
+  node["min"] = rhs.min;
+  node["p50"] = rhs.p50;
+  node["p90"] = rhs.p90;
+  node["p99"] = rhs.p99;
+  node["max"] = rhs.max;
+  return node;
+}
+
+bool convert<localization_evaluator::DistributionSummary>::decode(
+    const Node& node,
+    localization_evaluator::DistributionSummary& rhs) {  // NOLINT
+  if (!node.IsMap()) {
+    return false;
+  }
+  rhs.num_samples = node["num_samples"].as<size_t>();
+  rhs.mean = node["mean"].as<double>();
+  rhs.min = node["min"].as<double>();
+  rhs.p50 = node["p50"].as<double>();
+  rhs.p90 = node["p90"].as<double>();
+  rhs.p99 = node["p99"].as<double>();
+  rhs.max = node["max"].as<double>();
+  return true;
+}
+
+Node convert<localization_evaluator::EvaluationSummary>::encode(
+    const localization_evaluator::EvaluationSummary& rhs) {
+  Node node;
+  node["name"] = rhs.name;
+  node["num_queries"] = rhs.num_queries;
+  node["num_localized"] = rhs.num_localized;
+  node["num_ransac_ok"] = rhs.num_ransac_ok;
+  node["recall"] = rhs.recall;
+  node["latency_milliseconds"] = rhs.latency_milliseconds;
+  node["error_meters"] = rhs.error_meters;
+  node["inliers_count"] = rhs.inliers_count;
+  return node;
+}
+
+bool convert<localization_evaluator::EvaluationSummary>::decode(
+    const Node& node,
+    localization_evaluator::EvaluationSummary& rhs) {  // NOLINT
+  if (!node.IsMap()) {
+    return false;
+  }
+  rhs.name = node["name"].as<std::string>();
+  rhs.num_queries = node["num_queries"].as<size_t>();
+  rhs.num_localized = node["num_localized"].as<size_t>();
+  rhs.num_ransac_ok = node["num_ransac_ok"].as<size_t>();
+  rhs.recall = node["recall"].as<double>();
+  rhs.latency_milliseconds =
+      node["latency_milliseconds"]
+          .as<localization_evaluator::DistributionSummary>();
+  rhs.error_meters =
+      node["error_meters"].as<localization_evaluator::DistributionSummary>();
+  rhs.inliers_count =
+      node["inliers_count"].as<localization_evaluator::DistributionSummary>();
+  return true;
+}
+
+Node convert<localization_evaluator::LocalizationEvaluationReport>::encode(
+    const localization_evaluator::LocalizationEvaluationReport& rhs) {
+  Node node;
+  node["position_error_threshold_meters"] =
+      rhs.position_error_threshold_meters;
+  node["num_threads"] = rhs.num_threads;
+  node["wall_time_seconds"] = rhs.wall_time_seconds;
+  node["overall"] = rhs.overall;
+  node["missions"] = rhs.missions;
+  node["queries"] = rhs.queries;
+  return node;
+}
+
+bool convert<localization_evaluator::LocalizationEvaluationReport>::decode(
+    const Node& node,
+    localization_evaluator::LocalizationEvaluationReport& rhs) {  // NOLINT
+  if (!node.IsMap()) {
+    return false;
+  }
+  rhs.position_error_threshold_meters =
+      node["position_error_threshold_meters"].as<double>();
+  rhs.num_threads = node["num_threads"].as<size_t>();
+  rhs.wall_time_seconds = node["wall_time_seconds"].as<double>();
+  rhs.overall =
+      node["overall"].as<localization_evaluator::EvaluationSummary>();
+  rhs.missions =
+      node["missions"]
+          .as<std::vector<localization_evaluator::EvaluationSummary>>();
+  rhs.queries =
+      node["queries"].as<localization_evaluator::QueryResultList>();
+  return true;
+}
+
+}  // namespace YAML
@@ -1,5 +1,10 @@
 #include "localization-evaluator/localization-evaluator.h"
 
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <vector>
+
 #include <Eigen/Core>
 #include <aslam/common/statistics/statistics.h>
 #include <loop-closure-handler/loop-closure-handler.h>
@@ -22,6 +27,20 @@ bool LocalizationEvaluator::evaluateSingleKeyframe(
   CHECK_NOTNULL(error_meters);
   CHECK_NOTNULL(ransac_ok);
 
+  QueryResult result;
+  evaluateSingleKeyframe(query_vertex_id, &result);
+  *pnp_p_G_I = result.p_G_I;
+  *lc_matches_count = result.lc_matches_count;
+  *inliers_count = result.inliers_count;
+  *error_meters = result.error_meters;
+  *ransac_ok = result.ransac_ok;
+  return result.localized;
+}
+
+bool LocalizationEvaluator::evaluateSingleKeyframe(
+    const pose_graph::VertexId& query_vertex_id, QueryResult* result) {
+  CHECK_NOTNULL(result);
+
   statistics::StatsCollector stats_collector_error_successes(
       "LocalizationEvaluator -- successes");
   statistics::StatsCollector stats_collector_error_norm(
@@ -34,107 +53,78 @@ bool LocalizationEvaluator::evaluateSingleKeyframe(
   CHECK(map_->hasVertex(query_vertex_id))
       << "Couldn't find map vertex with ID: " << query_vertex_id.hexString();
   const vi_map::Vertex& query_vertex = map_->getVertex(query_vertex_id);
+  result->vertex_id = query_vertex_id;
 
   const bool kMergeLandmarks = false;
   const bool kAddLoopclosureEdges = false;
   vi_map::LoopClosureConstraint inlier_constraints;
   pose::Transformation pnp_T_G_I;
-  *ransac_ok = loop_detector_node_.findVertexInDatabase(
+  const std::chrono::steady_clock::time_point query_start_time =
+      std::chrono::steady_clock::now();
+  result->ransac_ok = loop_detector_node_.findVertexInDatabase(
       query_vertex, kMergeLandmarks, kAddLoopclosureEdges, map_, &pnp_T_G_I,
-      lc_matches_count, &inlier_constraints);
-  *inliers_count = inlier_constraints.structure_matches.size();
-  *pnp_p_G_I = pnp_T_G_I.getPosition();
+      &result->lc_matches_count, &inlier_constraints);
+  result->latency_seconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - query_start_time)
+          .count();
+  result->inliers_count = inlier_constraints.structure_matches.size();
+  result->p_G_I = pnp_T_G_I.getPosition();
 
   Eigen::Vector3d p_G_I = map_->getVertex_G_p_I(query_vertex_id);
   double position_error = (p_G_I - pnp_T_G_I.getPosition()).norm();
 
-  stats_collector_matches.AddSample(*lc_matches_count);
-  stats_collector_ransac_inliers.AddSample(*inliers_count);
+  stats_collector_matches.AddSample(result->lc_matches_count);
+  stats_collector_ransac_inliers.AddSample(result->inliers_count);
 
-  if (*ransac_ok) {
+  if (result->ransac_ok) {
     VLOG(1) << "\t" << pnp_T_G_I.getPosition().transpose() << " vs "
             << p_G_I.transpose() << " --> norm: " << position_error << " [m]";
     stats_collector_error_norm.AddSample(position_error);
-    *error_meters = position_error;
+    result->error_meters = position_error;
   } else {
-    LOG(WARNING) << "\tRansac failed:" << *lc_matches_count << " matches, "
-                 << *inliers_count << " inliers.";
-    *error_meters = std::numeric_limits<double>::infinity();
+    LOG(WARNING) << "\tRansac failed:" << result->lc_matches_count
+                 << " matches, " << result->inliers_count << " inliers.";
+    result->error_meters = std::numeric_limits<double>::infinity();
   }
-  if (*ransac_ok && position_error < FLAGS_benchmark_position_error_threshold) {
+  if (result->ransac_ok &&
+      position_error < FLAGS_benchmark_position_error_threshold) {
     stats_collector_error_successes.AddSample(1.0);
-    return true;
+    CHECK_GE(result->lc_matches_count, result->inliers_count);
+    result->localized = true;
   } else {
     LOG(WARNING) << "\tCouldn't localize " << query_vertex_id;
     stats_collector_error_successes.AddSample(0.0);
-    return false;
+    result->localized = false;
   }
+  return result->localized;
 }
 
 void LocalizationEvaluator::evaluateMission(
     const vi_map::MissionId& mission_id, MissionEvaluationStats* statistics) {
   CHECK_NOTNULL(statistics);
 
-  pose_graph::VertexIdList vertices;
-  map_->getAllVertexIdsInMission(mission_id, &vertices);
-
-  std::vector<char> is_correct;
-  std::vector<char> ransac_ok;
-  std::vector<unsigned int> inlier_counts;
-  std::vector<unsigned int> lc_matches_counts;
-  Aligned<std::vector, Eigen::Vector3d> localization_p_G_I;
-  is_correct.resize(vertices.size(), false);
-  ransac_ok.resize(vertices.size(), false);
-  inlier_counts.resize(vertices.size(), 0u);
-  lc_matches_counts.resize(vertices.size(), 0u);
-  localization_p_G_I.resize(vertices.size(), Eigen::Vector3d::Zero());
-  std::vector<double> errors_meters(
-      vertices.size(), std::numeric_limits<double>::infinity());
-
-  std::function<void(const std::vector<size_t>&)> pose_query =
-      [this, &vertices, &is_correct, &inlier_counts, &lc_matches_counts,
-       &localization_p_G_I, &errors_meters,
-       &ransac_ok](const std::vector<size_t>& batch) {
-        for (size_t item : batch) {
-          const pose_graph::VertexId& vertex_id = vertices[item];
-          Eigen::Vector3d& pnp_p_G_I = localization_p_G_I[item];
-          unsigned int& lc_matches_count = lc_matches_counts[item];
-          unsigned int& inliers_count = inlier_counts[item];
-          double& error_meters = errors_meters[item];
-          bool ransac_ok_item;
-          if (evaluateSingleKeyframe(
-                  vertex_id, &pnp_p_G_I, &lc_matches_count, &inliers_count,
-                  &error_meters, &ransac_ok_item)) {
-            CHECK_GE(lc_matches_count, inliers_count);
-            is_correct[item] = true;
-          }
-          ransac_ok[item] = ransac_ok_item;
-        }
-      };
-
-  constexpr bool kAlwaysParallelize = true;
-  const size_t num_threads = common::getNumHardwareThreads();
-  common::ParallelProcess(
-      is_correct.size(), pose_query, kAlwaysParallelize, num_threads);
+  QueryResultList results;
+  evaluateMissions(
+      vi_map::MissionIdList{mission_id}, common::getNumHardwareThreads(),
+      &results);
 
   // Copy back all valid results.
   statistics->num_vertices = 0u;
   statistics->successful_localizations = 0u;
-  statistics->inliers_counts.reserve(vertices.size());
-  statistics->lc_matches_counts.reserve(vertices.size());
-  statistics->localization_p_G_I.reserve(vertices.size());
-  statistics->num_vertices = 0u;
-  statistics->successful_localizations = 0u;
-  for (size_t i = 0; i < is_correct.size(); ++i) {
-    if (is_correct[i]) {
-      statistics->localization_p_G_I.emplace_back(localization_p_G_I[i]);
+  statistics->inliers_counts.reserve(results.size());
+  statistics->lc_matches_counts.reserve(results.size());
+  statistics->localization_p_G_I.reserve(results.size());
+  for (const QueryResult& result : results) {
+    if (result.localized) {
+      statistics->localization_p_G_I.emplace_back(result.p_G_I);
       ++statistics->successful_localizations;
-    } else if (ransac_ok[i]) {
-      statistics->bad_localization_p_G_I.emplace_back(localization_p_G_I[i]);
+    } else if (result.ransac_ok) {
+      statistics->bad_localization_p_G_I.emplace_back(result.p_G_I);
     }
-    statistics->inliers_counts.emplace_back(inlier_counts[i]);
-    statistics->lc_matches_counts.emplace_back(lc_matches_counts[i]);
-    statistics->localization_errors_meters.emplace_back(errors_meters[i]);
+    statistics->inliers_counts.emplace_back(result.inliers_count);
+    statistics->lc_matches_counts.emplace_back(result.lc_matches_count);
+    statistics->localization_errors_meters.emplace_back(result.error_meters);
     ++statistics->num_vertices;
   }
 
@@ -149,4 +139,36 @@ void LocalizationEvaluator::evaluateMission(
   }
 }
 
+void LocalizationEvaluator::evaluateMissions(
+    const vi_map::MissionIdList& query_mission_ids, const size_t num_threads,
+    QueryResultList* results) {
+  CHECK_NOTNULL(results)->clear();
+  CHECK_GT(num_threads, 0u);
+
+  for (const vi_map::MissionId& mission_id : query_mission_ids) {
+    pose_graph::VertexIdList vertices;
+    map_->getAllVertexIdsInMission(mission_id, &vertices);
+    for (const pose_graph::VertexId& vertex_id : vertices) {
+      results->emplace_back();
+      results->back().mission_id = mission_id;
+      results->back().vertex_id = vertex_id;
+    }
+  }
+  if (results->empty()) {
+    return;
+  }
+
+  std::function<void(const std::vector<size_t>&)> pose_query =
+      [this, results](const std::vector<size_t>& batch) {
+        for (const size_t item : batch) {
+          QueryResult& result = (*results)[item];
+          evaluateSingleKeyframe(result.vertex_id, &result);
+        }
+      };
+
+  constexpr bool kAlwaysParallelize = true;
+  common::ParallelProcess(
+      results->size(), pose_query, kAlwaysParallelize, num_threads);
+}
+
 }  // namespace localization_evaluator
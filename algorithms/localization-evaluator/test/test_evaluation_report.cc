@@ -0,0 +1,103 @@
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <maplab-common/unique-id.h>
+#include <yaml-cpp/yaml.h>
+
+#include "localization-evaluator/evaluation-report.h"
+
+namespace localization_evaluator {
+
+TEST(EvaluationReportTest, PercentilesUseNearestRank) {
+  std::vector<double> samples;
+  for (int i = 100; i >= 1; --i) {
+    samples.push_back(i);
+  }
+  DistributionSummary summary;
+  summarizeDistribution(samples, &summary);
+  EXPECT_EQ(summary.num_samples, 100u);
+  EXPECT_DOUBLE_EQ(summary.mean, 50.5);
+  EXPECT_EQ(summary.min, 1.0);
+  EXPECT_EQ(summary.p50, 50.0);
+  EXPECT_EQ(summary.p90, 90.0);
+  EXPECT_EQ(summary.p99, 99.0);
+  EXPECT_EQ(summary.max, 100.0);
+
+  summarizeDistribution({7.0}, &summary);
+  EXPECT_EQ(summary.p50, 7.0);
+  EXPECT_EQ(summary.p99, 7.0);
+
+  summarizeDistribution({}, &summary);
+  EXPECT_EQ(summary.num_samples, 0u);
+  EXPECT_EQ(summary.p99, 0.0);
+}
+
+TEST(EvaluationReportTest, ReportIsSummarizedPerMission) {
+  vi_map::MissionId mission_a, mission_b;
+  common::generateId(&mission_a);
+  common::generateId(&mission_b);
+
+  QueryResultList results(5u);
+  for (size_t i = 0u; i < results.size(); ++i) {
+    QueryResult& result = results[i];
+    result.mission_id = (i < 3u) ? mission_a : mission_b;
+    common::generateId(&result.vertex_id);
+    result.latency_seconds = 1e-3 * (i + 1u);
+    result.lc_matches_count = 20u;
+  }
+  results[0].ransac_ok = results[0].localized = true;
+  results[0].error_meters = 0.01;
+  results[0].inliers_count = 15u;
+  results[1].ransac_ok = true;
+  results[1].error_meters = 1.5;
+  results[1].inliers_count = 5u;
+  results[4].ransac_ok = results[4].localized = true;
+  results[4].error_meters = 0.02;
+  results[4].inliers_count = 12u;
+
+  LocalizationEvaluationReport report;
+  createEvaluationReport(results, 0.05, 4u, 2.0, &report);
+  EXPECT_EQ(report.overall.name, "all");
+  EXPECT_EQ(report.overall.num_queries, 5u);
+  EXPECT_EQ(report.overall.num_localized, 2u);
+  EXPECT_EQ(report.overall.num_ransac_ok, 3u);
+  EXPECT_DOUBLE_EQ(report.overall.recall, 0.4);
+  EXPECT_EQ(report.overall.error_meters.num_samples, 3u);
+  EXPECT_DOUBLE_EQ(report.overall.latency_milliseconds.p99, 5.0);
+
+  ASSERT_EQ(report.missions.size(), 2u);
+  EXPECT_EQ(report.missions[0].name, mission_a.hexString());
+  EXPECT_EQ(report.missions[0].num_queries, 3u);
+  EXPECT_EQ(report.missions[1].name, mission_b.hexString());
+  EXPECT_DOUBLE_EQ(report.missions[1].recall, 0.5);
+
+  EXPECT_TRUE(checkEvaluationReport(report, 0.0, 0.0));
+  EXPECT_TRUE(checkEvaluationReport(report, 0.4, 5.0));
+  EXPECT_FALSE(checkEvaluationReport(report, 0.5, 0.0));
+  EXPECT_FALSE(checkEvaluationReport(report, 0.0, 4.9));
+
+  const LocalizationEvaluationReport loaded_report =
+      YAML::Load(YAML::Dump(YAML::Node(report)))
+          .as<LocalizationEvaluationReport>();
+  EXPECT_EQ(loaded_report.num_threads, 4u);
+  EXPECT_EQ(loaded_report.overall.num_localized, 2u);
+  EXPECT_DOUBLE_EQ(
+      loaded_report.overall.latency_milliseconds.p99,
+      report.overall.latency_milliseconds.p99);
+  ASSERT_EQ(loaded_report.missions.size(), 2u);
+  EXPECT_EQ(loaded_report.missions[1].name, mission_b.hexString());
+  ASSERT_EQ(loaded_report.queries.size(), 5u);
+  EXPECT_EQ(loaded_report.queries[3].vertex_id, results[3].vertex_id);
+  EXPECT_FALSE(loaded_report.queries[3].ransac_ok);
+  EXPECT_EQ(
+      loaded_report.queries[3].error_meters,
+      std::numeric_limits<double>::infinity());
+  EXPECT_DOUBLE_EQ(loaded_report.queries[4].error_meters, 0.02);
+}
+
+}  // namespace localization_evaluator
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -145,6 +145,20 @@ class ViMappingTest : public ::testing::Test {
     const double avg_inlier_ratio =
         common::window_vec_ops::computeAverage(inlier_ratios, kInvalidValue);
     EXPECT_GT(avg_inlier_ratio, 0.75);
+
+    // The multi-mission evaluation reports the same queries with latencies.
+    constexpr size_t kNumThreads = 2u;
+    QueryResultList results;
+    evaluator.evaluateMissions({query_mission_id}, kNumThreads, &results);
+    ASSERT_EQ(results.size(), stats.num_vertices);
+    LocalizationEvaluationReport report;
+    createEvaluationReport(
+        results, FLAGS_benchmark_position_error_threshold, kNumThreads, 1.0,
+        &report);
+    EXPECT_GT(report.overall.recall, 0.95);
+    ASSERT_EQ(report.missions.size(), 1u);
+    EXPECT_EQ(report.missions[0].name, query_mission_id.hexString());
+    EXPECT_GT(report.overall.latency_milliseconds.p99, 0.0);
   }
 
  private:
@@ -357,10 +357,10 @@ void LoopDetectorNode::addLocalizationSummaryMapToDatabase(
   vi_map::LandmarkIdList observed_landmark_ids;
   localization_summary_map.getAllLandmarkIds(&observed_landmark_ids);
 
-  const Eigen::MatrixXf& projected_descriptors =
-      localization_summary_map.projectedDescriptors();
-
-  const int descriptor_dimensionality = projected_descriptors.rows();
+  const int num_projected_descriptors =
+      localization_summary_map.numProjectedDescriptors();
+  const int descriptor_dimensionality =
+      localization_summary_map.projectedDescriptorDimensions();
 
   const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
       observation_to_landmark_index =
@@ -389,9 +389,9 @@ void LoopDetectorNode::addLocalizationSummaryMapToDatabase(
 
     for (size_t i = 0; i < observations.size(); ++i) {
       const int observation_index = observations[i];
-      CHECK_LT(observation_index, projected_descriptors.cols());
-      projected_image.projected_descriptors.col(i) =
-          projected_descriptors.col(observation_index);
+      CHECK_LT(observation_index, num_projected_descriptors);
+      localization_summary_map.getProjectedDescriptor(
+          observation_index, projected_image.projected_descriptors.col(i));
 
       CHECK_LT(observation_index, observation_to_landmark_index.rows());
       const size_t landmark_index =
@@ -1,10 +1,16 @@
 #ifndef MATCHING_BASED_LOOPCLOSURE_TRAIN_VOCABULARY_H_
 #define MATCHING_BASED_LOOPCLOSURE_TRAIN_VOCABULARY_H_
+#include <vector>
+
 namespace vi_map {
 class VIMap;
 }  // namespace vi_map
 
 namespace loop_closure {
 void TrainProjectedVocabulary(const vi_map::VIMap& map);
+
+// Trains the vocabulary on a uniform random sample of the descriptors of all
+// given maps, see FLAGS_lc_num_descriptors_to_train.
+void TrainProjectedVocabulary(const std::vector<const vi_map::VIMap*>& maps);
 }  // namespace loop_closure
 #endif  // MATCHING_BASED_LOOPCLOSURE_TRAIN_VOCABULARY_H_
@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include <Eigen/Core>
@@ -11,7 +14,10 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <loopclosure-common/types.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 #include <vi-map/vi-map.h>
+#include <vocabulary-tree/mini-batch-kmeans.h>
 #include <vocabulary-tree/tree-builder.h>
 
 #include "matching-based-loopclosure/detector-settings.h"
@@ -33,6 +39,16 @@ DEFINE_int32(
 DEFINE_int32(
     lc_product_quantization_num_words, 256,
     "Number of words in the product vocabulary.");
+DEFINE_bool(
+    lc_vocabulary_use_mini_batch_kmeans, true,
+    "Train the vocabularies with parallel mini-batch k-means instead of "
+    "full-batch Lloyd iterations.");
+DEFINE_int32(
+    lc_mini_batch_kmeans_batch_size, 10000,
+    "Number of descriptors per mini-batch k-means iteration.");
+DEFINE_int32(
+    lc_mini_batch_kmeans_max_iterations, 300,
+    "Maximum number of mini-batch k-means iterations.");
 
 DECLARE_string(load_map);
 
@@ -45,25 +61,42 @@ typedef loop_closure::TreeBuilder<
     ProjectedDescriptorType,
     loop_closure::distance::L2<ProjectedDescriptorType>, FeatureAllocator>
     ProjectedTreeBuilder;
+typedef loop_closure::MiniBatchKmeans<ProjectedDescriptorType, FeatureAllocator>
+    ProjectedMiniBatchKmeans;
 
+// The number of threads is only respected by the mini-batch k-means, the
+// full-batch k-means always uses all hardware threads.
 void MakeVocabulary(
     int num_words, const DescriptorVector& descriptors,
-    int descriptor_dimensionality, Eigen::MatrixXf* words) {
+    int descriptor_dimensionality, size_t num_threads, Eigen::MatrixXf* words) {
   CHECK_NOTNULL(words);
   CHECK(!descriptors.empty());
 
-  ProjectedDescriptorType descriptor_zero;
-  descriptor_zero.setConstant(descriptor_dimensionality, 1, 0);
-
-  // Create tree.
-  static constexpr int kLevels = 1;
-  ProjectedTreeBuilder builder(descriptor_zero);
-  builder.kmeans().SetRestarts(1);
-  builder.Build(descriptors, num_words, kLevels);
-  VLOG(3) << "Done. Got " << builder.tree().centers().size() << " centers";
+  DescriptorVector centers;
+  if (FLAGS_lc_vocabulary_use_mini_batch_kmeans) {
+    CHECK_GT(FLAGS_lc_mini_batch_kmeans_batch_size, 0);
+    CHECK_GT(FLAGS_lc_mini_batch_kmeans_max_iterations, 0);
+    static constexpr int kRandomSeed = 42;
+    ProjectedMiniBatchKmeans kmeans;
+    kmeans.SetBatchSize(
+        static_cast<size_t>(FLAGS_lc_mini_batch_kmeans_batch_size));
+    kmeans.SetMaxIterations(
+        static_cast<size_t>(FLAGS_lc_mini_batch_kmeans_max_iterations));
+    kmeans.SetNumThreads(num_threads);
+    kmeans.Cluster(descriptors, num_words, kRandomSeed, &centers);
+  } else {
+    ProjectedDescriptorType descriptor_zero;
+    descriptor_zero.setConstant(descriptor_dimensionality, 1, 0);
+
+    // Create tree.
+    static constexpr int kLevels = 1;
+    ProjectedTreeBuilder builder(descriptor_zero);
+    builder.kmeans().SetRestarts(1);
+    builder.Build(descriptors, num_words, kLevels);
+    centers = builder.tree().centers();
+  }
+  VLOG(3) << "Done. Got " << centers.size() << " centers";
 
-  const descriptor_projection::DescriptorVector& centers =
-      builder.tree().centers();
   words->resize(descriptor_dimensionality, centers.size());
   for (size_t i = 0; i < centers.size(); ++i) {
     CHECK_EQ(centers[i].rows(), descriptor_dimensionality);
@@ -71,9 +104,17 @@ void MakeVocabulary(
   }
 }
 
+// Collects the descriptors of all missions of the given maps. If there are more
+// descriptors than FLAGS_lc_num_descriptors_to_train, a uniform random subset
+// of them is kept by reservoir sampling, such that only one mission at a time
+// is held in memory in addition to the training set and no map or mission is
+// preferred over the others.
 void LoadBinaryFeaturesFromDataset(
-    const vi_map::VIMap& map, loop_closure::DescriptorContainer* descriptors) {
+    const std::vector<const vi_map::VIMap*>& maps,
+    loop_closure::DescriptorContainer* descriptors) {
   CHECK_NOTNULL(descriptors);
+  CHECK(!maps.empty());
+  CHECK_GT(FLAGS_lc_num_descriptors_to_train, 0);
 
   // Get the descriptor-length.
   unsigned int descriptor_size = -1;
@@ -88,36 +129,54 @@ void LoadBinaryFeaturesFromDataset(
                  << FLAGS_feature_descriptor_type;
   }
 
-  CHECK_NOTNULL(descriptors);
-
-  vi_map::MissionIdList all_mission_ids;
-  map.getAllMissionIds(&all_mission_ids);
-
-  loop_closure::DescriptorContainer all_descriptors;
-  for (const vi_map::MissionId& mission_id : all_mission_ids) {
-    std::vector<descriptor_projection::Track> tracks;
-
-    loop_closure::DescriptorContainer mission_descriptors;
-    using descriptor_projection::CollectAndConvertDescriptors;
-    CollectAndConvertDescriptors(
-        map, mission_id, descriptor_size, raw_descriptor_matching_threshold,
-        &mission_descriptors, &tracks);
-    int old_size = all_descriptors.cols();
-    all_descriptors.conservativeResize(
-        Eigen::NoChange, old_size + mission_descriptors.cols());
-    all_descriptors.block(
-        0, old_size, mission_descriptors.rows(), mission_descriptors.cols()) =
-        mission_descriptors;
-    if (all_descriptors.cols() >= FLAGS_lc_num_descriptors_to_train) {
-      break;
+  const size_t max_num_descriptors = FLAGS_lc_num_descriptors_to_train;
+  static constexpr int kRandomSeed = 42;
+  std::mt19937 generator(kRandomSeed);
+  size_t num_collected_descriptors = 0u;
+
+  for (const vi_map::VIMap* map : maps) {
+    CHECK_NOTNULL(map);
+    vi_map::MissionIdList all_mission_ids;
+    map->getAllMissionIds(&all_mission_ids);
+
+    for (const vi_map::MissionId& mission_id : all_mission_ids) {
+      std::vector<descriptor_projection::Track> tracks;
+
+      loop_closure::DescriptorContainer mission_descriptors;
+      using descriptor_projection::CollectAndConvertDescriptors;
+      CollectAndConvertDescriptors(
+          *map, mission_id, descriptor_size, raw_descriptor_matching_threshold,
+          &mission_descriptors, &tracks);
+      if (mission_descriptors.cols() == 0) {
+        continue;
+      }
+      if (num_collected_descriptors == 0u) {
+        descriptors->resize(mission_descriptors.rows(), max_num_descriptors);
+      }
+      CHECK_EQ(mission_descriptors.rows(), descriptors->rows());
+
+      for (int i = 0; i < mission_descriptors.cols(); ++i) {
+        size_t sample_idx = num_collected_descriptors;
+        if (num_collected_descriptors >= max_num_descriptors) {
+          std::uniform_int_distribution<size_t> sample_distribution(
+              0u, num_collected_descriptors);
+          sample_idx = sample_distribution(generator);
+        }
+        if (sample_idx < max_num_descriptors) {
+          descriptors->col(sample_idx) = mission_descriptors.col(i);
+        }
+        ++num_collected_descriptors;
+      }
     }
   }
 
-  if (all_descriptors.cols() > FLAGS_lc_num_descriptors_to_train) {
-    LOG(WARNING) << "Truncated number of descriptors "
-                 << FLAGS_lc_num_descriptors_to_train;
-    all_descriptors.conservativeResize(
-        Eigen::NoChange, FLAGS_lc_num_descriptors_to_train);
+  CHECK_GT(num_collected_descriptors, 0u) << "The maps have no descriptors.";
+  if (num_collected_descriptors > max_num_descriptors) {
+    LOG(WARNING) << "Sampled " << max_num_descriptors << " out of "
+                 << num_collected_descriptors << " descriptors.";
+  } else {
+    descriptors->conservativeResize(
+        Eigen::NoChange, num_collected_descriptors);
   }
 }
 
@@ -135,16 +194,21 @@ void ProjectDescriptors(
   descriptor_zero.setConstant(FLAGS_lc_target_dimensionality, 1, 0);
 
   projected_descriptors->resize(descriptors.cols(), descriptor_zero);
-  for (int i = 0; i < descriptors.cols(); ++i) {
-    aslam::common::FeatureDescriptorConstRef raw_descriptor(
-        &descriptors.coeffRef(0, i), descriptors.rows());
-    descriptor_projection::ProjectDescriptor(
-        raw_descriptor, projection_matrix, FLAGS_lc_target_dimensionality,
-        (*projected_descriptors)[i]);
-    if (i % 10000 == 0) {
-      LOG(INFO) << "Projected " << i << "/" << descriptors.cols();
-    }
-  }
+  std::function<void(const std::vector<size_t>&)> project_descriptors =
+      [&](const std::vector<size_t>& range) {
+        for (const size_t i : range) {
+          aslam::common::FeatureDescriptorConstRef raw_descriptor(
+              &descriptors.coeffRef(0, i), descriptors.rows());
+          descriptor_projection::ProjectDescriptor(
+              raw_descriptor, projection_matrix, FLAGS_lc_target_dimensionality,
+              (*projected_descriptors)[i]);
+        }
+      };
+  static constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      descriptors.cols(), project_descriptors, kAlwaysParallelize,
+      common::getNumHardwareThreads());
+  LOG(INFO) << "Projected " << descriptors.cols() << " descriptors.";
 }
 
 void MakeProductVocabularies(
@@ -152,24 +216,31 @@ void MakeProductVocabularies(
     const Eigen::MatrixXf& base_vocabulary,
     Eigen::MatrixXf* product_vocabulary) {
   CHECK_NOTNULL(product_vocabulary);
+  CHECK(!input_descriptors.empty());
+  const size_t num_threads = common::getNumHardwareThreads();
+  static constexpr bool kAlwaysParallelize = false;
+
+  std::vector<int> best_words(input_descriptors.size());
+  std::function<void(const std::vector<size_t>&)> find_best_words =
+      [&](const std::vector<size_t>& range) {
+        for (const size_t i : range) {
+          (base_vocabulary.colwise() - input_descriptors[i])
+              .colwise()
+              .squaredNorm()
+              .minCoeff(&best_words[i]);
+        }
+      };
+  common::ParallelProcess(
+      input_descriptors.size(), find_best_words, kAlwaysParallelize,
+      num_threads);
+
   Aligned<std::vector, DescriptorVector> residuals;
   residuals.resize(base_vocabulary.cols());
-
-  for (const ProjectedDescriptorType& projected_descriptor :
-       input_descriptors) {
-    int best_word = 0;
-    float best_distance = std::numeric_limits<float>::max();
-    for (int i = 0; i < base_vocabulary.cols(); ++i) {
-      float distance =
-          (base_vocabulary.col(i) - projected_descriptor).squaredNorm();
-      if (distance < best_distance) {
-        best_distance = distance;
-        best_word = i;
-      }
-    }
+  for (size_t i = 0u; i < input_descriptors.size(); ++i) {
     // Calculate the residual w.r.t. to the closest vocabulary word.
+    const int best_word = best_words[i];
     ProjectedDescriptorType descriptor_residual =
-        projected_descriptor - base_vocabulary.col(best_word);
+        input_descriptors[i] - base_vocabulary.col(best_word);
     residuals[best_word].push_back(descriptor_residual);
   }
 
@@ -189,47 +260,81 @@ void MakeProductVocabularies(
   product_vocabulary->resize(
       num_dim_per_component, num_imi_words * num_components * num_pq_words);
 
-  int num_components_stored = 0;
   const unsigned int num_descriptors_per_training = num_pq_words * 200u;
 
-  for (const DescriptorVector& word_descriptors : residuals) {
-    for (int component = 0;
-         component < FLAGS_lc_product_quantization_num_components;
-         ++component) {
-      LOG(INFO) << "Training component " << num_components_stored << "/"
-                << num_imi_words * num_components;
-      DescriptorVector dim_for_component;
-      dim_for_component.reserve(word_descriptors.size());
-      const int start_block =
-          component * FLAGS_lc_product_quantization_num_dim_per_component;
-      const int block_size =
-          FLAGS_lc_product_quantization_num_dim_per_component;
-      for (const ProjectedDescriptorType& descriptor : word_descriptors) {
-        ProjectedDescriptorType sub_descriptor =
-            descriptor.block(start_block, 0, block_size, 1);
-        dim_for_component.push_back(sub_descriptor);
-        if (dim_for_component.size() >= num_descriptors_per_training) {
-          break;
+  // The trainings of the individual words and components are independent and
+  // small, so they are distributed over the threads as a whole. The full-batch
+  // k-means is parallelized internally and is therefore run one at a time.
+  const size_t num_trainings = num_imi_words * num_components;
+  const size_t num_parallel_trainings =
+      FLAGS_lc_vocabulary_use_mini_batch_kmeans ? num_threads : 1u;
+  static constexpr size_t kNumThreadsPerTraining = 1u;
+  std::function<void(const std::vector<size_t>&)> train_components =
+      [&](const std::vector<size_t>& range) {
+        for (const size_t training_idx : range) {
+          const DescriptorVector& word_descriptors =
+              residuals[training_idx / num_components];
+          const int component = training_idx % num_components;
+          VLOG(3) << "Training component " << training_idx << "/"
+                  << num_trainings;
+          DescriptorVector dim_for_component;
+          dim_for_component.reserve(
+              std::min<size_t>(
+                  word_descriptors.size(), num_descriptors_per_training));
+          const int start_block = component * num_dim_per_component;
+          for (const ProjectedDescriptorType& descriptor : word_descriptors) {
+            ProjectedDescriptorType sub_descriptor =
+                descriptor.block(start_block, 0, num_dim_per_component, 1);
+            dim_for_component.push_back(sub_descriptor);
+            if (dim_for_component.size() >= num_descriptors_per_training) {
+              break;
+            }
+          }
+          VLOG(3) << "Using " << dim_for_component.size() << " descriptors.";
+          Eigen::MatrixXf words_product_vocabulary;
+          MakeVocabulary(
+              num_pq_words, dim_for_component, num_dim_per_component,
+              kNumThreadsPerTraining, &words_product_vocabulary);
+          // Now store product vocabulary for component. Every training writes
+          // to its own block of columns.
+          CHECK_LE(
+              training_idx * num_pq_words + num_pq_words,
+              static_cast<size_t>(product_vocabulary->cols()));
+          product_vocabulary->block(
+              0, training_idx * num_pq_words, num_dim_per_component,
+              num_pq_words) = words_product_vocabulary;
         }
-      }
-      LOG(INFO) << "Using " << dim_for_component.size() << " descriptors.";
-      Eigen::MatrixXf words_product_vocabulary;
-      MakeVocabulary(
-          FLAGS_lc_product_quantization_num_words, dim_for_component,
-          block_size, &words_product_vocabulary);
-      // Now store product vocabulary for component.
-      CHECK_LE(
-          num_components_stored * num_pq_words + num_pq_words,
-          product_vocabulary->cols());
-      product_vocabulary->block(
-          0, num_components_stored * num_pq_words, num_dim_per_component,
-          num_pq_words) = words_product_vocabulary;
-      ++num_components_stored;
-    }
-  }
+      };
+  common::ParallelProcess(
+      num_trainings, train_components, kAlwaysParallelize,
+      num_parallel_trainings);
   LOG(INFO) << "Done with product vocabulary";
 }
 
+// Trains the vocabularies of both halves of an inverted multi-index at the
+// same time, each with half of the hardware threads.
+void MakeInvertedMultiIndexVocabularies(
+    const DescriptorVector& projected_descriptors_first_half,
+    const DescriptorVector& projected_descriptors_second_half,
+    int half_descriptor_length, Eigen::MatrixXf* words_first_half,
+    Eigen::MatrixXf* words_second_half) {
+  CHECK_NOTNULL(words_first_half);
+  CHECK_NOTNULL(words_second_half);
+  const size_t num_threads_per_half =
+      std::max<size_t>(1u, common::getNumHardwareThreads() / 2u);
+
+  LOG(INFO) << "Creating first and second vocabulary.";
+  std::thread first_half_thread([&]() {
+    MakeVocabulary(
+        FLAGS_lc_number_of_vocabulary_words, projected_descriptors_first_half,
+        half_descriptor_length, num_threads_per_half, words_first_half);
+  });
+  MakeVocabulary(
+      FLAGS_lc_number_of_vocabulary_words, projected_descriptors_second_half,
+      half_descriptor_length, num_threads_per_half, words_second_half);
+  first_half_thread.join();
+}
+
 void MakeVocabularies(
     const Eigen::MatrixXf& projection_matrix,
     const DescriptorVector& projected_descriptors) {
@@ -274,15 +379,9 @@ void MakeVocabularies(
       vocabulary.projection_matrix_ = projection_matrix;
       vocabulary.target_dimensionality_ = FLAGS_lc_target_dimensionality;
 
-      LOG(INFO) << "Creating first vocabulary.";
-      MakeVocabulary(
-          FLAGS_lc_number_of_vocabulary_words, projected_descriptors_first_half,
-          kHalfDescriptorLength, &vocabulary.words_first_half_);
-
-      LOG(INFO) << "Creating second vocabulary.";
-      MakeVocabulary(
-          FLAGS_lc_number_of_vocabulary_words,
-          projected_descriptors_second_half, kHalfDescriptorLength,
+      MakeInvertedMultiIndexVocabularies(
+          projected_descriptors_first_half, projected_descriptors_second_half,
+          kHalfDescriptorLength, &vocabulary.words_first_half_,
           &vocabulary.words_second_half_);
 
       std::ofstream out(
@@ -307,15 +406,9 @@ void MakeVocabularies(
       vocabulary.projection_matrix_ = projection_matrix;
       vocabulary.target_dimensionality_ = FLAGS_lc_target_dimensionality;
 
-      LOG(INFO) << "Creating first vocabulary.";
-      MakeVocabulary(
-          FLAGS_lc_number_of_vocabulary_words, projected_descriptors_first_half,
-          kHalfDescriptorLength, &vocabulary.words_first_half_);
-
-      LOG(INFO) << "Creating second vocabulary.";
-      MakeVocabulary(
-          FLAGS_lc_number_of_vocabulary_words,
-          projected_descriptors_second_half, kHalfDescriptorLength,
+      MakeInvertedMultiIndexVocabularies(
+          projected_descriptors_first_half, projected_descriptors_second_half,
+          kHalfDescriptorLength, &vocabulary.words_first_half_,
           &vocabulary.words_second_half_);
 
       vocabulary.number_of_components =
@@ -351,7 +444,8 @@ void MakeVocabularies(
     LOG(INFO) << "Creating vocabulary.";
     MakeVocabulary(
         FLAGS_lc_number_of_vocabulary_words, projected_descriptors,
-        FLAGS_lc_target_dimensionality, &vocabulary.words_);
+        FLAGS_lc_target_dimensionality, common::getNumHardwareThreads(),
+        &vocabulary.words_);
     std::ofstream out(
         FLAGS_lc_projected_quantizer_filename.c_str(), std::ios_base::binary);
     CHECK(out.is_open()) << "Failed to write quantizer file to "
@@ -363,7 +457,7 @@ void MakeVocabularies(
   }
 }
 
-void TrainProjectedVocabulary(const vi_map::VIMap& map) {
+void TrainProjectedVocabulary(const std::vector<const vi_map::VIMap*>& maps) {
   CHECK_NE(FLAGS_lc_projected_quantizer_filename, "")
       << "You have to provide a filename to write the quantizer to.";
 
@@ -380,7 +474,7 @@ void TrainProjectedVocabulary(const vi_map::VIMap& map) {
   CHECK_NE(0, projection_matrix.rows());
 
   loop_closure::DescriptorContainer raw_descriptors;
-  LoadBinaryFeaturesFromDataset(map, &raw_descriptors);
+  LoadBinaryFeaturesFromDataset(maps, &raw_descriptors);
 
   DescriptorVector projected_descriptors;
   ProjectDescriptors(
@@ -389,4 +483,8 @@ void TrainProjectedVocabulary(const vi_map::VIMap& map) {
   MakeVocabularies(projection_matrix, projected_descriptors);
   std::cout << "Done." << std::endl;
 }
+
+void TrainProjectedVocabulary(const vi_map::VIMap& map) {
+  TrainProjectedVocabulary(std::vector<const vi_map::VIMap*>({&map}));
+}
 }  // namespace loop_closure
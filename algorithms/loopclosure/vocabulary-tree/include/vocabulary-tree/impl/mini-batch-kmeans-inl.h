@@ -0,0 +1,315 @@
+#ifndef VOCABULARY_TREE_MINI_BATCH_KMEANS_INL_H_
+#define VOCABULARY_TREE_MINI_BATCH_KMEANS_INL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+
+namespace loop_closure {
+
+template <class Feature, class FeatureAllocator>
+MiniBatchKmeans<Feature, FeatureAllocator>::MiniBatchKmeans()
+    : batch_size_(1024u),
+      max_iterations_(100u),
+      max_no_improvement_(10u),
+      num_seeding_samples_per_center_(20u),
+      num_threads_(common::getNumHardwareThreads()) {}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::SetBatchSize(
+    size_t batch_size) {
+  CHECK_GT(batch_size, 0u);
+  batch_size_ = batch_size;
+}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::SetNumSeedingSamplesPerCenter(
+    size_t num_samples) {
+  CHECK_GT(num_samples, 0u);
+  num_seeding_samples_per_center_ = num_samples;
+}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::SetNumThreads(
+    size_t num_threads) {
+  CHECK_GT(num_threads, 0u);
+  num_threads_ = num_threads;
+}
+
+template <class Feature, class FeatureAllocator>
+typename MiniBatchKmeans<Feature, FeatureAllocator>::Scalar
+MiniBatchKmeans<Feature, FeatureAllocator>::Cluster(
+    const FeatureVector& features, size_t k, int random_seed,
+    FeatureVector* const centers) const {
+  CHECK_NOTNULL(centers);
+  CHECK(!features.empty());
+  CHECK_GT(k, 0u);
+  std::mt19937 generator(random_seed);
+
+  CenterMatrix center_matrix;
+  SeedKMeansPlusPlus(features, k, &generator, &center_matrix);
+
+  // The batches are drawn with replacement, so the batch may be larger than
+  // the feature set, but there is nothing to gain from that.
+  const size_t batch_size = std::min(batch_size_, features.size());
+  std::uniform_int_distribution<size_t> feature_distribution(
+      0u, features.size() - 1u);
+
+  // The batch inertia is noisy, so convergence is detected on an exponentially
+  // weighted average that roughly spans two passes over the features.
+  const double smoothing_factor = std::min(
+      1.0, 2.0 * batch_size / static_cast<double>(features.size() + 1u));
+  double smoothed_inertia = 0.0;
+  double best_smoothed_inertia = std::numeric_limits<double>::max();
+  size_t num_iterations_without_improvement = 0u;
+
+  std::vector<size_t> center_counts(k, 0u);
+  std::vector<size_t> batch_indices(batch_size);
+  std::vector<unsigned int> batch_membership;
+  std::vector<Scalar> batch_squared_distances;
+  std::vector<size_t> center_offsets(k + 1u);
+  std::vector<size_t> batch_order(batch_size);
+
+  size_t iteration = 0u;
+  for (; iteration < max_iterations_; ++iteration) {
+    for (size_t& feature_idx : batch_indices) {
+      feature_idx = feature_distribution(generator);
+    }
+    AssignSubset(
+        features, batch_indices, center_matrix, &batch_membership,
+        &batch_squared_distances);
+
+    const double batch_inertia =
+        std::accumulate(
+            batch_squared_distances.begin(), batch_squared_distances.end(),
+            0.0) /
+        batch_size;
+    smoothed_inertia = (iteration == 0u)
+                           ? batch_inertia
+                           : (1.0 - smoothing_factor) * smoothed_inertia +
+                                 smoothing_factor * batch_inertia;
+
+    // Group the batch by center, such that every center is updated by exactly
+    // one thread.
+    std::fill(center_offsets.begin(), center_offsets.end(), 0u);
+    for (const unsigned int center_idx : batch_membership) {
+      ++center_offsets[center_idx + 1u];
+    }
+    std::partial_sum(
+        center_offsets.begin(), center_offsets.end(), center_offsets.begin());
+    std::vector<size_t> insert_positions(
+        center_offsets.begin(), center_offsets.end() - 1);
+    for (size_t batch_idx = 0u; batch_idx < batch_size; ++batch_idx) {
+      batch_order[insert_positions[batch_membership[batch_idx]]++] = batch_idx;
+    }
+
+    std::function<void(const std::vector<size_t>&)> update_centers =
+        [&](const std::vector<size_t>& range) {
+          for (const size_t center_idx : range) {
+            for (size_t i = center_offsets[center_idx];
+                 i < center_offsets[center_idx + 1u]; ++i) {
+              const Feature& feature = features[batch_indices[batch_order[i]]];
+              ++center_counts[center_idx];
+              const Scalar learning_rate =
+                  static_cast<Scalar>(1) / center_counts[center_idx];
+              center_matrix.col(center_idx) +=
+                  learning_rate * (feature - center_matrix.col(center_idx));
+            }
+          }
+        };
+    static constexpr bool kAlwaysParallelize = false;
+    common::ParallelProcess(
+        k, update_centers, kAlwaysParallelize, num_threads_);
+
+    if (smoothed_inertia < best_smoothed_inertia) {
+      best_smoothed_inertia = smoothed_inertia;
+      num_iterations_without_improvement = 0u;
+    } else if (
+        ++num_iterations_without_improvement >= max_no_improvement_) {
+      ++iteration;
+      break;
+    }
+  }
+  VLOG(3) << "Mini-batch k-means with " << k << " centers stopped after "
+          << iteration << " iterations with a smoothed inertia of "
+          << smoothed_inertia << ".";
+
+  centers->clear();
+  centers->reserve(k);
+  for (size_t center_idx = 0u; center_idx < k; ++center_idx) {
+    centers->emplace_back(center_matrix.col(center_idx));
+  }
+  return static_cast<Scalar>(smoothed_inertia);
+}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::Assign(
+    const FeatureVector& features, const FeatureVector& centers,
+    std::vector<unsigned int>* const membership) const {
+  CHECK_NOTNULL(membership)->clear();
+  CHECK(!centers.empty());
+  if (features.empty()) {
+    return;
+  }
+  CenterMatrix center_matrix(centers.front().rows(), centers.size());
+  for (size_t center_idx = 0u; center_idx < centers.size(); ++center_idx) {
+    center_matrix.col(center_idx) = centers[center_idx];
+  }
+  std::vector<size_t> feature_indices(features.size());
+  std::iota(feature_indices.begin(), feature_indices.end(), 0u);
+  std::vector<Scalar> squared_distances;
+  AssignSubset(
+      features, feature_indices, center_matrix, membership,
+      &squared_distances);
+}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::SeedKMeansPlusPlus(
+    const FeatureVector& features, size_t k, std::mt19937* generator,
+    CenterMatrix* const centers) const {
+  CHECK_NOTNULL(generator);
+  CHECK_NOTNULL(centers);
+  CHECK(!features.empty());
+
+  // Draw the candidates without replacement using a partial Fisher-Yates
+  // shuffle.
+  const size_t num_candidates = std::min(
+      features.size(), std::max(k, k * num_seeding_samples_per_center_));
+  std::vector<size_t> candidates(features.size());
+  std::iota(candidates.begin(), candidates.end(), 0u);
+  for (size_t i = 0u; i < num_candidates; ++i) {
+    std::uniform_int_distribution<size_t> swap_distribution(
+        i, features.size() - 1u);
+    std::swap(candidates[i], candidates[swap_distribution(*generator)]);
+  }
+  candidates.resize(num_candidates);
+
+  // Greedy kmeans++: every new center is the best of several candidates
+  // sampled with a probability proportional to their squared distance to the
+  // closest existing center. This makes it much less likely that two centers
+  // end up in the same cluster while another cluster is left empty.
+  const size_t num_local_trials =
+      2u + static_cast<size_t>(std::log(static_cast<double>(k)));
+  std::vector<double> minimum_squared_distances(num_candidates);
+  std::vector<std::vector<double> > trial_squared_distances(
+      num_local_trials, std::vector<double>(num_candidates));
+  std::vector<size_t> trial_candidates(num_local_trials);
+
+  std::uniform_int_distribution<size_t> candidate_distribution(
+      0u, num_candidates - 1u);
+  centers->resize(features.front().rows(), k);
+  const Feature& first_center =
+      features[candidates[candidate_distribution(*generator)]];
+  centers->col(0) = first_center;
+  for (size_t i = 0u; i < num_candidates; ++i) {
+    minimum_squared_distances[i] =
+        (features[candidates[i]] - first_center).squaredNorm();
+  }
+
+  for (size_t center_idx = 1u; center_idx < k; ++center_idx) {
+    const double distance_sum = std::accumulate(
+        minimum_squared_distances.begin(), minimum_squared_distances.end(),
+        0.0);
+    if (!(distance_sum > 0.0)) {
+      // There are fewer distinct features than centers, so the remaining
+      // centers have to be duplicates.
+      centers->col(center_idx) =
+          features[candidates[candidate_distribution(*generator)]];
+      continue;
+    }
+
+    std::uniform_real_distribution<double> cutoff_distribution(
+        0.0, distance_sum);
+    for (size_t& trial_candidate : trial_candidates) {
+      const double cutoff = cutoff_distribution(*generator);
+      trial_candidate = num_candidates - 1u;
+      double partial_sum = 0.0;
+      for (size_t i = 0u; i < num_candidates; ++i) {
+        partial_sum += minimum_squared_distances[i];
+        if (partial_sum > cutoff) {
+          trial_candidate = i;
+          break;
+        }
+      }
+    }
+
+    std::function<void(const std::vector<size_t>&)> compute_trial_distances =
+        [&](const std::vector<size_t>& range) {
+          for (size_t trial = 0u; trial < num_local_trials; ++trial) {
+            const Feature& trial_center =
+                features[candidates[trial_candidates[trial]]];
+            std::vector<double>& squared_distances =
+                trial_squared_distances[trial];
+            for (const size_t i : range) {
+              squared_distances[i] = std::min<double>(
+                  minimum_squared_distances[i],
+                  (features[candidates[i]] - trial_center).squaredNorm());
+            }
+          }
+        };
+    static constexpr bool kAlwaysParallelize = false;
+    common::ParallelProcess(
+        num_candidates, compute_trial_distances, kAlwaysParallelize,
+        num_threads_);
+
+    size_t best_trial = 0u;
+    double best_distance_sum = std::numeric_limits<double>::max();
+    for (size_t trial = 0u; trial < num_local_trials; ++trial) {
+      const double trial_distance_sum = std::accumulate(
+          trial_squared_distances[trial].begin(),
+          trial_squared_distances[trial].end(), 0.0);
+      if (trial_distance_sum < best_distance_sum) {
+        best_distance_sum = trial_distance_sum;
+        best_trial = trial;
+      }
+    }
+    centers->col(center_idx) =
+        features[candidates[trial_candidates[best_trial]]];
+    minimum_squared_distances.swap(trial_squared_distances[best_trial]);
+  }
+}
+
+template <class Feature, class FeatureAllocator>
+void MiniBatchKmeans<Feature, FeatureAllocator>::AssignSubset(
+    const FeatureVector& features, const std::vector<size_t>& feature_indices,
+    const CenterMatrix& centers, std::vector<unsigned int>* const membership,
+    std::vector<Scalar>* const squared_distances) const {
+  CHECK_NOTNULL(membership);
+  CHECK_NOTNULL(squared_distances);
+  CHECK_GT(centers.cols(), 0);
+  membership->resize(feature_indices.size());
+  squared_distances->resize(feature_indices.size());
+  if (feature_indices.empty()) {
+    return;
+  }
+
+  std::function<void(const std::vector<size_t>&)> functor =
+      [&](const std::vector<size_t>& range) {
+        for (const size_t i : range) {
+          const Feature& feature = features[feature_indices[i]];
+          CHECK_EQ(feature.rows(), centers.rows());
+          typename CenterMatrix::Index closest_center;
+          (*squared_distances)[i] = (centers.colwise() - feature)
+                                        .colwise()
+                                        .squaredNorm()
+                                        .minCoeff(&closest_center);
+          (*membership)[i] = static_cast<unsigned int>(closest_center);
+        }
+      };
+  static constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      feature_indices.size(), functor, kAlwaysParallelize, num_threads_);
+}
+
+}  // namespace loop_closure
+
+#endif  // VOCABULARY_TREE_MINI_BATCH_KMEANS_INL_H_
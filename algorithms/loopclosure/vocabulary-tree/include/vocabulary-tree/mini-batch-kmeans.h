@@ -0,0 +1,104 @@
+#ifndef VOCABULARY_TREE_MINI_BATCH_KMEANS_H_
+#define VOCABULARY_TREE_MINI_BATCH_KMEANS_H_
+
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "vocabulary-tree/feature-allocator.h"
+
+namespace loop_closure {
+
+// Class for performing mini-batch K-means clustering on floating point
+// features (Sculley, "Web-Scale K-Means Clustering", 2010). The centers are
+// seeded by running kmeans++ on a random subset of the features. Every
+// iteration then assigns a small random batch of features to their closest
+// center and moves the centers towards their assigned features with a per
+// center learning rate. Both the assignment and the center updates run in
+// parallel, so the cost of an iteration only depends on the batch size and not
+// on the total number of features.
+template <class Feature,
+          class FeatureAllocator = typename DefaultAllocator<Feature>::type>
+class MiniBatchKmeans {
+ public:
+  typedef typename Feature::Scalar Scalar;
+  typedef std::vector<Feature, FeatureAllocator> FeatureVector;
+  static_assert(
+      std::is_floating_point<Scalar>::value,
+      "Mini-batch k-means is only valid for floating point descriptors.");
+
+  MiniBatchKmeans();
+
+  size_t GetBatchSize() const {
+    return batch_size_;
+  }
+  void SetBatchSize(size_t batch_size);
+
+  size_t GetMaxIterations() const {
+    return max_iterations_;
+  }
+  void SetMaxIterations(size_t iters) {
+    max_iterations_ = iters;
+  }
+
+  // The clustering terminates early if the smoothed batch inertia did not
+  // improve for this number of consecutive iterations.
+  size_t GetMaxNoImprovement() const {
+    return max_no_improvement_;
+  }
+  void SetMaxNoImprovement(size_t max_no_improvement) {
+    max_no_improvement_ = max_no_improvement;
+  }
+
+  // Number of features per center that kmeans++ samples the seeds from.
+  size_t GetNumSeedingSamplesPerCenter() const {
+    return num_seeding_samples_per_center_;
+  }
+  void SetNumSeedingSamplesPerCenter(size_t num_samples);
+
+  size_t GetNumThreads() const {
+    return num_threads_;
+  }
+  void SetNumThreads(size_t num_threads);
+
+  // Partition a set of features into k clusters.
+  // - features   The features to be clustered.
+  // - k          The number of clusters.
+  // - centers    A set of k cluster centers.
+  // Returns the smoothed mean squared distance of the batch features to their
+  // closest center at the last iteration.
+  Scalar Cluster(
+      const FeatureVector& features, size_t k, int random_seed,
+      FeatureVector* const centers) const;
+
+  // Assigns every feature to its closest center.
+  void Assign(
+      const FeatureVector& features, const FeatureVector& centers,
+      std::vector<unsigned int>* const membership) const;
+
+ private:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> CenterMatrix;
+
+  void SeedKMeansPlusPlus(
+      const FeatureVector& features, size_t k, std::mt19937* generator,
+      CenterMatrix* const centers) const;
+
+  // Finds the closest center of the features with the given indices.
+  void AssignSubset(
+      const FeatureVector& features, const std::vector<size_t>& feature_indices,
+      const CenterMatrix& centers, std::vector<unsigned int>* const membership,
+      std::vector<Scalar>* const squared_distances) const;
+
+  size_t batch_size_;
+  size_t max_iterations_;
+  size_t max_no_improvement_;
+  size_t num_seeding_samples_per_center_;
+  size_t num_threads_;
+};
+
+}  // namespace loop_closure
+
+#include "impl/mini-batch-kmeans-inl.h"
+#endif  // VOCABULARY_TREE_MINI_BATCH_KMEANS_H_
@@ -0,0 +1,127 @@
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <aslam/common/memory.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vocabulary-tree/mini-batch-kmeans.h>
+#include <vocabulary-tree/types.h>
+
+#include "./floating-point-test-helpers.h"
+
+namespace {
+double MeanSquaredDistanceToClosestCenter(
+    const DescriptorVector& descriptors, const DescriptorVector& centers) {
+  double squared_distance_sum = 0.0;
+  for (const DescriptorType& descriptor : descriptors) {
+    double min_squared_distance = std::numeric_limits<double>::max();
+    for (const DescriptorType& center : centers) {
+      min_squared_distance = std::min<double>(
+          min_squared_distance, (descriptor - center).squaredNorm());
+    }
+    squared_distance_sum += min_squared_distance;
+  }
+  return squared_distance_sum / descriptors.size();
+}
+}  // namespace
+
+TEST(VocabularyTree, MiniBatchKMeans_ClusterSeparatedData) {
+  std::mt19937 generator(40);
+  static const size_t kNumfeaturesPerCluster = 200;
+  static const size_t kNumClusters = 50;
+  DescriptorVector gt_centers;
+  DescriptorVector descriptors;
+  std::vector<unsigned int> membership;
+  std::vector<unsigned int> gt_membership;
+
+  GenerateTestData(
+      kNumfeaturesPerCluster, kNumClusters, generator(), &gt_centers,
+      &descriptors, &membership, &gt_membership);
+
+  loop_closure::MiniBatchKmeans<DescriptorType> kmeans;
+  kmeans.SetBatchSize(1000u);
+  kmeans.SetMaxIterations(200u);
+
+  DescriptorVector centers;
+  const Scalar smoothed_inertia =
+      kmeans.Cluster(descriptors, kNumClusters, generator(), &centers);
+  ASSERT_EQ(centers.size(), kNumClusters);
+
+  // The learned centers must explain the data almost as well as the ground
+  // truth centers, which a single merged pair of clusters would already
+  // prevent.
+  const double gt_inertia =
+      MeanSquaredDistanceToClosestCenter(descriptors, gt_centers);
+  const double inertia =
+      MeanSquaredDistanceToClosestCenter(descriptors, centers);
+  EXPECT_LT(inertia, 1.5 * gt_inertia);
+  EXPECT_NEAR(smoothed_inertia, inertia, 0.5 * inertia);
+
+  // The parallel assignment must agree with a brute force search.
+  kmeans.Assign(descriptors, centers, &membership);
+  ASSERT_EQ(membership.size(), descriptors.size());
+  for (size_t i = 0u; i < descriptors.size(); ++i) {
+    const double assigned_squared_distance =
+        (descriptors[i] - centers[membership[i]]).squaredNorm();
+    for (const DescriptorType& center : centers) {
+      EXPECT_LE(
+          assigned_squared_distance,
+          (descriptors[i] - center).squaredNorm() + 1e-4);
+    }
+  }
+}
+
+TEST(VocabularyTree, MiniBatchKMeans_IsDeterministicAndThreadIndependent) {
+  static const size_t kNumfeaturesPerCluster = 50;
+  static const size_t kNumClusters = 20;
+  DescriptorVector gt_centers;
+  DescriptorVector descriptors;
+  std::vector<unsigned int> membership;
+  std::vector<unsigned int> gt_membership;
+  GenerateTestData(
+      kNumfeaturesPerCluster, kNumClusters, 42, &gt_centers, &descriptors,
+      &membership, &gt_membership);
+
+  static constexpr int kRandomSeed = 7;
+  loop_closure::MiniBatchKmeans<DescriptorType> kmeans;
+  kmeans.SetBatchSize(100u);
+  kmeans.SetNumThreads(1u);
+  DescriptorVector single_threaded_centers;
+  kmeans.Cluster(
+      descriptors, kNumClusters, kRandomSeed, &single_threaded_centers);
+
+  kmeans.SetNumThreads(4u);
+  DescriptorVector multi_threaded_centers;
+  kmeans.Cluster(
+      descriptors, kNumClusters, kRandomSeed, &multi_threaded_centers);
+
+  ASSERT_EQ(single_threaded_centers.size(), multi_threaded_centers.size());
+  for (size_t i = 0u; i < single_threaded_centers.size(); ++i) {
+    EXPECT_TRUE(single_threaded_centers[i].isApprox(
+        multi_threaded_centers[i], static_cast<Scalar>(1e-5)));
+  }
+}
+
+TEST(VocabularyTree, MiniBatchKMeans_FewerFeaturesThanCenters) {
+  DescriptorVector descriptors;
+  for (int i = 0; i < 3; ++i) {
+    descriptors.emplace_back(
+        DescriptorType::Constant(kDescriptorDimensionality, i));
+  }
+
+  loop_closure::MiniBatchKmeans<DescriptorType> kmeans;
+  DescriptorVector centers;
+  const Scalar smoothed_inertia = kmeans.Cluster(descriptors, 5u, 0, &centers);
+  ASSERT_EQ(centers.size(), 5u);
+  EXPECT_NEAR(smoothed_inertia, 0.0, 1e-6);
+  for (const DescriptorType& descriptor : descriptors) {
+    bool found_center = false;
+    for (const DescriptorType& center : centers) {
+      found_center |= descriptor.isApprox(center);
+    }
+    EXPECT_TRUE(found_center);
+  }
+}
+
+MAPLAB_UNITTEST_ENTRYPOINT
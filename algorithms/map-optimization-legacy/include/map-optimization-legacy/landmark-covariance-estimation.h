@@ -1,6 +1,8 @@
 #ifndef MAP_OPTIMIZATION_LEGACY_LANDMARK_COVARIANCE_ESTIMATION_H_
 #define MAP_OPTIMIZATION_LEGACY_LANDMARK_COVARIANCE_ESTIMATION_H_
 
+#include <unordered_set>
+
 #include <map-optimization-legacy/graph-ba-optimizer.h>
 
 namespace map_optimization_legacy {
@@ -13,10 +15,30 @@ class LandmarkCovarianceEstimation : public GraphBaOptimizer {
   void assignCovarianceToLandmarks(
       const pose_graph::VertexIdSet& fixed_vertices);
 
+  // Partitioned alternative to assignCovarianceToLandmarks(..) for large maps.
+  // The vertices of every mission are split into submaps of consecutive
+  // vertices along the graph. Each submap gets its own problem with only the
+  // residual blocks that constrain its free states: the vertex states of the
+  // submap and the landmarks stored in it are free, while all other states
+  // (including the poses of the observers outside of the submap) are held
+  // fixed. The 3x3 marginal covariances of the landmarks are computed from
+  // the Schur complement of the submap information matrix and directly
+  // written to the landmarks. The submaps are processed in parallel and only
+  // the problems of the submaps being processed are held in memory.
+  void assignCovarianceToLandmarksPartitioned(
+      const pose_graph::VertexIdSet& fixed_vertices);
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
  private:
   void addErrorTerms(const pose_graph::VertexIdSet& fixed_vertices);
+  // Adds the residual blocks of the submap formed by the given vertices to
+  // problem_information_, which must be empty.
+  void addSubmapErrorTerms(
+      const pose_graph::VertexIdList& vertex_ids,
+      const pose_graph::VertexIdSet& fixed_vertices,
+      vi_map::LandmarkIdList* free_landmark_ids,
+      std::unordered_set<double*>* free_parameter_blocks);
   void calculateCovariance(ceres::Problem* problem);
 };
 
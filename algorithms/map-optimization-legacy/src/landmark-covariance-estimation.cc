@@ -1,8 +1,17 @@
 #include <map-optimization-legacy/landmark-covariance-estimation.h>
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Cholesky>
 #include <Eigen/Core>
 #include <ceres/ceres.h>
 #include <gflags/gflags.h>
+#include <maplab-common/accessors.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/threading-helpers.h>
 #include <vi-map/landmark-quality-metrics.h>
 
@@ -13,8 +22,303 @@ DEFINE_uint64(
 DEFINE_uint64(
     cov_estimation_min_observations_per_frame, 5,
     "Minimum required number of observations per frame.");
+DEFINE_uint64(
+    cov_estimation_submap_num_vertices, 50,
+    "Number of consecutive vertices per submap for the partitioned landmark "
+    "covariance estimation.");
 
 namespace map_optimization_legacy {
+namespace {
+
+// Covariance assigned to landmarks that are not constrained enough.
+constexpr double kLargeLandmarkCovariance = 100.0;
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMajorMatrixXd;
+
+// The problem of a submap only contains the residual blocks constraining at
+// least one of its free parameter blocks.
+struct Submap {
+  // The free landmarks, i.e. the well constrained landmarks stored in the
+  // vertices of the submap.
+  vi_map::LandmarkIdList landmark_ids;
+  std::unordered_set<double*> free_parameter_blocks;
+  ceres_error_terms::ProblemInformation problem_information;
+};
+
+// Information of a landmark position and its coupling with the free states of
+// the submap, indexed by the state index.
+struct LandmarkInformation {
+  LandmarkInformation() : H_ll(Eigen::Matrix3d::Zero()) {}
+  Eigen::Matrix3d H_ll;
+  std::map<size_t, Eigen::Matrix<double, Eigen::Dynamic, 3> > H_sl;
+};
+
+// Robustifies the Jacobians of a residual block like ceres::Corrector.
+void applyLossFunction(
+    const ceres::LossFunction& loss_function, const Eigen::VectorXd& residual,
+    std::vector<RowMajorMatrixXd>* jacobians) {
+  CHECK_NOTNULL(jacobians);
+  const double squared_norm = residual.squaredNorm();
+  double rho[3];
+  loss_function.Evaluate(squared_norm, rho);
+
+  const double sqrt_rho1 = std::sqrt(rho[1]);
+  double alpha_squared_norm = 0.0;
+  if (squared_norm > 0.0 && rho[2] > 0.0) {
+    const double alpha =
+        1.0 - std::sqrt(1.0 + 2.0 * squared_norm * rho[2] / rho[1]);
+    alpha_squared_norm = alpha / squared_norm;
+  }
+  for (RowMajorMatrixXd& jacobian : *jacobians) {
+    if (alpha_squared_norm != 0.0) {
+      jacobian -=
+          alpha_squared_norm * residual * (residual.transpose() * jacobian);
+    }
+    jacobian *= sqrt_rho1;
+  }
+}
+
+// Computes the marginal covariances of the landmarks of a submap. All
+// parameter blocks that are not free in the submap are treated as fixed.
+void estimateSubmapLandmarkCovariances(
+    const Submap& submap, const size_t submap_index, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  const ceres_error_terms::ProblemInformation::ParameterizationsMap&
+      parameterizations = submap.problem_information.parameterizations;
+
+  std::unordered_map<double*, size_t> landmark_indices;
+  for (size_t i = 0u; i < submap.landmark_ids.size(); ++i) {
+    landmark_indices.emplace(
+        map->getLandmark(submap.landmark_ids[i]).get_p_B_Mutable(), i);
+  }
+
+  auto is_free_in_submap = [&](double* parameter_block) {
+    return submap.free_parameter_blocks.count(parameter_block) > 0u;
+  };
+  auto get_parameterization = [&](double* parameter_block) {
+    const ceres_error_terms::ProblemInformation::ParameterizationsMap::
+        const_iterator it = parameterizations.find(parameter_block);
+    return it == parameterizations.end() ? nullptr : it->second.get();
+  };
+
+  std::vector<const ceres_error_terms::ResidualInformation*> residuals;
+  residuals.reserve(submap.problem_information.residual_blocks.size());
+  for (const ceres_error_terms::ProblemInformation::ResidualInformationMap::
+           value_type& residual_block :
+       submap.problem_information.residual_blocks) {
+    if (residual_block.second.active_) {
+      residuals.push_back(&residual_block.second);
+    }
+  }
+
+  // Assign the free states (vertex poses, velocities and biases) to
+  // consecutive rows of the reduced system.
+  std::unordered_map<double*, size_t> state_indices;
+  std::vector<int> state_offsets;
+  std::vector<int> state_sizes;
+  int num_state_rows = 0;
+  for (const ceres_error_terms::ResidualInformation* residual_ptr :
+       residuals) {
+    const ceres_error_terms::ResidualInformation& residual = *residual_ptr;
+    const std::vector<int32_t>& block_sizes =
+        residual.cost_function->parameter_block_sizes();
+    for (size_t k = 0u; k < residual.parameter_blocks.size(); ++k) {
+      double* parameter_block = residual.parameter_blocks[k];
+      if (!is_free_in_submap(parameter_block) ||
+          landmark_indices.count(parameter_block) > 0u ||
+          state_indices.count(parameter_block) > 0u) {
+        continue;
+      }
+      const ceres::LocalParameterization* parameterization =
+          get_parameterization(parameter_block);
+      const int local_size = parameterization == nullptr
+                                 ? block_sizes[k]
+                                 : parameterization->LocalSize();
+      state_indices.emplace(parameter_block, state_sizes.size());
+      state_offsets.push_back(num_state_rows);
+      state_sizes.push_back(local_size);
+      num_state_rows += local_size;
+    }
+  }
+
+  Eigen::MatrixXd H_ss = Eigen::MatrixXd::Zero(num_state_rows, num_state_rows);
+  std::vector<LandmarkInformation> landmark_information(
+      submap.landmark_ids.size());
+
+  for (const ceres_error_terms::ResidualInformation* residual_ptr :
+       residuals) {
+    const ceres_error_terms::ResidualInformation& residual = *residual_ptr;
+    const ceres::CostFunction& cost_function = *residual.cost_function;
+    const std::vector<int32_t>& block_sizes =
+        cost_function.parameter_block_sizes();
+    const size_t num_blocks = block_sizes.size();
+    CHECK_EQ(num_blocks, residual.parameter_blocks.size());
+
+    Eigen::VectorXd residual_vector(cost_function.num_residuals());
+    std::vector<RowMajorMatrixXd> jacobians(num_blocks);
+    std::vector<double*> jacobian_ptrs(num_blocks);
+    for (size_t k = 0u; k < num_blocks; ++k) {
+      jacobians[k].resize(cost_function.num_residuals(), block_sizes[k]);
+      jacobian_ptrs[k] = jacobians[k].data();
+    }
+
+    // Every submap has its own cost functions, so the ones caching
+    // intermediate results can be evaluated concurrently.
+    if (!cost_function.Evaluate(
+            residual.parameter_blocks.data(), residual_vector.data(),
+            jacobian_ptrs.data())) {
+      LOG(WARNING) << "Failed to evaluate a residual block, skipping it.";
+      continue;
+    }
+    if (residual.loss_function != nullptr) {
+      applyLossFunction(*residual.loss_function, residual_vector, &jacobians);
+    }
+
+    // Jacobians w.r.t. the local parameterizations of the free blocks.
+    std::vector<Eigen::MatrixXd> local_jacobians(num_blocks);
+    std::vector<int> landmark_index_of_block(num_blocks, -1);
+    std::vector<int> state_index_of_block(num_blocks, -1);
+    size_t num_landmark_blocks = 0u;
+    for (size_t k = 0u; k < num_blocks; ++k) {
+      double* parameter_block = residual.parameter_blocks[k];
+      if (!is_free_in_submap(parameter_block)) {
+        continue;
+      }
+      const std::unordered_map<double*, size_t>::const_iterator it_landmark =
+          landmark_indices.find(parameter_block);
+      if (it_landmark != landmark_indices.end()) {
+        landmark_index_of_block[k] = static_cast<int>(it_landmark->second);
+        ++num_landmark_blocks;
+      } else {
+        state_index_of_block[k] = static_cast<int>(
+            common::getChecked(state_indices, parameter_block));
+      }
+
+      const ceres::LocalParameterization* parameterization =
+          get_parameterization(parameter_block);
+      if (parameterization == nullptr) {
+        local_jacobians[k] = jacobians[k];
+      } else {
+        RowMajorMatrixXd lift_jacobian(
+            parameterization->GlobalSize(), parameterization->LocalSize());
+        CHECK(parameterization->ComputeJacobian(
+            parameter_block, lift_jacobian.data()));
+        local_jacobians[k] = jacobians[k] * lift_jacobian;
+      }
+    }
+    CHECK_LE(num_landmark_blocks, 1u)
+        << "Residual blocks coupling several landmarks are not supported.";
+
+    for (size_t k1 = 0u; k1 < num_blocks; ++k1) {
+      if (landmark_index_of_block[k1] >= 0) {
+        landmark_information[landmark_index_of_block[k1]].H_ll.noalias() +=
+            local_jacobians[k1].transpose() * local_jacobians[k1];
+        continue;
+      }
+      const int state_index_1 = state_index_of_block[k1];
+      if (state_index_1 < 0) {
+        continue;
+      }
+      for (size_t k2 = 0u; k2 < num_blocks; ++k2) {
+        if (landmark_index_of_block[k2] >= 0) {
+          LandmarkInformation& information =
+              landmark_information[landmark_index_of_block[k2]];
+          Eigen::Matrix<double, Eigen::Dynamic, 3>& H_sl =
+              information.H_sl[state_index_1];
+          if (H_sl.rows() == 0) {
+            H_sl.setZero(state_sizes[state_index_1], 3);
+          }
+          H_sl.noalias() +=
+              local_jacobians[k1].transpose() * local_jacobians[k2];
+          continue;
+        }
+        const int state_index_2 = state_index_of_block[k2];
+        if (state_index_2 < 0) {
+          continue;
+        }
+        H_ss.block(
+                state_offsets[state_index_1], state_offsets[state_index_2],
+                state_sizes[state_index_1], state_sizes[state_index_2])
+            .noalias() += local_jacobians[k1].transpose() * local_jacobians[k2];
+      }
+    }
+  }
+
+  // Eliminate the landmarks to get the Schur complement of the states.
+  Eigen::MatrixXd& schur_complement = H_ss;
+  std::vector<Eigen::Matrix3d> H_ll_inverses(submap.landmark_ids.size());
+  std::vector<bool> is_landmark_constrained(submap.landmark_ids.size());
+  for (size_t i = 0u; i < landmark_information.size(); ++i) {
+    const LandmarkInformation& information = landmark_information[i];
+    const Eigen::LLT<Eigen::Matrix3d> llt(information.H_ll);
+    is_landmark_constrained[i] = llt.info() == Eigen::Success;
+    if (!is_landmark_constrained[i]) {
+      continue;
+    }
+    H_ll_inverses[i] = llt.solve(Eigen::Matrix3d::Identity());
+    for (const auto& H_al : information.H_sl) {
+      const Eigen::Matrix<double, Eigen::Dynamic, 3> H_al_H_ll_inverse =
+          H_al.second * H_ll_inverses[i];
+      for (const auto& H_bl : information.H_sl) {
+        schur_complement
+            .block(
+                state_offsets[H_al.first], state_offsets[H_bl.first],
+                state_sizes[H_al.first], state_sizes[H_bl.first])
+            .noalias() -= H_al_H_ll_inverse * H_bl.second.transpose();
+      }
+    }
+  }
+
+  Eigen::MatrixXd schur_complement_inverse;
+  if (num_state_rows > 0) {
+    const Eigen::LLT<Eigen::MatrixXd> llt(schur_complement);
+    if (llt.info() != Eigen::Success) {
+      LOG(WARNING) << "The states of submap " << submap_index << " are not "
+                   << "constrained, assigning a large covariance to its "
+                   << submap.landmark_ids.size() << " landmarks.";
+      std::fill(
+          is_landmark_constrained.begin(), is_landmark_constrained.end(),
+          false);
+    } else {
+      schur_complement_inverse = llt.solve(
+          Eigen::MatrixXd::Identity(num_state_rows, num_state_rows));
+    }
+  }
+
+  for (size_t i = 0u; i < submap.landmark_ids.size(); ++i) {
+    vi_map::Landmark& landmark = map->getLandmark(submap.landmark_ids[i]);
+    // Landmarks with few observers are part of the problem, but like in
+    // assignCovarianceToLandmarks(..) their covariance is not estimated.
+    if (!is_landmark_constrained[i] ||
+        landmark.numberOfObservations() <=
+            FLAGS_cov_estimation_min_landmark_observer_count) {
+      landmark.set_p_B_Covariance(
+          kLargeLandmarkCovariance * Eigen::Matrix3d::Identity());
+      continue;
+    }
+    // Sigma_ll = H_ll^-1 + (H_sl H_ll^-1)^T S^-1 (H_sl H_ll^-1).
+    Eigen::Matrix3d covariance = H_ll_inverses[i];
+    const LandmarkInformation& information = landmark_information[i];
+    for (const auto& H_al : information.H_sl) {
+      const Eigen::Matrix<double, Eigen::Dynamic, 3> V_a =
+          H_al.second * H_ll_inverses[i];
+      for (const auto& H_bl : information.H_sl) {
+        const Eigen::Matrix<double, Eigen::Dynamic, 3> V_b =
+            H_bl.second * H_ll_inverses[i];
+        covariance.noalias() +=
+            V_a.transpose() *
+            schur_complement_inverse.block(
+                state_offsets[H_al.first], state_offsets[H_bl.first],
+                state_sizes[H_al.first], state_sizes[H_bl.first]) *
+            V_b;
+      }
+    }
+    landmark.set_p_B_Covariance(0.5 * (covariance + covariance.transpose()));
+  }
+}
+
+}  // namespace
 
 LandmarkCovarianceEstimation::LandmarkCovarianceEstimation(vi_map::VIMap* map)
     : GraphBaOptimizer(CHECK_NOTNULL(map)) {}
@@ -37,6 +341,217 @@ void LandmarkCovarianceEstimation::assignCovarianceToLandmarks(
   calculateCovariance(&problem);
 }
 
+void LandmarkCovarianceEstimation::assignCovarianceToLandmarksPartitioned(
+    const pose_graph::VertexIdSet& fixed_vertices) {
+  const size_t num_vertices_per_submap =
+      FLAGS_cov_estimation_submap_num_vertices;
+  CHECK_GT(num_vertices_per_submap, 0u);
+  removeLandmarksBehindCamera();
+
+  std::vector<pose_graph::VertexIdList> submap_vertex_ids;
+  vi_map::MissionIdList mission_ids;
+  const_map_.getAllMissionIds(&mission_ids);
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    pose_graph::VertexIdList vertex_ids;
+    const_map_.getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
+    for (size_t i = 0u; i < vertex_ids.size(); ++i) {
+      if (i % num_vertices_per_submap == 0u) {
+        submap_vertex_ids.emplace_back();
+      }
+      submap_vertex_ids.back().push_back(vertex_ids[i]);
+    }
+  }
+
+  // The problems are built sequentially, one submap per thread at a time,
+  // and only the problems of the submaps being processed are held in memory.
+  const size_t num_threads = common::getNumHardwareThreads();
+  LOG(INFO) << "Calculating the landmark covariances in "
+            << submap_vertex_ids.size() << " submaps.";
+  for (size_t batch_begin = 0u; batch_begin < submap_vertex_ids.size();
+       batch_begin += num_threads) {
+    const size_t batch_end =
+        std::min(batch_begin + num_threads, submap_vertex_ids.size());
+    std::vector<Submap> submaps(batch_end - batch_begin);
+    for (size_t i = 0u; i < submaps.size(); ++i) {
+      Submap& submap = submaps[i];
+      addSubmapErrorTerms(
+          submap_vertex_ids[batch_begin + i], fixed_vertices,
+          &submap.landmark_ids, &submap.free_parameter_blocks);
+      std::swap(submap.problem_information, problem_information_);
+      problem_information_ = ceres_error_terms::ProblemInformation();
+      residual_to_landmark.clear();
+    }
+
+    constexpr bool kAlwaysParallelize = true;
+    common::ParallelProcess(
+        submaps.size(),
+        [&](const std::vector<size_t>& batch) {
+          for (const size_t i : batch) {
+            estimateSubmapLandmarkCovariances(
+                submaps[i], batch_begin + i, &map_);
+          }
+        },
+        kAlwaysParallelize, num_threads);
+  }
+}
+
+void LandmarkCovarianceEstimation::addSubmapErrorTerms(
+    const pose_graph::VertexIdList& vertex_ids,
+    const pose_graph::VertexIdSet& fixed_vertices,
+    vi_map::LandmarkIdList* free_landmark_ids,
+    std::unordered_set<double*>* free_parameter_blocks) {
+  CHECK_NOTNULL(free_landmark_ids)->clear();
+  CHECK_NOTNULL(free_parameter_blocks)->clear();
+  CHECK(problem_information_.residual_blocks.empty());
+
+  // The landmarks stored in the submap are free if they get visual residuals,
+  // all other landmarks are not constrained enough.
+  const pose_graph::VertexIdSet submap_vertex_ids(
+      vertex_ids.begin(), vertex_ids.end());
+  vi_map::LandmarkIdSet submap_landmark_ids;
+  pose_graph::VertexIdSet observer_vertex_ids = submap_vertex_ids;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    vi_map::LandmarkIdList landmark_ids;
+    map_.getVertex(vertex_id).getStoredLandmarkIdList(&landmark_ids);
+    for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+      vi_map::Landmark& landmark = map_.getLandmark(landmark_id);
+      if (landmark.numberOfObservations() == 0u) {
+        continue;
+      }
+      if (!vi_map::isLandmarkWellConstrained(map_, landmark)) {
+        landmark.set_p_B_Covariance(
+            kLargeLandmarkCovariance * Eigen::Matrix3d::Identity());
+        continue;
+      }
+      submap_landmark_ids.insert(landmark_id);
+      free_landmark_ids->push_back(landmark_id);
+      for (const vi_map::KeypointIdentifier& observation :
+           landmark.getObservations()) {
+        observer_vertex_ids.insert(observation.frame_id.vertex_id);
+      }
+    }
+  }
+
+  // Visual residuals of the observations of the submap vertices and of the
+  // observations of the submap landmarks, same as addVisualResidualBlocks(..).
+  constexpr bool kFixLandmarkPosition = false;
+  constexpr unsigned int kMinNumOfObserverMissions = 0u;
+  for (const pose_graph::VertexId& vertex_id : observer_vertex_ids) {
+    const bool is_submap_vertex = submap_vertex_ids.count(vertex_id) > 0u;
+    vi_map::Vertex& ba_vertex = map_.getVertex(vertex_id);
+    const unsigned int num_frames = ba_vertex.numFrames();
+    for (unsigned int frame_idx = 0u; frame_idx < num_frames; ++frame_idx) {
+      if (!ba_vertex.isVisualFrameSet(frame_idx) ||
+          !ba_vertex.isVisualFrameValid(frame_idx) ||
+          getNumOfWellConstrainedLandmarksInFrame(ba_vertex, frame_idx) <
+              FLAGS_cov_estimation_min_observations_per_frame) {
+        continue;
+      }
+      const Eigen::Matrix2Xd& image_points_distorted =
+          ba_vertex.getVisualFrame(frame_idx).getKeypointMeasurements();
+      const Eigen::VectorXd& image_points_uncertainties =
+          ba_vertex.getVisualFrame(frame_idx)
+              .getKeypointMeasurementUncertainties();
+      const aslam::Camera::Ptr camera_ptr = ba_vertex.getCamera(frame_idx);
+      CHECK(camera_ptr != nullptr);
+
+      unsigned int external_landmarks_added = 0u;
+      for (int i = 0; i < image_points_distorted.cols(); ++i) {
+        const vi_map::LandmarkId landmark_id =
+            ba_vertex.getObservedLandmarkId(frame_idx, i);
+        if (!landmark_id.isValid() ||
+            (!is_submap_vertex &&
+             submap_landmark_ids.count(landmark_id) == 0u)) {
+          continue;
+        }
+        std::shared_ptr<ceres::LossFunction> loss_function(
+            new ceres::LossFunctionWrapper(
+                new ceres::CauchyLoss(3.0 * image_points_uncertainties(i)),
+                ceres::TAKE_OWNERSHIP));
+        addVisualResidualBlockOfKeypoint(
+            image_points_distorted.col(i), image_points_uncertainties(i),
+            landmark_id, kFixLandmarkPosition,
+            FLAGS_cov_estimation_min_landmark_observer_count,
+            FLAGS_cov_estimation_min_observations_per_frame,
+            kMinNumOfObserverMissions, loss_function, camera_ptr.get(),
+            &external_landmarks_added, &ba_vertex);
+      }
+      if (image_points_distorted.cols() > 0) {
+        constexpr bool kFixIntrinsics = true;
+        constexpr bool kFixExtrinsicsRotation = true;
+        constexpr bool kFixExtrinsicsTranslation = true;
+        setCameraParameterizationIfPartOfTheProblem(
+            camera_ptr, kFixIntrinsics, kFixExtrinsicsRotation,
+            kFixExtrinsicsTranslation);
+      }
+      if (external_landmarks_added > 0u) {
+        problem_information_.setParameterization(
+            vertex_poses_
+                .col(common::getChecked(vertex_id_to_pose_idx_, vertex_id))
+                .data(),
+            pose_parameterization_);
+      }
+    }
+  }
+
+  // Inertial residuals of the edges of the submap vertices.
+  pose_graph::EdgeIdSet edge_ids;
+  pose_graph::VertexIdSet submap_fixed_vertices;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    const_map_.getVertex(vertex_id).incidentEdges(&edge_ids);
+    if (fixed_vertices.count(vertex_id) > 0u) {
+      submap_fixed_vertices.insert(vertex_id);
+    }
+  }
+  constexpr bool kFixGyroBias = false;
+  constexpr bool kFixAccelBias = false;
+  constexpr bool kFixVelocity = false;
+  constexpr bool kUseGivenEdges = true;
+  constexpr bool kStoreCachedImuCovariances = false;
+  const BaOptimizationOptions options;
+  addInertialResidualBlocks(
+      kFixGyroBias, kFixAccelBias, kFixVelocity, kUseGivenEdges,
+      pose_graph::EdgeIdList(edge_ids.begin(), edge_ids.end()),
+      kStoreCachedImuCovariances, options.gravity_magnitude, nullptr);
+  addPosePriorResidualBlocks(
+      submap_fixed_vertices, options.prior_position_std_dev_meters,
+      options.prior_orientation_std_dev_radians);
+
+  // The states of the submap vertices and the submap landmarks are free, all
+  // other parameter blocks of the problem are held fixed.
+  auto add_if_free = [&](double* parameter_block) {
+    if (problem_information_.active_parameter_blocks.count(parameter_block) >
+            0u &&
+        !problem_information_.isParameterBlockConstant(parameter_block)) {
+      free_parameter_blocks->insert(parameter_block);
+    }
+  };
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    vi_map::Vertex& vertex = map_.getVertex(vertex_id);
+    add_if_free(
+        vertex_poses_
+            .col(common::getChecked(vertex_id_to_pose_idx_, vertex_id))
+            .data());
+    add_if_free(vertex.get_v_M_Mutable());
+    add_if_free(vertex.getAccelBiasMutable());
+    add_if_free(vertex.getGyroBiasMutable());
+  }
+  // Landmarks only observed by skipped frames did not get any residual.
+  vi_map::LandmarkIdList constrained_landmark_ids;
+  for (const vi_map::LandmarkId& landmark_id : *free_landmark_ids) {
+    vi_map::Landmark& landmark = map_.getLandmark(landmark_id);
+    double* p_B = landmark.get_p_B_Mutable();
+    if (problem_information_.active_parameter_blocks.count(p_B) > 0u) {
+      free_parameter_blocks->insert(p_B);
+      constrained_landmark_ids.push_back(landmark_id);
+    } else {
+      landmark.set_p_B_Covariance(
+          kLargeLandmarkCovariance * Eigen::Matrix3d::Identity());
+    }
+  }
+  free_landmark_ids->swap(constrained_landmark_ids);
+}
+
 void LandmarkCovarianceEstimation::addErrorTerms(
     const pose_graph::VertexIdSet& fixed_vertices) {
   bool kFixIntrinsics = true;
@@ -118,7 +633,7 @@ void LandmarkCovarianceEstimation::calculateCovariance(
               // diagonal.
               Eigen::Matrix3d some_large_covariance =
                   Eigen::Matrix3d::Identity();
-              some_large_covariance *= 100;
+              some_large_covariance *= kLargeLandmarkCovariance;
               landmark.set_p_B_Covariance(some_large_covariance);
             }
           }
@@ -0,0 +1,144 @@
+#include <unordered_set>
+
+#include <Eigen/Core>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <sensors/imu.h>
+#include <vi-map/6dof-vi-map-gen.h>
+#include <vi-map/vi-map.h>
+#include <vi-map/vi-optimization-test-helpers.h>
+
+#include "map-optimization-legacy/landmark-covariance-estimation.h"
+
+DECLARE_uint64(cov_estimation_submap_num_vertices);
+
+namespace map_optimization_legacy {
+
+class LandmarkCovarianceEstimationTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    vimap_gen_.generateVIMap();
+    vi_map::VIMap& map = vimap_gen_.vi_map_;
+
+    // The generated IMU sigmas are tiny, which makes the information matrix
+    // badly conditioned.
+    vi_map::ImuSigmas imu_sigmas;
+    vi_map::setImuSigmasConstant(1e-3, &imu_sigmas);
+    vi_map::SensorIdSet imu_ids;
+    map.getSensorManager().getAllSensorIdsOfType(
+        vi_map::SensorType::kImu, &imu_ids);
+    ASSERT_FALSE(imu_ids.empty());
+    for (const vi_map::SensorId& imu_id : imu_ids) {
+      static_cast<vi_map::Imu&>(map.getSensorManager().getSensor(imu_id))
+          .setImuSigmas(imu_sigmas);
+    }
+
+    vi_map::MissionIdList mission_ids;
+    map.getAllMissionIds(&mission_ids);
+    for (const vi_map::MissionId& mission_id : mission_ids) {
+      fixed_vertices_.insert(map.getMission(mission_id).getRootVertexId());
+    }
+
+    full_map_.deepCopy(map);
+    partitioned_map_.deepCopy(map);
+    LandmarkCovarianceEstimation full_estimation(&full_map_);
+    full_estimation.assignCovarianceToLandmarks(fixed_vertices_);
+  }
+
+  void estimatePartitioned(const size_t num_vertices_per_submap) {
+    const uint64_t original_num_vertices =
+        FLAGS_cov_estimation_submap_num_vertices;
+    FLAGS_cov_estimation_submap_num_vertices = num_vertices_per_submap;
+    LandmarkCovarianceEstimation estimation(&partitioned_map_);
+    estimation.assignCovarianceToLandmarksPartitioned(fixed_vertices_);
+    FLAGS_cov_estimation_submap_num_vertices = original_num_vertices;
+  }
+
+  // Calls the function for every landmark with an estimated covariance in
+  // both maps and returns the number of these landmarks.
+  template <typename Function>
+  size_t forEachEstimatedCovariance(const Function& function) const {
+    vi_map::LandmarkIdList landmark_ids;
+    full_map_.getAllLandmarkIds(&landmark_ids);
+    size_t num_estimated = 0u;
+    for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+      Eigen::Matrix3d full_covariance;
+      Eigen::Matrix3d partitioned_covariance;
+      const bool has_full_covariance =
+          full_map_.getLandmark(landmark_id)
+              .get_p_B_Covariance(&full_covariance);
+      const bool has_partitioned_covariance =
+          partitioned_map_.getLandmark(landmark_id)
+              .get_p_B_Covariance(&partitioned_covariance);
+      EXPECT_EQ(has_full_covariance, has_partitioned_covariance);
+      if (!has_full_covariance || !has_partitioned_covariance) {
+        continue;
+      }
+      // Both assign the same large covariance to unconstrained landmarks.
+      const bool is_estimated =
+          full_covariance(0, 0) < kLargeLandmarkCovariance;
+      EXPECT_EQ(
+          is_estimated, partitioned_covariance(0, 0) < kLargeLandmarkCovariance)
+          << landmark_id.hexString();
+      if (is_estimated) {
+        function(full_covariance, partitioned_covariance);
+        ++num_estimated;
+      }
+    }
+    return num_estimated;
+  }
+
+  static constexpr double kLargeLandmarkCovariance = 100.0;
+
+  vi_map::SixDofVIMapGenerator vimap_gen_;
+  pose_graph::VertexIdSet fixed_vertices_;
+  vi_map::VIMap full_map_;
+  vi_map::VIMap partitioned_map_;
+};
+
+constexpr double LandmarkCovarianceEstimationTest::kLargeLandmarkCovariance;
+
+// With a single submap spanning the whole mission, the partitioned estimation
+// solves the same problem as ceres::Covariance.
+TEST_F(LandmarkCovarianceEstimationTest, SingleSubmapMatchesCeresCovariance) {
+  estimatePartitioned(vimap_gen_.vi_map_.numVertices());
+
+  constexpr double kRelativePrecision = 1e-4;
+  const size_t num_estimated = forEachEstimatedCovariance(
+      [kRelativePrecision](
+          const Eigen::Matrix3d& full_covariance,
+          const Eigen::Matrix3d& partitioned_covariance) {
+        EXPECT_LE(
+            (full_covariance - partitioned_covariance).norm(),
+            kRelativePrecision * full_covariance.norm())
+            << "ceres:\n"
+            << full_covariance << "\npartitioned:\n"
+            << partitioned_covariance;
+      });
+  EXPECT_GT(num_estimated, 0u);
+}
+
+// Holding the states outside of the submaps fixed can only reduce the
+// uncertainty of the landmarks.
+TEST_F(LandmarkCovarianceEstimationTest, SmallSubmapsAreNotLessCertain) {
+  constexpr size_t kNumVerticesPerSubmap = 5u;
+  estimatePartitioned(kNumVerticesPerSubmap);
+
+  constexpr double kRelativePrecision = 1e-6;
+  const size_t num_estimated = forEachEstimatedCovariance(
+      [kRelativePrecision](
+          const Eigen::Matrix3d& full_covariance,
+          const Eigen::Matrix3d& partitioned_covariance) {
+        EXPECT_GT(partitioned_covariance.trace(), 0.0);
+        EXPECT_LE(
+            partitioned_covariance.trace(),
+            (1.0 + kRelativePrecision) * full_covariance.trace());
+      });
+  EXPECT_GT(num_estimated, 0u);
+}
+
+}  // namespace map_optimization_legacy
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -7,15 +7,22 @@
 
 namespace map_optimization {
 
+// If max_observations_per_visual_batch is larger than one, the observations
+// of each landmark are combined into residual blocks of up to that many
+// observations, see addBatchedVisualTermsForLandmark(..). Otherwise, one
+// residual block is added per observation.
 void addVisualTerms(
     const bool fix_landmark_positions, const bool fix_intrinsics,
     const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
-    const size_t min_landmarks_per_frame, OptimizationProblem* problem);
+    const size_t min_landmarks_per_frame,
+    const size_t max_observations_per_visual_batch,
+    OptimizationProblem* problem);
 
 void addVisualTermsForVertices(
     const bool fix_landmark_positions, const bool fix_intrinsics,
     const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
     const size_t min_landmarks_per_frame,
+    const size_t max_observations_per_visual_batch,
     const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
     const std::shared_ptr<ceres::LocalParameterization>&
         baseframe_parameterization,
@@ -34,15 +41,37 @@ bool addVisualTermForKeypoint(
         camera_parameterization,
     vi_map::Vertex* vertex_ptr, OptimizationProblem* problem);
 
+// Adds the given observations of a landmark as batched visual residual blocks,
+// see ceres_error_terms::BatchedVisualCostFunction. Observations made by
+// cameras of the same type are combined into blocks of up to
+// max_observations_per_batch observations. Larger batches result in fewer
+// residual blocks, but in larger dense Jacobian blocks. Returns the number of
+// residual blocks added.
+size_t addBatchedVisualTermsForLandmark(
+    const vi_map::LandmarkId& landmark_id,
+    const vi_map::KeypointIdentifierList& observations,
+    const size_t max_observations_per_batch,
+    const bool fix_landmark_positions, const bool fix_intrinsics,
+    const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
+    const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        baseframe_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        camera_parameterization,
+    OptimizationProblem* problem);
+
+// If use_imu_preintegration is set, the IMU measurements of each edge are
+// preintegrated once and only integrated again after larger bias changes, see
+// ceres_error_terms::PreintegratedInertialErrorTerm.
 void addInertialTerms(
     const bool fix_gyro_bias, const bool fix_accel_bias,
-    const bool fix_velocity, const double gravity_magnitude,
-    OptimizationProblem* problem);
+    const bool fix_velocity, const bool use_imu_preintegration,
+    const double gravity_magnitude, OptimizationProblem* problem);
 
 int addInertialTermsForEdges(
     const bool fix_gyro_bias, const bool fix_accel_bias,
-    const bool fix_velocity, const double gravity_magnitude,
-    const vi_map::ImuSigmas& imu_sigmas,
+    const bool fix_velocity, const bool use_imu_preintegration,
+    const double gravity_magnitude, const vi_map::ImuSigmas& imu_sigmas,
     const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
     const pose_graph::EdgeIdList& edges, OptimizationProblem* problem);
 
@@ -23,6 +23,7 @@ struct ViProblemOptions {
   bool fix_gyro_bias;
   bool fix_accel_bias;
   bool fix_velocity;
+  bool use_imu_preintegration;
   size_t min_landmarks_per_frame;
   double gravity_magnitude = std::numeric_limits<double>::quiet_NaN();
 
@@ -32,6 +33,9 @@ struct ViProblemOptions {
   bool fix_extrinsics_rotation;
   bool fix_extrinsics_translation;
   bool fix_landmark_positions;
+  // Maximum number of observations of a landmark combined into a single
+  // residual block. Batching is disabled if smaller than two.
+  size_t max_observations_per_visual_batch;
 
   bool isValid() const {
     return (gravity_magnitude > 0.0);
@@ -1,8 +1,14 @@
 #include "map-optimization/optimization-terms-addition.h"
 
+#include <map>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <ceres-error-terms/batched-visual-error-term.h>
 #include <ceres-error-terms/inertial-error-term.h>
+#include <ceres-error-terms/preintegrated-inertial-error-term.h>
 #include <ceres-error-terms/visual-error-term-factory.h>
 #include <ceres-error-terms/visual-error-term.h>
 #include <ceres/ceres.h>
@@ -11,6 +17,87 @@
 #include <vi-map/landmark-quality-metrics.h>
 
 namespace map_optimization {
+namespace {
+
+// Selects the visual error term type depending on where the landmark is
+// stored and returns the matching Huber loss delta.
+ceres_error_terms::visual::VisualErrorType getVisualErrorTermType(
+    const vi_map::Vertex& observer_vertex,
+    const vi_map::Vertex& landmark_store_vertex, double* huber_loss_delta) {
+  CHECK_NOTNULL(huber_loss_delta);
+  // As defined here: http://en.wikipedia.org/wiki/Huber_Loss_Function
+  *huber_loss_delta = 3.0;
+
+  if (observer_vertex.id() == landmark_store_vertex.id()) {
+    return ceres_error_terms::visual::VisualErrorType::kLocalKeyframe;
+  }
+  // Verify if the landmark and keyframe belong to the same mission.
+  if (observer_vertex.getMissionId() == landmark_store_vertex.getMissionId()) {
+    return ceres_error_terms::visual::VisualErrorType::kLocalMission;
+  }
+  *huber_loss_delta = 10.0;
+  return ceres_error_terms::visual::VisualErrorType::kGlobal;
+}
+
+// Sets the parameterizations and fixes the parameter blocks of a visual term
+// according to its type and the given options.
+void setVisualTermParameterBlockProperties(
+    const ceres_error_terms::visual::VisualErrorType error_term_type,
+    const bool fix_landmark_positions, const bool fix_intrinsics,
+    const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
+    const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        baseframe_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        camera_parameterization,
+    double* landmark_p_B, double* landmark_store_vertex_q_IM__M_p_MI,
+    double* landmark_store_baseframe_q_GM__G_p_GM,
+    double* observer_baseframe_q_GM__G_p_GM, double* vertex_q_IM__M_p_MI,
+    double* camera_q_CI, double* camera_C_p_CI, aslam::Camera* camera_ptr,
+    ceres_error_terms::ProblemInformation* problem_information) {
+  CHECK_NOTNULL(camera_ptr);
+  CHECK_NOTNULL(problem_information);
+
+  if (error_term_type !=
+      ceres_error_terms::visual::VisualErrorType::kLocalKeyframe) {
+    problem_information->setParameterization(
+        landmark_store_vertex_q_IM__M_p_MI, pose_parameterization);
+    problem_information->setParameterization(
+        vertex_q_IM__M_p_MI, pose_parameterization);
+
+    if (error_term_type ==
+        ceres_error_terms::visual::VisualErrorType::kGlobal) {
+      problem_information->setParameterization(
+          landmark_store_baseframe_q_GM__G_p_GM, baseframe_parameterization);
+      problem_information->setParameterization(
+          observer_baseframe_q_GM__G_p_GM, baseframe_parameterization);
+    }
+  }
+
+  problem_information->setParameterization(
+      camera_q_CI, camera_parameterization);
+
+  if (fix_landmark_positions) {
+    problem_information->setParameterBlockConstant(landmark_p_B);
+  }
+  if (fix_intrinsics) {
+    problem_information->setParameterBlockConstant(
+        camera_ptr->getParametersMutable());
+    if (camera_ptr->getDistortion().getType() !=
+        aslam::Distortion::Type::kNoDistortion) {
+      problem_information->setParameterBlockConstant(
+          camera_ptr->getDistortionMutable()->getParametersMutable());
+    }
+  }
+  if (fix_extrinsics_rotation) {
+    problem_information->setParameterBlockConstant(camera_q_CI);
+  }
+  if (fix_extrinsics_translation) {
+    problem_information->setParameterBlockConstant(camera_C_p_CI);
+  }
+}
+
+}  // namespace
 
 bool addVisualTermForKeypoint(
     const int keypoint_idx, const int frame_idx,
@@ -62,23 +149,10 @@ bool addVisualTermForKeypoint(
       vertex_ptr->getVisualFrame(frame_idx).getKeypointMeasurementUncertainty(
           keypoint_idx);
 
-  // As defined here: http://en.wikipedia.org/wiki/Huber_Loss_Function
-  double huber_loss_delta = 3.0;
-
-  ceres_error_terms::visual::VisualErrorType error_term_type;
-  if (vertex_ptr->id() != landmark_store_vertex.id()) {
-    // Verify if the landmark and keyframe belong to the same mission.
-    if (vertex_ptr->getMissionId() == landmark_store_vertex.getMissionId()) {
-      error_term_type =
-          ceres_error_terms::visual::VisualErrorType::kLocalMission;
-    } else {
-      error_term_type = ceres_error_terms::visual::VisualErrorType::kGlobal;
-      huber_loss_delta = 10.0;
-    }
-  } else {
-    error_term_type =
-        ceres_error_terms::visual::VisualErrorType::kLocalKeyframe;
-  }
+  double huber_loss_delta;
+  const ceres_error_terms::visual::VisualErrorType error_term_type =
+      getVisualErrorTermType(
+          *vertex_ptr, landmark_store_vertex, &huber_loss_delta);
 
   double* distortion_params = nullptr;
   if (camera_ptr->getDistortion().getType() !=
@@ -149,53 +223,162 @@ bool addVisualTermForKeypoint(
       ceres_error_terms::ResidualType::kVisualReprojectionError,
       visual_term_cost, loss_function, cost_term_args);
 
-  if (error_term_type !=
-      ceres_error_terms::visual::VisualErrorType::kLocalKeyframe) {
-    problem_information->setParameterization(
-        landmark_store_vertex_q_IM__M_p_MI, pose_parameterization);
-    problem_information->setParameterization(
-        vertex_q_IM__M_p_MI, pose_parameterization);
+  setVisualTermParameterBlockProperties(
+      error_term_type, fix_landmark_positions, fix_intrinsics,
+      fix_extrinsics_rotation, fix_extrinsics_translation,
+      pose_parameterization, baseframe_parameterization,
+      camera_parameterization, landmark.get_p_B_Mutable(),
+      landmark_store_vertex_q_IM__M_p_MI,
+      landmark_store_baseframe_q_GM__G_p_GM, observer_baseframe_q_GM__G_p_GM,
+      vertex_q_IM__M_p_MI, camera_q_CI, camera_C_p_CI, camera_ptr.get(),
+      problem_information);
 
-    if (error_term_type ==
-        ceres_error_terms::visual::VisualErrorType::kGlobal) {
-      problem_information->setParameterization(
-          landmark_store_baseframe_q_GM__G_p_GM, baseframe_parameterization);
-      problem_information->setParameterization(
-          observer_baseframe_q_GM__G_p_GM, baseframe_parameterization);
-    }
-  }
+  problem->getProblemBookkeepingMutable()->landmarks_in_problem.emplace(
+      landmark_id, visual_term_cost.get());
+  return true;
+}
 
-  problem_information->setParameterization(
-      camera_q_CI, camera_parameterization);
+size_t addBatchedVisualTermsForLandmark(
+    const vi_map::LandmarkId& landmark_id,
+    const vi_map::KeypointIdentifierList& observations,
+    const size_t max_observations_per_batch,
+    const bool fix_landmark_positions, const bool fix_intrinsics,
+    const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
+    const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        baseframe_parameterization,
+    const std::shared_ptr<ceres::LocalParameterization>&
+        camera_parameterization,
+    OptimizationProblem* problem) {
+  CHECK_NOTNULL(problem);
+  CHECK(landmark_id.isValid());
+  CHECK_GT(max_observations_per_batch, 0u);
 
-  if (fix_landmark_positions) {
-    problem_information->setParameterBlockConstant(landmark.get_p_B_Mutable());
-  }
-  if (fix_intrinsics) {
-    problem_information->setParameterBlockConstant(
-        camera_ptr->getParametersMutable());
+  CHECK(pose_parameterization != nullptr);
+  CHECK(baseframe_parameterization != nullptr);
+  CHECK(camera_parameterization != nullptr);
+
+  OptimizationStateBuffer* buffer =
+      CHECK_NOTNULL(problem->getOptimizationStateBufferMutable());
+  vi_map::VIMap* map = CHECK_NOTNULL(problem->getMapMutable());
+  ceres_error_terms::ProblemInformation* problem_information =
+      CHECK_NOTNULL(problem->getProblemInformationMutable());
+
+  vi_map::Vertex& landmark_store_vertex =
+      map->getLandmarkStoreVertex(landmark_id);
+  vi_map::Landmark& landmark = map->getLandmark(landmark_id);
+  double* landmark_store_vertex_q_IM__M_p_MI =
+      buffer->get_vertex_q_IM__M_p_MI_JPL(landmark_store_vertex.id());
+  double* landmark_store_baseframe_q_GM__G_p_GM =
+      buffer->get_baseframe_q_GM__G_p_GM_JPL(
+          map->getMissionForVertex(landmark_store_vertex.id())
+              .getBaseFrameId());
+
+  size_t num_residual_blocks_added = 0u;
+  typedef std::shared_ptr<ceres_error_terms::BatchedVisualCostFunction>
+      BatchedCostFunctionPtr;
+  auto add_batch_to_problem = [&](const BatchedCostFunctionPtr& batch) {
+    problem_information->addResidualBlock(
+        ceres_error_terms::ResidualType::kVisualReprojectionError, batch,
+        nullptr, batch->getParameterBlocks());
+    problem->getProblemBookkeepingMutable()->landmarks_in_problem.emplace(
+        landmark_id, batch.get());
+    ++num_residual_blocks_added;
+  };
+
+  // Observations can only be batched if they are made by cameras of the same
+  // projection and distortion type.
+  typedef std::pair<aslam::Camera::Type, aslam::Distortion::Type> CameraType;
+  std::map<CameraType, BatchedCostFunctionPtr> open_batches;
+
+  for (const vi_map::KeypointIdentifier& observation : observations) {
+    vi_map::Vertex& vertex = map->getVertex(observation.frame_id.vertex_id);
+    const size_t frame_idx = observation.frame_id.frame_index;
+    const aslam::VisualFrame& visual_frame = vertex.getVisualFrame(frame_idx);
+    CHECK_LT(
+        observation.keypoint_index, visual_frame.getNumKeypointMeasurements());
+    CHECK(vertex.getObservedLandmarkId(observation) == landmark_id);
+
+    const aslam::Camera::Ptr camera_ptr = vertex.getCamera(frame_idx);
+    CHECK(camera_ptr != nullptr);
+
+    double huber_loss_delta;
+    const ceres_error_terms::visual::VisualErrorType error_term_type =
+        getVisualErrorTermType(
+            vertex, landmark_store_vertex, &huber_loss_delta);
+
+    const aslam::CameraId& camera_id = camera_ptr->getId();
+    CHECK(camera_id.isValid());
+    double* camera_q_CI =
+        buffer->get_camera_extrinsics_q_CI__C_p_CI_JPL(camera_id);
+
+    ceres_error_terms::BatchedVisualCostFunction::ObservationParameterBlocks
+        parameter_blocks;
+    parameter_blocks.observer_mission_base_pose =
+        buffer->get_baseframe_q_GM__G_p_GM_JPL(
+            map->getMissionForVertex(vertex.id()).getBaseFrameId());
+    parameter_blocks.observer_pose =
+        buffer->get_vertex_q_IM__M_p_MI_JPL(vertex.id());
+    parameter_blocks.camera_to_imu_orientation = camera_q_CI;
+    // Shifting by 4 = the quaternion size.
+    parameter_blocks.camera_to_imu_position = camera_q_CI + 4;
+    parameter_blocks.camera_intrinsics = camera_ptr->getParametersMutable();
     if (camera_ptr->getDistortion().getType() !=
         aslam::Distortion::Type::kNoDistortion) {
-      problem_information->setParameterBlockConstant(
+      parameter_blocks.camera_distortion = CHECK_NOTNULL(
           camera_ptr->getDistortionMutable()->getParametersMutable());
     }
-  }
-  if (fix_extrinsics_rotation) {
-    problem_information->setParameterBlockConstant(camera_q_CI);
-  }
-  if (fix_extrinsics_translation) {
-    problem_information->setParameterBlockConstant(camera_C_p_CI);
+
+    const CameraType camera_type(
+        camera_ptr->getType(), camera_ptr->getDistortion().getType());
+    BatchedCostFunctionPtr& batch = open_batches[camera_type];
+    if (batch == nullptr) {
+      batch.reset(ceres_error_terms::createBatchedVisualCostFunction(
+          *camera_ptr, landmark.get_p_B_Mutable(),
+          landmark_store_vertex_q_IM__M_p_MI,
+          landmark_store_baseframe_q_GM__G_p_GM));
+    }
+
+    const double image_point_uncertainty =
+        visual_frame.getKeypointMeasurementUncertainty(
+            observation.keypoint_index);
+    batch->addObservation(
+        visual_frame.getKeypointMeasurement(observation.keypoint_index),
+        image_point_uncertainty, huber_loss_delta * image_point_uncertainty,
+        error_term_type, *camera_ptr, parameter_blocks);
+
+    setVisualTermParameterBlockProperties(
+        error_term_type, fix_landmark_positions, fix_intrinsics,
+        fix_extrinsics_rotation, fix_extrinsics_translation,
+        pose_parameterization, baseframe_parameterization,
+        camera_parameterization, landmark.get_p_B_Mutable(),
+        landmark_store_vertex_q_IM__M_p_MI,
+        landmark_store_baseframe_q_GM__G_p_GM,
+        parameter_blocks.observer_mission_base_pose,
+        parameter_blocks.observer_pose, camera_q_CI,
+        parameter_blocks.camera_to_imu_position, camera_ptr.get(),
+        problem_information);
+
+    if (batch->numObservations() >= max_observations_per_batch) {
+      add_batch_to_problem(batch);
+      batch.reset();
+    }
   }
 
-  problem->getProblemBookkeepingMutable()->landmarks_in_problem.emplace(
-      landmark_id, visual_term_cost.get());
-  return true;
+  for (const std::pair<const CameraType, BatchedCostFunctionPtr>& batch :
+       open_batches) {
+    if (batch.second != nullptr) {
+      add_batch_to_problem(batch.second);
+    }
+  }
+  return num_residual_blocks_added;
 }
 
 void addVisualTermsForVertices(
     const bool fix_landmark_positions, const bool fix_intrinsics,
     const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
     const size_t min_landmarks_per_frame,
+    const size_t max_observations_per_visual_batch,
     const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
     const std::shared_ptr<ceres::LocalParameterization>&
         baseframe_parameterization,
@@ -207,6 +390,13 @@ void addVisualTermsForVertices(
   vi_map::VIMap* map = CHECK_NOTNULL(problem->getMapMutable());
   const vi_map::MissionIdSet& missions_to_optimize = problem->getMissionIds();
 
+  // If batching is enabled the observations are first collected per landmark
+  // (in the order they are encountered) and added in a second pass.
+  const bool use_batches = max_observations_per_visual_batch > 1u;
+  vi_map::LandmarkIdList batched_landmark_ids;
+  std::unordered_map<vi_map::LandmarkId, vi_map::KeypointIdentifierList>
+      batched_observations;
+
   for (const pose_graph::VertexId& vertex_id : vertices) {
     vi_map::Vertex& vertex = map->getVertex(vertex_id);
     const size_t num_frames = vertex.numFrames();
@@ -261,6 +451,16 @@ void addVisualTermsForVertices(
           continue;
         }
 
+        if (use_batches) {
+          vi_map::KeypointIdentifierList& observations =
+              batched_observations[landmark_id];
+          if (observations.empty()) {
+            batched_landmark_ids.push_back(landmark_id);
+          }
+          observations.emplace_back(vertex_id, frame_idx, keypoint_idx);
+          continue;
+        }
+
         addVisualTermForKeypoint(
             keypoint_idx, frame_idx, fix_landmark_positions, fix_intrinsics,
             fix_extrinsics_rotation, fix_extrinsics_translation,
@@ -269,12 +469,28 @@ void addVisualTermsForVertices(
       }
     }
   }
+
+  size_t num_batches_added = 0u;
+  for (const vi_map::LandmarkId& landmark_id : batched_landmark_ids) {
+    num_batches_added += addBatchedVisualTermsForLandmark(
+        landmark_id, batched_observations[landmark_id],
+        max_observations_per_visual_batch, fix_landmark_positions,
+        fix_intrinsics, fix_extrinsics_rotation, fix_extrinsics_translation,
+        pose_parameterization, baseframe_parameterization,
+        camera_parameterization, problem);
+  }
+  if (use_batches) {
+    VLOG(1) << "Added " << num_batches_added << " batched visual residuals "
+            << "for " << batched_landmark_ids.size() << " landmarks.";
+  }
 }
 
 void addVisualTerms(
     const bool fix_landmark_positions, const bool fix_intrinsics,
     const bool fix_extrinsics_rotation, const bool fix_extrinsics_translation,
-    const size_t min_landmarks_per_frame, OptimizationProblem* problem) {
+    const size_t min_landmarks_per_frame,
+    const size_t max_observations_per_visual_batch,
+    OptimizationProblem* problem) {
   CHECK_NOTNULL(problem);
 
   vi_map::VIMap* map = CHECK_NOTNULL(problem->getMapMutable());
@@ -282,23 +498,29 @@ void addVisualTerms(
   const OptimizationProblem::LocalParameterizations& parameterizations =
       problem->getLocalParameterizations();
 
+  // All vertices are added at once such that observations of a landmark from
+  // different missions end up in the same batch.
+  pose_graph::VertexIdList vertices;
   const vi_map::MissionIdSet& missions_to_optimize = problem->getMissionIds();
   for (const vi_map::MissionId& mission_id : missions_to_optimize) {
-    pose_graph::VertexIdList vertices;
-    map->getAllVertexIdsInMissionAlongGraph(mission_id, &vertices);
-    addVisualTermsForVertices(
-        fix_landmark_positions, fix_intrinsics, fix_extrinsics_rotation,
-        fix_extrinsics_translation, min_landmarks_per_frame,
-        parameterizations.pose_parameterization,
-        parameterizations.baseframe_parameterization,
-        parameterizations.quaternion_parameterization, vertices, problem);
+    pose_graph::VertexIdList mission_vertices;
+    map->getAllVertexIdsInMissionAlongGraph(mission_id, &mission_vertices);
+    vertices.insert(
+        vertices.end(), mission_vertices.begin(), mission_vertices.end());
   }
+  addVisualTermsForVertices(
+      fix_landmark_positions, fix_intrinsics, fix_extrinsics_rotation,
+      fix_extrinsics_translation, min_landmarks_per_frame,
+      max_observations_per_visual_batch,
+      parameterizations.pose_parameterization,
+      parameterizations.baseframe_parameterization,
+      parameterizations.quaternion_parameterization, vertices, problem);
 }
 
 void addInertialTerms(
     const bool fix_gyro_bias, const bool fix_accel_bias,
-    const bool fix_velocity, const double gravity_magnitude,
-    OptimizationProblem* problem) {
+    const bool fix_velocity, const bool use_imu_preintegration,
+    const double gravity_magnitude, OptimizationProblem* problem) {
   CHECK_NOTNULL(problem);
 
   vi_map::VIMap* map = CHECK_NOTNULL(problem->getMapMutable());
@@ -319,8 +541,9 @@ void addInertialTerms(
     const vi_map::ImuSigmas& imu_sigmas = imu_sensor.getImuSigmas();
 
     num_residuals_added += addInertialTermsForEdges(
-        fix_gyro_bias, fix_accel_bias, fix_velocity, gravity_magnitude,
-        imu_sigmas, parameterizations.pose_parameterization, edges, problem);
+        fix_gyro_bias, fix_accel_bias, fix_velocity, use_imu_preintegration,
+        gravity_magnitude, imu_sigmas, parameterizations.pose_parameterization,
+        edges, problem);
   }
 
   VLOG(1) << "Added " << num_residuals_added << " inertial residuals.";
@@ -328,8 +551,8 @@ void addInertialTerms(
 
 int addInertialTermsForEdges(
     const bool fix_gyro_bias, const bool fix_accel_bias,
-    const bool fix_velocity, const double gravity_magnitude,
-    const vi_map::ImuSigmas& imu_sigmas,
+    const bool fix_velocity, const bool use_imu_preintegration,
+    const double gravity_magnitude, const vi_map::ImuSigmas& imu_sigmas,
     const std::shared_ptr<ceres::LocalParameterization>& pose_parameterization,
     const pose_graph::EdgeIdList& edges, OptimizationProblem* problem) {
   CHECK(pose_parameterization != nullptr);
@@ -344,13 +567,26 @@ int addInertialTermsForEdges(
     const vi_map::ViwlsEdge& inertial_edge =
         map->getEdgeAs<vi_map::ViwlsEdge>(edge_id);
 
-    std::shared_ptr<ceres_error_terms::InertialErrorTerm> inertial_term_cost(
-        new ceres_error_terms::InertialErrorTerm(
-            inertial_edge.getImuData(), inertial_edge.getImuTimestamps(),
-            imu_sigmas.gyro_noise_density,
-            imu_sigmas.gyro_bias_random_walk_noise_density,
-            imu_sigmas.acc_noise_density,
-            imu_sigmas.acc_bias_random_walk_noise_density, gravity_magnitude));
+    std::shared_ptr<ceres::CostFunction> inertial_term_cost;
+    if (use_imu_preintegration) {
+      inertial_term_cost.reset(
+          new ceres_error_terms::PreintegratedInertialErrorTerm(
+              inertial_edge.getImuData(), inertial_edge.getImuTimestamps(),
+              imu_sigmas.gyro_noise_density,
+              imu_sigmas.gyro_bias_random_walk_noise_density,
+              imu_sigmas.acc_noise_density,
+              imu_sigmas.acc_bias_random_walk_noise_density,
+              gravity_magnitude));
+    } else {
+      inertial_term_cost.reset(
+          new ceres_error_terms::InertialErrorTerm(
+              inertial_edge.getImuData(), inertial_edge.getImuTimestamps(),
+              imu_sigmas.gyro_noise_density,
+              imu_sigmas.gyro_bias_random_walk_noise_density,
+              imu_sigmas.acc_noise_density,
+              imu_sigmas.acc_bias_random_walk_noise_density,
+              gravity_magnitude));
+    }
 
     vi_map::Vertex& vertex_from = map->getVertex(inertial_edge.from());
     vi_map::Vertex& vertex_to = map->getVertex(inertial_edge.to());
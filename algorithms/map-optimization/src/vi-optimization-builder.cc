@@ -31,6 +31,10 @@ DEFINE_bool(
 DEFINE_bool(
     ba_fix_velocity, false,
     "Whether or not to fix the velocity of the vertices.");
+DEFINE_bool(
+    ba_use_imu_preintegration, false,
+    "Whether or not to use preintegrated IMU error-terms, which only integrate "
+    "the IMU measurements again after large changes of the bias estimates.");
 
 DEFINE_double(
     ba_latitude, common::locations::kLatitudeZurichDegrees,
@@ -44,6 +48,15 @@ DEFINE_int32(
     "Minimum number of landmarks a frame must observe to be included in the "
     "problem.");
 
+DEFINE_bool(
+    ba_use_batched_visual_terms, false,
+    "Whether or not to combine the observations of a landmark into batched "
+    "visual error-terms instead of adding one error-term per observation.");
+DEFINE_int32(
+    ba_visual_batch_max_observations, 8,
+    "Maximum number of observations per batched visual error-term. Larger "
+    "batches result in fewer residual blocks but larger dense Jacobians.");
+
 namespace map_optimization {
 
 ViProblemOptions ViProblemOptions::initFromGFlags() {
@@ -53,6 +66,7 @@ ViProblemOptions ViProblemOptions::initFromGFlags() {
   options.fix_gyro_bias = FLAGS_ba_fix_gyro_bias;
   options.fix_accel_bias = FLAGS_ba_fix_accel_bias;
   options.fix_velocity = FLAGS_ba_fix_velocity;
+  options.use_imu_preintegration = FLAGS_ba_use_imu_preintegration;
   options.min_landmarks_per_frame = FLAGS_ba_min_landmark_per_frame;
 
   common::GravityProvider gravity_provider(
@@ -66,6 +80,11 @@ ViProblemOptions ViProblemOptions::initFromGFlags() {
   options.fix_extrinsics_translation =
       FLAGS_ba_fix_ncamera_extrinsics_translation;
   options.fix_landmark_positions = FLAGS_ba_fix_landmark_positions;
+  CHECK_GT(FLAGS_ba_visual_batch_max_observations, 0);
+  options.max_observations_per_visual_batch =
+      FLAGS_ba_use_batched_visual_terms
+          ? static_cast<size_t>(FLAGS_ba_visual_batch_max_observations)
+          : 0u;
 
   return options;
 }
@@ -87,12 +106,13 @@ OptimizationProblem* constructViProblem(
     addVisualTerms(
         options.fix_landmark_positions, options.fix_intrinsics,
         options.fix_extrinsics_rotation, options.fix_extrinsics_translation,
-        options.min_landmarks_per_frame, problem);
+        options.min_landmarks_per_frame,
+        options.max_observations_per_visual_batch, problem);
   }
   if (options.add_inertial_constraints) {
     addInertialTerms(
         options.fix_gyro_bias, options.fix_accel_bias, options.fix_velocity,
-        options.gravity_magnitude, problem);
+        options.use_imu_preintegration, options.gravity_magnitude, problem);
   }
 
   // Fixing open DoF of the visual(-inertial) problem. We assume that if there
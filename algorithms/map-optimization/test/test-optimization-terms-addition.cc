@@ -67,10 +67,12 @@ class OptimizationTermAdditionTest : public ::testing::Test {
   static constexpr bool kFixExtrinsicsRotation = false;
   static constexpr bool kFixExtrinsicsTranslation = false;
   static constexpr size_t kMinLandmarksPerFrame = 0u;
+  static constexpr size_t kNoVisualBatching = 0u;
 
   static constexpr bool kFixGyroBias = false;
   static constexpr bool kFixAccelBias = false;
   static constexpr bool kFixVelocity = false;
+  static constexpr bool kUseImuPreintegration = false;
   static constexpr double kGravityMagnitude = 9.81;
 
   vi_map::VIMap map;
@@ -83,7 +85,8 @@ TEST_F(OptimizationTermAdditionTest, AddVisualTerms) {
   OptimizationProblem optimization_problem(&map, mission_ids_);
   addVisualTerms(
       kFixLandmarkPositions, kFixIntrinsics, kFixExtrinsicsRotation,
-      kFixExtrinsicsTranslation, kMinLandmarksPerFrame, &optimization_problem);
+      kFixExtrinsicsTranslation, kMinLandmarksPerFrame, kNoVisualBatching,
+      &optimization_problem);
 
   EXPECT_EQ(
       num_vertices_, optimization_problem.getProblemBookkeepingMutable()
@@ -98,11 +101,72 @@ TEST_F(OptimizationTermAdditionTest, AddVisualTerms) {
       problem_information->active_parameter_blocks.size());
 }
 
+TEST_F(OptimizationTermAdditionTest, AddBatchedVisualTerms) {
+  OptimizationProblem unbatched_problem(&map, mission_ids_);
+  addVisualTerms(
+      kFixLandmarkPositions, kFixIntrinsics, kFixExtrinsicsRotation,
+      kFixExtrinsicsTranslation, kMinLandmarksPerFrame, kNoVisualBatching,
+      &unbatched_problem);
+
+  OptimizationProblem optimization_problem(&map, mission_ids_);
+  constexpr size_t kMaxObservationsPerBatch = 4u;
+  addVisualTerms(
+      kFixLandmarkPositions, kFixIntrinsics, kFixExtrinsicsRotation,
+      kFixExtrinsicsTranslation, kMinLandmarksPerFrame,
+      kMaxObservationsPerBatch, &optimization_problem);
+
+  EXPECT_EQ(
+      num_vertices_, optimization_problem.getProblemBookkeepingMutable()
+                         ->keyframes_in_problem.size());
+  EXPECT_EQ(
+      unbatched_problem.getProblemBookkeepingMutable()
+          ->landmarks_in_problem.size(),
+      unbatched_problem.getProblemInformationMutable()->residual_blocks.size());
+
+  const ceres_error_terms::ProblemInformation* problem_information =
+      optimization_problem.getProblemInformationMutable();
+  // Batched terms only reference the parameter blocks they use, hence no
+  // dummy blocks are added.
+  EXPECT_TRUE(problem_information->constant_parameter_blocks.empty());
+  EXPECT_EQ(
+      numActiveParameterBlocksForVisualTerms() -
+          numConstParameterBlocksForVisualTerms(),
+      problem_information->active_parameter_blocks.size());
+  EXPECT_LT(
+      problem_information->residual_blocks.size(),
+      unbatched_problem.getProblemInformationMutable()->residual_blocks.size());
+  EXPECT_EQ(
+      optimization_problem.getProblemBookkeepingMutable()
+          ->landmarks_in_problem.size(),
+      problem_information->residual_blocks.size());
+}
+
 TEST_F(OptimizationTermAdditionTest, AddInertialTerms) {
   OptimizationProblem optimization_problem(&map, mission_ids_);
   addInertialTerms(
-      kFixGyroBias, kFixAccelBias, kFixVelocity, kGravityMagnitude,
-      &optimization_problem);
+      kFixGyroBias, kFixAccelBias, kFixVelocity, kUseImuPreintegration,
+      kGravityMagnitude, &optimization_problem);
+
+  EXPECT_EQ(
+      num_vertices_, optimization_problem.getProblemBookkeepingMutable()
+                         ->keyframes_in_problem.size());
+
+  const ceres_error_terms::ProblemInformation* problem_information =
+      optimization_problem.getProblemInformationMutable();
+  EXPECT_EQ(
+      numConstParameterBlocksForInertialTerms(),
+      problem_information->constant_parameter_blocks.size());
+  EXPECT_EQ(
+      numActiveParameterBlocksForInertialTerms(),
+      problem_information->active_parameter_blocks.size());
+}
+
+TEST_F(OptimizationTermAdditionTest, AddPreintegratedInertialTerms) {
+  OptimizationProblem optimization_problem(&map, mission_ids_);
+  constexpr bool kUsePreintegration = true;
+  addInertialTerms(
+      kFixGyroBias, kFixAccelBias, kFixVelocity, kUsePreintegration,
+      kGravityMagnitude, &optimization_problem);
 
   EXPECT_EQ(
       num_vertices_, optimization_problem.getProblemBookkeepingMutable()
@@ -123,10 +187,11 @@ TEST_F(OptimizationTermAdditionTest, AddVisualAndInertialTerms) {
 
   addVisualTerms(
       kFixLandmarkPositions, kFixIntrinsics, kFixExtrinsicsRotation,
-      kFixExtrinsicsTranslation, kMinLandmarksPerFrame, &optimization_problem);
-  addInertialTerms(
-      kFixGyroBias, kFixAccelBias, kFixVelocity, kGravityMagnitude,
+      kFixExtrinsicsTranslation, kMinLandmarksPerFrame, kNoVisualBatching,
       &optimization_problem);
+  addInertialTerms(
+      kFixGyroBias, kFixAccelBias, kFixVelocity, kUseImuPreintegration,
+      kGravityMagnitude, &optimization_problem);
 
   EXPECT_EQ(
       num_vertices_, optimization_problem.getProblemBookkeepingMutable()
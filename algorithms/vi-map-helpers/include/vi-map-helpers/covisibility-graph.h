@@ -0,0 +1,151 @@
+#ifndef VI_MAP_HELPERS_COVISIBILITY_GRAPH_H_
+#define VI_MAP_HELPERS_COVISIBILITY_GRAPH_H_
+
+#include <functional>
+#include <iostream>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vi-map/vi-map.h>
+
+namespace vi_map_helpers {
+
+// Weighted covisibility graph of the vertices of a map. Two vertices are
+// connected if they observe at least one common landmark, the weight of the
+// edge is the number of distinct landmarks observed by both vertices.
+//
+// The adjacency is stored in compressed sparse row (CSR) format, where every
+// undirected edge is stored in the rows of both of its vertices and the
+// neighbors of every row are sorted by vertex index. Landmark removals and
+// merges can be applied incrementally, but have to be reported to the graph
+// BEFORE the map is modified as the observations of the affected landmarks
+// are needed to compute the changes. Edges that are created by landmark merges
+// are kept in a small overlay that is folded into the CSR arrays once it grows
+// too large. Adding or removing vertices requires a rebuild.
+class CovisibilityGraph {
+ public:
+  struct CovisibleVertex {
+    CovisibleVertex(
+        const pose_graph::VertexId& _vertex_id,
+        const uint32_t _num_common_landmarks)
+        : vertex_id(_vertex_id), num_common_landmarks(_num_common_landmarks) {}
+    pose_graph::VertexId vertex_id;
+    uint32_t num_common_landmarks;
+  };
+  typedef std::vector<CovisibleVertex> CovisibleVertexList;
+
+  static const std::string kFileName;
+
+  CovisibilityGraph() = default;
+
+  // Builds the graph for all vertices of the map, processing the vertices in
+  // parallel.
+  void build(const vi_map::VIMap& map);
+  void build(const vi_map::VIMap& map, const size_t num_threads);
+
+  void clear();
+
+  inline size_t numVertices() const {
+    return vertex_ids_.size();
+  }
+  // Number of undirected edges with a non-zero weight.
+  size_t numEdges() const;
+
+  bool hasVertex(const pose_graph::VertexId& vertex_id) const;
+  const pose_graph::VertexIdList& getVertexIds() const {
+    return vertex_ids_;
+  }
+
+  // Returns 0 if the vertices don't share any landmark or are not part of the
+  // graph.
+  uint32_t getNumCommonLandmarks(
+      const pose_graph::VertexId& vertex_id_1,
+      const pose_graph::VertexId& vertex_id_2) const;
+
+  // Returns all vertices sharing at least min_num_common_landmarks landmarks
+  // with the given vertex, sorted by decreasing number of common landmarks.
+  // The vertex itself is not part of the result.
+  size_t getCovisibleVertices(
+      const pose_graph::VertexId& vertex_id,
+      const uint32_t min_num_common_landmarks,
+      CovisibleVertexList* covisible_vertices) const;
+
+  // Calls the action once for every undirected edge with a weight of at least
+  // min_num_common_landmarks.
+  void forEachEdge(
+      const uint32_t min_num_common_landmarks,
+      const std::function<void(
+          const pose_graph::VertexId&, const pose_graph::VertexId&,
+          const uint32_t)>& action) const;
+
+  // Incremental updates, have to be called BEFORE the corresponding operation
+  // is applied to the map, i.e. before VIMap::removeLandmark and
+  // VIMap::mergeLandmarks respectively.
+  void removeLandmark(const vi_map::Landmark& landmark);
+  void mergeLandmarks(
+      const vi_map::Landmark& landmark_to_merge,
+      const vi_map::Landmark& landmark_into);
+
+  // Folds all pending incremental changes into the CSR arrays and removes
+  // edges with zero weight.
+  void compact();
+
+  // Only compacted graphs can be serialized.
+  void serialize(std::ostream* out) const;
+  bool deserialize(std::istream* in);
+
+  // Stores the graph as kFileName in the given map folder.
+  bool saveToMapFolder(const std::string& map_folder) const;
+  // Loads the graph from the given map folder. Fails if no graph was stored or
+  // if the stored graph doesn't cover the same vertices as the map.
+  bool loadFromMapFolder(
+      const std::string& map_folder, const vi_map::VIMap& map);
+
+  // Returns true if the graph contains exactly the vertices of the map.
+  bool coversSameVerticesAs(const vi_map::VIMap& map) const;
+
+ private:
+  static constexpr uint32_t kSerializationVersion = 1u;
+  static constexpr uint32_t kInvalidIndex = static_cast<uint32_t>(-1);
+
+  uint32_t getVertexIndex(const pose_graph::VertexId& vertex_id) const;
+
+  // Distinct indices of the vertices that observe the landmark and are part
+  // of the graph, sorted in increasing order.
+  void getObserverIndices(
+      const vi_map::Landmark& landmark,
+      std::vector<uint32_t>* observer_indices) const;
+
+  // Adds delta to the weight of the edge between the two vertices.
+  void addToEdgeWeight(
+      const uint32_t vertex_index_1, const uint32_t vertex_index_2,
+      const int delta);
+  void addToDirectedEdgeWeight(
+      const uint32_t from_index, const uint32_t to_index, const int delta);
+  // Adds delta to all edges between the given vertices.
+  void addToCliqueWeights(
+      const std::vector<uint32_t>& vertex_indices, const int delta);
+
+  void rebuildVertexIndexMap();
+
+  pose_graph::VertexIdList vertex_ids_;
+  std::unordered_map<pose_graph::VertexId, uint32_t> vertex_indices_;
+
+  // CSR adjacency: the neighbors of vertex i are stored in
+  // neighbor_indices_[row_offsets_[i], row_offsets_[i + 1]).
+  std::vector<uint32_t> row_offsets_;
+  std::vector<uint32_t> neighbor_indices_;
+  std::vector<uint32_t> weights_;
+
+  // Directed edges not yet part of the CSR arrays, indexed by vertex index.
+  typedef std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>>
+      OverlayEdges;
+  OverlayEdges overlay_edges_;
+  size_t num_overlay_edges_ = 0u;
+};
+
+}  // namespace vi_map_helpers
+
+#endif  // VI_MAP_HELPERS_COVISIBILITY_GRAPH_H_
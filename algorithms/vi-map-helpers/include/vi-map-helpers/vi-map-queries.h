@@ -116,6 +116,14 @@ class VIMapQueries {
       const uint64_t timestamp_ns, const uint64_t tolerance_ns,
       pose_graph::VertexId* vertex_id,
       uint64_t* timestamp_difference = nullptr);
+  // Batch version of getClosestVertexIdByTimestamp for importers. Timestamps
+  // without a vertex within the tolerance get an invalid vertex id. Returns
+  // the number of timestamps for which a vertex was found.
+  // Parameter timestamp_differences may be a nullptr.
+  size_t getClosestVertexIdsByTimestamps(
+      const std::vector<uint64_t>& timestamps_ns, const uint64_t tolerance_ns,
+      pose_graph::VertexIdList* vertex_ids,
+      std::vector<uint64_t>* timestamp_differences) const;
 
   struct VertexCommonLandmarksCount {
     int in_common;
@@ -0,0 +1,517 @@
+#include "vi-map-helpers/covisibility-graph.h"
+
+#include <algorithm>
+#include <fstream>  // NOLINT
+#include <functional>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+#include <maplab-common/binary-serialization.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+#include <vi-map/vi-map.h>
+
+namespace vi_map_helpers {
+
+const std::string CovisibilityGraph::kFileName = "covisibility_graph";
+constexpr uint32_t CovisibilityGraph::kSerializationVersion;
+constexpr uint32_t CovisibilityGraph::kInvalidIndex;
+
+namespace {
+// Pending edges are folded into the CSR arrays once there are more than
+// kMinNumOverlayEdgesForCompaction of them and they exceed the given fraction
+// of the CSR edges.
+constexpr size_t kMinNumOverlayEdgesForCompaction = 1024u;
+constexpr size_t kCsrToOverlayEdgeRatioForCompaction = 8u;
+}  // namespace
+
+void CovisibilityGraph::build(const vi_map::VIMap& map) {
+  build(map, common::getNumHardwareThreads());
+}
+
+void CovisibilityGraph::build(
+    const vi_map::VIMap& map, const size_t num_threads) {
+  CHECK_GT(num_threads, 0u);
+  clear();
+
+  map.getAllVertexIds(&vertex_ids_);
+  rebuildVertexIndexMap();
+  const size_t num_vertices = vertex_ids_.size();
+  row_offsets_.assign(num_vertices + 1u, 0u);
+  if (num_vertices == 0u) {
+    return;
+  }
+
+  typedef std::vector<std::pair<uint32_t, uint32_t>> Row;
+  std::vector<Row> rows(num_vertices);
+
+  std::function<void(const std::vector<size_t>&)> build_rows =
+      [&](const std::vector<size_t>& batch) {
+        // Dense per-thread counters. The stamps ensure that every vertex is
+        // counted at most once per landmark, even if it observes the landmark
+        // in several frames.
+        std::vector<uint32_t> counts(num_vertices, 0u);
+        std::vector<uint32_t> landmark_stamps(num_vertices, 0u);
+        std::vector<uint32_t> touched_indices;
+        uint32_t stamp = 0u;
+
+        vi_map::LandmarkIdList observed_landmark_ids;
+        vi_map::LandmarkIdSet landmark_ids;
+        for (const size_t row_index : batch) {
+          map.getVertex(vertex_ids_[row_index])
+              .getAllObservedLandmarkIds(&observed_landmark_ids);
+          landmark_ids.clear();
+          for (const vi_map::LandmarkId& landmark_id : observed_landmark_ids) {
+            if (landmark_id.isValid()) {
+              landmark_ids.insert(landmark_id);
+            }
+          }
+
+          for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+            ++stamp;
+            map.getLandmark(landmark_id)
+                .forEachObservation(
+                    [&](const vi_map::KeypointIdentifier& backlink) {
+                      const uint32_t index =
+                          getVertexIndex(backlink.frame_id.vertex_id);
+                      if (index == kInvalidIndex || index == row_index ||
+                          landmark_stamps[index] == stamp) {
+                        return;
+                      }
+                      landmark_stamps[index] = stamp;
+                      if (counts[index]++ == 0u) {
+                        touched_indices.push_back(index);
+                      }
+                    });
+          }
+
+          std::sort(touched_indices.begin(), touched_indices.end());
+          Row& row = rows[row_index];
+          row.reserve(touched_indices.size());
+          for (const uint32_t index : touched_indices) {
+            row.emplace_back(index, counts[index]);
+            counts[index] = 0u;
+          }
+          touched_indices.clear();
+        }
+      };
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      num_vertices, build_rows, kAlwaysParallelize, num_threads);
+
+  for (size_t i = 0u; i < num_vertices; ++i) {
+    row_offsets_[i + 1u] = row_offsets_[i] + rows[i].size();
+  }
+  neighbor_indices_.resize(row_offsets_.back());
+  weights_.resize(row_offsets_.back());
+  for (size_t i = 0u; i < num_vertices; ++i) {
+    uint32_t offset = row_offsets_[i];
+    for (const std::pair<uint32_t, uint32_t>& entry : rows[i]) {
+      neighbor_indices_[offset] = entry.first;
+      weights_[offset] = entry.second;
+      ++offset;
+    }
+    Row().swap(rows[i]);
+  }
+}
+
+void CovisibilityGraph::clear() {
+  vertex_ids_.clear();
+  vertex_indices_.clear();
+  row_offsets_.clear();
+  neighbor_indices_.clear();
+  weights_.clear();
+  overlay_edges_.clear();
+  num_overlay_edges_ = 0u;
+}
+
+size_t CovisibilityGraph::numEdges() const {
+  size_t num_directed_edges =
+      weights_.size() - std::count(weights_.begin(), weights_.end(), 0u);
+  num_directed_edges += num_overlay_edges_;
+  CHECK_EQ(num_directed_edges % 2u, 0u);
+  return num_directed_edges / 2u;
+}
+
+bool CovisibilityGraph::hasVertex(const pose_graph::VertexId& vertex_id) const {
+  return vertex_indices_.count(vertex_id) > 0u;
+}
+
+uint32_t CovisibilityGraph::getNumCommonLandmarks(
+    const pose_graph::VertexId& vertex_id_1,
+    const pose_graph::VertexId& vertex_id_2) const {
+  const uint32_t index_1 = getVertexIndex(vertex_id_1);
+  const uint32_t index_2 = getVertexIndex(vertex_id_2);
+  if (index_1 == kInvalidIndex || index_2 == kInvalidIndex ||
+      index_1 == index_2) {
+    return 0u;
+  }
+
+  const std::vector<uint32_t>::const_iterator row_begin =
+      neighbor_indices_.begin() + row_offsets_[index_1];
+  const std::vector<uint32_t>::const_iterator row_end =
+      neighbor_indices_.begin() + row_offsets_[index_1 + 1u];
+  const std::vector<uint32_t>::const_iterator it =
+      std::lower_bound(row_begin, row_end, index_2);
+  if (it != row_end && *it == index_2) {
+    return weights_[it - neighbor_indices_.begin()];
+  }
+
+  const OverlayEdges::const_iterator overlay_row =
+      overlay_edges_.find(index_1);
+  if (overlay_row != overlay_edges_.end()) {
+    const std::unordered_map<uint32_t, uint32_t>::const_iterator edge =
+        overlay_row->second.find(index_2);
+    if (edge != overlay_row->second.end()) {
+      return edge->second;
+    }
+  }
+  return 0u;
+}
+
+size_t CovisibilityGraph::getCovisibleVertices(
+    const pose_graph::VertexId& vertex_id,
+    const uint32_t min_num_common_landmarks,
+    CovisibleVertexList* covisible_vertices) const {
+  CHECK_NOTNULL(covisible_vertices)->clear();
+  const uint32_t index = getVertexIndex(vertex_id);
+  if (index == kInvalidIndex) {
+    return 0u;
+  }
+  const uint32_t min_weight = std::max(min_num_common_landmarks, 1u);
+
+  std::vector<std::pair<uint32_t, uint32_t>> neighbors;
+  for (uint32_t k = row_offsets_[index]; k < row_offsets_[index + 1u]; ++k) {
+    if (weights_[k] >= min_weight) {
+      neighbors.emplace_back(neighbor_indices_[k], weights_[k]);
+    }
+  }
+  const OverlayEdges::const_iterator overlay_row = overlay_edges_.find(index);
+  if (overlay_row != overlay_edges_.end()) {
+    for (const std::pair<const uint32_t, uint32_t>& edge :
+         overlay_row->second) {
+      if (edge.second >= min_weight) {
+        neighbors.emplace_back(edge.first, edge.second);
+      }
+    }
+  }
+
+  // Most covisible vertices first, ties are broken by vertex index to keep
+  // the result deterministic.
+  std::sort(
+      neighbors.begin(), neighbors.end(),
+      [](const std::pair<uint32_t, uint32_t>& lhs,
+         const std::pair<uint32_t, uint32_t>& rhs) {
+        return lhs.second > rhs.second ||
+               (lhs.second == rhs.second && lhs.first < rhs.first);
+      });
+  covisible_vertices->reserve(neighbors.size());
+  for (const std::pair<uint32_t, uint32_t>& neighbor : neighbors) {
+    covisible_vertices->emplace_back(
+        vertex_ids_[neighbor.first], neighbor.second);
+  }
+  return covisible_vertices->size();
+}
+
+void CovisibilityGraph::forEachEdge(
+    const uint32_t min_num_common_landmarks,
+    const std::function<void(
+        const pose_graph::VertexId&, const pose_graph::VertexId&,
+        const uint32_t)>& action) const {
+  const uint32_t min_weight = std::max(min_num_common_landmarks, 1u);
+  for (uint32_t i = 0u; i < vertex_ids_.size(); ++i) {
+    for (uint32_t k = row_offsets_[i]; k < row_offsets_[i + 1u]; ++k) {
+      if (neighbor_indices_[k] > i && weights_[k] >= min_weight) {
+        action(vertex_ids_[i], vertex_ids_[neighbor_indices_[k]], weights_[k]);
+      }
+    }
+  }
+  for (const OverlayEdges::value_type& overlay_row : overlay_edges_) {
+    for (const std::pair<const uint32_t, uint32_t>& edge :
+         overlay_row.second) {
+      if (edge.first > overlay_row.first && edge.second >= min_weight) {
+        action(
+            vertex_ids_[overlay_row.first], vertex_ids_[edge.first],
+            edge.second);
+      }
+    }
+  }
+}
+
+void CovisibilityGraph::removeLandmark(const vi_map::Landmark& landmark) {
+  std::vector<uint32_t> observer_indices;
+  getObserverIndices(landmark, &observer_indices);
+  addToCliqueWeights(observer_indices, -1);
+}
+
+void CovisibilityGraph::mergeLandmarks(
+    const vi_map::Landmark& landmark_to_merge,
+    const vi_map::Landmark& landmark_into) {
+  std::vector<uint32_t> observers_to_merge;
+  getObserverIndices(landmark_to_merge, &observers_to_merge);
+  std::vector<uint32_t> observers_into;
+  getObserverIndices(landmark_into, &observers_into);
+
+  std::vector<uint32_t> observers_merged;
+  std::set_union(
+      observers_to_merge.begin(), observers_to_merge.end(),
+      observers_into.begin(), observers_into.end(),
+      std::back_inserter(observers_merged));
+
+  // Every pair of observers of the merged landmark shares it once; pairs that
+  // already shared one or both of the original landmarks lose those.
+  for (size_t i = 0u; i < observers_merged.size(); ++i) {
+    const uint32_t index_i = observers_merged[i];
+    const bool i_observes_to_merge = std::binary_search(
+        observers_to_merge.begin(), observers_to_merge.end(), index_i);
+    const bool i_observes_into = std::binary_search(
+        observers_into.begin(), observers_into.end(), index_i);
+    for (size_t j = i + 1u; j < observers_merged.size(); ++j) {
+      const uint32_t index_j = observers_merged[j];
+      int delta = 1;
+      if (i_observes_to_merge &&
+          std::binary_search(
+              observers_to_merge.begin(), observers_to_merge.end(), index_j)) {
+        --delta;
+      }
+      if (i_observes_into &&
+          std::binary_search(
+              observers_into.begin(), observers_into.end(), index_j)) {
+        --delta;
+      }
+      if (delta != 0) {
+        addToEdgeWeight(index_i, index_j, delta);
+      }
+    }
+  }
+
+  if (num_overlay_edges_ > kMinNumOverlayEdgesForCompaction &&
+      num_overlay_edges_ * kCsrToOverlayEdgeRatioForCompaction >
+          neighbor_indices_.size()) {
+    compact();
+  }
+}
+
+void CovisibilityGraph::compact() {
+  const size_t num_vertices = vertex_ids_.size();
+  std::vector<uint32_t> row_offsets(num_vertices + 1u, 0u);
+  std::vector<uint32_t> neighbor_indices;
+  std::vector<uint32_t> weights;
+  neighbor_indices.reserve(neighbor_indices_.size() + num_overlay_edges_);
+  weights.reserve(neighbor_indices_.size() + num_overlay_edges_);
+
+  std::vector<std::pair<uint32_t, uint32_t>> row;
+  for (uint32_t i = 0u; i < num_vertices; ++i) {
+    row.clear();
+    for (uint32_t k = row_offsets_[i]; k < row_offsets_[i + 1u]; ++k) {
+      if (weights_[k] > 0u) {
+        row.emplace_back(neighbor_indices_[k], weights_[k]);
+      }
+    }
+    const OverlayEdges::const_iterator overlay_row = overlay_edges_.find(i);
+    if (overlay_row != overlay_edges_.end()) {
+      row.insert(
+          row.end(), overlay_row->second.begin(), overlay_row->second.end());
+      std::sort(row.begin(), row.end());
+    }
+    for (const std::pair<uint32_t, uint32_t>& entry : row) {
+      neighbor_indices.push_back(entry.first);
+      weights.push_back(entry.second);
+    }
+    row_offsets[i + 1u] = neighbor_indices.size();
+  }
+
+  row_offsets_.swap(row_offsets);
+  neighbor_indices_.swap(neighbor_indices);
+  weights_.swap(weights);
+  overlay_edges_.clear();
+  num_overlay_edges_ = 0u;
+}
+
+void CovisibilityGraph::serialize(std::ostream* out) const {
+  CHECK_NOTNULL(out);
+  CHECK_EQ(num_overlay_edges_, 0u)
+      << "Pending changes have to be compacted before serializing the graph.";
+  common::Serialize(kSerializationVersion, out);
+  common::Serialize(static_cast<uint32_t>(vertex_ids_.size()), out);
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+    common::Serialize(vertex_id, out);
+  }
+  common::Serialize(row_offsets_, out);
+  common::Serialize(neighbor_indices_, out);
+  common::Serialize(weights_, out);
+}
+
+bool CovisibilityGraph::deserialize(std::istream* in) {
+  CHECK_NOTNULL(in);
+  clear();
+
+  uint32_t version;
+  common::Deserialize(&version, in);
+  if (version != kSerializationVersion) {
+    LOG(ERROR) << "Covisibility graph version " << version
+               << " is not supported, expected version "
+               << kSerializationVersion << '.';
+    return false;
+  }
+
+  uint32_t num_vertices;
+  common::Deserialize(&num_vertices, in);
+  vertex_ids_.resize(num_vertices);
+  for (pose_graph::VertexId& vertex_id : vertex_ids_) {
+    common::Deserialize(&vertex_id, in);
+  }
+  rebuildVertexIndexMap();
+  common::Deserialize(&row_offsets_, in);
+  common::Deserialize(&neighbor_indices_, in);
+  common::Deserialize(&weights_, in);
+
+  CHECK_EQ(row_offsets_.size(), num_vertices + 1u);
+  CHECK_EQ(row_offsets_.back(), neighbor_indices_.size());
+  CHECK_EQ(neighbor_indices_.size(), weights_.size());
+  return true;
+}
+
+bool CovisibilityGraph::saveToMapFolder(const std::string& map_folder) const {
+  const std::string file_path =
+      common::concatenateFolderAndFileName(map_folder, kFileName);
+  std::ofstream out(file_path, std::ios::binary);
+  if (!out.is_open()) {
+    LOG(ERROR) << "Failed to open " << file_path << " for writing.";
+    return false;
+  }
+  serialize(&out);
+  return out.good();
+}
+
+bool CovisibilityGraph::loadFromMapFolder(
+    const std::string& map_folder, const vi_map::VIMap& map) {
+  const std::string file_path =
+      common::concatenateFolderAndFileName(map_folder, kFileName);
+  if (!common::fileExists(file_path)) {
+    VLOG(1) << "No covisibility graph found at " << file_path << '.';
+    return false;
+  }
+  std::ifstream in(file_path, std::ios::binary);
+  CHECK(in.is_open()) << "Failed to open " << file_path << '.';
+  if (!deserialize(&in)) {
+    clear();
+    return false;
+  }
+  if (!coversSameVerticesAs(map)) {
+    LOG(WARNING) << "The covisibility graph at " << file_path
+                 << " doesn't match the vertices of the map.";
+    clear();
+    return false;
+  }
+  return true;
+}
+
+bool CovisibilityGraph::coversSameVerticesAs(const vi_map::VIMap& map) const {
+  if (map.numVertices() != vertex_ids_.size()) {
+    return false;
+  }
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+    if (!map.hasVertex(vertex_id)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t CovisibilityGraph::getVertexIndex(
+    const pose_graph::VertexId& vertex_id) const {
+  const std::unordered_map<pose_graph::VertexId, uint32_t>::const_iterator it =
+      vertex_indices_.find(vertex_id);
+  return it == vertex_indices_.end() ? kInvalidIndex : it->second;
+}
+
+void CovisibilityGraph::getObserverIndices(
+    const vi_map::Landmark& landmark,
+    std::vector<uint32_t>* observer_indices) const {
+  CHECK_NOTNULL(observer_indices)->clear();
+  landmark.forEachObservation(
+      [&](const vi_map::KeypointIdentifier& backlink) {
+        const uint32_t index = getVertexIndex(backlink.frame_id.vertex_id);
+        if (index != kInvalidIndex) {
+          observer_indices->push_back(index);
+        }
+      });
+  std::sort(observer_indices->begin(), observer_indices->end());
+  observer_indices->erase(
+      std::unique(observer_indices->begin(), observer_indices->end()),
+      observer_indices->end());
+}
+
+void CovisibilityGraph::addToEdgeWeight(
+    const uint32_t vertex_index_1, const uint32_t vertex_index_2,
+    const int delta) {
+  addToDirectedEdgeWeight(vertex_index_1, vertex_index_2, delta);
+  addToDirectedEdgeWeight(vertex_index_2, vertex_index_1, delta);
+}
+
+void CovisibilityGraph::addToDirectedEdgeWeight(
+    const uint32_t from_index, const uint32_t to_index, const int delta) {
+  CHECK_LT(from_index, vertex_ids_.size());
+  CHECK_LT(to_index, vertex_ids_.size());
+
+  const std::vector<uint32_t>::iterator row_begin =
+      neighbor_indices_.begin() + row_offsets_[from_index];
+  const std::vector<uint32_t>::iterator row_end =
+      neighbor_indices_.begin() + row_offsets_[from_index + 1u];
+  const std::vector<uint32_t>::iterator it =
+      std::lower_bound(row_begin, row_end, to_index);
+  if (it != row_end && *it == to_index) {
+    uint32_t& weight = weights_[it - neighbor_indices_.begin()];
+    CHECK_GE(static_cast<int>(weight) + delta, 0);
+    weight += delta;
+    return;
+  }
+
+  std::unordered_map<uint32_t, uint32_t>& overlay_row =
+      overlay_edges_[from_index];
+  std::unordered_map<uint32_t, uint32_t>::iterator edge =
+      overlay_row.find(to_index);
+  if (edge == overlay_row.end()) {
+    CHECK_GT(delta, 0) << "Edge between vertex " << vertex_ids_[from_index]
+                       << " and " << vertex_ids_[to_index] << " not found.";
+    overlay_row.emplace(to_index, static_cast<uint32_t>(delta));
+    ++num_overlay_edges_;
+    return;
+  }
+  CHECK_GE(static_cast<int>(edge->second) + delta, 0);
+  edge->second += delta;
+  if (edge->second == 0u) {
+    overlay_row.erase(edge);
+    --num_overlay_edges_;
+    if (overlay_row.empty()) {
+      overlay_edges_.erase(from_index);
+    }
+  }
+}
+
+void CovisibilityGraph::addToCliqueWeights(
+    const std::vector<uint32_t>& vertex_indices, const int delta) {
+  for (size_t i = 0u; i < vertex_indices.size(); ++i) {
+    for (size_t j = i + 1u; j < vertex_indices.size(); ++j) {
+      addToEdgeWeight(vertex_indices[i], vertex_indices[j], delta);
+    }
+  }
+}
+
+void CovisibilityGraph::rebuildVertexIndexMap() {
+  CHECK_LT(vertex_ids_.size(), kInvalidIndex);
+  vertex_indices_.clear();
+  vertex_indices_.reserve(vertex_ids_.size());
+  for (uint32_t i = 0u; i < vertex_ids_.size(); ++i) {
+    CHECK(vertex_indices_.emplace(vertex_ids_[i], i).second)
+        << "Duplicate vertex " << vertex_ids_[i] << '.';
+  }
+}
+
+}  // namespace vi_map_helpers
@@ -4,9 +4,8 @@
 #include <vector>
 
 #include <maplab-common/file-logger.h>
-#include <maplab-common/progress-bar.h>
 #include <metis.h>
-#include <vi-map-helpers/vi-map-queries.h>
+#include <vi-map-helpers/covisibility-graph.h>
 #include <vi-map/vi-map.h>
 
 namespace vi_map_helpers {
@@ -155,44 +154,37 @@ void VIMapPartitioner::getCoobserverEdges(
   const size_t num_vertices = vertex_indices.size();
   edges->resize(num_vertices);
 
-  typedef std::pair<pose_graph::VertexId, size_t> VertexIndexPair;
+  LOG(INFO) << "Building the covisibility graph...";
+  CovisibilityGraph covisibility_graph;
+  covisibility_graph.build(map);
 
-  vi_map_helpers::VIMapQueries vi_map_queries(map);
-  unsigned int index = 0u;
-  common::ProgressBar progress_bar(num_vertices);
   LOG(INFO) << "Partitioning the graph...";
-  for (const VertexIndexPair& vertex_index : vertex_indices) {
-    VLOG(5) << "Processing vertex " << index++ << "/" << (num_vertices - 1);
-
-    vi_map_helpers::VIMapQueries::VertexCommonLandmarksCountVector
-        coobserver_vertex_ids;
-
-    vi_map_queries.getVerticesWithCommonLandmarks(
-        vertex_index.first, min_number_of_common_landmarks,
-        &coobserver_vertex_ids);
-
-    for (const vi_map_helpers::VIMapQueries::VertexCommonLandmarksCount&
-             coobserver_vertex : coobserver_vertex_ids) {
-      std::unordered_map<pose_graph::VertexId, size_t>::const_iterator it =
-          vertex_indices.find(coobserver_vertex.vertex_id);
-      CHECK(it != vertex_indices.end());
-      unsigned int coobserver_index = it->second;
-      CHECK_LT(coobserver_index, edges->size());
-
-      GraphEdge edge_to_coobserver;
-      edge_to_coobserver.vertex_index = coobserver_index;
-      edge_to_coobserver.score = coobserver_vertex.in_common;
-      (*edges)[vertex_index.second].push_back(edge_to_coobserver);
-
-      GraphEdge edge_from_coobserver;
-      edge_from_coobserver.vertex_index = vertex_index.second;
-      edge_from_coobserver.score = coobserver_vertex.in_common;
-      (*edges)[coobserver_index].push_back(edge_from_coobserver);
-
-      ++(*total_num_edges);
-    }
-    progress_bar.increment();
-  }
+  covisibility_graph.forEachEdge(
+      min_number_of_common_landmarks,
+      [&](const pose_graph::VertexId& vertex_id_1,
+          const pose_graph::VertexId& vertex_id_2,
+          const uint32_t num_common_landmarks) {
+        std::unordered_map<pose_graph::VertexId, size_t>::const_iterator it_1 =
+            vertex_indices.find(vertex_id_1);
+        CHECK(it_1 != vertex_indices.end());
+        std::unordered_map<pose_graph::VertexId, size_t>::const_iterator it_2 =
+            vertex_indices.find(vertex_id_2);
+        CHECK(it_2 != vertex_indices.end());
+        CHECK_LT(it_1->second, edges->size());
+        CHECK_LT(it_2->second, edges->size());
+
+        GraphEdge edge_to_coobserver;
+        edge_to_coobserver.vertex_index = it_2->second;
+        edge_to_coobserver.score = num_common_landmarks;
+        (*edges)[it_1->second].push_back(edge_to_coobserver);
+
+        GraphEdge edge_from_coobserver;
+        edge_from_coobserver.vertex_index = it_1->second;
+        edge_from_coobserver.score = num_common_landmarks;
+        (*edges)[it_2->second].push_back(edge_from_coobserver);
+
+        ++(*total_num_edges);
+      });
 }
 
 void VIMapPartitioner::assignAndGetVertexIndices(
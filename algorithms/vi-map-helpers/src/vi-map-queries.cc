@@ -1,6 +1,7 @@
 #include "vi-map-helpers/vi-map-queries.h"
 
 #include <algorithm>
+#include <limits>
 #include <unordered_set>
 
 #include <glog/logging.h>
@@ -413,53 +414,77 @@ bool VIMapQueries::getClosestVertexIdByTimestamp(
     const uint64_t timestamp_ns, const uint64_t tolerance_ns,
     pose_graph::VertexId* vertex_id_out, uint64_t* timestamp_difference) {
   CHECK_NOTNULL(vertex_id_out);
-  pose_graph::VertexIdList ids;
-  map_.getAllVertexIdsAlongGraphsSortedByTimestamp(&ids);
-
-  int64_t min_difference = -1;
-  pose_graph::VertexId best_vertex_id;
-
-  bool found_exactly = false;
-  for (const pose_graph::VertexId& vertex_id : ids) {
-    const vi_map::Vertex& vertex = map_.getVertex(vertex_id);
-
-    const size_t num_frames = vertex.numFrames();
-    CHECK_GT(num_frames, 0u);
-
-    for (size_t frame_i = 0u; frame_i < num_frames; ++frame_i) {
-      const aslam::VisualFrame& frame = vertex.getVisualFrame(frame_i);
-      const int64 difference =
-          labs(timestamp_ns - frame.getTimestampNanoseconds());
-
-      if (min_difference < 0 || difference < min_difference) {
-        min_difference = difference;
-        best_vertex_id = vertex_id;
-        if (difference == 0) {
-          found_exactly = true;
-          break;
-        }
-      }
-    }
-    if (found_exactly) {
-      break;
-    }
-  }
+  pose_graph::VertexIdList vertex_ids;
+  std::vector<uint64_t> timestamp_differences;
+  const size_t num_found = getClosestVertexIdsByTimestamps(
+      std::vector<uint64_t>(1u, timestamp_ns), tolerance_ns, &vertex_ids,
+      &timestamp_differences);
+  CHECK_EQ(vertex_ids.size(), 1u);
 
   if (timestamp_difference != nullptr) {
-    *timestamp_difference = static_cast<uint64_t>(min_difference);
+    *timestamp_difference = timestamp_differences[0];
   }
-
-  if (min_difference < static_cast<int64_t>(tolerance_ns)) {
-    *vertex_id_out = best_vertex_id;
+  if (num_found == 1u) {
+    *vertex_id_out = vertex_ids[0];
     constexpr bool kSuccess = true;
     return kSuccess;
   } else {
-    vertex_id_out = nullptr;
     constexpr bool kNotFound = false;
     return kNotFound;
   }
 }
 
+size_t VIMapQueries::getClosestVertexIdsByTimestamps(
+    const std::vector<uint64_t>& timestamps_ns, const uint64_t tolerance_ns,
+    pose_graph::VertexIdList* vertex_ids,
+    std::vector<uint64_t>* timestamp_differences) const {
+  CHECK_NOTNULL(vertex_ids)->clear();
+  const size_t num_queries = timestamps_ns.size();
+  vertex_ids->resize(num_queries);
+
+  const std::vector<int64_t> query_timestamps_ns(
+      timestamps_ns.begin(), timestamps_ns.end());
+  std::vector<int64_t> min_differences(
+      num_queries, std::numeric_limits<int64_t>::max());
+
+  // Look up all timestamps in the time index of each mission. Missions are
+  // visited in chronological order so that ties are resolved in favor of the
+  // earlier vertex.
+  vi_map::MissionIdList mission_ids;
+  map_.getAllMissionIdsSortedByTimestamp(&mission_ids);
+  vi_map::VisualFrameIdentifierList mission_frame_ids;
+  std::vector<int64_t> mission_differences;
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    map_.getClosestVisualFramesByTimestamps(
+        mission_id, query_timestamps_ns, &mission_frame_ids,
+        &mission_differences);
+    for (size_t query_idx = 0u; query_idx < num_queries; ++query_idx) {
+      if (mission_frame_ids[query_idx].isValid() &&
+          mission_differences[query_idx] < min_differences[query_idx]) {
+        min_differences[query_idx] = mission_differences[query_idx];
+        (*vertex_ids)[query_idx] = mission_frame_ids[query_idx].vertex_id;
+      }
+    }
+  }
+
+  if (timestamp_differences != nullptr) {
+    timestamp_differences->resize(num_queries);
+  }
+  size_t num_found = 0u;
+  for (size_t query_idx = 0u; query_idx < num_queries; ++query_idx) {
+    if (timestamp_differences != nullptr) {
+      (*timestamp_differences)[query_idx] =
+          static_cast<uint64_t>(min_differences[query_idx]);
+    }
+    if (min_differences[query_idx] < static_cast<int64_t>(tolerance_ns)) {
+      ++num_found;
+    } else {
+      (*vertex_ids)[query_idx].setInvalid();
+    }
+  }
+  return num_found;
+}
+
 int VIMapQueries::getNumberOfCommonLandmarks(
     const pose_graph::VertexId& vertex_1,
     const pose_graph::VertexId& vertex_2) const {
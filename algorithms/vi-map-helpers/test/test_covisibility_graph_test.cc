@@ -0,0 +1,176 @@
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/pose-types.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/test/vi-map-generator.h>
+#include <vi-map/vi-map.h>
+
+#include "vi-map-helpers/covisibility-graph.h"
+#include "vi-map-helpers/vi-map-queries.h"
+
+namespace vi_map_helpers {
+
+class CovisibilityGraphTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kRandomSeed = 5u;
+  static constexpr size_t kNumVertices = 20u;
+  static constexpr size_t kNumLandmarks = 200u;
+  static constexpr size_t kMaxNumObservers = 4u;
+
+  CovisibilityGraphTest() : generator_(map_, kRandomSeed) {}
+
+  void SetUp() override {
+    const pose::Transformation T_G_M;
+    const vi_map::MissionId mission_id = generator_.createMission(T_G_M);
+    for (size_t i = 0u; i < kNumVertices; ++i) {
+      const pose::Transformation T_G_I;
+      vertex_ids_.push_back(generator_.createVertex(mission_id, T_G_I));
+    }
+
+    // Landmarks are observed by a few vertices close to the storing vertex.
+    std::mt19937 random_engine(kRandomSeed);
+    std::uniform_int_distribution<size_t> vertex_distribution(
+        0u, kNumVertices - 1u);
+    std::uniform_int_distribution<size_t> observer_distribution(
+        0u, kMaxNumObservers);
+    for (size_t i = 0u; i < kNumLandmarks; ++i) {
+      const size_t storing_index = vertex_distribution(random_engine);
+      const size_t num_observers = observer_distribution(random_engine);
+      pose_graph::VertexIdList observers;
+      for (size_t j = 1u; j <= num_observers; ++j) {
+        observers.push_back(vertex_ids_[(storing_index + j) % kNumVertices]);
+      }
+      landmark_ids_.push_back(generator_.createLandmark(
+          Eigen::Vector3d(0, 0, 1), vertex_ids_[storing_index], observers));
+    }
+    generator_.generateMap();
+  }
+
+  void expectGraphMatchesMap(const CovisibilityGraph& graph) const {
+    ASSERT_EQ(graph.numVertices(), kNumVertices);
+    VIMapQueries queries(map_);
+    for (const pose_graph::VertexId& vertex_id_1 : vertex_ids_) {
+      for (const pose_graph::VertexId& vertex_id_2 : vertex_ids_) {
+        if (vertex_id_1 == vertex_id_2) {
+          EXPECT_EQ(graph.getNumCommonLandmarks(vertex_id_1, vertex_id_2), 0u);
+          continue;
+        }
+        EXPECT_EQ(
+            static_cast<int>(
+                graph.getNumCommonLandmarks(vertex_id_1, vertex_id_2)),
+            queries.getNumberOfCommonLandmarks(vertex_id_1, vertex_id_2));
+      }
+    }
+  }
+
+  void expectGraphsEqual(
+      const CovisibilityGraph& graph_a,
+      const CovisibilityGraph& graph_b) const {
+    ASSERT_EQ(graph_a.numVertices(), graph_b.numVertices());
+    EXPECT_EQ(graph_a.numEdges(), graph_b.numEdges());
+    for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+      CovisibilityGraph::CovisibleVertexList covisible_a;
+      graph_a.getCovisibleVertices(vertex_id, 1u, &covisible_a);
+      CovisibilityGraph::CovisibleVertexList covisible_b;
+      graph_b.getCovisibleVertices(vertex_id, 1u, &covisible_b);
+      ASSERT_EQ(covisible_a.size(), covisible_b.size());
+      for (size_t i = 0u; i < covisible_a.size(); ++i) {
+        EXPECT_EQ(
+            covisible_a[i].num_common_landmarks,
+            covisible_b[i].num_common_landmarks);
+        EXPECT_EQ(
+            graph_a.getNumCommonLandmarks(
+                vertex_id, covisible_a[i].vertex_id),
+            graph_b.getNumCommonLandmarks(
+                vertex_id, covisible_a[i].vertex_id));
+      }
+    }
+  }
+
+  vi_map::VIMap map_;
+  vi_map::VIMapGenerator generator_;
+  pose_graph::VertexIdList vertex_ids_;
+  vi_map::LandmarkIdList landmark_ids_;
+};
+
+TEST_F(CovisibilityGraphTest, BuildMatchesQueries) {
+  CovisibilityGraph graph;
+  graph.build(map_);
+  expectGraphMatchesMap(graph);
+
+  constexpr size_t kSingleThread = 1u;
+  CovisibilityGraph single_threaded_graph;
+  single_threaded_graph.build(map_, kSingleThread);
+  expectGraphsEqual(graph, single_threaded_graph);
+}
+
+TEST_F(CovisibilityGraphTest, CovisibleVerticesAreSorted) {
+  CovisibilityGraph graph;
+  graph.build(map_);
+
+  constexpr uint32_t kMinNumCommonLandmarks = 2u;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+    CovisibilityGraph::CovisibleVertexList covisible_vertices;
+    graph.getCovisibleVertices(
+        vertex_id, kMinNumCommonLandmarks, &covisible_vertices);
+    for (size_t i = 0u; i < covisible_vertices.size(); ++i) {
+      EXPECT_NE(covisible_vertices[i].vertex_id, vertex_id);
+      EXPECT_GE(
+          covisible_vertices[i].num_common_landmarks, kMinNumCommonLandmarks);
+      if (i > 0u) {
+        EXPECT_LE(
+            covisible_vertices[i].num_common_landmarks,
+            covisible_vertices[i - 1u].num_common_landmarks);
+      }
+    }
+  }
+}
+
+TEST_F(CovisibilityGraphTest, IncrementalUpdatesMatchRebuild) {
+  CovisibilityGraph graph;
+  graph.build(map_);
+
+  // Remove every 7th landmark.
+  for (size_t i = 0u; i < landmark_ids_.size(); i += 7u) {
+    graph.removeLandmark(map_.getLandmark(landmark_ids_[i]));
+    map_.removeLandmark(landmark_ids_[i]);
+  }
+  // Merge pairs of landmarks stored at different places in the map.
+  for (size_t i = 1u; i + 1u < landmark_ids_.size(); i += 7u) {
+    const vi_map::LandmarkId& landmark_id_to_merge = landmark_ids_[i];
+    const vi_map::LandmarkId& landmark_id_into = landmark_ids_[i + 1u];
+    graph.mergeLandmarks(
+        map_.getLandmark(landmark_id_to_merge),
+        map_.getLandmark(landmark_id_into));
+    map_.mergeLandmarks(landmark_id_to_merge, landmark_id_into);
+  }
+
+  CovisibilityGraph rebuilt_graph;
+  rebuilt_graph.build(map_);
+  expectGraphsEqual(graph, rebuilt_graph);
+
+  graph.compact();
+  expectGraphsEqual(graph, rebuilt_graph);
+}
+
+TEST_F(CovisibilityGraphTest, SerializationRoundTrip) {
+  CovisibilityGraph graph;
+  graph.build(map_);
+
+  std::stringstream stream;
+  graph.serialize(&stream);
+
+  CovisibilityGraph deserialized_graph;
+  ASSERT_TRUE(deserialized_graph.deserialize(&stream));
+  EXPECT_TRUE(deserialized_graph.coversSameVerticesAs(map_));
+  expectGraphsEqual(graph, deserialized_graph);
+  expectGraphMatchesMap(deserialized_graph);
+}
+
+}  // namespace vi_map_helpers
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,145 @@
+#ifndef MAPLAB_CONSOLE_BATCH_CONTROL_H_
+#define MAPLAB_CONSOLE_BATCH_CONTROL_H_
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+namespace maplab {
+
+// The template strings "<CURRENT_VIMAP_FOLDER>" and "<CURRENT_MAP_KEY>" are
+// replaced by the folder of the currently processed map and by a map key that
+// is unique to it.
+extern const std::string kBatchMapFolderTemplate;
+extern const std::string kBatchMapKeyTemplate;
+
+struct BatchCommand {
+  // Name the dependencies of other commands refer to.
+  std::string name;
+  std::string command;
+  // The command is skipped unless all of these commands succeeded.
+  std::vector<std::string> depends_on;
+  // The command runs after these commands, no matter if they succeeded.
+  std::vector<std::string> runs_after;
+};
+
+// Commands are either given as plain strings, which run after the preceding
+// command, or as entries with an explicit list of dependencies:
+//   commands:
+//     - name: load
+//       command: load --map_folder=<CURRENT_VIMAP_FOLDER>
+//     - name: optimize
+//       command: optvi
+//       depends_on: [load]
+//     - save --map_folder=<CURRENT_VIMAP_FOLDER>_optimized
+// Entries can also list commands in "runs_after", which only constrain the
+// order. Plain commands are named "<position>_<console command>", e.g.
+// "3_save".
+struct BatchControlInformation {
+  std::vector<std::string> vi_map_folder_paths;
+  std::vector<BatchCommand> commands;
+};
+
+// Dependency graph of the batch commands. Commands that are connected through
+// dependencies form a group that runs on one console, in an order that
+// respects the dependencies. Different groups share no state and, e.g. when
+// every group loads its own copy of the map, can run concurrently.
+class BatchCommandGraph {
+ public:
+  BatchCommandGraph() = default;
+
+  // Returns false if a name is used twice, a dependency is unknown or the
+  // dependencies are cyclic.
+  bool initialize(const std::vector<BatchCommand>& commands);
+
+  size_t numCommands() const {
+    return commands_.size();
+  }
+  const BatchCommand& getCommand(const size_t command_index) const;
+  // The indices of the commands listed in depends_on.
+  const std::vector<size_t>& getDependencies(const size_t command_index) const;
+
+  // The command indices of every group, in execution order. Among the commands
+  // that are ready, the one listed first in the batch control file runs first.
+  const std::vector<std::vector<size_t>>& getCommandGroups() const {
+    return command_groups_;
+  }
+
+ private:
+  std::vector<BatchCommand> commands_;
+  std::vector<std::vector<size_t>> dependencies_;
+  // Dependencies and the commands listed in runs_after.
+  std::vector<std::vector<size_t>> predecessors_;
+  std::vector<std::vector<size_t>> command_groups_;
+};
+
+enum class BatchCommandStatus { kSuccess, kFailed, kSkipped };
+
+struct BatchCommandTiming {
+  BatchCommandTiming()
+      : map_index(0u),
+        command_index(0u),
+        status(BatchCommandStatus::kSkipped),
+        duration_s(0.0) {}
+  size_t map_index;
+  size_t command_index;
+  BatchCommandStatus status;
+  double duration_s;
+};
+typedef std::vector<BatchCommandTiming> BatchCommandTimingList;
+
+std::string getBatchMapKey(const size_t map_index);
+
+// Runs the commands of the given group on the given map. Commands whose
+// dependencies did not succeed are skipped. The timings are appended to the
+// list, on_command_done is called after every command if set. Returns the
+// number of commands that failed or were skipped.
+typedef std::function<int(const std::string&)> BatchCommandFunction;
+size_t runBatchCommandGroup(
+    const BatchCommandGraph& graph, const size_t group_index,
+    const size_t map_index, const std::string& map_folder,
+    const BatchCommandFunction& run_command,
+    const std::function<void(const BatchCommandTimingList&)>& on_command_done,
+    BatchCommandTimingList* timings);
+
+// Sum of the sizes of all files in the folder and its subfolders.
+uint64_t getFolderSizeBytes(const std::string& folder);
+
+// Picks the first of the pending jobs whose estimated memory fits into what
+// is left of the budget. A budget of 0 is unlimited. If no job is running, the
+// first pending job is always picked, even if it exceeds the budget on its
+// own. Returns false if no job can be started right now.
+bool selectNextBatchJob(
+    const std::vector<uint64_t>& pending_job_memory_bytes,
+    const uint64_t memory_in_use_bytes, const uint64_t memory_budget_bytes,
+    const size_t num_running_jobs, size_t* job_index);
+
+// Prints the number of runs, failures and skips and the total, mean and
+// maximum duration of every command.
+void printBatchTimingReport(
+    const BatchCommandGraph& graph, const BatchCommandTimingList& timings,
+    std::ostream* out);
+
+}  // namespace maplab
+
+namespace YAML {
+template <>
+struct convert<maplab::BatchControlInformation> {
+  static Node encode(const maplab::BatchControlInformation& rhs);
+  static bool decode(
+      const Node& node, maplab::BatchControlInformation& rhs);  // NOLINT
+};
+
+template <>
+struct convert<maplab::BatchCommandTiming> {
+  static Node encode(const maplab::BatchCommandTiming& rhs);
+  static bool decode(
+      const Node& node, maplab::BatchCommandTiming& rhs);  // NOLINT
+};
+}  // namespace YAML
+
+#endif  // MAPLAB_CONSOLE_BATCH_CONTROL_H_
@@ -0,0 +1,415 @@
+#include "maplab-console/batch-control.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <set>
+#include <unordered_map>
+
+#include <console-common/command-registerer.h>
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/string-tools.h>
+
+namespace maplab {
+
+const std::string kBatchMapFolderTemplate("<CURRENT_VIMAP_FOLDER>");
+const std::string kBatchMapKeyTemplate("<CURRENT_MAP_KEY>");
+
+bool BatchCommandGraph::initialize(const std::vector<BatchCommand>& commands) {
+  commands_ = commands;
+  const size_t num_commands = commands_.size();
+  dependencies_.assign(num_commands, std::vector<size_t>());
+  predecessors_.assign(num_commands, std::vector<size_t>());
+  command_groups_.clear();
+
+  std::unordered_map<std::string, size_t> name_to_index;
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    const std::string& name = commands_[command_index].name;
+    if (!name_to_index.emplace(name, command_index).second) {
+      LOG(ERROR) << "The batch command name \"" << name << "\" is not unique.";
+      return false;
+    }
+  }
+
+  std::vector<std::vector<size_t>> dependents(num_commands);
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    const BatchCommand& command = commands_[command_index];
+    std::vector<std::string> predecessors = command.depends_on;
+    predecessors.insert(
+        predecessors.end(), command.runs_after.begin(),
+        command.runs_after.end());
+    for (size_t i = 0u; i < predecessors.size(); ++i) {
+      const std::unordered_map<std::string, size_t>::const_iterator it =
+          name_to_index.find(predecessors[i]);
+      if (it == name_to_index.end()) {
+        LOG(ERROR) << "The batch command \"" << command.name
+                   << "\" depends on the unknown command \""
+                   << predecessors[i] << "\".";
+        return false;
+      }
+      if (i < command.depends_on.size()) {
+        dependencies_[command_index].push_back(it->second);
+      }
+      predecessors_[command_index].push_back(it->second);
+      dependents[it->second].push_back(command_index);
+    }
+  }
+
+  // Topological order that prefers the commands listed first.
+  std::vector<size_t> num_open_dependencies(num_commands);
+  std::set<size_t> ready_commands;
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    num_open_dependencies[command_index] = predecessors_[command_index].size();
+    if (num_open_dependencies[command_index] == 0u) {
+      ready_commands.insert(command_index);
+    }
+  }
+  std::vector<size_t> execution_order;
+  execution_order.reserve(num_commands);
+  while (!ready_commands.empty()) {
+    const size_t command_index = *ready_commands.begin();
+    ready_commands.erase(ready_commands.begin());
+    execution_order.push_back(command_index);
+    for (const size_t dependent : dependents[command_index]) {
+      CHECK_GT(num_open_dependencies[dependent], 0u);
+      if (--num_open_dependencies[dependent] == 0u) {
+        ready_commands.insert(dependent);
+      }
+    }
+  }
+  if (execution_order.size() != num_commands) {
+    LOG(ERROR) << "The dependencies of the batch commands contain a cycle.";
+    return false;
+  }
+
+  // Commands connected through dependencies form a group.
+  std::vector<size_t> group_root(num_commands);
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    group_root[command_index] = command_index;
+  }
+  std::function<size_t(size_t)> find_root = [&](size_t command_index) {
+    while (group_root[command_index] != command_index) {
+      group_root[command_index] = group_root[group_root[command_index]];
+      command_index = group_root[command_index];
+    }
+    return command_index;
+  };
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    for (const size_t predecessor : predecessors_[command_index]) {
+      group_root[find_root(predecessor)] = find_root(command_index);
+    }
+  }
+
+  // Groups are numbered by their first command.
+  std::unordered_map<size_t, size_t> root_to_group_index;
+  for (size_t command_index = 0u; command_index < num_commands;
+       ++command_index) {
+    const size_t root = find_root(command_index);
+    if (root_to_group_index.count(root) == 0u) {
+      const size_t group_index = command_groups_.size();
+      root_to_group_index.emplace(root, group_index);
+      command_groups_.emplace_back();
+    }
+  }
+  for (const size_t command_index : execution_order) {
+    command_groups_[root_to_group_index[find_root(command_index)]].push_back(
+        command_index);
+  }
+  return true;
+}
+
+const BatchCommand& BatchCommandGraph::getCommand(
+    const size_t command_index) const {
+  CHECK_LT(command_index, commands_.size());
+  return commands_[command_index];
+}
+
+const std::vector<size_t>& BatchCommandGraph::getDependencies(
+    const size_t command_index) const {
+  CHECK_LT(command_index, dependencies_.size());
+  return dependencies_[command_index];
+}
+
+std::string getBatchMapKey(const size_t map_index) {
+  return "batch_map_" + std::to_string(map_index);
+}
+
+size_t runBatchCommandGroup(
+    const BatchCommandGraph& graph, const size_t group_index,
+    const size_t map_index, const std::string& map_folder,
+    const BatchCommandFunction& run_command,
+    const std::function<void(const BatchCommandTimingList&)>& on_command_done,
+    BatchCommandTimingList* timings) {
+  CHECK(run_command);
+  CHECK_NOTNULL(timings);
+  CHECK_LT(group_index, graph.getCommandGroups().size());
+  const std::vector<size_t>& group = graph.getCommandGroups()[group_index];
+  const std::string map_key = getBatchMapKey(map_index);
+
+  std::unordered_map<size_t, BatchCommandStatus> command_status;
+  size_t num_unsuccessful_commands = 0u;
+  for (const size_t command_index : group) {
+    const BatchCommand& batch_command = graph.getCommand(command_index);
+    BatchCommandTiming timing;
+    timing.map_index = map_index;
+    timing.command_index = command_index;
+
+    bool dependencies_succeeded = true;
+    for (const size_t dependency : graph.getDependencies(command_index)) {
+      CHECK_GT(command_status.count(dependency), 0u);
+      dependencies_succeeded &=
+          command_status[dependency] == BatchCommandStatus::kSuccess;
+    }
+
+    if (!dependencies_succeeded) {
+      LOG(WARNING) << "\t Skipping command \"" << batch_command.name
+                   << "\" as one of its dependencies did not succeed.";
+      timing.status = BatchCommandStatus::kSkipped;
+    } else {
+      std::string actual_command = batch_command.command;
+      common::replaceSubstring(
+          kBatchMapFolderTemplate, map_folder, &actual_command);
+      common::replaceSubstring(kBatchMapKeyTemplate, map_key, &actual_command);
+      LOG(INFO) << "\t Running command \"" << batch_command.name
+                << "\": " << actual_command;
+
+      const std::chrono::steady_clock::time_point time_start =
+          std::chrono::steady_clock::now();
+      const int result = run_command(actual_command);
+      timing.duration_s = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - time_start)
+                              .count();
+      if (result == common::kSuccess) {
+        LOG(INFO) << "\t Command successful.";
+        timing.status = BatchCommandStatus::kSuccess;
+      } else {
+        LOG(ERROR) << "\t Command failed!";
+        timing.status = BatchCommandStatus::kFailed;
+      }
+    }
+
+    if (timing.status != BatchCommandStatus::kSuccess) {
+      ++num_unsuccessful_commands;
+    }
+    command_status[command_index] = timing.status;
+    timings->push_back(timing);
+    if (on_command_done) {
+      on_command_done(*timings);
+    }
+  }
+  return num_unsuccessful_commands;
+}
+
+uint64_t getFolderSizeBytes(const std::string& folder) {
+  std::vector<std::string> file_paths;
+  std::vector<std::string> folder_paths;
+  common::getAllFilesAndFoldersInFolder(folder, &file_paths, &folder_paths);
+
+  uint64_t size_bytes = 0u;
+  for (const std::string& file_path : file_paths) {
+    struct stat file_status;
+    if (stat(file_path.c_str(), &file_status) == 0) {
+      size_bytes += static_cast<uint64_t>(file_status.st_size);
+    }
+  }
+  for (const std::string& folder_path : folder_paths) {
+    size_bytes += getFolderSizeBytes(folder_path);
+  }
+  return size_bytes;
+}
+
+bool selectNextBatchJob(
+    const std::vector<uint64_t>& pending_job_memory_bytes,
+    const uint64_t memory_in_use_bytes, const uint64_t memory_budget_bytes,
+    const size_t num_running_jobs, size_t* job_index) {
+  CHECK_NOTNULL(job_index);
+  if (pending_job_memory_bytes.empty()) {
+    return false;
+  }
+  if (num_running_jobs == 0u || memory_budget_bytes == 0u) {
+    *job_index = 0u;
+    return true;
+  }
+  if (memory_in_use_bytes >= memory_budget_bytes) {
+    return false;
+  }
+  const uint64_t memory_left_bytes = memory_budget_bytes - memory_in_use_bytes;
+  for (size_t i = 0u; i < pending_job_memory_bytes.size(); ++i) {
+    if (pending_job_memory_bytes[i] <= memory_left_bytes) {
+      *job_index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void printBatchTimingReport(
+    const BatchCommandGraph& graph, const BatchCommandTimingList& timings,
+    std::ostream* out) {
+  CHECK_NOTNULL(out);
+  struct CommandStatistics {
+    CommandStatistics()
+        : num_runs(0u),
+          num_failed(0u),
+          num_skipped(0u),
+          total_s(0.0),
+          max_s(0.0) {}
+    size_t num_runs;
+    size_t num_failed;
+    size_t num_skipped;
+    double total_s;
+    double max_s;
+  };
+  std::vector<CommandStatistics> statistics(graph.numCommands());
+  for (const BatchCommandTiming& timing : timings) {
+    CHECK_LT(timing.command_index, statistics.size());
+    CommandStatistics& command_statistics = statistics[timing.command_index];
+    if (timing.status == BatchCommandStatus::kSkipped) {
+      ++command_statistics.num_skipped;
+      continue;
+    }
+    ++command_statistics.num_runs;
+    if (timing.status == BatchCommandStatus::kFailed) {
+      ++command_statistics.num_failed;
+    }
+    command_statistics.total_s += timing.duration_s;
+    command_statistics.max_s =
+        std::max(command_statistics.max_s, timing.duration_s);
+  }
+
+  size_t name_width = 7u;
+  for (size_t i = 0u; i < graph.numCommands(); ++i) {
+    name_width = std::max(name_width, graph.getCommand(i).name.size());
+  }
+  *out << "Batch command timing:\n"
+       << std::left << std::setw(name_width) << "Command" << std::right
+       << std::setw(6) << "runs" << std::setw(8) << "failed" << std::setw(9)
+       << "skipped" << std::setw(12) << "total [s]" << std::setw(11)
+       << "mean [s]" << std::setw(10) << "max [s]" << "\n";
+  for (size_t i = 0u; i < graph.numCommands(); ++i) {
+    const CommandStatistics& command_statistics = statistics[i];
+    const double mean_s =
+        command_statistics.num_runs == 0u
+            ? 0.0
+            : command_statistics.total_s / command_statistics.num_runs;
+    *out << std::left << std::setw(name_width) << graph.getCommand(i).name
+         << std::right << std::setw(6) << command_statistics.num_runs
+         << std::setw(8) << command_statistics.num_failed << std::setw(9)
+         << command_statistics.num_skipped << std::fixed
+         << std::setprecision(3) << std::setw(12) << command_statistics.total_s
+         << std::setw(11) << mean_s << std::setw(10) << command_statistics.max_s
+         << "\n";
+  }
+}
+
+}  // namespace maplab
+
+namespace YAML {
+namespace {
+// Reads a single name or a list of names.
+void readCommandNames(const Node& node, std::vector<std::string>* names) {
+  CHECK_NOTNULL(names)->clear();
+  if (!node) {
+    return;
+  }
+  if (node.IsScalar()) {
+    names->push_back(node.as<std::string>());
+  } else {
+    *names = node.as<std::vector<std::string>>();
+  }
+}
+}  // namespace
+
+Node convert<maplab::BatchControlInformation>::encode(
+    const maplab::BatchControlInformation& rhs) {
+  Node node;
+  node["vi_map_folder_paths"] = rhs.vi_map_folder_paths;
+  for (const maplab::BatchCommand& batch_command : rhs.commands) {
+    Node command_node;
+    command_node["name"] = batch_command.name;
+    command_node["command"] = batch_command.command;
+    command_node["depends_on"] = batch_command.depends_on;
+    command_node["runs_after"] = batch_command.runs_after;
+    node["commands"].push_back(command_node);
+  }
+  return node;
+}
+
+bool convert<maplab::BatchControlInformation>::decode(
+    const Node& node, maplab::BatchControlInformation& rhs) {  // NOLINT
+  rhs.vi_map_folder_paths =
+      node["vi_map_folder_paths"].as<std::vector<std::string>>();
+  rhs.commands.clear();
+  const Node& commands_node = node["commands"];
+  if (!commands_node.IsSequence()) {
+    LOG(ERROR) << "The batch commands have to be given as a list.";
+    return false;
+  }
+  for (size_t i = 0u; i < commands_node.size(); ++i) {
+    const Node& command_node = commands_node[i];
+    maplab::BatchCommand batch_command;
+    if (command_node.IsScalar()) {
+      batch_command.command = command_node.as<std::string>();
+      if (!rhs.commands.empty()) {
+        batch_command.runs_after.push_back(rhs.commands.back().name);
+      }
+    } else if (command_node.IsMap() && command_node["command"]) {
+      batch_command.command = command_node["command"].as<std::string>();
+      if (command_node["name"]) {
+        batch_command.name = command_node["name"].as<std::string>();
+      }
+      readCommandNames(command_node["depends_on"], &batch_command.depends_on);
+      readCommandNames(command_node["runs_after"], &batch_command.runs_after);
+    } else {
+      LOG(ERROR) << "Batch command " << i + 1u << " is neither a string nor "
+                 << "an entry with a \"command\".";
+      return false;
+    }
+
+    if (batch_command.name.empty()) {
+      std::vector<std::string> tokens;
+      common::tokenizeString(
+          batch_command.command, ' ', true /*remove_empty*/, &tokens);
+      batch_command.name = std::to_string(i + 1u);
+      if (!tokens.empty()) {
+        batch_command.name += "_" + tokens.front();
+      }
+    }
+    rhs.commands.push_back(batch_command);
+  }
+  return true;
+}
+
+Node convert<maplab::BatchCommandTiming>::encode(
+    const maplab::BatchCommandTiming& rhs) {
+  Node node;
+  node["map_index"] = rhs.map_index;
+  node["command_index"] = rhs.command_index;
+  node["status"] = static_cast<int>(rhs.status);
+  node["duration_s"] = rhs.duration_s;
+  return node;
+}
+
+bool convert<maplab::BatchCommandTiming>::decode(
+    const Node& node, maplab::BatchCommandTiming& rhs) {  // NOLINT
+  rhs.map_index = node["map_index"].as<size_t>();
+  rhs.command_index = node["command_index"].as<size_t>();
+  const int status = node["status"].as<int>();
+  if (status < static_cast<int>(maplab::BatchCommandStatus::kSuccess) ||
+      status > static_cast<int>(maplab::BatchCommandStatus::kSkipped)) {
+    return false;
+  }
+  rhs.status = static_cast<maplab::BatchCommandStatus>(status);
+  rhs.duration_s = node["duration_s"].as<double>();
+  return true;
+}
+
+}  // namespace YAML
@@ -1,15 +1,27 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <console-common/console.h>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <map-manager/map-manager.h>
 #include <maplab-common/file-system-tools.h>
-#include <maplab-common/string-tools.h>
+#include <maplab-common/yaml-serialization.h>
 #include <vi-map/vi-map.h>
 #include <visualization/viwls-graph-plotter.h>
 #include <yaml-cpp/yaml.h>
 
+#include "maplab-console/batch-control.h"
 #include "maplab-console/maplab-console.h"
 
 // This executable reads yaml files and executes the commands from it on all
@@ -18,6 +30,8 @@
 // processed map. This can be used e.g. to save the resulting map to a
 // different folder:
 //    save -map_folder=<CURRENT_VIMAP_FOLDER>_result
+// The template string "<CURRENT_MAP_KEY>" is replaced by a map key that is
+// unique to the currently processed map.
 //
 // Yaml-format:
 //   vi_map_folder_paths:
@@ -27,40 +41,285 @@
 //     - command1
 //     - command2
 //     - command3
+//
+// Commands can declare dependencies instead of running in the listed order,
+// see maplab::BatchControlInformation. Commands that are connected through
+// dependencies form a group. With --batch_runner_num_workers > 1, every group
+// of every map runs in a worker process of its own, such that e.g. one map is
+// optimized while another one is exported. A group shares no state with the
+// other groups, i.e. it has to load the map itself.
 
-const std::string kMapFolderTemplate("<CURRENT_VIMAP_FOLDER>");
 const std::string kConsoleName = "maplab-batch-runner";
 
-struct BatchControlInformation {
-  std::vector<std::string> vi_map_folder_paths;
-  std::vector<std::string> commands;
+DEFINE_string(
+    batch_control_file, "",
+    "Filename of the yaml file that "
+    "contains the batch processing information.");
+DEFINE_int32(
+    batch_runner_num_workers, 1,
+    "Number of command groups that are processed concurrently, each in a "
+    "worker process of its own. With 1, all maps are processed sequentially "
+    "in this process.");
+DEFINE_double(
+    batch_runner_memory_budget_gb, 0.0,
+    "Workers are only started while the estimated memory of all running "
+    "workers stays within this budget [GB]. 0 disables the budget.");
+DEFINE_double(
+    batch_runner_memory_per_map_disk_byte, 4.0,
+    "Estimated memory a worker needs per byte its map takes up on disk.");
+DEFINE_string(
+    batch_runner_timing_report_file, "",
+    "If set, the timings of all commands are written to this yaml file.");
+
+// Internal flags the worker processes are started with.
+DEFINE_int32(
+    batch_runner_worker_map_index, -1,
+    "Internal: index of the map a worker process runs its commands on.");
+DEFINE_int32(
+    batch_runner_worker_group_index, -1,
+    "Internal: index of the command group a worker process runs.");
+DEFINE_string(
+    batch_runner_worker_timing_file, "",
+    "Internal: file a worker process writes its command timings to.");
+
+namespace {
+
+struct BatchJob {
+  size_t map_index;
+  size_t group_index;
+  uint64_t memory_bytes;
 };
 
-namespace YAML {
-template <>
-struct convert<BatchControlInformation> {
-  static Node encode(const BatchControlInformation& rhs) {
-    Node node;
-    node["vi_map_folder_paths"] = rhs.vi_map_folder_paths;
-    node["commands"] = rhs.commands;
-    return node;
+// Releases all maps from memory, every command group starts from scratch.
+void releaseAllMaps(common::Console* console) {
+  CHECK_NOTNULL(console);
+  vi_map::VIMapManager map_manager;
+  std::unordered_set<std::string> all_map_keys;
+  map_manager.getAllMapKeys(&all_map_keys);
+  for (const std::string& key : all_map_keys) {
+    map_manager.deleteMap(key);
   }
-  static bool decode(
-      const Node& node, BatchControlInformation& rhs) {  // NOLINT
-    rhs.vi_map_folder_paths =
-        node["vi_map_folder_paths"].as<std::vector<std::string>>();
-    rhs.commands = node["commands"].as<std::vector<std::string>>();
-    return true;
+  const std::string kNoMapSelected = "";
+  console->setSelectedMapKey(kNoMapSelected);
+}
+
+size_t runCommandGroupInConsole(
+    const maplab::BatchCommandGraph& graph, const size_t map_index,
+    const size_t group_index, const std::string& map_folder,
+    common::Console* console,
+    const std::function<void(const maplab::BatchCommandTimingList&)>&
+        on_command_done,
+    maplab::BatchCommandTimingList* timings) {
+  CHECK_NOTNULL(console);
+  releaseAllMaps(console);
+  return maplab::runBatchCommandGroup(
+      graph, group_index, map_index, map_folder,
+      [console](const std::string& command) {
+        return console->RunCommand(command);
+      },
+      on_command_done, timings);
+}
+
+pid_t startWorker(
+    const std::vector<std::string>& arguments, const BatchJob& job,
+    const std::string& timing_file) {
+  std::vector<std::string> worker_arguments = arguments;
+  // Later flags override the ones of the batch runner.
+  worker_arguments.push_back("--batch_runner_num_workers=1");
+  worker_arguments.push_back(
+      "--batch_runner_worker_map_index=" + std::to_string(job.map_index));
+  worker_arguments.push_back(
+      "--batch_runner_worker_group_index=" + std::to_string(job.group_index));
+  worker_arguments.push_back(
+      "--batch_runner_worker_timing_file=" + timing_file);
+  worker_arguments.push_back("--batch_runner_timing_report_file=");
+
+  std::vector<char*> argv;
+  for (std::string& argument : worker_arguments) {
+    argv.push_back(&argument[0]);
   }
-};
-}  // namespace YAML
+  argv.push_back(nullptr);
 
-DEFINE_string(
-    batch_control_file, "",
-    "Filename of the yaml file that "
-    "contains the batch processing information.");
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0) << "Failed to start a worker process.";
+  if (pid == 0) {
+    execv("/proc/self/exe", argv.data());
+    // Only reached if starting the worker failed.
+    std::cerr << "Failed to execute the batch runner worker." << std::endl;
+    _exit(common::kUnknownError);
+  }
+  return pid;
+}
+
+int runWorker(
+    const maplab::BatchControlInformation& control_information,
+    const maplab::BatchCommandGraph& graph, int argc, char** argv) {
+  const size_t map_index = FLAGS_batch_runner_worker_map_index;
+  const size_t group_index = FLAGS_batch_runner_worker_group_index;
+  CHECK_LT(map_index, control_information.vi_map_folder_paths.size());
+  CHECK_LT(group_index, graph.getCommandGroups().size());
+  CHECK(!FLAGS_batch_runner_worker_timing_file.empty());
+
+  maplab::MapLabConsole console(kConsoleName, argc, argv);
+  maplab::BatchCommandTimingList timings;
+  // Writing the timings after every command keeps them if a later command
+  // crashes the worker.
+  const size_t num_unsuccessful_commands = runCommandGroupInConsole(
+      graph, map_index, group_index,
+      control_information.vi_map_folder_paths[map_index], &console,
+      [](const maplab::BatchCommandTimingList& timings_so_far) {
+        YAML::Save(timings_so_far, FLAGS_batch_runner_worker_timing_file);
+      },
+      &timings);
+  return num_unsuccessful_commands == 0u ? common::kSuccess
+                                         : common::kUnknownError;
+}
+
+void runSequentially(
+    const maplab::BatchControlInformation& control_information,
+    const maplab::BatchCommandGraph& graph, int argc, char** argv,
+    maplab::BatchCommandTimingList* timings) {
+  CHECK_NOTNULL(timings);
+  maplab::MapLabConsole console(kConsoleName, argc, argv);
+
+  const size_t num_maps = control_information.vi_map_folder_paths.size();
+  const size_t num_groups = graph.getCommandGroups().size();
+  for (size_t map_index = 0u; map_index < num_maps; ++map_index) {
+    const std::string& map_folder =
+        control_information.vi_map_folder_paths[map_index];
+    LOG(INFO) << "Running map (" << map_index + 1u << " / " << num_maps
+              << "): " << map_folder;
+    for (size_t group_index = 0u; group_index < num_groups; ++group_index) {
+      runCommandGroupInConsole(
+          graph, map_index, group_index, map_folder, &console,
+          std::function<void(const maplab::BatchCommandTimingList&)>(),
+          timings);
+    }
+    LOG(INFO) << "Done running map.";
+  }
+}
+
+void runInWorkers(
+    const maplab::BatchControlInformation& control_information,
+    const maplab::BatchCommandGraph& graph,
+    const std::vector<std::string>& arguments,
+    maplab::BatchCommandTimingList* timings) {
+  CHECK_NOTNULL(timings);
+  CHECK_GT(FLAGS_batch_runner_num_workers, 1);
+  CHECK_GE(FLAGS_batch_runner_memory_budget_gb, 0.0);
+  CHECK_GT(FLAGS_batch_runner_memory_per_map_disk_byte, 0.0);
+  const size_t max_num_workers = FLAGS_batch_runner_num_workers;
+  const uint64_t memory_budget_bytes =
+      static_cast<uint64_t>(FLAGS_batch_runner_memory_budget_gb * 1e9);
+
+  std::vector<BatchJob> pending_jobs;
+  for (size_t map_index = 0u;
+       map_index < control_information.vi_map_folder_paths.size();
+       ++map_index) {
+    const uint64_t memory_bytes = static_cast<uint64_t>(
+        FLAGS_batch_runner_memory_per_map_disk_byte *
+        maplab::getFolderSizeBytes(
+            control_information.vi_map_folder_paths[map_index]));
+    for (size_t group_index = 0u;
+         group_index < graph.getCommandGroups().size(); ++group_index) {
+      pending_jobs.push_back(BatchJob{map_index, group_index, memory_bytes});
+    }
+  }
+
+  char timing_folder_template[] = "/tmp/maplab_batch_runner_XXXXXX";
+  CHECK_NOTNULL(mkdtemp(timing_folder_template));
+  const std::string timing_folder(timing_folder_template);
+
+  struct RunningJob {
+    BatchJob job;
+    std::string timing_file;
+  };
+  std::unordered_map<pid_t, RunningJob> running_jobs;
+  uint64_t memory_in_use_bytes = 0u;
+  const size_t num_jobs = pending_jobs.size();
+  size_t num_finished_jobs = 0u;
+  while (!pending_jobs.empty() || !running_jobs.empty()) {
+    // Start as many jobs as the number of workers and the budget allow.
+    while (running_jobs.size() < max_num_workers) {
+      std::vector<uint64_t> pending_job_memory_bytes;
+      for (const BatchJob& job : pending_jobs) {
+        pending_job_memory_bytes.push_back(job.memory_bytes);
+      }
+      size_t job_index;
+      if (!maplab::selectNextBatchJob(
+              pending_job_memory_bytes, memory_in_use_bytes,
+              memory_budget_bytes, running_jobs.size(), &job_index)) {
+        break;
+      }
+      const BatchJob job = pending_jobs[job_index];
+      pending_jobs.erase(pending_jobs.begin() + job_index);
+      LOG_IF(WARNING, memory_budget_bytes != 0u &&
+                          job.memory_bytes > memory_budget_bytes)
+          << "The estimated memory of map "
+          << control_information.vi_map_folder_paths[job.map_index]
+          << " exceeds the memory budget on its own.";
+
+      const std::string timing_file = common::concatenateFolderAndFileName(
+          timing_folder, "timings_" + std::to_string(job.map_index) + "_" +
+                             std::to_string(job.group_index) + ".yaml");
+      const pid_t pid = startWorker(arguments, job, timing_file);
+      running_jobs.emplace(pid, RunningJob{job, timing_file});
+      memory_in_use_bytes += job.memory_bytes;
+      LOG(INFO) << "Started command group " << job.group_index + 1u
+                << " on map "
+                << control_information.vi_map_folder_paths[job.map_index]
+                << " in worker " << pid << ".";
+    }
+
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    CHECK_GT(pid, 0) << "Waiting for the worker processes failed.";
+    const std::unordered_map<pid_t, RunningJob>::iterator it =
+        running_jobs.find(pid);
+    if (it == running_jobs.end()) {
+      continue;
+    }
+    const RunningJob running_job = it->second;
+    running_jobs.erase(it);
+    memory_in_use_bytes -= running_job.job.memory_bytes;
+    ++num_finished_jobs;
+
+    maplab::BatchCommandTimingList worker_timings;
+    if (!YAML::Load(running_job.timing_file, &worker_timings)) {
+      worker_timings.clear();
+    }
+    common::deleteFile(running_job.timing_file);
+    // Commands the worker did not report on, e.g. because it crashed, count
+    // as failed.
+    const std::vector<size_t>& group =
+        graph.getCommandGroups()[running_job.job.group_index];
+    for (size_t i = worker_timings.size(); i < group.size(); ++i) {
+      maplab::BatchCommandTiming timing;
+      timing.map_index = running_job.job.map_index;
+      timing.command_index = group[i];
+      timing.status = maplab::BatchCommandStatus::kFailed;
+      worker_timings.push_back(timing);
+    }
+    timings->insert(
+        timings->end(), worker_timings.begin(), worker_timings.end());
+
+    const bool worker_succeeded =
+        WIFEXITED(status) && WEXITSTATUS(status) == common::kSuccess;
+    LOG(INFO) << "Worker " << pid << " on map "
+              << control_information
+                     .vi_map_folder_paths[running_job.job.map_index]
+              << (worker_succeeded ? " succeeded" : " failed") << " ("
+              << num_finished_jobs << " / " << num_jobs << " jobs done).";
+  }
+  common::removePath(timing_folder);
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
+  // The worker processes are started with the original arguments.
+  const std::vector<std::string> arguments(argv, argv + argc);
+
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InstallFailureSignalHandler();
@@ -69,11 +328,9 @@ int main(int argc, char** argv) {
 
   CHECK_NE(FLAGS_batch_control_file, "")
       << "You have to provide the path to the batch control yaml-file.";
+  CHECK_GT(FLAGS_batch_runner_num_workers, 0);
 
-  visualization::ViwlsGraphRvizPlotter::Ptr plotter(
-      new visualization::ViwlsGraphRvizPlotter());
-
-  BatchControlInformation control_information;
+  maplab::BatchControlInformation control_information;
   if (!YAML::Load(FLAGS_batch_control_file, &control_information)) {
     LOG(FATAL) << "Failed to read batch control file: "
                << FLAGS_batch_control_file;
@@ -86,8 +343,26 @@ int main(int argc, char** argv) {
   LOG_IF(FATAL, num_cmds == 0u) << "No commands supplied with file: "
                                 << FLAGS_batch_control_file;
 
-  LOG(INFO) << "Got " << num_cmds << " commands to apply on " << num_maps
-            << " maps.";
+  maplab::BatchCommandGraph graph;
+  if (!graph.initialize(control_information.commands)) {
+    LOG(FATAL) << "Invalid command dependencies in batch control file: "
+               << FLAGS_batch_control_file;
+  }
+
+  const bool is_worker = FLAGS_batch_runner_worker_map_index >= 0;
+  const bool run_in_workers = !is_worker && FLAGS_batch_runner_num_workers > 1;
+  visualization::ViwlsGraphRvizPlotter::Ptr plotter;
+  if (!run_in_workers) {
+    plotter.reset(new visualization::ViwlsGraphRvizPlotter());
+  }
+
+  if (is_worker) {
+    return runWorker(control_information, graph, argc, argv);
+  }
+
+  LOG(INFO) << "Got " << num_cmds << " commands in "
+            << graph.getCommandGroups().size() << " groups to apply on "
+            << num_maps << " maps.";
 
   for (const std::string& map_folder :
        control_information.vi_map_folder_paths) {
@@ -96,53 +371,39 @@ int main(int argc, char** argv) {
   }
 
   // Process all commands for all maps.
-  maplab::MapLabConsole console(kConsoleName, argc, argv);
-
-  size_t map_idx = 1u;
-  size_t num_failed_commands = 0u;
-  for (const std::string& map_folder :
-       control_information.vi_map_folder_paths) {
-    LOG(INFO) << "Running map (" << map_idx << " / " << num_maps
-              << "): " << map_folder;
+  const std::chrono::steady_clock::time_point time_start =
+      std::chrono::steady_clock::now();
+  maplab::BatchCommandTimingList timings;
+  if (run_in_workers) {
+    runInWorkers(control_information, graph, arguments, &timings);
+  } else {
+    runSequentially(control_information, graph, argc, argv, &timings);
+  }
+  const double duration_s = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - time_start)
+                                .count();
 
-    // Release all maps from memory.
-    vi_map::VIMapManager map_manager;
-    std::unordered_set<std::string> all_map_keys;
-    map_manager.getAllMapKeys(&all_map_keys);
-    for (const std::string& key : all_map_keys) {
-      map_manager.deleteMap(key);
-    }
-    const std::string kNoMapSelected = "";
-    console.setSelectedMapKey(kNoMapSelected);
-
-    // Run all commands on this map.
-    size_t cmd_idx = 1u;
-    for (const std::string& command : control_information.commands) {
-      // Replace the map_folder template string for the current command.
-      std::string actual_command = command;
-      common::replaceSubstring(kMapFolderTemplate, map_folder, &actual_command);
-
-      LOG(INFO) << "\t Running command (" << cmd_idx << " / " << num_cmds
-                << "): " << actual_command;
-
-      // Run the command.
-      if (console.RunCommand(actual_command) != common::kSuccess) {
-        LOG(ERROR) << "\t Command failed!";
-        ++num_failed_commands;
-      } else {
-        LOG(INFO) << "\t Command successful.";
-      }
-      ++cmd_idx;
-    }
+  std::ostringstream report;
+  maplab::printBatchTimingReport(graph, timings, &report);
+  LOG(INFO) << report.str();
+  if (!FLAGS_batch_runner_timing_report_file.empty()) {
+    YAML::Save(timings, FLAGS_batch_runner_timing_report_file);
+  }
 
-    LOG(INFO) << "Done running map.";
-    ++map_idx;
+  size_t num_failed_commands = 0u;
+  size_t num_skipped_commands = 0u;
+  for (const maplab::BatchCommandTiming& timing : timings) {
+    num_failed_commands +=
+        timing.status == maplab::BatchCommandStatus::kFailed ? 1u : 0u;
+    num_skipped_commands +=
+        timing.status == maplab::BatchCommandStatus::kSkipped ? 1u : 0u;
   }
 
   LOG(INFO) << "Done. Processed " << num_cmds << " commands for " << num_maps
-            << " maps.";
-  if (num_failed_commands != 0u) {
-    LOG(ERROR) << num_failed_commands << " commands failed.";
+            << " maps in " << duration_s << " s.";
+  if (num_failed_commands != 0u || num_skipped_commands != 0u) {
+    LOG(ERROR) << num_failed_commands << " commands failed, "
+               << num_skipped_commands << " commands were skipped.";
     return common::kUnknownError;
   }
   return common::kSuccess;
@@ -0,0 +1,159 @@
+#include <string>
+#include <vector>
+
+#include <console-common/command-registerer.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <yaml-cpp/yaml.h>
+
+#include "maplab-console/batch-control.h"
+
+namespace maplab {
+
+BatchControlInformation parseControlInformation(const std::string& yaml) {
+  return YAML::Load(yaml).as<BatchControlInformation>();
+}
+
+TEST(BatchControlTest, PlainCommandsRunInListedOrder) {
+  const BatchControlInformation control_information = parseControlInformation(
+      "vi_map_folder_paths: [map_a, map_b]\n"
+      "commands:\n"
+      "  - load --map_folder=<CURRENT_VIMAP_FOLDER>\n"
+      "  - rtl\n"
+      "  - rtl\n");
+  ASSERT_EQ(control_information.vi_map_folder_paths.size(), 2u);
+  ASSERT_EQ(control_information.commands.size(), 3u);
+  EXPECT_EQ(control_information.commands[0].name, "1_load");
+  EXPECT_EQ(control_information.commands[1].name, "2_rtl");
+  EXPECT_EQ(control_information.commands[2].name, "3_rtl");
+
+  BatchCommandGraph graph;
+  ASSERT_TRUE(graph.initialize(control_information.commands));
+  ASSERT_EQ(graph.getCommandGroups().size(), 1u);
+  EXPECT_EQ(graph.getCommandGroups()[0], std::vector<size_t>({0u, 1u, 2u}));
+
+  // A failing command does not stop the plain commands after it.
+  std::vector<std::string> executed_commands;
+  BatchCommandTimingList timings;
+  const size_t num_unsuccessful_commands = runBatchCommandGroup(
+      graph, 0u, 1u, "map_b",
+      [&executed_commands](const std::string& command) {
+        executed_commands.push_back(command);
+        return executed_commands.size() == 2u ? common::kUnknownError
+                                              : common::kSuccess;
+      },
+      std::function<void(const BatchCommandTimingList&)>(), &timings);
+  EXPECT_EQ(num_unsuccessful_commands, 1u);
+  ASSERT_EQ(executed_commands.size(), 3u);
+  EXPECT_EQ(executed_commands[0], "load --map_folder=map_b");
+  ASSERT_EQ(timings.size(), 3u);
+  EXPECT_EQ(timings[1].status, BatchCommandStatus::kFailed);
+  EXPECT_EQ(timings[2].status, BatchCommandStatus::kSuccess);
+  EXPECT_EQ(timings[2].map_index, 1u);
+}
+
+TEST(BatchControlTest, DependenciesFormGroups) {
+  const BatchControlInformation control_information = parseControlInformation(
+      "vi_map_folder_paths: [map]\n"
+      "commands:\n"
+      "  - name: load_for_export\n"
+      "    command: load --map_key=<CURRENT_MAP_KEY>\n"
+      "  - name: load\n"
+      "    command: load --map_folder=<CURRENT_VIMAP_FOLDER>\n"
+      "  - name: export\n"
+      "    command: export_trajectory_to_csv\n"
+      "    depends_on: load_for_export\n"
+      "  - name: optimize\n"
+      "    command: optvi\n"
+      "    depends_on: [load]\n"
+      "  - name: save\n"
+      "    command: save\n"
+      "    depends_on: [optimize]\n"
+      "    runs_after: [load]\n");
+  BatchCommandGraph graph;
+  ASSERT_TRUE(graph.initialize(control_information.commands));
+  ASSERT_EQ(graph.getCommandGroups().size(), 2u);
+  EXPECT_EQ(graph.getCommandGroups()[0], std::vector<size_t>({0u, 2u}));
+  EXPECT_EQ(graph.getCommandGroups()[1], std::vector<size_t>({1u, 3u, 4u}));
+  EXPECT_EQ(graph.getDependencies(4u), std::vector<size_t>({3u}));
+
+  std::vector<std::string> executed_commands;
+  const BatchCommandFunction run_command =
+      [&executed_commands](const std::string& command) {
+        executed_commands.push_back(command);
+        return command == "optvi" ? common::kUnknownError : common::kSuccess;
+      };
+  BatchCommandTimingList timings;
+  EXPECT_EQ(
+      runBatchCommandGroup(
+          graph, 0u, 3u, "map", run_command,
+          std::function<void(const BatchCommandTimingList&)>(), &timings),
+      0u);
+  ASSERT_EQ(executed_commands.size(), 2u);
+  EXPECT_EQ(executed_commands[0], "load --map_key=" + getBatchMapKey(3u));
+
+  // The save is skipped as the optimization failed.
+  size_t num_callbacks = 0u;
+  EXPECT_EQ(
+      runBatchCommandGroup(
+          graph, 1u, 3u, "map", run_command,
+          [&num_callbacks](const BatchCommandTimingList&) { ++num_callbacks; },
+          &timings),
+      2u);
+  EXPECT_EQ(num_callbacks, 3u);
+  ASSERT_EQ(executed_commands.size(), 4u);
+  ASSERT_EQ(timings.size(), 5u);
+  EXPECT_EQ(timings[3].status, BatchCommandStatus::kFailed);
+  EXPECT_EQ(timings[4].command_index, 4u);
+  EXPECT_EQ(timings[4].status, BatchCommandStatus::kSkipped);
+
+  const BatchCommandTiming timing =
+      YAML::Load(YAML::Dump(YAML::Node(timings[4])))
+          .as<BatchCommandTiming>();
+  EXPECT_EQ(timing.command_index, 4u);
+  EXPECT_EQ(timing.status, BatchCommandStatus::kSkipped);
+}
+
+TEST(BatchControlTest, InvalidDependenciesAreRejected) {
+  BatchCommandGraph graph;
+  std::vector<BatchCommand> commands(2u);
+  commands[0].name = "a";
+  commands[1].name = "b";
+  commands[1].depends_on.push_back("c");
+  EXPECT_FALSE(graph.initialize(commands));
+
+  commands[1].depends_on[0] = "a";
+  commands[0].runs_after.push_back("b");
+  EXPECT_FALSE(graph.initialize(commands));
+
+  commands[0].runs_after.clear();
+  EXPECT_TRUE(graph.initialize(commands));
+  commands[1].name = "a";
+  EXPECT_FALSE(graph.initialize(commands));
+}
+
+TEST(BatchControlTest, JobsAreSelectedWithinMemoryBudget) {
+  const std::vector<uint64_t> pending_job_memory_bytes = {80u, 30u, 10u};
+  size_t job_index;
+  // Without running jobs, the first job starts even if it exceeds the budget.
+  ASSERT_TRUE(
+      selectNextBatchJob(pending_job_memory_bytes, 0u, 50u, 0u, &job_index));
+  EXPECT_EQ(job_index, 0u);
+  ASSERT_TRUE(
+      selectNextBatchJob(pending_job_memory_bytes, 20u, 50u, 1u, &job_index));
+  EXPECT_EQ(job_index, 1u);
+  ASSERT_TRUE(
+      selectNextBatchJob(pending_job_memory_bytes, 30u, 50u, 1u, &job_index));
+  EXPECT_EQ(job_index, 2u);
+  EXPECT_FALSE(
+      selectNextBatchJob(pending_job_memory_bytes, 45u, 50u, 2u, &job_index));
+  // No budget.
+  ASSERT_TRUE(
+      selectNextBatchJob(pending_job_memory_bytes, 45u, 0u, 2u, &job_index));
+  EXPECT_EQ(job_index, 0u);
+  EXPECT_FALSE(selectNextBatchJob({}, 0u, 0u, 0u, &job_index));
+}
+
+}  // namespace maplab
+
+MAPLAB_UNITTEST_ENTRYPOINT
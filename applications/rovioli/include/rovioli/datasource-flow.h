@@ -47,6 +47,14 @@ class DataSourceFlow {
     datasource_->registerEndOfDataCallback(cb);
   }
 
+  bool isLockstepPlaybackEnabled() const {
+    return datasource_->isLockstepPlaybackEnabled();
+  }
+
+  void setWaitUntilIdleFunction(const std::function<void()>& wait_until_idle) {
+    datasource_->setWaitUntilIdleFunction(wait_until_idle);
+  }
+
  private:
   std::unique_ptr<DataSource> datasource_;
 };
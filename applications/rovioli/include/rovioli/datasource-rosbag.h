@@ -43,6 +43,7 @@ class DataSourceRosbag : public DataSource {
     return all_data_streamed_;
   }
   virtual std::string getDatasetName() const;
+  virtual bool isLockstepPlaybackEnabled() const;
 
  private:
   void streamingWorker();
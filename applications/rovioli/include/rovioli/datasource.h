@@ -60,6 +60,19 @@ class DataSource : public CallbackManager {
     }
   }
 
+  // Lock-step playback: instead of pacing the messages by their recording
+  // time, the data source calls the wait-until-idle function before
+  // publishing the next message. The function is expected to block until all
+  // consumers have processed everything published so far. Only data sources
+  // that control the playback (i.e. not live data) support this mode.
+  virtual bool isLockstepPlaybackEnabled() const {
+    return false;
+  }
+  void setWaitUntilIdleFunction(const std::function<void()>& wait_until_idle) {
+    CHECK(wait_until_idle);
+    wait_until_idle_ = wait_until_idle;
+  }
+
   // If this is the first timestamp we receive, we store it and shift all
   // subsequent timestamps. Will return false for any timestamps that are
   // smaller than the first timestamp received.
@@ -95,7 +108,15 @@ class DataSource : public CallbackManager {
  protected:
   DataSource() = default;
 
+  void waitUntilIdle() const {
+    CHECK(wait_until_idle_)
+        << "Lock-step playback requires a wait-until-idle function.";
+    wait_until_idle_();
+  }
+
  private:
+  std::function<void()> wait_until_idle_;
+
   std::vector<std::function<void()>> end_of_data_callbacks_;
 
   std::mutex timestamp_mutex_;
@@ -39,11 +39,8 @@ class ImuCameraSynchronizerFlow {
         kSubscriberNodeName, message_flow::DeliveryOptions(),
         [this](const vio::ImuMeasurement::Ptr& imu) {
           CHECK(imu);
-          // TODO(schneith): This seems inefficient. Should we batch IMU
-          // measurements on the datasource side?
-          this->synchronizing_pipeline_.addImuMeasurements(
-              (Eigen::Matrix<int64_t, 1, 1>() << imu->timestamp).finished(),
-              imu->imu_data);
+          this->synchronizing_pipeline_.addImuMeasurement(
+              imu->timestamp, imu->imu_data);
         });
 
     // Tracked nframes and IMU output.
@@ -55,6 +52,14 @@ class ImuCameraSynchronizerFlow {
     synchronizing_pipeline_.shutdown();
   }
 
+  void enableLockstepMode() {
+    synchronizing_pipeline_.enableLockstepMode();
+  }
+
+  void waitUntilIdle() {
+    synchronizing_pipeline_.waitUntilIdle();
+  }
+
  private:
   ImuCameraSynchronizer synchronizing_pipeline_;
 };
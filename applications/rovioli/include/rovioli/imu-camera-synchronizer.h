@@ -2,17 +2,23 @@
 #define ROVIOLI_IMU_CAMERA_SYNCHRONIZER_H_
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <Eigen/Core>
 #include <aslam/cameras/ncamera.h>
+#include <aslam/common/statistics/statistics.h>
 #include <aslam/pipeline/visual-npipeline.h>
 #include <opencv2/core/core.hpp>
 #include <vio-common/imu-measurements-buffer.h>
 #include <vio-common/vio-types.h>
 #include <vio-common/vio-update.h>
 
+#include "rovioli/synchronized-nframe-imu-pool.h"
+
 namespace rovioli {
 
 class ImuCameraSynchronizer {
@@ -28,44 +34,122 @@ class ImuCameraSynchronizer {
   void addImuMeasurements(
       const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& timestamps_nanoseconds,
       const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_measurements);
+  void addImuMeasurement(
+      int64_t timestamp_nanoseconds, const vio::ImuData& imu_measurement);
   void addCameraImage(
       size_t camera_index, const cv::Mat& image, int64_t timestamp);
 
+  // The published messages are taken from a pool and return to it once they
+  // are no longer referenced, see SynchronizedNFrameImuPool.
   void registerSynchronizedNFrameImuCallback(
       const std::function<void(const vio::SynchronizedNFrameImu::Ptr&)>& cb);
 
   void shutdown();
 
+  // In lock-step mode the synchronizer waits for the IMU data of an nframe
+  // without timeout instead of dropping the nframe after a while. This is only
+  // meaningful if the data source does not drop messages itself and the
+  // publishing is paced using waitUntilIdle().
+  void enableLockstepMode();
+
+  // Blocks until all images passed in so far have been processed and the
+  // resulting synchronized nframes have been handed to the callbacks, or until
+  // the synchronizer waits for IMU data that has not been passed in yet.
+  void waitUntilIdle();
+
   static constexpr size_t kFramesToSkipAtInit = 1u;
 
+  // Tag of the statistic that holds the time from receiving the first image
+  // of an nframe to publishing the synchronized nframe, in milliseconds.
+  static constexpr char kLatencyStatisticTag[] =
+      "ImuCameraSynchronizer: camera to synchronized nframe latency [ms]";
+
  private:
+  typedef std::function<void(const vio::SynchronizedNFrameImu::Ptr&)>
+      NFrameCallback;
+  typedef std::vector<NFrameCallback> NFrameCallbackList;
+
+  // Arrival time of an image, written by the camera callbacks and read by the
+  // processing thread without locking. The image timestamp is invalidated
+  // while the slot is being rewritten.
+  struct ImageArrival {
+    std::atomic<int64_t> image_timestamp_ns;
+    std::atomic<int64_t> arrival_time_ns;
+  };
+  // Number of arrival slots per camera, i.e. the maximum number of images of
+  // a camera that can be in flight while still reporting their latency.
+  static constexpr size_t kNumImageArrivalSlots = 64u;
+
+  // Wakes up the processing thread if it waits for IMU data in lock-step mode.
+  void notifyImuDataAdded();
+
+  void recordImageArrival(
+      size_t camera_index, int64_t image_timestamp_ns, int64_t arrival_time_ns);
+  // Returns the arrival time of the earliest image of the nframe or -1 if it
+  // is no longer known.
+  int64_t getNFrameArrivalTime(const aslam::VisualNFrame& nframe) const;
+
   void checkIfMessagesAreIncomingWorker();
   void processDataThreadWorker();
+  // Returns false on shutdown.
+  bool processNFrame(const aslam::VisualNFrame::Ptr& new_nframe);
+  vio_common::ImuMeasurementBuffer::QueryResult getImuDataLockstep(
+      int64_t timestamp_from_ns, int64_t timestamp_to_ns,
+      Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
+      Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_measurements);
 
   const aslam::NCamera::Ptr camera_system_;
 
   aslam::VisualNPipeline::UniquePtr visual_pipeline_;
+  // Shared by the IMU callbacks and the processing thread, both lock its
+  // mutex for every batch of IMU data or nframe respectively.
   vio_common::ImuMeasurementBuffer::UniquePtr imu_buffer_;
   const int64_t kImuBufferLengthNanoseconds;
 
   // Number of already skipped frames.
   size_t frame_skip_counter_;
 
+  // Only accessed by the processing thread.
   int64_t previous_nframe_timestamp_ns_;
-  std::mutex m_previous_nframe_timestamp_ns_;
 
   // Minimum interval of the output, as configured by the maximum frequency
   // flag.
   int64_t min_nframe_timestamp_diff_ns_;
 
-  std::vector<std::function<void(const vio::SynchronizedNFrameImu::Ptr&)>>
-      nframe_callbacks_;
-  std::mutex m_nframe_callbacks_;
+  // Immutable list of callbacks that is replaced on registration, such that
+  // the processing thread does not need to lock a mutex for every nframe.
+  // Only accessed through std::atomic_load and std::atomic_store.
+  std::shared_ptr<const NFrameCallbackList> nframe_callbacks_;
+  std::mutex m_nframe_callbacks_registration_;
   std::atomic<bool> initial_sync_succeeded_;
 
+  SynchronizedNFrameImuPool::Ptr synced_nframe_imu_pool_;
+
+  // kNumImageArrivalSlots slots per camera, used as a ring buffer.
+  std::unique_ptr<ImageArrival[]> image_arrivals_;
+  std::unique_ptr<std::atomic<size_t>[]> next_image_arrival_slots_;
+  statistics::StatsCollector latency_stats_;
+
   std::atomic<bool> shutdown_;
   std::condition_variable cv_shutdown_;
 
+  std::atomic<bool> lockstep_mode_;
+  // Guards the idle bookkeeping below, which is used by waitUntilIdle().
+  std::mutex m_idle_;
+  std::condition_variable cv_idle_;
+  // Number of nframes taken from the visual pipeline that have been fully
+  // processed (published or dropped). Incremented without locking, the
+  // processing thread only locks m_idle_ to wake up waiting callers of
+  // waitUntilIdle(), whose number is counted below.
+  std::atomic<size_t> num_nframes_handled_;
+  std::atomic<size_t> num_idle_waiters_;
+  // True while the processing thread waits for IMU data in lock-step mode and
+  // no new IMU data has arrived since it last checked.
+  bool is_waiting_for_imu_;
+  // Incremented for every batch of IMU data that is passed in.
+  size_t imu_data_counter_;
+  std::condition_variable cv_imu_data_;
+
   std::thread check_if_messages_are_incomfing_thread_;
   std::thread process_thread_;
   std::mutex mutex_check_if_messages_are_incoming_;
@@ -14,6 +14,7 @@
 #include <vio-common/vio-types.h>
 
 #include "rovioli/flow-topics.h"
+#include "rovioli/map-checkpointer.h"
 #include "rovioli/vi-map-with-mutex.h"
 #include "rovioli/vio-update-builder.h"
 
@@ -41,6 +42,9 @@ class MapBuilderFlow {
 
   VioUpdateBuilder vio_update_builder_;
   online_map_builders::StreamMapBuilder stream_map_builder_;
+
+  // Only set if the map is checkpointed while mapping.
+  std::unique_ptr<MapCheckpointer> map_checkpointer_;
 };
 
 }  // namespace rovioli
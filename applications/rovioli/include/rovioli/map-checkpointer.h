@@ -0,0 +1,216 @@
+#ifndef ROVIOLI_MAP_CHECKPOINTER_H_
+#define ROVIOLI_MAP_CHECKPOINTER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+#include <maplab-common/macros.h>
+#include <maplab-common/map-manager-config.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/vi-map-metadata.h>
+#include <vi-map/vi-map.h>
+#include <vi-map/vi_map.pb.h>
+
+#include "rovioli/vi-map-with-mutex.h"
+
+namespace rovioli {
+
+// The chunk files written by the MapCheckpointer for one kind of entity, i.e.
+// vertices or edges, and the entities in each of them.
+template <typename IdType>
+class CheckpointChunkFiles {
+ public:
+  typedef std::vector<IdType> IdList;
+  typedef std::function<bool(const IdType&)> ExistsFunction;
+
+  bool contains(const IdType& id) const {
+    return id_to_file_name_.count(id) > 0u;
+  }
+  size_t numIds() const {
+    return id_to_file_name_.size();
+  }
+
+  // Marks the chunk file that contains the entity as outdated.
+  void markModified(const IdType& id) {
+    typename std::unordered_map<IdType, std::string>::const_iterator it =
+        id_to_file_name_.find(id);
+    if (it != id_to_file_name_.end()) {
+      modified_chunks_.insert(it->second);
+    }
+  }
+  void markAllModified() {
+    for (const typename ChunkMap::value_type& chunk : chunks_) {
+      modified_chunks_.insert(chunk.first);
+    }
+  }
+  // Marks the chunk files that contain entities that don't exist anymore.
+  void markChunksWithRemovedIds(const ExistsFunction& exists) {
+    for (const typename ChunkMap::value_type& chunk : chunks_) {
+      for (const IdType& id : chunk.second) {
+        if (!exists(id)) {
+          modified_chunks_.insert(chunk.first);
+          break;
+        }
+      }
+    }
+  }
+
+  // Returns the outdated chunk files and the entities in them that still
+  // exist and have to be written again.
+  void getModifiedChunks(
+      const ExistsFunction& exists,
+      std::unordered_set<std::string>* file_names,
+      IdList* ids_to_rewrite) const {
+    CHECK_NOTNULL(file_names)->clear();
+    CHECK_NOTNULL(ids_to_rewrite)->clear();
+    for (const std::string& file_name : modified_chunks_) {
+      file_names->insert(file_name);
+      for (const IdType& id : chunks_.at(file_name)) {
+        if (exists(id)) {
+          ids_to_rewrite->emplace_back(id);
+        }
+      }
+    }
+  }
+
+  // Replaces the outdated chunk files by the newly written ones. The chunks
+  // are moved.
+  void replaceChunks(
+      const std::unordered_set<std::string>& outdated_file_names,
+      const std::vector<std::string>& file_names,
+      std::vector<IdList>* chunks) {
+    CHECK_NOTNULL(chunks);
+    CHECK_EQ(file_names.size(), chunks->size());
+    for (const std::string& file_name : outdated_file_names) {
+      const typename ChunkMap::iterator it = chunks_.find(file_name);
+      CHECK(it != chunks_.end());
+      for (const IdType& id : it->second) {
+        id_to_file_name_.erase(id);
+      }
+      chunks_.erase(it);
+      modified_chunks_.erase(file_name);
+    }
+    for (size_t chunk_idx = 0u; chunk_idx < file_names.size(); ++chunk_idx) {
+      for (const IdType& id : (*chunks)[chunk_idx]) {
+        id_to_file_name_[id] = file_names[chunk_idx];
+      }
+      chunks_[file_names[chunk_idx]].swap((*chunks)[chunk_idx]);
+    }
+  }
+
+ private:
+  typedef std::unordered_map<std::string, IdList> ChunkMap;
+
+  ChunkMap chunks_;
+  std::unordered_map<IdType, std::string> id_to_file_name_;
+  // Chunk files that contain outdated or removed entities.
+  std::unordered_set<std::string> modified_chunks_;
+};
+
+// Periodically appends the finished part of a map that is still being built
+// to a map folder. Every checkpoint writes the vertices that were finished
+// since the last checkpoint and their incoming edges into new chunk files,
+// the small per-map files (missions, landmark index, ...) are written under
+// a per-checkpoint name. The VIMap metadata, which references all files of
+// the map, is replaced atomically at the end of a checkpoint. Hence, the
+// folder always contains a loadable map and a crash loses at most the data
+// of one checkpoint interval.
+//
+// The map mutex is only held while the new data is serialized into protos,
+// writing the files happens while the mapping continues.
+//
+// The checkpointer enables the modification tracking of the map to find the
+// vertices and edges that changed or were removed after they were written.
+// Their chunks are rewritten by the next checkpoint or by saveFinalMap(),
+// e.g. after the landmark initialization at the end of a session.
+class MapCheckpointer {
+ public:
+  MapCheckpointer(
+      const std::string& map_folder, const double checkpoint_interval_s,
+      const VIMapWithMutex::Ptr& map_with_mutex);
+  ~MapCheckpointer();
+
+  // The map mutex must not be held by the caller.
+  void start();
+  // Stops the background thread. Blocks until a running checkpoint is
+  // finished. The map mutex must not be held by the caller. The modification
+  // tracking stays enabled until saveFinalMap().
+  void stop();
+
+  const std::string& getMapFolder() const {
+    return map_folder_;
+  }
+
+  // Writes the complete map to the map folder. The chunks of the checkpoints
+  // are reused unless one of their vertices or edges changed since it was
+  // written.
+  // Unless save_config.overwrite_existing_files is set, fails if a file that
+  // was not written by the checkpointer would be overwritten. The resources
+  // are saved according to save_config. Must be called after stop() and with
+  // the map mutex held. Disables the modification tracking of the map.
+  bool saveFinalMap(const backend::SaveConfig& save_config);
+
+ private:
+  typedef std::vector<std::pair<std::string, vi_map::proto::VIMap>>
+      NamedProtoList;
+
+  // Data of the files that are rewritten by every checkpoint.
+  struct MapWideFiles {
+    NamedProtoList protos;
+    std::string sensors_yaml;
+  };
+
+  void checkpointWorker();
+  bool writeCheckpoint();
+
+  // Serializes the missions, the landmark index, the optional sensor data and
+  // the sensors. The protos are named after the checkpoint. Must be called
+  // with the map mutex held.
+  void serializeMapWideFiles(
+      const size_t checkpoint_index, MapWideFiles* files,
+      vi_map::serialization::VIMapMetadata* metadata) const;
+  bool writeMapWideFiles(const MapWideFiles& files) const;
+  bool writeProtos(const NamedProtoList& protos) const;
+  // Records the checkpointed chunks that contain vertices or edges modified
+  // since the last call. Must be called with the map mutex held.
+  void takeModifiedChunks();
+  // Replaces the metadata file of the map folder.
+  bool commitMetadata(
+      const vi_map::serialization::VIMapMetadata& metadata) const;
+  void removeFiles(const vi_map::serialization::VIMapMetadata& metadata) const;
+
+  const std::string map_folder_;
+  const std::string vi_map_folder_;
+  const double checkpoint_interval_s_;
+  const VIMapWithMutex::Ptr map_with_mutex_;
+
+  std::thread checkpoint_thread_;
+  std::mutex mutex_shutdown_;
+  std::condition_variable cv_shutdown_;
+  bool shutdown_requested_;
+
+  // State of the written checkpoints, only accessed by the thread that writes
+  // checkpoints or by saveFinalMap() after stop().
+  size_t num_checkpoints_;
+  size_t num_vertices_checkpointed_;
+  // References all vertex and edge chunk files of the map.
+  vi_map::serialization::VIMapMetadata chunk_metadata_;
+  // References the per-checkpoint files of the latest checkpoint.
+  vi_map::serialization::VIMapMetadata map_wide_metadata_;
+  CheckpointChunkFiles<pose_graph::VertexId> vertex_chunk_files_;
+  CheckpointChunkFiles<pose_graph::EdgeId> edge_chunk_files_;
+
+  MAPLAB_DISALLOW_EVIL_CONSTRUCTORS(MapCheckpointer);
+};
+
+}  // namespace rovioli
+
+#endif  // ROVIOLI_MAP_CHECKPOINTER_H_
@@ -0,0 +1,120 @@
+#ifndef ROVIOLI_SYNCHRONIZED_NFRAME_IMU_POOL_H_
+#define ROVIOLI_SYNCHRONIZED_NFRAME_IMU_POOL_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <maplab-common/macros.h>
+#include <vio-common/vio-types.h>
+
+namespace rovioli {
+
+// Pool of synchronized nframe/IMU messages that are handed out as shared
+// pointers and return to the pool once the last reference to them is dropped.
+// The shared pointer control blocks are recycled by the pool as well.
+//
+// Only the message objects and their control blocks are pooled. A returned
+// message releases its nframe, which comes from the visual pipeline and is
+// kept by the map, so it is not pooled. The IMU matrices are kept, but they
+// are dynamically sized Eigen matrices that the IMU buffer resizes, so their
+// storage is only reused if the next message has the same number of IMU
+// measurements. Otherwise resizing them reallocates.
+//
+// The pool may be destroyed while messages are still in use, these are then
+// deleted when they are released.
+class SynchronizedNFrameImuPool
+    : public std::enable_shared_from_this<SynchronizedNFrameImuPool> {
+ public:
+  MAPLAB_POINTER_TYPEDEFS(SynchronizedNFrameImuPool);
+
+  static Ptr create(const size_t num_preallocated_messages);
+
+  // Returns a message from the pool. A new message is allocated if all
+  // messages are in use.
+  vio::SynchronizedNFrameImu::Ptr acquire();
+
+  size_t getNumAvailableMessages() const;
+  // Total number of messages allocated by this pool so far.
+  size_t getNumAllocatedMessages() const;
+  // Total number of shared pointer control blocks allocated so far.
+  size_t getNumAllocatedControlBlocks() const;
+
+ private:
+  typedef std::unique_ptr<vio::SynchronizedNFrameImu> MessageUniquePtr;
+
+  // Free list for the control blocks of the handed out shared pointers. A
+  // custom deleter means the control block cannot be allocated together with
+  // the message, so without this list every acquire() would allocate. Blocks
+  // are freed back to the list, which can happen after the pool is
+  // destroyed, hence the allocators share ownership of the arena.
+  class ControlBlockArena {
+   public:
+    explicit ControlBlockArena(const size_t num_expected_blocks);
+    ~ControlBlockArena();
+
+    void* allocate(const size_t num_bytes);
+    void deallocate(void* block, const size_t num_bytes);
+
+    size_t getNumAllocatedBlocks() const;
+
+   private:
+    // All control blocks of the pool have the same type, the size is set by
+    // the first allocation. Blocks of other sizes bypass the free list.
+    size_t block_size_;
+    size_t num_allocated_blocks_;
+    std::vector<void*> free_blocks_;
+    mutable std::mutex m_free_blocks_;
+  };
+
+  template <typename T>
+  class ControlBlockAllocator {
+   public:
+    typedef T value_type;
+
+    explicit ControlBlockAllocator(
+        const std::shared_ptr<ControlBlockArena>& arena)
+        : arena_(arena) {}
+    template <typename U>
+    ControlBlockAllocator(const ControlBlockAllocator<U>& other)  // NOLINT
+        : arena_(other.arena_) {}
+
+    T* allocate(const size_t num_elements) {
+      return static_cast<T*>(arena_->allocate(num_elements * sizeof(T)));
+    }
+    void deallocate(T* block, const size_t num_elements) {
+      arena_->deallocate(block, num_elements * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ControlBlockAllocator<U>& other) const {
+      return arena_ == other.arena_;
+    }
+    template <typename U>
+    bool operator!=(const ControlBlockAllocator<U>& other) const {
+      return arena_ != other.arena_;
+    }
+
+   private:
+    template <typename U>
+    friend class ControlBlockAllocator;
+
+    std::shared_ptr<ControlBlockArena> arena_;
+  };
+
+  explicit SynchronizedNFrameImuPool(const size_t num_preallocated_messages);
+
+  static void release(
+      const std::weak_ptr<SynchronizedNFrameImuPool>& pool,
+      vio::SynchronizedNFrameImu* message);
+
+  std::vector<MessageUniquePtr> available_messages_;
+  size_t num_allocated_messages_;
+  mutable std::mutex m_available_messages_;
+
+  const std::shared_ptr<ControlBlockArena> control_block_arena_;
+};
+
+}  // namespace rovioli
+
+#endif  // ROVIOLI_SYNCHRONIZED_NFRAME_IMU_POOL_H_
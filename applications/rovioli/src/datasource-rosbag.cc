@@ -31,6 +31,12 @@ DEFINE_double(
     vio_rosbag_realtime_playback_rate, 1.0,
     "Playback rate of the ROSBAG. Real-time corresponds to 1.0. "
     "This only makes sense when using offline data sources.");
+DEFINE_bool(
+    vio_rosbag_lockstep_playback, false,
+    "Play back the ROSBAG as fast as possible, but only publish the next "
+    "message once all previous messages have been processed by the pipeline. "
+    "No messages are dropped due to processing delays, hence the results are "
+    "reproducible. Overrides --vio_rosbag_realtime_playback_rate.");
 DEFINE_bool(
     rovioli_zero_initial_timestamps, false,
     "If set to true, the timestamps outputted by the estimator start with 0. "
@@ -73,6 +79,10 @@ std::string DataSourceRosbag::getDatasetName() const {
   return filename;
 }
 
+bool DataSourceRosbag::isLockstepPlaybackEnabled() const {
+  return FLAGS_vio_rosbag_lockstep_playback;
+}
+
 void DataSourceRosbag::initialize() {
   try {
     bag_.reset(new rosbag::Bag);
@@ -132,6 +142,11 @@ void DataSourceRosbag::streamingWorker() {
   CHECK_GT(FLAGS_vio_rosbag_realtime_playback_rate, 0.0);
   const double message_wait_time_scaler =
       1.0 / FLAGS_vio_rosbag_realtime_playback_rate;
+  const bool lockstep_playback = isLockstepPlaybackEnabled();
+  LOG_IF(INFO, lockstep_playback) << "Playing back the rosbag in lock-step.";
+  size_t num_messages_played = 0u;
+  const std::chrono::steady_clock::time_point time_playback_start =
+      std::chrono::steady_clock::now();
 
   // NOTE: the playback order corresponds to the message timestamp (=host
   // received) and not the actual timestamp in the message's header field.
@@ -144,6 +159,11 @@ void DataSourceRosbag::streamingWorker() {
     const std::chrono::high_resolution_clock::time_point time_publishing_start =
         std::chrono::high_resolution_clock::now();
 
+    if (lockstep_playback) {
+      // Wait until the previous message has been fully processed.
+      waitUntilIdle();
+    }
+
     const rosbag::MessageInstance& message = *it_message;
     const std::string& topic = message.getTopic();
     CHECK(!topic.empty());
@@ -201,10 +221,12 @@ void DataSourceRosbag::streamingWorker() {
       }
     }
 
+    ++num_messages_played;
+
     // Wait for the time between messages.
     rosbag::View::iterator it_next_message = it_message;
     ++it_next_message;
-    if (it_next_message != bag_view_->end()) {
+    if (!lockstep_playback && it_next_message != bag_view_->end()) {
       std::chrono::duration<double> delta_t_k_kp1(
           it_next_message->getTime().toSec() - message.getTime().toSec());
       delta_t_k_kp1 *= message_wait_time_scaler;
@@ -212,7 +234,15 @@ void DataSourceRosbag::streamingWorker() {
     }
     ++it_message;
   }
-  LOG(INFO) << "Rosbag playback finished!";
+  if (lockstep_playback) {
+    waitUntilIdle();
+  }
+  const double playback_duration_s =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - time_playback_start)
+          .count();
+  LOG(INFO) << "Rosbag playback finished! Played " << num_messages_played
+            << " messages in " << playback_duration_s << " s.";
   all_data_streamed_ = true;
   invokeEndOfDataCallbacks();
   return;
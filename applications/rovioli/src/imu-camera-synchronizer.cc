@@ -1,5 +1,8 @@
 #include "rovioli/imu-camera-synchronizer.h"
 
+#include <algorithm>
+#include <utility>
+
 #include <aslam/pipeline/visual-pipeline-null.h>
 #include <maplab-common/conversions.h>
 
@@ -14,6 +17,8 @@ DEFINE_double(
 
 namespace rovioli {
 
+constexpr char ImuCameraSynchronizer::kLatencyStatisticTag[];
+
 ImuCameraSynchronizer::ImuCameraSynchronizer(
     const aslam::NCamera::Ptr& camera_system)
     : camera_system_(camera_system),
@@ -23,8 +28,15 @@ ImuCameraSynchronizer::ImuCameraSynchronizer(
       min_nframe_timestamp_diff_ns_(
           kSecondsToNanoSeconds /
           FLAGS_vio_nframe_sync_max_output_frequency_hz),
+      nframe_callbacks_(std::make_shared<const NFrameCallbackList>()),
       initial_sync_succeeded_(false),
+      latency_stats_(kLatencyStatisticTag),
       shutdown_(false),
+      lockstep_mode_(false),
+      num_nframes_handled_(0u),
+      num_idle_waiters_(0u),
+      is_waiting_for_imu_(false),
+      imu_data_counter_(0u),
       time_last_imu_message_received_or_checked_ns_(
           aslam::time::nanoSecondsSinceEpoch()),
       time_last_camera_message_received_or_checked_ns_(
@@ -32,6 +44,23 @@ ImuCameraSynchronizer::ImuCameraSynchronizer(
   CHECK(camera_system_ != nullptr);
   CHECK_GT(FLAGS_vio_nframe_sync_max_output_frequency_hz, 0.);
 
+  // Enough messages for the queues of the downstream consumers, the pool
+  // grows if they hold on to more.
+  constexpr size_t kNumPreallocatedMessages = 32u;
+  synced_nframe_imu_pool_ =
+      SynchronizedNFrameImuPool::create(kNumPreallocatedMessages);
+
+  const size_t num_cameras = camera_system_->getNumCameras();
+  image_arrivals_.reset(new ImageArrival[num_cameras * kNumImageArrivalSlots]);
+  for (size_t i = 0u; i < num_cameras * kNumImageArrivalSlots; ++i) {
+    image_arrivals_[i].image_timestamp_ns = -1;
+    image_arrivals_[i].arrival_time_ns = -1;
+  }
+  next_image_arrival_slots_.reset(new std::atomic<size_t>[num_cameras]);
+  for (size_t camera_idx = 0u; camera_idx < num_cameras; ++camera_idx) {
+    next_image_arrival_slots_[camera_idx] = 0u;
+  }
+
   // Initialize the pipeline.
   static constexpr bool kCopyImages = false;
   std::vector<aslam::VisualPipeline::Ptr> mono_pipelines;
@@ -66,8 +95,10 @@ void ImuCameraSynchronizer::addCameraImage(
     size_t camera_index, const cv::Mat& image, int64_t timestamp) {
   constexpr int kMaxNFrameQueueSize = 50;
   CHECK(visual_pipeline_ != nullptr);
-  time_last_camera_message_received_or_checked_ns_ =
-      aslam::time::nanoSecondsSinceEpoch();
+  CHECK_LT(camera_index, camera_system_->getNumCameras());
+  const int64_t arrival_time_ns = aslam::time::nanoSecondsSinceEpoch();
+  time_last_camera_message_received_or_checked_ns_ = arrival_time_ns;
+  recordImageArrival(camera_index, timestamp, arrival_time_ns);
   if (!visual_pipeline_->processImageBlockingIfFull(
           camera_index, image, timestamp, kMaxNFrameQueueSize)) {
     shutdown();
@@ -81,6 +112,141 @@ void ImuCameraSynchronizer::addImuMeasurements(
   time_last_imu_message_received_or_checked_ns_ =
       aslam::time::nanoSecondsSinceEpoch();
   imu_buffer_->addMeasurements(timestamps_nanoseconds, imu_measurements);
+  notifyImuDataAdded();
+}
+
+void ImuCameraSynchronizer::addImuMeasurement(
+    int64_t timestamp_nanoseconds, const vio::ImuData& imu_measurement) {
+  CHECK(imu_buffer_ != nullptr);
+  time_last_imu_message_received_or_checked_ns_ =
+      aslam::time::nanoSecondsSinceEpoch();
+  imu_buffer_->addMeasurement(timestamp_nanoseconds, imu_measurement);
+  notifyImuDataAdded();
+}
+
+void ImuCameraSynchronizer::notifyImuDataAdded() {
+  // Only the lock-step mode waits for this notification, otherwise the IMU
+  // callbacks don't need to touch the idle mutex.
+  if (!lockstep_mode_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_idle_);
+    ++imu_data_counter_;
+    // The processing thread needs to re-check whether it can continue before
+    // the synchronizer can be considered idle again.
+    is_waiting_for_imu_ = false;
+  }
+  cv_imu_data_.notify_all();
+}
+
+void ImuCameraSynchronizer::recordImageArrival(
+    size_t camera_index, int64_t image_timestamp_ns, int64_t arrival_time_ns) {
+  const size_t slot_idx = next_image_arrival_slots_[camera_index]++ %
+                          kNumImageArrivalSlots;
+  ImageArrival& image_arrival =
+      image_arrivals_[camera_index * kNumImageArrivalSlots + slot_idx];
+  image_arrival.image_timestamp_ns = -1;
+  image_arrival.arrival_time_ns = arrival_time_ns;
+  image_arrival.image_timestamp_ns = image_timestamp_ns;
+}
+
+int64_t ImuCameraSynchronizer::getNFrameArrivalTime(
+    const aslam::VisualNFrame& nframe) const {
+  int64_t earliest_arrival_time_ns = -1;
+  for (size_t camera_idx = 0u; camera_idx < nframe.getNumFrames();
+       ++camera_idx) {
+    if (!nframe.isFrameSet(camera_idx)) {
+      continue;
+    }
+    const int64_t image_timestamp_ns =
+        nframe.getFrame(camera_idx).getTimestampNanoseconds();
+    const ImageArrival* slots =
+        &image_arrivals_[camera_idx * kNumImageArrivalSlots];
+    int64_t arrival_time_ns = -1;
+    for (size_t slot_idx = 0u; slot_idx < kNumImageArrivalSlots; ++slot_idx) {
+      if (slots[slot_idx].image_timestamp_ns != image_timestamp_ns) {
+        continue;
+      }
+      arrival_time_ns = slots[slot_idx].arrival_time_ns;
+      // Discard the arrival time if the slot was rewritten in the meantime.
+      if (slots[slot_idx].image_timestamp_ns != image_timestamp_ns) {
+        arrival_time_ns = -1;
+      }
+      break;
+    }
+    if (arrival_time_ns < 0) {
+      return -1;
+    }
+    earliest_arrival_time_ns = earliest_arrival_time_ns < 0
+                                   ? arrival_time_ns
+                                   : std::min(
+                                         earliest_arrival_time_ns,
+                                         arrival_time_ns);
+  }
+  return earliest_arrival_time_ns;
+}
+
+void ImuCameraSynchronizer::enableLockstepMode() {
+  lockstep_mode_ = true;
+}
+
+void ImuCameraSynchronizer::waitUntilIdle() {
+  // No new nframes can be completed after this point as long as no new images
+  // are passed in.
+  visual_pipeline_->waitForAllWorkToComplete();
+
+  // Registered before checking the condition, such that the processing thread
+  // either sees this waiter or this waiter sees the handled nframe.
+  ++num_idle_waiters_;
+  std::unique_lock<std::mutex> lock(m_idle_);
+  cv_idle_.wait(lock, [this]() {
+    if (shutdown_) {
+      return true;
+    }
+    // Check the output queue first: once it is empty, the number of retrieved
+    // nframes can't change anymore.
+    if (visual_pipeline_->getNumFramesComplete() > 0u) {
+      return false;
+    }
+    const size_t num_nframes_in_progress =
+        visual_pipeline_->getNumFramesRetrieved() - num_nframes_handled_;
+    return num_nframes_in_progress == 0u ||
+           (num_nframes_in_progress == 1u && is_waiting_for_imu_);
+  });
+  --num_idle_waiters_;
+}
+
+vio_common::ImuMeasurementBuffer::QueryResult
+ImuCameraSynchronizer::getImuDataLockstep(
+    int64_t timestamp_from_ns, int64_t timestamp_to_ns,
+    Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
+    Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_measurements) {
+  CHECK_NOTNULL(imu_timestamps);
+  CHECK_NOTNULL(imu_measurements);
+  std::unique_lock<std::mutex> lock(m_idle_);
+  while (true) {
+    // Query the buffer while holding the idle lock such that no IMU data can
+    // slip in between the query and flagging this thread as waiting.
+    const vio_common::ImuMeasurementBuffer::QueryResult result =
+        imu_buffer_->getImuDataInterpolatedBorders(
+            timestamp_from_ns, timestamp_to_ns, imu_timestamps,
+            imu_measurements);
+    if (result !=
+        vio_common::ImuMeasurementBuffer::QueryResult::kDataNotYetAvailable) {
+      return result;
+    }
+    if (shutdown_) {
+      return vio_common::ImuMeasurementBuffer::QueryResult::kQueueShutdown;
+    }
+
+    const size_t imu_data_counter = imu_data_counter_;
+    is_waiting_for_imu_ = true;
+    cv_idle_.notify_all();
+    cv_imu_data_.wait(lock, [this, imu_data_counter]() {
+      return shutdown_ || imu_data_counter_ != imu_data_counter;
+    });
+  }
 }
 
 void ImuCameraSynchronizer::checkIfMessagesAreIncomingWorker() {
@@ -126,117 +292,148 @@ void ImuCameraSynchronizer::processDataThreadWorker() {
       return;
     }
 
-    // Block the previous nframe timestamp so that no other thread can use it.
-    // It should wait till this iteration is done.
-    std::unique_lock<std::mutex> lock(m_previous_nframe_timestamp_ns_);
-
-    // Drop few first nframes as there might have incomplete IMU data.
-    const int64_t current_frame_timestamp_ns =
-        new_nframe->getMinTimestampNanoseconds();
-    if (frame_skip_counter_ < kFramesToSkipAtInit) {
-      ++frame_skip_counter_;
-      previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
-      continue;
+    if (!processNFrame(new_nframe)) {
+      // Shutdown.
+      return;
     }
 
-    // Throttle the output rate of VisualNFrames to reduce the rate of which
-    // the following nodes are running (e.g. tracker).
-    CHECK_GE(previous_nframe_timestamp_ns_, 0);
-    if (new_nframe->getMinTimestampNanoseconds() -
-            previous_nframe_timestamp_ns_ <
-        min_nframe_timestamp_diff_ns_) {
-      continue;
+    ++num_nframes_handled_;
+    if (num_idle_waiters_ > 0u) {
+      {
+        // Synchronize with a waiter that is between checking its condition
+        // and waiting.
+        std::lock_guard<std::mutex> lock(m_idle_);
+      }
+      cv_idle_.notify_all();
     }
+  }
+}
 
-    vio::SynchronizedNFrameImu::Ptr new_imu_nframe_measurement(
-        new vio::SynchronizedNFrameImu);
-    new_imu_nframe_measurement->nframe = new_nframe;
-
-    // Wait for the required IMU data.
-    CHECK(aslam::time::isValidTime(previous_nframe_timestamp_ns_));
-    CHECK_LT(previous_nframe_timestamp_ns_, current_frame_timestamp_ns);
-    const int64_t kWaitTimeoutNanoseconds = aslam::time::milliseconds(50);
-    vio_common::ImuMeasurementBuffer::QueryResult result;
-    bool skip_frame = false;
-    while ((result = imu_buffer_->getImuDataInterpolatedBordersBlocking(
-                previous_nframe_timestamp_ns_, current_frame_timestamp_ns,
-                kWaitTimeoutNanoseconds,
-                &new_imu_nframe_measurement->imu_timestamps,
-                &new_imu_nframe_measurement->imu_measurements)) !=
-           vio_common::ImuMeasurementBuffer::QueryResult::kDataAvailable) {
-      if (result ==
-          vio_common::ImuMeasurementBuffer::QueryResult::kQueueShutdown) {
-        // Shutdown.
-        return;
-      }
-      if (result ==
-          vio_common::ImuMeasurementBuffer::QueryResult::kDataNeverAvailable) {
-        LOG(ERROR) << "Camera/IMU data out-of-order. This might be okay during "
-                      "initialization.";
-        CHECK(!initial_sync_succeeded_)
-            << "Some synced IMU-camera frames were"
-            << "already published. This will lead to map inconsistency.";
-
-        // Skip this frame, but also advanced the previous frame timestamp.
-        previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
-        skip_frame = true;
-        break;
-      }
+bool ImuCameraSynchronizer::processNFrame(
+    const aslam::VisualNFrame::Ptr& new_nframe) {
+  CHECK(new_nframe);
+  // Drop few first nframes as there might have incomplete IMU data.
+  const int64_t current_frame_timestamp_ns =
+      new_nframe->getMinTimestampNanoseconds();
+  if (frame_skip_counter_ < kFramesToSkipAtInit) {
+    ++frame_skip_counter_;
+    previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
+    return true;
+  }
 
-      if (result ==
-          vio_common::ImuMeasurementBuffer::QueryResult::kDataNotYetAvailable) {
-        LOG(WARNING) << "NFrame-IMU synchronization timeout. IMU measurements "
-                     << "lag behind. Dropping this nframe.";
-        // Skip this frame.
-        skip_frame = true;
-        break;
-      }
+  // Throttle the output rate of VisualNFrames to reduce the rate of which
+  // the following nodes are running (e.g. tracker).
+  CHECK_GE(previous_nframe_timestamp_ns_, 0);
+  if (new_nframe->getMinTimestampNanoseconds() -
+          previous_nframe_timestamp_ns_ <
+      min_nframe_timestamp_diff_ns_) {
+    return true;
+  }
 
-      if (result == vio_common::ImuMeasurementBuffer::QueryResult::
-                        kTooFewMeasurementsAvailable) {
-        LOG(WARNING) << "NFrame-IMU synchronization: Too few IMU measurements "
-                     << "available between the previous and current nframe. "
-                     << "Dropping this nframe.";
-        // Skip this frame.
-        skip_frame = true;
-        break;
-      }
+  vio::SynchronizedNFrameImu::Ptr new_imu_nframe_measurement =
+      synced_nframe_imu_pool_->acquire();
+  new_imu_nframe_measurement->nframe = new_nframe;
+
+  // Wait for the required IMU data.
+  CHECK(aslam::time::isValidTime(previous_nframe_timestamp_ns_));
+  CHECK_LT(previous_nframe_timestamp_ns_, current_frame_timestamp_ns);
+  const int64_t kWaitTimeoutNanoseconds = aslam::time::milliseconds(50);
+  vio_common::ImuMeasurementBuffer::QueryResult result;
+  while ((result =
+              lockstep_mode_
+                  ? getImuDataLockstep(
+                        previous_nframe_timestamp_ns_,
+                        current_frame_timestamp_ns,
+                        &new_imu_nframe_measurement->imu_timestamps,
+                        &new_imu_nframe_measurement->imu_measurements)
+                  : imu_buffer_->getImuDataInterpolatedBordersBlocking(
+                        previous_nframe_timestamp_ns_,
+                        current_frame_timestamp_ns, kWaitTimeoutNanoseconds,
+                        &new_imu_nframe_measurement->imu_timestamps,
+                        &new_imu_nframe_measurement->imu_measurements)) !=
+         vio_common::ImuMeasurementBuffer::QueryResult::kDataAvailable) {
+    if (result ==
+        vio_common::ImuMeasurementBuffer::QueryResult::kQueueShutdown) {
+      // Shutdown.
+      return false;
     }
+    if (result ==
+        vio_common::ImuMeasurementBuffer::QueryResult::kDataNeverAvailable) {
+      LOG(ERROR) << "Camera/IMU data out-of-order. This might be okay during "
+                    "initialization.";
+      CHECK(!initial_sync_succeeded_)
+          << "Some synced IMU-camera frames were"
+          << "already published. This will lead to map inconsistency.";
 
-    if (skip_frame) {
-      continue;
+      // Skip this frame, but also advanced the previous frame timestamp.
+      previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
+      return true;
     }
 
-    previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
-    // Manually unlock the mutex as the previous nframe timestamp can be
-    // consumed by the next iteration.
-    lock.unlock();
-
-    // All the synchronization succeeded so let's mark we will publish
-    // the frames now. Any IMU data drops after this point mean that the map
-    // is inconsistent.
-    initial_sync_succeeded_ = true;
-
-    std::lock_guard<std::mutex> callback_lock(m_nframe_callbacks_);
-    for (const std::function<void(const vio::SynchronizedNFrameImu::Ptr&)>&
-             callback : nframe_callbacks_) {
-      callback(new_imu_nframe_measurement);
+    if (result ==
+        vio_common::ImuMeasurementBuffer::QueryResult::kDataNotYetAvailable) {
+      LOG(WARNING) << "NFrame-IMU synchronization timeout. IMU measurements "
+                   << "lag behind. Dropping this nframe.";
+      // Skip this frame.
+      return true;
+    }
+
+    if (result == vio_common::ImuMeasurementBuffer::QueryResult::
+                      kTooFewMeasurementsAvailable) {
+      LOG(WARNING) << "NFrame-IMU synchronization: Too few IMU measurements "
+                   << "available between the previous and current nframe. "
+                   << "Dropping this nframe.";
+      // Skip this frame.
+      return true;
     }
   }
+
+  previous_nframe_timestamp_ns_ = current_frame_timestamp_ns;
+
+  // All the synchronization succeeded so let's mark we will publish
+  // the frames now. Any IMU data drops after this point mean that the map
+  // is inconsistent.
+  initial_sync_succeeded_ = true;
+
+  const int64_t arrival_time_ns = getNFrameArrivalTime(*new_nframe);
+  if (arrival_time_ns >= 0) {
+    latency_stats_.AddSample(
+        aslam::time::nanoSecondsToSeconds(
+            aslam::time::nanoSecondsSinceEpoch() - arrival_time_ns) *
+        kSecondsToMilliSeconds);
+  }
+
+  const std::shared_ptr<const NFrameCallbackList> callbacks =
+      std::atomic_load(&nframe_callbacks_);
+  for (const NFrameCallback& callback : *callbacks) {
+    callback(new_imu_nframe_measurement);
+  }
+  return true;
 }
 
 void ImuCameraSynchronizer::registerSynchronizedNFrameImuCallback(
     const std::function<void(const vio::SynchronizedNFrameImu::Ptr&)>&
         callback) {
-  std::lock_guard<std::mutex> lock(m_nframe_callbacks_);
   CHECK(callback);
-  nframe_callbacks_.push_back(callback);
+  std::lock_guard<std::mutex> lock(m_nframe_callbacks_registration_);
+  std::shared_ptr<NFrameCallbackList> callbacks =
+      std::make_shared<NFrameCallbackList>(*nframe_callbacks_);
+  callbacks->push_back(callback);
+  std::atomic_store(
+      &nframe_callbacks_,
+      std::shared_ptr<const NFrameCallbackList>(std::move(callbacks)));
 }
 
 void ImuCameraSynchronizer::shutdown() {
   shutdown_ = true;
   visual_pipeline_->shutdown();
   imu_buffer_->shutdown();
+  {
+    // Release the processing thread and any caller of waitUntilIdle().
+    std::lock_guard<std::mutex> lock(m_idle_);
+  }
+  cv_imu_data_.notify_all();
+  cv_idle_.notify_all();
   if (process_thread_.joinable()) {
     process_thread_.join();
   }
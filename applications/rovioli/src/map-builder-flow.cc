@@ -6,6 +6,7 @@
 #include <localization-summary-map/localization-summary-map-creation.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <maplab-common/file-logger.h>
+#include <maplab-common/file-system-tools.h>
 #include <maplab-common/map-manager-config.h>
 #include <mapping-workflows-plugin/localization-map-creation.h>
 #include <vi-map-helpers/vi-map-landmark-quality-evaluation.h>
@@ -17,6 +18,11 @@
 DEFINE_double(
     localization_map_keep_landmark_fraction, 0.0,
     "Fraction of landmarks to keep when creating a localization summary map.");
+DEFINE_double(
+    rovioli_map_checkpoint_interval_s, 0.0,
+    "If larger than zero, the finished part of the map is periodically "
+    "written to the map folder while mapping, such that at most the data of "
+    "one interval is lost on a crash. This also speeds up the final save.");
 DECLARE_bool(rovioli_visualize_map);
 
 namespace rovioli {
@@ -30,6 +36,14 @@ MapBuilderFlow::MapBuilderFlow(
   if (!save_map_folder.empty()) {
     VLOG(1) << "Set VIMap folder to: " << save_map_folder;
     map_with_mutex_->vi_map.setMapFolder(save_map_folder);
+
+    if (FLAGS_rovioli_map_checkpoint_interval_s > 0.0) {
+      map_checkpointer_.reset(
+          new MapCheckpointer(
+              save_map_folder, FLAGS_rovioli_map_checkpoint_interval_s,
+              map_with_mutex_));
+      map_checkpointer_->start();
+    }
   }
 }
 
@@ -93,6 +107,12 @@ void MapBuilderFlow::saveMapAndOptionallyOptimize(
   CHECK(!path.empty());
   CHECK(map_with_mutex_);
 
+  if (map_checkpointer_) {
+    // Needs to happen before locking the map as a running checkpoint might
+    // wait for the map mutex.
+    map_checkpointer_->stop();
+  }
+
   std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
   mapping_terminated_ = true;
 
@@ -125,8 +145,21 @@ void MapBuilderFlow::saveMapAndOptionallyOptimize(
 
   backend::SaveConfig save_config;
   save_config.overwrite_existing_files = overwrite_existing_map;
-  vi_map::serialization::saveMapToFolder(
-      path, save_config, &map_with_mutex_->vi_map);
+  if (map_checkpointer_ &&
+      common::isSamePath(path, map_checkpointer_->getMapFolder())) {
+    // Only the parts of the map that changed since the last checkpoint are
+    // written.
+    if (!map_checkpointer_->saveFinalMap(save_config)) {
+      LOG(ERROR) << "Saving the map to " << path << " failed.";
+      return;
+    }
+  } else {
+    if (map_checkpointer_) {
+      map_with_mutex_->vi_map.disableModificationTracking();
+    }
+    vi_map::serialization::saveMapToFolder(
+        path, save_config, &map_with_mutex_->vi_map);
+  }
   LOG(INFO) << "Raw VI-map saved to: " << path;
 
   if (process_to_localization_map) {
@@ -0,0 +1,604 @@
+#include "rovioli/map-checkpointer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>  // NOLINT
+#include <sstream>  // NOLINT
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <glog/logging.h>
+#include <map-resources/resource-map-serialization.h>
+#include <map-resources/resource_info_map.pb.h>
+#include <map-resources/resource_metadata.pb.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/map-manager-config.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/proto-serialization-helper.h>
+#include <maplab-common/threading-helpers.h>
+#include <vi-map/vi-map-serialization.h>
+#include <yaml-cpp/yaml.h>
+
+namespace rovioli {
+namespace {
+
+// The tracker still modifies the most recent nframes, hence the newest
+// vertices are only written once newer vertices have been added.
+constexpr size_t kNumUnfinishedVertices = 2u;
+
+constexpr char kTemporaryFileSuffix[] = ".tmp";
+
+std::string getChunkFileName(
+    const std::string& base_file_name, const size_t checkpoint_index,
+    const size_t chunk_index) {
+  return base_file_name + "_" + std::to_string(checkpoint_index) + "_" +
+         std::to_string(chunk_index);
+}
+
+// Splits the ids into chunks that do not exceed the maximum proto size and
+// names the chunk files after the checkpoint.
+template <typename IdType>
+void splitIntoNamedChunks(
+    const std::vector<IdType>& ids, const size_t chunk_size,
+    const std::string& base_file_name, const size_t checkpoint_index,
+    std::vector<std::vector<IdType>>* chunks,
+    std::vector<std::string>* file_names) {
+  CHECK_NOTNULL(chunks)->clear();
+  CHECK_NOTNULL(file_names)->clear();
+  CHECK_GT(chunk_size, 0u);
+  for (size_t start_idx = 0u; start_idx < ids.size(); start_idx += chunk_size) {
+    const size_t end_idx = std::min(ids.size(), start_idx + chunk_size);
+    file_names->emplace_back(
+        getChunkFileName(base_file_name, checkpoint_index, chunks->size()));
+    chunks->emplace_back(ids.begin() + start_idx, ids.begin() + end_idx);
+  }
+}
+
+// Splits the chunk metadata into the entries that are kept and the ones of
+// the outdated chunk files.
+void splitOutdatedChunkMetadata(
+    const vi_map::serialization::VIMapMetadata& chunk_metadata,
+    const std::unordered_set<std::string>& outdated_vertex_chunks,
+    const std::unordered_set<std::string>& outdated_edge_chunks,
+    vi_map::serialization::VIMapMetadata* kept_metadata,
+    vi_map::serialization::VIMapMetadata* outdated_metadata) {
+  CHECK_NOTNULL(kept_metadata)->clear();
+  CHECK_NOTNULL(outdated_metadata)->clear();
+  for (const vi_map::serialization::VIMapMetadata::value_type& entry :
+       chunk_metadata) {
+    const bool is_outdated =
+        (entry.first == vi_map::serialization::VIMapFileType::kVertices &&
+         outdated_vertex_chunks.count(entry.second) > 0u) ||
+        (entry.first == vi_map::serialization::VIMapFileType::kEdges &&
+         outdated_edge_chunks.count(entry.second) > 0u);
+    if (is_outdated) {
+      outdated_metadata->insert(entry);
+    } else {
+      kept_metadata->insert(entry);
+    }
+  }
+}
+
+// Moves <file_path>.tmp to <file_path>. Files with fixed names are written to
+// the temporary file first, such that they are replaced completely or not at
+// all.
+bool renameTemporaryFile(const std::string& file_path) {
+  const std::string temporary_file_path = file_path + kTemporaryFileSuffix;
+  if (std::rename(temporary_file_path.c_str(), file_path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to move " << temporary_file_path << " to "
+               << file_path << ".";
+    return false;
+  }
+  return true;
+}
+
+bool serializeProtoToFileAtomically(
+    const std::string& folder_path, const std::string& file_name,
+    const google::protobuf::Message& proto, const bool use_text_format) {
+  if (!common::proto_serialization_helper::serializeProtoToFile(
+          folder_path, file_name + kTemporaryFileSuffix, proto,
+          use_text_format)) {
+    return false;
+  }
+  return renameTemporaryFile(
+      common::concatenateFolderAndFileName(folder_path, file_name));
+}
+
+}  // namespace
+
+MapCheckpointer::MapCheckpointer(
+    const std::string& map_folder, const double checkpoint_interval_s,
+    const VIMapWithMutex::Ptr& map_with_mutex)
+    : map_folder_(map_folder),
+      vi_map_folder_(
+          common::concatenateFolderAndFileName(
+              map_folder, vi_map::serialization::getSubFolderName())),
+      checkpoint_interval_s_(checkpoint_interval_s),
+      map_with_mutex_(map_with_mutex),
+      shutdown_requested_(false),
+      num_checkpoints_(0u),
+      num_vertices_checkpointed_(0u) {
+  CHECK(!map_folder_.empty());
+  CHECK_GT(checkpoint_interval_s_, 0.0);
+  CHECK(map_with_mutex_);
+}
+
+MapCheckpointer::~MapCheckpointer() {
+  stop();
+}
+
+void MapCheckpointer::start() {
+  CHECK(!checkpoint_thread_.joinable());
+  CHECK(common::createPath(vi_map_folder_))
+      << "Could not create the map folder " << vi_map_folder_;
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    map_with_mutex_->vi_map.enableModificationTracking();
+  }
+  checkpoint_thread_ =
+      std::thread(&MapCheckpointer::checkpointWorker, this);
+}
+
+void MapCheckpointer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_shutdown_);
+    shutdown_requested_ = true;
+  }
+  cv_shutdown_.notify_all();
+  if (checkpoint_thread_.joinable()) {
+    checkpoint_thread_.join();
+  }
+}
+
+void MapCheckpointer::checkpointWorker() {
+  const std::chrono::duration<double> checkpoint_interval(
+      checkpoint_interval_s_);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_shutdown_);
+      if (cv_shutdown_.wait_for(
+              lock, checkpoint_interval, [this]() {
+                return shutdown_requested_;
+              })) {
+        return;
+      }
+    }
+    const std::chrono::steady_clock::time_point time_start =
+        std::chrono::steady_clock::now();
+    const size_t num_checkpoints_before = num_checkpoints_;
+    if (!writeCheckpoint()) {
+      LOG(ERROR) << "Writing the map checkpoint to " << map_folder_
+                 << " failed.";
+      continue;
+    }
+    VLOG_IF(1, num_checkpoints_ != num_checkpoints_before)
+        << "Wrote map checkpoint " << num_checkpoints_ << " with "
+        << num_vertices_checkpointed_ << " vertices in "
+        << std::chrono::duration<double>(
+               std::chrono::steady_clock::now() - time_start)
+               .count()
+        << " s.";
+  }
+}
+
+bool MapCheckpointer::writeCheckpoint() {
+  const size_t checkpoint_index = num_checkpoints_;
+  NamedProtoList protos;
+  MapWideFiles map_wide_files;
+  metadata::proto::MetaData resource_metadata_proto;
+  resource_info::proto::ResourceInfoMap resource_info_proto;
+  vi_map::serialization::VIMapMetadata new_chunk_metadata;
+  vi_map::serialization::VIMapMetadata new_map_wide_metadata;
+  std::unordered_set<std::string> outdated_vertex_chunks;
+  std::unordered_set<std::string> outdated_edge_chunks;
+  std::vector<pose_graph::VertexIdList> vertex_chunks;
+  std::vector<std::string> vertex_chunk_file_names;
+  std::vector<pose_graph::EdgeIdList> edge_chunks;
+  std::vector<std::string> edge_chunk_file_names;
+  size_t num_vertices_finished;
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    const vi_map::VIMap& map = map_with_mutex_->vi_map;
+    takeModifiedChunks();
+    vi_map::MissionIdList mission_ids;
+    map.getAllMissionIds(&mission_ids);
+    if (mission_ids.empty()) {
+      return true;
+    }
+    // The map builder only ever adds a single mission.
+    CHECK_EQ(mission_ids.size(), 1u);
+
+    // The chunks with modified or removed vertices and edges are replaced.
+    // Their remaining entities are written again by this checkpoint.
+    pose_graph::VertexIdList vertex_ids_to_write;
+    vertex_chunk_files_.getModifiedChunks(
+        [&map](const pose_graph::VertexId& vertex_id) {
+          return map.hasVertex(vertex_id);
+        },
+        &outdated_vertex_chunks, &vertex_ids_to_write);
+    pose_graph::EdgeIdList edge_ids_to_write;
+    edge_chunk_files_.getModifiedChunks(
+        [&map](const pose_graph::EdgeId& edge_id) {
+          return map.hasEdge(edge_id);
+        },
+        &outdated_edge_chunks, &edge_ids_to_write);
+
+    pose_graph::VertexIdList vertex_ids;
+    map.getAllVertexIdsInMissionAlongGraph(mission_ids.front(), &vertex_ids);
+    num_vertices_finished = num_vertices_checkpointed_;
+    if (vertex_ids.size() >
+        num_vertices_checkpointed_ + kNumUnfinishedVertices) {
+      num_vertices_finished = vertex_ids.size() - kNumUnfinishedVertices;
+    }
+    if (num_vertices_finished == num_vertices_checkpointed_ &&
+        outdated_vertex_chunks.empty() && outdated_edge_chunks.empty()) {
+      // Nothing new to write.
+      return true;
+    }
+
+    // Each edge is written together with the vertex it points to. The source
+    // vertex of such an edge is always older and therefore finished as well.
+    for (size_t vertex_idx = num_vertices_checkpointed_;
+         vertex_idx < num_vertices_finished; ++vertex_idx) {
+      const pose_graph::VertexId& vertex_id = vertex_ids[vertex_idx];
+      vertex_ids_to_write.emplace_back(vertex_id);
+      pose_graph::EdgeIdSet incoming_edges;
+      map.getVertex(vertex_id).getIncomingEdges(&incoming_edges);
+      for (const pose_graph::EdgeId& edge_id : incoming_edges) {
+        if (!edge_chunk_files_.contains(edge_id)) {
+          edge_ids_to_write.emplace_back(edge_id);
+        }
+      }
+    }
+
+    splitIntoNamedChunks(
+        vertex_ids_to_write, backend::SaveConfig::kVerticesPerProtoFile,
+        vi_map::serialization::internal::kFileNameVertices, checkpoint_index,
+        &vertex_chunks, &vertex_chunk_file_names);
+    for (size_t chunk_idx = 0u; chunk_idx < vertex_chunks.size();
+         ++chunk_idx) {
+      protos.emplace_back(
+          vertex_chunk_file_names[chunk_idx], vi_map::proto::VIMap());
+      vi_map::serialization::serializeVertices(
+          map, vertex_chunks[chunk_idx], &protos.back().second);
+      new_chunk_metadata.emplace(
+          vi_map::serialization::VIMapFileType::kVertices,
+          vertex_chunk_file_names[chunk_idx]);
+    }
+
+    splitIntoNamedChunks(
+        edge_ids_to_write, backend::SaveConfig::kEdgesPerProtoFile,
+        vi_map::serialization::internal::kFileNameEdges, checkpoint_index,
+        &edge_chunks, &edge_chunk_file_names);
+    for (size_t chunk_idx = 0u; chunk_idx < edge_chunks.size(); ++chunk_idx) {
+      protos.emplace_back(
+          edge_chunk_file_names[chunk_idx], vi_map::proto::VIMap());
+      vi_map::serialization::serializeEdges(
+          map, edge_chunks[chunk_idx], &protos.back().second);
+      new_chunk_metadata.emplace(
+          vi_map::serialization::VIMapFileType::kEdges,
+          edge_chunk_file_names[chunk_idx]);
+    }
+
+    serializeMapWideFiles(
+        checkpoint_index, &map_wide_files, &new_map_wide_metadata);
+    map.serializeMetaData(&resource_metadata_proto);
+    map.serializeResourceInfo(&resource_info_proto);
+  }
+
+  // The mapping continues while the files are written.
+  constexpr bool kResourceMetadataIsTextFormat = true;
+  if (!writeProtos(protos) || !writeMapWideFiles(map_wide_files) ||
+      !serializeProtoToFileAtomically(
+          map_folder_,
+          backend::resource_map_serialization::internal::kFileNameMapMetadata,
+          resource_metadata_proto, kResourceMetadataIsTextFormat) ||
+      !serializeProtoToFileAtomically(
+          map_folder_,
+          backend::resource_map_serialization::internal::kFileNameResourceInfo,
+          resource_info_proto, !kResourceMetadataIsTextFormat)) {
+    return false;
+  }
+
+  vi_map::serialization::VIMapMetadata chunk_metadata;
+  vi_map::serialization::VIMapMetadata outdated_metadata;
+  splitOutdatedChunkMetadata(
+      chunk_metadata_, outdated_vertex_chunks, outdated_edge_chunks,
+      &chunk_metadata, &outdated_metadata);
+  chunk_metadata.insert(new_chunk_metadata.begin(), new_chunk_metadata.end());
+  vi_map::serialization::VIMapMetadata metadata = chunk_metadata;
+  metadata.insert(new_map_wide_metadata.begin(), new_map_wide_metadata.end());
+  if (!commitMetadata(metadata)) {
+    return false;
+  }
+
+  // The checkpoint is complete, the files of the previous one and the
+  // replaced chunks are obsolete.
+  removeFiles(map_wide_metadata_);
+  removeFiles(outdated_metadata);
+  map_wide_metadata_.swap(new_map_wide_metadata);
+  chunk_metadata_.swap(chunk_metadata);
+  vertex_chunk_files_.replaceChunks(
+      outdated_vertex_chunks, vertex_chunk_file_names, &vertex_chunks);
+  edge_chunk_files_.replaceChunks(
+      outdated_edge_chunks, edge_chunk_file_names, &edge_chunks);
+  num_vertices_checkpointed_ = num_vertices_finished;
+  ++num_checkpoints_;
+  return true;
+}
+
+bool MapCheckpointer::saveFinalMap(const backend::SaveConfig& save_config) {
+  CHECK(!checkpoint_thread_.joinable())
+      << "Stop the checkpointing before saving the final map.";
+  const size_t checkpoint_index = num_checkpoints_;
+  vi_map::VIMap* map = &map_with_mutex_->vi_map;
+  CHECK(common::createPath(vi_map_folder_));
+  takeModifiedChunks();
+
+  MapWideFiles map_wide_files;
+  vi_map::serialization::VIMapMetadata new_map_wide_metadata;
+  serializeMapWideFiles(
+      checkpoint_index, &map_wide_files, &new_map_wide_metadata);
+
+  // Chunks with modified or removed vertices and edges are replaced. Their
+  // remaining entities are rewritten together with the ones that are not
+  // part of any checkpoint yet.
+  const CheckpointChunkFiles<pose_graph::VertexId>::ExistsFunction
+      vertex_exists = [map](const pose_graph::VertexId& vertex_id) {
+        return map->hasVertex(vertex_id);
+      };
+  const CheckpointChunkFiles<pose_graph::EdgeId>::ExistsFunction edge_exists =
+      [map](const pose_graph::EdgeId& edge_id) {
+        return map->hasEdge(edge_id);
+      };
+  vertex_chunk_files_.markChunksWithRemovedIds(vertex_exists);
+  edge_chunk_files_.markChunksWithRemovedIds(edge_exists);
+  std::unordered_set<std::string> outdated_vertex_chunks;
+  pose_graph::VertexIdList vertex_ids_to_write;
+  vertex_chunk_files_.getModifiedChunks(
+      vertex_exists, &outdated_vertex_chunks, &vertex_ids_to_write);
+  std::unordered_set<std::string> outdated_edge_chunks;
+  pose_graph::EdgeIdList edge_ids_to_write;
+  edge_chunk_files_.getModifiedChunks(
+      edge_exists, &outdated_edge_chunks, &edge_ids_to_write);
+
+  pose_graph::VertexIdList all_vertex_ids;
+  map->getAllVertexIds(&all_vertex_ids);
+  for (const pose_graph::VertexId& vertex_id : all_vertex_ids) {
+    if (!vertex_chunk_files_.contains(vertex_id)) {
+      vertex_ids_to_write.emplace_back(vertex_id);
+    }
+  }
+  pose_graph::EdgeIdList all_edge_ids;
+  map->getAllEdgeIds(&all_edge_ids);
+  for (const pose_graph::EdgeId& edge_id : all_edge_ids) {
+    if (!edge_chunk_files_.contains(edge_id)) {
+      edge_ids_to_write.emplace_back(edge_id);
+    }
+  }
+
+  std::vector<pose_graph::VertexIdList> vertex_chunks;
+  std::vector<std::string> vertex_chunk_file_names;
+  splitIntoNamedChunks(
+      vertex_ids_to_write, backend::SaveConfig::kVerticesPerProtoFile,
+      vi_map::serialization::internal::kFileNameVertices, checkpoint_index,
+      &vertex_chunks, &vertex_chunk_file_names);
+  std::vector<pose_graph::EdgeIdList> edge_chunks;
+  std::vector<std::string> edge_chunk_file_names;
+  splitIntoNamedChunks(
+      edge_ids_to_write, backend::SaveConfig::kEdgesPerProtoFile,
+      vi_map::serialization::internal::kFileNameEdges, checkpoint_index,
+      &edge_chunks, &edge_chunk_file_names);
+
+  vi_map::serialization::VIMapMetadata chunk_metadata;
+  vi_map::serialization::VIMapMetadata outdated_metadata;
+  splitOutdatedChunkMetadata(
+      chunk_metadata_, outdated_vertex_chunks, outdated_edge_chunks,
+      &chunk_metadata, &outdated_metadata);
+  for (const std::string& file_name : vertex_chunk_file_names) {
+    chunk_metadata.emplace(
+        vi_map::serialization::VIMapFileType::kVertices, file_name);
+  }
+  for (const std::string& file_name : edge_chunk_file_names) {
+    chunk_metadata.emplace(
+        vi_map::serialization::VIMapFileType::kEdges, file_name);
+  }
+  vi_map::serialization::VIMapMetadata metadata = chunk_metadata;
+  metadata.insert(new_map_wide_metadata.begin(), new_map_wide_metadata.end());
+
+  if (!save_config.overwrite_existing_files) {
+    // The files of the checkpoints are replaced, but none of the files that
+    // are new to the map may exist already.
+    std::vector<std::string> new_file_names;
+    for (const vi_map::serialization::VIMapMetadata::value_type& entry :
+         new_map_wide_metadata) {
+      new_file_names.emplace_back(entry.second);
+    }
+    new_file_names.insert(
+        new_file_names.end(), vertex_chunk_file_names.begin(),
+        vertex_chunk_file_names.end());
+    new_file_names.insert(
+        new_file_names.end(), edge_chunk_file_names.begin(),
+        edge_chunk_file_names.end());
+    for (const std::string& file_name : new_file_names) {
+      if (common::fileExists(
+              common::concatenateFolderAndFileName(
+                  vi_map_folder_, file_name))) {
+        LOG(ERROR) << "Map can't be saved because the file " << file_name
+                   << " would be overwritten.";
+        return false;
+      }
+    }
+  }
+
+  // Serialize and write the chunks in parallel, the map is not modified
+  // anymore at this point.
+  std::atomic<bool> success(writeMapWideFiles(map_wide_files));
+  const size_t num_chunks = vertex_chunks.size() + edge_chunks.size();
+  constexpr bool kAlwaysParallelize = true;
+  common::ParallelProcess(
+      num_chunks,
+      [&](const std::vector<size_t>& range) {
+        vi_map::proto::VIMap proto;
+        for (const size_t chunk_idx : range) {
+          proto.Clear();
+          std::string file_name;
+          if (chunk_idx < vertex_chunks.size()) {
+            vi_map::serialization::serializeVertices(
+                *map, vertex_chunks[chunk_idx], &proto);
+            file_name = vertex_chunk_file_names[chunk_idx];
+          } else {
+            const size_t edge_chunk_idx = chunk_idx - vertex_chunks.size();
+            vi_map::serialization::serializeEdges(
+                *map, edge_chunks[edge_chunk_idx], &proto);
+            file_name = edge_chunk_file_names[edge_chunk_idx];
+          }
+          if (!common::proto_serialization_helper::serializeProtoToFile(
+                  vi_map_folder_, file_name, proto)) {
+            success = false;
+          }
+        }
+      },
+      kAlwaysParallelize, common::getNumHardwareThreads());
+  if (!success ||
+      !backend::resource_map_serialization::saveMapToFolder(
+          map_folder_, save_config, map) ||
+      !commitMetadata(metadata)) {
+    return false;
+  }
+
+  removeFiles(outdated_metadata);
+  removeFiles(map_wide_metadata_);
+  map_wide_metadata_.swap(new_map_wide_metadata);
+  LOG(INFO) << "Saved map in \"" << map_folder_ << "\", reused "
+            << all_vertex_ids.size() - vertex_ids_to_write.size()
+            << " vertices and "
+            << all_edge_ids.size() - edge_ids_to_write.size()
+            << " edges of " << num_checkpoints_ << " checkpoints.";
+
+  // The saved map is the new checkpoint.
+  chunk_metadata_.swap(chunk_metadata);
+  vertex_chunk_files_.replaceChunks(
+      outdated_vertex_chunks, vertex_chunk_file_names, &vertex_chunks);
+  edge_chunk_files_.replaceChunks(
+      outdated_edge_chunks, edge_chunk_file_names, &edge_chunks);
+  num_vertices_checkpointed_ = all_vertex_ids.size();
+  ++num_checkpoints_;
+  map->disableModificationTracking();
+  return true;
+}
+
+void MapCheckpointer::serializeMapWideFiles(
+    const size_t checkpoint_index, MapWideFiles* files,
+    vi_map::serialization::VIMapMetadata* metadata) const {
+  CHECK_NOTNULL(files);
+  CHECK_NOTNULL(metadata);
+  const vi_map::VIMap& map = map_with_mutex_->vi_map;
+  NamedProtoList* protos = &files->protos;
+
+  const std::string missions_file_name =
+      std::string(vi_map::serialization::internal::kFileNameMissions) + "_" +
+      std::to_string(checkpoint_index);
+  protos->emplace_back(missions_file_name, vi_map::proto::VIMap());
+  vi_map::serialization::serializeMissionsAndBaseframes(
+      map, &protos->back().second);
+  metadata->emplace(
+      vi_map::serialization::VIMapFileType::kMissions, missions_file_name);
+
+  const std::string landmark_index_file_name =
+      std::string(vi_map::serialization::internal::kFileNameLandmarkIndex) +
+      "_" + std::to_string(checkpoint_index);
+  protos->emplace_back(landmark_index_file_name, vi_map::proto::VIMap());
+  vi_map::serialization::serializeLandmarkIndex(map, &protos->back().second);
+  metadata->emplace(
+      vi_map::serialization::VIMapFileType::kLandmarkIndex,
+      landmark_index_file_name);
+
+  const std::string optional_sensor_data_file_name =
+      std::string(
+          vi_map::serialization::internal::kFileNameOptionalSensorData) +
+      "_" + std::to_string(checkpoint_index);
+  protos->emplace_back(optional_sensor_data_file_name, vi_map::proto::VIMap());
+  vi_map::serialization::serializeOptionalSensorData(
+      map, &protos->back().second);
+  metadata->emplace(
+      vi_map::serialization::VIMapFileType::kOptionalSensorData,
+      optional_sensor_data_file_name);
+
+  YAML::Node sensors_yaml_node;
+  map.getSensorManager().serialize(&sensors_yaml_node);
+  std::ostringstream sensors_yaml_stream;
+  sensors_yaml_stream << sensors_yaml_node;
+  files->sensors_yaml = sensors_yaml_stream.str();
+}
+
+bool MapCheckpointer::writeMapWideFiles(const MapWideFiles& files) const {
+  if (!writeProtos(files.protos)) {
+    return false;
+  }
+  // The sensors have a fixed file name and are replaced atomically.
+  const std::string sensors_file_path = common::concatenateFolderAndFileName(
+      vi_map_folder_, vi_map::serialization::internal::kYamlSensorsFilename);
+  std::ofstream sensors_file(sensors_file_path + kTemporaryFileSuffix);
+  sensors_file << files.sensors_yaml;
+  sensors_file.close();
+  if (!sensors_file) {
+    LOG(ERROR) << "Failed to write " << sensors_file_path
+               << kTemporaryFileSuffix << ".";
+    return false;
+  }
+  return renameTemporaryFile(sensors_file_path);
+}
+
+void MapCheckpointer::takeModifiedChunks() {
+  vi_map::VIMap::ModifiedEntities modified_entities;
+  map_with_mutex_->vi_map.takeModifiedEntities(&modified_entities);
+  if (modified_entities.all) {
+    vertex_chunk_files_.markAllModified();
+    edge_chunk_files_.markAllModified();
+    return;
+  }
+  for (const pose_graph::VertexId& vertex_id : modified_entities.vertex_ids) {
+    vertex_chunk_files_.markModified(vertex_id);
+  }
+  for (const pose_graph::EdgeId& edge_id : modified_entities.edge_ids) {
+    edge_chunk_files_.markModified(edge_id);
+  }
+}
+
+bool MapCheckpointer::writeProtos(const NamedProtoList& protos) const {
+  for (const NamedProtoList::value_type& file_name_with_proto : protos) {
+    if (!common::proto_serialization_helper::serializeProtoToFile(
+            vi_map_folder_, file_name_with_proto.first,
+            file_name_with_proto.second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MapCheckpointer::commitMetadata(
+    const vi_map::serialization::VIMapMetadata& metadata) const {
+  vi_map::proto::VIMapMetadata metadata_proto;
+  vi_map::serialization::serializeMetadata(metadata, &metadata_proto);
+  constexpr bool kIsTextFormat = true;
+  return serializeProtoToFileAtomically(
+      vi_map_folder_, vi_map::serialization::internal::kFileNameMetadata,
+      metadata_proto, kIsTextFormat);
+}
+
+void MapCheckpointer::removeFiles(
+    const vi_map::serialization::VIMapMetadata& metadata) const {
+  for (const vi_map::serialization::VIMapMetadata::value_type& entry :
+       metadata) {
+    const std::string file_path =
+        common::concatenateFolderAndFileName(vi_map_folder_, entry.second);
+    LOG_IF(WARNING, !common::deleteFile(file_path))
+        << "Could not remove the outdated map file " << file_path;
+  }
+}
+
+}  // namespace rovioli
@@ -84,6 +84,22 @@ RovioliNode::RovioliNode(
     map_builder_flow_->attachToMessageFlow(flow);
   }
 
+  if (datasource_flow_->isLockstepPlaybackEnabled()) {
+    // The synchronizer is the only node with its own processing threads, all
+    // other nodes run in the message flow dispatcher.
+    if (synchronizer_flow_) {
+      synchronizer_flow_->enableLockstepMode();
+    }
+    datasource_flow_->setWaitUntilIdleFunction([this, flow]() {
+      flow->waitUntilIdle();
+      if (synchronizer_flow_) {
+        synchronizer_flow_->waitUntilIdle();
+        // Wait for the nodes consuming the synchronized nframes.
+        flow->waitUntilIdle();
+      }
+    });
+  }
+
   // Subscribe to end of days signal from the datasource.
   datasource_flow_->registerEndOfDataCallback(
       [&]() { is_datasource_exhausted_.store(true); });
@@ -0,0 +1,132 @@
+#include "rovioli/synchronized-nframe-imu-pool.h"
+
+#include <utility>
+
+#include <glog/logging.h>
+
+namespace rovioli {
+
+SynchronizedNFrameImuPool::Ptr SynchronizedNFrameImuPool::create(
+    const size_t num_preallocated_messages) {
+  return Ptr(new SynchronizedNFrameImuPool(num_preallocated_messages));
+}
+
+SynchronizedNFrameImuPool::SynchronizedNFrameImuPool(
+    const size_t num_preallocated_messages)
+    : num_allocated_messages_(num_preallocated_messages),
+      control_block_arena_(
+          std::make_shared<ControlBlockArena>(num_preallocated_messages)) {
+  available_messages_.reserve(num_preallocated_messages);
+  for (size_t i = 0u; i < num_preallocated_messages; ++i) {
+    available_messages_.emplace_back(new vio::SynchronizedNFrameImu);
+  }
+}
+
+vio::SynchronizedNFrameImu::Ptr SynchronizedNFrameImuPool::acquire() {
+  MessageUniquePtr message;
+  {
+    std::lock_guard<std::mutex> lock(m_available_messages_);
+    if (!available_messages_.empty()) {
+      message = std::move(available_messages_.back());
+      available_messages_.pop_back();
+    } else {
+      ++num_allocated_messages_;
+    }
+  }
+  if (!message) {
+    VLOG(3) << "All synchronized nframe messages are in use, allocating a new "
+            << "one.";
+    message.reset(new vio::SynchronizedNFrameImu);
+  }
+  const std::weak_ptr<SynchronizedNFrameImuPool> pool = shared_from_this();
+  return vio::SynchronizedNFrameImu::Ptr(
+      message.release(),
+      [pool](vio::SynchronizedNFrameImu* released_message) {
+        release(pool, released_message);
+      },
+      ControlBlockAllocator<vio::SynchronizedNFrameImu>(control_block_arena_));
+}
+
+size_t SynchronizedNFrameImuPool::getNumAvailableMessages() const {
+  std::lock_guard<std::mutex> lock(m_available_messages_);
+  return available_messages_.size();
+}
+
+size_t SynchronizedNFrameImuPool::getNumAllocatedMessages() const {
+  std::lock_guard<std::mutex> lock(m_available_messages_);
+  return num_allocated_messages_;
+}
+
+size_t SynchronizedNFrameImuPool::getNumAllocatedControlBlocks() const {
+  return control_block_arena_->getNumAllocatedBlocks();
+}
+
+void SynchronizedNFrameImuPool::release(
+    const std::weak_ptr<SynchronizedNFrameImuPool>& pool,
+    vio::SynchronizedNFrameImu* message) {
+  CHECK_NOTNULL(message);
+  MessageUniquePtr message_ptr(message);
+  const Ptr locked_pool = pool.lock();
+  if (!locked_pool) {
+    return;
+  }
+  // The nframe is usually kept alive by the map, the pool must not extend its
+  // lifetime.
+  message_ptr->nframe.reset();
+  message_ptr->motion_wrt_last_nframe = vio::MotionType::kInvalid;
+
+  std::lock_guard<std::mutex> lock(locked_pool->m_available_messages_);
+  locked_pool->available_messages_.emplace_back(std::move(message_ptr));
+}
+
+SynchronizedNFrameImuPool::ControlBlockArena::ControlBlockArena(
+    const size_t num_expected_blocks)
+    : block_size_(0u), num_allocated_blocks_(0u) {
+  free_blocks_.reserve(num_expected_blocks);
+}
+
+SynchronizedNFrameImuPool::ControlBlockArena::~ControlBlockArena() {
+  for (void* block : free_blocks_) {
+    ::operator delete(block);
+  }
+}
+
+void* SynchronizedNFrameImuPool::ControlBlockArena::allocate(
+    const size_t num_bytes) {
+  {
+    std::lock_guard<std::mutex> lock(m_free_blocks_);
+    if (block_size_ == 0u) {
+      block_size_ = num_bytes;
+    }
+    if (num_bytes == block_size_) {
+      if (!free_blocks_.empty()) {
+        void* block = free_blocks_.back();
+        free_blocks_.pop_back();
+        return block;
+      }
+      ++num_allocated_blocks_;
+    }
+  }
+  return ::operator new(num_bytes);
+}
+
+void SynchronizedNFrameImuPool::ControlBlockArena::deallocate(
+    void* block, const size_t num_bytes) {
+  CHECK_NOTNULL(block);
+  {
+    std::lock_guard<std::mutex> lock(m_free_blocks_);
+    if (num_bytes == block_size_) {
+      free_blocks_.emplace_back(block);
+      return;
+    }
+  }
+  ::operator delete(block);
+}
+
+size_t SynchronizedNFrameImuPool::ControlBlockArena::getNumAllocatedBlocks()
+    const {
+  std::lock_guard<std::mutex> lock(m_free_blocks_);
+  return num_allocated_blocks_;
+}
+
+}  // namespace rovioli
@@ -0,0 +1,198 @@
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/map-manager-config.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/test/vi-map-generator.h>
+#include <vi-map/vi-map-serialization.h>
+#include <vi-map/vi-map.h>
+
+#include "rovioli/map-checkpointer.h"
+#include "rovioli/vi-map-with-mutex.h"
+
+namespace rovioli {
+
+class MapCheckpointerTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kNumVertices = 10u;
+  static constexpr char kMapFolder[] = "./map_checkpointer_test_map";
+
+  virtual void SetUp() {
+    common::removePath(kMapFolder);
+    map_with_mutex_ = aligned_shared<VIMapWithMutex>();
+    vi_map::VIMapGenerator generator(map_with_mutex_->vi_map, 42);
+    const pose::Transformation T_G_M;
+    const vi_map::MissionId mission_id = generator.createMission(T_G_M);
+    for (size_t vertex_idx = 0u; vertex_idx < kNumVertices; ++vertex_idx) {
+      pose::Transformation T_M_I;
+      T_M_I.getPosition() << vertex_idx, 0.0, 0.0;
+      generator.createVertex(mission_id, T_M_I);
+    }
+    generator.generateMap();
+  }
+
+  virtual void TearDown() {
+    common::removePath(kMapFolder);
+  }
+
+  // Waits until the first checkpoint has been written.
+  bool waitForCheckpoint() const {
+    return waitForFile(vi_map::serialization::internal::kFileNameMetadata);
+  }
+
+  // Waits until a file exists in the VIMap folder of the map.
+  bool waitForFile(const std::string& file_name) const {
+    const std::string file_path = common::concatenateFolderAndFileName(
+        common::concatenateFolderAndFileName(
+            kMapFolder, vi_map::serialization::getSubFolderName()),
+        file_name);
+    constexpr size_t kMaxNumPolls = 500u;
+    for (size_t poll_idx = 0u; poll_idx < kMaxNumPolls; ++poll_idx) {
+      if (common::fileExists(file_path)) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  VIMapWithMutex::Ptr map_with_mutex_;
+};
+
+constexpr char MapCheckpointerTest::kMapFolder[];
+
+TEST_F(MapCheckpointerTest, CheckpointContainsFinishedVertices) {
+  constexpr double kCheckpointIntervalS = 0.01;
+  MapCheckpointer checkpointer(
+      kMapFolder, kCheckpointIntervalS, map_with_mutex_);
+  checkpointer.start();
+  ASSERT_TRUE(waitForCheckpoint());
+  checkpointer.stop();
+
+  // The two newest vertices are still being modified while mapping.
+  vi_map::VIMap checkpoint_map;
+  ASSERT_TRUE(
+      vi_map::serialization::loadMapFromFolder(kMapFolder, &checkpoint_map));
+  EXPECT_EQ(checkpoint_map.numMissions(), 1u);
+  EXPECT_EQ(checkpoint_map.numVertices(), kNumVertices - 2u);
+  EXPECT_EQ(checkpoint_map.numEdges(), kNumVertices - 3u);
+}
+
+TEST_F(MapCheckpointerTest, FinalMapIsComplete) {
+  constexpr double kCheckpointIntervalS = 0.01;
+  MapCheckpointer checkpointer(
+      kMapFolder, kCheckpointIntervalS, map_with_mutex_);
+  checkpointer.start();
+  ASSERT_TRUE(waitForCheckpoint());
+  checkpointer.stop();
+
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    backend::SaveConfig save_config;
+    save_config.overwrite_existing_files = false;
+    ASSERT_TRUE(checkpointer.saveFinalMap(save_config));
+  }
+
+  vi_map::VIMap final_map;
+  ASSERT_TRUE(vi_map::serialization::loadMapFromFolder(kMapFolder, &final_map));
+  EXPECT_EQ(final_map.numMissions(), 1u);
+  EXPECT_EQ(final_map.numVertices(), map_with_mutex_->vi_map.numVertices());
+  EXPECT_EQ(final_map.numEdges(), map_with_mutex_->vi_map.numEdges());
+  EXPECT_EQ(
+      final_map.numLandmarks(), map_with_mutex_->vi_map.numLandmarks());
+}
+
+TEST_F(MapCheckpointerTest, FinalMapContainsModifiedCheckpointedVertices) {
+  constexpr double kCheckpointIntervalS = 0.01;
+  MapCheckpointer checkpointer(
+      kMapFolder, kCheckpointIntervalS, map_with_mutex_);
+  checkpointer.start();
+  ASSERT_TRUE(waitForCheckpoint());
+  checkpointer.stop();
+
+  const Eigen::Vector3d p_M_I(1.0, 2.0, 3.0);
+  pose_graph::VertexId root_vertex_id;
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    vi_map::VIMap& map = map_with_mutex_->vi_map;
+    root_vertex_id =
+        map.getMission(map.getIdOfFirstMission()).getRootVertexId();
+    map.getVertex(root_vertex_id).set_p_M_I(p_M_I);
+    backend::SaveConfig save_config;
+    save_config.overwrite_existing_files = false;
+    ASSERT_TRUE(checkpointer.saveFinalMap(save_config));
+  }
+
+  vi_map::VIMap final_map;
+  ASSERT_TRUE(vi_map::serialization::loadMapFromFolder(kMapFolder, &final_map));
+  EXPECT_EQ(final_map.numVertices(), map_with_mutex_->vi_map.numVertices());
+  EXPECT_EQ(final_map.getVertex(root_vertex_id).get_p_M_I(), p_M_I);
+}
+
+TEST_F(MapCheckpointerTest, CheckpointRewritesModifiedVertices) {
+  constexpr double kCheckpointIntervalS = 0.01;
+  MapCheckpointer checkpointer(
+      kMapFolder, kCheckpointIntervalS, map_with_mutex_);
+  checkpointer.start();
+  ASSERT_TRUE(waitForCheckpoint());
+
+  const Eigen::Vector3d p_M_I(1.0, 2.0, 3.0);
+  pose_graph::VertexId root_vertex_id;
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    vi_map::VIMap& map = map_with_mutex_->vi_map;
+    root_vertex_id =
+        map.getMission(map.getIdOfFirstMission()).getRootVertexId();
+    map.getVertex(root_vertex_id).set_p_M_I(p_M_I);
+  }
+  // Only the modified vertex triggers the second checkpoint.
+  ASSERT_TRUE(
+      waitForFile(
+          std::string(vi_map::serialization::internal::kFileNameMissions) +
+          "_1"));
+  checkpointer.stop();
+
+  vi_map::VIMap checkpoint_map;
+  ASSERT_TRUE(
+      vi_map::serialization::loadMapFromFolder(kMapFolder, &checkpoint_map));
+  EXPECT_EQ(checkpoint_map.numVertices(), kNumVertices - 2u);
+  EXPECT_EQ(checkpoint_map.getVertex(root_vertex_id).get_p_M_I(), p_M_I);
+}
+
+TEST_F(MapCheckpointerTest, FinalMapDoesNotContainRemovedCheckpointedEdges) {
+  constexpr double kCheckpointIntervalS = 0.01;
+  MapCheckpointer checkpointer(
+      kMapFolder, kCheckpointIntervalS, map_with_mutex_);
+  checkpointer.start();
+  ASSERT_TRUE(waitForCheckpoint());
+  checkpointer.stop();
+
+  pose_graph::EdgeId removed_edge_id;
+  {
+    std::lock_guard<std::mutex> lock(map_with_mutex_->mutex);
+    vi_map::VIMap& map = map_with_mutex_->vi_map;
+    const pose_graph::VertexId& root_vertex_id =
+        map.getMission(map.getIdOfFirstMission()).getRootVertexId();
+    pose_graph::EdgeIdSet outgoing_edges;
+    map.getVertex(root_vertex_id).getOutgoingEdges(&outgoing_edges);
+    ASSERT_EQ(outgoing_edges.size(), 1u);
+    removed_edge_id = *outgoing_edges.begin();
+    map.removeEdge(removed_edge_id);
+    backend::SaveConfig save_config;
+    save_config.overwrite_existing_files = false;
+    ASSERT_TRUE(checkpointer.saveFinalMap(save_config));
+  }
+
+  vi_map::VIMap final_map;
+  ASSERT_TRUE(vi_map::serialization::loadMapFromFolder(kMapFolder, &final_map));
+  EXPECT_EQ(final_map.numEdges(), map_with_mutex_->vi_map.numEdges());
+  EXPECT_FALSE(final_map.hasEdge(removed_edge_id));
+}
+
+}  // namespace rovioli
+
+MAPLAB_UNITTEST_ENTRYPOINT
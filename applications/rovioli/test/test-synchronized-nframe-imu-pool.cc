@@ -0,0 +1,86 @@
+#include <Eigen/Core>
+#include <aslam/common/memory.h>
+#include <aslam/frames/visual-nframe.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vio-common/vio-types.h>
+
+#include "rovioli/synchronized-nframe-imu-pool.h"
+
+namespace rovioli {
+
+TEST(SynchronizedNFrameImuPoolTest, ReleasedMessagesAreReused) {
+  constexpr size_t kNumPreallocatedMessages = 2u;
+  SynchronizedNFrameImuPool::Ptr pool =
+      SynchronizedNFrameImuPool::create(kNumPreallocatedMessages);
+  EXPECT_EQ(pool->getNumAvailableMessages(), kNumPreallocatedMessages);
+
+  const aslam::VisualNFrame::Ptr nframe =
+      aligned_shared<aslam::VisualNFrame>();
+  vio::SynchronizedNFrameImu* first_message_address;
+  {
+    vio::SynchronizedNFrameImu::Ptr message = pool->acquire();
+    ASSERT_TRUE(message != nullptr);
+    first_message_address = message.get();
+    message->nframe = nframe;
+    message->imu_timestamps.resize(Eigen::NoChange, 5);
+    message->imu_measurements.resize(Eigen::NoChange, 5);
+    message->motion_wrt_last_nframe = vio::MotionType::kGeneralMotion;
+    EXPECT_EQ(pool->getNumAvailableMessages(), kNumPreallocatedMessages - 1u);
+    EXPECT_EQ(nframe.use_count(), 2);
+  }
+  // The returned message must not keep the nframe alive.
+  EXPECT_EQ(nframe.use_count(), 1);
+  EXPECT_EQ(pool->getNumAvailableMessages(), kNumPreallocatedMessages);
+
+  vio::SynchronizedNFrameImu::Ptr message = pool->acquire();
+  EXPECT_EQ(message.get(), first_message_address);
+  EXPECT_TRUE(message->nframe == nullptr);
+  EXPECT_EQ(message->motion_wrt_last_nframe, vio::MotionType::kInvalid);
+  // The IMU storage is kept.
+  EXPECT_EQ(message->imu_measurements.cols(), 5);
+  EXPECT_EQ(pool->getNumAllocatedMessages(), kNumPreallocatedMessages);
+}
+
+TEST(SynchronizedNFrameImuPoolTest, ControlBlocksAreReused) {
+  constexpr size_t kNumPreallocatedMessages = 2u;
+  SynchronizedNFrameImuPool::Ptr pool =
+      SynchronizedNFrameImuPool::create(kNumPreallocatedMessages);
+  EXPECT_EQ(pool->getNumAllocatedControlBlocks(), 0u);
+
+  constexpr size_t kNumIterations = 10u;
+  for (size_t iteration = 0u; iteration < kNumIterations; ++iteration) {
+    vio::SynchronizedNFrameImu::Ptr first_message = pool->acquire();
+    vio::SynchronizedNFrameImu::Ptr second_message = pool->acquire();
+    ASSERT_TRUE(first_message != nullptr);
+    ASSERT_TRUE(second_message != nullptr);
+  }
+  EXPECT_EQ(pool->getNumAllocatedControlBlocks(), 2u);
+  EXPECT_EQ(pool->getNumAllocatedMessages(), kNumPreallocatedMessages);
+}
+
+TEST(SynchronizedNFrameImuPoolTest, PoolGrowsAndOutlivesMessages) {
+  constexpr size_t kNumPreallocatedMessages = 1u;
+  SynchronizedNFrameImuPool::Ptr pool =
+      SynchronizedNFrameImuPool::create(kNumPreallocatedMessages);
+
+  vio::SynchronizedNFrameImu::Ptr first_message = pool->acquire();
+  vio::SynchronizedNFrameImu::Ptr second_message = pool->acquire();
+  ASSERT_TRUE(first_message != nullptr);
+  ASSERT_TRUE(second_message != nullptr);
+  EXPECT_NE(first_message.get(), second_message.get());
+  EXPECT_EQ(pool->getNumAllocatedMessages(), 2u);
+  EXPECT_EQ(pool->getNumAvailableMessages(), 0u);
+
+  first_message.reset();
+  EXPECT_EQ(pool->getNumAvailableMessages(), 1u);
+
+  // Messages that are still in use are deleted once they are released after
+  // the pool is gone.
+  pool.reset();
+  second_message.reset();
+}
+
+}  // namespace rovioli
+
+MAPLAB_UNITTEST_ENTRYPOINT
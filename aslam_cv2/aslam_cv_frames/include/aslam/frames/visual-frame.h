@@ -1,7 +1,10 @@
 #ifndef ASLAM_FRAMES_VISUAL_FRAME_H_
 #define ASLAM_FRAMES_VISUAL_FRAME_H_
 
+#include <atomic>
 #include <memory>
+#include <tuple>
+#include <typeinfo>
 #include <unordered_map>
 #include <cstdint>
 
@@ -22,8 +25,16 @@ class Camera;
 /// camera. It stores a pointer to the camera's intrinsic calibration,
 /// an id that uniquely identifies this frame, and a measurement timestamp.
 ///
-/// The class also stores a ChannelGroup object that can be used to hold
-/// keypoint data, the raw image, and other associated information.
+/// The keypoint data (measurements, uncertainties, orientations, scores, scales,
+/// descriptors and track ids) has a fixed schema and is stored in place in the
+/// frame. The class also stores a ChannelGroup object that can be used to hold
+/// the raw image and other associated information. The named channel interface
+/// (e.g. getChannelData()) covers both, i.e. the keypoint channels can still
+/// be accessed by their channel names.
+///
+/// As with the ChannelGroup, different keypoint channels of the same frame may be
+/// added and accessed concurrently. The data of a single channel is not
+/// synchronized.
 ///
 /// The camera geometry stored in the frame and accessible by getCameraGeometry()
 /// may refer to a transformed geometry that includes downsampling and undistortion.
@@ -60,6 +71,14 @@ class VisualFrame  {
 
   template<typename CHANNEL_DATA_TYPE>
   void addChannel(const std::string& channel) {
+    const int keypoint_channel = getKeypointChannelIndex(channel);
+    if (keypoint_channel != kNotAKeypointChannel) {
+      CHECK(!setKeypointChannel(keypoint_channel))
+          << "Channelgroup already contains channel " << channel;
+      getKeypointChannelData(
+          keypoint_channel, typeid(CHANNEL_DATA_TYPE), true /*add*/);
+      return;
+    }
     aslam::channels::addChannel<CHANNEL_DATA_TYPE>(channel, &channels_);
   }
 
@@ -89,6 +108,10 @@ class VisualFrame  {
 
   /// Is a certain channel stored in this frame?
   bool hasChannel(const std::string& channel) const {
+    const int keypoint_channel = getKeypointChannelIndex(channel);
+    if (keypoint_channel != kNotAKeypointChannel) {
+      return isKeypointChannelSet(keypoint_channel);
+    }
     return aslam::channels::hasChannel(channel, channels_);
   }
 
@@ -130,7 +153,7 @@ class VisualFrame  {
 
   template<typename CHANNEL_DATA_TYPE>
   const CHANNEL_DATA_TYPE& getChannelData(const std::string& channel) const {
-    return aslam::channels::getChannelData<CHANNEL_DATA_TYPE>(channel, channels_);
+    return *getChannelDataMutable<CHANNEL_DATA_TYPE>(channel);
   }
 
   /// A pointer to the keypoint measurements, can be used to swap in new data.
@@ -159,6 +182,11 @@ class VisualFrame  {
 
   template<typename CHANNEL_DATA_TYPE>
   CHANNEL_DATA_TYPE* getChannelDataMutable(const std::string& channel) const {
+    const int keypoint_channel = getKeypointChannelIndex(channel);
+    if (keypoint_channel != kNotAKeypointChannel) {
+      return static_cast<CHANNEL_DATA_TYPE*>(getKeypointChannelData(
+          keypoint_channel, typeid(CHANNEL_DATA_TYPE), false /*add*/));
+    }
     CHANNEL_DATA_TYPE& data =
         aslam::channels::getChannelData<CHANNEL_DATA_TYPE>(channel,
                                                            channels_);
@@ -219,6 +247,13 @@ class VisualFrame  {
   template<typename CHANNEL_DATA_TYPE>
   void setChannelData(const std::string& channel,
                       const CHANNEL_DATA_TYPE& data_new) {
+    const int keypoint_channel = getKeypointChannelIndex(channel);
+    if (keypoint_channel != kNotAKeypointChannel) {
+      *static_cast<CHANNEL_DATA_TYPE*>(getKeypointChannelData(
+          keypoint_channel, typeid(CHANNEL_DATA_TYPE), true /*add*/)) =
+          data_new;
+      return;
+    }
     if (!aslam::channels::hasChannel(channel, channels_)) {
       aslam::channels::addChannel<CHANNEL_DATA_TYPE>(channel, &channels_);
     }
@@ -256,6 +291,13 @@ class VisualFrame  {
   void swapChannelData(const std::string& channel,
                        CHANNEL_DATA_TYPE* data_new) {
     CHECK_NOTNULL(data_new);
+    const int keypoint_channel = getKeypointChannelIndex(channel);
+    if (keypoint_channel != kNotAKeypointChannel) {
+      static_cast<CHANNEL_DATA_TYPE*>(getKeypointChannelData(
+          keypoint_channel, typeid(CHANNEL_DATA_TYPE), true /*add*/))
+          ->swap(*data_new);
+      return;
+    }
     if (!aslam::channels::hasChannel(channel, channels_)) {
       aslam::channels::addChannel<CHANNEL_DATA_TYPE>(channel, &channels_);
     }
@@ -352,10 +394,64 @@ class VisualFrame  {
   void discardUntrackedObservations(std::vector<size_t>* discarded_indices);
 
  private:
+  /// Slots of the keypoint channels, the order has to match the order of the
+  /// types in KeypointChannelData.
+  enum KeypointChannel {
+    kKeypointMeasurementsChannel = 0,
+    kKeypointMeasurementUncertaintiesChannel,
+    kKeypointOrientationsChannel,
+    kKeypointScoresChannel,
+    kKeypointScalesChannel,
+    kDescriptorsChannel,
+    kTrackIdsChannel,
+    kNumKeypointChannels
+  };
+  static constexpr int kNotAKeypointChannel = -1;
+
+  typedef std::tuple<Eigen::Matrix2Xd, Eigen::VectorXd, Eigen::VectorXd,
+                     Eigen::VectorXd, Eigen::VectorXd, DescriptorsT,
+                     Eigen::VectorXi> KeypointChannelData;
+  template<KeypointChannel kChannel>
+  using KeypointChannelType =
+      typename std::tuple_element<kChannel, KeypointChannelData>::type;
+
+  /// Returns the slot of the keypoint channel with the given name or
+  /// kNotAKeypointChannel if the channel is not part of the keypoint schema.
+  static int getKeypointChannelIndex(const std::string& channel);
+
+  /// Returns whether the keypoint channel was set before.
+  bool setKeypointChannel(int keypoint_channel);
+  bool isKeypointChannelSet(int keypoint_channel) const {
+    return (keypoint_channels_set_.load(std::memory_order_acquire) &
+            (1u << keypoint_channel)) != 0u;
+  }
+
+  /// Access to the keypoint channels with the slot resolved at compile time.
+  /// Dies if the channel is not set.
+  template<KeypointChannel kChannel>
+  KeypointChannelType<kChannel>& getKeypointChannel() const;
+  template<KeypointChannel kChannel>
+  KeypointChannelType<kChannel>& getOrAddKeypointChannel();
+
+  /// Access to the keypoint channels for the named channel interface. Dies if
+  /// the type doesn't match the type of the channel or if the channel is not
+  /// set and should not be added.
+  void* getKeypointChannelData(
+      int keypoint_channel, const std::type_info& type,
+      bool add_if_missing) const;
+  template<KeypointChannel kChannel>
+  void* getKeypointChannelData(
+      const std::type_info& type, bool add_if_missing) const;
+
+  bool areKeypointChannelsEqual(const VisualFrame& other) const;
+
   /// Timestamp in nanoseconds.
   int64_t timestamp_nanoseconds_;
 
   aslam::FrameId id_;
+  KeypointChannelData keypoint_channels_;
+  /// Bit i is set if the keypoint channel in slot i is set.
+  std::atomic<uint32_t> keypoint_channels_set_;
   aslam::channels::ChannelGroup channels_;
   Camera::ConstPtr camera_geometry_;
   Camera::ConstPtr raw_camera_geometry_;
@@ -1,16 +1,135 @@
 #include "aslam/frames/visual-frame.h"
 
+#include <bitset>
 #include <memory>
+#include <string>
 #include <aslam/common/channel-definitions.h>
 #include <aslam/common/stl-helpers.h>
 #include <aslam/common/time.h>
 
 namespace aslam {
+namespace {
+/// Channel names of the keypoint channels, in the order of their slots.
+const std::string* const kKeypointChannelNames[] = {
+    &channels::VISUAL_KEYPOINT_MEASUREMENTS_CHANNEL,
+    &channels::VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_CHANNEL,
+    &channels::VISUAL_KEYPOINT_ORIENTATIONS_CHANNEL,
+    &channels::VISUAL_KEYPOINT_SCORES_CHANNEL,
+    &channels::VISUAL_KEYPOINT_SCALES_CHANNEL,
+    &channels::DESCRIPTORS_CHANNEL,
+    &channels::TRACK_IDS_CHANNEL};
+
+template<size_t kChannel, typename KeypointChannelData>
+bool isKeypointChannelEqual(
+    const KeypointChannelData& left, const KeypointChannelData& right,
+    const uint32_t channels_set) {
+  if ((channels_set & (1u << kChannel)) == 0u) {
+    return true;
+  }
+  const auto& left_data = std::get<kChannel>(left);
+  const auto& right_data = std::get<kChannel>(right);
+  return left_data.rows() == right_data.rows() &&
+      left_data.cols() == right_data.cols() && left_data == right_data;
+}
+}  // namespace
+
+constexpr int VisualFrame::kNotAKeypointChannel;
+
+int VisualFrame::getKeypointChannelIndex(const std::string& channel) {
+  static_assert(
+      sizeof(kKeypointChannelNames) / sizeof(kKeypointChannelNames[0]) ==
+      kNumKeypointChannels, "Every keypoint channel needs a name.");
+  // Rejects most other channels, e.g. the raw image, without a string compare.
+  static const std::bitset<256> kKeypointChannelFirstChars = []() {
+    std::bitset<256> first_chars;
+    for (const std::string* name : kKeypointChannelNames) {
+      first_chars.set(static_cast<unsigned char>(name->front()));
+    }
+    return first_chars;
+  }();
+  if (channel.empty() || !kKeypointChannelFirstChars[
+          static_cast<unsigned char>(channel.front())]) {
+    return kNotAKeypointChannel;
+  }
+  for (int channel_idx = 0; channel_idx < kNumKeypointChannels; ++channel_idx) {
+    if (*kKeypointChannelNames[channel_idx] == channel) {
+      return channel_idx;
+    }
+  }
+  return kNotAKeypointChannel;
+}
+
+bool VisualFrame::setKeypointChannel(int keypoint_channel) {
+  const uint32_t channel_bit = 1u << keypoint_channel;
+  return (keypoint_channels_set_.fetch_or(
+              channel_bit, std::memory_order_acq_rel) & channel_bit) != 0u;
+}
+
+template<VisualFrame::KeypointChannel kChannel>
+VisualFrame::KeypointChannelType<kChannel>&
+VisualFrame::getKeypointChannel() const {
+  CHECK(isKeypointChannelSet(kChannel)) << "Channelgroup does not "
+      "contain channel " << *kKeypointChannelNames[kChannel];
+  // The mutable accessors of the channel interface are const.
+  return const_cast<KeypointChannelType<kChannel>&>(
+      std::get<kChannel>(keypoint_channels_));
+}
+
+template<VisualFrame::KeypointChannel kChannel>
+VisualFrame::KeypointChannelType<kChannel>&
+VisualFrame::getOrAddKeypointChannel() {
+  setKeypointChannel(kChannel);
+  return std::get<kChannel>(keypoint_channels_);
+}
+
+template<VisualFrame::KeypointChannel kChannel>
+void* VisualFrame::getKeypointChannelData(
+    const std::type_info& type, bool add_if_missing) const {
+  CHECK(type == typeid(KeypointChannelType<kChannel>))
+      << "Channel cast to derived failed channel: "
+      << *kKeypointChannelNames[kChannel];
+  if (add_if_missing) {
+    return &const_cast<VisualFrame*>(this)->getOrAddKeypointChannel<kChannel>();
+  }
+  return &getKeypointChannel<kChannel>();
+}
+
+void* VisualFrame::getKeypointChannelData(
+    int keypoint_channel, const std::type_info& type,
+    bool add_if_missing) const {
+  switch (keypoint_channel) {
+    case kKeypointMeasurementsChannel:
+      return getKeypointChannelData<kKeypointMeasurementsChannel>(
+          type, add_if_missing);
+    case kKeypointMeasurementUncertaintiesChannel:
+      return getKeypointChannelData<kKeypointMeasurementUncertaintiesChannel>(
+          type, add_if_missing);
+    case kKeypointOrientationsChannel:
+      return getKeypointChannelData<kKeypointOrientationsChannel>(
+          type, add_if_missing);
+    case kKeypointScoresChannel:
+      return getKeypointChannelData<kKeypointScoresChannel>(
+          type, add_if_missing);
+    case kKeypointScalesChannel:
+      return getKeypointChannelData<kKeypointScalesChannel>(
+          type, add_if_missing);
+    case kDescriptorsChannel:
+      return getKeypointChannelData<kDescriptorsChannel>(type, add_if_missing);
+    case kTrackIdsChannel:
+      return getKeypointChannelData<kTrackIdsChannel>(type, add_if_missing);
+    default:
+      LOG(FATAL) << "Invalid keypoint channel: " << keypoint_channel;
+  }
+  return nullptr;
+}
+
 VisualFrame::VisualFrame()
     : timestamp_nanoseconds_(time::getInvalidTime()),
+      keypoint_channels_set_(0u),
       is_valid_(true) {}
 
-VisualFrame::VisualFrame(const VisualFrame& other) {
+VisualFrame::VisualFrame(const VisualFrame& other)
+    : keypoint_channels_set_(0u) {
   *this = other;
 }
 
@@ -20,6 +139,10 @@ VisualFrame& VisualFrame::operator=(const VisualFrame& other) {
   camera_geometry_ = other.camera_geometry_;
   raw_camera_geometry_ = other.raw_camera_geometry_;
 
+  keypoint_channels_ = other.keypoint_channels_;
+  keypoint_channels_set_.store(
+      other.keypoint_channels_set_.load(std::memory_order_acquire),
+      std::memory_order_release);
   channels_ = channels::cloneChannelGroup(other.channels_);
   is_valid_ = other.is_valid_;
   return *this;
@@ -28,6 +151,7 @@ VisualFrame& VisualFrame::operator=(const VisualFrame& other) {
 bool VisualFrame::operator==(const VisualFrame& other) const {
   bool same = true;
   same &= timestamp_nanoseconds_ == other.timestamp_nanoseconds_;
+  same &= areKeypointChannelsEqual(other);
   same &= channels::isChannelGroupEqual(channels_, other.channels_);
   same &= static_cast<bool>(camera_geometry_) ==
       static_cast<bool>(other.camera_geometry_);
@@ -42,56 +166,82 @@ bool VisualFrame::operator==(const VisualFrame& other) const {
 bool VisualFrame::compareWithoutCameraGeometry(const VisualFrame& other) const {
   bool same = true;
   same &= timestamp_nanoseconds_ == other.timestamp_nanoseconds_;
+  same &= areKeypointChannelsEqual(other);
   same &= channels::isChannelGroupEqual(channels_, other.channels_);
   same &= is_valid_ == other.is_valid_;
   return same;
 }
 
+bool VisualFrame::areKeypointChannelsEqual(const VisualFrame& other) const {
+  const uint32_t channels_set =
+      keypoint_channels_set_.load(std::memory_order_acquire);
+  if (channels_set != other.keypoint_channels_set_.load(
+                          std::memory_order_acquire)) {
+    return false;
+  }
+  const KeypointChannelData& left = keypoint_channels_;
+  const KeypointChannelData& right = other.keypoint_channels_;
+  return isKeypointChannelEqual<kKeypointMeasurementsChannel>(
+             left, right, channels_set) &&
+      isKeypointChannelEqual<kKeypointMeasurementUncertaintiesChannel>(
+          left, right, channels_set) &&
+      isKeypointChannelEqual<kKeypointOrientationsChannel>(
+          left, right, channels_set) &&
+      isKeypointChannelEqual<kKeypointScoresChannel>(
+          left, right, channels_set) &&
+      isKeypointChannelEqual<kKeypointScalesChannel>(
+          left, right, channels_set) &&
+      isKeypointChannelEqual<kDescriptorsChannel>(
+          left, right, channels_set) &&
+      isKeypointChannelEqual<kTrackIdsChannel>(
+          left, right, channels_set);
+}
+
 bool VisualFrame::hasKeypointMeasurements() const {
-  return aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENTS_Channel(channels_);
+  return isKeypointChannelSet(kKeypointMeasurementsChannel);
 }
 bool VisualFrame::hasKeypointMeasurementUncertainties() const{
-  return aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Channel(channels_);
+  return isKeypointChannelSet(kKeypointMeasurementUncertaintiesChannel);
 }
 bool VisualFrame::hasKeypointOrientations() const{
-  return aslam::channels::has_VISUAL_KEYPOINT_ORIENTATIONS_Channel(channels_);
+  return isKeypointChannelSet(kKeypointOrientationsChannel);
 }
 bool VisualFrame::hasKeypointScores() const {
-  return aslam::channels::has_VISUAL_KEYPOINT_SCORES_Channel(channels_);
+  return isKeypointChannelSet(kKeypointScoresChannel);
 }
 bool VisualFrame::hasKeypointScales() const{
-  return aslam::channels::has_VISUAL_KEYPOINT_SCALES_Channel(channels_);
+  return isKeypointChannelSet(kKeypointScalesChannel);
 }
 bool VisualFrame::hasDescriptors() const{
-  return aslam::channels::has_DESCRIPTORS_Channel(channels_);
+  return isKeypointChannelSet(kDescriptorsChannel);
 }
 bool VisualFrame::hasTrackIds() const {
-  return aslam::channels::has_TRACK_IDS_Channel(channels_);
+  return isKeypointChannelSet(kTrackIdsChannel);
 }
 bool VisualFrame::hasRawImage() const {
   return aslam::channels::has_RAW_IMAGE_Channel(channels_);
 }
 
 const Eigen::Matrix2Xd& VisualFrame::getKeypointMeasurements() const {
-  return aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENTS_Data(channels_);
+  return getKeypointChannel<kKeypointMeasurementsChannel>();
 }
 const Eigen::VectorXd& VisualFrame::getKeypointMeasurementUncertainties() const {
-  return aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Data(channels_);
+  return getKeypointChannel<kKeypointMeasurementUncertaintiesChannel>();
 }
 const Eigen::VectorXd& VisualFrame::getKeypointScales() const {
-  return aslam::channels::get_VISUAL_KEYPOINT_SCALES_Data(channels_);
+  return getKeypointChannel<kKeypointScalesChannel>();
 }
 const Eigen::VectorXd& VisualFrame::getKeypointOrientations() const {
-  return aslam::channels::get_VISUAL_KEYPOINT_ORIENTATIONS_Data(channels_);
+  return getKeypointChannel<kKeypointOrientationsChannel>();
 }
 const Eigen::VectorXd& VisualFrame::getKeypointScores() const {
-  return aslam::channels::get_VISUAL_KEYPOINT_SCORES_Data(channels_);
+  return getKeypointChannel<kKeypointScoresChannel>();
 }
 const VisualFrame::DescriptorsT& VisualFrame::getDescriptors() const {
-  return aslam::channels::get_DESCRIPTORS_Data(channels_);
+  return getKeypointChannel<kDescriptorsChannel>();
 }
 const Eigen::VectorXi& VisualFrame::getTrackIds() const {
-  return aslam::channels::get_TRACK_IDS_Data(channels_);
+  return getKeypointChannel<kTrackIdsChannel>();
 }
 const cv::Mat& VisualFrame::getRawImage() const {
   return aslam::channels::get_RAW_IMAGE_Data(channels_);
@@ -102,39 +252,25 @@ void VisualFrame::releaseRawImage() {
 }
 
 Eigen::Matrix2Xd* VisualFrame::getKeypointMeasurementsMutable() {
-  Eigen::Matrix2Xd& keypoints =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENTS_Data(channels_);
-    return &keypoints;
+  return &getKeypointChannel<kKeypointMeasurementsChannel>();
 }
 Eigen::VectorXd* VisualFrame::getKeypointMeasurementUncertaintiesMutable() {
-  Eigen::VectorXd& uncertainties =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Data(channels_);
-    return &uncertainties;
+  return &getKeypointChannel<kKeypointMeasurementUncertaintiesChannel>();
 }
 Eigen::VectorXd* VisualFrame::getKeypointScalesMutable() {
-  Eigen::VectorXd& scales =
-      aslam::channels::get_VISUAL_KEYPOINT_SCALES_Data(channels_);
-    return &scales;
+  return &getKeypointChannel<kKeypointScalesChannel>();
 }
 Eigen::VectorXd* VisualFrame::getKeypointOrientationsMutable() {
-  Eigen::VectorXd& orientations =
-      aslam::channels::get_VISUAL_KEYPOINT_ORIENTATIONS_Data(channels_);
-    return &orientations;
+  return &getKeypointChannel<kKeypointOrientationsChannel>();
 }
 Eigen::VectorXd* VisualFrame::getKeypointScoresMutable() {
-  Eigen::VectorXd& scores =
-      aslam::channels::get_VISUAL_KEYPOINT_SCORES_Data(channels_);
-    return &scores;
+  return &getKeypointChannel<kKeypointScoresChannel>();
 }
 VisualFrame::DescriptorsT* VisualFrame::getDescriptorsMutable() {
-  VisualFrame::DescriptorsT& descriptors =
-      aslam::channels::get_DESCRIPTORS_Data(channels_);
-  return &descriptors;
+  return &getKeypointChannel<kDescriptorsChannel>();
 }
 Eigen::VectorXi* VisualFrame::getTrackIdsMutable() {
-  Eigen::VectorXi& track_ids =
-      aslam::channels::get_TRACK_IDS_Data(channels_);
-  return &track_ids;
+  return &getKeypointChannel<kTrackIdsChannel>();
 }
 cv::Mat* VisualFrame::getRawImageMutable() {
   cv::Mat& image =
@@ -145,117 +281,75 @@ cv::Mat* VisualFrame::getRawImageMutable() {
 const Eigen::Block<Eigen::Matrix2Xd, 2, 1>
 VisualFrame::getKeypointMeasurement(size_t index) const {
   Eigen::Matrix2Xd& keypoints =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENTS_Data(channels_);
+      getKeypointChannel<kKeypointMeasurementsChannel>();
   CHECK_LT(static_cast<int>(index), keypoints.cols());
   return keypoints.block<2, 1>(0, index);
 }
 double VisualFrame::getKeypointMeasurementUncertainty(size_t index) const {
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Data(channels_);
+  const Eigen::VectorXd& data =
+      getKeypointChannel<kKeypointMeasurementUncertaintiesChannel>();
   CHECK_LT(static_cast<int>(index), data.rows());
   return data.coeff(index, 0);
 }
 double VisualFrame::getKeypointScale(size_t index) const {
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCALES_Data(channels_);
+  const Eigen::VectorXd& data = getKeypointChannel<kKeypointScalesChannel>();
   CHECK_LT(static_cast<int>(index), data.rows());
   return data.coeff(index, 0);
 }
 double VisualFrame::getKeypointOrientation(size_t index) const {
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_ORIENTATIONS_Data(channels_);
+  const Eigen::VectorXd& data =
+      getKeypointChannel<kKeypointOrientationsChannel>();
   CHECK_LT(static_cast<int>(index), data.rows());
   return data.coeff(index, 0);
 }
 double VisualFrame::getKeypointScore(size_t index) const {
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCORES_Data(channels_);
+  const Eigen::VectorXd& data = getKeypointChannel<kKeypointScoresChannel>();
   CHECK_LT(static_cast<int>(index), data.rows());
   return data.coeff(index, 0);
 }
 const unsigned char* VisualFrame::getDescriptor(size_t index) const {
-  VisualFrame::DescriptorsT& descriptors =
-      aslam::channels::get_DESCRIPTORS_Data(channels_);
+  const VisualFrame::DescriptorsT& descriptors =
+      getKeypointChannel<kDescriptorsChannel>();
   CHECK_LT(static_cast<int>(index), descriptors.cols());
   return &descriptors.coeffRef(0, index);
 }
 int VisualFrame::getTrackId(size_t index) const {
-  Eigen::VectorXi& track_ids =
-      aslam::channels::get_TRACK_IDS_Data(channels_);
+  const Eigen::VectorXi& track_ids = getKeypointChannel<kTrackIdsChannel>();
   CHECK_LT(static_cast<int>(index), track_ids.rows());
   return track_ids.coeff(index, 0);
 }
 
 void VisualFrame::setKeypointMeasurements(
     const Eigen::Matrix2Xd& keypoints_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENTS_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_MEASUREMENTS_Channel(&channels_);
-  }
-  Eigen::Matrix2Xd& keypoints =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENTS_Data(channels_);
-  keypoints = keypoints_new;
+  getOrAddKeypointChannel<kKeypointMeasurementsChannel>() = keypoints_new;
 }
 void VisualFrame::setKeypointMeasurementUncertainties(
     const Eigen::VectorXd& uncertainties_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Data(channels_);
-  data = uncertainties_new;
+  getOrAddKeypointChannel<kKeypointMeasurementUncertaintiesChannel>() =
+      uncertainties_new;
 }
 void VisualFrame::setKeypointScales(
     const Eigen::VectorXd& scales_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_SCALES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_SCALES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCALES_Data(channels_);
-  data = scales_new;
+  getOrAddKeypointChannel<kKeypointScalesChannel>() = scales_new;
 }
 void VisualFrame::setKeypointOrientations(
     const Eigen::VectorXd& orientations_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_ORIENTATIONS_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_ORIENTATIONS_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_ORIENTATIONS_Data(channels_);
-  data = orientations_new;
+  getOrAddKeypointChannel<kKeypointOrientationsChannel>() = orientations_new;
 }
 void VisualFrame::setKeypointScores(
     const Eigen::VectorXd& scores_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_SCORES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_SCORES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCORES_Data(channels_);
-  data = scores_new;
+  getOrAddKeypointChannel<kKeypointScoresChannel>() = scores_new;
 }
 void VisualFrame::setDescriptors(
     const DescriptorsT& descriptors_new) {
-  if (!aslam::channels::has_DESCRIPTORS_Channel(channels_)) {
-    aslam::channels::add_DESCRIPTORS_Channel(&channels_);
-  }
-  VisualFrame::DescriptorsT& descriptors =
-      aslam::channels::get_DESCRIPTORS_Data(channels_);
-  descriptors = descriptors_new;
+  getOrAddKeypointChannel<kDescriptorsChannel>() = descriptors_new;
 }
 void VisualFrame::setDescriptors(
     const Eigen::Map<const DescriptorsT>& descriptors_new) {
-  if (!aslam::channels::has_DESCRIPTORS_Channel(channels_)) {
-    aslam::channels::add_DESCRIPTORS_Channel(&channels_);
-  }
-  VisualFrame::DescriptorsT& descriptors =
-      aslam::channels::get_DESCRIPTORS_Data(channels_);
-  descriptors = descriptors_new;
+  getOrAddKeypointChannel<kDescriptorsChannel>() = descriptors_new;
 }
 void VisualFrame::setTrackIds(const Eigen::VectorXi& track_ids_new) {
-  if (!aslam::channels::has_TRACK_IDS_Channel(channels_)) {
-    aslam::channels::add_TRACK_IDS_Channel(&channels_);
-  }
-  Eigen::VectorXi& data =
-      aslam::channels::get_TRACK_IDS_Data(channels_);
-  data = track_ids_new;
+  getOrAddKeypointChannel<kTrackIdsChannel>() = track_ids_new;
 }
 
 void VisualFrame::setRawImage(const cv::Mat& image_new) {
@@ -268,60 +362,35 @@ void VisualFrame::setRawImage(const cv::Mat& image_new) {
 }
 
 void VisualFrame::swapKeypointMeasurements(Eigen::Matrix2Xd* keypoints_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENTS_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_MEASUREMENTS_Channel(&channels_);
-  }
-  Eigen::Matrix2Xd& keypoints =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENTS_Data(channels_);
-  keypoints.swap(*keypoints_new);
+  CHECK_NOTNULL(keypoints_new);
+  getOrAddKeypointChannel<kKeypointMeasurementsChannel>().swap(*keypoints_new);
 }
 void VisualFrame::swapKeypointMeasurementUncertainties(Eigen::VectorXd* uncertainties_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_MEASUREMENT_UNCERTAINTIES_Data(channels_);
-  data.swap(*uncertainties_new);
+  CHECK_NOTNULL(uncertainties_new);
+  getOrAddKeypointChannel<kKeypointMeasurementUncertaintiesChannel>().swap(
+      *uncertainties_new);
 }
 void VisualFrame::swapKeypointScales(Eigen::VectorXd* scales_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_SCALES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_SCALES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCALES_Data(channels_);
-  data.swap(*scales_new);
+  CHECK_NOTNULL(scales_new);
+  getOrAddKeypointChannel<kKeypointScalesChannel>().swap(*scales_new);
 }
 void VisualFrame::swapKeypointOrientations(Eigen::VectorXd* orientations_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_ORIENTATIONS_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_ORIENTATIONS_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_ORIENTATIONS_Data(channels_);
-  data.swap(*orientations_new);
+  CHECK_NOTNULL(orientations_new);
+  getOrAddKeypointChannel<kKeypointOrientationsChannel>().swap(
+      *orientations_new);
 }
 void VisualFrame::swapKeypointScores(Eigen::VectorXd* scores_new) {
-  if (!aslam::channels::has_VISUAL_KEYPOINT_SCORES_Channel(channels_)) {
-    aslam::channels::add_VISUAL_KEYPOINT_SCORES_Channel(&channels_);
-  }
-  Eigen::VectorXd& data =
-      aslam::channels::get_VISUAL_KEYPOINT_SCORES_Data(channels_);
-  data.swap(*scores_new);
+  CHECK_NOTNULL(scores_new);
+  getOrAddKeypointChannel<kKeypointScoresChannel>().swap(*scores_new);
 }
 void VisualFrame::swapDescriptors(DescriptorsT* descriptors_new) {
-  if (!aslam::channels::has_DESCRIPTORS_Channel(channels_)) {
-    aslam::channels::add_DESCRIPTORS_Channel(&channels_);
-  }
-  VisualFrame::DescriptorsT& descriptors =
-      aslam::channels::get_DESCRIPTORS_Data(channels_);
-  descriptors.swap(*descriptors_new);
+  CHECK_NOTNULL(descriptors_new);
+  getOrAddKeypointChannel<kDescriptorsChannel>().swap(*descriptors_new);
 }
 
 void VisualFrame::swapTrackIds(Eigen::VectorXi* track_ids_new) {
-  if (!aslam::channels::has_TRACK_IDS_Channel(channels_)) {
-    aslam::channels::add_TRACK_IDS_Channel(&channels_);
-  }
-  Eigen::VectorXi& track_ids = aslam::channels::get_TRACK_IDS_Data(channels_);
-  track_ids.swap(*track_ids_new);
+  CHECK_NOTNULL(track_ids_new);
+  getOrAddKeypointChannel<kTrackIdsChannel>().swap(*track_ids_new);
 }
 
 void VisualFrame::clearKeypointChannels() {
@@ -366,6 +435,12 @@ void VisualFrame::print(std::ostream& out, const std::string& label) const {
   } else {
     out << "  VisualFrame::camera is NULL" << std::endl;
   }
+  out << "  Keypoint channels:" << std::endl;
+  for (int channel_idx = 0; channel_idx < kNumKeypointChannels; ++channel_idx) {
+    if (isKeypointChannelSet(channel_idx)) {
+      out << "   - " << *kKeypointChannelNames[channel_idx] << std::endl;
+    }
+  }
   channels_.printParameters(out);
 }
 
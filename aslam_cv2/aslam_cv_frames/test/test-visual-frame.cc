@@ -1,3 +1,5 @@
+#include <thread>
+
 #include <eigen-checks/gtest.h>
 #include <gtest/gtest.h>
 
@@ -141,6 +143,64 @@ TEST(Frame, NamedChannel) {
   EXPECT_TRUE(EIGEN_MATRIX_NEAR(data, data_2, 1e-6));
 }
 
+TEST(Frame, KeypointChannelsByName) {
+  aslam::VisualFrame frame;
+  const std::string kScoresChannel = "VISUAL_KEYPOINT_SCORES";
+  EXPECT_FALSE(frame.hasChannel(kScoresChannel));
+  EXPECT_DEATH(frame.getChannelData<Eigen::VectorXd>(kScoresChannel), "^");
+
+  // The named channel interface and the keypoint accessors share the data.
+  Eigen::VectorXd scores = Eigen::VectorXd::Random(10);
+  frame.setKeypointScores(scores);
+  EXPECT_TRUE(frame.hasChannel(kScoresChannel));
+  EXPECT_EQ(&frame.getKeypointScores(),
+            &frame.getChannelData<Eigen::VectorXd>(kScoresChannel));
+  EXPECT_DEATH(frame.getChannelData<Eigen::VectorXi>(kScoresChannel), "^");
+
+  Eigen::VectorXi track_ids = Eigen::VectorXi::Random(10);
+  frame.setChannelData("TRACK_IDS", track_ids);
+  ASSERT_TRUE(frame.hasTrackIds());
+  EXPECT_TRUE(EIGEN_MATRIX_EQUAL(track_ids, frame.getTrackIds()));
+
+  frame.addChannel<aslam::VisualFrame::DescriptorsT>("DESCRIPTORS");
+  EXPECT_TRUE(frame.hasDescriptors());
+  EXPECT_EQ(0, frame.getDescriptors().cols());
+  EXPECT_DEATH(
+      frame.addChannel<aslam::VisualFrame::DescriptorsT>("DESCRIPTORS"), "^");
+  EXPECT_FALSE(frame.hasKeypointMeasurements());
+
+  // Frames only differ in the set keypoint channels.
+  aslam::VisualFrame other_frame(frame);
+  EXPECT_TRUE(frame == other_frame);
+  other_frame.setKeypointScales(scores);
+  EXPECT_FALSE(frame == other_frame);
+}
+
+TEST(Frame, ConcurrentKeypointChannelAdds) {
+  aslam::VisualFrame frame;
+  // Channels that share a first character with a keypoint channel.
+  frame.addChannel<Eigen::VectorXd>("VISUAL_TEST_CHANNEL");
+  EXPECT_TRUE(frame.hasChannel("VISUAL_TEST_CHANNEL"));
+  EXPECT_FALSE(frame.hasChannel("TRACK"));
+
+  std::thread scores_thread([&frame]() {
+    frame.setKeypointScores(Eigen::VectorXd::Random(10));
+  });
+  std::thread track_ids_thread([&frame]() {
+    frame.setTrackIds(Eigen::VectorXi::Random(10));
+  });
+  std::thread descriptors_thread([&frame]() {
+    frame.addChannel<aslam::VisualFrame::DescriptorsT>("DESCRIPTORS");
+  });
+  scores_thread.join();
+  track_ids_thread.join();
+  descriptors_thread.join();
+  EXPECT_TRUE(frame.hasKeypointScores());
+  EXPECT_TRUE(frame.hasTrackIds());
+  EXPECT_TRUE(frame.hasDescriptors());
+  EXPECT_FALSE(frame.hasKeypointMeasurements());
+}
+
 TEST(Frame, SetGetImage) {
   aslam::VisualFrame frame;
   cv::Mat data(10,10,CV_8SC3,uint8_t(7));
@@ -117,6 +117,10 @@ class VisualNPipeline final {
   /// Get the number of frames being processed.
   size_t getNumFramesProcessing() const;
 
+  /// Total number of VisualNFrames that have been taken out of the output
+  /// queue by getNext*() or getLatestAndClear*() since construction.
+  size_t getNumFramesRetrieved() const;
+
   /// Get the next available set of processed frames.
   /// This may not be the latest data, it is simply the next in a FIFO queue.
   /// If there are no VisualNFrames waiting, this returns a NULL pointer.
@@ -193,6 +197,8 @@ class VisualNPipeline final {
   TimestampVisualNFrameMap processing_;
   /// The output queue of completed frames.
   TimestampVisualNFrameMap completed_;
+  /// The number of frames that have been taken from the output queue.
+  size_t num_frames_retrieved_;
 
   /// A thread pool for processing.
   std::shared_ptr<aslam::ThreadPool> thread_pool_;
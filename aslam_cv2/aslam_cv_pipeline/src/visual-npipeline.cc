@@ -21,6 +21,7 @@ VisualNPipeline::VisualNPipeline(
     int64_t timestamp_tolerance_ns) :
       pipelines_(pipelines),
       shutdown_(false),
+      num_frames_retrieved_(0u),
       input_camera_system_(input_camera_system),
       output_camera_system_(output_camera_system),
       timestamp_tolerance_ns_(timestamp_tolerance_ns)  {
@@ -136,6 +137,7 @@ std::shared_ptr<VisualNFrame> VisualNPipeline::getNextImpl() {
   auto it_completed = completed_.begin();
   nframe = it_completed->second;
   completed_.erase(it_completed);
+  ++num_frames_retrieved_;
   condition_not_full_.notify_all();
   return nframe;
 }
@@ -155,6 +157,7 @@ std::shared_ptr<VisualNFrame> VisualNPipeline::getLatestAndClear() {
   auto reverse_it_completed = completed_.rbegin();
   nframe = reverse_it_completed->second;
   const int64_t timestamp_nanoseconds = reverse_it_completed->first;
+  num_frames_retrieved_ += completed_.size();
   completed_.clear();
   condition_not_full_.notify_all();
   // Clear any processing frames older than this one.
@@ -184,6 +187,7 @@ bool VisualNPipeline::getLatestAndClearBlocking(
     *nframe = nframe_iterator->second;
     CHECK(*nframe);
     const int64_t timestamp_nanoseconds = nframe_iterator->first;
+    num_frames_retrieved_ += completed_.size();
     completed_.clear();
     condition_not_full_.notify_all();
     // Clear any processing frames older than this one.
@@ -206,6 +210,11 @@ std::shared_ptr<const NCamera> VisualNPipeline::getOutputNCameras() const {
   return output_camera_system_;
 }
 
+size_t VisualNPipeline::getNumFramesRetrieved() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_frames_retrieved_;
+}
+
 size_t VisualNPipeline::getNumFramesProcessing() const {
   std::lock_guard<std::mutex> lock(mutex_);
   return processing_.size();
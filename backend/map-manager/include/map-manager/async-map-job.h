@@ -0,0 +1,104 @@
+#ifndef MAP_MANAGER_ASYNC_MAP_JOB_H_
+#define MAP_MANAGER_ASYNC_MAP_JOB_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <gflags/gflags.h>
+
+DECLARE_int32(map_manager_num_async_threads);
+
+namespace backend {
+
+template <typename MapType>
+class MapManager;
+
+/// \brief Handle to an asynchronous map manager operation, e.g. as returned by
+/// MapManager::loadMapAsync() and MapManager::saveMapAsync().
+///
+/// The handle can be polled for the state and progress of the operation, waited
+/// on and used to cancel the operation. Cancellation is cooperative: the
+/// operation is stopped at its next checkpoint, i.e. before it starts or, for
+/// loading, before the loaded map is inserted into the storage. A save that is
+/// already writing to the file system is completed.
+class AsyncMapJob {
+ public:
+  typedef std::shared_ptr<AsyncMapJob> Ptr;
+
+  enum class State { kQueued, kRunning, kSucceeded, kFailed, kCancelled };
+
+  explicit AsyncMapJob(const std::string& map_key);
+
+  /// \brief Key of the map this job operates on.
+  const std::string& getMapKey() const {
+    return map_key_;
+  }
+
+  State getState() const;
+
+  /// \brief Returns true if the job succeeded, failed or was cancelled.
+  bool isFinished() const;
+
+  /// \brief Returns the progress of the job in [0, 1].
+  double getProgress() const {
+    return progress_.load();
+  }
+
+  /// \brief Requests the job to be cancelled.
+  /// \returns False if the job has already finished.
+  bool cancel();
+  bool isCancellationRequested() const {
+    return cancellation_requested_.load();
+  }
+
+  /// \brief Blocks until the job has finished.
+  /// \returns True if the job succeeded.
+  bool wait() const;
+
+  /// \brief Blocks until the job has finished or the timeout expired.
+  /// \returns True if the job has finished.
+  template <typename Rep, typename Period>
+  bool waitFor(const std::chrono::duration<Rep, Period>& timeout) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return state_changed_.wait_for(
+        lock, timeout, [this]() { return isFinishedState(state_); });
+  }
+
+  static std::string stateToString(const State state);
+
+ private:
+  template <typename MapType>
+  friend class MapManager;
+
+  static bool isFinishedState(const State state) {
+    return state == State::kSucceeded || state == State::kFailed ||
+           state == State::kCancelled;
+  }
+
+  /// \brief Marks the job as running. Returns false and finishes the job as
+  /// cancelled if a cancellation was requested before.
+  bool start();
+
+  /// \brief Finishes the job as cancelled and returns true if a cancellation
+  /// was requested.
+  bool finishIfCancelled();
+
+  void setProgress(const double progress);
+  void finish(const bool success);
+
+  const std::string map_key_;
+  std::atomic<bool> cancellation_requested_;
+  std::atomic<double> progress_;
+
+  State state_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable state_changed_;
+};
+
+}  // namespace backend
+
+#endif  // MAP_MANAGER_ASYNC_MAP_JOB_H_
@@ -1,7 +1,10 @@
 #ifndef MAP_MANAGER_MAP_MANAGER_INL_H_
 #define MAP_MANAGER_MAP_MANAGER_INL_H_
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>    // NOLINT
+#include <functional>
 #include <iostream>  // NOLINT
 #include <memory>
 #include <sstream>
@@ -17,9 +20,12 @@
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/map-manager-config.h>
 #include <maplab-common/map-traits.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/proto-serialization-helper.h>
 #include <maplab-common/text-formatting.h>
+#include <maplab-common/threading-helpers.h>
 
+#include "map-manager/async-map-job.h"
 #include "map-manager/map-manager.h"
 #include "map-manager/map-storage.h"
 
@@ -186,10 +192,19 @@ void MapManager<MapType>::setMapFolder(
 template <typename MapType>
 bool MapManager<MapType>::loadMapFromFolder(
     const std::string& folder_path, const std::string& key_in) {
+  constexpr AsyncMapJob* kNoJob = nullptr;
+  return loadMapIntoStorage(folder_path, key_in, map_storage_, kNoJob);
+}
+
+template <typename MapType>
+bool MapManager<MapType>::loadMapIntoStorage(
+    const std::string& folder_path, const std::string& key,
+    MapStorage<MapType>* map_storage, AsyncMapJob* job) {
+  CHECK_NOTNULL(map_storage);
   CHECK(!folder_path.empty());
-  CHECK(!key_in.empty());
-  if (!map_storage_->isKeyValid(key_in)) {
-    LOG(ERROR) << "The key \"" << key_in << "\" is not a valid key.";
+  CHECK(!key.empty());
+  if (!map_storage->isKeyValid(key)) {
+    LOG(ERROR) << "The key \"" << key << "\" is not a valid key.";
     return false;
   }
   AlignedUniquePtr<MapType> map = aligned_unique<MapType>();
@@ -198,17 +213,67 @@ bool MapManager<MapType>::loadMapFromFolder(
     return false;
   }
 
-  aslam::ScopedWriteLock lock(map_storage_->getContainerMutex());
-  if (map_storage_->hasMap(key_in)) {
-    LOG(ERROR) << "Map with the key \"" << key_in
+  aslam::ScopedWriteLock lock(map_storage->getContainerMutex());
+  if (job != nullptr) {
+    // Loading is the bulk of the work, inserting the map is instantaneous.
+    constexpr double kProgressMapLoaded = 0.9;
+    job->setProgress(kProgressMapLoaded);
+    if (job->isCancellationRequested()) {
+      return false;
+    }
+  }
+  if (map_storage->hasMap(key)) {
+    LOG(ERROR) << "Map with the key \"" << key
                << "\" already exists in the storage!";
     return false;
   }
-  map_storage_->addMap(key_in, map);
+  map_storage->addMap(key, map);
 
   return true;
 }
 
+template <typename MapType>
+AsyncMapJob::Ptr MapManager<MapType>::loadMapAsync(
+    const std::string& folder_path, const std::string& key) {
+  CHECK(!folder_path.empty());
+  CHECK(!key.empty());
+  AsyncMapJob::Ptr job = std::make_shared<AsyncMapJob>(key);
+  MapStorage<MapType>* map_storage = map_storage_;
+  runAsyncJob(
+      [folder_path, key, map_storage](AsyncMapJob* running_job) {
+        return loadMapIntoStorage(folder_path, key, map_storage, running_job);
+      },
+      job);
+  return job;
+}
+
+template <typename MapType>
+void MapManager<MapType>::runAsyncJob(
+    const std::function<bool(AsyncMapJob*)>& operation,
+    const AsyncMapJob::Ptr& job) const {
+  CHECK(operation);
+  CHECK(job);
+  map_storage_->getAsyncJobThreadPool()->enqueue([operation, job]() {
+    if (!job->start()) {
+      return;
+    }
+    const std::chrono::steady_clock::time_point start_time =
+        std::chrono::steady_clock::now();
+    const bool success = operation(job.get());
+    // A cancellation that is requested after the operation succeeded has no
+    // effect anymore.
+    if (success || !job->finishIfCancelled()) {
+      job->finish(success);
+    }
+    VLOG(1) << "Job for map \"" << job->getMapKey() << "\" "
+            << AsyncMapJob::stateToString(job->getState()) << " after "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start_time)
+                   .count()
+            << " s.";
+  });
+}
+
 template <typename MapType>
 bool MapManager<MapType>::loadMapFromFolder(
     const std::string& folder_path, std::string* key_out) {
@@ -306,41 +371,66 @@ bool MapManager<MapType>::loadAllMapsFromFolder(
   }
   VLOG(1) << maps_to_load_ss.str() << "\n";
 
-  aslam::ScopedWriteLock lock(map_storage_->getContainerMutex());
-  std::unordered_set<std::string> key_set;
-  for (const std::string& map_key : key_list) {
-    if (!key_set.emplace(map_key).second) {
-      LOG(ERROR) << "Found duplicate map key: " << map_key << " in folder "
-                 << folder_path << ". No maps will be loaded.";
+  {
+    aslam::ScopedReadLock lock(map_storage_->getContainerMutex());
+    std::unordered_set<std::string> key_set;
+    for (const std::string& map_key : key_list) {
+      if (!key_set.emplace(map_key).second) {
+        LOG(ERROR) << "Found duplicate map key: " << map_key << " in folder "
+                   << folder_path << ". No maps will be loaded.";
+        return false;
+      }
+      if (map_storage_->hasMap(map_key)) {
+        LOG(ERROR) << "No maps will be loaded because a map with key \""
+                   << map_key << "\" already exists in the storage.";
+        return false;
+      }
+    }
+  }
+
+  // Load all maps in parallel on dedicated threads. The pool of the
+  // asynchronous jobs is not used, as this call may itself run on it or wait
+  // for jobs queued there.
+  CHECK_EQ(map_list.size(), key_list.size());
+  std::vector<AlignedUniquePtr<MapType>> maps(map_list.size());
+  std::vector<char> loaded(map_list.size(), false);
+  constexpr bool kAlwaysParallelize = true;
+  common::ParallelProcess(
+      map_list.size(),
+      [&](const std::vector<size_t>& range) {
+        for (const size_t map_idx : range) {
+          CHECK(isKeyValid(key_list[map_idx]));
+          maps[map_idx] = aligned_unique<MapType>();
+          loaded[map_idx] = traits<MapType>::loadFromFolder(
+              map_list[map_idx], maps[map_idx].get());
+        }
+      },
+      kAlwaysParallelize,
+      std::min(map_list.size(), common::getNumHardwareThreads()));
+  for (size_t i = 0u; i < map_list.size(); ++i) {
+    if (!loaded[i]) {
+      LOG(ERROR) << "Loading the map " << map_list[i]
+                 << " failed. No maps will be loaded.";
       return false;
     }
+  }
+
+  // Either all maps are inserted or none.
+  aslam::ScopedWriteLock lock(map_storage_->getContainerMutex());
+  for (const std::string& map_key : key_list) {
     if (map_storage_->hasMap(map_key)) {
       LOG(ERROR) << "No maps will be loaded because a map with key \""
-                 << map_key << "\" already exists in the storage.";
+                 << map_key << "\" was added to the storage meanwhile.";
       return false;
     }
   }
-
+  for (size_t i = 0u; i < map_list.size(); ++i) {
+    map_storage_->addMap(key_list[i], maps[i]);
+    VLOG(1) << "Loaded map " << key_list[i];
+  }
   if (new_keys != nullptr) {
     new_keys->insert(key_list.cbegin(), key_list.cend());
   }
-
-  // Load and insert all maps.
-  CHECK_EQ(map_list.size(), key_list.size());
-  for (size_t i = 0u; i < map_list.size(); ++i) {
-    const std::string& map_folder = map_list[i];
-    const std::string& key_name = key_list[i];
-    CHECK(!map_folder.empty());
-    CHECK(!key_name.empty());
-    CHECK(isKeyValid(key_name));
-    CHECK(!map_storage_->hasMap(key_name));
-
-    AlignedUniquePtr<MapType> map = aligned_unique<MapType>();
-    CHECK(traits<MapType>::loadFromFolder(map_folder, map.get()))
-        << "Loading map " << map_folder << " failed.";
-    map_storage_->addMap(key_name, map);
-    VLOG(1) << "Loaded map " << key_name;
-  }
   return true;
 }
 
@@ -355,20 +445,58 @@ template <typename MapType>
 bool MapManager<MapType>::saveMapToFolder(
     const std::string& key, const std::string& folder_path,
     const SaveConfig& config) const {
+  constexpr AsyncMapJob* kNoJob = nullptr;
+  return saveMapFromStorage(key, folder_path, config, map_storage_, kNoJob);
+}
+
+template <typename MapType>
+bool MapManager<MapType>::saveMapFromStorage(
+    const std::string& key, const std::string& folder_path,
+    const SaveConfig& config, MapStorage<MapType>* map_storage,
+    AsyncMapJob* job) {
+  CHECK_NOTNULL(map_storage);
   CHECK(!key.empty());
   CHECK(!folder_path.empty());
 
-  map_storage_->getContainerMutex()->acquireReadLock();
-  if (!map_storage_->hasMap(key)) {
-    map_storage_->getContainerMutex()->releaseReadLock();
+  map_storage->getContainerMutex()->acquireReadLock();
+  if (!map_storage->hasMap(key)) {
+    map_storage->getContainerMutex()->releaseReadLock();
     LOG(ERROR) << "Map with key \"" << key << "\" doesn't exist.";
     return false;
   }
-  MapWriteAccess map = map_storage_->getMapWriteAccess(key);
-  map_storage_->getContainerMutex()->releaseReadLock();
+  MapWriteAccess map = map_storage->getMapWriteAccess(key);
+  map_storage->getContainerMutex()->releaseReadLock();
+  // Acquiring the map may have taken a while if it was in use.
+  if (job != nullptr && job->isCancellationRequested()) {
+    return false;
+  }
   return traits<MapType>::saveToFolder(folder_path, config, map.get());
 }
 
+template <typename MapType>
+AsyncMapJob::Ptr MapManager<MapType>::saveMapAsync(
+    const std::string& key, const std::string& folder_path) const {
+  const SaveConfig config;
+  return saveMapAsync(key, folder_path, config);
+}
+
+template <typename MapType>
+AsyncMapJob::Ptr MapManager<MapType>::saveMapAsync(
+    const std::string& key, const std::string& folder_path,
+    const SaveConfig& config) const {
+  CHECK(!key.empty());
+  CHECK(!folder_path.empty());
+  AsyncMapJob::Ptr job = std::make_shared<AsyncMapJob>(key);
+  MapStorage<MapType>* map_storage = map_storage_;
+  runAsyncJob(
+      [key, folder_path, config, map_storage](AsyncMapJob* running_job) {
+        return saveMapFromStorage(
+            key, folder_path, config, map_storage, running_job);
+      },
+      job);
+  return job;
+}
+
 template <typename MapType>
 bool MapManager<MapType>::saveMapToMapFolder(const std::string& key) const {
   const SaveConfig config;
@@ -402,61 +530,77 @@ bool MapManager<MapType>::saveAllMapsToFolder(
     }
   }
 
-  // Get all map keys.
-  aslam::ScopedReadLock lock(map_storage_->getContainerMutex());
-  std::unordered_set<std::string> all_map_keys_list;
-  map_storage_->getAllMapKeys(&all_map_keys_list);
-
-  if (all_map_keys_list.empty()) {
-    LOG(ERROR) << "No maps stored that could be saved.";
-    return false;
-  }
-
   std::unordered_map<std::string, std::string> key_to_folder_map;
+  {
+    // Get all map keys.
+    aslam::ScopedReadLock lock(map_storage_->getContainerMutex());
+    std::unordered_set<std::string> all_map_keys_list;
+    map_storage_->getAllMapKeys(&all_map_keys_list);
 
-  // Check if all maps can be saved.
-  for (const std::string& key : all_map_keys_list) {
-    std::string complete_folder_path;
-    if (folder_path.empty()) {
-      // If the map gets saved into the map folder, there is no need to append
-      // the key.
-      typename common::Monitor<MapType>::ReadAccess map =
-          map_storage_->getMapReadAccess(key);
-      if (!traits<MapType>::hasMapFolder(*map)) {
-        LOG(ERROR) << "Can't save map \"" << key
-                   << "\" to map folder because it doesn't have a map folder "
-                      "associated with it.";
-        return false;
-      }
-      traits<MapType>::getMapFolder(*map, &complete_folder_path);
-    } else {
-      common::concatenateFolderAndFileName(
-          folder_path, key, &complete_folder_path);
+    if (all_map_keys_list.empty()) {
+      LOG(ERROR) << "No maps stored that could be saved.";
+      return false;
     }
 
-    key_to_folder_map.emplace(key, complete_folder_path);
+    // Check if all maps can be saved.
+    for (const std::string& key : all_map_keys_list) {
+      std::string complete_folder_path;
+      if (folder_path.empty()) {
+        // If the map gets saved into the map folder, there is no need to
+        // append the key.
+        typename common::Monitor<MapType>::ReadAccess map =
+            map_storage_->getMapReadAccess(key);
+        if (!traits<MapType>::hasMapFolder(*map)) {
+          LOG(ERROR) << "Can't save map \"" << key
+                     << "\" to map folder because it doesn't have a map "
+                        "folder associated with it.";
+          return false;
+        }
+        traits<MapType>::getMapFolder(*map, &complete_folder_path);
+      } else {
+        common::concatenateFolderAndFileName(
+            folder_path, key, &complete_folder_path);
+      }
 
-    common::concatenateFolderAndFileName(
-        complete_folder_path, traits<MapType>::getSubFolderName(),
-        &complete_folder_path);
-    if (!config.overwrite_existing_files &&
-        (common::pathExists(complete_folder_path) ||
-         common::fileExists(complete_folder_path))) {
-      LOG(ERROR) << "No maps will be saved because this folder \""
-                 << complete_folder_path << "\" already contains a map!";
-      return false;
-    }
-  }
+      key_to_folder_map.emplace(key, complete_folder_path);
 
-  // Save all maps.
-  for (const std::string& key : all_map_keys_list) {
-    MapWriteAccess map = map_storage_->getMapWriteAccess(key);
-    CHECK(
-        traits<MapType>::saveToFolder(
-            key_to_folder_map[key], config, map.get()));
+      common::concatenateFolderAndFileName(
+          complete_folder_path, traits<MapType>::getSubFolderName(),
+          &complete_folder_path);
+      if (!config.overwrite_existing_files &&
+          (common::pathExists(complete_folder_path) ||
+           common::fileExists(complete_folder_path))) {
+        LOG(ERROR) << "No maps will be saved because this folder \""
+                   << complete_folder_path << "\" already contains a map!";
+        return false;
+      }
+    }
   }
 
-  return true;
+  // Save all maps in parallel on dedicated threads, for the same reason as in
+  // loadAllMapsFromFolder(). The container lock is released, as every save
+  // acquires it to look up its map.
+  const std::vector<std::pair<std::string, std::string>> keys_and_folders(
+      key_to_folder_map.begin(), key_to_folder_map.end());
+  std::atomic<bool> success(true);
+  constexpr bool kAlwaysParallelize = true;
+  constexpr AsyncMapJob* kNoJob = nullptr;
+  common::ParallelProcess(
+      keys_and_folders.size(),
+      [&](const std::vector<size_t>& range) {
+        for (const size_t map_idx : range) {
+          const std::string& key = keys_and_folders[map_idx].first;
+          if (!saveMapFromStorage(
+                  key, keys_and_folders[map_idx].second, config, map_storage_,
+                  kNoJob)) {
+            LOG(ERROR) << "Saving the map \"" << key << "\" failed.";
+            success = false;
+          }
+        }
+      },
+      kAlwaysParallelize,
+      std::min(keys_and_folders.size(), common::getNumHardwareThreads()));
+  return success;
 }
 
 template <typename MapType>
@@ -1,6 +1,7 @@
 #ifndef MAP_MANAGER_MAP_MANAGER_H_
 #define MAP_MANAGER_MAP_MANAGER_H_
 
+#include <functional>
 #include <string>
 #include <type_traits>
 #include <unordered_set>
@@ -9,6 +10,7 @@
 #include <maplab-common/map-manager-config.h>
 #include <maplab-common/monitor.h>
 
+#include "map-manager/async-map-job.h"
 #include "map-manager/map-storage.h"
 
 namespace backend {
@@ -166,7 +168,9 @@ class MapManager {
   /// \brief Copies the map specified by \p source_key into \p target_key.
   ///
   /// Crashes if the source map doesn't exist or if a map under \p target_key
-  /// already exists.
+  /// already exists. Map types can implement the copy as a copy-on-write
+  /// snapshot, e.g. the VIMap only clones the vertices and edges that are
+  /// modified afterwards in either of the two maps.
   /// \param source_key Key of the map to be copied.
   /// \param target_key Key under which the copy will be stored.
   void copyMap(const std::string& source_key, const std::string& target_key);
@@ -216,6 +220,19 @@ class MapManager {
   bool loadMapFromFolder(const std::string& folder_path, std::string* key_out);
   bool loadMapFromFolder(const std::string& folder_path);
 
+  /// \brief Loads a map from the given folder in the background.
+  ///
+  /// The map is loaded without holding any lock of the storage, so all other
+  /// maps stay usable meanwhile. It is only inserted into the storage once it
+  /// is completely loaded; loading fails if a map with the same key exists by
+  /// then. The operations run on a pool of
+  /// FLAGS_map_manager_num_async_threads threads.
+  /// \param[in] folder_path Path to the folder containing the map data.
+  /// \param[in] key Key under which the map is stored.
+  /// \returns Handle to monitor, wait for or cancel the operation.
+  AsyncMapJob::Ptr loadMapAsync(
+      const std::string& folder_path, const std::string& key);
+
   /// \brief Loads all maps in a given folder.
   ///
   /// This method recursively scans the given folder and searches for a map file
@@ -224,7 +241,8 @@ class MapManager {
   ///
   /// The keys under which the maps are stored are determined by the filename.
   /// If a key already
-  /// exists in the storage, this operation will fail.
+  /// exists in the storage, this operation will fail. The maps are loaded in
+  /// parallel and only inserted into the storage if all of them are loaded.
   /// \param folder_path Path of the folder containing the maps to load.
   /// \returns True if all maps in the folder are successfully loaded and at
   /// least one map has been loaded.
@@ -252,6 +270,19 @@ class MapManager {
       const std::string& key, const std::string& folder_path,
       const SaveConfig& config) const;
 
+  /// \brief Saves a map to a folder in the background.
+  ///
+  /// Same as saveMapToFolder() but returns immediately. Only the saved map is
+  /// locked while it is written to the file system.
+  /// \param key Key of the map to save.
+  /// \param folder_path Folder in which the map should be saved.
+  /// \returns Handle to monitor, wait for or cancel the operation.
+  AsyncMapJob::Ptr saveMapAsync(
+      const std::string& key, const std::string& folder_path) const;
+  AsyncMapJob::Ptr saveMapAsync(
+      const std::string& key, const std::string& folder_path,
+      const SaveConfig& config) const;
+
   /// \brief Saves a map into its map folder as specified by the map's metadata.
   /// \param key Key of the map to save.
   /// \param overwrite_existing_file If set to true, any already existing file
@@ -275,7 +306,8 @@ class MapManager {
   /// \param overwrite_existing_file If set to true, any already existing file
   /// will be overwritten.
   /// Set to false by default.
-  /// \returns True if all maps are successfully saved.
+  /// \returns True if all maps are successfully saved. The maps are saved in
+  /// parallel.
   bool saveAllMapsToFolder(const std::string& folder_path) const;
   bool saveAllMapsToFolder(
       const std::string& folder_path, const SaveConfig& config) const;
@@ -311,6 +343,23 @@ class MapManager {
                            std::vector<std::string>* map_list);
 
  protected:
+  /// \brief Implementation of the synchronous and asynchronous loading and
+  /// saving. The job is optional and used to report progress and check for
+  /// cancellation.
+  static bool loadMapIntoStorage(
+      const std::string& folder_path, const std::string& key,
+      MapStorage<MapType>* map_storage, AsyncMapJob* job);
+  static bool saveMapFromStorage(
+      const std::string& key, const std::string& folder_path,
+      const SaveConfig& config, MapStorage<MapType>* map_storage,
+      AsyncMapJob* job);
+
+  /// \brief Runs the given operation on the thread pool of the storage and
+  /// tracks it with the job.
+  void runAsyncJob(
+      const std::function<bool(AsyncMapJob*)>& operation,
+      const AsyncMapJob::Ptr& job) const;
+
   MapStorage<MapType>* map_storage_;
 };
 
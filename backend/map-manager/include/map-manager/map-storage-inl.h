@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -10,8 +11,10 @@
 
 #include <aslam/common/memory.h>
 #include <aslam/common/reader-writer-lock.h>
+#include <aslam/common/thread-pool.h>
 #include <glog/logging.h>
 
+#include "map-manager/async-map-job.h"
 #include "map-manager/map-storage.h"
 
 namespace backend {
@@ -189,6 +192,16 @@ aslam::ReaderWriterMutex* MapStorage<MapType>::getContainerMutex() const {
   return &container_mutex_;
 }
 
+template <typename MapType>
+aslam::ThreadPool* MapStorage<MapType>::getAsyncJobThreadPool() {
+  std::call_once(async_job_thread_pool_flag_, [this]() {
+    CHECK_GT(FLAGS_map_manager_num_async_threads, 0);
+    async_job_thread_pool_.reset(new aslam::ThreadPool(
+        static_cast<size_t>(FLAGS_map_manager_num_async_threads)));
+  });
+  return CHECK_NOTNULL(async_job_thread_pool_.get());
+}
+
 }  // namespace backend
 
 #endif  // MAP_MANAGER_MAP_STORAGE_INL_H_
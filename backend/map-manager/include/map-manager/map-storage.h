@@ -2,6 +2,7 @@
 #define MAP_MANAGER_MAP_STORAGE_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -9,6 +10,7 @@
 
 #include <aslam/common/memory.h>
 #include <aslam/common/reader-writer-lock.h>
+#include <aslam/common/thread-pool.h>
 #include <maplab-common/macros.h>
 #include <maplab-common/monitor.h>
 
@@ -163,6 +165,11 @@ class MapStorage {
   /// \returns Pointer to the MapStorage's ReaderWriterMutex.
   aslam::ReaderWriterMutex* getContainerMutex() const;
 
+  /// \brief Returns the thread pool that runs the asynchronous operations of
+  /// the MapManager. The pool is created on first use.
+  /// \returns Pointer to the thread pool.
+  aslam::ThreadPool* getAsyncJobThreadPool();
+
  private:
   /// \brief Container which stores all the maps.
   typedef typename std::unordered_map<std::string, std::unique_ptr<MapAndMutex>>
@@ -191,6 +198,12 @@ class MapStorage {
   MapStorageContainer map_storage_container_;
 
   mutable aslam::ReaderWriterMutex container_mutex_;
+
+  /// \brief Runs the asynchronous load and save operations. Declared last
+  /// such that the pending operations are finished before the maps are
+  /// destroyed.
+  std::once_flag async_job_thread_pool_flag_;
+  std::unique_ptr<aslam::ThreadPool> async_job_thread_pool_;
 };
 
 }  // namespace backend
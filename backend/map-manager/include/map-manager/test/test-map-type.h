@@ -29,11 +29,11 @@ class TestMapType : public MapInterface<TestMapType> {
     return false;
   }
   virtual bool loadFromFolder(const std::string& /*folder_path*/) {
-    return false;
+    return true;
   }
   virtual bool saveToFolder(
       const std::string& /*folder_path*/, const SaveConfig& /*config*/) {
-    return false;
+    return true;
   }
 
   void incrementCounter() {
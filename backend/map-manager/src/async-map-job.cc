@@ -0,0 +1,110 @@
+#include "map-manager/async-map-job.h"
+
+#include <string>
+
+#include <glog/logging.h>
+
+DEFINE_int32(
+    map_manager_num_async_threads, 2,
+    "Number of threads used by the map manager to load and save maps in the "
+    "background.");
+
+namespace backend {
+
+AsyncMapJob::AsyncMapJob(const std::string& map_key)
+    : map_key_(map_key),
+      cancellation_requested_(false),
+      progress_(0.0),
+      state_(State::kQueued) {}
+
+AsyncMapJob::State AsyncMapJob::getState() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return state_;
+}
+
+bool AsyncMapJob::isFinished() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return isFinishedState(state_);
+}
+
+bool AsyncMapJob::cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (isFinishedState(state_)) {
+    return false;
+  }
+  cancellation_requested_ = true;
+  return true;
+}
+
+bool AsyncMapJob::wait() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  state_changed_.wait(lock, [this]() { return isFinishedState(state_); });
+  return state_ == State::kSucceeded;
+}
+
+std::string AsyncMapJob::stateToString(const State state) {
+  switch (state) {
+    case State::kQueued:
+      return "queued";
+    case State::kRunning:
+      return "running";
+    case State::kSucceeded:
+      return "succeeded";
+    case State::kFailed:
+      return "failed";
+    case State::kCancelled:
+      return "cancelled";
+    default:
+      LOG(FATAL) << "Unknown state: " << static_cast<int>(state);
+  }
+  return "";
+}
+
+bool AsyncMapJob::start() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(state_ == State::kQueued);
+    if (!cancellation_requested_) {
+      state_ = State::kRunning;
+      return true;
+    }
+  }
+  CHECK(finishIfCancelled());
+  return false;
+}
+
+bool AsyncMapJob::finishIfCancelled() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!isFinishedState(state_));
+    if (!cancellation_requested_) {
+      return false;
+    }
+    state_ = State::kCancelled;
+  }
+  VLOG(1) << "Cancelled job for map \"" << map_key_ << "\".";
+  state_changed_.notify_all();
+  return true;
+}
+
+void AsyncMapJob::setProgress(const double progress) {
+  CHECK_GE(progress, 0.0);
+  CHECK_LE(progress, 1.0);
+  progress_ = progress;
+}
+
+void AsyncMapJob::finish(const bool success) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!isFinishedState(state_));
+    if (success) {
+      progress_ = 1.0;
+      state_ = State::kSucceeded;
+    } else {
+      state_ = State::kFailed;
+    }
+  }
+  state_changed_.notify_all();
+}
+
+}  // namespace backend
@@ -2,6 +2,7 @@
 #include <string>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include <aslam/common/memory.h>
 #include <gtest/gtest.h>
@@ -312,4 +313,70 @@ TEST_F(MapManagerBasicTest, ReleaseMapWhileInUse) {
   }
 }
 
+TEST_F(MapManagerBasicTest, LoadMapAsync) {
+  const std::string kMapFolder = "async_test_map_folder";
+  backend::AsyncMapJob::Ptr job =
+      map_manager_.loadMapAsync(kMapFolder, TestStrings::kFirstMapKey);
+  ASSERT_TRUE(job != nullptr);
+  EXPECT_EQ(TestStrings::kFirstMapKey, job->getMapKey());
+  EXPECT_TRUE(job->wait());
+  EXPECT_TRUE(job->isFinished());
+  EXPECT_EQ(backend::AsyncMapJob::State::kSucceeded, job->getState());
+  EXPECT_DOUBLE_EQ(1.0, job->getProgress());
+  EXPECT_TRUE(map_manager_.hasMap(TestStrings::kFirstMapKey));
+  EXPECT_FALSE(job->cancel());
+
+  // Loading into an existing key fails without touching the existing map.
+  backend::AsyncMapJob::Ptr second_job =
+      map_manager_.loadMapAsync(kMapFolder, TestStrings::kFirstMapKey);
+  EXPECT_FALSE(second_job->wait());
+  EXPECT_EQ(backend::AsyncMapJob::State::kFailed, second_job->getState());
+  EXPECT_EQ(1u, map_manager_.numberOfMaps());
+}
+
+TEST_F(MapManagerBasicTest, SaveMapAsync) {
+  const std::string kMapFolder = "async_test_map_folder";
+  addSampleMapToStorage();
+  backend::AsyncMapJob::Ptr job =
+      map_manager_.saveMapAsync(TestStrings::kFirstMapKey, kMapFolder);
+  EXPECT_TRUE(job->wait());
+  EXPECT_EQ(backend::AsyncMapJob::State::kSucceeded, job->getState());
+
+  backend::AsyncMapJob::Ptr missing_map_job =
+      map_manager_.saveMapAsync(TestStrings::kSecondMapKey, kMapFolder);
+  EXPECT_FALSE(missing_map_job->wait());
+  EXPECT_EQ(backend::AsyncMapJob::State::kFailed, missing_map_job->getState());
+}
+
+TEST_F(MapManagerBasicTest, CancelQueuedAsyncJob) {
+  const std::string kMapFolder = "async_test_map_folder";
+  addSampleMapToStorage();
+
+  std::vector<backend::AsyncMapJob::Ptr> save_jobs;
+  backend::AsyncMapJob::Ptr load_job;
+  {
+    // Keep all threads of the pool busy with saves that wait for the map.
+    backend::MapManager<backend::TestMapType>::MapWriteAccess map =
+        map_manager_.getMapWriteAccess(TestStrings::kFirstMapKey);
+    ASSERT_GT(FLAGS_map_manager_num_async_threads, 0);
+    for (int i = 0; i < FLAGS_map_manager_num_async_threads; ++i) {
+      save_jobs.emplace_back(
+          map_manager_.saveMapAsync(TestStrings::kFirstMapKey, kMapFolder));
+    }
+    load_job =
+        map_manager_.loadMapAsync(kMapFolder, TestStrings::kSecondMapKey);
+    EXPECT_FALSE(load_job->waitFor(std::chrono::milliseconds(10)));
+    EXPECT_EQ(backend::AsyncMapJob::State::kQueued, load_job->getState());
+    EXPECT_TRUE(load_job->cancel());
+    EXPECT_TRUE(load_job->isCancellationRequested());
+  }
+
+  for (const backend::AsyncMapJob::Ptr& save_job : save_jobs) {
+    EXPECT_TRUE(save_job->wait());
+  }
+  EXPECT_FALSE(load_job->wait());
+  EXPECT_EQ(backend::AsyncMapJob::State::kCancelled, load_job->getState());
+  EXPECT_FALSE(map_manager_.hasMap(TestStrings::kSecondMapKey));
+}
+
 MAPLAB_UNITTEST_ENTRYPOINT
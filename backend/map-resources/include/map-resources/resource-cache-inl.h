@@ -59,6 +59,20 @@ void ResourceCache::putResource(
   updateCacheSizeStatistic<DataType>(type, *cache, &statistic_);
 }
 
+template <typename DataType>
+bool ResourceCache::hasResource(
+    const ResourceId& id, const ResourceType& type) {
+  typename Cache<DataType>::ResourceDeque* cache = getCache<DataType>(type);
+  if (cache == nullptr) {
+    return false;
+  }
+  return std::find_if(
+             cache->begin(), cache->end(),
+             [id](const typename Cache<DataType>::Element& element) {
+               return element.first == id;
+             }) != cache->end();
+}
+
 template <typename DataType>
 bool ResourceCache::deleteResource(
     const ResourceId& id, const ResourceType& type) {
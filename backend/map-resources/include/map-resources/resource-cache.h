@@ -54,6 +54,10 @@ class ResourceCache {
   void putResource(
       const ResourceId& id, const ResourceType& type, const DataType& resource);
 
+  // Unlike getResource, does not count as a cache hit or miss.
+  template <typename DataType>
+  bool hasResource(const ResourceId& id, const ResourceType& type);
+
   template <typename DataType>
   bool deleteResource(const ResourceId& id, const ResourceType& type);
 
@@ -31,16 +31,40 @@ void ResourceLoader::getResource(
     DataType* resource) const {
   CHECK(!folder.empty());
   CHECK_NOTNULL(resource);
-  if (cache_.getResource<DataType>(id, type, resource)) {
+  if (getCachedResource<DataType>(id, type, resource)) {
     return;
-  } else {
-    std::string file_path;
-    getResourceFilePath(id, type, folder, &file_path);
-    CHECK(loadResourceFromFile(file_path, type, resource))
-        << "Failed to load " << ResourceTypeNames[static_cast<size_t>(type)]
-        << " resource with id " << id.hexString()
-        << " from file: " << file_path;
-    cache_.putResource<DataType>(id, type, *resource);
+  }
+  loadResource<DataType>(id, type, folder, resource);
+  cache_.putResource<DataType>(id, type, *resource);
+}
+
+template <typename DataType>
+bool ResourceLoader::getCachedResource(
+    const ResourceId& id, const ResourceType& type, DataType* resource) const {
+  CHECK_NOTNULL(resource);
+  return cache_.getResource<DataType>(id, type, resource);
+}
+
+template <typename DataType>
+void ResourceLoader::loadResource(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    DataType* resource) const {
+  CHECK(!folder.empty());
+  CHECK_NOTNULL(resource);
+  std::string file_path;
+  getResourceFilePath(id, type, folder, &file_path);
+  CHECK(loadResourceFromFile(file_path, type, resource))
+      << "Failed to load " << ResourceTypeNames[static_cast<size_t>(type)]
+      << " resource with id " << id.hexString()
+      << " from file: " << file_path;
+}
+
+template <typename DataType>
+void ResourceLoader::cacheResource(
+    const ResourceId& id, const ResourceType& type,
+    const DataType& resource) const {
+  if (!cache_.hasResource<DataType>(id, type)) {
+    cache_.putResource<DataType>(id, type, resource);
   }
 }
 
@@ -32,6 +32,23 @@ class ResourceLoader {
       const ResourceId& id, const ResourceType& type, const std::string& folder,
       DataType* resource) const;
 
+  // The steps of getResource, for callers that load the file without holding
+  // the lock that protects the cache. Only loadResource may run concurrently
+  // with other calls, the cache itself is not thread-safe.
+  template <typename DataType>
+  bool getCachedResource(
+      const ResourceId& id, const ResourceType& type,
+      DataType* resource) const;
+  template <typename DataType>
+  void loadResource(
+      const ResourceId& id, const ResourceType& type, const std::string& folder,
+      DataType* resource) const;
+  // Does nothing if the resource has been cached in the meantime.
+  template <typename DataType>
+  void cacheResource(
+      const ResourceId& id, const ResourceType& type,
+      const DataType& resource) const;
+
   template <typename DataType>
   bool checkResourceFile(
       const ResourceId& id, const ResourceType& type,
@@ -14,19 +14,29 @@ template <typename DataType>
 bool ResourceMap::getResource(
     const ResourceId& id, const ResourceType& type, DataType* resource) const {
   CHECK_NOTNULL(resource);
-  aslam::ScopedWriteLock lock(&resource_mutex_);
-  const ResourceInfoMap& info_map =
-      resource_info_map_[static_cast<size_t>(type)];
-  const ResourceInfoMap::const_iterator it = info_map.find(id);
-  if (it == info_map.cend()) {
-    return false;
-  } else {
-    std::string folder;
+  std::string folder;
+  {
+    // Looking up the cache updates its statistics.
+    aslam::ScopedWriteLock lock(&resource_mutex_);
+    const ResourceInfoMap& info_map =
+        resource_info_map_[static_cast<size_t>(type)];
+    const ResourceInfoMap::const_iterator it = info_map.find(id);
+    if (it == info_map.cend()) {
+      return false;
+    }
     getFolderFromIndex(it->second.folder_idx, &folder);
-
-    resource_loader_.getResource<DataType>(id, type, folder, resource);
-    return true;
+    if (resource_loader_.getCachedResource<DataType>(id, type, resource)) {
+      return true;
+    }
   }
+
+  // Loading the file is the expensive part, hence several resources can be
+  // loaded concurrently.
+  resource_loader_.loadResource<DataType>(id, type, folder, resource);
+
+  aslam::ScopedWriteLock lock(&resource_mutex_);
+  resource_loader_.cacheResource<DataType>(id, type, *resource);
+  return true;
 }
 
 template <typename DataType>
@@ -92,6 +102,30 @@ void ResourceMap::addResourceImpl(
   resource_loader_.addResource<DataType>(id, type, folder_to_use, resource);
 }
 
+template <typename DataType>
+void ResourceMap::writeResourceFile(
+    const ResourceType& type, const DataType& resource,
+    PendingResource* pending_resource) const {
+  CHECK_NOTNULL(pending_resource);
+  std::string folder;
+  {
+    aslam::ScopedReadLock lock(&resource_mutex_);
+    pending_resource->folder_idx = meta_data_.resource_folder_in_use;
+    getFolderFromIndex(pending_resource->folder_idx, &folder);
+  }
+  CHECK(!folder.empty());
+  common::generateId(&pending_resource->id);
+  pending_resource->type = type;
+
+  // Writing the file is the expensive part and does not touch any state of
+  // the resource map. The newest resource is not cached, as the cache is only
+  // accessed while holding the lock.
+  std::string file_path;
+  resource_loader_.getResourceFilePath(
+      pending_resource->id, type, folder, &file_path);
+  resource_loader_.saveResourceToFile<DataType>(file_path, type, resource);
+}
+
 template <typename DataType>
 bool ResourceMap::deleteResource(
     const ResourceId& id, const ResourceType& type) {
@@ -75,6 +75,15 @@ class ResourceMap {
     std::vector<std::string> external_resource_folders;
   };
 
+  // A resource whose file has been written with writeResourceFile, but that
+  // has not been registered in the resource map yet.
+  struct PendingResource {
+    ResourceId id;
+    ResourceType type;
+    ResourceFolderIndex folder_idx = kUnknownResourceFolder;
+  };
+  typedef std::vector<PendingResource> PendingResourceList;
+
   void migrateAllResourcesToFolder(
       const std::string& resource_folder, const bool move_resources);
   void migrateAllResourcesToMapResourceFolder(const bool move_resources);
@@ -192,10 +201,26 @@ class ResourceMap {
   void addResource(
       const ResourceType& type, const DataType& resource, const ResourceId& id);
 
+  // The resource file is read without holding the resource lock, so several
+  // threads can load resources at the same time. The resource must not be
+  // deleted, replaced or migrated while it is loaded.
   template <typename DataType>
   bool getResource(
       const ResourceId& id, const ResourceType& type, DataType* resource) const;
 
+  // Two-phase alternative to addResource for bulk imports: writeResourceFile
+  // stores the resource in the folder in use and generates a new resource id,
+  // but only takes the resource lock to look up the folder. Hence, many
+  // resources can be encoded and written concurrently. The written resources
+  // then have to be registered with registerResources, which takes the lock
+  // once for the whole batch. The resource folder in use must not be changed
+  // between the two calls.
+  template <typename DataType>
+  void writeResourceFile(
+      const ResourceType& type, const DataType& resource,
+      PendingResource* pending_resource) const;
+  void registerResources(const PendingResourceList& pending_resources);
+
   // Returns true if the resource was successfully deleted, false if it didn't
   // exist in the first place. By default it also deletes the file on the
   // file-system.
@@ -292,6 +292,20 @@ ResourceMap::ResourceFolderIndex ResourceMap::getIndexFromFolder(
   return kUnknownResourceFolder;
 }
 
+void ResourceMap::registerResources(
+    const PendingResourceList& pending_resources) {
+  aslam::ScopedWriteLock lock(&resource_mutex_);
+  for (const PendingResource& pending_resource : pending_resources) {
+    CHECK(pending_resource.id.isValid());
+    CHECK_NE(pending_resource.folder_idx, kUnknownResourceFolder);
+    ResourceInfoMap& info_map =
+        resource_info_map_[static_cast<size_t>(pending_resource.type)];
+    auto it = info_map.emplace(pending_resource.id, ResourceInfo());
+    CHECK(it.second) << "ResourceId collision!";
+    it.first->second.folder_idx = pending_resource.folder_idx;
+  }
+}
+
 void ResourceMap::getFolderFromIndex(
     const ResourceMap::ResourceFolderIndex& index, std::string* folder) const {
   CHECK_NOTNULL(folder)->clear();
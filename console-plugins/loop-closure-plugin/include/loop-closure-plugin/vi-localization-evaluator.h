@@ -24,8 +24,11 @@ class VILocalizationEvaluator {
   };
 
   void alignMissionsForEvaluation(const vi_map::MissionId& query_mission_id);
-  void evaluateLocalizationPerformance(
-      const vi_map::MissionId& query_mission_id);
+  // Localizes the query missions against all other missions and writes the
+  // report to --eloc_report_file if set. Returns false if the report misses
+  // --eloc_min_recall or --eloc_max_p99_latency_ms.
+  bool evaluateLocalizationPerformance(
+      const vi_map::MissionIdList& query_mission_ids);
 
  private:
   vi_map::VIMap* map_;
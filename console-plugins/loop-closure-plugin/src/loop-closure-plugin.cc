@@ -2,6 +2,7 @@
 
 #include <console-common/console.h>
 #include <map-manager/map-manager.h>
+#include <maplab-common/string-tools.h>
 #include <posegraph/pose-graph.h>
 #include <posegraph/unique-id.h>
 #include <vi-map/vi-map-serialization.h>
@@ -13,6 +14,10 @@
 #include "loop-closure-plugin/vi-map-merger.h"
 
 DECLARE_string(map_mission);
+DEFINE_string(
+    eloc_query_missions, "",
+    "Comma-separated ids of the missions to evaluate the localization for. "
+    "If empty, --map_mission is used. All other missions form the database.");
 
 namespace loop_closure_plugin {
 
@@ -52,7 +57,9 @@ LoopClosurePlugin::LoopClosurePlugin(
       {"eloc", "evaluate_localization"},
       [this]() -> int { return evaluateLocalization(); },
       "Evaluation localization between a query and database missions. "
-      "Please align the missions first.",
+      "Please align the missions first. Use --eloc_query_missions to "
+      "evaluate several query missions at once and --eloc_report_file to "
+      "write the statistics to a file.",
       common::Processing::Sync);
 }
 
@@ -181,17 +188,39 @@ int LoopClosurePlugin::evaluateLocalization() const {
   vi_map::VIMapManager::MapWriteAccess map =
       map_manager.getMapWriteAccess(selected_map_key);
 
-  vi_map::MissionId query_mission_id;
-  map->ensureMissionIdValid(FLAGS_map_mission, &query_mission_id);
+  std::vector<std::string> query_mission_strings;
+  if (FLAGS_eloc_query_missions.empty()) {
+    query_mission_strings.push_back(FLAGS_map_mission);
+  } else {
+    constexpr bool kRemoveEmptyTokens = true;
+    common::tokenizeString(
+        FLAGS_eloc_query_missions, ',', kRemoveEmptyTokens,
+        &query_mission_strings);
+  }
 
-  if (!query_mission_id.isValid()) {
-    LOG(ERROR) << "The given mission \"" << FLAGS_map_mission
-               << "\" is not valid.";
-    return common::kUnknownError;
+  vi_map::MissionIdList query_mission_ids;
+  vi_map::MissionIdSet unique_query_mission_ids;
+  for (const std::string& query_mission_string : query_mission_strings) {
+    vi_map::MissionId query_mission_id;
+    map->ensureMissionIdValid(query_mission_string, &query_mission_id);
+    if (!query_mission_id.isValid()) {
+      LOG(ERROR) << "The given mission \"" << query_mission_string
+                 << "\" is not valid.";
+      return common::kUnknownError;
+    }
+    if (unique_query_mission_ids.insert(query_mission_id).second) {
+      query_mission_ids.push_back(query_mission_id);
+    }
+  }
+  if (query_mission_ids.empty()) {
+    LOG(ERROR) << "No query mission given.";
+    return common::kStupidUserError;
   }
 
   VILocalizationEvaluator evaluator(map.get(), getPlotterUnsafe());
-  evaluator.evaluateLocalizationPerformance(query_mission_id);
+  if (!evaluator.evaluateLocalizationPerformance(query_mission_ids)) {
+    return common::kUnknownError;
+  }
 
   return common::kSuccess;
 }
@@ -1,11 +1,35 @@
 #include "loop-closure-plugin/vi-localization-evaluator.h"
 
+#include <chrono>
+
+#include <gflags/gflags.h>
+#include <localization-evaluator/evaluation-report.h>
 #include <localization-evaluator/localization-evaluator.h>
 #include <localization-evaluator/mission-aligner.h>
 #include <maplab-common/file-system-tools.h>
+#include <maplab-common/threading-helpers.h>
+#include <maplab-common/yaml-serialization.h>
 #include <vi-map/unique-id.h>
 #include <vi-map/vi-map.h>
 
+DEFINE_uint64(
+    eloc_num_threads, 0u,
+    "Number of threads querying the localization database. 0 uses the number "
+    "of hardware threads.");
+DEFINE_string(
+    eloc_report_file, "",
+    "If set, the per-query results and the recall, latency and error "
+    "statistics of the localization evaluation are written to this YAML "
+    "file.");
+DEFINE_double(
+    eloc_min_recall, 0.0,
+    "The localization evaluation fails if the recall is below this value. "
+    "Disabled if 0.");
+DEFINE_double(
+    eloc_max_p99_latency_ms, 0.0,
+    "The localization evaluation fails if the 99th percentile of the query "
+    "latency exceeds this value in milliseconds. Disabled if 0.");
+
 namespace loop_closure_plugin {
 
 VILocalizationEvaluator::VILocalizationEvaluator(
@@ -31,15 +55,22 @@ void VILocalizationEvaluator::alignMissionsForEvaluation(
       kOptimizeOnlyQueryMission, map_);
 }
 
-void VILocalizationEvaluator::evaluateLocalizationPerformance(
-    const vi_map::MissionId& query_mission_id) {
+bool VILocalizationEvaluator::evaluateLocalizationPerformance(
+    const vi_map::MissionIdList& query_mission_ids) {
+  CHECK(!query_mission_ids.empty());
   vi_map::MissionIdList all_mission_ids;
   map_->getAllMissionIds(&all_mission_ids);
 
   vi_map::MissionIdSet db_mission_ids(
       all_mission_ids.begin(), all_mission_ids.end());
-  CHECK_GT(db_mission_ids.count(query_mission_id), 0u);
-  db_mission_ids.erase(query_mission_id);
+  for (const vi_map::MissionId& query_mission_id : query_mission_ids) {
+    CHECK_GT(db_mission_ids.count(query_mission_id), 0u);
+    db_mission_ids.erase(query_mission_id);
+  }
+  if (db_mission_ids.empty()) {
+    LOG(ERROR) << "There are no missions left to query against.";
+    return false;
+  }
 
   // Collect all database landmarks.
   vi_map::LandmarkIdSet selected_landmarks;
@@ -52,20 +83,41 @@ void VILocalizationEvaluator::evaluateLocalizationPerformance(
   LOG(INFO) << "Will query against " << selected_landmarks.size()
             << " landmarks.";
 
-  localization_evaluator::MissionEvaluationStats mission_statistics;
   localization_evaluator::LocalizationEvaluator benchmark(
       selected_landmarks, map_);
-  LOG(INFO) << "Evaluating the localizations.";
-  benchmark.evaluateMission(query_mission_id, &mission_statistics);
-
-  if (mission_statistics.num_vertices > 0u) {
-    LOG(INFO) << "Recall: "
-              << (static_cast<float>(
-                      mission_statistics.successful_localizations) /
-                  mission_statistics.num_vertices);
-  } else {
+  const size_t num_threads = (FLAGS_eloc_num_threads > 0u)
+                                 ? FLAGS_eloc_num_threads
+                                 : common::getNumHardwareThreads();
+  LOG(INFO) << "Evaluating the localizations of " << query_mission_ids.size()
+            << " missions with " << num_threads << " threads.";
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  localization_evaluator::QueryResultList results;
+  benchmark.evaluateMissions(query_mission_ids, num_threads, &results);
+  const double wall_time_seconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start_time)
+          .count();
+
+  if (results.empty()) {
     LOG(WARNING) << "No vertices evaluated!";
+    return false;
+  }
+
+  localization_evaluator::LocalizationEvaluationReport report;
+  localization_evaluator::createEvaluationReport(
+      results, FLAGS_benchmark_position_error_threshold, num_threads,
+      wall_time_seconds, &report);
+  localization_evaluator::printEvaluationReport(report);
+  LOG(INFO) << "Recall: " << report.overall.recall;
+
+  if (!FLAGS_eloc_report_file.empty()) {
+    YAML::Save(report, FLAGS_eloc_report_file);
+    LOG(INFO) << "Wrote the evaluation report to " << FLAGS_eloc_report_file
+              << ".";
   }
+  return localization_evaluator::checkEvaluationReport(
+      report, FLAGS_eloc_min_recall, FLAGS_eloc_max_p99_latency_ms);
 }
 
 }  // namespace loop_closure_plugin
@@ -31,6 +31,7 @@ class OptimizerPlugin : public common::ConsolePluginBaseWithPlotter {
   int optimizeVisualInertial();
   int optimizeOneMission();
   int relax();
+  int estimateLandmarkCovariances();
 };
 
 }  // namespace map_optimization_legacy_plugin
@@ -5,12 +5,19 @@
 #include <console-common/console.h>
 #include <map-manager/map-manager.h>
 #include <map-optimization-legacy/ba-optimization-options.h>
+#include <map-optimization-legacy/landmark-covariance-estimation.h>
 #include <vi-map/vi-map.h>
 #include <visualization/viwls-graph-plotter.h>
 
 #include "map-optimization-legacy-plugin/vi-map-optimizer-legacy.h"
 
 DECLARE_string(map_mission);
+DEFINE_bool(
+    lcov_use_submaps, false,
+    "Estimate the landmark covariances independently per submap of "
+    "consecutive vertices instead of over the whole map at once. Scales to "
+    "large maps, but ignores the uncertainty of the states outside of the "
+    "submaps.");
 
 namespace map_optimization_legacy_plugin {
 
@@ -39,6 +46,15 @@ OptimizerPlugin::OptimizerPlugin(
       "need to "
       "be present already.",
       common::Processing::Sync);
+
+  addCommand(
+      {"legacy_estimate_landmark_covariances", "lcov"},
+      [this]() -> int { return estimateLandmarkCovariances(); },
+      "Legacy - Estimate the position covariances of the landmarks while "
+      "holding the root vertex of every mission fixed. Set --lcov_use_submaps "
+      "to estimate them per submap of --cov_estimation_submap_num_vertices "
+      "vertices.",
+      common::Processing::Sync);
 }
 
 int OptimizerPlugin::optimizeVisionOnly() {
@@ -126,6 +142,32 @@ int OptimizerPlugin::relax() {
   return status;
 }
 
+int OptimizerPlugin::estimateLandmarkCovariances() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  vi_map::VIMapManager map_manager;
+  vi_map::VIMapManager::MapWriteAccess map =
+      map_manager.getMapWriteAccess(selected_map_key);
+
+  pose_graph::VertexIdSet fixed_vertices;
+  vi_map::MissionIdList mission_ids;
+  map->getAllMissionIds(&mission_ids);
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    fixed_vertices.insert(map->getMission(mission_id).getRootVertexId());
+  }
+
+  map_optimization_legacy::LandmarkCovarianceEstimation estimation(map.get());
+  if (FLAGS_lcov_use_submaps) {
+    estimation.assignCovarianceToLandmarksPartitioned(fixed_vertices);
+  } else {
+    estimation.assignCovarianceToLandmarks(fixed_vertices);
+  }
+  return common::kSuccess;
+}
+
 }  // namespace map_optimization_legacy_plugin
 
 MAPLAB_CREATE_CONSOLE_PLUGIN_WITH_PLOTTER(
@@ -100,18 +100,30 @@ void OptimizerPlugin::addExternalLoopClosureEdgesToMap(
   constexpr uint64_t kTimestampDifferenceToleranceNs =
       static_cast<uint64_t>(20e6);  // 20 ms
 
+  // Look up the vertices of all loop closures at once.
+  std::vector<uint64_t> timestamps_ns;
+  timestamps_ns.reserve(2u * edges.size());
   for (const data_import_export::LoopClosureEdge& edge : edges) {
-    pose_graph::VertexId id_from;
-    uint64_t timestamp_difference_from;
-    const bool found_from = vi_map_queries.getClosestVertexIdByTimestamp(
-        edge.from.timestamp_ns, kTimestampDifferenceToleranceNs, &id_from,
-        &timestamp_difference_from);
-
-    pose_graph::VertexId id_to;
-    uint64_t timestamp_difference_to;
-    const bool found_to = vi_map_queries.getClosestVertexIdByTimestamp(
-        edge.to.timestamp_ns, kTimestampDifferenceToleranceNs, &id_to,
-        &timestamp_difference_to);
+    timestamps_ns.push_back(edge.from.timestamp_ns);
+    timestamps_ns.push_back(edge.to.timestamp_ns);
+  }
+  pose_graph::VertexIdList vertex_ids;
+  std::vector<uint64_t> timestamp_differences;
+  vi_map_queries.getClosestVertexIdsByTimestamps(
+      timestamps_ns, kTimestampDifferenceToleranceNs, &vertex_ids,
+      &timestamp_differences);
+
+  for (size_t edge_idx = 0u; edge_idx < edges.size(); ++edge_idx) {
+    const data_import_export::LoopClosureEdge& edge = edges[edge_idx];
+    const pose_graph::VertexId& id_from = vertex_ids[2u * edge_idx];
+    const uint64_t timestamp_difference_from =
+        timestamp_differences[2u * edge_idx];
+    const bool found_from = id_from.isValid();
+
+    const pose_graph::VertexId& id_to = vertex_ids[2u * edge_idx + 1u];
+    const uint64_t timestamp_difference_to =
+        timestamp_differences[2u * edge_idx + 1u];
+    const bool found_to = id_to.isValid();
 
     if (!found_from || !found_to) {
       std::string msg = "Could not find a close enough vertex for:\n";
@@ -2,6 +2,7 @@
 
 #include <console-common/console.h>
 #include <csv-export/csv-export.h>
+#include <csv-export/streaming-export.h>
 #include <map-manager/map-manager.h>
 #include <maplab-common/file-logger.h>
 #include <vi-map-data-import-export/export-ncamera-calibration.h>
@@ -17,6 +18,10 @@ DECLARE_bool(csv_export_landmarks);
 DECLARE_bool(csv_export_observations);
 
 DEFINE_string(csv_export_path, "", "Path to save the map in CSV format into.");
+DEFINE_string(
+    csv_export_format, "csv",
+    "Output format of the streaming export. Options: csv, columnar (one flat "
+    "binary file per column).");
 DEFINE_string(
     mission_info_export_path, "", "Export path of the mission info yaml.");
 
@@ -82,6 +87,40 @@ DataImportExportPlugin::DataImportExportPlugin(common::Console* console)
       "Exports only vertices in a CSV file in a folder specified by "
       "--csv_export_path.",
       common::Processing::Sync);
+  addCommand(
+      {"csv_export_streaming"},
+      [this]() -> int {
+        std::string selected_map_key;
+        if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+          return common::kStupidUserError;
+        }
+
+        const std::string& save_path = FLAGS_csv_export_path;
+        if (save_path.empty()) {
+          LOG(ERROR) << "No path to export the map into has been specified. "
+                     << "Please specify using the --csv_export_path flag.";
+          return common::kStupidUserError;
+        }
+        csv_export::ExportFormat format;
+        if (!csv_export::exportFormatFromString(
+                FLAGS_csv_export_format, &format)) {
+          LOG(ERROR) << "Unknown export format \"" << FLAGS_csv_export_format
+                     << "\". Valid options are csv and columnar.";
+          return common::kStupidUserError;
+        }
+
+        vi_map::VIMapManager map_manager;
+        vi_map::VIMapManager::MapReadAccess map =
+            map_manager.getMapReadAccess(selected_map_key);
+        csv_export::exportMapStreaming(
+            *map, save_path, format, nullptr /*statistics*/);
+        return common::kSuccess;
+      },
+      "Exports the same data as csv_export into the folder specified by "
+      "--csv_export_path, writing all missions in parallel. Use "
+      "--csv_export_format=columnar to write one flat binary file per column "
+      "instead of CSV files.",
+      common::Processing::Sync);
 
   addCommand(
       {"export_mission_info"}, [this]() -> int { return exportMissionInfo(); },
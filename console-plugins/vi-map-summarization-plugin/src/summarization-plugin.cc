@@ -8,6 +8,11 @@
 #include <vi-map/vi-map.h>
 
 DEFINE_string(summary_map_save_path, "", "Save path of the summary map.");
+DEFINE_string(
+    summary_map_descriptor_precision, "float32",
+    "Precision of the projected descriptors in the saved summary map: "
+    "float32, float16 or int8. Summary maps with float16 or int8 descriptors "
+    "are saved in a compact binary format that is memory mapped on loading.");
 DECLARE_bool(overwrite);
 
 namespace summarization_plugin {
@@ -34,12 +39,22 @@ int SummarizationPlugin::saveSummaryMapToDisk() const {
     return common::kStupidUserError;
   }
 
+  summary_map::DescriptorPrecision descriptor_precision;
+  if (!summary_map::parseDescriptorPrecision(
+          FLAGS_summary_map_descriptor_precision, &descriptor_precision)) {
+    LOG(ERROR) << "Unknown descriptor precision \""
+               << FLAGS_summary_map_descriptor_precision << "\", use one of "
+               << "float32, float16 or int8.";
+    return common::kStupidUserError;
+  }
+
   vi_map::VIMapManager map_manager;
   vi_map::VIMapManager::MapReadAccess map =
       map_manager.getMapReadAccess(selected_map_key);
   summary_map::LocalizationSummaryMap summary_map;
   summary_map::createLocalizationSummaryMapForWellConstrainedLandmarks(
       *map, &summary_map);
+  summary_map.compressProjectedDescriptors(descriptor_precision);
 
   backend::SaveConfig save_config;
   save_config.overwrite_existing_files = FLAGS_overwrite;
@@ -40,6 +40,10 @@ struct PmvsConfig {
   double undistortion_alpha = 0.0;
   double undistortion_scale = 1.0;
   std::string reconstruction_folder = "";
+  // Threads computing the covisibility and undistorting and writing images.
+  size_t num_threads = 1u;
+  // Maximum number of loaded images that are not yet written to disk.
+  size_t max_num_images_in_flight = 16u;
 
   static PmvsConfig getFromGflags();
 };
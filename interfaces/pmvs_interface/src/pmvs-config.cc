@@ -4,6 +4,7 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <maplab-common/threading-helpers.h>
 
 DEFINE_bool(
     cmvs_use_only_good_landmarks, true,
@@ -26,6 +27,14 @@ DEFINE_double(
 DEFINE_double(pmvs_undistortion_scale, 1.0, "Scale of undistorted image.");
 DEFINE_string(
     pmvs_reconstruction_folder, "", "Output folder of the PMVS export.");
+DEFINE_uint64(
+    pmvs_num_threads, 0u,
+    "Number of threads used by the PMVS export. 0 uses the number of "
+    "hardware threads.");
+DEFINE_uint64(
+    pmvs_max_images_in_flight, 16u,
+    "Maximum number of images that are loaded but not yet written by the "
+    "PMVS export. Bounds its memory consumption.");
 
 namespace dense_reconstruction {
 
@@ -38,6 +47,10 @@ PmvsConfig PmvsConfig::getFromGflags() {
   settings.undistortion_alpha = FLAGS_pmvs_undistortion_alpha;
   settings.undistortion_scale = FLAGS_pmvs_undistortion_scale;
   settings.reconstruction_folder = FLAGS_pmvs_reconstruction_folder;
+  settings.num_threads = (FLAGS_pmvs_num_threads > 0u)
+                             ? FLAGS_pmvs_num_threads
+                             : common::getNumHardwareThreads();
+  settings.max_num_images_in_flight = FLAGS_pmvs_max_images_in_flight;
   return settings;
 }
 
@@ -51,6 +64,8 @@ void checkPmvsConfig(const PmvsConfig& config) {
   CHECK_GE(config.undistortion_alpha, 0.0);
   CHECK_LE(config.undistortion_alpha, 1.0);
   CHECK_GT(config.undistortion_scale, 0.0);
+  CHECK_GT(config.num_threads, 0u);
+  CHECK_GT(config.max_num_images_in_flight, 0u);
 }
 
 }  // namespace dense_reconstruction
@@ -1,16 +1,73 @@
 #include "dense-reconstruction/pmvs-file-utils.h"
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <Eigen/Core>
 #include <aslam/common/memory.h>
+#include <aslam/common/thread-pool.h>
 #include <glog/logging.h>
 #include <maplab-common/file-logger.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgproc/types_c.h>
 
 namespace dense_reconstruction {
+namespace {
+
+void writeObserverPoseAndImage(
+    const PmvsConfig& config, const std::string& image_folder,
+    const std::string& txt_folder, const ObserverCameraMap& observer_cameras,
+    const ObserverPose& observer_pose, const cv::Mat& distorted_image) {
+  const size_t observer_number = observer_pose.camera_number;
+  char image_name[1024];
+  snprintf(
+      image_name, sizeof(image_name), config.image_file_name_string.c_str(),
+      image_folder.c_str(), observer_number);
+
+  // The undistortion maps are computed once per camera and shared by all
+  // workers.
+  cv::Mat image = distorted_image;
+  if (observer_pose.needsUndistortion()) {
+    const ObserverCamera& observer_camera =
+        common::getChecked(observer_cameras, observer_pose.camera_id);
+    cv::Mat undistorted_image;
+    observer_camera.undistortImage(image, &undistorted_image);
+    image = undistorted_image;
+  }
+
+  cv::Mat color_image;
+  if (image.channels() == 3 && image.type() == CV_8UC3) {
+    color_image = image;
+  } else {
+    // PMVS expects color images, therefore we convert the grayscale image
+    // to a pseudo color image.
+    VLOG(2) << "Convert grayscale image to pseudo color image.";
+    cv::cvtColor(image, color_image, CV_GRAY2RGB);
+  }
+  // Save to visualize folder.
+  cv::imwrite(std::string(image_name), color_image);
+
+  // Write camera projection matrix to txt folder.
+  char camera_file_name_buffer[1024];
+  snprintf(
+      camera_file_name_buffer, sizeof(camera_file_name_buffer),
+      config.kCameraFileNameString_.c_str(), txt_folder.c_str(),
+      observer_number);
+  std::string camera_file_name(camera_file_name_buffer);
+  common::FileLogger camera_file(camera_file_name);
+  CHECK(camera_file.isOpen())
+      << "Could not write to camera projection matrix file: "
+      << camera_file_name;
+  camera_file << "CONTOUR" << std::endl;
+  camera_file << observer_pose.P_undistorted;
+}
+
+}  // namespace
 
 void createBundleFileForCmvs(
     const PmvsConfig& config, const std::string& folder_prefix,
@@ -62,54 +119,54 @@ void writeObserverPosesAndImagesToFileSystem(
     const std::string& image_folder, const std::string& txt_folder,
     const ObserverCameraMap& observer_cameras,
     const ObserverPosesMap& observer_poses) {
+  CHECK_GT(config.num_threads, 0u);
+  CHECK_GT(config.max_num_images_in_flight, 0u);
+
+  // The images are loaded in this thread, as the resource cache of the map is
+  // not thread-safe, and then undistorted, encoded and written by the worker
+  // pool. Loading blocks while the maximum number of images is in flight.
+  std::unique_ptr<aslam::ThreadPool> worker_pool;
+  if (config.num_threads > 1u) {
+    worker_pool.reset(new aslam::ThreadPool(config.num_threads));
+  }
+  std::mutex mutex;
+  std::condition_variable cv_image_written;
+  size_t num_images_in_flight = 0u;
+
   for (const ObserverPosesMap::value_type& observer_pose_w_vertex_id :
        observer_poses) {
     const ObserverPoseSet& observer_pose_set = observer_pose_w_vertex_id.second;
     for (const ObserverPose& observer_pose : observer_pose_set) {
-      const size_t observer_number = observer_pose.camera_number;
-      char image_name[1024];
-      snprintf(
-          image_name, sizeof(image_name), config.image_file_name_string.c_str(),
-          image_folder.c_str(), observer_number);
-
       cv::Mat image;
       observer_pose.loadImage(vi_map, &image);
 
-      if (observer_pose.needsUndistortion()) {
-        const ObserverCamera& observer_camera =
-            common::getChecked(observer_cameras, observer_pose.camera_id);
-        cv::Mat undistorted_image;
-        observer_camera.undistortImage(image, &undistorted_image);
-        image = undistorted_image;
+      if (!worker_pool) {
+        writeObserverPoseAndImage(
+            config, image_folder, txt_folder, observer_cameras, observer_pose,
+            image);
+        continue;
       }
 
-      cv::Mat color_image;
-      if (image.channels() == 3 && image.type() == CV_8UC3) {
-        color_image = image;
-      } else {
-        // PMVS expects color images, therefore we convert the grayscale image
-        // to a pseudo color image.
-        VLOG(2) << "Convert grayscale image to pseudo color image.";
-        cv::cvtColor(image, color_image, CV_GRAY2RGB);
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_image_written.wait(lock, [&]() {
+          return num_images_in_flight < config.max_num_images_in_flight;
+        });
+        ++num_images_in_flight;
       }
-      // Save to visualize folder.
-      cv::imwrite(std::string(image_name), color_image);
-
-      // Write camera projection matrix to txt folder.
-      char camera_file_name_buffer[1024];
-      snprintf(
-          camera_file_name_buffer, sizeof(camera_file_name_buffer),
-          config.kCameraFileNameString_.c_str(), txt_folder.c_str(),
-          observer_number);
-      std::string camera_file_name(camera_file_name_buffer);
-      common::FileLogger camera_file(camera_file_name);
-      CHECK(camera_file.isOpen())
-          << "Could not write to camera projection matrix file: "
-          << camera_file_name;
-      camera_file << "CONTOUR" << std::endl;
-      camera_file << observer_pose.P_undistorted;
+      worker_pool->enqueue([&, image]() {
+        writeObserverPoseAndImage(
+            config, image_folder, txt_folder, observer_cameras, observer_pose,
+            image);
+        std::lock_guard<std::mutex> lock(mutex);
+        --num_images_in_flight;
+        cv_image_written.notify_all();
+      });
     }
   }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv_image_written.wait(lock, [&]() { return num_images_in_flight == 0u; });
 }
 
 void createReconstructionFolders(
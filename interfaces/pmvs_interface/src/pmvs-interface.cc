@@ -1,7 +1,13 @@
 #include "dense-reconstruction/pmvs-interface.h"
 
+#include <algorithm>
 #include <map>
+#include <mutex>
 #include <stdlib.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <Eigen/Core>
 #include <aslam/cameras/camera-factory.h>
@@ -16,6 +22,7 @@
 #include <landmark-triangulation/pose-interpolator.h>
 #include <maplab-common/accessors.h>
 #include <maplab-common/file-system-tools.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/progress-bar.h>
 #include <maplab-common/vector-window-operations.h>
 #include <opencv2/core/core.hpp>
@@ -28,6 +35,129 @@
 #include "dense-reconstruction/pmvs-file-utils.h"
 
 namespace dense_reconstruction {
+namespace {
+
+struct LandmarkCovisibility {
+  // Position of the vertex along the export vertices and of the landmark in
+  // the observations of this vertex. Determines the landmark number.
+  std::pair<size_t, size_t> first_observation;
+  Eigen::Vector3d p_G;
+  std::unordered_set<size_t> observer_numbers;
+};
+typedef std::unordered_map<vi_map::LandmarkId, LandmarkCovisibility>
+    CovisibilityBuffer;
+
+// Observer pose data that is shared by all landmarks of a vertex.
+struct VertexObserver {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+  const aslam::Camera* camera;
+  aslam::Transformation T_C_G;
+  size_t camera_number;
+};
+
+const aslam::Camera& getCameraOfObserver(
+    const vi_map::VIMap& vi_map, const vi_map::Vertex& vertex,
+    const ObserverCamera& observer_camera) {
+  // Retrieve aslam::Camera from either optional cameras or NCamera.
+  const aslam::Camera* camera = nullptr;
+  if (observer_camera.is_optional_camera) {
+    const backend::CameraWithExtrinsics& cam_with_extrinsics =
+        vi_map.getSensorManager().getOptionalCameraWithExtrinsics(
+            observer_camera.camera_id);
+    camera = cam_with_extrinsics.second.get();
+  } else {
+    CHECK_LT(observer_camera.frame_idx, vertex.numFrames());
+    camera = vertex.getCamera(observer_camera.frame_idx).get();
+  }
+  return *CHECK_NOTNULL(camera);
+}
+
+bool isPointVisibleInCamera(
+    const aslam::Camera& camera, const Eigen::Vector3d& p_C) {
+  if (p_C.z() < 0.0) {
+    return false;
+  }
+  Eigen::Vector2d keypoint_out;
+  return static_cast<bool>(camera.project3(p_C, &keypoint_out));
+}
+
+void addCovisibilityOfVertex(
+    const vi_map::VIMap& vi_map, const PmvsConfig& config,
+    const pose_graph::VertexId& vertex_id, const size_t vertex_position,
+    const ObserverCameraMap& observer_cameras,
+    const ObserverPosesMap& observer_poses, CovisibilityBuffer* buffer) {
+  CHECK_NOTNULL(buffer);
+  const ObserverPosesMap::const_iterator it = observer_poses.find(vertex_id);
+  if (it == observer_poses.cend()) {
+    VLOG(3) << "No observer poses found for vertex " << vertex_id;
+    return;
+  }
+  const ObserverPoseSet& observer_poses_for_vertex = it->second;
+  CHECK(!observer_poses_for_vertex.empty());
+  VLOG(3) << "Found " << observer_poses_for_vertex.size()
+          << " observers for vertex " << vertex_id;
+
+  const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
+  std::vector<VertexObserver, Eigen::aligned_allocator<VertexObserver>>
+      vertex_observers;
+  vertex_observers.reserve(observer_poses_for_vertex.size());
+  for (const ObserverPose& observer_pose : observer_poses_for_vertex) {
+    vertex_observers.emplace_back();
+    VertexObserver& vertex_observer = vertex_observers.back();
+    vertex_observer.camera = &getCameraOfObserver(
+        vi_map, vertex,
+        common::getChecked(observer_cameras, observer_pose.camera_id));
+    vertex_observer.T_C_G = observer_pose.T_G_C.inverse();
+    vertex_observer.camera_number = observer_pose.camera_number;
+  }
+
+  vi_map::LandmarkIdList observed_landmark_ids;
+  vertex.getAllObservedLandmarkIds(&observed_landmark_ids);
+  std::vector<size_t> observer_camera_numbers;
+  for (size_t landmark_position = 0u;
+       landmark_position < observed_landmark_ids.size(); ++landmark_position) {
+    const vi_map::LandmarkId& landmark_id =
+        observed_landmark_ids[landmark_position];
+    if (!landmark_id.isValid()) {
+      VLOG(3) << "Discard invalid landmark!";
+      continue;
+    }
+
+    if (config.use_only_good_landmarks) {
+      if (vi_map.getLandmark(landmark_id).getQuality() !=
+          vi_map::Landmark::Quality::kGood) {
+        continue;
+      }
+    }
+
+    const Eigen::Vector3d p_G = vi_map.getLandmark_G_p_fi(landmark_id);
+
+    // Find out which observer poses see this landmark.
+    observer_camera_numbers.clear();
+    for (const VertexObserver& vertex_observer : vertex_observers) {
+      if (isPointVisibleInCamera(
+              *vertex_observer.camera, vertex_observer.T_C_G * p_G)) {
+        observer_camera_numbers.push_back(vertex_observer.camera_number);
+      }
+    }
+
+    if (observer_camera_numbers.empty()) {
+      VLOG(3) << "Landmark " << landmark_id << " has no observers!";
+      continue;
+    }
+
+    LandmarkCovisibility& covisibility = (*buffer)[landmark_id];
+    if (covisibility.observer_numbers.empty()) {
+      covisibility.first_observation =
+          std::make_pair(vertex_position, landmark_position);
+      covisibility.p_G = p_G;
+    }
+    covisibility.observer_numbers.insert(
+        observer_camera_numbers.cbegin(), observer_camera_numbers.cend());
+  }
+}
+
+}  // namespace
 
 bool exportVIMapToPmvsSfmInputData(
     const PmvsConfig& pmvs_settings, const vi_map::VIMap& vi_map) {
@@ -325,94 +455,83 @@ void getObservedLandmarksAndCovisibilityInformation(
     const ObserverPosesMap& observer_poses,
     ObservedLandmarks* observed_landmarks) {
   CHECK(!export_vertex_ids.empty());
-  CHECK_NOTNULL(observed_landmarks);
-
-  size_t landmark_number = 0u;
-  vi_map::LandmarkIdSet actually_observed_landmarks_ids;
-
-  for (const pose_graph::VertexId& vertex_id : export_vertex_ids) {
-    const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
-
-    vi_map::LandmarkIdList observed_landmark_ids;
-    vertex.getAllObservedLandmarkIds(&observed_landmark_ids);
-
-    const ObserverPosesMap::const_iterator it = observer_poses.find(vertex_id);
-    if (it == observer_poses.cend()) {
-      VLOG(3) << "No observer poses found for vertex " << vertex_id;
-      return;
-    }
-    const ObserverPoseSet& observer_poses_for_vertex = it->second;
-    CHECK(!observer_poses_for_vertex.empty());
-
-    VLOG(3) << "Found " << observer_poses_for_vertex.size()
-            << " observers for vertex " << vertex_id;
-
-    for (const vi_map::LandmarkId& landmark_id : observed_landmark_ids) {
-      if (!landmark_id.isValid()) {
-        VLOG(3) << "Discard invalid landmark!";
-        continue;
-      }
-
-      if (config.use_only_good_landmarks) {
-        if (vi_map.getLandmark(landmark_id).getQuality() !=
-            vi_map::Landmark::Quality::kGood) {
-          continue;
+  CHECK_NOTNULL(observed_landmarks)->clear();
+
+  // Every thread collects the observers of the landmarks of its vertices in
+  // its own buffer, the buffers are merged afterwards.
+  std::mutex buffers_mutex;
+  std::vector<CovisibilityBuffer> buffers;
+  common::ParallelProcess(
+      export_vertex_ids.size(),
+      [&](const std::vector<size_t>& range) {
+        CovisibilityBuffer buffer;
+        for (const size_t vertex_position : range) {
+          addCovisibilityOfVertex(
+              vi_map, config, export_vertex_ids[vertex_position],
+              vertex_position, observer_cameras, observer_poses, &buffer);
         }
-      }
-
-      const Eigen::Vector3d p_G = vi_map.getLandmark_G_p_fi(landmark_id);
-
-      // Find out which observer poses see this landmark.
-      std::unordered_set<size_t> observer_camera_numbers;
-      for (const ObserverPose& observer_pose : observer_poses_for_vertex) {
-        const ObserverCamera& observer_camera =
-            common::getChecked(observer_cameras, observer_pose.camera_id);
-        if (isLandmarkVisibleForObserverCamera(
-                vi_map, vertex, landmark_id, p_G, observer_camera,
-                observer_pose)) {
-          observer_camera_numbers.insert(observer_pose.camera_number);
-          VLOG(4) << "Landmark: " << landmark_id
-                  << " is visible from observer number "
-                  << observer_pose.camera_number;
-        } else {
-          VLOG(4) << "Landmark: " << landmark_id
-                  << " is NOT visible from observer number "
-                  << observer_pose.camera_number;
-        }
-      }
-
-      if (observer_camera_numbers.empty()) {
-        VLOG(3) << "Landmark " << landmark_id << " has no observers!";
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.emplace_back();
+        buffers.back().swap(buffer);
+      },
+      true /*always_parallelize*/, config.num_threads);
+
+  CovisibilityBuffer merged_buffer;
+  for (CovisibilityBuffer& buffer : buffers) {
+    if (merged_buffer.empty()) {
+      merged_buffer.swap(buffer);
+      continue;
+    }
+    for (CovisibilityBuffer::value_type& landmark_with_id : buffer) {
+      LandmarkCovisibility& merged_covisibility =
+          merged_buffer[landmark_with_id.first];
+      LandmarkCovisibility& covisibility = landmark_with_id.second;
+      if (merged_covisibility.observer_numbers.empty()) {
+        merged_covisibility.first_observation = covisibility.first_observation;
+        merged_covisibility.p_G = covisibility.p_G;
+        merged_covisibility.observer_numbers.swap(
+            covisibility.observer_numbers);
         continue;
       }
-
-      ObservedLandmarks::iterator it = observed_landmarks->find(landmark_id);
-      // Initialize the observed landmark if it doesnt exists already.
-      ObservedLandmark* observed_landmark = nullptr;
-      if (it == observed_landmarks->end()) {
-        observed_landmark = &((*observed_landmarks)[landmark_id]);
-        CHECK_NOTNULL(observed_landmark);
-
-        observed_landmark->p_G = vi_map.getLandmark_G_p_fi(landmark_id);
-        observed_landmark->landmark_id = landmark_id;
-        observed_landmark->landmark_number = landmark_number++;
-        VLOG(4) << "New observed landmark created: " << landmark_id;
-      } else {
-        observed_landmark = &(it->second);
-        CHECK_NOTNULL(observed_landmark);
-        CHECK_EQ(observed_landmark->landmark_id, landmark_id);
-
-        VLOG(4) << "Retrieved observed landmark: " << landmark_id;
-      }
-
-      observed_landmark->observer_pose_numbers.insert(
-          observer_camera_numbers.cbegin(), observer_camera_numbers.cend());
-
-      VLOG(3) << "Added " << observer_camera_numbers.size()
-              << " observers for landmark " << landmark_id
-              << ". Total number of observers are now "
-              << observed_landmark->observer_pose_numbers.size();
+      merged_covisibility.first_observation = std::min(
+          merged_covisibility.first_observation,
+          covisibility.first_observation);
+      merged_covisibility.observer_numbers.insert(
+          covisibility.observer_numbers.cbegin(),
+          covisibility.observer_numbers.cend());
     }
+    CovisibilityBuffer().swap(buffer);
+  }
+
+  // Number the landmarks in the order they are first observed along the
+  // export vertices, independent of the number of threads.
+  std::vector<CovisibilityBuffer::value_type*> sorted_landmarks;
+  sorted_landmarks.reserve(merged_buffer.size());
+  for (CovisibilityBuffer::value_type& landmark_with_id : merged_buffer) {
+    sorted_landmarks.push_back(&landmark_with_id);
+  }
+  std::sort(
+      sorted_landmarks.begin(), sorted_landmarks.end(),
+      [](const CovisibilityBuffer::value_type* lhs,
+         const CovisibilityBuffer::value_type* rhs) {
+        return lhs->second.first_observation < rhs->second.first_observation;
+      });
+
+  observed_landmarks->reserve(sorted_landmarks.size());
+  size_t landmark_number = 0u;
+  for (const CovisibilityBuffer::value_type* landmark_with_id :
+       sorted_landmarks) {
+    const vi_map::LandmarkId& landmark_id = landmark_with_id->first;
+    ObservedLandmark& observed_landmark = (*observed_landmarks)[landmark_id];
+    observed_landmark.landmark_id = landmark_id;
+    observed_landmark.landmark_number = landmark_number++;
+    observed_landmark.p_G = landmark_with_id->second.p_G;
+    observed_landmark.observer_pose_numbers.insert(
+        landmark_with_id->second.observer_numbers.cbegin(),
+        landmark_with_id->second.observer_numbers.cend());
+    VLOG(4) << "Landmark " << landmark_id << " has "
+            << observed_landmark.observer_pose_numbers.size()
+            << " observers.";
   }
 }
 
@@ -420,39 +539,16 @@ bool isLandmarkVisibleForObserverCamera(
     const vi_map::VIMap& vi_map, const vi_map::Vertex& vertex,
     const vi_map::LandmarkId& landmark_id, const Eigen::Vector3d& p_G,
     const ObserverCamera& observer_camera, const ObserverPose& observer_pose) {
-  // Retrieve aslam::Camera from either optional cameras or NCamera.
-  const aslam::Camera* camera = nullptr;
-  if (observer_camera.is_optional_camera) {
-    const backend::CameraWithExtrinsics& cam_with_extrinsics =
-        vi_map.getSensorManager().getOptionalCameraWithExtrinsics(
-            observer_camera.camera_id);
-    camera = cam_with_extrinsics.second.get();
-  } else {
-    CHECK_LT(observer_camera.frame_idx, vertex.numFrames());
-    camera = vertex.getCamera(observer_camera.frame_idx).get();
-  }
-  CHECK_NOTNULL(camera);
-
-  Eigen::Vector3d p_C = observer_pose.T_G_C.inverse() * p_G;
-
-  if (p_C.z() < 0.0) {
-    VLOG(4) << "Landmark " << landmark_id << " is behind camera "
-            << observer_camera.camera_id;
-    return false;
-  }
-
-  Eigen::Vector2d keypoint_out;
-  const aslam::ProjectionResult& projection_result =
-      camera->project3(p_C, &keypoint_out);
-
-  if (projection_result) {
+  const aslam::Camera& camera =
+      getCameraOfObserver(vi_map, vertex, observer_camera);
+  const Eigen::Vector3d p_C = observer_pose.T_G_C.inverse() * p_G;
+  if (isPointVisibleInCamera(camera, p_C)) {
     VLOG(4) << "Landmark " << landmark_id << " is visible in camera "
             << observer_camera.camera_id;
     return true;
-  } else {
-    VLOG(4) << "Landmark " << landmark_id << " is NOT visible in camera "
-            << observer_camera.camera_id;
   }
+  VLOG(4) << "Landmark " << landmark_id << " is NOT visible in camera "
+          << observer_camera.camera_id;
   return false;
 }
 
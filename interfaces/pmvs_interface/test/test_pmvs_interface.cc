@@ -1,7 +1,11 @@
 #include <string>
 
 #include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/accessors.h>
 #include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/6dof-vi-map-gen.h>
+#include <vi-map/vi-map.h>
 
 #include "dense-reconstruction/pmvs-config.h"
 #include "dense-reconstruction/pmvs-file-utils.h"
@@ -20,4 +24,79 @@ TEST_F(PmvsImportExportTest, TestPmvsImportExport) {}
 
 }  // namespace backend
 
+namespace dense_reconstruction {
+
+class PmvsCovisibilityTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    vimap_gen_.generateVIMap();
+    const vi_map::VIMap& map = vimap_gen_.vi_map_;
+    config_.use_only_good_landmarks = false;
+    config_.use_color_images = false;
+
+    vi_map::MissionIdList mission_ids;
+    map.getAllMissionIds(&mission_ids);
+    getAllObserverCameras(map, config_, mission_ids, &observer_cameras_);
+    getExportVertexIds(map, mission_ids, config_, &export_vertex_ids_);
+
+    // One observer per nframe camera, as exported from the raw images.
+    size_t num_observers = 0u;
+    for (const pose_graph::VertexId& vertex_id : export_vertex_ids_) {
+      const vi_map::Vertex& vertex = map.getVertex(vertex_id);
+      for (size_t frame_idx = 0u; frame_idx < vertex.numFrames();
+           ++frame_idx) {
+        const ObserverCamera& observer_camera = common::getChecked(
+            observer_cameras_, vertex.getCamera(frame_idx)->getId());
+        observer_poses_[vertex_id].emplace(
+            map, num_observers++, vertex.getMissionId(), vertex_id,
+            vertex.getVisualFrame(frame_idx).getTimestampNanoseconds(),
+            observer_camera, backend::ResourceType::kRawImage);
+      }
+    }
+  }
+
+  void getObservedLandmarks(
+      const size_t num_threads, ObservedLandmarks* observed_landmarks) {
+    config_.num_threads = num_threads;
+    getObservedLandmarksAndCovisibilityInformation(
+        vimap_gen_.vi_map_, config_, export_vertex_ids_, observer_cameras_,
+        observer_poses_, observed_landmarks);
+  }
+
+  vi_map::SixDofVIMapGenerator vimap_gen_;
+  PmvsConfig config_;
+  ObserverCameraMap observer_cameras_;
+  pose_graph::VertexIdList export_vertex_ids_;
+  ObserverPosesMap observer_poses_;
+};
+
+TEST_F(PmvsCovisibilityTest, ResultDoesNotDependOnNumThreads) {
+  ObservedLandmarks sequential_landmarks;
+  getObservedLandmarks(1u, &sequential_landmarks);
+  ASSERT_FALSE(sequential_landmarks.empty());
+
+  constexpr size_t kNumThreads = 4u;
+  ObservedLandmarks parallel_landmarks;
+  getObservedLandmarks(kNumThreads, &parallel_landmarks);
+  ASSERT_EQ(sequential_landmarks.size(), parallel_landmarks.size());
+
+  for (const ObservedLandmarks::value_type& landmark_with_id :
+       sequential_landmarks) {
+    const ObservedLandmark& sequential_landmark = landmark_with_id.second;
+    const ObservedLandmarks::const_iterator it =
+        parallel_landmarks.find(landmark_with_id.first);
+    ASSERT_TRUE(it != parallel_landmarks.end());
+    const ObservedLandmark& parallel_landmark = it->second;
+    EXPECT_EQ(
+        sequential_landmark.landmark_number,
+        parallel_landmark.landmark_number);
+    EXPECT_EQ(
+        sequential_landmark.observer_pose_numbers,
+        parallel_landmark.observer_pose_numbers);
+    EXPECT_EQ(sequential_landmark.p_G, parallel_landmark.p_G);
+  }
+}
+
+}  // namespace dense_reconstruction
+
 MAPLAB_UNITTEST_ENTRYPOINT
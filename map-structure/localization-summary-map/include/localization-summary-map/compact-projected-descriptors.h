@@ -0,0 +1,114 @@
+#ifndef LOCALIZATION_SUMMARY_MAP_COMPACT_PROJECTED_DESCRIPTORS_H_
+#define LOCALIZATION_SUMMARY_MAP_COMPACT_PROJECTED_DESCRIPTORS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+namespace summary_map {
+
+enum class DescriptorPrecision : uint32_t {
+  kFloat32 = 0,
+  kFloat16 = 1,
+  kInt8 = 2
+};
+
+// Parses "float32", "float16" or "int8". Returns false for anything else.
+bool parseDescriptorPrecision(
+    const std::string& precision_string, DescriptorPrecision* precision);
+std::string descriptorPrecisionToString(const DescriptorPrecision precision);
+size_t getBytesPerDescriptorElement(const DescriptorPrecision precision);
+
+uint16_t floatToHalf(const float value);
+float halfToFloat(const uint16_t value);
+
+// Projected descriptors stored as 16 bit floats or 8 bit integers, one column
+// per descriptor. Every dimension is divided by its largest absolute value
+// beforehand, such that it uses the full range of the type.
+//
+// The data is immutable and either owned or referenced from e.g. a memory
+// mapped file, copies share the data.
+class CompactProjectedDescriptors {
+ public:
+  CompactProjectedDescriptors();
+
+  void quantize(
+      const Eigen::MatrixXf& descriptors, const DescriptorPrecision precision);
+
+  // References the quantized descriptors at data, which has to stay valid as
+  // long as data_owner lives.
+  void setData(
+      const DescriptorPrecision precision, const int rows, const int cols,
+      const Eigen::VectorXf& scales, const uint8_t* data,
+      const std::shared_ptr<const void>& data_owner);
+
+  void clear();
+
+  inline DescriptorPrecision precision() const {
+    return precision_;
+  }
+  inline int rows() const {
+    return rows_;
+  }
+  inline int cols() const {
+    return cols_;
+  }
+  inline const Eigen::VectorXf& scales() const {
+    return scales_;
+  }
+  inline const uint8_t* data() const {
+    return data_;
+  }
+  inline size_t numBytes() const {
+    return static_cast<size_t>(rows_) * cols_ *
+           getBytesPerDescriptorElement(precision_);
+  }
+
+  template <typename Derived>
+  void getDescriptor(
+      const int col,
+      const Eigen::MatrixBase<Derived>& descriptor_const) const {
+    CHECK_GE(col, 0);
+    CHECK_LT(col, cols_);
+    Eigen::MatrixBase<Derived>& descriptor =
+        const_cast<Eigen::MatrixBase<Derived>&>(descriptor_const);
+    descriptor.derived().resize(rows_, 1);
+    const size_t offset = static_cast<size_t>(col) * rows_;
+    if (precision_ == DescriptorPrecision::kInt8) {
+      const int8_t* values = reinterpret_cast<const int8_t*>(data_) + offset;
+      for (int row = 0; row < rows_; ++row) {
+        descriptor(row, 0) = values[row] * dequantization_factors_(row);
+      }
+    } else {
+      CHECK(precision_ == DescriptorPrecision::kFloat16);
+      const uint16_t* values =
+          reinterpret_cast<const uint16_t*>(data_) + offset;
+      for (int row = 0; row < rows_; ++row) {
+        descriptor(row, 0) = halfToFloat(values[row]) * scales_(row);
+      }
+    }
+  }
+
+  void toFloat(Eigen::MatrixXf* descriptors) const;
+
+  bool operator==(const CompactProjectedDescriptors& other) const;
+
+ private:
+  void initializeDequantizationFactors();
+
+  DescriptorPrecision precision_;
+  int rows_;
+  int cols_;
+  // Largest absolute value of every dimension.
+  Eigen::VectorXf scales_;
+  Eigen::VectorXf dequantization_factors_;
+  const uint8_t* data_;
+  std::shared_ptr<const void> data_owner_;
+};
+
+}  // namespace summary_map
+
+#endif  // LOCALIZATION_SUMMARY_MAP_COMPACT_PROJECTED_DESCRIPTORS_H_
@@ -5,62 +5,84 @@
 #include <utility>
 
 #include <Eigen/Core>
-#include <maplab-common/accessors.h>
+#include <glog/logging.h>
 #include <posegraph/unique-id.h>
 #include <vi-map/unique-id.h>
 
 namespace summary_map {
 
 // This class stores projected descriptors to speed up the summary map creation.
+// The descriptors are stored in a single flat block with one column per
+// keypoint, the keypoints are mapped to their column by a single index.
 class LocalizationSummaryMapCache {
  public:
+  LocalizationSummaryMapCache() : num_descriptors_(0u) {}
+
+  // Reserves space for the given total number of projected descriptors.
+  void reserve(const size_t num_descriptors, const int descriptor_dimensions) {
+    CHECK_GT(descriptor_dimensions, 0);
+    CHECK(
+        num_descriptors_ == 0u ||
+        projected_descriptors_.rows() == descriptor_dimensions);
+    keypoint_to_column_.reserve(num_descriptors);
+    if (static_cast<size_t>(projected_descriptors_.cols()) < num_descriptors) {
+      projected_descriptors_.conservativeResize(
+          descriptor_dimensions, num_descriptors);
+    }
+  }
+
   // Gets the projected descriptor if it's stored. Returns true if a descriptor
   // is stored in the cache, returns false otherwise.
-  bool getProjectedDescriptorForLandmark(
+  template <typename DerivedOut>
+  bool getProjectedDescriptor(
       const vi_map::KeypointIdentifier& keypoint_identifier,
-      const vi_map::LandmarkId& landmark_id,
-      const Eigen::MatrixXf::ColXpr& projected_descriptor_const) {
-    const DescriptorMap::const_iterator descriptor_iterator =
-        descriptor_map_.find(landmark_id);
-    if (descriptor_iterator != descriptor_map_.end()) {
-      const DescriptorMapInner& inner_map = descriptor_iterator->second;
-      const DescriptorMapInner::const_iterator inner_iterator =
-          inner_map.find(keypoint_identifier);
-      if (inner_iterator != inner_map.end()) {
-        Eigen::MatrixXf::ColXpr& projected_descriptor =
-            const_cast<Eigen::MatrixXf::ColXpr&>(projected_descriptor_const);
-        projected_descriptor = inner_iterator->second;
-        return true;
-      }
+      const Eigen::MatrixBase<DerivedOut>& projected_descriptor_const) const {
+    const KeypointToColumnMap::const_iterator it =
+        keypoint_to_column_.find(keypoint_identifier);
+    if (it == keypoint_to_column_.end()) {
+      return false;
     }
-    return false;
+    Eigen::MatrixBase<DerivedOut>& projected_descriptor =
+        const_cast<Eigen::MatrixBase<DerivedOut>&>(projected_descriptor_const);
+    projected_descriptor = projected_descriptors_.col(it->second);
+    return true;
   }
 
   // Adds a projected descriptor to the cache.
+  template <typename DerivedIn>
   void addProjectedDescriptor(
       const vi_map::KeypointIdentifier& keypoint_identifier,
-      const vi_map::LandmarkId& landmark_id,
-      const Eigen::VectorXf& projected_descriptor) {
-    DescriptorMap::iterator descriptor_iterator =
-        descriptor_map_.find(landmark_id);
-    if (descriptor_iterator == descriptor_map_.end()) {
-      std::pair<DescriptorMap::iterator, bool> insertion_result =
-          descriptor_map_.insert(
-              std::make_pair(landmark_id, DescriptorMapInner()));
-      CHECK(insertion_result.second);
-      descriptor_iterator = insertion_result.first;
+      const Eigen::MatrixBase<DerivedIn>& projected_descriptor) {
+    CHECK_EQ(projected_descriptor.cols(), 1);
+    if (num_descriptors_ == 0u) {
+      projected_descriptors_.resize(
+          projected_descriptor.rows(), projected_descriptors_.cols());
     }
+    CHECK_EQ(projected_descriptor.rows(), projected_descriptors_.rows());
+    if (!keypoint_to_column_.emplace(keypoint_identifier, num_descriptors_)
+             .second) {
+      return;
+    }
+    if (static_cast<size_t>(projected_descriptors_.cols()) <=
+        num_descriptors_) {
+      // Grow geometrically to amortize the copies.
+      projected_descriptors_.conservativeResize(
+          Eigen::NoChange, 2u * num_descriptors_ + 1u);
+    }
+    projected_descriptors_.col(num_descriptors_) = projected_descriptor;
+    ++num_descriptors_;
+  }
 
-    descriptor_iterator->second.insert(
-        std::make_pair(keypoint_identifier, projected_descriptor));
+  inline size_t size() const {
+    return num_descriptors_;
   }
 
  private:
-  typedef std::unordered_map<vi_map::KeypointIdentifier, const Eigen::VectorXf>
-      DescriptorMapInner;
-  typedef std::unordered_map<vi_map::LandmarkId, DescriptorMapInner>
-      DescriptorMap;
-  DescriptorMap descriptor_map_;
+  typedef std::unordered_map<vi_map::KeypointIdentifier, size_t>
+      KeypointToColumnMap;
+  KeypointToColumnMap keypoint_to_column_;
+  Eigen::MatrixXf projected_descriptors_;
+  size_t num_descriptors_;
 };
 
 }  // namespace summary_map
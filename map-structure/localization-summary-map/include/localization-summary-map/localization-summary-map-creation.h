@@ -22,6 +22,9 @@ void createLocalizationSummaryMapFromLandmarkList(
     const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
     summary_map::LocalizationSummaryMap* summary_map);
 
+// The descriptors are projected in blocks distributed over all threads. The
+// cache is optional, projected descriptors are taken from it if available and
+// newly projected descriptors are added to it.
 void createLocalizationSummaryMapFromLandmarkList(
     const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
     LocalizationSummaryMapCache* summary_map_cache,
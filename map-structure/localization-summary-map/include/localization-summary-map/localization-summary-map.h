@@ -1,6 +1,7 @@
 #ifndef LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_H_
 #define LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_H_
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -12,6 +13,8 @@
 #include <vi-map/landmark.h>
 #include <vi-map/unique-id.h>
 
+#include "localization-summary-map/compact-projected-descriptors.h"
+#include "localization-summary-map/sorted-id-index.h"
 #include "localization-summary-map/unique-id.h"
 
 namespace summary_map {
@@ -47,6 +50,8 @@ class LocalizationSummaryMap {
   bool loadFromFolder(
       const LocalizationSummaryMapId& summary_map_id,
       const std::string& folder_path);
+  // Maps with compact projected descriptors are saved in a binary layout that
+  // is memory mapped when loading, all other maps are saved as protobuf.
   bool saveToFolder(
       const std::string& folder_path, const backend::SaveConfig& config);
   static bool hasMapOnFileSystem(const std::string& folder_path);
@@ -62,9 +67,22 @@ class LocalizationSummaryMap {
       const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
           observation_to_landmark_index);
 
+  // Stores the projected descriptors as 16 bit floats or 8 bit integers with
+  // a scale per dimension, which takes a half or a quarter of the memory.
+  void compressProjectedDescriptors(const DescriptorPrecision precision);
+
   const Eigen::Matrix3Xf& GLandmarkPosition() const;
   const Eigen::Matrix3Xf& GObserverPosition() const;
+  // Only available if the projected descriptors are not compressed, use
+  // getProjectedDescriptor otherwise.
   const Eigen::MatrixXf& projectedDescriptors() const;
+  DescriptorPrecision projectedDescriptorPrecision() const;
+  int numProjectedDescriptors() const;
+  int projectedDescriptorDimensions() const;
+  template <typename Derived>
+  void getProjectedDescriptor(
+      const int observation_index,
+      const Eigen::MatrixBase<Derived>& projected_descriptor) const;
   const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>& observerIndices() const;
   const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
   observationToLandmarkIndex() const;
@@ -81,6 +99,12 @@ class LocalizationSummaryMap {
 
  private:
   static constexpr char kFileName[] = "localization_summary_map";
+  static constexpr char kCompactFileName[] =
+      "localization_summary_map_compact";
+
+  void initializeObserverIds(int num_observers);
+  bool loadCompactFile(const std::string& file_path);
+  bool saveCompactFile(const std::string& file_path) const;
 
   // The goal here is to get the most compact representation (memory).
   // So instead of storing for every descriptor a vertex+frame id pair, we just
@@ -90,21 +114,41 @@ class LocalizationSummaryMap {
 
   LocalizationSummaryMapId id_;
   /// Mapping of landmark-ids to landmark indices.
-  std::unordered_map<vi_map::LandmarkId, int> landmark_id_to_landmark_index_;
+  SortedIdIndex<vi_map::LandmarkId> landmark_id_to_landmark_index_;
   /// The position of the landmarks in the global frame of reference.
   Eigen::Matrix3Xf G_landmark_position_;
   /// Mapping of vertex-ids to vertex indices.
-  std::unordered_map<pose_graph::VertexId, int> vertex_id_to_index_;
+  SortedIdIndex<pose_graph::VertexId> vertex_id_to_index_;
   /// The position of the observers in the global frame of reference.
   Eigen::Matrix3Xf G_observer_position_;
   /// A set of projected_descriptors from observations of landmarks.
   Eigen::MatrixXf projected_descriptors_;
+  /// The projected descriptors if they are compressed, projected_descriptors_
+  /// is empty then.
+  CompactProjectedDescriptors compact_projected_descriptors_;
   /// An index of a key-frame for every observation (descriptor).
   Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> observer_indices_;
   /// A mapping from observation (descriptor) to index in G_landmark_position.
   Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> observation_to_landmark_index_;
 };
 
+template <typename Derived>
+void LocalizationSummaryMap::getProjectedDescriptor(
+    const int observation_index,
+    const Eigen::MatrixBase<Derived>& projected_descriptor_const) const {
+  if (compact_projected_descriptors_.precision() !=
+      DescriptorPrecision::kFloat32) {
+    compact_projected_descriptors_.getDescriptor(
+        observation_index, projected_descriptor_const);
+    return;
+  }
+  CHECK_GE(observation_index, 0);
+  CHECK_LT(observation_index, projected_descriptors_.cols());
+  Eigen::MatrixBase<Derived>& projected_descriptor =
+      const_cast<Eigen::MatrixBase<Derived>&>(projected_descriptor_const);
+  projected_descriptor = projected_descriptors_.col(observation_index);
+}
+
 typedef std::unordered_map<LocalizationSummaryMapId,
                            LocalizationSummaryMap::Ptr>
     LocalizationSummaryMapMap;
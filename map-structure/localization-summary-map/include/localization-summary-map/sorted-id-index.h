@@ -0,0 +1,89 @@
+#ifndef LOCALIZATION_SUMMARY_MAP_SORTED_ID_INDEX_H_
+#define LOCALIZATION_SUMMARY_MAP_SORTED_ID_INDEX_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace summary_map {
+
+// Maps ids to the dense indices 0..N-1. The ids are kept in index order next
+// to the indices sorted by id, lookups are binary searches. This takes the
+// id and 4 bytes per entry, a fraction of what a hash map needs.
+template <typename IdType>
+class SortedIdIndex {
+ public:
+  SortedIdIndex() = default;
+
+  // The id at position i gets the index i. The ids have to be unique.
+  void assign(std::vector<IdType>&& ids_by_index) {
+    CHECK_LE(
+        ids_by_index.size(),
+        static_cast<size_t>(std::numeric_limits<uint32_t>::max()));
+    ids_by_index_ = std::move(ids_by_index);
+    sorted_indices_.resize(ids_by_index_.size());
+    for (size_t i = 0u; i < sorted_indices_.size(); ++i) {
+      sorted_indices_[i] = static_cast<uint32_t>(i);
+    }
+    std::sort(
+        sorted_indices_.begin(), sorted_indices_.end(),
+        [this](const uint32_t lhs, const uint32_t rhs) {
+          return ids_by_index_[lhs] < ids_by_index_[rhs];
+        });
+    for (size_t i = 1u; i < sorted_indices_.size(); ++i) {
+      CHECK(
+          ids_by_index_[sorted_indices_[i - 1u]] !=
+          ids_by_index_[sorted_indices_[i]])
+          << "Id collision: " << ids_by_index_[sorted_indices_[i]];
+    }
+  }
+
+  void clear() {
+    ids_by_index_.clear();
+    sorted_indices_.clear();
+  }
+
+  inline size_t size() const {
+    return ids_by_index_.size();
+  }
+
+  // Returns false if the id is not in the index.
+  bool getIndex(const IdType& id, size_t* index) const {
+    CHECK_NOTNULL(index);
+    const std::vector<uint32_t>::const_iterator it = std::lower_bound(
+        sorted_indices_.begin(), sorted_indices_.end(), id,
+        [this](const uint32_t lhs, const IdType& rhs) {
+          return ids_by_index_[lhs] < rhs;
+        });
+    if (it == sorted_indices_.end() || ids_by_index_[*it] != id) {
+      return false;
+    }
+    *index = *it;
+    return true;
+  }
+
+  inline bool hasId(const IdType& id) const {
+    size_t index;
+    return getIndex(id, &index);
+  }
+
+  inline const std::vector<IdType>& getIdsByIndex() const {
+    return ids_by_index_;
+  }
+
+  inline bool operator==(const SortedIdIndex& other) const {
+    return ids_by_index_ == other.ids_by_index_;
+  }
+
+ private:
+  std::vector<IdType> ids_by_index_;
+  std::vector<uint32_t> sorted_indices_;
+};
+
+}  // namespace summary_map
+
+#endif  // LOCALIZATION_SUMMARY_MAP_SORTED_ID_INDEX_H_
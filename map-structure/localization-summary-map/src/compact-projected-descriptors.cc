@@ -0,0 +1,207 @@
+#include "localization-summary-map/compact-projected-descriptors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace summary_map {
+
+bool parseDescriptorPrecision(
+    const std::string& precision_string, DescriptorPrecision* precision) {
+  CHECK_NOTNULL(precision);
+  if (precision_string == "float32") {
+    *precision = DescriptorPrecision::kFloat32;
+  } else if (precision_string == "float16") {
+    *precision = DescriptorPrecision::kFloat16;
+  } else if (precision_string == "int8") {
+    *precision = DescriptorPrecision::kInt8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string descriptorPrecisionToString(const DescriptorPrecision precision) {
+  switch (precision) {
+    case DescriptorPrecision::kFloat32:
+      return "float32";
+    case DescriptorPrecision::kFloat16:
+      return "float16";
+    case DescriptorPrecision::kInt8:
+      return "int8";
+    default:
+      LOG(FATAL) << "Unknown descriptor precision "
+                 << static_cast<uint32_t>(precision) << ".";
+  }
+  return "";
+}
+
+size_t getBytesPerDescriptorElement(const DescriptorPrecision precision) {
+  switch (precision) {
+    case DescriptorPrecision::kFloat32:
+      return sizeof(float);
+    case DescriptorPrecision::kFloat16:
+      return sizeof(uint16_t);
+    case DescriptorPrecision::kInt8:
+      return sizeof(int8_t);
+    default:
+      LOG(FATAL) << "Unknown descriptor precision "
+                 << static_cast<uint32_t>(precision) << ".";
+  }
+  return 0u;
+}
+
+uint16_t floatToHalf(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  const uint32_t abs_bits = bits & 0x7fffffffu;
+
+  if (abs_bits >= 0x7f800000u) {
+    // Infinity or NaN.
+    return sign | 0x7c00u | (abs_bits > 0x7f800000u ? 0x0200u : 0u);
+  }
+  if (abs_bits >= 0x477ff000u) {
+    // Rounds to a value beyond the largest half.
+    return sign | 0x7c00u;
+  }
+  if (abs_bits < 0x38800000u) {
+    // Subnormal half, in units of 2^-24.
+    float abs_value;
+    std::memcpy(&abs_value, &abs_bits, sizeof(abs_value));
+    return sign |
+           static_cast<uint16_t>(std::nearbyint(abs_value * 16777216.0f));
+  }
+  // Normal half, the mantissa is rounded to nearest even. A carry out of the
+  // mantissa correctly increments the exponent.
+  uint32_t half_bits =
+      ((((abs_bits >> 23) - 127u + 15u) << 10) | ((abs_bits >> 13) & 0x3ffu));
+  const uint32_t remainder = abs_bits & 0x1fffu;
+  if (remainder > 0x1000u || (remainder == 0x1000u && (half_bits & 1u))) {
+    ++half_bits;
+  }
+  return sign | static_cast<uint16_t>(half_bits);
+}
+
+float halfToFloat(const uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1fu;
+  const uint32_t mantissa = value & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0u) {
+    const float abs_value = mantissa / 16777216.0f;
+    std::memcpy(&bits, &abs_value, sizeof(bits));
+    bits |= sign;
+  } else if (exponent == 0x1fu) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent - 15u + 127u) << 23) | (mantissa << 13);
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+CompactProjectedDescriptors::CompactProjectedDescriptors() {
+  clear();
+}
+
+void CompactProjectedDescriptors::quantize(
+    const Eigen::MatrixXf& descriptors, const DescriptorPrecision precision) {
+  CHECK(precision != DescriptorPrecision::kFloat32)
+      << "Float descriptors are not compact.";
+  const int rows = descriptors.rows();
+  const int cols = descriptors.cols();
+
+  Eigen::VectorXf scales(rows);
+  for (int row = 0; row < rows; ++row) {
+    const float max_abs_value =
+        cols > 0 ? descriptors.row(row).cwiseAbs().maxCoeff() : 0.0f;
+    scales(row) = max_abs_value > 0.0f ? max_abs_value : 1.0f;
+  }
+  const Eigen::VectorXf inverse_scales = scales.cwiseInverse();
+
+  std::shared_ptr<std::vector<uint8_t>> buffer =
+      std::make_shared<std::vector<uint8_t>>(
+          static_cast<size_t>(rows) * cols *
+          getBytesPerDescriptorElement(precision));
+  if (precision == DescriptorPrecision::kInt8) {
+    constexpr float kMaxInt8 = 127.0f;
+    int8_t* values = reinterpret_cast<int8_t*>(buffer->data());
+    for (int col = 0; col < cols; ++col) {
+      for (int row = 0; row < rows; ++row) {
+        const float normalized_value =
+            descriptors(row, col) * inverse_scales(row);
+        values[static_cast<size_t>(col) * rows + row] =
+            static_cast<int8_t>(std::max(
+                -kMaxInt8,
+                std::min(kMaxInt8, std::round(normalized_value * kMaxInt8))));
+      }
+    }
+  } else {
+    CHECK(precision == DescriptorPrecision::kFloat16);
+    uint16_t* values = reinterpret_cast<uint16_t*>(buffer->data());
+    for (int col = 0; col < cols; ++col) {
+      for (int row = 0; row < rows; ++row) {
+        values[static_cast<size_t>(col) * rows + row] =
+            floatToHalf(descriptors(row, col) * inverse_scales(row));
+      }
+    }
+  }
+  setData(precision, rows, cols, scales, buffer->data(), buffer);
+}
+
+void CompactProjectedDescriptors::setData(
+    const DescriptorPrecision precision, const int rows, const int cols,
+    const Eigen::VectorXf& scales, const uint8_t* data,
+    const std::shared_ptr<const void>& data_owner) {
+  CHECK(precision != DescriptorPrecision::kFloat32)
+      << "Float descriptors are not compact.";
+  CHECK_GE(rows, 0);
+  CHECK_GE(cols, 0);
+  CHECK_EQ(scales.rows(), rows);
+  CHECK(data != nullptr || rows * cols == 0);
+  precision_ = precision;
+  rows_ = rows;
+  cols_ = cols;
+  scales_ = scales;
+  data_ = data;
+  data_owner_ = data_owner;
+  initializeDequantizationFactors();
+}
+
+void CompactProjectedDescriptors::clear() {
+  precision_ = DescriptorPrecision::kFloat32;
+  rows_ = 0;
+  cols_ = 0;
+  scales_.resize(0);
+  dequantization_factors_.resize(0);
+  data_ = nullptr;
+  data_owner_.reset();
+}
+
+void CompactProjectedDescriptors::initializeDequantizationFactors() {
+  if (precision_ == DescriptorPrecision::kInt8) {
+    dequantization_factors_ = scales_ / 127.0f;
+  } else {
+    dequantization_factors_ = scales_;
+  }
+}
+
+void CompactProjectedDescriptors::toFloat(Eigen::MatrixXf* descriptors) const {
+  CHECK_NOTNULL(descriptors)->resize(rows_, cols_);
+  for (int col = 0; col < cols_; ++col) {
+    getDescriptor(col, descriptors->col(col));
+  }
+}
+
+bool CompactProjectedDescriptors::operator==(
+    const CompactProjectedDescriptors& other) const {
+  return precision_ == other.precision_ && rows_ == other.rows_ &&
+         cols_ == other.cols_ && scales_ == other.scales_ &&
+         (numBytes() == 0u ||
+          std::memcmp(data_, other.data_, numBytes()) == 0);
+}
+
+}  // namespace summary_map
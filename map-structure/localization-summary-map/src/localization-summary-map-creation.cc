@@ -1,6 +1,9 @@
 #include "localization-summary-map/localization-summary-map-creation.h"
 
+#include <algorithm>
 #include <fstream>  // NOLINT
+#include <unordered_map>
+#include <vector>
 
 #include <Eigen/Core>
 #include <descriptor-projection/descriptor-projection.h>
@@ -10,6 +13,8 @@
 #include <map-sparsification/sampler-factory.h>
 #include <maplab-common/binary-serialization.h>
 #include <maplab-common/eigen-proto.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 #include <vi-map-helpers/vi-map-queries.h>
 #include <vi-map/vi-map.h>
 
@@ -17,6 +22,10 @@
 #include "localization-summary-map/localization-summary-map.h"
 
 namespace summary_map {
+namespace {
+// Number of descriptors that are gathered and projected at once.
+constexpr size_t kNumObservationsPerProjectionBlock = 1024u;
+}  // namespace
 
 void createLocalizationSummaryMapForWellConstrainedLandmarks(
     const vi_map::VIMap& map,
@@ -135,14 +144,18 @@ void createLocalizationSummaryMapFromLandmarkList(
                                 << FLAGS_lc_projection_matrix_filename;
   common::Deserialize(&projection_matrix, &deserializer);
 
+  const size_t num_observations = observations.size();
   projected_descriptors.resize(
-      FLAGS_lc_target_dimensionality, observations.size());
-  observer_indices.resize(observations.size());
+      FLAGS_lc_target_dimensionality, num_observations);
+  observer_indices.resize(num_observations);
   Aligned<std::vector, Eigen::Vector3d> G_observer_positions;
 
   std::unordered_map<vi_map::VisualFrameIdentifier, int> frame_id_to_index;
   int observer_index = 0;
-  for (size_t observation_index = 0u; observation_index < observations.size();
+  // Observations whose descriptors are not cached and need to be projected.
+  std::vector<size_t> observations_to_project;
+  observations_to_project.reserve(num_observations);
+  for (size_t observation_index = 0u; observation_index < num_observations;
        ++observation_index) {
     // We store the observer index for covisibility graph based filtering.
     const vi_map::KeypointIdentifier& observation =
@@ -160,34 +173,70 @@ void createLocalizationSummaryMapFromLandmarkList(
     }
     observer_indices(observation_index, 0) = it->second;
 
-    CHECK_LT(observation_index, observation_to_landmark.size());
-    const size_t landmark_index = observation_to_landmark[observation_index];
-    CHECK_LT(landmark_index, landmark_ids.size());
-    const vi_map::LandmarkId& landmark_id = landmark_ids[landmark_index];
     if (summary_map_cache == nullptr ||
-        !summary_map_cache->getProjectedDescriptorForLandmark(
-            observation, landmark_id,
-            projected_descriptors.col(observation_index))) {
-      // No projected descriptor is stored yet, need to compute first.
-      const aslam::VisualFrame& frame =
-          map.getVertex(observation.frame_id.vertex_id)
-              .getVisualFrame(observation.frame_id.frame_index);
-
-      Eigen::Map<const Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> >
-          raw_descriptor(
-              frame.getDescriptor(observation.keypoint_index),
-              frame.getDescriptorSizeBytes(), 1);
-
-      // Project the descriptors directly into the descriptor storage.
-      descriptor_projection::ProjectDescriptor(
-          raw_descriptor, projection_matrix, FLAGS_lc_target_dimensionality,
-          projected_descriptors.col(observation_index));
+        !summary_map_cache->getProjectedDescriptor(
+            observation, projected_descriptors.col(observation_index))) {
+      observations_to_project.push_back(observation_index);
+    }
+  }
 
-      if (summary_map_cache != nullptr) {
-        summary_map_cache->addProjectedDescriptor(
-            observation, landmark_id,
-            projected_descriptors.col(observation_index));
-      }
+  // Gather the raw descriptors of blocks of observations into contiguous
+  // matrices and project every block with a single matrix product. The blocks
+  // are distributed over all threads and write to disjoint columns.
+  const size_t num_observations_to_project = observations_to_project.size();
+  const size_t num_blocks =
+      (num_observations_to_project + kNumObservationsPerProjectionBlock - 1u) /
+      kNumObservationsPerProjectionBlock;
+  const size_t num_threads = common::getNumHardwareThreads();
+  common::ParallelProcess(
+      num_blocks,
+      [&](const std::vector<size_t>& batch) {
+        Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>
+            raw_descriptors;
+        Eigen::MatrixXf projected_block;
+        for (const size_t block_idx : batch) {
+          const size_t begin = block_idx * kNumObservationsPerProjectionBlock;
+          const size_t end = std::min(
+              begin + kNumObservationsPerProjectionBlock,
+              num_observations_to_project);
+          for (size_t idx = begin; idx < end; ++idx) {
+            const vi_map::KeypointIdentifier& observation =
+                observations[observations_to_project[idx]];
+            const aslam::VisualFrame& frame =
+                map.getVertex(observation.frame_id.vertex_id)
+                    .getVisualFrame(observation.frame_id.frame_index);
+            const int descriptor_size_bytes =
+                static_cast<int>(frame.getDescriptorSizeBytes());
+            if (idx == begin) {
+              raw_descriptors.resize(descriptor_size_bytes, end - begin);
+            }
+            CHECK_EQ(descriptor_size_bytes, raw_descriptors.rows())
+                << "All descriptors need to have the same size.";
+            raw_descriptors.col(idx - begin) =
+                Eigen::Map<const Eigen::Matrix<unsigned char, Eigen::Dynamic,
+                                               1> >(
+                    frame.getDescriptor(observation.keypoint_index),
+                    descriptor_size_bytes, 1);
+          }
+          descriptor_projection::ProjectDescriptorBlock(
+              raw_descriptors, projection_matrix,
+              FLAGS_lc_target_dimensionality, &projected_block);
+          for (size_t idx = begin; idx < end; ++idx) {
+            projected_descriptors.col(observations_to_project[idx]) =
+                projected_block.col(idx - begin);
+          }
+        }
+      },
+      true /*always_parallelize*/, num_threads);
+
+  if (summary_map_cache != nullptr) {
+    summary_map_cache->reserve(
+        summary_map_cache->size() + num_observations_to_project,
+        FLAGS_lc_target_dimensionality);
+    for (const size_t observation_index : observations_to_project) {
+      summary_map_cache->addProjectedDescriptor(
+          observations[observation_index],
+          projected_descriptors.col(observation_index));
     }
   }
   G_observer_position.resize(Eigen::NoChange, G_observer_positions.size());
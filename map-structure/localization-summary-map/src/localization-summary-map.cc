@@ -1,5 +1,15 @@
 #include "localization-summary-map/localization-summary-map.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT
+#include <vector>
+
 #include <maplab-common/eigen-proto.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/proto-serialization-helper.h>
@@ -8,8 +18,81 @@
 #include "localization-summary-map/localization-summary-map.pb.h"
 
 namespace summary_map {
+namespace {
+
+constexpr char kCompactFileMagic[8] = {'M', 'L', 'S', 'U', 'M', 'M', 'A', 'P'};
+constexpr uint32_t kCompactFileVersion = 1u;
+constexpr size_t kCompactFileSectionAlignment = 64u;
+
+// The compact file starts with this header, followed by the landmark
+// positions, the observer positions, the descriptor scales, the projected
+// descriptors, the observer indices and the observation to landmark indices.
+// Every section starts at a multiple of kCompactFileSectionAlignment, such
+// that the file can be memory mapped and used in place. The values are stored
+// in the byte order of the host.
+struct CompactFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t descriptor_precision;
+  uint64_t num_landmarks;
+  uint64_t num_observers;
+  uint64_t num_observations;
+  uint64_t descriptor_dimensions;
+};
+
+size_t alignSectionOffset(const size_t offset) {
+  return (offset + kCompactFileSectionAlignment - 1u) /
+         kCompactFileSectionAlignment * kCompactFileSectionAlignment;
+}
+
+struct CompactFileLayout {
+  explicit CompactFileLayout(const CompactFileHeader& header) {
+    const size_t descriptor_bytes =
+        getBytesPerDescriptorElement(
+            static_cast<DescriptorPrecision>(header.descriptor_precision)) *
+        header.descriptor_dimensions * header.num_observations;
+    landmark_positions_offset = alignSectionOffset(sizeof(CompactFileHeader));
+    observer_positions_offset = alignSectionOffset(
+        landmark_positions_offset + 3u * sizeof(float) * header.num_landmarks);
+    descriptor_scales_offset = alignSectionOffset(
+        observer_positions_offset + 3u * sizeof(float) * header.num_observers);
+    descriptors_offset = alignSectionOffset(
+        descriptor_scales_offset +
+        sizeof(float) * header.descriptor_dimensions);
+    observer_indices_offset =
+        alignSectionOffset(descriptors_offset + descriptor_bytes);
+    observation_to_landmark_index_offset = alignSectionOffset(
+        observer_indices_offset +
+        sizeof(unsigned int) * header.num_observations);
+    file_size = observation_to_landmark_index_offset +
+                sizeof(unsigned int) * header.num_observations;
+  }
+  size_t landmark_positions_offset;
+  size_t observer_positions_offset;
+  size_t descriptor_scales_offset;
+  size_t descriptors_offset;
+  size_t observer_indices_offset;
+  size_t observation_to_landmark_index_offset;
+  size_t file_size;
+};
+
+void writeCompactFileSection(
+    const size_t offset, const void* data, const size_t num_bytes,
+    std::ofstream* file) {
+  CHECK_NOTNULL(file);
+  const size_t position = static_cast<size_t>(file->tellp());
+  CHECK_LE(position, offset);
+  const std::vector<char> padding(offset - position, 0);
+  file->write(padding.data(), padding.size());
+  if (num_bytes > 0u) {
+    file->write(reinterpret_cast<const char*>(data), num_bytes);
+  }
+}
+
+}  // namespace
 
 constexpr char LocalizationSummaryMap::kFileName[];
+constexpr char LocalizationSummaryMap::kCompactFileName[];
 
 bool LocalizationSummaryMap::operator==(
     const LocalizationSummaryMap& other) const {
@@ -20,6 +103,8 @@ bool LocalizationSummaryMap::operator==(
   is_same &= G_landmark_position_ == other.G_landmark_position_;
   is_same &= G_observer_position_ == other.G_observer_position_;
   is_same &= projected_descriptors_ == other.projected_descriptors_;
+  is_same &=
+      compact_projected_descriptors_ == other.compact_projected_descriptors_;
   is_same &= observer_indices_ == other.observer_indices_;
   is_same &=
       observation_to_landmark_index_ == other.observation_to_landmark_index_;
@@ -42,8 +127,15 @@ void LocalizationSummaryMap::serialize(
       proto->mutable_uncompressed_map();
   common::eigen_proto::serialize(
       G_observer_position_, uncompressed_map->mutable_g_observer_position());
-  common::eigen_proto::serialize(
-      projected_descriptors_, uncompressed_map->mutable_descriptors());
+  if (projectedDescriptorPrecision() == DescriptorPrecision::kFloat32) {
+    common::eigen_proto::serialize(
+        projected_descriptors_, uncompressed_map->mutable_descriptors());
+  } else {
+    Eigen::MatrixXf projected_descriptors;
+    compact_projected_descriptors_.toFloat(&projected_descriptors);
+    common::eigen_proto::serialize(
+        projected_descriptors, uncompressed_map->mutable_descriptors());
+  }
   common::eigen_proto::serialize(
       observer_indices_, uncompressed_map->mutable_observer_indices());
   common::eigen_proto::serialize(
@@ -64,21 +156,11 @@ void LocalizationSummaryMap::deserialize(
         proto.uncompressed_map();
     common::eigen_proto::deserialize(
         uncompressed_map.g_observer_position(), &G_observer_position_);
-
-    // Create deterministic IDs based on the loc-summary-map-id.
-    constexpr int kMarsennePrime = 131071;
-    const int hash_seed = id_.hashToSizeT() ^ kMarsennePrime;
-    // Generate arbitrary IDs for the vertices. They are only necessary to
-    // communicate with the loop-closure backend and the map.
-    for (int i = 0; i < G_observer_position_.cols(); ++i) {
-      pose_graph::VertexId vertex_id;
-      common::generateIdFromInt(hash_seed + i, &vertex_id);
-      CHECK(vertex_id_to_index_.insert(std::make_pair(vertex_id, i)).second)
-          << "VertexId collision.";
-    }
+    initializeObserverIds(G_observer_position_.cols());
 
     common::eigen_proto::deserialize(
         uncompressed_map.descriptors(), &projected_descriptors_);
+    compact_projected_descriptors_.clear();
     common::eigen_proto::deserialize(
         uncompressed_map.observer_indices(), &observer_indices_);
     common::eigen_proto::deserialize(
@@ -106,6 +188,13 @@ bool LocalizationSummaryMap::loadFromFolder(
     return false;
   }
 
+  const std::string compact_file_path =
+      common::concatenateFolderAndFileName(folder_path, kCompactFileName);
+  if (common::fileExists(compact_file_path)) {
+    id_ = summary_map_id;
+    return loadCompactFile(compact_file_path);
+  }
+
   proto::LocalizationSummaryMap proto;
   if (!common::proto_serialization_helper::parseProtoFromFile(
           folder_path, kFileName, &proto)) {
@@ -132,10 +221,185 @@ bool LocalizationSummaryMap::saveToFolder(
     return false;
   }
 
+  // Once the new map is written, remove the map in the other format, it would
+  // shadow or be shadowed by the new one.
+  const std::string proto_file_path =
+      common::concatenateFolderAndFileName(folder_path, kFileName);
+  const std::string compact_file_path =
+      common::concatenateFolderAndFileName(folder_path, kCompactFileName);
+  if (projectedDescriptorPrecision() != DescriptorPrecision::kFloat32) {
+    if (!saveCompactFile(compact_file_path)) {
+      return false;
+    }
+    if (common::fileExists(proto_file_path)) {
+      common::deleteFile(proto_file_path);
+    }
+    return true;
+  }
+
   proto::LocalizationSummaryMap proto;
   serialize(&proto);
-  return common::proto_serialization_helper::serializeProtoToFile(
-      folder_path, kFileName, proto);
+  if (!common::proto_serialization_helper::serializeProtoToFile(
+          folder_path, kFileName, proto)) {
+    return false;
+  }
+  // Unlinking the compact file keeps it valid for maps that still map it.
+  if (common::fileExists(compact_file_path)) {
+    common::deleteFile(compact_file_path);
+  }
+  return true;
+}
+
+bool LocalizationSummaryMap::saveCompactFile(
+    const std::string& file_path) const {
+  CompactFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kCompactFileMagic, sizeof(header.magic));
+  header.version = kCompactFileVersion;
+  header.descriptor_precision =
+      static_cast<uint32_t>(projectedDescriptorPrecision());
+  header.num_landmarks = G_landmark_position_.cols();
+  header.num_observers = G_observer_position_.cols();
+  header.num_observations = numProjectedDescriptors();
+  header.descriptor_dimensions = projectedDescriptorDimensions();
+  CHECK_EQ(
+      static_cast<uint64_t>(observer_indices_.rows()),
+      header.num_observations);
+  CHECK_EQ(
+      static_cast<uint64_t>(observation_to_landmark_index_.rows()),
+      header.num_observations);
+  const CompactFileLayout layout(header);
+
+  // The existing file may be memory mapped by a loaded map, possibly this one,
+  // so it must not be truncated. The new file is written next to it and then
+  // replaces it atomically, the old mappings keep referring to the old file.
+  const std::string temporary_file_path = file_path + ".tmp";
+  std::ofstream file(temporary_file_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to open \"" << temporary_file_path
+               << "\" for writing.";
+    return false;
+  }
+  writeCompactFileSection(0u, &header, sizeof(header), &file);
+  writeCompactFileSection(
+      layout.landmark_positions_offset, G_landmark_position_.data(),
+      sizeof(float) * G_landmark_position_.size(), &file);
+  writeCompactFileSection(
+      layout.observer_positions_offset, G_observer_position_.data(),
+      sizeof(float) * G_observer_position_.size(), &file);
+  writeCompactFileSection(
+      layout.descriptor_scales_offset,
+      compact_projected_descriptors_.scales().data(),
+      sizeof(float) * compact_projected_descriptors_.scales().size(), &file);
+  writeCompactFileSection(
+      layout.descriptors_offset, compact_projected_descriptors_.data(),
+      compact_projected_descriptors_.numBytes(), &file);
+  writeCompactFileSection(
+      layout.observer_indices_offset, observer_indices_.data(),
+      sizeof(unsigned int) * observer_indices_.size(), &file);
+  writeCompactFileSection(
+      layout.observation_to_landmark_index_offset,
+      observation_to_landmark_index_.data(),
+      sizeof(unsigned int) * observation_to_landmark_index_.size(), &file);
+  file.close();
+  if (file.fail()) {
+    LOG(ERROR) << "Failed to write the summary map to \""
+               << temporary_file_path << "\".";
+    common::deleteFile(temporary_file_path);
+    return false;
+  }
+  if (std::rename(temporary_file_path.c_str(), file_path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to move the summary map to \"" << file_path
+               << "\".";
+    common::deleteFile(temporary_file_path);
+    return false;
+  }
+  return true;
+}
+
+bool LocalizationSummaryMap::loadCompactFile(const std::string& file_path) {
+  const int file_descriptor = open(file_path.c_str(), O_RDONLY);
+  if (file_descriptor < 0) {
+    LOG(ERROR) << "Failed to open \"" << file_path << "\".";
+    return false;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0 ||
+      static_cast<size_t>(file_status.st_size) < sizeof(CompactFileHeader)) {
+    LOG(ERROR) << "The summary map \"" << file_path << "\" is truncated.";
+    close(file_descriptor);
+    return false;
+  }
+  const size_t file_size = file_status.st_size;
+  void* mapped_file =
+      mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+  // The mapping stays valid after closing the file.
+  close(file_descriptor);
+  if (mapped_file == MAP_FAILED) {
+    LOG(ERROR) << "Failed to memory map \"" << file_path << "\".";
+    return false;
+  }
+  const std::shared_ptr<const void> mapping(
+      mapped_file,
+      [file_size](const void* data) {
+        munmap(const_cast<void*>(data), file_size);
+      });
+  const uint8_t* data = static_cast<const uint8_t*>(mapped_file);
+
+  CompactFileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kCompactFileMagic, sizeof(header.magic)) !=
+          0 ||
+      header.version != kCompactFileVersion) {
+    LOG(ERROR) << "\"" << file_path << "\" is not a compact summary map of "
+               << "version " << kCompactFileVersion << ".";
+    return false;
+  }
+  if (header.descriptor_precision !=
+          static_cast<uint32_t>(DescriptorPrecision::kFloat16) &&
+      header.descriptor_precision !=
+          static_cast<uint32_t>(DescriptorPrecision::kInt8)) {
+    LOG(ERROR) << "The summary map \"" << file_path << "\" has the unknown "
+               << "descriptor precision " << header.descriptor_precision
+               << ".";
+    return false;
+  }
+  const CompactFileLayout layout(header);
+  if (file_size < layout.file_size) {
+    LOG(ERROR) << "The summary map \"" << file_path << "\" is truncated.";
+    return false;
+  }
+
+  // The positions and indices are copied, the descriptors, which take up most
+  // of the memory, are used in place.
+  G_landmark_position_ = Eigen::Map<const Eigen::Matrix3Xf>(
+      reinterpret_cast<const float*>(data + layout.landmark_positions_offset),
+      3, header.num_landmarks);
+  initializeLandmarkIds(G_landmark_position_.cols());
+  G_observer_position_ = Eigen::Map<const Eigen::Matrix3Xf>(
+      reinterpret_cast<const float*>(data + layout.observer_positions_offset),
+      3, header.num_observers);
+  initializeObserverIds(G_observer_position_.cols());
+
+  typedef Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> IndexVector;
+  observer_indices_ = Eigen::Map<const IndexVector>(
+      reinterpret_cast<const unsigned int*>(
+          data + layout.observer_indices_offset),
+      header.num_observations);
+  observation_to_landmark_index_ = Eigen::Map<const IndexVector>(
+      reinterpret_cast<const unsigned int*>(
+          data + layout.observation_to_landmark_index_offset),
+      header.num_observations);
+
+  projected_descriptors_.resize(0, 0);
+  const Eigen::VectorXf scales = Eigen::Map<const Eigen::VectorXf>(
+      reinterpret_cast<const float*>(data + layout.descriptor_scales_offset),
+      header.descriptor_dimensions);
+  compact_projected_descriptors_.setData(
+      static_cast<DescriptorPrecision>(header.descriptor_precision),
+      header.descriptor_dimensions, header.num_observations, scales,
+      data + layout.descriptors_offset, mapping);
+  return true;
 }
 
 bool LocalizationSummaryMap::hasMapOnFileSystem(
@@ -144,47 +408,42 @@ bool LocalizationSummaryMap::hasMapOnFileSystem(
   if (!common::pathExists(folder_path)) {
     return false;
   }
-  const std::string complete_file_name = common::concatenateFolderAndFileName(
-      common::getRealPath(folder_path), kFileName);
-  return common::fileExists(complete_file_name);
+  const std::string real_folder_path = common::getRealPath(folder_path);
+  return common::fileExists(common::concatenateFolderAndFileName(
+             real_folder_path, kFileName)) ||
+         common::fileExists(common::concatenateFolderAndFileName(
+             real_folder_path, kCompactFileName));
 }
 
 bool LocalizationSummaryMap::hasLandmark(
     const vi_map::LandmarkId& landmark_id) const {
-  return landmark_id_to_landmark_index_.count(landmark_id) > 0u;
+  return landmark_id_to_landmark_index_.hasId(landmark_id);
 }
 
 Eigen::Vector3d LocalizationSummaryMap::getGLandmarkPosition(
     const vi_map::LandmarkId& landmark_id) const {
-  std::unordered_map<vi_map::LandmarkId, int>::const_iterator it =
-      landmark_id_to_landmark_index_.find(landmark_id);
-  CHECK(it != landmark_id_to_landmark_index_.end())
+  size_t index;
+  CHECK(landmark_id_to_landmark_index_.getIndex(landmark_id, &index))
       << "Landmark " << landmark_id << " is not in localization summary map.";
-  const int index = it->second;
-  CHECK_LT(index, G_landmark_position_.cols());
+  CHECK_LT(static_cast<int>(index), G_landmark_position_.cols());
   return G_landmark_position_.col(index).cast<double>();
 }
 
+bool LocalizationSummaryMap::hasVertex(
+    const pose_graph::VertexId& vertex_id) const {
+  return vertex_id_to_index_.hasId(vertex_id);
+}
+
 void LocalizationSummaryMap::getAllObserverIds(
     pose_graph::VertexIdList* observer_ids) const {
   CHECK_NOTNULL(observer_ids);
-  observer_ids->resize(vertex_id_to_index_.size());
-  for (const std::pair<pose_graph::VertexId, int>& value :
-       vertex_id_to_index_) {
-    CHECK_LT(value.second, static_cast<int>(observer_ids->size()));
-    (*observer_ids)[value.second] = value.first;
-  }
+  *observer_ids = vertex_id_to_index_.getIdsByIndex();
 }
 
 void LocalizationSummaryMap::getAllLandmarkIds(
     vi_map::LandmarkIdList* landmark_ids) const {
   CHECK_NOTNULL(landmark_ids);
-  landmark_ids->resize(landmark_id_to_landmark_index_.size());
-  for (const std::pair<vi_map::LandmarkId, int>& value :
-       landmark_id_to_landmark_index_) {
-    CHECK_LT(value.second, static_cast<int>(landmark_ids->size()));
-    (*landmark_ids)[value.second] = value.first;
-  }
+  *landmark_ids = landmark_id_to_landmark_index_.getIdsByIndex();
 }
 
 const Eigen::Matrix3Xf& LocalizationSummaryMap::GLandmarkPosition() const {
@@ -194,8 +453,27 @@ const Eigen::Matrix3Xf& LocalizationSummaryMap::GObserverPosition() const {
   return G_observer_position_;
 }
 const Eigen::MatrixXf& LocalizationSummaryMap::projectedDescriptors() const {
+  CHECK(projectedDescriptorPrecision() == DescriptorPrecision::kFloat32)
+      << "The projected descriptors are compressed, access them with "
+      << "getProjectedDescriptor.";
   return projected_descriptors_;
 }
+DescriptorPrecision LocalizationSummaryMap::projectedDescriptorPrecision()
+    const {
+  return compact_projected_descriptors_.precision();
+}
+int LocalizationSummaryMap::numProjectedDescriptors() const {
+  if (projectedDescriptorPrecision() == DescriptorPrecision::kFloat32) {
+    return projected_descriptors_.cols();
+  }
+  return compact_projected_descriptors_.cols();
+}
+int LocalizationSummaryMap::projectedDescriptorDimensions() const {
+  if (projectedDescriptorPrecision() == DescriptorPrecision::kFloat32) {
+    return projected_descriptors_.rows();
+  }
+  return compact_projected_descriptors_.rows();
+}
 const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
 LocalizationSummaryMap::observerIndices() const {
   return observer_indices_;
@@ -214,21 +492,29 @@ void LocalizationSummaryMap::setGLandmarkPosition(
 }
 
 void LocalizationSummaryMap::initializeLandmarkIds(int num_landmarks) {
-  landmark_id_to_landmark_index_.clear();
-
   // Create deterministic IDs based on the loc-summary-map-id.
   constexpr int kMarsennePrime = 524287;
   const int hash_seed = id_.hashToSizeT() ^ kMarsennePrime;
 
+  vi_map::LandmarkIdList landmark_ids(num_landmarks);
   for (int i = 0; i < num_landmarks; ++i) {
-    vi_map::LandmarkId landmark_id;
     const int id_seed = hash_seed + i;
-    common::generateIdFromInt(id_seed, &landmark_id);
-    CHECK(
-        landmark_id_to_landmark_index_.insert(std::make_pair(landmark_id, i))
-            .second)
-        << "LandmarkID collision.";
+    common::generateIdFromInt(id_seed, &landmark_ids[i]);
+  }
+  landmark_id_to_landmark_index_.assign(std::move(landmark_ids));
+}
+
+void LocalizationSummaryMap::initializeObserverIds(int num_observers) {
+  // Create deterministic IDs based on the loc-summary-map-id.
+  constexpr int kMarsennePrime = 131071;
+  const int hash_seed = id_.hashToSizeT() ^ kMarsennePrime;
+  // Generate arbitrary IDs for the vertices. They are only necessary to
+  // communicate with the loop-closure backend and the map.
+  pose_graph::VertexIdList vertex_ids(num_observers);
+  for (int i = 0; i < num_observers; ++i) {
+    common::generateIdFromInt(hash_seed + i, &vertex_ids[i]);
   }
+  vertex_id_to_index_.assign(std::move(vertex_ids));
 }
 
 void LocalizationSummaryMap::setGObserverPosition(
@@ -238,6 +524,26 @@ void LocalizationSummaryMap::setGObserverPosition(
 void LocalizationSummaryMap::setProjectedDescriptors(
     const Eigen::MatrixXf& descriptors) {
   projected_descriptors_ = descriptors;
+  compact_projected_descriptors_.clear();
+}
+void LocalizationSummaryMap::compressProjectedDescriptors(
+    const DescriptorPrecision precision) {
+  if (precision == projectedDescriptorPrecision()) {
+    return;
+  }
+  Eigen::MatrixXf descriptors;
+  if (projectedDescriptorPrecision() == DescriptorPrecision::kFloat32) {
+    descriptors.swap(projected_descriptors_);
+  } else {
+    compact_projected_descriptors_.toFloat(&descriptors);
+  }
+  if (precision == DescriptorPrecision::kFloat32) {
+    compact_projected_descriptors_.clear();
+    projected_descriptors_.swap(descriptors);
+  } else {
+    compact_projected_descriptors_.quantize(descriptors, precision);
+    projected_descriptors_.resize(0, 0);
+  }
 }
 void LocalizationSummaryMap::setObserverIndices(
     const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>& observer_indices) {
@@ -0,0 +1,167 @@
+#include <cmath>
+#include <string>
+
+#include <Eigen/Core>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/map-manager-config.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <maplab-common/test/testing-predicates.h>
+#include <maplab-common/unique-id.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/unique-id.h>
+
+#include "localization-summary-map/compact-projected-descriptors.h"
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace summary_map {
+
+class CompactLocalizationSummaryMapTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    common::generateId(&id_);
+    summary_map_.setId(id_);
+
+    constexpr int kNumLandmarks = 50;
+    Eigen::Matrix3Xd G_landmark_position;
+    G_landmark_position.setRandom(3, kNumLandmarks);
+    summary_map_.setGLandmarkPosition(G_landmark_position);
+
+    constexpr int kNumKeyframes = 10;
+    Eigen::Matrix3Xd G_observer_position;
+    G_observer_position.setRandom(3, kNumKeyframes);
+    summary_map_.setGObserverPosition(G_observer_position);
+
+    constexpr int kNumObservations = 120;
+    constexpr int kNumDescriptorDimensions = 10;
+    descriptors_.setRandom(kNumDescriptorDimensions, kNumObservations);
+    // Dimensions of very different magnitude.
+    descriptors_.row(0) *= 100.0f;
+    descriptors_.row(1) *= 1e-3f;
+    summary_map_.setProjectedDescriptors(descriptors_);
+
+    Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> observer_indices(
+        kNumObservations);
+    Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>
+        observation_to_landmark_index(kNumObservations);
+    for (int i = 0; i < kNumObservations; ++i) {
+      observer_indices(i) = i % kNumKeyframes;
+      observation_to_landmark_index(i) = i % kNumLandmarks;
+    }
+    summary_map_.setObserverIndices(observer_indices);
+    summary_map_.setObservationToLandmarkIndex(observation_to_landmark_index);
+  }
+
+  void expectDescriptorsNear(
+      const LocalizationSummaryMap& summary_map,
+      const double relative_tolerance) const {
+    ASSERT_EQ(summary_map.numProjectedDescriptors(), descriptors_.cols());
+    ASSERT_EQ(summary_map.projectedDescriptorDimensions(), descriptors_.rows());
+    for (int col = 0; col < descriptors_.cols(); ++col) {
+      Eigen::VectorXf descriptor;
+      summary_map.getProjectedDescriptor(col, descriptor);
+      for (int row = 0; row < descriptors_.rows(); ++row) {
+        const double max_abs_value =
+            descriptors_.row(row).cwiseAbs().maxCoeff();
+        EXPECT_NEAR(
+            descriptor(row), descriptors_(row, col),
+            relative_tolerance * max_abs_value);
+      }
+    }
+  }
+
+  LocalizationSummaryMapId id_;
+  LocalizationSummaryMap summary_map_;
+  Eigen::MatrixXf descriptors_;
+};
+
+TEST(CompactProjectedDescriptorsTest, HalfConversionIsExact) {
+  const float kValues[] = {0.0f,    1.0f,       -1.0f,    0.5f,
+                           65504.0f, 6.1035156e-05f, 5.9604645e-08f, -2.25f};
+  for (const float value : kValues) {
+    EXPECT_EQ(halfToFloat(floatToHalf(value)), value);
+  }
+  // Rounds to the nearest half.
+  EXPECT_NEAR(halfToFloat(floatToHalf(0.1f)), 0.1f, 0.1f * 1e-3f);
+  EXPECT_TRUE(std::isinf(halfToFloat(floatToHalf(1e6f))));
+}
+
+TEST_F(CompactLocalizationSummaryMapTest, CompressedDescriptorsAreClose) {
+  summary_map_.compressProjectedDescriptors(DescriptorPrecision::kFloat16);
+  EXPECT_TRUE(
+      summary_map_.projectedDescriptorPrecision() ==
+      DescriptorPrecision::kFloat16);
+  expectDescriptorsNear(summary_map_, 1e-3);
+
+  summary_map_.compressProjectedDescriptors(DescriptorPrecision::kInt8);
+  EXPECT_TRUE(
+      summary_map_.projectedDescriptorPrecision() ==
+      DescriptorPrecision::kInt8);
+  // Half a quantization step plus the error of the float16 step before.
+  expectDescriptorsNear(summary_map_, 0.5 / 127.0 + 1e-3);
+
+  summary_map_.compressProjectedDescriptors(DescriptorPrecision::kFloat32);
+  EXPECT_EQ(summary_map_.projectedDescriptors().cols(), descriptors_.cols());
+  expectDescriptorsNear(summary_map_, 0.5 / 127.0 + 1e-3);
+}
+
+TEST_F(CompactLocalizationSummaryMapTest, SaveAndLoadCompactMap) {
+  summary_map_.compressProjectedDescriptors(DescriptorPrecision::kInt8);
+
+  const std::string kFolder = "compact_localization_summary_map_test";
+  ASSERT_TRUE(common::removeIfExistsAndCreatePath(kFolder));
+  backend::SaveConfig save_config;
+  ASSERT_TRUE(summary_map_.saveToFolder(kFolder, save_config));
+  EXPECT_TRUE(LocalizationSummaryMap::hasMapOnFileSystem(kFolder));
+
+  LocalizationSummaryMap loaded_summary_map;
+  ASSERT_TRUE(loaded_summary_map.loadFromFolder(id_, kFolder));
+  EXPECT_EQ(summary_map_, loaded_summary_map);
+  expectDescriptorsNear(loaded_summary_map, 0.5 / 127.0);
+
+  vi_map::LandmarkIdList landmark_ids;
+  loaded_summary_map.getAllLandmarkIds(&landmark_ids);
+  ASSERT_EQ(landmark_ids.size(), 50u);
+  for (size_t i = 0u; i < landmark_ids.size(); ++i) {
+    ASSERT_TRUE(loaded_summary_map.hasLandmark(landmark_ids[i]));
+    EXPECT_NEAR_EIGEN(
+        loaded_summary_map.getGLandmarkPosition(landmark_ids[i]),
+        summary_map_.GLandmarkPosition().col(i).cast<double>(), 1e-12);
+  }
+  vi_map::LandmarkId unknown_landmark_id;
+  common::generateId(&unknown_landmark_id);
+  EXPECT_FALSE(loaded_summary_map.hasLandmark(unknown_landmark_id));
+
+  pose_graph::VertexIdList observer_ids;
+  loaded_summary_map.getAllObserverIds(&observer_ids);
+  ASSERT_EQ(observer_ids.size(), 10u);
+  for (const pose_graph::VertexId& observer_id : observer_ids) {
+    EXPECT_TRUE(loaded_summary_map.hasVertex(observer_id));
+  }
+
+  // Saving a loaded map to its own folder replaces the file it maps without
+  // invalidating the mapping.
+  save_config.overwrite_existing_files = true;
+  ASSERT_TRUE(loaded_summary_map.saveToFolder(kFolder, save_config));
+  EXPECT_EQ(summary_map_, loaded_summary_map);
+  expectDescriptorsNear(loaded_summary_map, 0.5 / 127.0);
+  EXPECT_FALSE(common::fileExists(common::concatenateFolderAndFileName(
+      kFolder, "localization_summary_map_compact.tmp")));
+  LocalizationSummaryMap reloaded_summary_map;
+  ASSERT_TRUE(reloaded_summary_map.loadFromFolder(id_, kFolder));
+  EXPECT_EQ(summary_map_, reloaded_summary_map);
+  expectDescriptorsNear(reloaded_summary_map, 0.5 / 127.0);
+
+  // Saving the float map again replaces the compact one.
+  summary_map_.compressProjectedDescriptors(DescriptorPrecision::kFloat32);
+  ASSERT_TRUE(summary_map_.saveToFolder(kFolder, save_config));
+  LocalizationSummaryMap float_summary_map;
+  ASSERT_TRUE(float_summary_map.loadFromFolder(id_, kFolder));
+  EXPECT_TRUE(
+      float_summary_map.projectedDescriptorPrecision() ==
+      DescriptorPrecision::kFloat32);
+  EXPECT_EQ(summary_map_, float_summary_map);
+}
+
+}  // namespace summary_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
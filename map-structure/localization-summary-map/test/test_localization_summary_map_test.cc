@@ -10,6 +10,7 @@
 #include <vi-map/test/vi-map-generator.h>
 #include <vi-map/unique-id.h>
 
+#include "localization-summary-map/localization-summary-map-cache.h"
 #include "localization-summary-map/localization-summary-map-creation.h"
 #include "localization-summary-map/localization-summary-map.h"
 
@@ -85,4 +86,63 @@ TEST_F(LocalizationSummaryMapTest, LocalizationSummaryCreationFromMapTest) {
   EXPECT_EQ(2, landmark_observers(4, 0));
 }
 
+TEST_F(LocalizationSummaryMapTest, LocalizationSummaryCreationWithCacheTest) {
+  vi_map::LandmarkIdList summary_landmark_ids;
+  summary_landmark_ids.push_back(landmark_1_id_);
+  summary_landmark_ids.push_back(landmark_2_id_);
+
+  summary_map::LocalizationSummaryMapCache cache;
+  summary_map::LocalizationSummaryMap summary_map;
+  summary_map::createLocalizationSummaryMapFromLandmarkList(
+      map_, summary_landmark_ids, &cache, &summary_map);
+  EXPECT_EQ(5u, cache.size());
+
+  // The second map reuses the cached descriptors of the first two landmarks.
+  summary_landmark_ids.push_back(landmark_3_id_);
+  summary_map::LocalizationSummaryMap summary_map_cached;
+  summary_map::createLocalizationSummaryMapFromLandmarkList(
+      map_, summary_landmark_ids, &cache, &summary_map_cached);
+  EXPECT_EQ(7u, cache.size());
+
+  summary_map::LocalizationSummaryMap summary_map_uncached;
+  summary_map::createLocalizationSummaryMapFromLandmarkList(
+      map_, summary_landmark_ids, &summary_map_uncached);
+  ASSERT_EQ(7, summary_map_cached.projectedDescriptors().cols());
+  EXPECT_NEAR_EIGEN(
+      summary_map_uncached.projectedDescriptors(),
+      summary_map_cached.projectedDescriptors(), 1e-6);
+  EXPECT_NEAR_EIGEN(
+      summary_map.projectedDescriptors(),
+      summary_map_cached.projectedDescriptors().leftCols(5), 1e-6);
+}
+
+TEST(LocalizationSummaryMapCacheTest, AddAndGetProjectedDescriptors) {
+  summary_map::LocalizationSummaryMapCache cache;
+  constexpr int kDimensions = 10;
+  constexpr size_t kNumDescriptors = 50u;
+  Eigen::MatrixXf descriptors =
+      Eigen::MatrixXf::Random(kDimensions, kNumDescriptors);
+
+  vi_map::VisualFrameIdentifier frame_id;
+  common::generateId(&frame_id.vertex_id);
+  frame_id.frame_index = 0u;
+  for (size_t i = 0u; i < kNumDescriptors; ++i) {
+    cache.addProjectedDescriptor(
+        vi_map::KeypointIdentifier(frame_id, i), descriptors.col(i));
+  }
+  EXPECT_EQ(kNumDescriptors, cache.size());
+
+  Eigen::MatrixXf cached_descriptors(kDimensions, kNumDescriptors);
+  for (size_t i = 0u; i < kNumDescriptors; ++i) {
+    EXPECT_TRUE(cache.getProjectedDescriptor(
+        vi_map::KeypointIdentifier(frame_id, i), cached_descriptors.col(i)));
+  }
+  EXPECT_NEAR_EIGEN(descriptors, cached_descriptors, 0.0);
+
+  Eigen::VectorXf missing_descriptor(kDimensions);
+  EXPECT_FALSE(cache.getProjectedDescriptor(
+      vi_map::KeypointIdentifier(frame_id, kNumDescriptors),
+      missing_descriptor));
+}
+
 MAPLAB_UNITTEST_ENTRYPOINT
@@ -45,6 +45,10 @@ class Edge {
   virtual const VertexId& from() const = 0;
   virtual const VertexId& to() const = 0;
 
+  // Returns a copy of this edge. Used to detach edges that are shared between
+  // pose graphs before modifying them.
+  virtual Edge::UniquePtr clone() const = 0;
+
   inline EdgeType getType() const {
     return edge_type_;
   }
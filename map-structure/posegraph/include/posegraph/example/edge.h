@@ -20,6 +20,8 @@ class Edge : public pose_graph::Edge {
   virtual const VertexId& from() const;
   virtual const VertexId& to() const;
 
+  virtual pose_graph::Edge::UniquePtr clone() const;
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
  private:
@@ -16,6 +16,8 @@ class Vertex : public pose_graph::Vertex {
 
   virtual const VertexId& id() const;
 
+  virtual pose_graph::Vertex::UniquePtr clone() const;
+
   virtual bool addIncomingEdge(const EdgeId& edge);
   virtual bool addOutgoingEdge(const EdgeId& edge);
 
@@ -28,6 +28,7 @@ size_t PoseGraph::removeEdgesOfType() {
 void PoseGraph::clear() {
   vertices_.clear();
   edges_.clear();
+  may_have_shared_items_ = false;
 }
 
 }  // namespace pose_graph
@@ -1,7 +1,10 @@
 #ifndef POSEGRAPH_POSE_GRAPH_H_
 #define POSEGRAPH_POSE_GRAPH_H_
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -14,11 +17,32 @@ namespace pose_graph {
 class PoseGraph {
  protected:
   // Accessible by derived classes for more flexible extension.
-  typedef std::unordered_map<VertexId, AlignedUniquePtr<Vertex>> VertexMap;
+  // The vertices and edges are reference counted such that they can be shared
+  // between pose graphs, see shareVerticesAndEdgesFrom(..).
+  typedef std::unordered_map<VertexId, std::shared_ptr<Vertex>> VertexMap;
   VertexMap vertices_;
-  typedef std::unordered_map<EdgeId, AlignedUniquePtr<Edge>> EdgeMap;
+  typedef std::unordered_map<EdgeId, std::shared_ptr<Edge>> EdgeMap;
   EdgeMap edges_;
 
+ private:
+  // Replaces the item by a clone if it is shared with other pose graphs and
+  // returns the item owned by this graph. Safe to call concurrently, also for
+  // the same item.
+  template <typename ItemType>
+  ItemType* detachIfShared(std::shared_ptr<ItemType>* item);
+  // Reads the item of the slot, locked against a concurrent detach if this
+  // graph shares items.
+  template <typename ItemType>
+  const ItemType* loadItem(const std::shared_ptr<ItemType>& item) const;
+
+  // Set once this graph shares items with another graph, the mutable getters
+  // don't lock anything before.
+  mutable std::atomic<bool> may_have_shared_items_{false};
+  // Serializes the detaching and the reading of the same slot, indexed by the
+  // item's slot.
+  static constexpr size_t kNumDetachMutexes = 64u;
+  mutable std::array<std::mutex, kNumDetachMutexes> detach_mutexes_;
+
  public:
   MAPLAB_POINTER_TYPEDEFS(PoseGraph);
 
@@ -34,6 +58,46 @@ class PoseGraph {
 
   void addEdge(AlignedUniquePtr<Edge> edge);
 
+  // Reserves space for the given total number of vertices and edges.
+  void reserve(size_t num_vertices, size_t num_edges);
+
+  // Bulk insertion of vertices and edges, e.g. of shards that were built in
+  // parallel. Contrary to addEdge(..), no book-keeping is done in the
+  // vertices, i.e. the vertices are expected to already reference their edges
+  // and the edges may be added before their vertices. The vectors are empty
+  // afterwards.
+  void addVerticesAndEdges(
+      std::vector<AlignedUniquePtr<Vertex>>* vertices,
+      std::vector<AlignedUniquePtr<Edge>>* edges);
+
+  // Moves all vertices and edges of the other pose graph into this one
+  // without copying them, the other pose graph is empty afterwards. No
+  // book-keeping is done in the vertices, see addVerticesAndEdges(..).
+  void moveVerticesAndEdgesFrom(PoseGraph* other);
+
+  // Makes this pose graph share all vertices and edges of the other pose graph
+  // (copy-on-write). A shared vertex or edge is cloned by the first of the
+  // graphs that accesses it through one of the mutable getters, all other
+  // items stay shared. The graphs must not have any vertices or edges in
+  // common before and must not be modified during this call.
+  // Concurrent mutable accesses detach an item exactly once, the other graph
+  // then is the only owner of the replaced item and writes it in place.
+  // Detaching an item is like removing it from this graph: references to it
+  // obtained from this graph before stay valid only as long as the other
+  // graph keeps the item, i.e. the other graph is the lifetime of such a
+  // snapshot reference.
+  void shareVerticesAndEdgesFrom(const PoseGraph& other);
+
+  // Clones all items that are still shared, which invalidates all references
+  // to them obtained from this graph. Must not be called concurrently with
+  // any other access to this graph.
+  void detachSharedVerticesAndEdges();
+
+  // Returns the number of vertices or edges that are currently shared with at
+  // least one other pose graph.
+  size_t numSharedVertices() const;
+  size_t numSharedEdges() const;
+
   /****************************************
    * Const ops
    ****************************************/
@@ -60,7 +124,8 @@ class PoseGraph {
   // returns an Edge with the given ID.
   const Edge& getEdge(const EdgeId& id) const;
 
-  // returns a Vertex with the given ID.
+  // returns a Vertex with the given ID. All mutable getters clone the item
+  // first if it is shared with another pose graph.
   Vertex& getVertexMutable(const VertexId& id);
 
   // returns an Edge with the given ID.
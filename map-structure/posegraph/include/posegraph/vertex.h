@@ -20,6 +20,10 @@ class Vertex {
 
   virtual const VertexId& id() const = 0;
 
+  // Returns a copy of this vertex that doesn't share any data with it. Used to
+  // detach vertices that are shared between pose graphs before modifying them.
+  virtual Vertex::UniquePtr clone() const = 0;
+
   virtual bool addIncomingEdge(const EdgeId& edge) = 0;
   virtual bool addOutgoingEdge(const EdgeId& edge) = 0;
 
@@ -1,3 +1,4 @@
+#include <aslam/common/memory.h>
 #include <glog/logging.h>
 #include <posegraph/example/edge.h>
 
@@ -23,5 +24,9 @@ const VertexId& Edge::to() const {
   return to_;
 }
 
+pose_graph::Edge::UniquePtr Edge::clone() const {
+  return aligned_unique<Edge>(*this);
+}
+
 }  // namespace example
 }  // namespace pose_graph
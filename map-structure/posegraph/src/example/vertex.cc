@@ -1,3 +1,4 @@
+#include <aslam/common/memory.h>
 #include <glog/logging.h>
 #include <posegraph/example/vertex.h>
 
@@ -12,6 +13,10 @@ const VertexId& Vertex::id() const {
   return id_;
 }
 
+pose_graph::Vertex::UniquePtr Vertex::clone() const {
+  return aligned_unique<Vertex>(*this);
+}
+
 bool Vertex::addIncomingEdge(const EdgeId& edge) {
   return incoming_.insert(edge).second;
 }
@@ -1,6 +1,11 @@
 #include "posegraph/pose-graph.h"
 
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <aslam/common/memory.h>
 #include <glog/logging.h>
@@ -10,11 +15,72 @@
 #include "posegraph/vertex.h"
 
 namespace pose_graph {
+namespace {
+template <typename ItemMap>
+size_t countSharedItems(const ItemMap& items) {
+  size_t num_shared_items = 0u;
+  for (const typename ItemMap::value_type& item : items) {
+    if (item.second.use_count() > 1) {
+      ++num_shared_items;
+    }
+  }
+  return num_shared_items;
+}
+
+template <typename ItemMap>
+void cloneSharedItems(ItemMap* items) {
+  CHECK_NOTNULL(items);
+  for (typename ItemMap::value_type& item : *items) {
+    CHECK(item.second != nullptr);
+    if (item.second.use_count() > 1) {
+      item.second = item.second->clone();
+    }
+  }
+}
+}  // namespace
+
+constexpr size_t PoseGraph::kNumDetachMutexes;
+
+template <typename ItemType>
+ItemType* PoseGraph::detachIfShared(std::shared_ptr<ItemType>* item) {
+  CHECK_NOTNULL(item);
+  if (!may_have_shared_items_.load(std::memory_order_acquire)) {
+    return CHECK_NOTNULL(item->get());
+  }
+  // The slots of an unordered_map don't move, so all threads accessing the
+  // same item lock the same mutex.
+  const size_t mutex_index =
+      std::hash<const void*>()(item) % kNumDetachMutexes;
+  std::lock_guard<std::mutex> lock(detach_mutexes_[mutex_index]);
+  CHECK(*item != nullptr);
+  // Only the graphs hold references to the items, so a count of one means
+  // that the other graphs have detached or released the item.
+  if (item->use_count() > 1) {
+    std::shared_ptr<ItemType> clone = (*item)->clone();
+    item->swap(clone);
+  }
+  return item->get();
+}
+
+template <typename ItemType>
+const ItemType* PoseGraph::loadItem(
+    const std::shared_ptr<ItemType>& item) const {
+  if (!may_have_shared_items_.load(std::memory_order_acquire)) {
+    return CHECK_NOTNULL(item.get());
+  }
+  const size_t mutex_index =
+      std::hash<const void*>()(&item) % kNumDetachMutexes;
+  std::lock_guard<std::mutex> lock(detach_mutexes_[mutex_index]);
+  return CHECK_NOTNULL(item.get());
+}
 
 void PoseGraph::swap(PoseGraph* other) {
   CHECK_NOTNULL(other);
   vertices_.swap(other->vertices_);
   edges_.swap(other->edges_);
+  const bool may_have_shared_items = may_have_shared_items_;
+  may_have_shared_items_ = other->may_have_shared_items_.load();
+  other->may_have_shared_items_ = may_have_shared_items;
 }
 
 void PoseGraph::addVertex(Vertex::UniquePtr vertex) {
@@ -37,17 +103,96 @@ void PoseGraph::addEdge(Edge::UniquePtr edge) {
       vertex_to.addIncomingEdge(edge_raw->id()));
 }
 
+void PoseGraph::reserve(const size_t num_vertices, const size_t num_edges) {
+  vertices_.reserve(num_vertices);
+  edges_.reserve(num_edges);
+}
+
+void PoseGraph::addVerticesAndEdges(
+    std::vector<AlignedUniquePtr<Vertex>>* vertices,
+    std::vector<AlignedUniquePtr<Edge>>* edges) {
+  CHECK_NOTNULL(vertices);
+  CHECK_NOTNULL(edges);
+  reserve(vertices_.size() + vertices->size(), edges_.size() + edges->size());
+  for (AlignedUniquePtr<Vertex>& vertex : *vertices) {
+    CHECK(vertex != nullptr);
+    const VertexId vertex_id = vertex->id();
+    CHECK(vertices_.emplace(vertex_id, std::move(vertex)).second)
+        << "Vertex " << vertex_id << " already exists.";
+  }
+  for (AlignedUniquePtr<Edge>& edge : *edges) {
+    CHECK(edge != nullptr);
+    const EdgeId edge_id = edge->id();
+    CHECK(edges_.emplace(edge_id, std::move(edge)).second)
+        << "Edge " << edge_id << " already exists.";
+  }
+  vertices->clear();
+  edges->clear();
+}
+
+void PoseGraph::moveVerticesAndEdgesFrom(PoseGraph* other) {
+  CHECK_NOTNULL(other);
+  CHECK_NE(this, other);
+  reserve(
+      vertices_.size() + other->vertices_.size(),
+      edges_.size() + other->edges_.size());
+  for (VertexMap::value_type& vertex : other->vertices_) {
+    CHECK(vertex.second != nullptr);
+    CHECK(vertices_.emplace(vertex.first, std::move(vertex.second)).second)
+        << "Vertex " << vertex.first << " already exists.";
+  }
+  for (EdgeMap::value_type& edge : other->edges_) {
+    CHECK(edge.second != nullptr);
+    CHECK(edges_.emplace(edge.first, std::move(edge.second)).second)
+        << "Edge " << edge.first << " already exists.";
+  }
+  other->clear();
+}
+
+void PoseGraph::shareVerticesAndEdgesFrom(const PoseGraph& other) {
+  CHECK_NE(this, &other);
+  reserve(
+      vertices_.size() + other.vertices_.size(),
+      edges_.size() + other.edges_.size());
+  for (const VertexMap::value_type& vertex : other.vertices_) {
+    CHECK(vertex.second != nullptr);
+    CHECK(vertices_.emplace(vertex.first, vertex.second).second)
+        << "Vertex " << vertex.first << " already exists.";
+  }
+  for (const EdgeMap::value_type& edge : other.edges_) {
+    CHECK(edge.second != nullptr);
+    CHECK(edges_.emplace(edge.first, edge.second).second)
+        << "Edge " << edge.first << " already exists.";
+  }
+  may_have_shared_items_ = true;
+  other.may_have_shared_items_ = true;
+}
+
+void PoseGraph::detachSharedVerticesAndEdges() {
+  cloneSharedItems(&vertices_);
+  cloneSharedItems(&edges_);
+  may_have_shared_items_ = false;
+}
+
+size_t PoseGraph::numSharedVertices() const {
+  return countSharedItems(vertices_);
+}
+
+size_t PoseGraph::numSharedEdges() const {
+  return countSharedItems(edges_);
+}
+
 const Vertex& PoseGraph::getVertex(const VertexId& id) const {
   const VertexMap::const_iterator it = vertices_.find(id);
   CHECK(it != vertices_.end()) << "Vertex with ID " << id
                                << " not in posegraph.";
-  return *CHECK_NOTNULL(it->second.get());
+  return *loadItem(it->second);
 }
 
 const Edge& PoseGraph::getEdge(const EdgeId& id) const {
   const EdgeMap::const_iterator it = edges_.find(id);
   CHECK(it != edges_.end()) << "Edge with ID " << id << " not in posegraph.";
-  return *CHECK_NOTNULL(it->second.get());
+  return *loadItem(it->second);
 }
 
 Vertex& PoseGraph::getVertexMutable(const VertexId& id) {
@@ -59,19 +204,19 @@ Edge& PoseGraph::getEdgeMutable(const EdgeId& id) {
 }
 
 Vertex* PoseGraph::getVertexPtrMutable(const VertexId& id) {
-  return common::getChecked(vertices_, id).get();
+  return detachIfShared(&common::getChecked(vertices_, id));
 }
 
 Edge* PoseGraph::getEdgePtrMutable(const EdgeId& id) {
-  return common::getChecked(edges_, id).get();
+  return detachIfShared(&common::getChecked(edges_, id));
 }
 
 const Vertex* PoseGraph::getVertexPtr(const VertexId& id) const {
-  return common::getChecked(vertices_, id).get();
+  return loadItem(common::getChecked(vertices_, id));
 }
 
 const Edge* PoseGraph::getEdgePtr(const EdgeId& id) const {
-  return common::getChecked(edges_, id).get();
+  return loadItem(common::getChecked(edges_, id));
 }
 
 bool PoseGraph::vertexExists(const VertexId& id) const {
@@ -188,6 +188,60 @@ TEST(AslamPosegraph, ElementPointers) {
   EXPECT_EQ(edge1_ptr, &pose_graph.getEdge(edge1));
 }
 
+TEST(AslamPosegraph, SharedElementsAreClonedOnWrite) {
+  PoseGraph pose_graph;
+
+  pose_graph::VertexId vertex1;
+  pose_graph::VertexId vertex2;
+  CHECK(vertex1.fromHexString("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa1"));
+  CHECK(vertex2.fromHexString("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa2"));
+  pose_graph.addVertex(vertex1);
+  pose_graph.addVertex(vertex2);
+
+  pose_graph::EdgeId edge1;
+  CHECK(edge1.fromHexString("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa3"));
+  pose_graph.addEdge(vertex1, vertex2, edge1);
+
+  PoseGraph snapshot;
+  snapshot.shareVerticesAndEdgesFrom(pose_graph);
+  EXPECT_EQ(2u, snapshot.numVertices());
+  EXPECT_EQ(1u, snapshot.numEdges());
+  EXPECT_EQ(2u, pose_graph.numSharedVertices());
+  EXPECT_EQ(1u, pose_graph.numSharedEdges());
+  EXPECT_EQ(&pose_graph.getVertex(vertex1), &snapshot.getVertex(vertex1));
+  EXPECT_EQ(&pose_graph.getEdge(edge1), &snapshot.getEdge(edge1));
+
+  // Modifying the snapshot clones only the accessed vertex.
+  const pose_graph::Vertex* original_vertex1 = pose_graph.getVertexPtr(vertex1);
+  pose_graph::EdgeId edge2;
+  CHECK(edge2.fromHexString("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa4"));
+  snapshot.addEdge(vertex1, vertex1, edge2);
+  EXPECT_NE(original_vertex1, snapshot.getVertexPtr(vertex1));
+  EXPECT_EQ(original_vertex1, pose_graph.getVertexPtr(vertex1));
+  EXPECT_EQ(&pose_graph.getVertex(vertex2), &snapshot.getVertex(vertex2));
+  EXPECT_EQ(1u, snapshot.numSharedVertices());
+  EXPECT_EQ(1u, snapshot.numSharedEdges());
+
+  pose_graph::EdgeIdSet original_edges;
+  pose_graph.getVertex(vertex1).incidentEdges(&original_edges);
+  EXPECT_EQ(1u, original_edges.size());
+  pose_graph::EdgeIdSet snapshot_edges;
+  snapshot.getVertex(vertex1).incidentEdges(&snapshot_edges);
+  EXPECT_EQ(2u, snapshot_edges.size());
+  EXPECT_FALSE(pose_graph.edgeExists(edge2));
+
+  // The original is the only owner of its vertex now and modifies it in place.
+  EXPECT_EQ(original_vertex1, pose_graph.getVertexPtrMutable(vertex1));
+
+  // Removing an edge from the snapshot leaves the original untouched.
+  snapshot.removeEdge(edge1);
+  EXPECT_TRUE(pose_graph.edgeExists(edge1));
+  EXPECT_TRUE(pose_graph.getVertex(vertex2).hasIncomingEdges());
+  EXPECT_FALSE(snapshot.getVertex(vertex2).hasIncomingEdges());
+  EXPECT_EQ(0u, pose_graph.numSharedVertices());
+  EXPECT_EQ(0u, pose_graph.numSharedEdges());
+}
+
 }  // namespace example
 }  // namespace pose_graph
 
@@ -1,14 +1,49 @@
 #ifndef VI_MAP_CHECK_MAP_CONSISTENCY_H_
 #define VI_MAP_CHECK_MAP_CONSISTENCY_H_
 
+#include <string>
+#include <vector>
+
 #include <posegraph/vertex.h>
 #include <vi-map/mission.h>
 
 namespace vi_map {
 class VIMap;
+
+// Number of checked items and duration of the individual checks of a map
+// consistency check.
+struct MapConsistencyCheckStatistics {
+  struct Check {
+    double getItemsPerSecond() const;
+
+    std::string name;
+    size_t num_items = 0u;
+    double duration_seconds = 0.0;
+  };
+
+  bool is_incremental = false;
+  std::vector<Check> checks;
+};
+
 bool isGpsReferenceVertex(
     const vi_map::VIMap& vi_map, const pose_graph::VertexId& vertex_id);
+
+// Checks the whole map. The independent checks run concurrently and the
+// vertex and landmark checks are parallelized over the vertices and landmarks.
+// Resets the recorded modifications if the map is consistent.
 bool checkMapConsistency(const vi_map::VIMap& vi_map);
+bool checkMapConsistency(
+    const vi_map::VIMap& vi_map, MapConsistencyCheckStatistics* statistics);
+
+// Only re-validates the vertices and missions that were modified since the
+// last check, which requires the modification tracking to be enabled, see
+// VIMap::enableModificationTracking(). Falls back to a full check if
+// modifications were not tracked or if operations touching the whole map were
+// performed. The resource consistency is only checked by full checks.
+bool checkMapConsistencyIncremental(const vi_map::VIMap& vi_map);
+bool checkMapConsistencyIncremental(
+    const vi_map::VIMap& vi_map, MapConsistencyCheckStatistics* statistics);
+
 bool checkPosegraphConsistency(
     const vi_map::VIMap& vi_map, const vi_map::MissionId& mission_id);
 bool checkForOrphanedPosegraphItems(const vi_map::VIMap& vi_map);
@@ -50,6 +50,8 @@ class Edge : public pose_graph::Edge {
   // Input: pointer to a shared pointer which should store the copied edge.
   void copyEdgeInto(Edge** new_edge) const;
 
+  virtual pose_graph::Edge::UniquePtr clone() const;
+
  protected:
   // Helper function to copy edge.
   template <typename EdgeType>
@@ -64,6 +64,22 @@ class LandmarkIndex {
     index_.emplace(landmark_id, vertex_id);
   }
 
+  // Adds all landmark references of the other index at once, reserving the
+  // space for them upfront.
+  inline void addLandmarkAndVertexReferences(const LandmarkIndex& other) {
+    CHECK_NE(this, &other);
+    std::lock(access_mutex_, other.access_mutex_);
+    std::lock_guard<std::mutex> lock(access_mutex_, std::adopt_lock);
+    std::lock_guard<std::mutex> other_lock(
+        other.access_mutex_, std::adopt_lock);
+    index_.reserve(index_.size() + other.index_.size());
+    for (const LandmarkToVertexMap::value_type& item : other.index_) {
+      CHECK(item.first.isValid());
+      CHECK(index_.emplace(item.first, item.second).second)
+          << "Landmark " << item.first << " is already in the index!";
+    }
+  }
+
   inline void getAllLandmarkIds(
       std::unordered_set<LandmarkId>* landmark_ids) const {
     CHECK_NOTNULL(landmark_ids)->clear();
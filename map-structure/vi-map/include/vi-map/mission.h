@@ -55,6 +55,9 @@ class Mission {
   void setBaseFrameId(const MissionBaseFrameId& base_frame_id);
   const MissionBaseFrameId& getBaseFrameId() const;
 
+  // Changing the root vertex or the backbone type changes the vertices that
+  // are traversed by VIMap. Its cached traversals are rebuilt on the next
+  // query.
   void setRootVertexId(const pose_graph::VertexId& vertex_id);
   const pose_graph::VertexId& getRootVertexId() const;
 
@@ -1,6 +1,7 @@
 #ifndef VI_MAP_VERTEX_INL_H_
 #define VI_MAP_VERTEX_INL_H_
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -15,21 +16,26 @@ inline void Vertex::setMissionId(const vi_map::MissionId& mission_id) {
 }
 
 inline aslam::VisualNFrame& Vertex::getVisualNFrame() {
+  detachSharedNFrame();
   CHECK(n_frame_ != nullptr);
   return *n_frame_;
 }
 inline const aslam::VisualNFrame& Vertex::getVisualNFrame() const {
+  const std::unique_lock<std::mutex> lock = lockSharedBlocks();
   CHECK(n_frame_ != nullptr);
   return *n_frame_;
 }
 inline aslam::VisualNFrame::Ptr& Vertex::getVisualNFrameShared() {
+  detachSharedNFrame();
   return n_frame_;
 }
 inline aslam::VisualNFrame::ConstPtr Vertex::getVisualNFrameShared() const {
+  const std::unique_lock<std::mutex> lock = lockSharedBlocks();
   return n_frame_;
 }
 
 inline aslam::VisualFrame& Vertex::getVisualFrame(unsigned int frame_idx) {
+  detachSharedNFrame();
   CHECK(n_frame_ != nullptr);
   CHECK(n_frame_->getFrameShared(frame_idx) != nullptr);
   return *(n_frame_->getFrameShared(frame_idx));
@@ -47,11 +53,13 @@ inline bool Vertex::isVisualFrameValid(unsigned int frame_idx) const {
 
 inline aslam::VisualFrame::Ptr Vertex::getVisualFrameShared(
     unsigned int frame_idx) {
+  detachSharedNFrame();
   return n_frame_->getFrameShared(frame_idx);
 }
 
 inline aslam::VisualFrame::Ptr Vertex::getVisualFrameShared(
     aslam::FrameId frame_id) {
+  detachSharedNFrame();
   for (unsigned int i = 0; i < n_frame_->getNumCameras(); ++i) {
     aslam::VisualFrame::Ptr frame = n_frame_->getFrameShared(i);
     if (frame != nullptr && frame->getId() == frame_id) {
@@ -75,6 +83,7 @@ inline unsigned int Vertex::getVisualFrameIndex(aslam::FrameId frame_id) const {
 
 inline const aslam::VisualFrame& Vertex::getVisualFrame(
     unsigned int frame_idx) const {
+  const std::unique_lock<std::mutex> lock = lockSharedBlocks();
   CHECK(n_frame_ != nullptr);
   CHECK(n_frame_->isFrameSet(frame_idx));
   return n_frame_->getFrame(frame_idx);
@@ -82,6 +91,7 @@ inline const aslam::VisualFrame& Vertex::getVisualFrame(
 
 inline const aslam::VisualFrame::ConstPtr Vertex::getVisualFrameShared(
     unsigned int frame_idx) const {
+  const std::unique_lock<std::mutex> lock = lockSharedBlocks();
   return n_frame_->getFrameShared(frame_idx);
 }
 
@@ -110,6 +120,7 @@ inline void Vertex::setCamera(
 }
 
 inline void Vertex::setNCameras(const aslam::NCamera::Ptr& n_cameras) {
+  detachSharedNFrame();
   CHECK(n_frame_ != nullptr);
   n_frame_->setNCameras(n_cameras);
 }
@@ -120,15 +131,17 @@ inline size_t Vertex::numFrames() const {
 }
 
 inline LandmarkStore& Vertex::getLandmarks() {
-  return landmarks_;
+  detachSharedLandmarks();
+  return *landmarks_;
 }
 
 inline const LandmarkStore& Vertex::getLandmarks() const {
-  return landmarks_;
+  const std::unique_lock<std::mutex> lock = lockSharedBlocks();
+  return *landmarks_;
 }
 
 inline void Vertex::setLandmarks(const LandmarkStore& landmark_store) {
-  landmarks_ = landmark_store;
+  getLandmarks() = landmark_store;
 }
 
 inline void Vertex::forEachUnassociatedKeypoint(
@@ -187,7 +200,7 @@ inline bool Vertex::isSameApartFromOutgoingEdges(const Vertex& lhs) const {
     // test.
     is_same &= n_frame_->compareWithoutCameraSystem(*lhs.n_frame_);
   }
-  is_same &= landmarks_ == lhs.landmarks_;
+  is_same &= getLandmarks() == lhs.getLandmarks();
   return is_same;
 }
 
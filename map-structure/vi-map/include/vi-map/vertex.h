@@ -3,6 +3,9 @@
 
 #include <posegraph/vertex.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -83,9 +86,18 @@ class Vertex : public pose_graph::Vertex {
   // populate it.
   Vertex();
   virtual ~Vertex() {}
-  Vertex(const Vertex&) = default;
+  // Shares the VisualNFrame with the other vertex. The landmarks are copied
+  // on write.
+  Vertex(const Vertex& other);
   Vertex& operator=(const Vertex&) = delete;
 
+  // Contrary to the copy constructor, the clone also copies the VisualNFrame
+  // on write. The first mutable access of the frames or landmarks of either
+  // vertex copies them, writing e.g. the pose doesn't copy the descriptors.
+  // Such an access replaces the shared block and invalidates references to
+  // it obtained before from this vertex once the other vertex is gone.
+  virtual pose_graph::Vertex::UniquePtr clone() const;
+
   virtual const pose_graph::VertexId& id() const;
   void setId(const pose_graph::VertexId& id);
 
@@ -277,6 +289,14 @@ class Vertex : public pose_graph::Vertex {
   int determineNewObservedLandmarkIdVectorSize(
       int previous_new_size, int current_new_size, int old_size) const;
 
+  // Give the frames or landmarks a copy of their own if they are shared with
+  // another vertex, see clone(). Safe to call concurrently.
+  void detachSharedNFrame();
+  void detachSharedLandmarks();
+  // Locks the reads of the block pointers in the const getters against
+  // concurrent detaches, returns an unlocked lock if nothing is shared.
+  std::unique_lock<std::mutex> lockSharedBlocks() const;
+
   pose_graph::VertexId id_;
   vi_map::MissionId mission_id_;
 
@@ -293,8 +313,15 @@ class Vertex : public pose_graph::Vertex {
   aslam::VisualNFrame::Ptr n_frame_;
   std::vector<LandmarkIdList> observed_landmark_ids_;
 
-  // Landmark storage.
-  LandmarkStore landmarks_;
+  // Landmark storage, shared with the copies of this vertex until either
+  // writes to it.
+  std::shared_ptr<LandmarkStore> landmarks_ = aligned_shared<LandmarkStore>();
+
+  // Set while the frames or landmarks may be shared with a clone. The
+  // VisualNFrame is also handed out as shared pointer, so its reference count
+  // doesn't tell whether it is shared with a clone.
+  mutable std::atomic<bool> is_n_frame_shared_{false};
+  mutable std::atomic<bool> may_share_landmarks_{false};
 
   // VisualFrame resources;
   FrameResourceMap resource_map_;
@@ -51,17 +51,21 @@ bool VIMap::hasVertex(const pose_graph::VertexId& id) const {
 }
 vi_map::Vertex& VIMap::getVertex(const pose_graph::VertexId& id) {
   CHECK(id.isValid());
+  markVertexModified(id);
   vi_map::Vertex& vertex =
       posegraph.getVertexPtrMutable(id)->getAs<vi_map::Vertex>();
   CHECK(vertex.getNCameras() != nullptr);
+  markFramesModified(vertex.getMissionId());
   return vertex;
 }
 vi_map::Vertex* VIMap::getVertexPtr(const pose_graph::VertexId& id) {
   CHECK(id.isValid());
+  markVertexModified(id);
   vi_map::Vertex* vertex_ptr = dynamic_cast<vi_map::Vertex*>(  // NOLINT
       posegraph.getVertexPtrMutable(id));
   CHECK(vertex_ptr != nullptr);
   CHECK(vertex_ptr->getNCameras() != nullptr);
+  markFramesModified(vertex_ptr->getMissionId());
   return vertex_ptr;
 }
 const vi_map::Vertex& VIMap::getVertex(const pose_graph::VertexId& id) const {
@@ -110,6 +114,7 @@ bool VIMap::hasEdge(const pose_graph::EdgeId& id) const {
 }
 template <typename EdgeType>
 EdgeType& VIMap::getEdgeAs(const pose_graph::EdgeId& id) {
+  markEdgeModified(id);
   return posegraph.getEdgePtrMutable(id)->getAs<EdgeType>();
 }
 template <typename EdgeType>
@@ -118,6 +123,7 @@ const EdgeType& VIMap::getEdgeAs(const pose_graph::EdgeId& id) const {
 }
 template <typename EdgeType>
 EdgeType* VIMap::getEdgePtrAs(const pose_graph::EdgeId& id) {
+  markEdgeModified(id);
   EdgeType* edge_ptr =
       dynamic_cast<EdgeType*>(posegraph.getEdgePtrMutable(id));  // NOLINT
   CHECK(edge_ptr != nullptr);
@@ -150,6 +156,7 @@ bool VIMap::hasMission(const vi_map::MissionId& id) const {
 
 vi_map::VIMission& VIMap::getMission(const vi_map::MissionId& id) {
   CHECK(id.isValid());
+  markMissionModified(id);
   vi_map::VIMission& mission =
       common::getChecked(missions, id)->getAs<vi_map::VIMission>();
   return mission;
@@ -798,6 +805,8 @@ void VIMap::addVertex(vi_map::Vertex::UniquePtr vertex_ptr) {
   CHECK(!hasVertex(vertex_ptr->id())) << "A vertex with id " << vertex_ptr->id()
                                       << " already exists.";
 
+  markVertexModified(vertex_ptr->id());
+  markMissionModified(vertex_ptr->getMissionId());
   posegraph.addVertex(std::move(vertex_ptr));
 }
 
@@ -807,7 +816,15 @@ void VIMap::addEdge(vi_map::Edge::UniquePtr edge_ptr) {
   CHECK(hasMission(getMissionIdForVertex(edge_ptr->from())));
   CHECK(!hasEdge(edge_ptr->id()));
 
+  markVertexModified(edge_ptr->from());
+  markVertexModified(edge_ptr->to());
+  markEdgeModified(edge_ptr->id());
+  markMissionModified(getMissionIdForVertex(edge_ptr->from()));
+  markMissionModified(getMissionIdForVertex(edge_ptr->to()));
+
+  const pose_graph::Edge& edge = *edge_ptr;
   posegraph.addEdge(std::move(edge_ptr));
+  updateMissionVertexCacheForNewEdge(edge);
 }
 
 pose_graph::Edge::EdgeType VIMap::getEdgeType(
@@ -892,15 +909,28 @@ void VIMap::removeVertex(pose_graph::VertexId vertex_id) {
     }
   }
 
+  invalidateMissionVertexCache(vertex.getMissionId());
+  markVertexModified(vertex_id);
+  markMissionModified(vertex.getMissionId());
   posegraph.removeVertex(vertex_id);
 }
 
 void VIMap::removeEdge(pose_graph::EdgeId edge_id) {
   CHECK(hasEdge(edge_id));
+  const pose_graph::Edge& edge = *posegraph.getEdgePtr(edge_id);
+  for (const pose_graph::VertexId& vertex_id : {edge.from(), edge.to()}) {
+    if (posegraph.vertexExists(vertex_id)) {
+      const vi_map::MissionId& mission_id = getVertex(vertex_id).getMissionId();
+      invalidateMissionVertexCache(mission_id);
+      markMissionModified(mission_id);
+    }
+  }
+  markEdgeModified(edge_id);
   posegraph.removeEdge(edge_id);
 }
 
 size_t VIMap::removeLoopClosureEdges() {
+  markAllModified();
   return posegraph
       .removeEdgesOfType<pose_graph::Edge::EdgeType::kLoopClosure>();
 }
@@ -1068,6 +1098,8 @@ void VIMap::deleteFrameResourcesOfType(
 }
 
 void VIMap::clear() {
+  invalidateAllMissionVertexCaches();
+  markAllModified();
   posegraph.clear();
   missions.clear();
   mission_base_frames.clear();
@@ -1125,6 +1157,46 @@ void VIMap::addOptionalSensorResource(
       type, sensor_id, resource_id, timestamp_ns);
 }
 
+template <typename DataType>
+void VIMap::writeOptionalSensorResourceFile(
+    const backend::ResourceType& type, const DataType& resource,
+    backend::ResourceMap::PendingResource* pending_resource) const {
+  CHECK_NOTNULL(pending_resource);
+  writeResourceFile(type, resource, pending_resource);
+}
+
+template <typename SensorId>
+void VIMap::addOptionalSensorResources(
+    const SensorId& sensor_id,
+    const StampedPendingResourceList& stamped_resources, VIMission* mission) {
+  CHECK_NOTNULL(mission);
+  backend::ResourceMap::PendingResourceList pending_resources;
+  pending_resources.reserve(stamped_resources.size());
+  // Timestamps of the batch per resource type, as they have to be unique
+  // within the batch as well.
+  std::map<backend::ResourceType, std::unordered_set<int64_t>>
+      batch_timestamps_ns;
+  for (const std::pair<int64_t, backend::ResourceMap::PendingResource>&
+           stamped_resource : stamped_resources) {
+    CHECK(!mission->hasOptionalSensorResourceId(
+        stamped_resource.second.type, sensor_id, stamped_resource.first));
+    CHECK(batch_timestamps_ns[stamped_resource.second.type]
+              .insert(stamped_resource.first)
+              .second)
+        << "The batch contains several resources of the same type with "
+        << "timestamp " << stamped_resource.first << "ns.";
+    pending_resources.emplace_back(stamped_resource.second);
+  }
+  registerResources(pending_resources);
+
+  for (const std::pair<int64_t, backend::ResourceMap::PendingResource>&
+           stamped_resource : stamped_resources) {
+    mission->addOptionalSensorResourceId(
+        stamped_resource.second.type, sensor_id, stamped_resource.second.id,
+        stamped_resource.first);
+  }
+}
+
 template <typename SensorId, typename DataType>
 bool VIMap::deleteOptionalSensorResource(
     const backend::ResourceType& type, const SensorId& sensor_id,
@@ -1276,6 +1348,82 @@ bool VIMap::findAllCloseOptionalSensorResources(
       type, timestamp_ns, tolerance_ns, sensor_ids, closest_timestamps_ns);
 }
 
+void VIMap::ModifiedEntities::clear() {
+  all = false;
+  vertex_ids.clear();
+  edge_ids.clear();
+  mission_ids.clear();
+  landmark_ids.clear();
+}
+
+bool VIMap::ModifiedEntities::empty() const {
+  return !all && vertex_ids.empty() && edge_ids.empty() &&
+         mission_ids.empty() && landmark_ids.empty();
+}
+
+void VIMap::ModifiedEntities::merge(const ModifiedEntities& other) {
+  all = all || other.all;
+  vertex_ids.insert(other.vertex_ids.begin(), other.vertex_ids.end());
+  edge_ids.insert(other.edge_ids.begin(), other.edge_ids.end());
+  mission_ids.insert(other.mission_ids.begin(), other.mission_ids.end());
+  landmark_ids.insert(other.landmark_ids.begin(), other.landmark_ids.end());
+}
+
+template <typename IdType>
+VIMap::ModifiedEntitiesShard& VIMap::getModifiedEntitiesShard(
+    const IdType& id) const {
+  return modified_entities_shards_[std::hash<IdType>()(id) %
+                                   kNumModifiedEntitiesShards];
+}
+
+VIMap::FrameModificationShard& VIMap::getFrameModificationShard(
+    const vi_map::MissionId& mission_id) const {
+  return frame_modification_shards_[std::hash<vi_map::MissionId>()(
+                                        mission_id) %
+                                    kNumFrameModificationShards];
+}
+
+void VIMap::markFramesModified(const vi_map::MissionId& mission_id) const {
+  std::atomic<bool>& are_frames_modified =
+      getFrameModificationShard(mission_id).are_frames_modified;
+  // Only write the flag if it isn't set yet, such that concurrent accesses
+  // don't contend on it.
+  if (!are_frames_modified.load(std::memory_order_relaxed)) {
+    are_frames_modified.store(true);
+  }
+}
+
+void VIMap::markVertexModified(const pose_graph::VertexId& vertex_id) const {
+  if (is_modification_tracking_enabled_.load(std::memory_order_relaxed) &&
+      !are_all_entities_modified_.load(std::memory_order_relaxed)) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(vertex_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.entities.vertex_ids.insert(vertex_id).second) {
+      // The vertex is not modified yet, so this records the landmarks it
+      // observed before.
+      recordObservedLandmarks(vertex_id, &shard.entities.landmark_ids);
+    }
+  }
+}
+
+void VIMap::markEdgeModified(const pose_graph::EdgeId& edge_id) const {
+  if (is_modification_tracking_enabled_.load(std::memory_order_relaxed) &&
+      !are_all_entities_modified_.load(std::memory_order_relaxed)) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(edge_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entities.edge_ids.insert(edge_id);
+  }
+}
+
+void VIMap::markMissionModified(const vi_map::MissionId& mission_id) const {
+  if (is_modification_tracking_enabled_.load(std::memory_order_relaxed) &&
+      !are_all_entities_modified_.load(std::memory_order_relaxed)) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(mission_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entities.mission_ids.insert(mission_id);
+  }
+}
+
 }  // namespace vi_map
 
 #endif  // VI_MAP_VI_MAP_INL_H_
@@ -6,6 +6,7 @@
 
 #include <maplab-common/map-manager-config.h>
 #include <maplab-common/network-common.h>
+#include <posegraph/unique-id.h>
 
 #include "vi-map/vi-map-metadata.h"
 #include "vi-map/vi_map.pb.h"
@@ -57,10 +58,18 @@ void serializeVertices(const vi_map::VIMap& map, vi_map::proto::VIMap* proto);
 size_t serializeVertices(
     const vi_map::VIMap& map, const size_t start_index,
     const size_t vertices_per_proto, vi_map::proto::VIMap* proto);
+// Only serializes the given vertices, e.g. to write a map incrementally.
+void serializeVertices(
+    const vi_map::VIMap& map, const pose_graph::VertexIdList& vertex_ids,
+    vi_map::proto::VIMap* proto);
 void serializeEdges(const vi_map::VIMap& map, vi_map::proto::VIMap* proto);
 size_t serializeEdges(
     const vi_map::VIMap& map, const size_t start_index,
     const size_t edges_per_proto, vi_map::proto::VIMap* proto);
+// Only serializes the given edges, e.g. to write a map incrementally.
+void serializeEdges(
+    const vi_map::VIMap& map, const pose_graph::EdgeIdList& edge_ids,
+    vi_map::proto::VIMap* proto);
 void serializeMissionsAndBaseframes(
     const vi_map::VIMap& map, vi_map::proto::VIMap* proto);
 void serializeLandmarkIndex(
@@ -1,6 +1,8 @@
 #ifndef VI_MAP_VI_MAP_H_
 #define VI_MAP_VI_MAP_H_
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -15,6 +17,7 @@
 #include <Eigen/SparseCore>
 #include <aslam/common/memory.h>
 #include <aslam/common/pose-types.h>
+#include <aslam/common/reader-writer-lock.h>
 #include <map-resources/resource-common.h>
 #include <map-resources/resource-map.h>
 #include <maplab-common/file-serializable.h>
@@ -78,6 +81,17 @@ typedef std::unordered_map<MissionId, pose_graph::VertexIdList>
 
 typedef std::pair<MissionId, pose_graph::VertexIdList> MissionVertexIdPair;
 
+// Number of merged items and duration of a map merge.
+struct MapMergeStatistics {
+  double getVerticesPerSecond() const;
+
+  size_t num_missions = 0u;
+  size_t num_vertices = 0u;
+  size_t num_edges = 0u;
+  size_t num_landmarks = 0u;
+  double duration_seconds = 0.0;
+};
+
 class VIMap : public backend::ResourceMap,
               public backend::MapInterface<vi_map::VIMap> {
   friend ::LoopClosureHandlerTest;                   // Test.
@@ -103,6 +117,12 @@ class VIMap : public backend::ResourceMap,
   virtual ~VIMap();
 
   // Discards any data that is not stored in MappedContainerBase-s.
+  // The copy is a copy-on-write snapshot: the vertices and edges are shared
+  // with the other map and only cloned once they are accessed through a
+  // mutable accessor of either map, which is safe from concurrent threads.
+  // The frames and landmarks of a cloned vertex stay shared until they are
+  // written to. Const references obtained from a map before such an access
+  // stay valid only as long as the other map keeps the shared item.
   void deepCopy(const VIMap& other) override;
   void swap(VIMap* other);  // NOLINT
 
@@ -378,6 +398,30 @@ class VIMap : public backend::ResourceMap,
   unsigned int getVertexCountInMission(
       const vi_map::MissionId& mission_id) const;
 
+  /// Get the visual frame of the mission that is closest in time to the given
+  /// timestamp. The lookup uses a sorted index of all frame timestamps of the
+  /// mission, which is built on first use and kept along with the ordered
+  /// vertex list of the mission. Returns false if the mission has no frames.
+  /// timestamp_difference_ns may be a nullptr.
+  bool getClosestVisualFrameByTimestamp(
+      const vi_map::MissionId& mission_id, const int64_t timestamp_ns,
+      VisualFrameIdentifier* frame_id, int64_t* timestamp_difference_ns) const;
+  /// Batch version of getClosestVisualFrameByTimestamp. Frames that can't be
+  /// found are returned as invalid identifiers with a timestamp difference of
+  /// std::numeric_limits<int64_t>::max(). timestamp_differences_ns may be a
+  /// nullptr.
+  void getClosestVisualFramesByTimestamps(
+      const vi_map::MissionId& mission_id,
+      const std::vector<int64_t>& timestamps_ns,
+      VisualFrameIdentifierList* frame_ids,
+      std::vector<int64_t>* timestamp_differences_ns) const;
+  /// Get all visual frames of the mission with a timestamp in the range
+  /// [min_timestamp_ns, max_timestamp_ns], sorted by timestamp.
+  void getVisualFramesInTimeRange(
+      const vi_map::MissionId& mission_id, const int64_t min_timestamp_ns,
+      const int64_t max_timestamp_ns,
+      VisualFrameIdentifierList* frame_ids) const;
+
   /// Get all the vertex ids in the order that they appear when traversing the
   /// pose-graph of the provided mission.
   void getAllVertexIdsInMissionAlongGraph(
@@ -542,6 +586,49 @@ class VIMap : public backend::ResourceMap,
   /// Set the seed for random selection methods in this class.
   void setRandIntGeneratorSeed(int seed);
 
+  // =====================
+  // MODIFICATION TRACKING
+  // =====================
+
+  /// Vertices, edges and missions that were possibly modified, e.g. to only
+  /// re-validate those in the incremental map consistency check.
+  struct ModifiedEntities {
+    ModifiedEntities() : all(false) {}
+    inline void clear();
+    inline bool empty() const;
+    inline void merge(const ModifiedEntities& other);
+
+    // Set if the whole map has to be considered modified, e.g. after
+    // operations touching large parts of the map or if modifications were
+    // not tracked.
+    bool all;
+    pose_graph::VertexIdSet vertex_ids;
+    // Added, removed or mutably accessed edges.
+    pose_graph::EdgeIdSet edge_ids;
+    vi_map::MissionIdSet mission_ids;
+    // Landmarks the modified vertices observed before their first
+    // modification, whose back-references to them may have become stale.
+    vi_map::LandmarkIdSet landmark_ids;
+  };
+
+  /// Once enabled, every vertex, edge and mission that is accessed through a
+  /// non-const accessor or changed by a mutating method of the map is
+  /// recorded as modified. Since everything before enabling is unknown, the
+  /// whole map is initially marked as modified. Modifications through
+  /// references that were obtained before the last call to
+  /// takeModifiedEntities() are not tracked. Tracking is disabled by default
+  /// since it adds a lock to every non-const accessor, at least until the
+  /// whole map is marked as modified. The record is split into shards by id,
+  /// so accessors of different entities rarely contend for the same lock.
+  void enableModificationTracking() const;
+  /// Stops tracking and drops the record.
+  void disableModificationTracking() const;
+  bool isModificationTrackingEnabled() const;
+  /// Moves the recorded entities to the output and resets the record.
+  void takeModifiedEntities(ModifiedEntities* modified_entities) const;
+  /// Adds entities to the record, e.g. to re-validate them later again.
+  void addModifiedEntities(const ModifiedEntities& modified_entities) const;
+
   // =========
   // RESOURCES
   // =========
@@ -725,6 +812,23 @@ class VIMap : public backend::ResourceMap,
       const backend::ResourceType& type, const SensorId& camera_id,
       const int64_t timestamp_ns, const DataType& resource, VIMission* mission);
 
+  // Bulk import of optional sensor resources, see
+  // ResourceMap::writeResourceFile. The resource files can be written
+  // concurrently from several threads, followed by a single call to
+  // addOptionalSensorResources that attaches them to the mission. The
+  // timestamps of resources of the same type have to be unique, both within
+  // the batch and with respect to the resources already in the mission.
+  typedef std::vector<std::pair<int64_t, backend::ResourceMap::PendingResource>>
+      StampedPendingResourceList;
+  template <typename DataType>
+  void writeOptionalSensorResourceFile(
+      const backend::ResourceType& type, const DataType& resource,
+      backend::ResourceMap::PendingResource* pending_resource) const;
+  template <typename SensorId>
+  void addOptionalSensorResources(
+      const SensorId& sensor_id,
+      const StampedPendingResourceList& stamped_resources, VIMission* mission);
+
   // NOTE: When deleting optional camera resources will not clean up the list of
   // optional cameras.
   template <typename SensorId, typename DataType>
@@ -802,6 +906,19 @@ class VIMap : public backend::ResourceMap,
   // MAP INTERFACE (for map manager)
   // ===============================
   void mergeAllMissionsFromMap(const vi_map::VIMap& other) override;
+
+  // Merges all missions of all given maps into this map. The vertices and
+  // edges are deep-copied in parallel into pose graph shards, which are then
+  // moved into this map in bulk after reserving the space for all of them.
+  void mergeAllMissionsFromMaps(
+      const std::vector<const vi_map::VIMap*>& other_maps,
+      MapMergeStatistics* statistics = nullptr);
+
+  // Moves all missions of the other map into this map without copying any
+  // vertices, edges or landmarks. The resource infos are merged like in
+  // mergeAllMissionsFromMap(..). The other map is left without missions.
+  void moveAllMissionsFromMap(
+      vi_map::VIMap* other, MapMergeStatistics* statistics = nullptr);
   static std::string getSubFolderName();
 
   static bool hasMapOnFileSystem(const std::string& map_folder);
@@ -815,6 +932,118 @@ class VIMap : public backend::ResourceMap,
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
  private:
+  // Vertices of a mission in the order of the graph traversal. The cache is
+  // patched when the traversal of a mission is extended at its end and
+  // invalidated by all other changes of the posegraph. It is also rebuilt if
+  // the root vertex of the mission changed in the meantime.
+  struct TimestampedVisualFrame {
+    TimestampedVisualFrame(
+        const int64_t _timestamp_ns, const VisualFrameIdentifier& _frame_id)
+        : timestamp_ns(_timestamp_ns), frame_id(_frame_id) {}
+    int64_t timestamp_ns;
+    VisualFrameIdentifier frame_id;
+  };
+  typedef std::vector<TimestampedVisualFrame> TimestampedVisualFrameList;
+
+  // The cache of every mission has its own mutex, such that queries for
+  // different missions don't block each other.
+  struct MissionVertexCache {
+    MissionVertexCache()
+        : is_valid(false),
+          traversal_edge_type(pose_graph::Edge::EdgeType::kUndefined),
+          is_time_index_valid(false),
+          time_index_generation(0u) {}
+    std::mutex mutex;
+
+    // The cache is rebuilt if the root vertex or the backbone type of the
+    // mission changes, as both are set directly on the mission.
+    bool is_valid;
+    pose_graph::VertexId root_vertex_id;
+    pose_graph::Edge::EdgeType traversal_edge_type;
+    pose_graph::VertexIdList vertex_ids;
+
+    // All visual frames of the vertices above, sorted by timestamp. The
+    // index is rebuilt if the frames of the mission were modified since, see
+    // getFramesGeneration().
+    bool is_time_index_valid;
+    uint64_t time_index_generation;
+    TimestampedVisualFrameList frames_by_timestamp;
+  };
+  typedef std::unordered_map<vi_map::MissionId, MissionVertexCache>
+      MissionVertexCacheMap;
+
+  // Calls the function with the cache of the mission, which is (re)built if
+  // necessary. The function is called with the mutex of the cache held and
+  // a read lock on mission_vertex_caches_mutex_, so it must not query the
+  // cache of any mission again.
+  template <typename Function>
+  void accessMissionVertexCache(
+      const vi_map::MissionId& mission_id, const Function& function) const;
+  // The functions below need the mutex of the cache to be held by the caller.
+  // Returns the cached vertices of the mission and (re)builds the cache if
+  // necessary.
+  const pose_graph::VertexIdList& getMissionVertexCacheLocked(
+      const vi_map::MissionId& mission_id, MissionVertexCache* cache) const;
+  // Continues the graph traversal from the last cached vertex.
+  void extendMissionVertexCacheLocked(MissionVertexCache* cache) const;
+  // Same as above for the time index of the mission.
+  const TimestampedVisualFrameList& getMissionTimeIndexLocked(
+      const vi_map::MissionId& mission_id, MissionVertexCache* cache) const;
+  // Adds the frames of the vertices starting at first_vertex_idx to the time
+  // index. The index is invalidated if the frames are not newer than the
+  // frames already in the index.
+  void appendToMissionTimeIndexLocked(
+      const size_t first_vertex_idx, MissionVertexCache* cache) const;
+  static bool findClosestFrameInTimeIndex(
+      const TimestampedVisualFrameList& frames_by_timestamp,
+      const int64_t timestamp_ns, VisualFrameIdentifier* frame_id,
+      int64_t* timestamp_difference_ns);
+  void updateMissionVertexCacheForNewEdge(const pose_graph::Edge& edge);
+  void invalidateMissionVertexCache(const vi_map::MissionId& mission_id);
+  void invalidateAllMissionVertexCaches();
+
+  // The timestamps of the frames of a vertex can change through the mutable
+  // vertex accessors, which only flag the shard of the mission of the vertex.
+  // The generation of a shard is increased when its flag is found to be set,
+  // so the time index of every mission in the shard is rebuilt. Missions are
+  // sharded to keep the accessors free of locks.
+  struct FrameModificationShard {
+    FrameModificationShard() : are_frames_modified(false), generation(0u) {}
+    std::atomic<bool> are_frames_modified;
+    std::mutex mutex;
+    uint64_t generation;
+  };
+  static constexpr size_t kNumFrameModificationShards = 32u;
+  inline FrameModificationShard& getFrameModificationShard(
+      const vi_map::MissionId& mission_id) const;
+  inline void markFramesModified(const vi_map::MissionId& mission_id) const;
+  uint64_t getFramesGeneration(const vi_map::MissionId& mission_id) const;
+
+  // A part of the record of the single modified entities. The all flag of
+  // the entities is not used.
+  struct ModifiedEntitiesShard {
+    std::mutex mutex;
+    ModifiedEntities entities;
+  };
+  static constexpr size_t kNumModifiedEntitiesShards = 32u;
+
+  // Record modifications if modification tracking is enabled.
+  inline void markVertexModified(const pose_graph::VertexId& vertex_id) const;
+  inline void markEdgeModified(const pose_graph::EdgeId& edge_id) const;
+  inline void markMissionModified(const vi_map::MissionId& mission_id) const;
+  // Returns the shard that records the entity with the given id.
+  template <typename IdType>
+  inline ModifiedEntitiesShard& getModifiedEntitiesShard(
+      const IdType& id) const;
+  // Records the landmarks observed by the vertex, if it exists. Requires the
+  // mutex of the shard of landmark_ids to be locked.
+  void recordObservedLandmarks(
+      const pose_graph::VertexId& vertex_id,
+      vi_map::LandmarkIdSet* landmark_ids) const;
+  void markAllModified() const;
+  // Requires modified_entities_mutex_ to be locked.
+  void markAllModifiedLocked() const;
+
   // Functions to retrieve and modify the resource ids associated with a set of
   // missions of this VIMap.These functinos are NOT threadsafe and should only
   // be used by the public mission resource functions defined above.
@@ -851,6 +1080,16 @@ class VIMap : public backend::ResourceMap,
   // Merges only the part inside the VIMap, not the objects related to the
   // ResourceMap.
   void mergeAllMissionsFromMapWithoutResources(const vi_map::VIMap& source_map);
+  void mergeAllMissionsFromMapsWithoutResources(
+      const std::vector<const vi_map::VIMap*>& source_maps,
+      MapMergeStatistics* statistics);
+  // Copies all missions of the source map together with their optional
+  // sensor data, returns the number of copied missions.
+  size_t copyMissionsFromMap(const vi_map::VIMap& source_map);
+  // Adds a mission of the source map together with its base frame and
+  // sensors.
+  void addMissionFromMap(
+      vi_map::VIMission::UniquePtr mission, const vi_map::VIMap& source_map);
 
   // To force const accessors in non-const methods.
   const VIMap* const const_this;
@@ -867,6 +1106,23 @@ class VIMap : public backend::ResourceMap,
   mutable std::default_random_engine generator_;
 
   mutable std::recursive_mutex resource_mutex_;
+
+  mutable MissionVertexCacheMap mission_vertex_caches_;
+  // Queries only take a read lock to look up the cache of their mission.
+  // Adding, removing and modifying caches takes the write lock.
+  mutable aslam::ReaderWriterMutex mission_vertex_caches_mutex_;
+  mutable std::array<FrameModificationShard, kNumFrameModificationShards>
+      frame_modification_shards_;
+
+  mutable std::atomic<bool> is_modification_tracking_enabled_;
+  // Set if the whole map is modified, recording single entities is skipped
+  // then.
+  mutable std::atomic<bool> are_all_entities_modified_;
+  mutable std::array<ModifiedEntitiesShard, kNumModifiedEntitiesShards>
+      modified_entities_shards_;
+  // Serializes enabling, disabling, taking and marking everything as
+  // modified. Locked before the mutexes of the shards.
+  mutable std::mutex modified_entities_mutex_;
 };
 }  // namespace vi_map
 
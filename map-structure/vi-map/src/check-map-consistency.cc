@@ -1,7 +1,16 @@
 #include <vi-map/check-map-consistency.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 #include <vi-map/vi-map.h>
 
 namespace vi_map {
@@ -28,465 +37,640 @@ bool isGpsReferenceVertex(
   return true;
 }
 
-bool checkMapConsistency(const vi_map::VIMap& vi_map) {
-  LOG(INFO) << "Checking VI-Map consistency.";
+namespace {
+
+// Runs the check for all items in [0, num_items) in parallel. Returns true if
+// the check passed for all items.
+bool checkAllInParallel(
+    const size_t num_items, const std::function<bool(size_t)>& check) {
+  std::atomic<bool> all_passed(true);
+  std::function<void(const std::vector<size_t>&)> check_batch =
+      [&](const std::vector<size_t>& batch) {
+        bool batch_passed = true;
+        for (const size_t item_idx : batch) {
+          if (!check(item_idx)) {
+            batch_passed = false;
+          }
+        }
+        if (!batch_passed) {
+          all_passed = false;
+        }
+      };
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      num_items, check_batch, kAlwaysParallelize,
+      common::getNumHardwareThreads());
+  return all_passed;
+}
 
-  bool is_consistent = true;
-  // Verify that every mission has a valid base-frame.
-  VLOG(2) << "Verifying mission base-frames...";
+// Measures the duration of a single check.
+class CheckTimer {
+ public:
+  explicit CheckTimer(const std::string& name)
+      : name_(name), start_(std::chrono::steady_clock::now()) {}
+
+  MapConsistencyCheckStatistics::Check stop(const size_t num_items) const {
+    MapConsistencyCheckStatistics::Check check;
+    check.name = name_;
+    check.num_items = num_items;
+    check.duration_seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start_)
+                                 .count();
+    return check;
+  }
 
-  const SensorManager& sensor_manager = vi_map.getSensorManager();
+ private:
+  const std::string name_;
+  const std::chrono::steady_clock::time_point start_;
+};
 
-  vi_map::MissionIdList mission_ids;
-  vi_map.getAllMissionIds(&mission_ids);
+bool checkMission(
+    const vi_map::VIMap& vi_map, const vi_map::MissionId& mission_id) {
+  if (!vi_map.hasMission(mission_id)) {
+    LOG(ERROR) << "Vi map claims to have mission " << mission_id
+               << " but then returns false when retrieving it.";
+    return false;
+  }
 
-  for (const vi_map::MissionId& mission_id : mission_ids) {
-    if (!vi_map.hasMission(mission_id)) {
-      LOG(ERROR) << "Vi map claims to have mission " << mission_id
-                 << " but then returns false when retrieving it.";
-      is_consistent = false;
-      continue;
-    }
+  const vi_map::VIMission& mission = vi_map.getMission(mission_id);
+  if (mission.id() != mission_id) {
+    LOG(ERROR) << "Mission provided by map for mission-id " << mission_id
+               << " has a different id internally " << mission.id();
+    return false;
+  }
 
-    const vi_map::VIMission& mission = vi_map.getMission(mission_id);
-    if (mission.id() != mission_id) {
-      LOG(ERROR) << "Mission provided by map for mission-id " << mission_id
-                 << " has a different id internally " << mission.id();
-      is_consistent = false;
-      continue;
-    }
+  if (!mission.id().isValid()) {
+    LOG(ERROR) << "Found invalid mission id ";
+    return false;
+  }
+  if (!mission.getBaseFrameId().isValid()) {
+    LOG(ERROR) << "Found invalid mission base frame id for mission: "
+               << mission.id().hexString();
+    return false;
+  }
 
-    if (!mission.id().isValid()) {
-      LOG(ERROR) << "Found invalid mission id ";
-      is_consistent = false;
+  if (!vi_map.hasMissionBaseFrame(mission.getBaseFrameId())) {
+    LOG(ERROR) << "Mission: " << mission.id().hexString()
+               << " claims to have the baseframe id "
+               << mission.getBaseFrameId() << " but that baseframe is not in "
+               << "the map.";
+    return false;
+  }
+
+  if (!vi_map.getSensorManager().hasNCamera(mission_id)) {
+    LOG(ERROR) << "Mission " << mission_id.hexString() << " does not have "
+        << "an ncamera.";
+    return false;
+  }
+  return true;
+}
+
+// Verifies that the landmark index entry points to a vertex storing the
+// landmark.
+bool checkLandmarkIndexEntry(
+    const vi_map::VIMap& vi_map, const vi_map::LandmarkId& landmark_id) {
+  if (!vi_map.hasLandmark(landmark_id)) {
+    LOG(ERROR) << "Vi map claims to have global landmark " << landmark_id
+               << " but then returns false when retrieving it.";
+    return false;
+  }
+
+  const pose_graph::VertexId storing_vertex_id =
+      vi_map.getLandmarkStoreVertexId(landmark_id);
+  if (!vi_map.hasVertex(storing_vertex_id)) {
+    LOG(ERROR) << "Landmark: " << landmark_id
+               << " points to vertex " << storing_vertex_id
+               << " but this vertex is not in the map.";
+    return false;
+  }
+
+  if (!vi_map.getVertex(storing_vertex_id)
+           .getLandmarks()
+           .hasLandmark(landmark_id)) {
+    LOG(ERROR) << "Landmark to vertex table claims that landmark: "
+               << landmark_id.hexString() << " resides in vertex "
+               << storing_vertex_id.hexString() << " which is not the case.";
+    return false;
+  }
+  return true;
+}
+
+// Verifies the landmark ids observed by the visual frames of the vertex and
+// that every landmark lists the vertex as often as an observer as the vertex
+// references it.
+bool checkVertexObservations(
+    const vi_map::VIMap& vi_map, const vi_map::Vertex& vertex) {
+  bool is_consistent = true;
+  const pose_graph::VertexId& vertex_id = vertex.id();
+
+  // Verify that the Landmark IDs in the visual frame are sane:
+  // These tests look for errors that have a soft bound, the thresholds
+  // here are rather arbitrary.
+  // If we find two times the same landmark ID, how far are they allowed to
+  // be apart in image space before we warn or fail.
+  static constexpr double kImageDisparitySameLandmarkWarn = 10.;
+  static constexpr double kImageDisparitySameLandmarkError = 75;
+  // How often can the same landmark ID occur before we declare a map
+  // inconsistent.
+  static constexpr int kMaxNumSameLandmarkId = 5;
+
+  std::unordered_map<LandmarkId, int> appearance_count;
+  std::unordered_map<LandmarkId, std::vector<int>> keypoints_of_landmarks;
+  const int num_frames = vertex.numFrames();
+  for (int i = 0; i < num_frames; ++i) {
+    if (!vertex.isVisualFrameSet(i)) {
       continue;
     }
-    if (!mission.getBaseFrameId().isValid()) {
-      LOG(ERROR) << "Found invalid mission base frame id for mission: "
-                 << mission.id().hexString();
+    const aslam::VisualFrame& visual_frame = vertex.getVisualFrame(i);
+    if (!visual_frame.getId().isValid()) {
+      LOG(ERROR) << "Visual frame id for frame " << i << " in vertex "
+                 << vertex_id << " is invalid.";
       is_consistent = false;
       continue;
     }
 
-    if (!vi_map.hasMissionBaseFrame(mission.getBaseFrameId())) {
-      LOG(ERROR) << "Mission: " << mission.id().hexString()
-                 << " claims to have the baseframe id "
-                 << mission.getBaseFrameId() << " but that baseframe is not in "
-                 << "the map.";
-      is_consistent = false;
-      continue;
+    // Group the keypoints by landmark, so repeated observations of the same
+    // landmark can be compared without looking at all pairs of keypoints.
+    keypoints_of_landmarks.clear();
+    const int num_observed_landmarks = vertex.observedLandmarkIdsSize(i);
+    for (int j = 0; j < num_observed_landmarks; ++j) {
+      const LandmarkId& observed_landmark_j =
+          vertex.getObservedLandmarkId(i, j);
+      if (!observed_landmark_j.isValid()) {
+        continue;
+      }
+      keypoints_of_landmarks[observed_landmark_j].push_back(j);
+      const int count = ++appearance_count[observed_landmark_j];
+      if (count == kMaxNumSameLandmarkId + 1) {
+        LOG(ERROR) << "Landmark " << observed_landmark_j << " is observed "
+                   << "more than " << kMaxNumSameLandmarkId
+                   << " times in the same vertex (" << vertex_id
+                   << ") which is considered an error.";
+      }
     }
 
-    if (!sensor_manager.hasNCamera(mission_id)) {
-      LOG(ERROR) << "Mission " << mission_id.hexString() << " does not have "
-          << "an ncamera.";
-      is_consistent = false;
+    if (!visual_frame.hasKeypointMeasurements()) {
       continue;
     }
+    for (const std::pair<const LandmarkId, std::vector<int>>& keypoints :
+         keypoints_of_landmarks) {
+      const std::vector<int>& keypoint_indices = keypoints.second;
+      for (size_t j = 0u; j < keypoint_indices.size(); ++j) {
+        for (size_t k = j + 1u; k < keypoint_indices.size(); ++k) {
+          // Same landmark id, check the distance in image space.
+          const Eigen::Matrix<double, 2, 1> measurement_i =
+              visual_frame.getKeypointMeasurement(keypoint_indices[j]);
+          const Eigen::Matrix<double, 2, 1> measurement_j =
+              visual_frame.getKeypointMeasurement(keypoint_indices[k]);
+          const double distance = (measurement_i - measurement_j).norm();
+          if (distance > kImageDisparitySameLandmarkError) {
+            LOG(ERROR) << "Landmark " << keypoints.first << " is observed "
+                       << " twice from the same frame (" << vertex_id
+                       << "), but the "
+                       << "observations evaluate to ["
+                       << measurement_i.transpose() << "] and ["
+                       << measurement_j.transpose() << "] (distance of "
+                       << distance << ") and threshold evaluates to "
+                       << kImageDisparitySameLandmarkError;
+            is_consistent = false;
+          } else if (distance > kImageDisparitySameLandmarkWarn) {
+            LOG(WARNING)
+                << "Landmark " << keypoints.first << " is observed "
+                << " twice from the same frame (" << vertex_id << "), but the "
+                << "observations evaluate to [" << measurement_i.transpose()
+                << "] and [" << measurement_j.transpose() << "] (distance of "
+                << distance << ") and threshold evaluates to "
+                << kImageDisparitySameLandmarkWarn;
+          }
+        }
+      }
+    }
   }
-  VLOG_IF(2, is_consistent) << "OK.";
 
-  VLOG(2) << "Verifying  map vertices and edges...";
-  pose_graph::VertexIdList all_vertices;
-  vi_map.getAllVertexIds(&all_vertices);
-  for (const pose_graph::VertexId& vertex_id : all_vertices) {
-    if (!vi_map.hasVertex(vertex_id)) {
-      LOG(ERROR) << "VI map claims to have vertex " << vertex_id
-                 << " but then returns false when retrieving it.";
-      is_consistent = false;
+  // Every reference to a landmark needs a back-reference from the landmark.
+  for (const std::pair<const LandmarkId, int>& observed_landmark :
+       appearance_count) {
+    const LandmarkId& landmark_id = observed_landmark.first;
+    if (!vi_map.hasLandmark(landmark_id)) {
+      LOG(WARNING) << "Vertex " << vertex_id.hexString()
+                   << " observes landmark " << landmark_id.hexString()
+                   << " which is not in the map.";
       continue;
     }
-  }
-  pose_graph::EdgeIdList all_edges;
-  vi_map.getAllEdgeIds(&all_edges);
-  for (const pose_graph::EdgeId& edge_id : all_edges) {
-    if (!vi_map.hasEdge(edge_id)) {
-      LOG(ERROR) << "VI map claims to have edge " << edge_id
-                 << " but then returns false when retrieving it.";
+    int num_back_references = 0;
+    for (const KeypointIdentifier& observation :
+         vi_map.getLandmark(landmark_id).getObservations()) {
+      if (observation.frame_id.vertex_id == vertex_id) {
+        ++num_back_references;
+      }
+    }
+    if (num_back_references != observed_landmark.second) {
+      LOG(ERROR) << "Vertex " << vertex_id.hexString() << " observes landmark "
+                 << landmark_id.hexString() << " " << observed_landmark.second
+                 << " times, but the landmark has " << num_back_references
+                 << " back-references to the vertex.";
       is_consistent = false;
-      continue;
     }
   }
-  VLOG_IF(2, is_consistent) << "OK.";
-
-  // Verify that all landmark IDs in the map are valid.
-  VLOG(2) << "Verifying landmark validity...";
-  vi_map::LandmarkIdList all_landmark_ids;
-  vi_map.getAllLandmarkIds(&all_landmark_ids);
+  return is_consistent;
+}
 
-  // Build a list of landmarks that we expect to find in every vertex, so
-  // we can then check every vertex in batch for its landmarks which is more
-  // cache efficient.
-  typedef std::unordered_map<pose_graph::VertexId,
-                             std::vector<vi_map::LandmarkId> >
-      ExpectedVertexLandmarks;
-  ExpectedVertexLandmarks vertex_expected_landmarks;
+// Verifies a landmark stored in the given vertex and that all its
+// back-references point to observations of the landmark.
+bool checkStoredLandmark(
+    const vi_map::VIMap& vi_map, const pose_graph::VertexId& vertex_id,
+    const vi_map::Landmark& landmark) {
+  bool is_consistent = true;
+  const vi_map::LandmarkId& landmark_id = landmark.id();
+
+  // If this landmark id is non valid, it should not be in the global map.
+  if (!landmark_id.isValid()) {
+    LOG(ERROR) << "Landmark " << landmark_id.hexString()
+               << " stored in vertex " << vertex_id.hexString()
+               << " is invalid. Only valid landmarks should be in the "
+                  "store.";
+    return false;
+  }
+  // Every landmark in the store should be in the global map.
+  if (!vi_map.hasLandmark(landmark_id)) {
+    LOG(ERROR) << "Landmark " << landmark_id.hexString()
+               << " stored in vertex " << vertex_id.hexString()
+               << " is not found in the global map.";
+    is_consistent = false;
+  } else if (vi_map.getLandmarkStoreVertexId(landmark_id) != vertex_id) {
+    LOG(ERROR) << "Landmark " << landmark_id.hexString()
+               << " stored in vertex " << vertex_id.hexString()
+               << " has a landmark index entry pointing to vertex "
+               << vi_map.getLandmarkStoreVertexId(landmark_id).hexString()
+               << '.';
+    is_consistent = false;
+  }
 
-  for (const vi_map::LandmarkId& landmark_id : all_landmark_ids) {
-    if (!vi_map.hasLandmark(landmark_id)) {
-      LOG(ERROR) << "Vi map claims to have global landmark " << landmark_id
-                 << " but then returns false when retrieving it.";
+  for (const KeypointIdentifier& observation : landmark.getObservations()) {
+    const pose_graph::VertexId& observer_vertex_id =
+        observation.frame_id.vertex_id;
+    if (!vi_map.hasVertex(observer_vertex_id)) {
+      LOG(ERROR) << "Landmark " << landmark_id.hexString()
+                 << " stored in vertex " << vertex_id
+                 << " lists the vertex " << observer_vertex_id
+                 << " as observer, but that vertex does not exist.";
       is_consistent = false;
       continue;
     }
 
-    const pose_graph::VertexId& storing_vertex_id =
-        vi_map.getLandmarkStoreVertexId(landmark_id);
-
-    if (!vi_map.hasVertex(storing_vertex_id)) {
-      LOG(ERROR) << "Landmark: " << landmark_id
-                 << " points to vertex " << storing_vertex_id
-                 << " but this vertex is not in the map.";
+    const Vertex& observer_vertex = vi_map.getVertex(observer_vertex_id);
+    const unsigned int frame_index = observation.frame_id.frame_index;
+    if (frame_index >= observer_vertex.numFrames() ||
+        observation.keypoint_index >=
+            observer_vertex.observedLandmarkIdsSize(frame_index)) {
+      LOG(ERROR) << "Keypoint index " << observation.keypoint_index
+                 << " of frame " << frame_index
+                 << " to retrieve landmark ID " << landmark_id.hexString()
+                 << " from vertex " << observer_vertex_id.hexString()
+                 << " is out of bounds.";
       is_consistent = false;
       continue;
     }
 
-    vertex_expected_landmarks[storing_vertex_id].push_back(landmark_id);
+    const vi_map::LandmarkId& observer_landmark_id =
+        observer_vertex.getObservedLandmarkId(
+            frame_index, observation.keypoint_index);
+    if (!observer_landmark_id.isValid()) {
+      LOG(ERROR) << "The store landmark id " << landmark_id.hexString()
+                 << " has a backlink to an observer that has an invalid"
+                 << " landmark ID.";
+      is_consistent = false;
+    } else if (observer_landmark_id != landmark_id) {
+      LOG(ERROR) << "The store vertex of landmark id "
+                 << landmark_id.hexString()
+                 << " and landmark id in the observer table "
+                 << observer_landmark_id.hexString()
+                 << " are inconsistent";
+      is_consistent = false;
+    }
+  }
+  return is_consistent;
+}
+
+// Verifies the landmarks stored in the vertex.
+bool checkVertexLandmarkStore(
+    const vi_map::VIMap& vi_map, const vi_map::Vertex& vertex) {
+  bool is_consistent = true;
+  for (const vi_map::Landmark& landmark : vertex.getLandmarks()) {
+    is_consistent &= checkStoredLandmark(vi_map, vertex.id(), landmark);
   }
+  return is_consistent;
+}
 
-  // Now check all landmarks for every vertex in batch. Iterate through vertices
-  // in cache friendly order too.
-  for (const pose_graph::VertexId& vertex_id : all_vertices) {
-    ExpectedVertexLandmarks::const_iterator it =
-        vertex_expected_landmarks.find(vertex_id);
-    if (it == vertex_expected_landmarks.end()) {
-      LOG(WARNING) << "Skip vertex " << vertex_id << " since no landmarks.";
-      continue;
-    }
-    CHECK(vi_map.hasVertex(vertex_id)) << "No vertex with id "
-                                       << vertex_id.hexString();
-    const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
-    const vi_map::LandmarkStore& landmark_store = vertex.getLandmarks();
-    for (const vi_map::LandmarkId& landmark_id : it->second) {
-      if (!landmark_store.hasLandmark(landmark_id)) {
-        LOG(ERROR) << "Landmark to vertex table claims that landmark: "
-                   << landmark_id.hexString() << " resides in vertex "
-                   << vertex_id.hexString() << " which is not the case.";
-        is_consistent = false;
+bool checkVertex(
+    const vi_map::VIMap& vi_map, const pose_graph::VertexId& vertex_id) {
+  if (!vi_map.hasVertex(vertex_id)) {
+    LOG(ERROR) << "VI map claims to have vertex " << vertex_id
+               << " but then returns false when retrieving it.";
+    return false;
+  }
+  const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
+  const bool observations_consistent =
+      checkVertexObservations(vi_map, vertex);
+  const bool landmark_store_consistent =
+      checkVertexLandmarkStore(vi_map, vertex);
+  return observations_consistent && landmark_store_consistent;
+}
+
+// Checks the given entities of the map, or the whole map if modified_entities
+// is a nullptr.
+bool checkMapConsistencyImpl(
+    const vi_map::VIMap& vi_map,
+    const VIMap::ModifiedEntities* modified_entities,
+    MapConsistencyCheckStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  const bool is_incremental = modified_entities != nullptr;
+  statistics->is_incremental = is_incremental;
+  statistics->checks.clear();
+
+  vi_map::MissionIdList all_mission_ids;
+  vi_map.getAllMissionIds(&all_mission_ids);
+
+  VLOG(2) << "Verifying mission base-frames...";
+  bool missions_consistent = true;
+  {
+    CheckTimer timer("missions");
+    for (const vi_map::MissionId& mission_id : all_mission_ids) {
+      if (!checkMission(vi_map, mission_id)) {
+        missions_consistent = false;
       }
     }
+    statistics->checks.push_back(timer.stop(all_mission_ids.size()));
+  }
 
-    for (const vi_map::Landmark& landmark : landmark_store) {
-      if (!landmark.id().isValid()) {
-        LOG(ERROR) << "Landmark stored in vertex " << vertex_id.hexString()
-                   << " has an invalid ID.";
-        is_consistent = false;
-      } else if (!vi_map.hasLandmark(landmark.id())) {
-        LOG(ERROR) << "Landmark " << landmark.id().hexString() << " stored in "
-                   << "vertex " << vertex_id.hexString() << " has no entry in "
-                   << "landmark index.";
-        is_consistent = false;
+  vi_map::MissionIdList posegraph_mission_ids;
+  if (is_incremental) {
+    for (const vi_map::MissionId& mission_id :
+         modified_entities->mission_ids) {
+      if (vi_map.hasMission(mission_id)) {
+        posegraph_mission_ids.push_back(mission_id);
       }
     }
+  } else {
+    posegraph_mission_ids = all_mission_ids;
   }
-
-  VLOG_IF(2, is_consistent) << "OK.";
-
-  // Create a map of all vertices that have a reference to a given landmark
-  // in order to check the back-reference from landmark to vertices.
-  typedef std::unordered_multimap<vi_map::LandmarkId, pose_graph::VertexId>
-      LandmarkToVertexMap;
-  LandmarkToVertexMap landmark_observing_vertices;
-  VLOG(2) << "Building landmark observers list...";
-  for (const pose_graph::VertexId& vertex_id : all_vertices) {
-    if (!vi_map.hasVertex(vertex_id)) {
-      LOG(ERROR) << "Vi map claims to have vertex " << vertex_id
-                 << " but then returns false when retrieving it.";
+  const bool check_orphaned_items =
+      !is_incremental || !modified_entities->mission_ids.empty();
+
+  // The checks of the posegraph, the sensors and the resources are
+  // independent of the vertex and landmark checks and run concurrently.
+  MapConsistencyCheckStatistics::Check posegraph_check, orphaned_items_check,
+      sensors_check, resources_check;
+  std::future<bool> graph_checks = std::async(std::launch::async, [&]() {
+    bool is_consistent = true;
+
+    VLOG(2) << "Verifying sensor consistency...";
+    CheckTimer sensors_timer("sensors");
+    if (!checkSensorConsistency(vi_map)) {
+      LOG(ERROR) << "Inconsistent sensors detected.";
       is_consistent = false;
-      continue;
     }
+    sensors_check = sensors_timer.stop(all_mission_ids.size());
+
+    VLOG(2) << "Verifying posegraph consistency of "
+            << posegraph_mission_ids.size() << " missions...";
+    // The missions are checked sequentially, the threads are taken by the
+    // vertex and landmark checks running meanwhile.
+    CheckTimer posegraph_timer("posegraph");
+    for (const vi_map::MissionId& mission_id : posegraph_mission_ids) {
+      if (!checkPosegraphConsistency(vi_map, mission_id)) {
+        LOG(ERROR) << "Posegraph of mission " << mission_id
+                   << " inconsistent.";
+        is_consistent = false;
+      }
+    }
+    posegraph_check = posegraph_timer.stop(posegraph_mission_ids.size());
 
-    const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
-
-    for (unsigned int i = 0; i < vertex.numFrames(); ++i) {
-      if (vertex.isVisualFrameSet(i)) {
-        for (size_t j = 0; j < vertex.observedLandmarkIdsSize(i); ++j) {
-          vi_map::LandmarkId landmark_id =
-              vertex.getObservedLandmarkId(i, j);
-          if (landmark_id.isValid()) {
-            landmark_observing_vertices.emplace(landmark_id, vertex_id);
-          }
-        }
+    if (check_orphaned_items) {
+      VLOG(2) << "Looking for orphaned posegraph items...";
+      CheckTimer orphaned_items_timer("orphaned items");
+      if (!checkForOrphanedPosegraphItems(vi_map)) {
+        LOG(ERROR) << "Orphaned items detected.";
+        is_consistent = false;
       }
+      orphaned_items_check =
+          orphaned_items_timer.stop(vi_map.numVertices() + vi_map.numEdges());
     }
-  }
-  VLOG_IF(2, is_consistent) << "OK.";
-
-  VLOG(2) << "Verifying landmark references...";
-  int num_checked = 0;
-  for (const pose_graph::VertexId& vertex_id : all_vertices) {
-    // Existence in map verified above.
-    const Vertex& vertex = vi_map.getVertex(vertex_id);
-
-    VLOG_EVERY_N(2, static_cast<int>(all_vertices.size()) / 10)
-        << "Verifying vertices... "
-        << std::round(
-               static_cast<double>(num_checked + 1) / all_vertices.size() *
-               100.)
-        << "%";
-
-    // Verify that the Landmark IDs in the visual frame are sane:
-    // These tests look for errors that have a soft bound, the thresholds
-    // here are rather arbitrary.
-    // If we find two times the same landmark ID, how far are they allowed to
-    // be apart in image space before we warn or fail.
-    static constexpr double kImageDisparitySameLandmarkWarn = 10.;
-    static constexpr double kImageDisparitySameLandmarkError = 75;
-    // How often can the same landmark ID occur before we declare a map
-    // inconsistent.
-    static constexpr int kMaxNumSameLandmarkId = 5;
-    std::unordered_map<LandmarkId, int> appearance_count;
-    const int num_frames = vertex.numFrames();
-    for (int i = 0; i < num_frames; ++i) {
-      if (vertex.isVisualFrameSet(i)) {
-        if (!vertex.getVisualFrame(i).getId().isValid()) {
-          LOG(ERROR) << "Visual frame id for frame " << i << " in vertex "
-                     << vertex_id << " is invalid.";
-          is_consistent = false;
-          continue;
-        }
-        const int num_observed_landmarks = vertex.observedLandmarkIdsSize(i);
-        for (int j = 0; j < num_observed_landmarks; ++j) {
-          LandmarkId observed_landmark_j = vertex.getObservedLandmarkId(i, j);
-          if (!observed_landmark_j.isValid()) {
-            continue;
-          }
-          ++appearance_count[observed_landmark_j];
-          if (appearance_count[observed_landmark_j] > kMaxNumSameLandmarkId) {
-            LOG(ERROR) << "Landmark " << observed_landmark_j << " is observed "
-                       << appearance_count[observed_landmark_j]
-                       << "times in the same frame (" << vertex_id
-                       << ") which is considered an "
-                       << "error (threshold evaluates to "
-                       << kMaxNumSameLandmarkId << ").";
-          }
 
-          for (int k = j + 1; k < num_observed_landmarks; ++k) {
-            LandmarkId observed_landmark_k =
-                vertex.getObservedLandmarkId(i, k);
-            if (!observed_landmark_k.isValid()) {
-              continue;
-            }
-            if (observed_landmark_j != observed_landmark_k) {
-              continue;
-            }
-            // Same landmark id, check the distance in image space.
-            if (vertex.getVisualFrame(i).hasKeypointMeasurements()) {
-              Eigen::Matrix<double, 2, 1> measurement_i =
-                  vertex.getVisualFrame(i).getKeypointMeasurement(j);
-              Eigen::Matrix<double, 2, 1> measurement_j =
-                  vertex.getVisualFrame(i).getKeypointMeasurement(k);
-              double distance = (measurement_i - measurement_j).norm();
-              if (distance > kImageDisparitySameLandmarkError) {
-                LOG(ERROR) << "Landmark " << observed_landmark_j
-                           << " is observed "
-                           << " twice from the same frame (" << vertex_id
-                           << "), but the "
-                           << "observations evaluate to ["
-                           << measurement_i.transpose() << "] and ["
-                           << measurement_j.transpose() << "] (distance of "
-                           << distance << ") and threshold evaluates to "
-                           << kImageDisparitySameLandmarkError;
-                is_consistent = false;
-              } else if (distance > kImageDisparitySameLandmarkWarn) {
-                LOG(WARNING)
-                    << "Landmark " << observed_landmark_j << " is observed "
-                    << " twice from the same frame (" << vertex_id
-                    << "), but the "
-                    << "observations evaluate to [" << measurement_i.transpose()
-                    << "] and [" << measurement_j.transpose()
-                    << "] (distance of " << distance
-                    << ") and threshold evaluates to "
-                    << kImageDisparitySameLandmarkWarn;
-              }
+    // Resources are not tracked by the modification tracking.
+    if (!is_incremental) {
+      VLOG(2) << "Verifying resource consistency...";
+      CheckTimer resources_timer("resources");
+      if (!vi_map.checkResourceConsistency()) {
+        LOG(ERROR)
+            << "Inconsistent resources or resource info entries detected.";
+        is_consistent = false;
+      }
+      resources_check = resources_timer.stop(vi_map.numVertices());
+    }
+    return is_consistent;
+  });
+
+  pose_graph::VertexIdList vertex_ids;
+  vi_map::LandmarkIdList landmark_ids;
+  pose_graph::EdgeIdList edge_ids;
+  // Landmarks stored in unmodified vertices that the modified vertices
+  // observe or observed before their modification. Their back-references
+  // to the modified vertices may have become stale.
+  vi_map::LandmarkIdList referenced_landmark_ids;
+  if (is_incremental) {
+    pose_graph::EdgeIdSet edge_ids_to_check;
+    vi_map::LandmarkIdSet stored_landmark_ids;
+    vi_map::LandmarkIdSet observed_landmark_ids =
+        modified_entities->landmark_ids;
+    for (const pose_graph::VertexId& vertex_id :
+         modified_entities->vertex_ids) {
+      // Removed vertices are covered by the posegraph checks of their
+      // missions.
+      if (vi_map.hasVertex(vertex_id)) {
+        vertex_ids.push_back(vertex_id);
+        const vi_map::Vertex& vertex = vi_map.getVertex(vertex_id);
+        for (const vi_map::Landmark& landmark : vertex.getLandmarks()) {
+          if (landmark.id().isValid()) {
+            landmark_ids.push_back(landmark.id());
+            stored_landmark_ids.insert(landmark.id());
+          }
+        }
+        for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+             ++frame_idx) {
+          for (const vi_map::LandmarkId& landmark_id :
+               vertex.getFrameObservedLandmarkIds(frame_idx)) {
+            if (landmark_id.isValid()) {
+              observed_landmark_ids.insert(landmark_id);
             }
           }
         }
+        vertex.incidentEdges(&edge_ids_to_check);
       }
     }
-
-    const vi_map::LandmarkStore& landmark_store = vertex.getLandmarks();
-
-    for (const vi_map::Landmark& landmark : landmark_store) {
-      const vi_map::LandmarkId& landmark_id = landmark.id();
-
-      // If this landmark id is non valid, it should not be in the global map.
-      if (!landmark_id.isValid()) {
-        LOG(ERROR) << "Landmark " << landmark_id.hexString()
-                   << " stored in vertex " << vertex_id.hexString()
-                   << " is invalid. Only valid landmarks should be in the "
-                      "store.";
-        is_consistent = false;
+    for (const pose_graph::EdgeId& edge_id : modified_entities->edge_ids) {
+      if (vi_map.hasEdge(edge_id)) {
+        edge_ids_to_check.insert(edge_id);
       }
-      // Every landmark in the store should be in the global map.
-      if (!vi_map.hasLandmark(landmark_id)) {
-        LOG(ERROR) << "Landmark " << landmark_id.hexString()
-                   << " stored in vertex " << vertex_id.hexString()
-                   << " is not found in the global map.";
-        is_consistent = false;
+    }
+    edge_ids.assign(edge_ids_to_check.begin(), edge_ids_to_check.end());
+    // Landmarks that don't exist anymore are reported by the vertex checks.
+    for (const vi_map::LandmarkId& landmark_id : observed_landmark_ids) {
+      if (stored_landmark_ids.count(landmark_id) == 0u &&
+          vi_map.hasLandmark(landmark_id)) {
+        referenced_landmark_ids.push_back(landmark_id);
       }
+    }
+  } else {
+    vi_map.getAllVertexIds(&vertex_ids);
+    vi_map.getAllLandmarkIds(&landmark_ids);
+    vi_map.getAllEdgeIds(&edge_ids);
+  }
 
-      const KeypointIdentifierList& vertex_id_frame_idx_kp_idx =
-          landmark_store.getLandmark(landmark_id).getObservations();
-
-      // Count how often we expect to find every vertex in the backwards
-      // reference list of the current landmark.
-      std::pair<LandmarkToVertexMap::iterator,
-                LandmarkToVertexMap::iterator>
-          range = landmark_observing_vertices.equal_range(landmark_id);
-      std::unordered_map<pose_graph::VertexId, int> refound_map;
-      for (LandmarkToVertexMap::iterator it_vertex = range.first;
-           it_vertex != range.second; ++it_vertex) {
-        // Increment the number of times we expect to find this to be
-        // back-referenced from the landmarks.
-        if (refound_map.count(it_vertex->second) == 0) {
-          refound_map[it_vertex->second] = 1;
-        } else {
-          ++refound_map[it_vertex->second];
-        }
-      }
+  VLOG(2) << "Verifying " << edge_ids.size() << " edges...";
+  bool edges_consistent;
+  {
+    CheckTimer timer("edges");
+    edges_consistent =
+        checkAllInParallel(edge_ids.size(), [&](const size_t edge_idx) {
+          if (!vi_map.hasEdge(edge_ids[edge_idx])) {
+            LOG(ERROR) << "VI map claims to have edge " << edge_ids[edge_idx]
+                       << " but then returns false when retrieving it.";
+            return false;
+          }
+          return true;
+        });
+    statistics->checks.push_back(timer.stop(edge_ids.size()));
+  }
 
-      VLOG(5) << "refound map:";
-      for (const std::pair<pose_graph::VertexId, int>& observation_counts :
-           refound_map) {
-        VLOG(5) << "Back-references to vertex "
-                << observation_counts.first.hexString() << " from landmark "
-                << landmark_id.hexString() << "  " << observation_counts.second;
-      }
+  VLOG(2) << "Verifying " << landmark_ids.size()
+          << " landmark index entries...";
+  bool landmark_index_consistent;
+  {
+    CheckTimer timer("landmark index");
+    landmark_index_consistent =
+        checkAllInParallel(landmark_ids.size(), [&](const size_t landmark_idx) {
+          return checkLandmarkIndexEntry(vi_map, landmark_ids[landmark_idx]);
+        });
+    statistics->checks.push_back(timer.stop(landmark_ids.size()));
+  }
 
-      // Check that all other observing vertices of this landmark have
-      // set the ID to the same state.
-      for (unsigned int j = 0; j < vertex_id_frame_idx_kp_idx.size(); ++j) {
-        const pose_graph::VertexId& observer_vertex_id =
-            vertex_id_frame_idx_kp_idx[j].frame_id.vertex_id;
-        if (!vi_map.hasVertex(observer_vertex_id)) {
-          LOG(ERROR) << "Landmark " << landmark_id.hexString()
-                     << " stored in vertex " << vertex_id
-                     << " lists the vertex " << observer_vertex_id
-                     << " as observer, but that vertex does not exist.";
-          is_consistent = false;
-        }
+  // The full check verifies all landmarks through their storing vertices.
+  bool referenced_landmarks_consistent = true;
+  if (is_incremental) {
+    VLOG(2) << "Verifying " << referenced_landmark_ids.size()
+            << " landmarks referenced by the modified vertices...";
+    CheckTimer timer("referenced landmarks");
+    referenced_landmarks_consistent = checkAllInParallel(
+        referenced_landmark_ids.size(), [&](const size_t landmark_idx) {
+          const vi_map::LandmarkId& landmark_id =
+              referenced_landmark_ids[landmark_idx];
+          if (!checkLandmarkIndexEntry(vi_map, landmark_id)) {
+            return false;
+          }
+          return checkStoredLandmark(
+              vi_map, vi_map.getLandmarkStoreVertexId(landmark_id),
+              vi_map.getLandmark(landmark_id));
+        });
+    statistics->checks.push_back(timer.stop(referenced_landmark_ids.size()));
+  }
 
-        const Vertex& observer_vertex = vi_map.getVertex(observer_vertex_id);
+  VLOG(2) << "Verifying landmark references of " << vertex_ids.size()
+          << " vertices...";
+  bool vertices_consistent;
+  {
+    CheckTimer timer("vertices and landmark references");
+    vertices_consistent =
+        checkAllInParallel(vertex_ids.size(), [&](const size_t vertex_idx) {
+          return checkVertex(vi_map, vertex_ids[vertex_idx]);
+        });
+    statistics->checks.push_back(timer.stop(vertex_ids.size()));
+  }
 
-        // Check that we have seen this vertex before.
-        if (refound_map.count(observer_vertex_id) == 0u) {
-          LOG(ERROR) << "Landmark " << landmark_id.hexString()
-                     << " has an unknown vertex listed as observer: "
-                     << observer_vertex_id.hexString();
-          is_consistent = false;
-        }
-        // Check that there is still an unmatched observation for this vertex.
-        if (refound_map[observer_vertex_id] <= 0) {
-          LOG(ERROR)
-              << "The landmark " << landmark_id.hexString()
-              << " has the vertex " << observer_vertex_id.hexString()
-              << " in the list of back-references, but all back-references to"
-              << " this vertex have already been matched.";
-          is_consistent = false;
-        }
-        // Mark as found.
-        --refound_map[observer_vertex_id];
-
-        if (vertex_id_frame_idx_kp_idx[j].keypoint_index >=
-            observer_vertex.observedLandmarkIdsSize(
-                vertex_id_frame_idx_kp_idx[j].frame_id.frame_index)) {
-          LOG(ERROR) << "Keypoint index "
-                     << vertex_id_frame_idx_kp_idx[j].keypoint_index
-                     << " to retrieve landmark ID "
-                     << vertex_id_frame_idx_kp_idx[j].frame_id.vertex_id
-                     << " is out of bounds.";
-          is_consistent = false;
-          continue;
-        }
+  const bool graph_consistent = graph_checks.get();
+  statistics->checks.push_back(sensors_check);
+  statistics->checks.push_back(posegraph_check);
+  if (check_orphaned_items) {
+    statistics->checks.push_back(orphaned_items_check);
+  }
+  if (!is_incremental) {
+    statistics->checks.push_back(resources_check);
+  }
 
-        const vi_map::LandmarkId& observer_landmark_id =
-            observer_vertex.getObservedLandmarkId(
-                vertex_id_frame_idx_kp_idx[j].frame_id.frame_index,
-                vertex_id_frame_idx_kp_idx[j].keypoint_index);
-        if (!observer_landmark_id.isValid()) {
-          LOG(ERROR) << "The store landmark id " << landmark_id.hexString()
-                     << " has a backlink to an observer that has an invalid"
-                     << " landmark ID.";
-          is_consistent = false;
-        } else if (
-            observer_landmark_id != landmark_id) {
-          LOG(ERROR) << "The store vertex of landmark id "
-                     << landmark_id.hexString()
-                     << " and landmark id in the observer table "
-                     << observer_landmark_id.hexString()
-                     << " are inconsistent";
-          is_consistent = false;
-        }
+  for (const MapConsistencyCheckStatistics::Check& check :
+       statistics->checks) {
+    VLOG(1) << "Consistency check \"" << check.name << "\": "
+            << check.num_items << " items in " << check.duration_seconds
+            << " s (" << check.getItemsPerSecond() << " items/s).";
+  }
 
-        if (landmark_id.isValid() != observer_landmark_id.isValid()) {
-          LOG(ERROR)
-              << "The valid state of corresponding landmarks stored in vertex "
-              << vertex_id.hexString() << " and "
-              << vertex_id_frame_idx_kp_idx[j].frame_id.vertex_id.hexString()
-              << " are inconsistent";
-          is_consistent = false;
-        }
-      }
+  return missions_consistent && edges_consistent &&
+         landmark_index_consistent && referenced_landmarks_consistent &&
+         vertices_consistent && graph_consistent;
+}
 
-      for (const std::pair<pose_graph::VertexId, int>& observation_counts :
-           refound_map) {
-        if (observation_counts.second != 0) {
-          LOG(ERROR) << "Back-references to vertex "
-                     << observation_counts.first.hexString()
-                     << " missing in the list of back-references of landmark "
-                     << landmark_id.hexString();
-          is_consistent = false;
-        }
-      }
-    }
-    ++num_checked;
-  }
-  VLOG_IF(2, is_consistent) << "OK.";
+}  // namespace
 
-  VLOG(2) << "Verifying sensor consistency...";
-  if (!checkSensorConsistency(vi_map)) {
-    LOG(ERROR) << "Inconsistent sensors detected.";
-    is_consistent = false;
-  } else {
-    VLOG(2) << "OK.";
+double MapConsistencyCheckStatistics::Check::getItemsPerSecond() const {
+  if (duration_seconds <= 0.0) {
+    return 0.0;
   }
+  return num_items / duration_seconds;
+}
 
-  VLOG(2) << "Verifying posegraph consistency for each mission...";
-  for (const vi_map::MissionId& mission_id : mission_ids) {
-    VLOG(2) << "Verifying mission: " << mission_id << "...";
-    if (!vi_map.hasMission(mission_id)) {
-      LOG(ERROR) << "Vi map claims to have mission " << mission_id
-                 << " but then returns false when retrieving it.";
-      is_consistent = false;
-      continue;
-    }
+bool checkMapConsistency(const vi_map::VIMap& vi_map) {
+  MapConsistencyCheckStatistics statistics;
+  return checkMapConsistency(vi_map, &statistics);
+}
 
-    if (!checkPosegraphConsistency(vi_map, mission_id)) {
-      LOG(ERROR) << "Posegraph inconsistent.";
-      is_consistent = false;
-    } else {
-      VLOG(2) << "OK.";
-    }
+bool checkMapConsistency(
+    const vi_map::VIMap& vi_map, MapConsistencyCheckStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  LOG(INFO) << "Checking VI-Map consistency.";
+
+  // Everything is validated, so all modifications up to now can be dropped.
+  VIMap::ModifiedEntities modified_entities;
+  vi_map.takeModifiedEntities(&modified_entities);
+
+  const bool is_consistent =
+      checkMapConsistencyImpl(vi_map, nullptr, statistics);
+  if (!is_consistent) {
+    modified_entities.clear();
+    modified_entities.all = true;
+    vi_map.addModifiedEntities(modified_entities);
   }
+  LOG_IF(INFO, is_consistent) << "VI-Map is consistent.";
+  return is_consistent;
+}
 
-  VLOG(2) << "Looking for orphaned posegraph items...";
-  if (!checkForOrphanedPosegraphItems(vi_map)) {
-    LOG(ERROR) << "Orphaned items detected.";
-    is_consistent = false;
-  } else {
-    VLOG(2) << "OK.";
+bool checkMapConsistencyIncremental(const vi_map::VIMap& vi_map) {
+  MapConsistencyCheckStatistics statistics;
+  return checkMapConsistencyIncremental(vi_map, &statistics);
+}
+
+bool checkMapConsistencyIncremental(
+    const vi_map::VIMap& vi_map, MapConsistencyCheckStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  if (!vi_map.isModificationTrackingEnabled()) {
+    return checkMapConsistency(vi_map, statistics);
   }
 
-  VLOG(2) << "Verifying resource consistency...";
-  if (!vi_map.checkResourceConsistency()) {
-    LOG(ERROR) << "Inconsistent resources or resource info entries detected.";
-    is_consistent = false;
-  } else {
-    VLOG(2) << "OK.";
+  VIMap::ModifiedEntities modified_entities;
+  vi_map.takeModifiedEntities(&modified_entities);
+  if (modified_entities.all) {
+    vi_map.addModifiedEntities(modified_entities);
+    return checkMapConsistency(vi_map, statistics);
   }
 
-  LOG_IF(INFO, is_consistent) << "VI-Map is consistent.";
+  VLOG(1) << "Checking VI-Map consistency of "
+          << modified_entities.vertex_ids.size() << " modified vertices and "
+          << modified_entities.mission_ids.size() << " modified missions.";
+  const bool is_consistent =
+      checkMapConsistencyImpl(vi_map, &modified_entities, statistics);
+  if (!is_consistent) {
+    // Validate the same entities again during the next check.
+    vi_map.addModifiedEntities(modified_entities);
+  }
   return is_consistent;
 }
 
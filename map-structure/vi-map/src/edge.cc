@@ -143,4 +143,10 @@ void Edge::copyEdgeInto(Edge** new_edge) const {
   CHECK(new_edge != nullptr);
 }
 
+pose_graph::Edge::UniquePtr Edge::clone() const {
+  Edge* cloned_edge = nullptr;
+  copyEdgeInto(&cloned_edge);
+  return pose_graph::Edge::UniquePtr(CHECK_NOTNULL(cloned_edge));
+}
+
 }  // namespace vi_map
@@ -1,12 +1,17 @@
 #include "vi-map/vertex.h"
 
+#include <array>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <unordered_set>
+#include <utility>
 
 #include <glog/logging.h>
 
 #include <aslam-serialization/visual-frame-serialization.h>
 #include <aslam/common/hash-id.h>
+#include <aslam/common/memory.h>
 #include <aslam/common/stl-helpers.h>
 #include <maplab-common/aslam-id-proto.h>
 #include <maplab-common/eigen-proto.h>
@@ -15,6 +20,14 @@
 #include "vi-map/vi_map.pb.h"
 
 namespace vi_map {
+namespace {
+// Serializes the detaching of the shared blocks of the same vertex.
+constexpr size_t kNumSharedBlockMutexes = 64u;
+std::mutex& getSharedBlockMutex(const Vertex* vertex) {
+  static std::array<std::mutex, kNumSharedBlockMutexes> mutexes;
+  return mutexes[std::hash<const void*>()(vertex) % kNumSharedBlockMutexes];
+}
+}  // namespace
 
 Vertex::Vertex(
     const pose_graph::VertexId& vertex_id,
@@ -186,6 +199,71 @@ const pose_graph::VertexId& Vertex::id() const {
   return id_;
 }
 
+Vertex::Vertex(const Vertex& other)
+    : pose_graph::Vertex(other),
+      id_(other.id_),
+      mission_id_(other.mission_id_),
+      T_M_I_(other.T_M_I_),
+      v_M_(other.v_M_),
+      accel_bias_(other.accel_bias_),
+      gyro_bias_(other.gyro_bias_),
+      incoming_edges_(other.incoming_edges_),
+      outgoing_edges_(other.outgoing_edges_),
+      n_frame_(other.n_frame_),
+      observed_landmark_ids_(other.observed_landmark_ids_),
+      landmarks_(other.landmarks_),
+      is_n_frame_shared_(other.is_n_frame_shared_.load()),
+      may_share_landmarks_(true),
+      resource_map_(other.resource_map_) {
+  CHECK(landmarks_ != nullptr);
+  other.may_share_landmarks_.store(true, std::memory_order_release);
+}
+
+pose_graph::Vertex::UniquePtr Vertex::clone() const {
+  AlignedUniquePtr<Vertex> cloned_vertex = aligned_unique<Vertex>(*this);
+  if (n_frame_ != nullptr) {
+    cloned_vertex->is_n_frame_shared_ = true;
+    is_n_frame_shared_.store(true, std::memory_order_release);
+  }
+  return std::move(cloned_vertex);
+}
+
+void Vertex::detachSharedNFrame() {
+  if (!is_n_frame_shared_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(getSharedBlockMutex(this));
+  if (is_n_frame_shared_.load(std::memory_order_relaxed)) {
+    // The other vertex copies the frames as well on its first write, the
+    // reference count can't tell whether it still uses them.
+    CHECK(n_frame_ != nullptr);
+    n_frame_.reset(new aslam::VisualNFrame(*n_frame_));
+    is_n_frame_shared_.store(false, std::memory_order_release);
+  }
+}
+
+void Vertex::detachSharedLandmarks() {
+  if (!may_share_landmarks_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(getSharedBlockMutex(this));
+  if (may_share_landmarks_.load(std::memory_order_relaxed)) {
+    CHECK(landmarks_ != nullptr);
+    if (landmarks_.use_count() > 1) {
+      landmarks_ = aligned_shared<LandmarkStore>(*landmarks_);
+    }
+    may_share_landmarks_.store(false, std::memory_order_release);
+  }
+}
+
+std::unique_lock<std::mutex> Vertex::lockSharedBlocks() const {
+  if (is_n_frame_shared_.load(std::memory_order_acquire) ||
+      may_share_landmarks_.load(std::memory_order_acquire)) {
+    return std::unique_lock<std::mutex>(getSharedBlockMutex(this));
+  }
+  return std::unique_lock<std::mutex>();
+}
+
 void Vertex::setId(const pose_graph::VertexId& id) {
   id_ = id;
 }
@@ -278,7 +356,7 @@ void Vertex::serialize(vi_map::proto::ViwlsVertex* proto) const {
     }
   }
 
-  landmarks_.serialize(proto->mutable_landmark_store());
+  getLandmarks().serialize(proto->mutable_landmark_store());
 
   // Serialize FrameResourceMap.
   for (backend::ResourceTypeToIdsMap resource_type_to_id_map : resource_map_) {
@@ -307,7 +385,7 @@ void Vertex::deserialize(
 
   CHECK(proto.has_n_visual_frame());
   aslam::serialization::deserializeVisualNFrame(
-      proto.n_visual_frame(), &n_frame_);
+      proto.n_visual_frame(), &getVisualNFrameShared());
 
   const int num_frames = proto.n_visual_frame().frames_size();
   observed_landmark_ids_.resize(num_frames);
@@ -622,14 +700,16 @@ std::string Vertex::getComparisonString(const Vertex& other) const {
   }
 
   // Important: Landmark operator == doesn't cover the observations!
-  if (landmarks_ != other.landmarks_) {
+  const LandmarkStore& landmarks = getLandmarks();
+  const LandmarkStore& other_landmarks = other.getLandmarks();
+  if (landmarks != other_landmarks) {
     ss << "The store landmarks differ (amount, position).\n";
   }
-  if (landmarks_.size() == other.landmarks_.size()) {
+  if (landmarks.size() == other_landmarks.size()) {
     bool observations_differ = false;
-    for (size_t i = 0u; i < landmarks_.size(); ++i) {
-      if (landmarks_[i].getObservations() !=
-          other.landmarks_[i].getObservations()) {
+    for (size_t i = 0u; i < landmarks.size(); ++i) {
+      if (landmarks[i].getObservations() !=
+          other_landmarks[i].getObservations()) {
         observations_differ = true;
         break;
       }
@@ -693,6 +773,7 @@ void Vertex::setFrameAndLandmarkObservations(
     const std::vector<std::vector<LandmarkId>>& img_landmarks) {
   CHECK(visual_n_frame != nullptr);
   n_frame_ = visual_n_frame;
+  is_n_frame_shared_ = false;
   for (unsigned int frame_idx = 0u; frame_idx < observed_landmark_ids_.size();
        ++frame_idx) {
     // We want to make sure nobody calls this on a populated vertex since in
@@ -795,8 +876,9 @@ pose::Position3D Vertex::getLandmark_p_LM_fi(
 
 void Vertex::getStoredLandmarkIdList(LandmarkIdList* landmark_id_list) const {
   CHECK_NOTNULL(landmark_id_list)->clear();
-  landmark_id_list->reserve(landmarks_.size());
-  for (const Landmark& landmark : landmarks_) {
+  const LandmarkStore& landmarks = getLandmarks();
+  landmark_id_list->reserve(landmarks.size());
+  for (const Landmark& landmark : landmarks) {
     landmark_id_list->emplace_back(landmark.id());
   }
 }
@@ -808,7 +890,7 @@ void Vertex::setLandmark_LM_p_fi(
 }
 
 bool Vertex::hasStoredLandmark(const LandmarkId& landmark_id) const {
-  return landmarks_.hasLandmark(landmark_id);
+  return getLandmarks().hasLandmark(landmark_id);
 }
 
 bool Vertex::hasFrameResourceOfType(
@@ -45,6 +45,18 @@ size_t serializeVertices(
   return counter;
 }
 
+void serializeVertices(
+    const vi_map::VIMap& map, const pose_graph::VertexIdList& vertex_ids,
+    vi_map::proto::VIMap* proto) {
+  CHECK_NOTNULL(proto);
+  proto->mutable_vertex_ids()->Reserve(vertex_ids.size());
+  proto->mutable_vertices()->Reserve(vertex_ids.size());
+  for (const pose_graph::VertexId& id : vertex_ids) {
+    id.serialize(proto->add_vertex_ids());
+    map.getVertex(id).serialize(proto->add_vertices());
+  }
+}
+
 void serializeEdges(const vi_map::VIMap& map, vi_map::proto::VIMap* proto) {
   // Serialize all edges.
   const size_t num_edges = map.numEdges();
@@ -72,6 +84,18 @@ size_t serializeEdges(
   return counter;
 }
 
+void serializeEdges(
+    const vi_map::VIMap& map, const pose_graph::EdgeIdList& edge_ids,
+    vi_map::proto::VIMap* proto) {
+  CHECK_NOTNULL(proto);
+  proto->mutable_edge_ids()->Reserve(edge_ids.size());
+  proto->mutable_edges()->Reserve(edge_ids.size());
+  for (const pose_graph::EdgeId& id : edge_ids) {
+    id.serialize(proto->add_edge_ids());
+    map.getEdgeAs<vi_map::Edge>(id).serialize(proto->add_edges());
+  }
+}
+
 void serializeMissionsAndBaseframes(
     const vi_map::VIMap& map, vi_map::proto::VIMap* proto) {
   CHECK_NOTNULL(proto);
@@ -1,12 +1,20 @@
 #include "vi-map/vi-map.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <limits>
 #include <queue>
+#include <utility>
 
 #include <aslam/common/memory.h>
 #include <aslam/common/time.h>
 #include <map-resources/resource_metadata.pb.h>
+#include <maplab-common/accessors.h>
 #include <maplab-common/file-system-tools.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 
 #include "vi-map/semantics-manager.h"
 #include "vi-map/vertex.h"
@@ -18,90 +26,185 @@ VIMap::VIMap(const std::string& map_folder)
     : backend::ResourceMap(map_folder),
       const_this(this),
       generator_(static_cast<int>(
-          std::chrono::system_clock::now().time_since_epoch().count())) {}
+          std::chrono::system_clock::now().time_since_epoch().count())),
+      is_modification_tracking_enabled_(false),
+      are_all_entities_modified_(false) {}
 
 VIMap::VIMap(const metadata::proto::MetaData& metadata_proto)
     : backend::ResourceMap(metadata_proto),
       const_this(this),
       generator_(static_cast<int>(
-          std::chrono::system_clock::now().time_since_epoch().count())) {}
+          std::chrono::system_clock::now().time_since_epoch().count())),
+      is_modification_tracking_enabled_(false),
+      are_all_entities_modified_(false) {}
 
 VIMap::VIMap()
     : backend::ResourceMap(),
       const_this(this),
       generator_(static_cast<int>(
-          std::chrono::system_clock::now().time_since_epoch().count())) {}
+          std::chrono::system_clock::now().time_since_epoch().count())),
+      is_modification_tracking_enabled_(false),
+      are_all_entities_modified_(false) {}
+
+constexpr size_t VIMap::kNumModifiedEntitiesShards;
+constexpr size_t VIMap::kNumFrameModificationShards;
 
 VIMap::~VIMap() {}
 
+double MapMergeStatistics::getVerticesPerSecond() const {
+  if (duration_seconds <= 0.0) {
+    return 0.0;
+  }
+  return num_vertices / duration_seconds;
+}
+
 void VIMap::deepCopy(const VIMap& other) {
   clear();
-  mergeAllMissionsFromMapWithoutResources(other);
+  if (other.selected_missions_.empty()) {
+    copyMissionsFromMap(other);
+    // The vertices and edges are only cloned once they get modified.
+    posegraph.shareVerticesAndEdgesFrom(other.posegraph);
+    landmark_index.addLandmarkAndVertexReferences(other.landmark_index);
+  } else {
+    // Only the selected missions are copied, so the pose graph can't be shared
+    // as a whole.
+    mergeAllMissionsFromMapWithoutResources(other);
+  }
   ResourceMap::deepCopy(other);
 }
 
 void VIMap::mergeAllMissionsFromMapWithoutResources(
     const vi_map::VIMap& other) {
-  const SensorManager& other_sensor_manager = other.getSensorManager();
-
-  // Get all missions from old map and add them into the new map.
-  vi_map::MissionIdList other_mission_ids;
-  other.getAllMissionIds(&other_mission_ids);
-  vi_map::MissionBaseFrameIdList mission_base_frame_ids;
-  other.getAllMissionBaseFrameIds(&mission_base_frame_ids);
-
-  for (const vi_map::MissionId& other_mission_id : other_mission_ids) {
-    CHECK(other_mission_id.isValid());
-    const vi_map::VIMission& other_mission = other.getMission(other_mission_id);
-    const vi_map::MissionBaseFrame& original_mission_base_frame =
-        other.getMissionBaseFrameForMission(other_mission_id);
+  mergeAllMissionsFromMapsWithoutResources({&other}, nullptr);
+}
+
+void VIMap::mergeAllMissionsFromMapsWithoutResources(
+    const std::vector<const vi_map::VIMap*>& source_maps,
+    MapMergeStatistics* statistics) {
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  markAllModified();
+
+  // Add the missions and gather the items to copy from all maps.
+  typedef std::pair<const VIMap*, pose_graph::VertexId> SourceVertex;
+  typedef std::pair<const VIMap*, pose_graph::EdgeId> SourceEdge;
+  std::vector<SourceVertex> source_vertices;
+  std::vector<SourceEdge> source_edges;
+  MapMergeStatistics merge_statistics;
+  for (const VIMap* source_map : source_maps) {
+    CHECK_NOTNULL(source_map);
+    merge_statistics.num_missions += copyMissionsFromMap(*source_map);
 
-    addNewMissionWithBaseframe(
-        aligned_unique<VIMission>(other_mission), original_mission_base_frame);
-
-    sensor_manager_.merge(other_sensor_manager, other_mission_id);
-
-    vi_map::Mission& copied_mission = getMission(other_mission_id);
-    copied_mission.setRootVertexId(other_mission.getRootVertexId());
-  }
-
-  // Get all vertices and add them into the new map.
-  pose_graph::VertexIdList vertex_ids;
-  other.getAllVertexIds(&vertex_ids);
+    pose_graph::VertexIdList vertex_ids;
+    source_map->getAllVertexIds(&vertex_ids);
+    source_vertices.reserve(source_vertices.size() + vertex_ids.size());
+    for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+      source_vertices.emplace_back(source_map, vertex_id);
+    }
 
-  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
-    const vi_map::Vertex& original_vertex = other.getVertex(vertex_id);
-    vi_map::Vertex::UniquePtr copied_vertex =
-        aligned_unique<vi_map::Vertex>(original_vertex);
-    addVertex(std::move(copied_vertex));
+    pose_graph::EdgeIdList edge_ids;
+    source_map->getAllEdgeIds(&edge_ids);
+    source_edges.reserve(source_edges.size() + edge_ids.size());
+    for (const pose_graph::EdgeId& edge_id : edge_ids) {
+      source_edges.emplace_back(source_map, edge_id);
+    }
   }
 
-  // Add all edges into the new map.
-  pose_graph::EdgeIdList edge_ids;
-  other.getAllEdgeIds(&edge_ids);
+  // Deep-copy the vertices and edges in parallel, every thread fills its own
+  // shard.
+  const size_t num_items =
+      std::max(source_vertices.size(), source_edges.size());
+  const size_t num_shards = std::max<size_t>(
+      1u, std::min<size_t>(common::getNumHardwareThreads(), num_items));
+  std::vector<std::vector<pose_graph::Vertex::UniquePtr>> vertex_shards(
+      num_shards);
+  std::vector<std::vector<pose_graph::Edge::UniquePtr>> edge_shards(
+      num_shards);
+  common::ParallelProcess(
+      num_shards,
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t shard_idx : batch) {
+          const size_t vertex_begin =
+              shard_idx * source_vertices.size() / num_shards;
+          const size_t vertex_end =
+              (shard_idx + 1u) * source_vertices.size() / num_shards;
+          std::vector<pose_graph::Vertex::UniquePtr>& vertex_shard =
+              vertex_shards[shard_idx];
+          vertex_shard.reserve(vertex_end - vertex_begin);
+          for (size_t idx = vertex_begin; idx < vertex_end; ++idx) {
+            const SourceVertex& source_vertex = source_vertices[idx];
+            vertex_shard.emplace_back(
+                aligned_unique<vi_map::Vertex>(
+                    source_vertex.first->getVertex(source_vertex.second)));
+          }
 
-  for (const pose_graph::EdgeId& edge_id : edge_ids) {
-    const vi_map::Edge& original_edge = other.getEdgeAs<vi_map::Edge>(edge_id);
-    vi_map::Edge* copied_edge;
-    original_edge.copyEdgeInto(&copied_edge);
-    addEdge(vi_map::Edge::UniquePtr(copied_edge));
-  }
-
-  // Add landmarks into copy of map.
-  const LandmarkIndex& original_landmark_index = other.landmark_index;
-  vi_map::LandmarkIdList landmarks_ids;
-  original_landmark_index.getAllLandmarkIds(&landmarks_ids);
-  for (const vi_map::LandmarkId& landmark_id : landmarks_ids) {
-    CHECK(landmark_id.isValid());
-    const pose_graph::VertexId& original_landmark_store_vertex_id =
-        original_landmark_index.getStoringVertexId(landmark_id);
-    CHECK(hasVertex(original_landmark_store_vertex_id));
-    landmark_index.addLandmarkAndVertexReference(
-        landmark_id, original_landmark_store_vertex_id);
+          const size_t edge_begin =
+              shard_idx * source_edges.size() / num_shards;
+          const size_t edge_end =
+              (shard_idx + 1u) * source_edges.size() / num_shards;
+          std::vector<pose_graph::Edge::UniquePtr>& edge_shard =
+              edge_shards[shard_idx];
+          edge_shard.reserve(edge_end - edge_begin);
+          for (size_t idx = edge_begin; idx < edge_end; ++idx) {
+            const SourceEdge& source_edge = source_edges[idx];
+            const vi_map::Edge& original_edge =
+                source_edge.first->getEdgeAs<vi_map::Edge>(
+                    source_edge.second);
+            vi_map::Edge* copied_edge;
+            original_edge.copyEdgeInto(&copied_edge);
+            edge_shard.emplace_back(CHECK_NOTNULL(copied_edge));
+          }
+        }
+      },
+      true /*always_parallelize*/, num_shards);
+
+  // The copied vertices already reference their edges, so the shards can be
+  // inserted in bulk.
+  posegraph.reserve(
+      posegraph.numVertices() + source_vertices.size(),
+      posegraph.numEdges() + source_edges.size());
+  for (size_t shard_idx = 0u; shard_idx < num_shards; ++shard_idx) {
+    posegraph.addVerticesAndEdges(
+        &vertex_shards[shard_idx], &edge_shards[shard_idx]);
+  }
+
+  for (const VIMap* source_map : source_maps) {
+    merge_statistics.num_landmarks += source_map->landmark_index.numLandmarks();
+    landmark_index.addLandmarkAndVertexReferences(source_map->landmark_index);
+  }
+
+  merge_statistics.num_vertices = source_vertices.size();
+  merge_statistics.num_edges = source_edges.size();
+  merge_statistics.duration_seconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start_time)
+          .count();
+  VLOG(1) << "Merged " << merge_statistics.num_missions << " missions with "
+          << merge_statistics.num_vertices << " vertices, "
+          << merge_statistics.num_edges << " edges and "
+          << merge_statistics.num_landmarks << " landmarks in "
+          << merge_statistics.duration_seconds << " s ("
+          << merge_statistics.getVerticesPerSecond() << " vertices/s).";
+  if (statistics != nullptr) {
+    *statistics = merge_statistics;
+  }
+}
+
+size_t VIMap::copyMissionsFromMap(const vi_map::VIMap& source_map) {
+  vi_map::MissionIdList other_mission_ids;
+  source_map.getAllMissionIds(&other_mission_ids);
+  for (const vi_map::MissionId& other_mission_id : other_mission_ids) {
+    CHECK(other_mission_id.isValid());
+    const vi_map::VIMission& other_mission =
+        source_map.getMission(other_mission_id);
+    vi_map::VIMission::UniquePtr copied_mission =
+        aligned_unique<VIMission>(other_mission);
+    copied_mission->setRootVertexId(other_mission.getRootVertexId());
+    addMissionFromMap(std::move(copied_mission), source_map);
   }
 
   for (const OptionalSensorDataMap::value_type& other_optional_sensor_data :
-      other.optional_sensor_data_map_) {
+       source_map.optional_sensor_data_map_) {
     const MissionId& mission_id = other_optional_sensor_data.first;
     CHECK(hasMission(mission_id));
     CHECK(optional_sensor_data_map_.emplace(
@@ -109,6 +212,22 @@ void VIMap::mergeAllMissionsFromMapWithoutResources(
         std::forward_as_tuple(mission_id),
         std::forward_as_tuple(other_optional_sensor_data.second)).second);
   }
+  return other_mission_ids.size();
+}
+
+void VIMap::addMissionFromMap(
+    vi_map::VIMission::UniquePtr mission, const vi_map::VIMap& source_map) {
+  CHECK(mission);
+  const vi_map::MissionId mission_id = mission->id();
+  CHECK(mission_id.isValid());
+  // Not going through the mission of the source map, which may have been moved
+  // out already.
+  const vi_map::MissionBaseFrame& mission_base_frame =
+      common::getChecked(source_map.mission_base_frames,
+                         mission->getBaseFrameId());
+  addNewMissionWithBaseframe(std::move(mission), mission_base_frame);
+  sensor_manager_.merge(source_map.getSensorManager(), mission_id);
+  invalidateMissionVertexCache(mission_id);
 }
 
 void VIMap::mergeAllMissionsFromMap(const vi_map::VIMap& other) {
@@ -119,6 +238,81 @@ void VIMap::mergeAllMissionsFromMap(const vi_map::VIMap& other) {
   ResourceMap::mergeFromMap(other);
 }
 
+void VIMap::mergeAllMissionsFromMaps(
+    const std::vector<const vi_map::VIMap*>& other_maps,
+    MapMergeStatistics* statistics) {
+  VLOG(1) << "Merging from " << other_maps.size() << " VI-Maps.";
+  mergeAllMissionsFromMapsWithoutResources(other_maps, statistics);
+
+  VLOG(1) << "Copying metadata and resource infos.";
+  for (const VIMap* other : other_maps) {
+    ResourceMap::mergeFromMap(*CHECK_NOTNULL(other));
+  }
+}
+
+void VIMap::moveAllMissionsFromMap(
+    vi_map::VIMap* other, MapMergeStatistics* statistics) {
+  CHECK_NOTNULL(other);
+  CHECK_NE(this, other);
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  markAllModified();
+  other->markAllModified();
+
+  MapMergeStatistics merge_statistics;
+  vi_map::MissionIdList other_mission_ids;
+  other->getAllMissionIds(&other_mission_ids);
+  for (const vi_map::MissionId& other_mission_id : other_mission_ids) {
+    CHECK(other_mission_id.isValid());
+    addMissionFromMap(
+        std::move(common::getChecked(other->missions, other_mission_id)),
+        *other);
+  }
+  for (OptionalSensorDataMap::value_type& other_optional_sensor_data :
+       other->optional_sensor_data_map_) {
+    const MissionId& mission_id = other_optional_sensor_data.first;
+    CHECK(hasMission(mission_id));
+    CHECK(optional_sensor_data_map_.emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(mission_id),
+        std::forward_as_tuple(
+            std::move(other_optional_sensor_data.second))).second);
+  }
+
+  merge_statistics.num_missions = other_mission_ids.size();
+  merge_statistics.num_vertices = other->numVertices();
+  merge_statistics.num_edges = other->numEdges();
+  merge_statistics.num_landmarks = other->landmark_index.numLandmarks();
+
+  posegraph.moveVerticesAndEdgesFrom(&other->posegraph);
+  landmark_index.addLandmarkAndVertexReferences(other->landmark_index);
+  ResourceMap::mergeFromMap(*other);
+
+  // Leave the other map without any mission.
+  for (const vi_map::MissionId& other_mission_id : other_mission_ids) {
+    other->sensor_manager_.removeAllSensorsAssociatedToMission(
+        other_mission_id);
+    other->selected_missions_.erase(other_mission_id);
+  }
+  other->missions.clear();
+  other->mission_base_frames.clear();
+  other->landmark_index.clear();
+  other->optional_sensor_data_map_.clear();
+  other->invalidateAllMissionVertexCaches();
+
+  merge_statistics.duration_seconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start_time)
+          .count();
+  VLOG(1) << "Moved " << merge_statistics.num_missions << " missions with "
+          << merge_statistics.num_vertices << " vertices in "
+          << merge_statistics.duration_seconds << " s ("
+          << merge_statistics.getVerticesPerSecond() << " vertices/s).";
+  if (statistics != nullptr) {
+    *statistics = merge_statistics;
+  }
+}
+
 void VIMap::swap(VIMap* other) {
   CHECK_NOTNULL(other);
   posegraph.swap(&other->posegraph);
@@ -126,6 +320,22 @@ void VIMap::swap(VIMap* other) {
   mission_base_frames.swap(other->mission_base_frames);
   landmark_index.swap(&other->landmark_index);
   optional_sensor_data_map_.swap(other->optional_sensor_data_map_);
+
+  {
+    // Lock in a fixed order to not deadlock with a swap in the other
+    // direction.
+    const bool is_this_first = std::less<const VIMap*>()(this, other);
+    aslam::ScopedWriteLock first_lock(
+        is_this_first ? &mission_vertex_caches_mutex_
+                      : &other->mission_vertex_caches_mutex_);
+    aslam::ScopedWriteLock second_lock(
+        is_this_first ? &other->mission_vertex_caches_mutex_
+                      : &mission_vertex_caches_mutex_);
+    mission_vertex_caches_.swap(other->mission_vertex_caches_);
+  }
+
+  markAllModified();
+  other->markAllModified();
 }
 
 bool VIMap::hexStringToMissionIdIfValid(
@@ -268,6 +478,7 @@ void VIMap::sparsifyMission(
   CHECK_GT(every_nth_vertex_to_keep, 0);
   CHECK(hasMission(mission_id)) << "The mission " << mission_id << " is not "
                                 << "present or selected.";
+  markMissionModified(mission_id);
 
   const vi_map::VIMission& mission = getMission(mission_id);
   const pose_graph::VertexId& root_vertex_id = mission.getRootVertexId();
@@ -780,6 +991,7 @@ void VIMap::addNewMissionWithBaseframe(
   const MissionBaseFrameId& mission_base_frame_id = mission_base_frame.id();
   CHECK(mission_base_frame_id.isValid());
   CHECK_EQ(mission->getBaseFrameId(), mission_base_frame_id);
+  markMissionModified(mission_id);
   missions.emplace(mission_id, std::move(mission));
   mission_base_frames.emplace(mission_base_frame_id, mission_base_frame);
 }
@@ -800,6 +1012,7 @@ void VIMap::addNewMissionWithBaseframe(
   VIMission* new_mission(new VIMission(
       mission_id, mission_baseframe_id, backbone_type));
 
+  markMissionModified(mission_id);
   missions.emplace(mission_id, VIMission::UniquePtr(new_mission));
 
   if (!selected_missions_.empty()) {
@@ -1002,6 +1215,7 @@ void VIMap::mergeNeighboringVertices(
        next_vertex_incoming_edge_ids) {
     if (getEdgeType(incoming_edge) != pose_graph::Edge::EdgeType::kViwls &&
         getEdgeType(incoming_edge) != pose_graph::Edge::EdgeType::kOdometry) {
+      markEdgeModified(incoming_edge);
       posegraph.removeEdge(incoming_edge);
     }
   }
@@ -1009,6 +1223,7 @@ void VIMap::mergeNeighboringVertices(
        next_vertex_outgoing_edge_ids) {
     if (getEdgeType(outgoing_edge) != pose_graph::Edge::EdgeType::kViwls &&
         getEdgeType(outgoing_edge) != pose_graph::Edge::EdgeType::kOdometry) {
+      markEdgeModified(outgoing_edge);
       posegraph.removeEdge(outgoing_edge);
     }
   }
@@ -1062,6 +1277,8 @@ void VIMap::mergeNeighboringVertices(
     }
   }
   // Remove the vertex.
+  invalidateMissionVertexCache(mission_id);
+  markMissionModified(mission_id);
   posegraph.removeVertex(vertex_to_merge);
 }
 
@@ -1129,6 +1346,7 @@ void VIMap::mergeLandmarks(
 
 void VIMap::duplicateMission(const vi_map::MissionId& source_mission_id) {
   CHECK(hasMission(source_mission_id));
+  markAllModified();
 
   const vi_map::VIMission& source_mission = getMission(source_mission_id);
   const vi_map::MissionBaseFrame& source_baseframe =
@@ -1649,6 +1867,10 @@ void VIMap::removeMissionObject(
   optional_sensor_data_map_.erase(mission_id);
   missions.erase(mission_id);
   selected_missions_.erase(mission_id);
+  markAllModified();
+
+  aslam::ScopedWriteLock lock(&mission_vertex_caches_mutex_);
+  mission_vertex_caches_.erase(mission_id);
 }
 
 void VIMap::moveLandmarkToOtherVertex(
@@ -1690,19 +1912,34 @@ void VIMap::moveLandmarkToOtherVertex(
   landmark_store_from.removeLandmark(landmark_id);
 }
 
+template <typename Function>
+void VIMap::accessMissionVertexCache(
+    const vi_map::MissionId& mission_id, const Function& function) const {
+  while (true) {
+    {
+      aslam::ScopedReadLock lock(&mission_vertex_caches_mutex_);
+      const MissionVertexCacheMap::iterator it =
+          mission_vertex_caches_.find(mission_id);
+      if (it != mission_vertex_caches_.end()) {
+        std::lock_guard<std::mutex> cache_lock(it->second.mutex);
+        function(&it->second);
+        return;
+      }
+    }
+    // Insert the cache of the mission, it is built on the next attempt.
+    aslam::ScopedWriteLock lock(&mission_vertex_caches_mutex_);
+    mission_vertex_caches_[mission_id];
+  }
+}
+
 unsigned int VIMap::getVertexCountInMission(
     const vi_map::MissionId& mission_id) const {
   CHECK(hasMission(mission_id));
 
-  const vi_map::VIMission& mission = getMission(mission_id);
-  pose_graph::VertexId current_vertex_id = mission.getRootVertexId();
-
-  unsigned int vertex_count = 0;
-  do {
-    ++vertex_count;
-  } while (getNextVertex(
-      current_vertex_id, getGraphTraversalEdgeType(mission_id),
-      &current_vertex_id));
+  unsigned int vertex_count = 0u;
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    vertex_count = getMissionVertexCacheLocked(mission_id, cache).size();
+  });
   return vertex_count;
 }
 
@@ -1730,21 +1967,362 @@ void VIMap::getAllVertexIdsInMissionAlongGraph(
     pose_graph::VertexIdList* vertices) const {
   CHECK_NOTNULL(vertices);
   CHECK(hasMission(mission_id));
-  vertices->clear();
 
-  const vi_map::VIMission& mission = getMission(mission_id);
-  pose_graph::VertexId current_vertex_id = mission.getRootVertexId();
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    *vertices = getMissionVertexCacheLocked(mission_id, cache);
+  });
+}
 
-  // Early exit if the root vertex hasn't been set yet.
-  if (!current_vertex_id.isValid()) {
+const pose_graph::VertexIdList& VIMap::getMissionVertexCacheLocked(
+    const vi_map::MissionId& mission_id, MissionVertexCache* cache) const {
+  CHECK_NOTNULL(cache);
+  const pose_graph::VertexId& root_vertex_id =
+      getMission(mission_id).getRootVertexId();
+  const pose_graph::Edge::EdgeType traversal_edge_type =
+      getGraphTraversalEdgeType(mission_id);
+  if (cache->is_valid && cache->root_vertex_id == root_vertex_id &&
+      cache->traversal_edge_type == traversal_edge_type) {
+    return cache->vertex_ids;
+  }
+
+  cache->is_valid = true;
+  cache->root_vertex_id = root_vertex_id;
+  cache->traversal_edge_type = traversal_edge_type;
+  cache->vertex_ids.clear();
+  cache->is_time_index_valid = false;
+  cache->frames_by_timestamp.clear();
+  // The cache stays empty if the root vertex hasn't been set yet.
+  if (root_vertex_id.isValid()) {
+    cache->vertex_ids.push_back(root_vertex_id);
+    extendMissionVertexCacheLocked(cache);
+  }
+  return cache->vertex_ids;
+}
+
+void VIMap::extendMissionVertexCacheLocked(MissionVertexCache* cache) const {
+  CHECK_NOTNULL(cache);
+  CHECK(!cache->vertex_ids.empty());
+  const size_t num_cached_vertices = cache->vertex_ids.size();
+  pose_graph::VertexId next_vertex_id;
+  while (getNextVertex(
+      cache->vertex_ids.back(), cache->traversal_edge_type,
+      &next_vertex_id)) {
+    cache->vertex_ids.push_back(next_vertex_id);
+  }
+  if (cache->is_time_index_valid) {
+    appendToMissionTimeIndexLocked(num_cached_vertices, cache);
+  }
+}
+
+const VIMap::TimestampedVisualFrameList& VIMap::getMissionTimeIndexLocked(
+    const vi_map::MissionId& mission_id, MissionVertexCache* cache) const {
+  CHECK_NOTNULL(cache);
+  getMissionVertexCacheLocked(mission_id, cache);
+  const uint64_t frames_generation = getFramesGeneration(mission_id);
+  if (!cache->is_time_index_valid ||
+      cache->time_index_generation != frames_generation) {
+    cache->frames_by_timestamp.clear();
+    cache->is_time_index_valid = true;
+    cache->time_index_generation = frames_generation;
+    appendToMissionTimeIndexLocked(0u, cache);
+  }
+  return cache->frames_by_timestamp;
+}
+
+uint64_t VIMap::getFramesGeneration(const vi_map::MissionId& mission_id) const {
+  FrameModificationShard& shard = getFrameModificationShard(mission_id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.are_frames_modified.exchange(false)) {
+    ++shard.generation;
+  }
+  return shard.generation;
+}
+
+void VIMap::appendToMissionTimeIndexLocked(
+    const size_t first_vertex_idx, MissionVertexCache* cache) const {
+  CHECK_NOTNULL(cache);
+  CHECK(cache->is_time_index_valid);
+  TimestampedVisualFrameList& frames_by_timestamp = cache->frames_by_timestamp;
+  const size_t num_indexed_frames = frames_by_timestamp.size();
+  for (size_t vertex_idx = first_vertex_idx;
+       vertex_idx < cache->vertex_ids.size(); ++vertex_idx) {
+    const pose_graph::VertexId& vertex_id = cache->vertex_ids[vertex_idx];
+    const vi_map::Vertex& vertex = getVertex(vertex_id);
+    const size_t num_frames = vertex.numFrames();
+    for (size_t frame_idx = 0u; frame_idx < num_frames; ++frame_idx) {
+      if (vertex.isVisualFrameSet(frame_idx)) {
+        frames_by_timestamp.emplace_back(
+            vertex.getVisualFrame(frame_idx).getTimestampNanoseconds(),
+            VisualFrameIdentifier(vertex_id, frame_idx));
+      }
+    }
+  }
+
+  // Frames of different cameras of the same vertex are not necessarily sorted,
+  // so sort only the new part and check that it continues the index.
+  const TimestampedVisualFrameList::iterator first_new_frame =
+      frames_by_timestamp.begin() + num_indexed_frames;
+  const auto is_earlier = [](
+      const TimestampedVisualFrame& lhs, const TimestampedVisualFrame& rhs) {
+    return lhs.timestamp_ns < rhs.timestamp_ns;
+  };
+  std::stable_sort(first_new_frame, frames_by_timestamp.end(), is_earlier);
+  if (num_indexed_frames > 0u && first_new_frame != frames_by_timestamp.end() &&
+      is_earlier(*first_new_frame, *(first_new_frame - 1))) {
+    cache->is_time_index_valid = false;
+  }
+}
+
+bool VIMap::findClosestFrameInTimeIndex(
+    const TimestampedVisualFrameList& frames_by_timestamp,
+    const int64_t timestamp_ns, VisualFrameIdentifier* frame_id,
+    int64_t* timestamp_difference_ns) {
+  CHECK_NOTNULL(frame_id);
+  if (frames_by_timestamp.empty()) {
+    return false;
+  }
+
+  // First frame that is not earlier than the timestamp; the closest frame is
+  // either this one or the one before.
+  TimestampedVisualFrameList::const_iterator it = std::lower_bound(
+      frames_by_timestamp.begin(), frames_by_timestamp.end(), timestamp_ns,
+      [](const TimestampedVisualFrame& frame, const int64_t query_ns) {
+        return frame.timestamp_ns < query_ns;
+      });
+  if (it == frames_by_timestamp.end() ||
+      (it != frames_by_timestamp.begin() &&
+       timestamp_ns - (it - 1)->timestamp_ns <=
+           it->timestamp_ns - timestamp_ns)) {
+    --it;
+  }
+  *frame_id = it->frame_id;
+  if (timestamp_difference_ns != nullptr) {
+    *timestamp_difference_ns = std::abs(it->timestamp_ns - timestamp_ns);
+  }
+  return true;
+}
+
+bool VIMap::getClosestVisualFrameByTimestamp(
+    const vi_map::MissionId& mission_id, const int64_t timestamp_ns,
+    VisualFrameIdentifier* frame_id, int64_t* timestamp_difference_ns) const {
+  CHECK_NOTNULL(frame_id);
+  CHECK(hasMission(mission_id));
+
+  bool found = false;
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    found = findClosestFrameInTimeIndex(
+        getMissionTimeIndexLocked(mission_id, cache), timestamp_ns, frame_id,
+        timestamp_difference_ns);
+  });
+  return found;
+}
+
+void VIMap::getClosestVisualFramesByTimestamps(
+    const vi_map::MissionId& mission_id,
+    const std::vector<int64_t>& timestamps_ns,
+    VisualFrameIdentifierList* frame_ids,
+    std::vector<int64_t>* timestamp_differences_ns) const {
+  CHECK_NOTNULL(frame_ids)->clear();
+  CHECK(hasMission(mission_id));
+
+  frame_ids->resize(timestamps_ns.size());
+  if (timestamp_differences_ns != nullptr) {
+    timestamp_differences_ns->assign(
+        timestamps_ns.size(), std::numeric_limits<int64_t>::max());
+  }
+
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    const TimestampedVisualFrameList& frames_by_timestamp =
+        getMissionTimeIndexLocked(mission_id, cache);
+    for (size_t query_idx = 0u; query_idx < timestamps_ns.size();
+         ++query_idx) {
+      findClosestFrameInTimeIndex(
+          frames_by_timestamp, timestamps_ns[query_idx],
+          &(*frame_ids)[query_idx],
+          timestamp_differences_ns == nullptr
+              ? nullptr
+              : &(*timestamp_differences_ns)[query_idx]);
+    }
+  });
+}
+
+void VIMap::getVisualFramesInTimeRange(
+    const vi_map::MissionId& mission_id, const int64_t min_timestamp_ns,
+    const int64_t max_timestamp_ns,
+    VisualFrameIdentifierList* frame_ids) const {
+  CHECK_NOTNULL(frame_ids)->clear();
+  CHECK(hasMission(mission_id));
+  CHECK_LE(min_timestamp_ns, max_timestamp_ns);
+
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    const TimestampedVisualFrameList& frames_by_timestamp =
+        getMissionTimeIndexLocked(mission_id, cache);
+    TimestampedVisualFrameList::const_iterator it = std::lower_bound(
+        frames_by_timestamp.begin(), frames_by_timestamp.end(),
+        min_timestamp_ns,
+        [](const TimestampedVisualFrame& frame, const int64_t query_ns) {
+          return frame.timestamp_ns < query_ns;
+        });
+    while (it != frames_by_timestamp.end() &&
+           it->timestamp_ns <= max_timestamp_ns) {
+      frame_ids->push_back(it->frame_id);
+      ++it;
+    }
+  });
+}
+
+void VIMap::updateMissionVertexCacheForNewEdge(const pose_graph::Edge& edge) {
+  const vi_map::MissionId& mission_id = getVertex(edge.from()).getMissionId();
+  const pose_graph::Edge::EdgeType traversal_edge_type =
+      getGraphTraversalEdgeType(mission_id);
+  if (edge.getType() != traversal_edge_type) {
+    // Only edges of the traversal type can change the order of the vertices.
     return;
   }
 
-  do {
-    vertices->push_back(current_vertex_id);
-  } while (getNextVertex(
-      current_vertex_id, getGraphTraversalEdgeType(mission_id),
-      &current_vertex_id));
+  aslam::ScopedWriteLock lock(&mission_vertex_caches_mutex_);
+  MissionVertexCacheMap::iterator it = mission_vertex_caches_.find(mission_id);
+  if (it == mission_vertex_caches_.end() || !it->second.is_valid) {
+    return;
+  }
+  MissionVertexCache& cache = it->second;
+
+  // Patch the cache if the new edge extends the mission at its end, which is
+  // the common case while building a map. Otherwise rebuild it lazily.
+  pose_graph::VertexId next_vertex_id;
+  if (cache.traversal_edge_type == traversal_edge_type &&
+      !cache.vertex_ids.empty() && cache.vertex_ids.back() == edge.from() &&
+      getNextVertex(edge.from(), traversal_edge_type, &next_vertex_id) &&
+      next_vertex_id == edge.to()) {
+    extendMissionVertexCacheLocked(&cache);
+  } else {
+    cache.is_valid = false;
+  }
+}
+
+void VIMap::invalidateMissionVertexCache(const vi_map::MissionId& mission_id) {
+  aslam::ScopedWriteLock lock(&mission_vertex_caches_mutex_);
+  MissionVertexCacheMap::iterator it = mission_vertex_caches_.find(mission_id);
+  if (it != mission_vertex_caches_.end()) {
+    it->second.is_valid = false;
+  }
+}
+
+void VIMap::invalidateAllMissionVertexCaches() {
+  aslam::ScopedWriteLock lock(&mission_vertex_caches_mutex_);
+  mission_vertex_caches_.clear();
+}
+
+void VIMap::enableModificationTracking() const {
+  std::lock_guard<std::mutex> lock(modified_entities_mutex_);
+  if (!is_modification_tracking_enabled_) {
+    // Nothing is known about the modifications up to now.
+    markAllModifiedLocked();
+    is_modification_tracking_enabled_ = true;
+  }
+}
+
+void VIMap::disableModificationTracking() const {
+  std::lock_guard<std::mutex> lock(modified_entities_mutex_);
+  is_modification_tracking_enabled_ = false;
+  for (ModifiedEntitiesShard& shard : modified_entities_shards_) {
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.clear();
+  }
+  are_all_entities_modified_ = false;
+}
+
+bool VIMap::isModificationTrackingEnabled() const {
+  return is_modification_tracking_enabled_;
+}
+
+void VIMap::takeModifiedEntities(ModifiedEntities* modified_entities) const {
+  CHECK_NOTNULL(modified_entities)->clear();
+  std::lock_guard<std::mutex> lock(modified_entities_mutex_);
+  if (!is_modification_tracking_enabled_) {
+    modified_entities->all = true;
+    return;
+  }
+  // Reset the flag before collecting the shards, such that no modification
+  // after this point is skipped.
+  modified_entities->all = are_all_entities_modified_.exchange(false);
+  for (ModifiedEntitiesShard& shard : modified_entities_shards_) {
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    if (!modified_entities->all) {
+      modified_entities->merge(shard.entities);
+    }
+    shard.entities.clear();
+  }
+}
+
+void VIMap::addModifiedEntities(
+    const ModifiedEntities& modified_entities) const {
+  std::lock_guard<std::mutex> lock(modified_entities_mutex_);
+  if (!is_modification_tracking_enabled_ || are_all_entities_modified_) {
+    return;
+  }
+  if (modified_entities.all) {
+    markAllModifiedLocked();
+    return;
+  }
+  for (const pose_graph::VertexId& vertex_id : modified_entities.vertex_ids) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(vertex_id);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.vertex_ids.insert(vertex_id);
+  }
+  for (const pose_graph::EdgeId& edge_id : modified_entities.edge_ids) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(edge_id);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.edge_ids.insert(edge_id);
+  }
+  for (const vi_map::MissionId& mission_id : modified_entities.mission_ids) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(mission_id);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.mission_ids.insert(mission_id);
+  }
+  for (const vi_map::LandmarkId& landmark_id :
+       modified_entities.landmark_ids) {
+    ModifiedEntitiesShard& shard = getModifiedEntitiesShard(landmark_id);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.landmark_ids.insert(landmark_id);
+  }
+}
+
+void VIMap::recordObservedLandmarks(
+    const pose_graph::VertexId& vertex_id,
+    vi_map::LandmarkIdSet* landmark_ids) const {
+  CHECK_NOTNULL(landmark_ids);
+  if (!posegraph.vertexExists(vertex_id)) {
+    return;
+  }
+  const vi_map::Vertex& vertex =
+      posegraph.getVertex(vertex_id).getAs<vi_map::Vertex>();
+  for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+       ++frame_idx) {
+    for (const vi_map::LandmarkId& landmark_id :
+         vertex.getFrameObservedLandmarkIds(frame_idx)) {
+      if (landmark_id.isValid()) {
+        landmark_ids->insert(landmark_id);
+      }
+    }
+  }
+}
+
+void VIMap::markAllModified() const {
+  if (is_modification_tracking_enabled_.load(std::memory_order_relaxed) &&
+      !are_all_entities_modified_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(modified_entities_mutex_);
+    markAllModifiedLocked();
+  }
+}
+
+void VIMap::markAllModifiedLocked() const {
+  are_all_entities_modified_ = true;
+  // The single entities are implied.
+  for (ModifiedEntitiesShard& shard : modified_entities_shards_) {
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.entities.clear();
+  }
 }
 
 void VIMap::getAllVertexIdsAlongGraphsSortedByTimestamp(
@@ -1837,16 +2415,23 @@ void VIMap::getAllLandmarkIdsInMission(
   CHECK_NOTNULL(landmarks)->clear();
   CHECK(hasMission(mission_id));
 
-  pose_graph::VertexIdList mission_vertex_ids;
-  getAllVertexIdsInMission(mission_id, &mission_vertex_ids);
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    const pose_graph::VertexIdList& mission_vertex_ids =
+        getMissionVertexCacheLocked(mission_id, cache);
 
-  for (const pose_graph::VertexId& vertex_id : mission_vertex_ids) {
-    LandmarkIdList vertex_landmarks;
-    const LandmarkStore& store = getVertex(vertex_id).getLandmarks();
-    for (const Landmark& landmark : store) {
-      landmarks->push_back(landmark.id());
+    size_t num_landmarks = 0u;
+    for (const pose_graph::VertexId& vertex_id : mission_vertex_ids) {
+      num_landmarks += getVertex(vertex_id).getLandmarks().size();
     }
-  }
+    landmarks->reserve(num_landmarks);
+
+    for (const pose_graph::VertexId& vertex_id : mission_vertex_ids) {
+      const LandmarkStore& store = getVertex(vertex_id).getLandmarks();
+      for (const Landmark& landmark : store) {
+        landmarks->push_back(landmark.id());
+      }
+    }
+  });
 }
 
 void VIMap::getOutgoingOfType(
@@ -1915,11 +2500,16 @@ void VIMap::getRandomVertexIdInMission(
 pose_graph::VertexId VIMap::getLastVertexIdOfMission(
     const vi_map::MissionId& mission_id) const {
   CHECK(mission_id.isValid());
+  CHECK(hasMission(mission_id));
 
-  pose_graph::VertexIdList vertices;
-  getAllVertexIdsInMissionAlongGraph(mission_id, &vertices);
-  CHECK(!vertices.empty());
-  return vertices.back();
+  pose_graph::VertexId last_vertex_id;
+  accessMissionVertexCache(mission_id, [&](MissionVertexCache* cache) {
+    const pose_graph::VertexIdList& vertices =
+        getMissionVertexCacheLocked(mission_id, cache);
+    CHECK(!vertices.empty());
+    last_vertex_id = vertices.back();
+  });
+  return last_vertex_id;
 }
 
 void VIMap::setRandIntGeneratorSeed(int seed) {
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <thread>
 #include <vector>
 
 #include <Eigen/Core>
@@ -444,6 +445,145 @@ TEST_F(MapConsistencyCheckTest, MapConsistencyLoopClosureEdges) {
   EXPECT_TRUE(vi_map::checkMapConsistency(map_));
 }
 
+TEST_F(MapConsistencyCheckTest, IncrementalCheckFallsBackToFullCheck) {
+  // Modifications are only tracked on request.
+  MapConsistencyCheckStatistics statistics;
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_FALSE(statistics.is_incremental);
+  EXPECT_FALSE(map_.isModificationTrackingEnabled());
+
+  // Everything before enabling the tracking is unknown.
+  map_.enableModificationTracking();
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_FALSE(statistics.is_incremental);
+
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_TRUE(statistics.is_incremental);
+  for (const MapConsistencyCheckStatistics::Check& check :
+       statistics.checks) {
+    if (check.name != "missions" && check.name != "sensors") {
+      EXPECT_EQ(check.num_items, 0u) << check.name;
+    }
+  }
+
+  map_.disableModificationTracking();
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_FALSE(statistics.is_incremental);
+}
+
+TEST_F(MapConsistencyCheckTest, ModificationTrackingOfConcurrentAccesses) {
+  map_.enableModificationTracking();
+  ASSERT_TRUE(vi_map::checkMapConsistency(map_));
+
+  std::vector<std::thread> threads;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_mission_1_) {
+    threads.emplace_back([this, vertex_id]() { map_.getVertex(vertex_id); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  VIMap::ModifiedEntities modified_entities;
+  map_.takeModifiedEntities(&modified_entities);
+  EXPECT_FALSE(modified_entities.all);
+  EXPECT_EQ(
+      modified_entities.vertex_ids,
+      pose_graph::VertexIdSet(
+          vertex_ids_mission_1_.begin(), vertex_ids_mission_1_.end()));
+  // The landmarks observed by the vertices are recorded as well.
+  EXPECT_FALSE(modified_entities.landmark_ids.empty());
+
+  map_.takeModifiedEntities(&modified_entities);
+  EXPECT_TRUE(modified_entities.empty());
+}
+
+TEST_F(MapConsistencyCheckTest, IncrementalCheckMissingBackLink) {
+  map_.enableModificationTracking();
+  ASSERT_TRUE(vi_map::checkMapConsistency(map_));
+
+  vi_map::Vertex& vertex0 = map_.getVertex(vertex_ids_mission_1_[2]);
+  vi_map::LandmarkId landmark_id;
+  generateId(&landmark_id);
+  vi_map::Landmark landmark;
+  landmark.setId(landmark_id);
+  vertex0.getLandmarks().addLandmark(landmark);
+  addLandmarkAndVertexReference(landmark_id, vertex_ids_mission_1_[2]);
+  const unsigned int keypoint_index =
+      vertex0.numValidObservedLandmarkIds(kVisualFrameIndex);
+  vertex0.setObservedLandmarkId(kVisualFrameIndex, keypoint_index, landmark_id);
+
+  MapConsistencyCheckStatistics statistics;
+  EXPECT_FALSE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_TRUE(statistics.is_incremental);
+  for (const MapConsistencyCheckStatistics::Check& check :
+       statistics.checks) {
+    if (check.name == "vertices and landmark references") {
+      EXPECT_EQ(check.num_items, 1u);
+    }
+  }
+
+  // The modified vertex stays marked until the map is consistent again.
+  EXPECT_FALSE(vi_map::checkMapConsistencyIncremental(map_));
+  vi_map::LandmarkId invalid_landmark_id;
+  invalid_landmark_id.setInvalid();
+  map_.getVertex(vertex_ids_mission_1_[2])
+      .setObservedLandmarkId(
+          kVisualFrameIndex, keypoint_index, invalid_landmark_id);
+  map_.removeLandmark(landmark_id);
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_));
+}
+
+TEST_F(MapConsistencyCheckTest, IncrementalCheckDroppedObservation) {
+  map_.enableModificationTracking();
+  ASSERT_TRUE(vi_map::checkMapConsistency(map_));
+
+  // The first vertex observes the landmarks stored in the second one. Drop
+  // one of the observations without removing the backlink of the landmark.
+  const pose_graph::VertexId& vertex_id = vertex_ids_mission_1_[0];
+  vi_map::Vertex& vertex = map_.getVertex(vertex_id);
+  ASSERT_EQ(vertex.getLandmarks().size(), 0u);
+  ASSERT_EQ(vertex.numValidObservedLandmarkIds(kVisualFrameIndex), 5u);
+  constexpr unsigned int kKeypointIndex = 0u;
+  const vi_map::LandmarkId landmark_id =
+      vertex.getObservedLandmarkId(kVisualFrameIndex, kKeypointIndex);
+  ASSERT_TRUE(landmark_id.isValid());
+  vi_map::LandmarkId invalid_landmark_id;
+  invalid_landmark_id.setInvalid();
+  vertex.setObservedLandmarkId(
+      kVisualFrameIndex, kKeypointIndex, invalid_landmark_id);
+
+  MapConsistencyCheckStatistics statistics;
+  EXPECT_FALSE(vi_map::checkMapConsistencyIncremental(map_, &statistics));
+  EXPECT_TRUE(statistics.is_incremental);
+  bool has_referenced_landmarks_check = false;
+  for (const MapConsistencyCheckStatistics::Check& check :
+       statistics.checks) {
+    if (check.name == "referenced landmarks") {
+      has_referenced_landmarks_check = true;
+      EXPECT_EQ(check.num_items, 5u);
+    }
+  }
+  EXPECT_TRUE(has_referenced_landmarks_check);
+
+  map_.getVertex(vertex_id).setObservedLandmarkId(
+      kVisualFrameIndex, kKeypointIndex, landmark_id);
+  EXPECT_TRUE(vi_map::checkMapConsistencyIncremental(map_));
+}
+
+TEST_F(MapConsistencyCheckTest, IncrementalCheckPosegraphInvalidEdge) {
+  map_.enableModificationTracking();
+  ASSERT_TRUE(vi_map::checkMapConsistency(map_));
+  addInvalidEdge();
+  EXPECT_FALSE(vi_map::checkMapConsistencyIncremental(map_));
+}
+
+TEST_F(MapConsistencyCheckTest, IncrementalCheckPosegraphOrphanedVertex) {
+  map_.enableModificationTracking();
+  ASSERT_TRUE(vi_map::checkMapConsistency(map_));
+  addOrphanedVertex();
+  EXPECT_FALSE(vi_map::checkMapConsistencyIncremental(map_));
+}
+
 }  // namespace vi_map
 
 MAPLAB_UNITTEST_ENTRYPOINT
@@ -1,8 +1,10 @@
 #include <Eigen/Core>
+#include <aslam/common/memory.h>
 #include <gtest/gtest.h>
 #include <maplab-common/test/testing-entrypoint.h>
 
 #include "vi-map/test/vi-map-generator.h"
+#include "vi-map/transformation-edge.h"
 
 namespace vi_map {
 
@@ -27,6 +29,16 @@ class VIMapTest : public ::testing::Test {
     generator_.generateMap();
   }
 
+  pose_graph::EdgeId getOutgoingTraversalEdgeId(
+      const pose_graph::VertexId& vertex_id) const {
+    pose_graph::EdgeIdList edge_ids;
+    map_.getOutgoingOfType(
+        map_.getGraphTraversalEdgeType(map_.getMissionIdForVertex(vertex_id)),
+        vertex_id, &edge_ids);
+    CHECK_EQ(edge_ids.size(), 1u);
+    return edge_ids.front();
+  }
+
   vi_map::MissionId missions_[2];
   pose_graph::VertexId vertices_[6];
 
@@ -58,6 +70,79 @@ TEST_F(VIMapTest, TestGetAllVertexIdsInMissionAlongGraph) {
   }
 }
 
+TEST_F(VIMapTest, TestCachedVertexIdsFollowEdgeChanges) {
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[0], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 3u);
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[0]), 3u);
+
+  // Cutting the traversal at the last edge shortens the mission.
+  const pose_graph::EdgeId last_edge_id =
+      getOutgoingTraversalEdgeId(vertices_[1]);
+  const TransformationEdge last_edge =
+      map_.getEdgeAs<TransformationEdge>(last_edge_id);
+  map_.removeEdge(last_edge_id);
+
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[0], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 2u);
+  EXPECT_EQ(vertex_ids[0], vertices_[0]);
+  EXPECT_EQ(vertex_ids[1], vertices_[1]);
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[0]), 2u);
+  EXPECT_EQ(map_.getLastVertexIdOfMission(missions_[0]), vertices_[1]);
+
+  // Appending the edge again extends the mission at its end.
+  map_.addEdge(aligned_unique<TransformationEdge>(last_edge));
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[0], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 3u);
+  for (size_t i = 0u; i < vertex_ids.size(); ++i) {
+    EXPECT_EQ(vertex_ids[i], vertices_[i]);
+  }
+  EXPECT_EQ(map_.getLastVertexIdOfMission(missions_[0]), vertices_[2]);
+
+  // The other mission is not affected.
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[1], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 3u);
+  for (size_t i = 0u; i < vertex_ids.size(); ++i) {
+    EXPECT_EQ(vertex_ids[i], vertices_[i + 3u]);
+  }
+}
+
+TEST_F(VIMapTest, TestCachedVertexIdsFollowVertexMerging) {
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[1]), 3u);
+
+  map_.mergeNeighboringVertices(vertices_[3], vertices_[4]);
+
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[1], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 2u);
+  EXPECT_EQ(vertex_ids[0], vertices_[3]);
+  EXPECT_EQ(vertex_ids[1], vertices_[5]);
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[1]), 2u);
+}
+
+TEST_F(VIMapTest, TestCachedVertexIdsFollowBackboneType) {
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[0]), 3u);
+  const Mission::BackBone original_backbone_type =
+      map_.getMission(missions_[0]).backboneType();
+
+  // There are no edges of the other backbone type, hence only the root
+  // vertex can be reached.
+  map_.getMission(missions_[0])
+      .setBackboneType(
+          original_backbone_type == Mission::BackBone::kViwls
+              ? Mission::BackBone::kOdometry
+              : Mission::BackBone::kViwls);
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIdsInMissionAlongGraph(missions_[0], &vertex_ids);
+  ASSERT_EQ(vertex_ids.size(), 1u);
+  EXPECT_EQ(vertex_ids[0], vertices_[0]);
+  EXPECT_EQ(map_.getLastVertexIdOfMission(missions_[0]), vertices_[0]);
+
+  map_.getMission(missions_[0]).setBackboneType(original_backbone_type);
+  EXPECT_EQ(map_.getVertexCountInMission(missions_[0]), 3u);
+  EXPECT_EQ(map_.getLastVertexIdOfMission(missions_[0]), vertices_[2]);
+}
+
 }  // namespace vi_map
 
 MAPLAB_UNITTEST_ENTRYPOINT
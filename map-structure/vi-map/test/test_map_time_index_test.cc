@@ -0,0 +1,184 @@
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/memory.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "vi-map/test/vi-map-generator.h"
+#include "vi-map/transformation-edge.h"
+
+namespace vi_map {
+
+class VIMapTimeIndexTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kNumVerticesPerMission = 10u;
+  static constexpr int64_t kVertexSpacingNs = 100;
+  static constexpr int64_t kSecondMissionOffsetNs = 5000;
+
+  VIMapTimeIndexTest() : map_(), generator_(map_, 42) {}
+
+  virtual void SetUp() {
+    const pose::Transformation T_G_M;
+    const pose::Transformation T_G_I;
+    for (size_t mission_idx = 0u; mission_idx < 2u; ++mission_idx) {
+      missions_[mission_idx] = generator_.createMission(T_G_M);
+      for (size_t vertex_idx = 0u; vertex_idx < kNumVerticesPerMission;
+           ++vertex_idx) {
+        const int64_t timestamp_ns = mission_idx * kSecondMissionOffsetNs +
+                                     vertex_idx * kVertexSpacingNs;
+        vertices_[mission_idx].push_back(generator_.createVertex(
+            missions_[mission_idx], T_G_I, timestamp_ns));
+      }
+    }
+    generator_.generateMap();
+  }
+
+  VisualFrameIdentifier getClosestFrame(
+      const size_t mission_idx, const int64_t timestamp_ns,
+      int64_t* timestamp_difference_ns) const {
+    VisualFrameIdentifier frame_id;
+    EXPECT_TRUE(map_.getClosestVisualFrameByTimestamp(
+        missions_[mission_idx], timestamp_ns, &frame_id,
+        timestamp_difference_ns));
+    return frame_id;
+  }
+
+  vi_map::MissionId missions_[2];
+  pose_graph::VertexIdList vertices_[2];
+
+  VIMap map_;
+  VIMapGenerator generator_;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+TEST_F(VIMapTimeIndexTest, TestClosestFrameByTimestamp) {
+  int64_t difference_ns;
+  EXPECT_EQ(
+      getClosestFrame(0u, 149, &difference_ns).vertex_id, vertices_[0][1]);
+  EXPECT_EQ(difference_ns, 49);
+  // Ties are resolved in favor of the earlier frame.
+  EXPECT_EQ(
+      getClosestFrame(0u, 150, &difference_ns).vertex_id, vertices_[0][1]);
+  EXPECT_EQ(difference_ns, 50);
+  EXPECT_EQ(
+      getClosestFrame(0u, 151, &difference_ns).vertex_id, vertices_[0][2]);
+  EXPECT_EQ(difference_ns, 49);
+  EXPECT_EQ(
+      getClosestFrame(0u, 300, &difference_ns).vertex_id, vertices_[0][3]);
+  EXPECT_EQ(difference_ns, 0);
+
+  // Before the first and after the last frame.
+  EXPECT_EQ(
+      getClosestFrame(0u, -50, &difference_ns).vertex_id, vertices_[0][0]);
+  EXPECT_EQ(difference_ns, 50);
+  EXPECT_EQ(
+      getClosestFrame(0u, 1000000, nullptr).vertex_id, vertices_[0].back());
+
+  // The index is per mission.
+  EXPECT_EQ(
+      getClosestFrame(1u, kSecondMissionOffsetNs + 210, &difference_ns)
+          .vertex_id,
+      vertices_[1][2]);
+  EXPECT_EQ(difference_ns, 10);
+}
+
+TEST_F(VIMapTimeIndexTest, TestBatchLookupMatchesSingleLookups) {
+  std::vector<int64_t> timestamps_ns;
+  for (int64_t timestamp_ns = -100; timestamp_ns < 1200; timestamp_ns += 7) {
+    timestamps_ns.push_back(timestamp_ns);
+  }
+
+  VisualFrameIdentifierList frame_ids;
+  std::vector<int64_t> differences_ns;
+  map_.getClosestVisualFramesByTimestamps(
+      missions_[0], timestamps_ns, &frame_ids, &differences_ns);
+  ASSERT_EQ(frame_ids.size(), timestamps_ns.size());
+  ASSERT_EQ(differences_ns.size(), timestamps_ns.size());
+
+  for (size_t i = 0u; i < timestamps_ns.size(); ++i) {
+    int64_t difference_ns;
+    EXPECT_EQ(
+        frame_ids[i], getClosestFrame(0u, timestamps_ns[i], &difference_ns));
+    EXPECT_EQ(differences_ns[i], difference_ns);
+  }
+}
+
+TEST_F(VIMapTimeIndexTest, TestFramesInTimeRange) {
+  VisualFrameIdentifierList frame_ids;
+  map_.getVisualFramesInTimeRange(missions_[0], 100, 300, &frame_ids);
+  ASSERT_EQ(frame_ids.size(), 3u);
+  for (size_t i = 0u; i < frame_ids.size(); ++i) {
+    EXPECT_EQ(frame_ids[i].vertex_id, vertices_[0][i + 1u]);
+  }
+
+  map_.getVisualFramesInTimeRange(missions_[0], 101, 199, &frame_ids);
+  EXPECT_TRUE(frame_ids.empty());
+
+  map_.getVisualFramesInTimeRange(
+      missions_[1], 0, kSecondMissionOffsetNs, &frame_ids);
+  ASSERT_EQ(frame_ids.size(), 1u);
+  EXPECT_EQ(frame_ids[0].vertex_id, vertices_[1][0]);
+}
+
+TEST_F(VIMapTimeIndexTest, TestIndexFollowsGraphChanges) {
+  const int64_t last_timestamp_ns =
+      (kNumVerticesPerMission - 1u) * kVertexSpacingNs;
+  const pose_graph::VertexId& second_to_last_vertex_id =
+      vertices_[0][kNumVerticesPerMission - 2u];
+  EXPECT_EQ(
+      getClosestFrame(0u, last_timestamp_ns, nullptr).vertex_id,
+      vertices_[0].back());
+
+  // Detach the last vertex from the mission.
+  pose_graph::EdgeIdList edge_ids;
+  map_.getOutgoingOfType(
+      map_.getGraphTraversalEdgeType(missions_[0]), second_to_last_vertex_id,
+      &edge_ids);
+  ASSERT_EQ(edge_ids.size(), 1u);
+  const TransformationEdge last_edge =
+      map_.getEdgeAs<TransformationEdge>(edge_ids[0]);
+  map_.removeEdge(edge_ids[0]);
+  EXPECT_EQ(
+      getClosestFrame(0u, last_timestamp_ns, nullptr).vertex_id,
+      second_to_last_vertex_id);
+
+  // Attaching it again extends the index.
+  map_.addEdge(aligned_unique<TransformationEdge>(last_edge));
+  EXPECT_EQ(
+      getClosestFrame(0u, last_timestamp_ns, nullptr).vertex_id,
+      vertices_[0].back());
+}
+
+TEST_F(VIMapTimeIndexTest, TestIndexFollowsFrameTimestampChanges) {
+  const int64_t new_timestamp_ns = 10000;
+  EXPECT_EQ(
+      getClosestFrame(0u, new_timestamp_ns, nullptr).vertex_id,
+      vertices_[0].back());
+
+  // Move the first frame of the mission past all other frames.
+  map_.getVertex(vertices_[0][0])
+      .getVisualFrame(0u)
+      .setTimestampNanoseconds(new_timestamp_ns);
+  int64_t difference_ns;
+  EXPECT_EQ(
+      getClosestFrame(0u, new_timestamp_ns, &difference_ns).vertex_id,
+      vertices_[0][0]);
+  EXPECT_EQ(difference_ns, 0);
+  EXPECT_EQ(getClosestFrame(0u, 0, nullptr).vertex_id, vertices_[0][1]);
+
+  // The same through the vertex pointer.
+  map_.getVertexPtr(vertices_[0][1])
+      ->getVisualFrame(0u)
+      .setTimestampNanoseconds(new_timestamp_ns + 1);
+  EXPECT_EQ(
+      getClosestFrame(0u, new_timestamp_ns + 1, nullptr).vertex_id,
+      vertices_[0][1]);
+  EXPECT_EQ(getClosestFrame(0u, 0, nullptr).vertex_id, vertices_[0][2]);
+}
+
+}  // namespace vi_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -1,4 +1,6 @@
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <aslam/cameras/camera.h>
 #include <maplab-common/test/testing-entrypoint.h>
@@ -95,6 +97,188 @@ TEST_F(MergeMapTest, MergeMapWithTwoLinkedMissions) {
   EXPECT_EQ(num_landmarks_before, empty_map_.numLandmarks());
 }
 
+TEST_F(MergeMapTest, MergeSeveralMapsInParallel) {
+  vi_map::VIMap second_map;
+  test::generateMap<vi_map::TransformationEdge>(&second_map);
+  vi_map::VIMap third_map;
+  test::generateMap<vi_map::TransformationEdge>(&third_map);
+
+  MapMergeStatistics statistics;
+  empty_map_.mergeAllMissionsFromMaps(
+      {&map_, &second_map, &third_map}, &statistics);
+  EXPECT_TRUE(checkMapConsistency(empty_map_));
+
+  EXPECT_EQ(3u, empty_map_.numMissions());
+  const size_t num_vertices =
+      map_.numVertices() + second_map.numVertices() + third_map.numVertices();
+  EXPECT_EQ(num_vertices, empty_map_.numVertices());
+  EXPECT_EQ(
+      map_.numEdges() + second_map.numEdges() + third_map.numEdges(),
+      empty_map_.numEdges());
+  EXPECT_EQ(
+      map_.numLandmarks() + second_map.numLandmarks() +
+          third_map.numLandmarks(),
+      empty_map_.numLandmarks());
+
+  EXPECT_EQ(3u, statistics.num_missions);
+  EXPECT_EQ(num_vertices, statistics.num_vertices);
+  EXPECT_EQ(empty_map_.numEdges(), statistics.num_edges);
+  EXPECT_GE(statistics.duration_seconds, 0.0);
+  EXPECT_GE(statistics.getVerticesPerSecond(), 0.0);
+}
+
+TEST_F(MergeMapTest, MoveIntoEmptyMap) {
+  vi_map::VIMap map_copy;
+  map_copy.deepCopy(map_);
+
+  MapMergeStatistics statistics;
+  empty_map_.moveAllMissionsFromMap(&map_copy, &statistics);
+  EXPECT_TRUE(test::compareVIMap(map_, empty_map_));
+  EXPECT_TRUE(checkMapConsistency(empty_map_));
+  EXPECT_EQ(map_.numVertices(), statistics.num_vertices);
+
+  EXPECT_EQ(0u, map_copy.numMissions());
+  EXPECT_EQ(0u, map_copy.numVertices());
+  EXPECT_EQ(0u, map_copy.numEdges());
+  EXPECT_EQ(0u, map_copy.numLandmarks());
+}
+
+TEST_F(MergeMapTest, MoveIntoNonEmpty) {
+  vi_map::VIMap second_map;
+  test::generateMap<vi_map::TransformationEdge>(&second_map);
+  const size_t num_vertices_before = second_map.numVertices();
+  const size_t num_edges_before = second_map.numEdges();
+  const size_t num_landmarks_before = second_map.numLandmarks();
+  const size_t num_vertices_moved = map_.numVertices();
+  const size_t num_edges_moved = map_.numEdges();
+  const size_t num_landmarks_moved = map_.numLandmarks();
+
+  second_map.moveAllMissionsFromMap(&map_);
+  EXPECT_EQ(2u, second_map.numMissions());
+  EXPECT_EQ(num_vertices_before + num_vertices_moved, second_map.numVertices());
+  EXPECT_EQ(num_edges_before + num_edges_moved, second_map.numEdges());
+  EXPECT_EQ(
+      num_landmarks_before + num_landmarks_moved, second_map.numLandmarks());
+  EXPECT_TRUE(checkMapConsistency(second_map));
+  EXPECT_EQ(0u, map_.numMissions());
+}
+
+TEST_F(MergeMapTest, DeepCopySharesUnmodifiedVertices) {
+  vi_map::VIMap map_copy;
+  map_copy.deepCopy(map_);
+  EXPECT_TRUE(test::compareVIMap(map_, map_copy));
+  EXPECT_TRUE(checkMapConsistency(map_copy));
+
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIds(&vertex_ids);
+  ASSERT_GE(vertex_ids.size(), 2u);
+  const vi_map::VIMap& const_map = map_;
+  const vi_map::VIMap& const_map_copy = map_copy;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    EXPECT_EQ(
+        &const_map.getVertex(vertex_id), &const_map_copy.getVertex(vertex_id));
+  }
+
+  // Writing to a vertex of the copy clones the vertex, but its frames and
+  // landmarks are only copied once they are written to.
+  const pose_graph::VertexId& modified_vertex_id = vertex_ids.front();
+  const vi_map::Vertex& original_vertex =
+      const_map.getVertex(modified_vertex_id);
+  const Eigen::Vector3d p_M_I_before = original_vertex.get_p_M_I();
+  vi_map::Vertex& modified_vertex = map_copy.getVertex(modified_vertex_id);
+  const vi_map::Vertex& const_modified_vertex = modified_vertex;
+  EXPECT_NE(&original_vertex, &modified_vertex);
+  modified_vertex.set_p_M_I(p_M_I_before + Eigen::Vector3d::Ones());
+  EXPECT_EQ(p_M_I_before, const_map.getVertex(modified_vertex_id).get_p_M_I());
+  EXPECT_EQ(
+      &original_vertex.getVisualNFrame(),
+      &const_modified_vertex.getVisualNFrame());
+  EXPECT_EQ(
+      &original_vertex.getLandmarks(), &const_modified_vertex.getLandmarks());
+
+  modified_vertex.getLandmarks();
+  EXPECT_NE(
+      &original_vertex.getLandmarks(), &const_modified_vertex.getLandmarks());
+  EXPECT_EQ(
+      &original_vertex.getVisualNFrame(),
+      &const_modified_vertex.getVisualNFrame());
+  modified_vertex.getVisualNFrame();
+  EXPECT_NE(
+      &original_vertex.getVisualNFrame(),
+      &const_modified_vertex.getVisualNFrame());
+  EXPECT_TRUE(
+      original_vertex.getVisualNFrame().compareWithoutCameraSystem(
+          const_modified_vertex.getVisualNFrame()));
+
+  for (size_t idx = 1u; idx < vertex_ids.size(); ++idx) {
+    EXPECT_EQ(
+        &const_map.getVertex(vertex_ids[idx]),
+        &const_map_copy.getVertex(vertex_ids[idx]));
+  }
+
+  // The original map is now the only owner of its vertex.
+  EXPECT_EQ(&original_vertex, &map_.getVertex(modified_vertex_id));
+  EXPECT_TRUE(checkMapConsistency(map_));
+  EXPECT_TRUE(checkMapConsistency(map_copy));
+}
+
+TEST_F(MergeMapTest, DeepCopyDetachesVertexOnceUnderConcurrentWrites) {
+  vi_map::VIMap map_copy;
+  map_copy.deepCopy(map_);
+
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIds(&vertex_ids);
+  const vi_map::VIMap& const_map = map_;
+  pose_graph::VertexId vertex_id;
+  for (const pose_graph::VertexId& candidate_id : vertex_ids) {
+    if (const_map.getVertex(candidate_id).getLandmarks().size() >= 4u) {
+      vertex_id = candidate_id;
+      break;
+    }
+  }
+  ASSERT_TRUE(vertex_id.isValid());
+  const vi_map::LandmarkStore& original_landmarks =
+      const_map.getVertex(vertex_id).getLandmarks();
+  vi_map::LandmarkIdList landmark_ids;
+  for (const vi_map::Landmark& landmark : original_landmarks) {
+    landmark_ids.push_back(landmark.id());
+  }
+  std::vector<pose::Position3D> original_positions;
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    original_positions.push_back(const_map.getLandmark(landmark_id).get_p_B());
+  }
+
+  // Every thread moves a different landmark of the same shared vertex.
+  const pose::Position3D kOffset(1.0, 2.0, 3.0);
+  std::vector<std::thread> threads;
+  for (size_t idx = 0u; idx < landmark_ids.size(); ++idx) {
+    threads.emplace_back([&, idx]() {
+      vi_map::Landmark& landmark = map_copy.getLandmark(landmark_ids[idx]);
+      landmark.set_p_B(original_positions[idx] + kOffset);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // All writes ended up in the same clone and the original stayed untouched.
+  const vi_map::VIMap& const_map_copy = map_copy;
+  EXPECT_NE(
+      &const_map.getVertex(vertex_id), &const_map_copy.getVertex(vertex_id));
+  for (size_t idx = 0u; idx < landmark_ids.size(); ++idx) {
+    EXPECT_EQ(
+        original_positions[idx] + kOffset,
+        const_map_copy.getLandmark(landmark_ids[idx]).get_p_B());
+    EXPECT_EQ(
+        original_positions[idx],
+        const_map.getLandmark(landmark_ids[idx]).get_p_B());
+  }
+  // References taken before the detach still point to the shared vertex.
+  EXPECT_EQ(
+      &original_landmarks, &const_map.getVertex(vertex_id).getLandmarks());
+  EXPECT_TRUE(checkMapConsistency(map_copy));
+}
+
 // Copies a map, then deletes the map's only mission and merges the mission back
 // from the copy.
 TEST_F(MergeMapTest, CopyDeleteMerge) {
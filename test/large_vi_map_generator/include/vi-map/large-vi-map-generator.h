@@ -0,0 +1,150 @@
+#ifndef VI_MAP_LARGE_VI_MAP_GENERATOR_H_
+#define VI_MAP_LARGE_VI_MAP_GENERATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/cameras/ncamera.h>
+#include <aslam/common/memory.h>
+#include <aslam/frames/visual-frame.h>
+#include <maplab-common/macros.h>
+#include <maplab-common/pose_types.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/unique-id.h>
+
+namespace vi_map {
+
+struct LargeVIMapGeneratorSettings {
+  // Initializes the settings from the large_map_generator_* flags.
+  LargeVIMapGeneratorSettings();
+
+  size_t num_missions;
+  size_t num_vertices_per_mission;
+  // Vertices are generated and written in blocks of this size, every block is
+  // processed independently by one of the worker threads.
+  size_t num_vertices_per_block;
+  size_t num_threads;
+  uint64_t seed;
+
+  // All missions drive laps on a circuit of this radius [m], which makes them
+  // revisit the same places within and across missions.
+  double circuit_radius_m;
+  // Distance between two consecutive vertices [m].
+  double vertex_distance_m;
+  // Speed of the sensor rig [m/s].
+  double speed_m_s;
+  double imu_rate_hz;
+
+  // Landmarks are placed along the circuit in cells of this length [m].
+  double landmark_cell_length_m;
+  size_t num_landmarks_per_cell;
+  // Landmarks are observed within this range of arc length ahead of the
+  // vertex [m].
+  double min_viewing_distance_m;
+  double max_viewing_distance_m;
+
+  double keypoint_noise_sigma_px;
+  // Every observation flips up to this many bits of the descriptor of the
+  // landmark it observes.
+  size_t max_descriptor_bit_flips;
+};
+
+// Generates large multi-mission maps for benchmarking and streams them to disk
+// in the chunked format of the map serialization, without ever holding the
+// whole map in memory.
+//
+// Every vertex, edge and landmark id is a function of the seed and of its
+// position in the map. This lets every block of vertices be generated on its
+// own, including the landmarks it shares with the neighboring blocks, and
+// makes the pose graph and the landmarks reproducible across runs.
+//
+// Each mission observes its own copy of the landmarks of every lap. The
+// copies of the same physical landmark share the position and a base
+// descriptor, such that revisits can be found by loop closure.
+class LargeVIMapGenerator {
+ public:
+  MAPLAB_POINTER_TYPEDEFS(LargeVIMapGenerator);
+
+  struct Statistics {
+    Statistics()
+        : num_vertices(0u),
+          num_edges(0u),
+          num_landmarks(0u),
+          num_observations(0u),
+          num_files(0u) {}
+    size_t num_vertices;
+    size_t num_edges;
+    size_t num_landmarks;
+    size_t num_observations;
+    size_t num_files;
+  };
+
+  explicit LargeVIMapGenerator(const LargeVIMapGeneratorSettings& settings);
+
+  // Writes the map to the given map folder, which must not contain a map yet.
+  // Returns false if any of the files could not be written.
+  bool generateMapToFolder(
+      const std::string& map_folder, Statistics* statistics) const;
+
+  pose_graph::VertexId getVertexId(
+      const size_t mission_index, const size_t vertex_index) const;
+  MissionId getMissionId(const size_t mission_index) const;
+
+ private:
+  struct Observation {
+    int64_t cell_index;
+    uint32_t landmark_index_in_cell;
+    Eigen::Vector2d keypoint;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  typedef Aligned<std::vector, Observation> ObservationList;
+
+  // Generates and writes the vertices of the given block of a mission, the
+  // edges leading to them and the landmarks they store. Returns the names of
+  // the written files.
+  bool generateBlock(
+      const std::string& vi_map_folder, const size_t mission_index,
+      const size_t block_index, std::vector<std::string>* vertex_file_names,
+      std::string* edge_file_name, std::string* landmark_index_file_name,
+      Statistics* statistics) const;
+
+  bool writeMissions(const std::string& map_folder) const;
+
+  void getObservations(
+      const size_t mission_index, const size_t vertex_index,
+      ObservationList* observations) const;
+
+  pose::Transformation get_T_G_I(
+      const size_t mission_index, const size_t vertex_index) const;
+  pose::Transformation get_T_G_M(const size_t mission_index) const;
+  double getVertexArcLength(
+      const size_t mission_index, const size_t vertex_index) const;
+  double getLaneOffset(const size_t mission_index) const;
+  int64_t getTimestampNanoseconds(
+      const size_t mission_index, const size_t vertex_index) const;
+  Eigen::Vector3d getLandmarkPosition(
+      const int64_t cell_index, const uint32_t landmark_index_in_cell) const;
+  void getDescriptor(
+      const size_t mission_index, const size_t vertex_index,
+      const Observation& observation,
+      aslam::VisualFrame::DescriptorsT::ColXpr descriptor) const;
+
+  LandmarkId getLandmarkId(
+      const size_t mission_index, const int64_t cell_index,
+      const uint32_t landmark_index_in_cell) const;
+  pose_graph::EdgeId getEdgeId(
+      const size_t mission_index, const size_t vertex_index) const;
+
+  const LargeVIMapGeneratorSettings settings_;
+  aslam::NCamera::Ptr ncamera_;
+  // The circuit is divided into an integer number of landmark cells, such
+  // that every lap sees the same landmarks.
+  size_t num_cells_per_lap_;
+  double cell_length_m_;
+};
+
+}  // namespace vi_map
+
+#endif  // VI_MAP_LARGE_VI_MAP_GENERATOR_H_
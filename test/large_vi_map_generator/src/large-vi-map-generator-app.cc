@@ -0,0 +1,44 @@
+#include <chrono>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "vi-map/large-vi-map-generator.h"
+
+DEFINE_string(
+    map_output_path, "",
+    "Folder the generated map is written to. It must not contain a map yet.");
+
+// Example, generates a map with 1M vertices in 10 missions:
+//   large_vi_map_generator --map_output_path=/tmp/large_map
+//       --large_map_generator_num_missions=10
+//       --large_map_generator_num_vertices_per_mission=100000
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+  FLAGS_alsologtostderr = true;
+  FLAGS_colorlogtostderr = true;
+
+  CHECK(!FLAGS_map_output_path.empty())
+      << "You have to provide the folder to write the map to. Flag: "
+      << "--map_output_path";
+
+  const vi_map::LargeVIMapGeneratorSettings settings;
+  const vi_map::LargeVIMapGenerator generator(settings);
+  vi_map::LargeVIMapGenerator::Statistics statistics;
+  const std::chrono::steady_clock::time_point time_start =
+      std::chrono::steady_clock::now();
+  if (!generator.generateMapToFolder(FLAGS_map_output_path, &statistics)) {
+    LOG(ERROR) << "Generating the map in " << FLAGS_map_output_path
+               << " failed.";
+    return 1;
+  }
+  LOG(INFO) << "Generating the map took "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - time_start)
+                   .count()
+            << " s.";
+  return 0;
+}
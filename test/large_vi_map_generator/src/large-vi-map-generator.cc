@@ -0,0 +1,783 @@
+#include "vi-map/large-vi-map-generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <aslam/cameras/camera-pinhole.h>
+#include <aslam/common/memory.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <map-resources/resource-map-serialization.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/map-manager-config.h>
+#include <maplab-common/multi-threaded-progress-bar.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/proto-serialization-helper.h>
+#include <maplab-common/threading-helpers.h>
+#include <sensors/imu.h>
+#include <vi-map/landmark.h>
+#include <vi-map/vertex.h>
+#include <vi-map/vi-map-metadata.h>
+#include <vi-map/vi-map-serialization.h>
+#include <vi-map/vi-map.h>
+#include <vi-map/vi_map.pb.h>
+#include <vi-map/viwls-edge.h>
+
+DEFINE_uint64(
+    large_map_generator_num_missions, 10u,
+    "Number of missions of the generated map.");
+DEFINE_uint64(
+    large_map_generator_num_vertices_per_mission, 100000u,
+    "Number of vertices of every mission of the generated map.");
+DEFINE_uint64(
+    large_map_generator_num_vertices_per_block, 2000u,
+    "Number of vertices that are generated and written by a worker at once.");
+DEFINE_uint64(
+    large_map_generator_num_threads, 0u,
+    "Number of worker threads. If 0, the number of hardware threads is used.");
+DEFINE_uint64(
+    large_map_generator_seed, 42u,
+    "Seed of the generated map. All ids and measurements are a function of "
+    "the seed.");
+DEFINE_double(
+    large_map_generator_circuit_radius_m, 150.0,
+    "Radius of the circuit all missions drive laps on [m].");
+DEFINE_double(
+    large_map_generator_vertex_distance_m, 0.5,
+    "Distance between two consecutive vertices [m].");
+DEFINE_double(
+    large_map_generator_speed_m_s, 1.5, "Speed of the sensor rig [m/s].");
+DEFINE_double(
+    large_map_generator_imu_rate_hz, 200.0, "Rate of the IMU measurements.");
+DEFINE_double(
+    large_map_generator_landmark_cell_length_m, 1.0,
+    "Length of the cells along the circuit that contain the landmarks [m].");
+DEFINE_uint64(
+    large_map_generator_num_landmarks_per_cell, 10u,
+    "Number of landmarks per cell along the circuit.");
+DEFINE_double(
+    large_map_generator_min_viewing_distance_m, 2.0,
+    "Landmarks closer than this along the circuit are not observed [m].");
+DEFINE_double(
+    large_map_generator_max_viewing_distance_m, 25.0,
+    "Landmarks further than this along the circuit are not observed [m].");
+DEFINE_double(
+    large_map_generator_keypoint_noise_sigma_px, 0.8,
+    "Standard deviation of the keypoint measurement noise [px].");
+DEFINE_uint64(
+    large_map_generator_max_descriptor_bit_flips, 40u,
+    "Maximum number of bits an observation flips in the descriptor of the "
+    "landmark it observes.");
+
+namespace vi_map {
+namespace {
+
+constexpr uint32_t kImageWidth = 752u;
+constexpr uint32_t kImageHeight = 480u;
+constexpr double kFocalLengthPx = 460.0;
+constexpr size_t kDescriptorSizeBytes = 48u;
+constexpr size_t kDescriptorSizeWords = kDescriptorSizeBytes / sizeof(uint64_t);
+constexpr double kGravityMagnitude = 9.81;
+constexpr unsigned int kFrameIndex = 0u;
+
+// Separates the hashes of the different quantities derived from the same
+// indices.
+enum HashTag : uint64_t {
+  kMissionTag = 1u,
+  kVertexTag,
+  kEdgeTag,
+  kFrameTag,
+  kLandmarkTag,
+  kLandmarkPositionTag,
+  kDescriptorTag,
+  kBitFlipTag,
+  kKeypointNoiseTag,
+  kBaseframeTag,
+  kLaneTag
+};
+
+// Finalizer of SplitMix64. All random quantities are hashes of their position
+// in the map instead of draws from a sequential generator, which makes them
+// independent of the order the blocks are generated in.
+inline uint64_t mix(uint64_t value) {
+  value += 0x9e3779b97f4a7c15ull;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+inline uint64_t combineHash(const uint64_t a, const uint64_t b) {
+  return mix(mix(a) ^ b);
+}
+
+inline uint64_t combineHash(
+    const uint64_t a, const uint64_t b, const uint64_t c) {
+  return combineHash(combineHash(a, b), c);
+}
+
+inline uint64_t combineHash(
+    const uint64_t a, const uint64_t b, const uint64_t c, const uint64_t d) {
+  return combineHash(combineHash(a, b, c), d);
+}
+
+// Returns the n-th uniform sample in [0, 1) of the given hash.
+inline double uniform(const uint64_t hash_value, const uint64_t n) {
+  return (mix(hash_value + n) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+template <typename IdType>
+IdType makeId(const uint64_t high, const uint64_t low) {
+  const uint64_t words[2] = {high, low};
+  IdType id;
+  id.fromHashId(aslam::HashId(words));
+  return id;
+}
+
+template <typename AslamIdType>
+AslamIdType makeAslamId(const uint64_t high, const uint64_t low) {
+  const uint64_t words[2] = {high, low};
+  AslamIdType id;
+  id.fromUint64(words);
+  return id;
+}
+
+std::string getBlockFileName(
+    const std::string& base_file_name, const size_t mission_index,
+    const size_t block_index) {
+  return base_file_name + "_" + std::to_string(mission_index) + "_" +
+         std::to_string(block_index);
+}
+
+}  // namespace
+
+LargeVIMapGeneratorSettings::LargeVIMapGeneratorSettings()
+    : num_missions(FLAGS_large_map_generator_num_missions),
+      num_vertices_per_mission(
+          FLAGS_large_map_generator_num_vertices_per_mission),
+      num_vertices_per_block(FLAGS_large_map_generator_num_vertices_per_block),
+      num_threads(
+          FLAGS_large_map_generator_num_threads > 0u
+              ? FLAGS_large_map_generator_num_threads
+              : common::getNumHardwareThreads()),
+      seed(FLAGS_large_map_generator_seed),
+      circuit_radius_m(FLAGS_large_map_generator_circuit_radius_m),
+      vertex_distance_m(FLAGS_large_map_generator_vertex_distance_m),
+      speed_m_s(FLAGS_large_map_generator_speed_m_s),
+      imu_rate_hz(FLAGS_large_map_generator_imu_rate_hz),
+      landmark_cell_length_m(FLAGS_large_map_generator_landmark_cell_length_m),
+      num_landmarks_per_cell(FLAGS_large_map_generator_num_landmarks_per_cell),
+      min_viewing_distance_m(FLAGS_large_map_generator_min_viewing_distance_m),
+      max_viewing_distance_m(FLAGS_large_map_generator_max_viewing_distance_m),
+      keypoint_noise_sigma_px(
+          FLAGS_large_map_generator_keypoint_noise_sigma_px),
+      max_descriptor_bit_flips(
+          FLAGS_large_map_generator_max_descriptor_bit_flips) {}
+
+LargeVIMapGenerator::LargeVIMapGenerator(
+    const LargeVIMapGeneratorSettings& settings)
+    : settings_(settings) {
+  CHECK_GT(settings_.num_missions, 0u);
+  CHECK_GT(settings_.num_vertices_per_mission, 0u);
+  CHECK_GT(settings_.num_vertices_per_block, 0u);
+  // Every block writes all of its edges to a single file.
+  CHECK_LE(
+      settings_.num_vertices_per_block,
+      backend::SaveConfig::kEdgesPerProtoFile);
+  CHECK_GT(settings_.num_threads, 0u);
+  CHECK_GT(settings_.circuit_radius_m, 0.0);
+  CHECK_GT(settings_.vertex_distance_m, 0.0);
+  CHECK_GT(settings_.speed_m_s, 0.0);
+  CHECK_GT(settings_.imu_rate_hz, 0.0);
+  CHECK_GT(settings_.landmark_cell_length_m, 0.0);
+  CHECK_GE(settings_.min_viewing_distance_m, 0.0);
+  CHECK_GT(
+      settings_.max_viewing_distance_m, settings_.min_viewing_distance_m);
+  CHECK_GE(settings_.keypoint_noise_sigma_px, 0.0);
+  CHECK_LE(settings_.max_descriptor_bit_flips, kDescriptorSizeBytes * 8u);
+
+  const double circumference_m = 2.0 * M_PI * settings_.circuit_radius_m;
+  num_cells_per_lap_ = std::max<size_t>(
+      1u, static_cast<size_t>(std::round(
+              circumference_m / settings_.landmark_cell_length_m)));
+  cell_length_m_ = circumference_m / num_cells_per_lap_;
+
+  aslam::Camera::Ptr camera(
+      new aslam::PinholeCamera(
+          kFocalLengthPx, kFocalLengthPx, 0.5 * kImageWidth,
+          0.5 * kImageHeight, kImageWidth, kImageHeight));
+  camera->setId(makeAslamId<aslam::CameraId>(settings_.seed, 0u));
+  std::vector<aslam::Camera::Ptr> cameras(1u, camera);
+  const Aligned<std::vector, aslam::Transformation> T_C_B(
+      1u, aslam::Transformation());
+  ncamera_.reset(
+      new aslam::NCamera(
+          makeAslamId<aslam::NCameraId>(settings_.seed, 1u), T_C_B, cameras,
+          "Large map generator camera rig"));
+}
+
+bool LargeVIMapGenerator::generateMapToFolder(
+    const std::string& map_folder, Statistics* statistics) const {
+  CHECK_NOTNULL(statistics);
+  CHECK(!map_folder.empty());
+  *statistics = Statistics();
+  const std::string vi_map_folder = common::concatenateFolderAndFileName(
+      map_folder, serialization::getSubFolderName());
+  if (common::pathExists(vi_map_folder)) {
+    LOG(ERROR) << "There is already a map in " << map_folder << ".";
+    return false;
+  }
+  if (!common::createPath(vi_map_folder)) {
+    LOG(ERROR) << "Could not create the map folder " << vi_map_folder << ".";
+    return false;
+  }
+
+  const size_t num_blocks_per_mission =
+      (settings_.num_vertices_per_mission + settings_.num_vertices_per_block -
+       1u) /
+      settings_.num_vertices_per_block;
+  const size_t num_blocks = settings_.num_missions * num_blocks_per_mission;
+  std::vector<std::vector<std::string>> vertex_file_names(num_blocks);
+  std::vector<std::string> edge_file_names(num_blocks);
+  std::vector<std::string> landmark_index_file_names(num_blocks);
+
+  LOG(INFO) << "Generating " << settings_.num_missions << " missions with "
+            << settings_.num_vertices_per_mission << " vertices each in "
+            << num_blocks << " blocks on " << settings_.num_threads
+            << " threads.";
+  std::mutex statistics_mutex;
+  bool success = true;
+  common::MultiThreadedProgressBar progress_bar;
+  constexpr bool kAlwaysParallelize = true;
+  common::ParallelProcess(
+      num_blocks,
+      [&](const std::vector<size_t>& range) {
+        progress_bar.setNumElements(range.size());
+        size_t num_processed_blocks = 0u;
+        for (const size_t block : range) {
+          Statistics block_statistics;
+          const bool block_success = generateBlock(
+              vi_map_folder, block / num_blocks_per_mission,
+              block % num_blocks_per_mission, &vertex_file_names[block],
+              &edge_file_names[block], &landmark_index_file_names[block],
+              &block_statistics);
+          {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            success &= block_success;
+            statistics->num_vertices += block_statistics.num_vertices;
+            statistics->num_edges += block_statistics.num_edges;
+            statistics->num_landmarks += block_statistics.num_landmarks;
+            statistics->num_observations += block_statistics.num_observations;
+            statistics->num_files += block_statistics.num_files;
+          }
+          progress_bar.update(++num_processed_blocks);
+        }
+      },
+      kAlwaysParallelize, settings_.num_threads);
+  if (!success || !writeMissions(map_folder)) {
+    return false;
+  }
+
+  // The metadata is written last, a map without it is not loaded.
+  serialization::VIMapMetadata metadata;
+  metadata.emplace(
+      serialization::VIMapFileType::kMissions,
+      serialization::internal::kFileNameMissions);
+  metadata.emplace(
+      serialization::VIMapFileType::kOptionalSensorData,
+      serialization::internal::kFileNameOptionalSensorData);
+  for (size_t block = 0u; block < num_blocks; ++block) {
+    for (const std::string& file_name : vertex_file_names[block]) {
+      metadata.emplace(serialization::VIMapFileType::kVertices, file_name);
+    }
+    if (!edge_file_names[block].empty()) {
+      metadata.emplace(
+          serialization::VIMapFileType::kEdges, edge_file_names[block]);
+    }
+    metadata.emplace(
+        serialization::VIMapFileType::kLandmarkIndex,
+        landmark_index_file_names[block]);
+  }
+  proto::VIMapMetadata metadata_proto;
+  serialization::serializeMetadata(metadata, &metadata_proto);
+  constexpr bool kIsTextFormat = true;
+  if (!common::proto_serialization_helper::serializeProtoToFile(
+          vi_map_folder, serialization::internal::kFileNameMetadata,
+          metadata_proto, kIsTextFormat)) {
+    return false;
+  }
+  statistics->num_files += 4u;
+
+  LOG(INFO) << "Generated map in \"" << map_folder << "\" with "
+            << statistics->num_vertices << " vertices, "
+            << statistics->num_edges << " edges, "
+            << statistics->num_landmarks << " landmarks and "
+            << statistics->num_observations << " observations in "
+            << statistics->num_files << " files.";
+  return true;
+}
+
+bool LargeVIMapGenerator::generateBlock(
+    const std::string& vi_map_folder, const size_t mission_index,
+    const size_t block_index, std::vector<std::string>* vertex_file_names,
+    std::string* edge_file_name, std::string* landmark_index_file_name,
+    Statistics* statistics) const {
+  CHECK_NOTNULL(vertex_file_names)->clear();
+  CHECK_NOTNULL(edge_file_name)->clear();
+  CHECK_NOTNULL(landmark_index_file_name);
+  CHECK_NOTNULL(statistics);
+  const size_t num_vertices = settings_.num_vertices_per_mission;
+  const size_t begin = block_index * settings_.num_vertices_per_block;
+  const size_t end =
+      std::min(num_vertices, begin + settings_.num_vertices_per_block);
+  CHECK_LT(begin, end);
+
+  // All observers of a landmark lie within this many vertices of each other.
+  // The observations of the vertices around the block are generated as well,
+  // such that the block knows all observers of the landmarks it stores and
+  // whether a landmark is already stored by the previous block.
+  const size_t track_span = static_cast<size_t>(std::ceil(
+                                (settings_.max_viewing_distance_m -
+                                 settings_.min_viewing_distance_m +
+                                 cell_length_m_) /
+                                settings_.vertex_distance_m)) +
+                            1u;
+  const size_t cache_begin = begin > track_span ? begin - track_span : 0u;
+  const size_t cache_end = std::min(num_vertices, end + track_span);
+  std::vector<ObservationList> observations(cache_end - cache_begin);
+
+  // Observers of every landmark, in increasing order of the vertex index.
+  typedef std::pair<size_t, uint32_t> VertexAndKeypointIndex;
+  std::unordered_map<uint64_t, std::vector<VertexAndKeypointIndex>> tracks;
+  const auto landmark_key = [this](const Observation& observation) {
+    return static_cast<uint64_t>(observation.cell_index) *
+               settings_.num_landmarks_per_cell +
+           observation.landmark_index_in_cell;
+  };
+  for (size_t vertex_index = cache_begin; vertex_index < cache_end;
+       ++vertex_index) {
+    ObservationList& vertex_observations =
+        observations[vertex_index - cache_begin];
+    getObservations(mission_index, vertex_index, &vertex_observations);
+    for (size_t keypoint_index = 0u;
+         keypoint_index < vertex_observations.size(); ++keypoint_index) {
+      tracks[landmark_key(vertex_observations[keypoint_index])].emplace_back(
+          vertex_index, keypoint_index);
+    }
+  }
+
+  const MissionId mission_id = getMissionId(mission_index);
+  const pose::Transformation T_M_G = get_T_G_M(mission_index).inverse();
+  const uint64_t frame_id_hash =
+      combineHash(settings_.seed, kFrameTag, mission_index);
+  const double lane_speed_m_s =
+      settings_.speed_m_s *
+      (settings_.circuit_radius_m + getLaneOffset(mission_index)) /
+      settings_.circuit_radius_m;
+  proto::VIMap landmark_index_proto;
+  bool success = true;
+
+  size_t chunk_index = 0u;
+  for (size_t chunk_begin = begin; chunk_begin < end;
+       chunk_begin += backend::SaveConfig::kVerticesPerProtoFile) {
+    const size_t chunk_end = std::min(
+        end, chunk_begin + backend::SaveConfig::kVerticesPerProtoFile);
+    proto::VIMap vertices_proto;
+    vertices_proto.mutable_vertex_ids()->Reserve(chunk_end - chunk_begin);
+    vertices_proto.mutable_vertices()->Reserve(chunk_end - chunk_begin);
+    for (size_t vertex_index = chunk_begin; vertex_index < chunk_end;
+         ++vertex_index) {
+      const ObservationList& vertex_observations =
+          observations[vertex_index - cache_begin];
+      const size_t num_keypoints = vertex_observations.size();
+      Eigen::Matrix2Xd keypoints(2, num_keypoints);
+      aslam::VisualFrame::DescriptorsT descriptors(
+          kDescriptorSizeBytes, num_keypoints);
+      LandmarkIdList observed_landmark_ids(num_keypoints);
+      for (size_t keypoint_index = 0u; keypoint_index < num_keypoints;
+           ++keypoint_index) {
+        const Observation& observation = vertex_observations[keypoint_index];
+        keypoints.col(keypoint_index) = observation.keypoint;
+        getDescriptor(
+            mission_index, vertex_index, observation,
+            descriptors.col(keypoint_index));
+        observed_landmark_ids[keypoint_index] = getLandmarkId(
+            mission_index, observation.cell_index,
+            observation.landmark_index_in_cell);
+      }
+
+      const pose_graph::VertexId vertex_id =
+          getVertexId(mission_index, vertex_index);
+      const aslam::FrameId frame_id =
+          makeAslamId<aslam::FrameId>(frame_id_hash, vertex_index);
+      Vertex vertex(
+          vertex_id, Eigen::Matrix<double, 6, 1>::Zero(), keypoints,
+          Eigen::VectorXd::Ones(num_keypoints), descriptors,
+          observed_landmark_ids, mission_id, frame_id,
+          getTimestampNanoseconds(mission_index, vertex_index), ncamera_);
+
+      const pose::Transformation T_G_I = get_T_G_I(mission_index, vertex_index);
+      const pose::Transformation T_M_I = T_M_G * T_G_I;
+      vertex.set_T_M_I(T_M_I);
+      // The rig drives along the z-axis of the camera.
+      vertex.set_v_M(
+          T_M_I.getRotation().rotate(
+              Eigen::Vector3d(0.0, 0.0, lane_speed_m_s)));
+      if (vertex_index > 0u) {
+        vertex.addIncomingEdge(getEdgeId(mission_index, vertex_index));
+      }
+      if (vertex_index + 1u < num_vertices) {
+        vertex.addOutgoingEdge(getEdgeId(mission_index, vertex_index + 1u));
+      }
+
+      // The first observer of a landmark stores it.
+      const pose::Transformation T_I_G = T_G_I.inverse();
+      for (size_t keypoint_index = 0u; keypoint_index < num_keypoints;
+           ++keypoint_index) {
+        const Observation& observation = vertex_observations[keypoint_index];
+        const std::vector<VertexAndKeypointIndex>& track =
+            tracks[landmark_key(observation)];
+        CHECK(!track.empty());
+        if (track.front().first != vertex_index) {
+          continue;
+        }
+        Landmark landmark;
+        landmark.setId(observed_landmark_ids[keypoint_index]);
+        landmark.set_p_B(
+            T_I_G * getLandmarkPosition(
+                        observation.cell_index,
+                        observation.landmark_index_in_cell));
+        for (const VertexAndKeypointIndex& observer : track) {
+          landmark.addObservation(
+              getVertexId(mission_index, observer.first), kFrameIndex,
+              observer.second);
+        }
+        statistics->num_observations += track.size();
+        vertex.getLandmarks().addLandmark(landmark);
+
+        proto::LandmarkToVertexReference* reference =
+            landmark_index_proto.add_landmark_index();
+        landmark.id().serialize(reference->mutable_landmark_id());
+        vertex_id.serialize(reference->mutable_vertex_id());
+        ++statistics->num_landmarks;
+      }
+
+      vertex_id.serialize(vertices_proto.add_vertex_ids());
+      vertex.serialize(vertices_proto.add_vertices());
+      ++statistics->num_vertices;
+    }
+
+    vertex_file_names->emplace_back(
+        getBlockFileName(
+            serialization::internal::kFileNameVertices, mission_index,
+            block_index) +
+        "_" + std::to_string(chunk_index));
+    success &= common::proto_serialization_helper::serializeProtoToFile(
+        vi_map_folder, vertex_file_names->back(), vertices_proto);
+    ++chunk_index;
+  }
+
+  // The edges leading to the vertices of the block. The rig drives on a
+  // circle at constant speed, hence the IMU measures a constant specific force
+  // and angular velocity in its own frame.
+  const double dt_s = settings_.vertex_distance_m / settings_.speed_m_s;
+  const double yaw_rate_rad_s =
+      settings_.speed_m_s / settings_.circuit_radius_m;
+  const double centripetal_acceleration_m_s2 =
+      yaw_rate_rad_s * yaw_rate_rad_s *
+      (settings_.circuit_radius_m + getLaneOffset(mission_index));
+  Eigen::Matrix<double, 6, 1> imu_measurement;
+  imu_measurement << -centripetal_acceleration_m_s2, -kGravityMagnitude, 0.0,
+      0.0, -yaw_rate_rad_s, 0.0;
+  const int num_imu_measurements = std::max(
+      2, static_cast<int>(std::round(dt_s * settings_.imu_rate_hz)) + 1);
+  const Eigen::Matrix<double, 6, Eigen::Dynamic> imu_data =
+      imu_measurement.replicate(1, num_imu_measurements);
+
+  proto::VIMap edges_proto;
+  for (size_t vertex_index = std::max<size_t>(begin, 1u); vertex_index < end;
+       ++vertex_index) {
+    const int64_t timestamp_from_ns =
+        getTimestampNanoseconds(mission_index, vertex_index - 1u);
+    const int64_t timestamp_to_ns =
+        getTimestampNanoseconds(mission_index, vertex_index);
+    Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps(
+        1, num_imu_measurements);
+    for (int i = 0; i < num_imu_measurements; ++i) {
+      imu_timestamps(i) = timestamp_from_ns +
+                          (timestamp_to_ns - timestamp_from_ns) * i /
+                              (num_imu_measurements - 1);
+    }
+    const pose_graph::EdgeId edge_id = getEdgeId(mission_index, vertex_index);
+    const ViwlsEdge edge(
+        edge_id, getVertexId(mission_index, vertex_index - 1u),
+        getVertexId(mission_index, vertex_index), imu_timestamps, imu_data);
+    edge_id.serialize(edges_proto.add_edge_ids());
+    static_cast<const Edge&>(edge).serialize(edges_proto.add_edges());
+    ++statistics->num_edges;
+  }
+  if (edges_proto.edges_size() > 0) {
+    *edge_file_name = getBlockFileName(
+        serialization::internal::kFileNameEdges, mission_index, block_index);
+    success &= common::proto_serialization_helper::serializeProtoToFile(
+        vi_map_folder, *edge_file_name, edges_proto);
+    ++statistics->num_files;
+  }
+
+  *landmark_index_file_name = getBlockFileName(
+      serialization::internal::kFileNameLandmarkIndex, mission_index,
+      block_index);
+  success &= common::proto_serialization_helper::serializeProtoToFile(
+      vi_map_folder, *landmark_index_file_name, landmark_index_proto);
+  statistics->num_files += vertex_file_names->size() + 1u;
+
+  LOG_IF(ERROR, !success) << "Failed to write block " << block_index
+                          << " of mission " << mission_index << ".";
+  return success;
+}
+
+bool LargeVIMapGenerator::writeMissions(const std::string& map_folder) const {
+  VIMap map;
+  map.setMapFolder(map_folder);
+  SensorManager& sensor_manager = map.getSensorManager();
+  const SensorId imu_sensor_id = makeId<SensorId>(settings_.seed, 2u);
+  for (size_t mission_index = 0u; mission_index < settings_.num_missions;
+       ++mission_index) {
+    const MissionId mission_id = getMissionId(mission_index);
+    map.addNewMissionWithBaseframe(
+        mission_id, get_T_G_M(mission_index),
+        Eigen::Matrix<double, 6, 6>::Zero(), ncamera_,
+        Mission::BackBone::kViwls);
+    map.getMission(mission_id).setRootVertexId(
+        getVertexId(mission_index, 0u));
+    if (mission_index == 0u) {
+      Imu::UniquePtr imu_sensor =
+          aligned_unique<Imu>(imu_sensor_id, std::string("imu0"));
+      imu_sensor->setImuSigmas(ImuSigmas(0.01, 0.001, 0.1, 0.001));
+      sensor_manager.addSensor(std::move(imu_sensor), mission_id);
+    } else {
+      sensor_manager.associateExistingSensorWithMission(
+          imu_sensor_id, mission_id);
+    }
+  }
+
+  const std::string vi_map_folder = common::concatenateFolderAndFileName(
+      map_folder, serialization::getSubFolderName());
+  proto::VIMap missions_proto;
+  serialization::serializeMissionsAndBaseframes(map, &missions_proto);
+  proto::VIMap optional_sensor_data_proto;
+  serialization::serializeOptionalSensorData(map, &optional_sensor_data_proto);
+  if (!common::proto_serialization_helper::serializeProtoToFile(
+          vi_map_folder, serialization::internal::kFileNameMissions,
+          missions_proto) ||
+      !common::proto_serialization_helper::serializeProtoToFile(
+          vi_map_folder, serialization::internal::kFileNameOptionalSensorData,
+          optional_sensor_data_proto)) {
+    return false;
+  }
+  sensor_manager.serializeToFile(
+      common::concatenateFolderAndFileName(
+          vi_map_folder, serialization::internal::kYamlSensorsFilename));
+
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = true;
+  return backend::resource_map_serialization::saveMapToFolder(
+      map_folder, save_config, &map);
+}
+
+void LargeVIMapGenerator::getObservations(
+    const size_t mission_index, const size_t vertex_index,
+    ObservationList* observations) const {
+  CHECK_NOTNULL(observations)->clear();
+  const double arc_length_m = getVertexArcLength(mission_index, vertex_index);
+  const int64_t first_cell_index = static_cast<int64_t>(std::ceil(
+      (arc_length_m + settings_.min_viewing_distance_m) / cell_length_m_));
+  const int64_t last_cell_index = static_cast<int64_t>(std::floor(
+      (arc_length_m + settings_.max_viewing_distance_m) / cell_length_m_));
+  const pose::Transformation T_C_G =
+      ncamera_->get_T_C_B(0u) *
+      get_T_G_I(mission_index, vertex_index).inverse();
+  const aslam::Camera& camera = ncamera_->getCamera(0u);
+
+  observations->reserve(
+      (last_cell_index - first_cell_index + 1) *
+      settings_.num_landmarks_per_cell);
+  for (int64_t cell_index = first_cell_index; cell_index <= last_cell_index;
+       ++cell_index) {
+    for (uint32_t landmark_index = 0u;
+         landmark_index < settings_.num_landmarks_per_cell; ++landmark_index) {
+      const Eigen::Vector3d p_C =
+          T_C_G * getLandmarkPosition(cell_index, landmark_index);
+      Eigen::Vector2d keypoint;
+      if (p_C.z() <= 0.0 ||
+          !camera.project3(p_C, &keypoint).isKeypointVisible()) {
+        continue;
+      }
+      // Box-Muller transform of two uniform samples.
+      const uint64_t noise_hash = combineHash(
+          combineHash(settings_.seed, kKeypointNoiseTag, mission_index),
+          vertex_index, cell_index, landmark_index);
+      const double radius =
+          settings_.keypoint_noise_sigma_px *
+          std::sqrt(-2.0 * std::log(1.0 - uniform(noise_hash, 0u)));
+      const double angle = 2.0 * M_PI * uniform(noise_hash, 1u);
+      keypoint += radius * Eigen::Vector2d(std::cos(angle), std::sin(angle));
+      keypoint.x() = std::min(std::max(keypoint.x(), 0.0), kImageWidth - 1.0);
+      keypoint.y() = std::min(std::max(keypoint.y(), 0.0), kImageHeight - 1.0);
+
+      observations->emplace_back();
+      observations->back().cell_index = cell_index;
+      observations->back().landmark_index_in_cell = landmark_index;
+      observations->back().keypoint = keypoint;
+    }
+  }
+}
+
+pose::Transformation LargeVIMapGenerator::get_T_G_I(
+    const size_t mission_index, const size_t vertex_index) const {
+  const double angle_rad = getVertexArcLength(mission_index, vertex_index) /
+                           settings_.circuit_radius_m;
+  const double radius_m =
+      settings_.circuit_radius_m + getLaneOffset(mission_index);
+  const double cos_angle = std::cos(angle_rad);
+  const double sin_angle = std::sin(angle_rad);
+  // Camera convention: x points to the right (away from the center of the
+  // circuit), y points down and z along the direction of travel.
+  Eigen::Matrix3d R_G_I;
+  R_G_I.col(0) << cos_angle, sin_angle, 0.0;
+  R_G_I.col(1) << 0.0, 0.0, -1.0;
+  R_G_I.col(2) << -sin_angle, cos_angle, 0.0;
+  return pose::Transformation(
+      Eigen::Quaterniond(R_G_I),
+      Eigen::Vector3d(radius_m * cos_angle, radius_m * sin_angle, 0.0));
+}
+
+pose::Transformation LargeVIMapGenerator::get_T_G_M(
+    const size_t mission_index) const {
+  // Every mission has its own, arbitrary baseframe, as if the missions were
+  // recorded independently.
+  const uint64_t baseframe_hash =
+      combineHash(settings_.seed, kBaseframeTag, mission_index);
+  const double yaw_rad = 2.0 * M_PI * uniform(baseframe_hash, 0u);
+  const Eigen::Vector3d p_G_M(
+      100.0 * (uniform(baseframe_hash, 1u) - 0.5),
+      100.0 * (uniform(baseframe_hash, 2u) - 0.5),
+      4.0 * (uniform(baseframe_hash, 3u) - 0.5));
+  return pose::Transformation(
+      Eigen::Quaterniond(
+          Eigen::AngleAxisd(yaw_rad, Eigen::Vector3d::UnitZ())),
+      p_G_M);
+}
+
+double LargeVIMapGenerator::getVertexArcLength(
+    const size_t mission_index, const size_t vertex_index) const {
+  // The missions start at different places along the circuit.
+  const double start_m = mission_index * num_cells_per_lap_ * cell_length_m_ /
+                         settings_.num_missions;
+  return start_m + vertex_index * settings_.vertex_distance_m;
+}
+
+double LargeVIMapGenerator::getLaneOffset(const size_t mission_index) const {
+  // Missions drive on different lanes to see the landmarks from different
+  // viewpoints.
+  const uint64_t lane_hash =
+      combineHash(settings_.seed, kLaneTag, mission_index);
+  return 4.0 * (uniform(lane_hash, 0u) - 0.5);
+}
+
+int64_t LargeVIMapGenerator::getTimestampNanoseconds(
+    const size_t mission_index, const size_t vertex_index) const {
+  constexpr int64_t kMissionTimeOffsetNs = 24ll * 3600ll * 1000000000ll;
+  const double dt_ns =
+      1e9 * settings_.vertex_distance_m / settings_.speed_m_s;
+  return static_cast<int64_t>(mission_index + 1u) * kMissionTimeOffsetNs +
+         static_cast<int64_t>(std::round(vertex_index * dt_ns));
+}
+
+Eigen::Vector3d LargeVIMapGenerator::getLandmarkPosition(
+    const int64_t cell_index, const uint32_t landmark_index_in_cell) const {
+  // Every lap passes the same physical landmarks.
+  const int64_t cell_index_in_lap =
+      cell_index % static_cast<int64_t>(num_cells_per_lap_);
+  const uint64_t position_hash = combineHash(
+      settings_.seed, kLandmarkPositionTag, cell_index_in_lap,
+      landmark_index_in_cell);
+  const double angle_rad =
+      (cell_index_in_lap + uniform(position_hash, 0u)) * cell_length_m_ /
+      settings_.circuit_radius_m;
+  // Landmarks lie 3 to 15 meters on either side of the circuit.
+  const double side = uniform(position_hash, 1u) < 0.5 ? -1.0 : 1.0;
+  const double radius_m = settings_.circuit_radius_m +
+                          side * (3.0 + 12.0 * uniform(position_hash, 2u));
+  const double height_m = -1.5 + 6.0 * uniform(position_hash, 3u);
+  return Eigen::Vector3d(
+      radius_m * std::cos(angle_rad), radius_m * std::sin(angle_rad),
+      height_m);
+}
+
+void LargeVIMapGenerator::getDescriptor(
+    const size_t mission_index, const size_t vertex_index,
+    const Observation& observation,
+    aslam::VisualFrame::DescriptorsT::ColXpr descriptor) const {
+  CHECK_EQ(static_cast<size_t>(descriptor.rows()), kDescriptorSizeBytes);
+  // All observations of a physical landmark, in every lap and mission, share
+  // the same base descriptor.
+  const int64_t cell_index_in_lap =
+      observation.cell_index % static_cast<int64_t>(num_cells_per_lap_);
+  const uint64_t descriptor_hash = combineHash(
+      settings_.seed, kDescriptorTag, cell_index_in_lap,
+      observation.landmark_index_in_cell);
+  uint64_t words[kDescriptorSizeWords];
+  for (size_t word = 0u; word < kDescriptorSizeWords; ++word) {
+    words[word] = mix(descriptor_hash + word);
+  }
+
+  // Appearance changes between the observations flip a few bits.
+  const uint64_t bit_flip_hash = combineHash(
+      combineHash(settings_.seed, kBitFlipTag, mission_index), vertex_index,
+      observation.cell_index, observation.landmark_index_in_cell);
+  const size_t num_bit_flips =
+      mix(bit_flip_hash) % (settings_.max_descriptor_bit_flips + 1u);
+  for (size_t flip = 1u; flip <= num_bit_flips; ++flip) {
+    const size_t bit = mix(bit_flip_hash + flip) % (kDescriptorSizeBytes * 8u);
+    words[bit / 64u] ^= 1ull << (bit % 64u);
+  }
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(words);
+  for (size_t byte = 0u; byte < kDescriptorSizeBytes; ++byte) {
+    descriptor(byte) = bytes[byte];
+  }
+}
+
+pose_graph::VertexId LargeVIMapGenerator::getVertexId(
+    const size_t mission_index, const size_t vertex_index) const {
+  return makeId<pose_graph::VertexId>(
+      combineHash(settings_.seed, kVertexTag, mission_index), vertex_index);
+}
+
+MissionId LargeVIMapGenerator::getMissionId(const size_t mission_index) const {
+  return makeId<MissionId>(
+      combineHash(settings_.seed, kMissionTag), mission_index);
+}
+
+LandmarkId LargeVIMapGenerator::getLandmarkId(
+    const size_t mission_index, const int64_t cell_index,
+    const uint32_t landmark_index_in_cell) const {
+  return makeId<LandmarkId>(
+      combineHash(settings_.seed, kLandmarkTag, mission_index),
+      static_cast<uint64_t>(cell_index) * settings_.num_landmarks_per_cell +
+          landmark_index_in_cell);
+}
+
+pose_graph::EdgeId LargeVIMapGenerator::getEdgeId(
+    const size_t mission_index, const size_t vertex_index) const {
+  return makeId<pose_graph::EdgeId>(
+      combineHash(settings_.seed, kEdgeTag, mission_index), vertex_index);
+}
+
+}  // namespace vi_map
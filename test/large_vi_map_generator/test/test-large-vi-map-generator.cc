@@ -0,0 +1,114 @@
+#include <string>
+
+#include <gtest/gtest.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/check-map-consistency.h>
+#include <vi-map/vi-map-serialization.h>
+#include <vi-map/vi-map.h>
+
+#include "vi-map/large-vi-map-generator.h"
+
+namespace vi_map {
+
+class LargeVIMapGeneratorTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    settings_.num_missions = 2u;
+    settings_.num_vertices_per_mission = 450u;
+    settings_.num_vertices_per_block = 100u;
+    settings_.num_threads = 4u;
+    // A lap is about 250 vertices long, such that every mission revisits its
+    // start.
+    settings_.circuit_radius_m = 20.0;
+    settings_.num_landmarks_per_cell = 3u;
+  }
+
+  void generateAndLoadMap(
+      const std::string& map_folder, VIMap* map,
+      LargeVIMapGenerator::Statistics* statistics) const {
+    CHECK_NOTNULL(map);
+    CHECK_NOTNULL(statistics);
+    common::removeIfExistsAndCreatePath(map_folder);
+    const LargeVIMapGenerator generator(settings_);
+    ASSERT_TRUE(generator.generateMapToFolder(map_folder, statistics));
+    ASSERT_TRUE(serialization::loadMapFromFolder(map_folder, map));
+  }
+
+  LargeVIMapGeneratorSettings settings_;
+};
+
+TEST_F(LargeVIMapGeneratorTest, GeneratedMapIsConsistent) {
+  VIMap map;
+  LargeVIMapGenerator::Statistics statistics;
+  generateAndLoadMap("large_vi_map_generator_test_map", &map, &statistics);
+
+  EXPECT_EQ(map.numMissions(), settings_.num_missions);
+  const size_t num_vertices =
+      settings_.num_missions * settings_.num_vertices_per_mission;
+  EXPECT_EQ(map.numVertices(), num_vertices);
+  EXPECT_EQ(statistics.num_vertices, num_vertices);
+  EXPECT_EQ(map.numEdges(), num_vertices - settings_.num_missions);
+  EXPECT_EQ(statistics.num_edges, map.numEdges());
+  EXPECT_EQ(map.numLandmarks(), statistics.num_landmarks);
+  EXPECT_GT(statistics.num_landmarks, 0u);
+  EXPECT_TRUE(checkMapConsistency(map));
+
+  // Every keypoint observes a landmark.
+  size_t num_observations = 0u;
+  map.forEachVertex([&](const Vertex& vertex) {
+    const int num_vertex_observations =
+        vertex.numValidObservedLandmarkIdsInAllFrames();
+    EXPECT_GT(num_vertex_observations, 0);
+    num_observations += num_vertex_observations;
+  });
+  EXPECT_EQ(num_observations, statistics.num_observations);
+
+  const LargeVIMapGenerator generator(settings_);
+  for (size_t mission_index = 0u; mission_index < settings_.num_missions;
+       ++mission_index) {
+    const MissionId mission_id = generator.getMissionId(mission_index);
+    ASSERT_TRUE(map.hasMission(mission_id));
+    EXPECT_EQ(
+        map.getMission(mission_id).getRootVertexId(),
+        generator.getVertexId(mission_index, 0u));
+  }
+}
+
+TEST_F(LargeVIMapGeneratorTest, MapIsIndependentOfBlockSizeAndThreads) {
+  VIMap map;
+  LargeVIMapGenerator::Statistics statistics;
+  generateAndLoadMap("large_vi_map_generator_test_map_a", &map, &statistics);
+
+  // Blocks that are shorter than the landmark tracks.
+  settings_.num_vertices_per_block = 30u;
+  settings_.num_threads = 1u;
+  VIMap other_map;
+  LargeVIMapGenerator::Statistics other_statistics;
+  generateAndLoadMap(
+      "large_vi_map_generator_test_map_b", &other_map, &other_statistics);
+
+  EXPECT_EQ(statistics.num_landmarks, other_statistics.num_landmarks);
+  EXPECT_EQ(statistics.num_observations, other_statistics.num_observations);
+  ASSERT_EQ(map.numVertices(), other_map.numVertices());
+  map.forEachVertex([&](const Vertex& vertex) {
+    ASSERT_TRUE(other_map.hasVertex(vertex.id()));
+    const Vertex& other_vertex = other_map.getVertex(vertex.id());
+    EXPECT_TRUE(
+        vertex.get_T_M_I().getTransformationMatrix().isApprox(
+            other_vertex.get_T_M_I().getTransformationMatrix()));
+    LandmarkIdList landmark_ids, other_landmark_ids;
+    vertex.getAllObservedLandmarkIds(&landmark_ids);
+    other_vertex.getAllObservedLandmarkIds(&other_landmark_ids);
+    EXPECT_EQ(landmark_ids, other_landmark_ids);
+    EXPECT_EQ(
+        vertex.getVisualFrame(0u).getDescriptors(),
+        other_vertex.getVisualFrame(0u).getDescriptors());
+    EXPECT_EQ(
+        vertex.getLandmarks().size(), other_vertex.getLandmarks().size());
+  });
+}
+
+}  // namespace vi_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,39 @@
+#ifndef CSV_EXPORT_STREAMING_EXPORT_H_
+#define CSV_EXPORT_STREAMING_EXPORT_H_
+
+#include <string>
+
+#include <vi-map/vi-map.h>
+
+#include "csv-export/table-writer.h"
+
+namespace csv_export {
+
+struct StreamingExportStatistics {
+  StreamingExportStatistics()
+      : num_rows(0u), num_bytes(0u), duration_seconds(0.0) {}
+  size_t num_rows;
+  size_t num_bytes;
+  double duration_seconds;
+};
+
+// Exports the same tables as exportMapToCsv, but the tables of all missions
+// are written concurrently through buffered writers instead of being
+// formatted line by line through iostreams. Vertex and landmark indices are
+// assigned up front, hence the output is identical no matter how many
+// threads are used. The tables to export are selected using the same
+// --csv_export_* flags as exportMapToCsv.
+//
+// Folder layout for the CSV format:
+//   <base_path>/<mission_id>/{vertices,tracks,descriptor,landmarks,
+//                             observations,imu}.csv
+// Folder layout for the columnar binary format:
+//   <base_path>/<mission_id>/<table>/<column>.bin
+//   <base_path>/<mission_id>/<table>/schema.yaml
+void exportMapStreaming(
+    const vi_map::VIMap& map, const std::string& base_path,
+    const ExportFormat format, StreamingExportStatistics* statistics);
+
+}  // namespace csv_export
+
+#endif  // CSV_EXPORT_STREAMING_EXPORT_H_
@@ -0,0 +1,129 @@
+#ifndef CSV_EXPORT_TABLE_WRITER_H_
+#define CSV_EXPORT_TABLE_WRITER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <maplab-common/macros.h>
+
+namespace csv_export {
+
+enum class ExportFormat {
+  // One human readable CSV file per table.
+  kCsv,
+  // One flat binary file per column plus a schema file per table. All values
+  // are stored in native byte order without any padding, such that a column
+  // can be memory mapped or read with e.g. numpy.fromfile.
+  kColumnarBinary
+};
+
+// Parses "csv" or "columnar". Returns false if the string is not recognized.
+bool exportFormatFromString(const std::string& format, ExportFormat* result);
+std::string exportFormatToString(const ExportFormat format);
+
+// Appends to a file through a fixed-size user-space buffer. Numbers are
+// formatted directly into the buffer, hence no iostream is involved and no
+// flush is triggered per line.
+class BufferedFileWriter {
+ public:
+  BufferedFileWriter(const std::string& filename, size_t buffer_size_bytes);
+  ~BufferedFileWriter();
+
+  void write(const void* data, size_t num_bytes);
+  void write(const char* text);
+  void write(const std::string& text);
+  void write(const char character);
+
+  void writeFormatted(const int64_t value);
+  void writeFormatted(const uint64_t value);
+  void writeFormatted(const double value);
+
+  void flush();
+
+  size_t getNumBytesWritten() const {
+    return num_bytes_written_ + buffer_position_;
+  }
+
+ private:
+  MAPLAB_DISALLOW_EVIL_CONSTRUCTORS(BufferedFileWriter);
+
+  void reserve(size_t num_bytes);
+
+  FILE* file_;
+  std::vector<char> buffer_;
+  size_t buffer_position_;
+  size_t num_bytes_written_;
+};
+
+// Writes a table row by row. The values of a row have to be added in the
+// order of the columns passed at construction, followed by a call to
+// finishRow().
+class TableWriter {
+ public:
+  enum class ColumnType { kInt64, kUInt64, kDouble, kBytes };
+
+  struct Column {
+    Column(const std::string& _name, const std::string& _header,
+           const ColumnType _type)
+        : name(_name), header(_header), type(_type), num_bytes(0u) {}
+    Column(const std::string& _name, const std::string& _header,
+           const size_t _num_bytes)
+        : name(_name),
+          header(_header),
+          type(ColumnType::kBytes),
+          num_bytes(_num_bytes) {}
+
+    // Identifier used for the column files of the binary format. The CSV
+    // header of a kBytes column lists the bytes as <name>_0 to <name>_N-1.
+    std::string name;
+    // Human readable name used for the CSV header.
+    std::string header;
+    ColumnType type;
+    // Only used for kBytes columns: fixed number of bytes per row.
+    size_t num_bytes;
+  };
+  typedef std::vector<Column> ColumnList;
+
+  virtual ~TableWriter() {}
+
+  virtual void addInt64(const int64_t value) = 0;
+  virtual void addUInt64(const uint64_t value) = 0;
+  virtual void addDouble(const double value) = 0;
+  virtual void addBytes(const unsigned char* data, const size_t num_bytes) = 0;
+  virtual void finishRow() = 0;
+
+  // Flushes all buffers and finalizes the output files. Called automatically
+  // on destruction.
+  virtual void close() = 0;
+
+  size_t getNumRows() const {
+    return num_rows_;
+  }
+  virtual size_t getNumBytesWritten() const = 0;
+
+  // Creates the output files for table_name in the folder base_path.
+  static std::unique_ptr<TableWriter> create(
+      const ExportFormat format, const std::string& base_path,
+      const std::string& table_name, const ColumnList& columns,
+      const size_t buffer_size_bytes);
+
+ protected:
+  explicit TableWriter(const ColumnList& columns)
+      : columns_(columns), current_column_(0u), num_rows_(0u) {}
+
+  // Checks that the next value of the row has the given type and advances to
+  // the following column.
+  const Column& advanceColumn(const ColumnType type);
+  void finishRowImpl();
+
+  const ColumnList columns_;
+  size_t current_column_;
+  size_t num_rows_;
+};
+
+}  // namespace csv_export
+
+#endif  // CSV_EXPORT_TABLE_WRITER_H_
@@ -0,0 +1,520 @@
+#include "csv-export/streaming-export.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/progress-bar.h>
+#include <maplab-common/threading-helpers.h>
+#include <vi-map/landmark-quality-metrics.h>
+
+DECLARE_bool(csv_export_vertices);
+DECLARE_bool(csv_export_imu_data);
+DECLARE_bool(csv_export_tracks_and_keypoints);
+DECLARE_bool(csv_export_descriptors);
+DECLARE_bool(csv_export_landmarks);
+DECLARE_bool(csv_export_observations);
+DECLARE_bool(only_export_high_quality_landmarks);
+
+DEFINE_uint64(
+    csv_export_num_threads, 0u,
+    "Number of threads used by the streaming export. 0 uses the number of "
+    "hardware threads.");
+DEFINE_uint64(
+    csv_export_buffer_size_kb, 1024u,
+    "Size of the write buffer of each table of the streaming export in "
+    "kilobytes.");
+
+namespace csv_export {
+namespace {
+
+typedef std::unordered_map<pose_graph::VertexId, size_t> VertexIdToIndexMap;
+
+// Everything a task needs to know about a mission. Filled in before any table
+// is written such that the global vertex and landmark indices are known.
+struct MissionExportInfo {
+  vi_map::MissionId mission_id;
+  std::string base_path;
+  pose_graph::VertexIdList vertex_ids;
+  vi_map::LandmarkIdList landmark_ids;
+  size_t first_vertex_index;
+  size_t first_landmark_index;
+};
+
+enum class ExportTask { kVerticesAndTracks, kLandmarksAndObservations, kImu };
+
+struct ExportTaskStatistics {
+  ExportTaskStatistics() : num_rows(0u), num_bytes(0u) {}
+  void add(const TableWriter& writer) {
+    num_rows += writer.getNumRows();
+    num_bytes += writer.getNumBytesWritten();
+  }
+  size_t num_rows;
+  size_t num_bytes;
+};
+
+size_t getDescriptorSizeBytes(
+    const vi_map::VIMap& map, const pose_graph::VertexIdList& vertex_ids) {
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    const aslam::VisualNFrame& nframe =
+        map.getVertex(vertex_id).getVisualNFrame();
+    for (size_t frame_idx = 0u; frame_idx < nframe.getNumFrames();
+         ++frame_idx) {
+      if (nframe.isFrameSet(frame_idx) &&
+          nframe.getFrame(frame_idx).hasDescriptors()) {
+        return nframe.getFrame(frame_idx).getDescriptorSizeBytes();
+      }
+    }
+  }
+  return 0u;
+}
+
+void addVector3(const Eigen::Vector3d& vector, TableWriter* writer) {
+  CHECK_NOTNULL(writer);
+  writer->addDouble(vector.x());
+  writer->addDouble(vector.y());
+  writer->addDouble(vector.z());
+}
+
+void exportVerticesAndTracks(
+    const vi_map::VIMap& map, const MissionExportInfo& mission_info,
+    const ExportFormat format, const size_t buffer_size_bytes,
+    ExportTaskStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  typedef TableWriter::Column Column;
+  typedef TableWriter::ColumnType ColumnType;
+
+  std::unique_ptr<TableWriter> vertices_writer;
+  if (FLAGS_csv_export_vertices) {
+    vertices_writer = TableWriter::create(
+        format, mission_info.base_path, "vertices",
+        {Column("vertex_index", "vertex index", ColumnType::kUInt64),
+         Column("timestamp_ns", "timestamp [ns]", ColumnType::kInt64),
+         Column("p_x", "position x [m]", ColumnType::kDouble),
+         Column("p_y", "position y [m]", ColumnType::kDouble),
+         Column("p_z", "position z [m]", ColumnType::kDouble),
+         Column("q_x", "quaternion x", ColumnType::kDouble),
+         Column("q_y", "quaternion y", ColumnType::kDouble),
+         Column("q_z", "quaternion z", ColumnType::kDouble),
+         Column("q_w", "quaternion w", ColumnType::kDouble),
+         Column("v_x", "velocity x [m/s]", ColumnType::kDouble),
+         Column("v_y", "velocity y [m/s]", ColumnType::kDouble),
+         Column("v_z", "velocity z [m/s]", ColumnType::kDouble),
+         Column("acc_bias_x", "acc bias x [m/s^2]", ColumnType::kDouble),
+         Column("acc_bias_y", "acc bias y [m/s^2]", ColumnType::kDouble),
+         Column("acc_bias_z", "acc bias z [m/s^2]", ColumnType::kDouble),
+         Column("gyro_bias_x", "gyro bias x [rad/s]", ColumnType::kDouble),
+         Column("gyro_bias_y", "gyro bias y [rad/s]", ColumnType::kDouble),
+         Column("gyro_bias_z", "gyro bias z [rad/s]", ColumnType::kDouble)},
+        buffer_size_bytes);
+  }
+
+  std::unique_ptr<TableWriter> tracks_writer;
+  if (FLAGS_csv_export_tracks_and_keypoints) {
+    tracks_writer = TableWriter::create(
+        format, mission_info.base_path, "tracks",
+        {Column("timestamp_ns", "timestamp [ns]", ColumnType::kInt64),
+         Column("vertex_index", "vertex index", ColumnType::kUInt64),
+         Column("frame_index", "frame index", ColumnType::kUInt64),
+         Column("keypoint_index", "keypoint index", ColumnType::kUInt64),
+         Column(
+             "keypoint_measurement_0", "keypoint measurement 0 [px]",
+             ColumnType::kDouble),
+         Column(
+             "keypoint_measurement_1", "keypoint measurement 1 [px]",
+             ColumnType::kDouble),
+         Column(
+             "keypoint_uncertainty", "keypoint measurement uncertainty",
+             ColumnType::kDouble),
+         Column("keypoint_scale", "keypoint scale", ColumnType::kDouble),
+         Column("track_id", "keypoint track id", ColumnType::kInt64)},
+        buffer_size_bytes);
+  }
+
+  // Rows of the descriptor table correspond to the rows of the tracks table.
+  const size_t descriptor_size_bytes =
+      getDescriptorSizeBytes(map, mission_info.vertex_ids);
+  std::unique_ptr<TableWriter> descriptor_writer;
+  if (FLAGS_csv_export_descriptors && descriptor_size_bytes > 0u) {
+    descriptor_writer = TableWriter::create(
+        format, mission_info.base_path, "descriptor",
+        {Column(
+            "descriptor", "Descriptor byte as integer 1-N",
+            descriptor_size_bytes)},
+        buffer_size_bytes);
+  }
+  const std::vector<unsigned char> empty_descriptor(descriptor_size_bytes, 0u);
+
+  size_t vertex_index = mission_info.first_vertex_index;
+  for (const pose_graph::VertexId& vertex_id : mission_info.vertex_ids) {
+    const vi_map::Vertex& vertex = map.getVertex(vertex_id);
+
+    if (vertices_writer != nullptr) {
+      const aslam::Transformation T_G_I = map.getVertex_T_G_I(vertex_id);
+      vertices_writer->addUInt64(vertex_index);
+      vertices_writer->addInt64(vertex.getMinTimestampNanoseconds());
+      addVector3(T_G_I.getPosition(), vertices_writer.get());
+      const Eigen::Quaterniond& q_G_I = T_G_I.getEigenQuaternion();
+      vertices_writer->addDouble(q_G_I.x());
+      vertices_writer->addDouble(q_G_I.y());
+      vertices_writer->addDouble(q_G_I.z());
+      vertices_writer->addDouble(q_G_I.w());
+      addVector3(vertex.get_v_M(), vertices_writer.get());
+      addVector3(vertex.getAccelBias(), vertices_writer.get());
+      addVector3(vertex.getGyroBias(), vertices_writer.get());
+      vertices_writer->finishRow();
+    }
+
+    if (tracks_writer != nullptr || descriptor_writer != nullptr) {
+      vertex.forEachFrame(
+          [&](const unsigned int frame_index, const aslam::VisualFrame& frame) {
+            const size_t num_keypoints = frame.getNumKeypointMeasurements();
+            const bool has_scales = frame.hasKeypointScales();
+            const bool has_track_ids = frame.hasTrackIds();
+            const bool has_descriptors = frame.hasDescriptors();
+            const int64_t timestamp_ns = frame.getTimestampNanoseconds();
+            const Eigen::Matrix2Xd& keypoint_measurements =
+                frame.getKeypointMeasurements();
+            const Eigen::VectorXd& keypoint_measurement_uncertainties =
+                frame.getKeypointMeasurementUncertainties();
+
+            for (size_t keypoint_idx = 0u; keypoint_idx < num_keypoints;
+                 ++keypoint_idx) {
+              if (tracks_writer != nullptr) {
+                tracks_writer->addInt64(timestamp_ns);
+                tracks_writer->addUInt64(vertex_index);
+                tracks_writer->addUInt64(frame_index);
+                tracks_writer->addUInt64(keypoint_idx);
+                tracks_writer->addDouble(
+                    keypoint_measurements(0, keypoint_idx));
+                tracks_writer->addDouble(
+                    keypoint_measurements(1, keypoint_idx));
+                tracks_writer->addDouble(
+                    keypoint_measurement_uncertainties(keypoint_idx));
+                // Missing scales and track ids are exported as -1.
+                tracks_writer->addDouble(
+                    has_scales ? frame.getKeypointScale(keypoint_idx) : -1.0);
+                tracks_writer->addInt64(
+                    has_track_ids ? frame.getTrackId(keypoint_idx) : -1);
+                tracks_writer->finishRow();
+              }
+
+              if (descriptor_writer != nullptr) {
+                if (has_descriptors) {
+                  CHECK_EQ(
+                      frame.getDescriptorSizeBytes(), descriptor_size_bytes);
+                  descriptor_writer->addBytes(
+                      CHECK_NOTNULL(frame.getDescriptor(keypoint_idx)),
+                      descriptor_size_bytes);
+                } else {
+                  descriptor_writer->addBytes(
+                      empty_descriptor.data(), descriptor_size_bytes);
+                }
+                descriptor_writer->finishRow();
+              }
+            }
+          });
+    }
+    ++vertex_index;
+  }
+
+  for (TableWriter* writer :
+       {vertices_writer.get(), tracks_writer.get(), descriptor_writer.get()}) {
+    if (writer != nullptr) {
+      writer->close();
+      statistics->add(*writer);
+    }
+  }
+}
+
+void exportLandmarksAndObservations(
+    const vi_map::VIMap& map, const MissionExportInfo& mission_info,
+    const VertexIdToIndexMap& vertex_id_to_index_map,
+    const ExportFormat format, const size_t buffer_size_bytes,
+    ExportTaskStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  typedef TableWriter::Column Column;
+  typedef TableWriter::ColumnType ColumnType;
+
+  std::unique_ptr<TableWriter> landmarks_writer;
+  if (FLAGS_csv_export_landmarks) {
+    landmarks_writer = TableWriter::create(
+        format, mission_info.base_path, "landmarks",
+        {Column("landmark_index", "landmark index", ColumnType::kUInt64),
+         Column("p_x", "landmark position x [m]", ColumnType::kDouble),
+         Column("p_y", "landmark position y [m]", ColumnType::kDouble),
+         Column("p_z", "landmark position z [m]", ColumnType::kDouble)},
+        buffer_size_bytes);
+  }
+
+  std::unique_ptr<TableWriter> observations_writer;
+  if (FLAGS_csv_export_observations) {
+    observations_writer = TableWriter::create(
+        format, mission_info.base_path, "observations",
+        {Column("vertex_index", "vertex index", ColumnType::kUInt64),
+         Column("frame_index", "frame index", ColumnType::kUInt64),
+         Column("keypoint_index", "keypoint index", ColumnType::kUInt64),
+         Column("landmark_index", "landmark index", ColumnType::kUInt64)},
+        buffer_size_bytes);
+  }
+
+  size_t landmark_index = mission_info.first_landmark_index;
+  for (const vi_map::LandmarkId& landmark_id : mission_info.landmark_ids) {
+    if (landmarks_writer != nullptr) {
+      landmarks_writer->addUInt64(landmark_index);
+      addVector3(map.getLandmark_G_p_fi(landmark_id), landmarks_writer.get());
+      landmarks_writer->finishRow();
+    }
+
+    if (observations_writer != nullptr) {
+      const vi_map::KeypointIdentifierList& observations =
+          map.getLandmark(landmark_id).getObservations();
+      for (const vi_map::KeypointIdentifier& observation : observations) {
+        const VertexIdToIndexMap::const_iterator it_vertex_id_to_index =
+            vertex_id_to_index_map.find(observation.frame_id.vertex_id);
+        CHECK(it_vertex_id_to_index != vertex_id_to_index_map.end());
+        observations_writer->addUInt64(it_vertex_id_to_index->second);
+        observations_writer->addUInt64(observation.frame_id.frame_index);
+        observations_writer->addUInt64(observation.keypoint_index);
+        observations_writer->addUInt64(landmark_index);
+        observations_writer->finishRow();
+      }
+    }
+    ++landmark_index;
+  }
+
+  for (TableWriter* writer :
+       {landmarks_writer.get(), observations_writer.get()}) {
+    if (writer != nullptr) {
+      writer->close();
+      statistics->add(*writer);
+    }
+  }
+}
+
+void exportImuData(
+    const vi_map::VIMap& map, const MissionExportInfo& mission_info,
+    const ExportFormat format, const size_t buffer_size_bytes,
+    ExportTaskStatistics* statistics) {
+  CHECK_NOTNULL(statistics);
+  typedef TableWriter::Column Column;
+  typedef TableWriter::ColumnType ColumnType;
+
+  std::unique_ptr<TableWriter> imu_writer = TableWriter::create(
+      format, mission_info.base_path, "imu",
+      {Column("timestamp_ns", "timestamp [ns]", ColumnType::kInt64),
+       Column("acc_x", "acc x [m/s^2]", ColumnType::kDouble),
+       Column("acc_y", "acc y [m/s^2]", ColumnType::kDouble),
+       Column("acc_z", "acc z [m/s^2]", ColumnType::kDouble),
+       Column("gyro_x", "gyro x [rad/s]", ColumnType::kDouble),
+       Column("gyro_y", "gyro y [rad/s]", ColumnType::kDouble),
+       Column("gyro_z", "gyro z [rad/s]", ColumnType::kDouble)},
+      buffer_size_bytes);
+
+  pose_graph::EdgeIdList edge_ids;
+  map.getAllEdgeIdsInMissionAlongGraph(
+      mission_info.mission_id, pose_graph::Edge::EdgeType::kViwls, &edge_ids);
+  for (const pose_graph::EdgeId& edge_id : edge_ids) {
+    const vi_map::ViwlsEdge& viwls_edge =
+        map.getEdgeAs<vi_map::ViwlsEdge>(edge_id);
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps =
+        viwls_edge.getImuTimestamps();
+    const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data =
+        viwls_edge.getImuData();
+    const int num_measurements = imu_timestamps.cols();
+    CHECK_EQ(num_measurements, imu_data.cols());
+    for (int i = 0; i < num_measurements; ++i) {
+      imu_writer->addInt64(imu_timestamps(i));
+      for (int row = 0; row < 6; ++row) {
+        imu_writer->addDouble(imu_data(row, i));
+      }
+      imu_writer->finishRow();
+    }
+  }
+  imu_writer->close();
+  statistics->add(*imu_writer);
+}
+
+}  // namespace
+
+void exportMapStreaming(
+    const vi_map::VIMap& map, const std::string& base_path,
+    const ExportFormat format, StreamingExportStatistics* statistics) {
+  CHECK(!base_path.empty());
+  CHECK(common::createPath(base_path));
+  CHECK_GT(FLAGS_csv_export_buffer_size_kb, 0u);
+
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  const size_t buffer_size_bytes = FLAGS_csv_export_buffer_size_kb * 1024u;
+  const size_t num_threads = (FLAGS_csv_export_num_threads > 0u)
+                                 ? FLAGS_csv_export_num_threads
+                                 : common::getNumHardwareThreads();
+
+  vi_map::MissionIdList mission_ids;
+  map.getAllMissionIds(&mission_ids);
+  const size_t num_missions = mission_ids.size();
+  if (num_missions == 0u) {
+    LOG(WARNING) << "The map contains no missions, nothing to export.";
+    return;
+  }
+
+  // Collect the vertices and landmarks of all missions in parallel.
+  std::vector<MissionExportInfo> mission_infos(num_missions);
+  const bool export_landmark_tables =
+      FLAGS_csv_export_landmarks || FLAGS_csv_export_observations;
+  common::ParallelProcess(
+      num_missions,
+      [&](const std::vector<size_t>& range) {
+        for (const size_t mission_idx : range) {
+          MissionExportInfo& info = mission_infos[mission_idx];
+          info.mission_id = mission_ids[mission_idx];
+          info.base_path = common::concatenateFolderAndFileName(
+              base_path, info.mission_id.hexString());
+          map.getAllVertexIdsInMissionAlongGraph(
+              info.mission_id, &info.vertex_ids);
+          if (!export_landmark_tables) {
+            continue;
+          }
+          vi_map::LandmarkIdList landmark_ids;
+          map.getAllLandmarkIdsInMission(info.mission_id, &landmark_ids);
+          info.landmark_ids.reserve(landmark_ids.size());
+          for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+            if (!landmark_id.isValid()) {
+              continue;
+            }
+            if (FLAGS_only_export_high_quality_landmarks &&
+                !vi_map::isLandmarkWellConstrained(
+                    map, map.getLandmark(landmark_id))) {
+              continue;
+            }
+            info.landmark_ids.emplace_back(landmark_id);
+          }
+        }
+      },
+      true /*always_parallelize*/, num_threads);
+
+  // Assign the global indices in mission order.
+  size_t num_vertices = 0u;
+  size_t num_landmarks = 0u;
+  for (MissionExportInfo& info : mission_infos) {
+    CHECK(common::createPath(info.base_path));
+    info.first_vertex_index = num_vertices;
+    info.first_landmark_index = num_landmarks;
+    num_vertices += info.vertex_ids.size();
+    num_landmarks += info.landmark_ids.size();
+  }
+  VertexIdToIndexMap vertex_id_to_index_map;
+  if (FLAGS_csv_export_observations) {
+    vertex_id_to_index_map.reserve(num_vertices);
+    for (const MissionExportInfo& info : mission_infos) {
+      size_t vertex_index = info.first_vertex_index;
+      for (const pose_graph::VertexId& vertex_id : info.vertex_ids) {
+        vertex_id_to_index_map.emplace(vertex_id, vertex_index++);
+      }
+    }
+  }
+
+  // Every table group of every mission is an independent task.
+  typedef std::pair<size_t, ExportTask> MissionTask;
+  std::vector<MissionTask> tasks;
+  for (size_t mission_idx = 0u; mission_idx < num_missions; ++mission_idx) {
+    if (FLAGS_csv_export_vertices || FLAGS_csv_export_tracks_and_keypoints ||
+        FLAGS_csv_export_descriptors) {
+      tasks.emplace_back(mission_idx, ExportTask::kVerticesAndTracks);
+    }
+    if (export_landmark_tables) {
+      tasks.emplace_back(mission_idx, ExportTask::kLandmarksAndObservations);
+    }
+    if (FLAGS_csv_export_imu_data) {
+      tasks.emplace_back(mission_idx, ExportTask::kImu);
+    }
+  }
+  // Process the largest tasks first to balance the load over the threads.
+  std::stable_sort(
+      tasks.begin(), tasks.end(),
+      [&mission_infos](const MissionTask& lhs, const MissionTask& rhs) {
+        return mission_infos[lhs.first].vertex_ids.size() >
+               mission_infos[rhs.first].vertex_ids.size();
+      });
+  if (tasks.empty()) {
+    LOG(WARNING) << "All tables are disabled, nothing to export.";
+    return;
+  }
+
+  LOG(INFO) << "Exporting " << num_vertices << " vertices and "
+            << num_landmarks << " landmarks of " << num_missions
+            << " missions as " << exportFormatToString(format) << " using "
+            << std::min(num_threads, tasks.size()) << " threads.";
+
+  // ParallelProcess splits the items into contiguous blocks, which would hand
+  // the largest tasks to the same thread. Instead, every thread pulls the
+  // next task from a shared counter until all tasks are done.
+  const size_t num_workers = std::min(num_threads, tasks.size());
+  std::vector<ExportTaskStatistics> task_statistics(tasks.size());
+  std::atomic<size_t> next_task_idx(0u);
+  std::mutex progress_bar_mutex;
+  common::ProgressBar progress_bar(tasks.size());
+  common::ParallelProcess(
+      num_workers,
+      [&](const std::vector<size_t>& /*workers*/) {
+        for (size_t task_idx = next_task_idx++; task_idx < tasks.size();
+             task_idx = next_task_idx++) {
+          const MissionExportInfo& info = mission_infos[tasks[task_idx].first];
+          ExportTaskStatistics* statistics = &task_statistics[task_idx];
+          switch (tasks[task_idx].second) {
+            case ExportTask::kVerticesAndTracks:
+              exportVerticesAndTracks(
+                  map, info, format, buffer_size_bytes, statistics);
+              break;
+            case ExportTask::kLandmarksAndObservations:
+              exportLandmarksAndObservations(
+                  map, info, vertex_id_to_index_map, format, buffer_size_bytes,
+                  statistics);
+              break;
+            case ExportTask::kImu:
+              exportImuData(map, info, format, buffer_size_bytes, statistics);
+              break;
+            default:
+              LOG(FATAL) << "Unknown export task.";
+          }
+          std::lock_guard<std::mutex> lock(progress_bar_mutex);
+          progress_bar.increment();
+        }
+      },
+      true /*always_parallelize*/, num_workers);
+
+  StreamingExportStatistics total_statistics;
+  for (const ExportTaskStatistics& statistics : task_statistics) {
+    total_statistics.num_rows += statistics.num_rows;
+    total_statistics.num_bytes += statistics.num_bytes;
+  }
+  total_statistics.duration_seconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start_time)
+          .count();
+
+  const double duration_seconds =
+      std::max(total_statistics.duration_seconds, 1e-9);
+  LOG(INFO) << "Exported " << total_statistics.num_rows << " rows ("
+            << total_statistics.num_bytes / (1024.0 * 1024.0) << " MiB) in "
+            << total_statistics.duration_seconds << " s: "
+            << total_statistics.num_rows / duration_seconds << " rows/s, "
+            << total_statistics.num_bytes / (1024.0 * 1024.0) /
+                   duration_seconds
+            << " MiB/s.";
+
+  if (statistics != nullptr) {
+    *statistics = total_statistics;
+  }
+}
+
+}  // namespace csv_export
@@ -0,0 +1,380 @@
+#include "csv-export/table-writer.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <string>
+
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+
+namespace csv_export {
+namespace {
+
+static constexpr char kCsvDelimiter[] = ", ";
+static constexpr char kFormatInt64[] = "%" PRId64;
+static constexpr char kFormatUInt64[] = "%" PRIu64;
+// Enough significant digits to represent positions and timestamps without
+// the truncation of the default iostream precision of 6.
+static constexpr char kFormatDouble[] = "%.10g";
+// Upper bound of the number of characters a single formatted value takes.
+constexpr size_t kMaxFormattedValueLength = 32u;
+// Smallest buffer that can hold any formatted value.
+constexpr size_t kMinBufferSizeBytes = kMaxFormattedValueLength + 1u;
+
+const char* columnTypeToString(const TableWriter::ColumnType type) {
+  switch (type) {
+    case TableWriter::ColumnType::kInt64:
+      return "int64";
+    case TableWriter::ColumnType::kUInt64:
+      return "uint64";
+    case TableWriter::ColumnType::kDouble:
+      return "float64";
+    case TableWriter::ColumnType::kBytes:
+      return "bytes";
+    default:
+      LOG(FATAL) << "Unknown column type: " << static_cast<int>(type);
+  }
+  return "";
+}
+
+class CsvTableWriter : public TableWriter {
+ public:
+  CsvTableWriter(
+      const std::string& filename, const ColumnList& columns,
+      const size_t buffer_size_bytes)
+      : TableWriter(columns), file_(filename, buffer_size_bytes) {
+    for (size_t column_idx = 0u; column_idx < columns_.size(); ++column_idx) {
+      if (column_idx != 0u) {
+        file_.write(kCsvDelimiter);
+      }
+      const Column& column = columns_[column_idx];
+      if (column.type != ColumnType::kBytes) {
+        file_.write(column.header);
+        continue;
+      }
+      // Every byte is written as a field of its own, so every byte gets a
+      // header as well.
+      for (size_t byte_idx = 0u; byte_idx < column.num_bytes; ++byte_idx) {
+        if (byte_idx != 0u) {
+          file_.write(kCsvDelimiter);
+        }
+        file_.write(column.name + "_" + std::to_string(byte_idx));
+      }
+    }
+    file_.write('\n');
+  }
+
+  ~CsvTableWriter() {
+    close();
+  }
+
+  void addInt64(const int64_t value) override {
+    writeDelimiterIfNeeded();
+    advanceColumn(ColumnType::kInt64);
+    file_.writeFormatted(value);
+  }
+
+  void addUInt64(const uint64_t value) override {
+    writeDelimiterIfNeeded();
+    advanceColumn(ColumnType::kUInt64);
+    file_.writeFormatted(value);
+  }
+
+  void addDouble(const double value) override {
+    writeDelimiterIfNeeded();
+    advanceColumn(ColumnType::kDouble);
+    file_.writeFormatted(value);
+  }
+
+  void addBytes(const unsigned char* data, const size_t num_bytes) override {
+    CHECK_NOTNULL(data);
+    writeDelimiterIfNeeded();
+    const Column& column = advanceColumn(ColumnType::kBytes);
+    CHECK_EQ(num_bytes, column.num_bytes);
+    for (size_t byte_idx = 0u; byte_idx < num_bytes; ++byte_idx) {
+      if (byte_idx != 0u) {
+        file_.write(kCsvDelimiter);
+      }
+      file_.writeFormatted(static_cast<uint64_t>(data[byte_idx]));
+    }
+  }
+
+  void finishRow() override {
+    finishRowImpl();
+    file_.write('\n');
+  }
+
+  void close() override {
+    file_.flush();
+  }
+
+  size_t getNumBytesWritten() const override {
+    return file_.getNumBytesWritten();
+  }
+
+ private:
+  void writeDelimiterIfNeeded() {
+    if (current_column_ != 0u) {
+      file_.write(kCsvDelimiter);
+    }
+  }
+
+  BufferedFileWriter file_;
+};
+
+class ColumnarBinaryTableWriter : public TableWriter {
+ public:
+  ColumnarBinaryTableWriter(
+      const std::string& table_folder, const ColumnList& columns,
+      const size_t buffer_size_bytes)
+      : TableWriter(columns), table_folder_(table_folder), is_closed_(false) {
+    CHECK(common::createPath(table_folder_));
+    // Distribute the buffer over the column files to keep the memory footprint
+    // independent of the number of columns.
+    const size_t buffer_size_per_column = std::max<size_t>(
+        buffer_size_bytes / columns_.size(), kMinBufferSizeBytes);
+    for (const Column& column : columns_) {
+      column_files_.emplace_back(
+          new BufferedFileWriter(
+              common::concatenateFolderAndFileName(
+                  table_folder_, column.name + ".bin"),
+              buffer_size_per_column));
+    }
+  }
+
+  ~ColumnarBinaryTableWriter() {
+    close();
+  }
+
+  void addInt64(const int64_t value) override {
+    const size_t column_idx = current_column_;
+    advanceColumn(ColumnType::kInt64);
+    column_files_[column_idx]->write(&value, sizeof(value));
+  }
+
+  void addUInt64(const uint64_t value) override {
+    const size_t column_idx = current_column_;
+    advanceColumn(ColumnType::kUInt64);
+    column_files_[column_idx]->write(&value, sizeof(value));
+  }
+
+  void addDouble(const double value) override {
+    const size_t column_idx = current_column_;
+    advanceColumn(ColumnType::kDouble);
+    column_files_[column_idx]->write(&value, sizeof(value));
+  }
+
+  void addBytes(const unsigned char* data, const size_t num_bytes) override {
+    CHECK_NOTNULL(data);
+    const size_t column_idx = current_column_;
+    const Column& column = advanceColumn(ColumnType::kBytes);
+    CHECK_EQ(num_bytes, column.num_bytes);
+    column_files_[column_idx]->write(data, num_bytes);
+  }
+
+  void finishRow() override {
+    finishRowImpl();
+  }
+
+  void close() override {
+    if (is_closed_) {
+      return;
+    }
+    for (const std::unique_ptr<BufferedFileWriter>& column_file :
+         column_files_) {
+      column_file->flush();
+    }
+    writeSchema();
+    is_closed_ = true;
+  }
+
+  size_t getNumBytesWritten() const override {
+    size_t num_bytes = 0u;
+    for (const std::unique_ptr<BufferedFileWriter>& column_file :
+         column_files_) {
+      num_bytes += column_file->getNumBytesWritten();
+    }
+    return num_bytes;
+  }
+
+ private:
+  // The schema is written last such that its presence marks a complete table.
+  void writeSchema() const {
+    BufferedFileWriter schema_file(
+        common::concatenateFolderAndFileName(table_folder_, "schema.yaml"),
+        4096u);
+    schema_file.write("num_rows: ");
+    schema_file.writeFormatted(static_cast<uint64_t>(num_rows_));
+    schema_file.write("\ncolumns:\n");
+    for (const Column& column : columns_) {
+      schema_file.write("  - name: " + column.name + "\n");
+      schema_file.write("    description: \"" + column.header + "\"\n");
+      schema_file.write("    type: ");
+      schema_file.write(columnTypeToString(column.type));
+      schema_file.write("\n    bytes_per_row: ");
+      const size_t bytes_per_row = (column.type == ColumnType::kBytes)
+                                       ? column.num_bytes
+                                       : sizeof(int64_t);
+      schema_file.writeFormatted(static_cast<uint64_t>(bytes_per_row));
+      schema_file.write("\n    file: " + column.name + ".bin\n");
+    }
+  }
+
+  const std::string table_folder_;
+  std::vector<std::unique_ptr<BufferedFileWriter>> column_files_;
+  bool is_closed_;
+};
+
+}  // namespace
+
+bool exportFormatFromString(const std::string& format, ExportFormat* result) {
+  CHECK_NOTNULL(result);
+  if (format == "csv") {
+    *result = ExportFormat::kCsv;
+    return true;
+  } else if (format == "columnar") {
+    *result = ExportFormat::kColumnarBinary;
+    return true;
+  }
+  return false;
+}
+
+std::string exportFormatToString(const ExportFormat format) {
+  switch (format) {
+    case ExportFormat::kCsv:
+      return "csv";
+    case ExportFormat::kColumnarBinary:
+      return "columnar";
+    default:
+      LOG(FATAL) << "Unknown export format: " << static_cast<int>(format);
+  }
+  return "";
+}
+
+BufferedFileWriter::BufferedFileWriter(
+    const std::string& filename, size_t buffer_size_bytes)
+    : file_(nullptr), buffer_position_(0u), num_bytes_written_(0u) {
+  CHECK(!filename.empty());
+  CHECK_GT(buffer_size_bytes, kMaxFormattedValueLength);
+  file_ = fopen(filename.c_str(), "wb");
+  CHECK(file_ != nullptr) << "Unable to open file " << filename
+                          << " for writing.";
+  // The data is already buffered here, hence flush() writes directly to the
+  // file instead of copying into a second stdio buffer.
+  CHECK_EQ(setvbuf(file_, nullptr, _IONBF, 0u), 0);
+  buffer_.resize(buffer_size_bytes);
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+  flush();
+  CHECK_EQ(fclose(file_), 0);
+}
+
+void BufferedFileWriter::reserve(size_t num_bytes) {
+  if (buffer_position_ + num_bytes > buffer_.size()) {
+    flush();
+  }
+}
+
+void BufferedFileWriter::write(const void* data, size_t num_bytes) {
+  CHECK_NOTNULL(data);
+  if (num_bytes >= buffer_.size()) {
+    // Large blocks bypass the buffer.
+    flush();
+    CHECK_EQ(fwrite(data, 1u, num_bytes, file_), num_bytes);
+    num_bytes_written_ += num_bytes;
+    return;
+  }
+  reserve(num_bytes);
+  memcpy(buffer_.data() + buffer_position_, data, num_bytes);
+  buffer_position_ += num_bytes;
+}
+
+void BufferedFileWriter::write(const char* text) {
+  CHECK_NOTNULL(text);
+  write(text, strlen(text));
+}
+
+void BufferedFileWriter::write(const std::string& text) {
+  write(text.data(), text.size());
+}
+
+void BufferedFileWriter::write(const char character) {
+  reserve(1u);
+  buffer_[buffer_position_] = character;
+  ++buffer_position_;
+}
+
+void BufferedFileWriter::writeFormatted(const int64_t value) {
+  reserve(kMaxFormattedValueLength);
+  buffer_position_ += snprintf(
+      buffer_.data() + buffer_position_, kMaxFormattedValueLength, kFormatInt64,
+      value);
+}
+
+void BufferedFileWriter::writeFormatted(const uint64_t value) {
+  reserve(kMaxFormattedValueLength);
+  buffer_position_ += snprintf(
+      buffer_.data() + buffer_position_, kMaxFormattedValueLength,
+      kFormatUInt64, value);
+}
+
+void BufferedFileWriter::writeFormatted(const double value) {
+  reserve(kMaxFormattedValueLength);
+  buffer_position_ += snprintf(
+      buffer_.data() + buffer_position_, kMaxFormattedValueLength,
+      kFormatDouble, value);
+}
+
+void BufferedFileWriter::flush() {
+  if (buffer_position_ == 0u) {
+    return;
+  }
+  CHECK_EQ(fwrite(buffer_.data(), 1u, buffer_position_, file_), buffer_position_);
+  num_bytes_written_ += buffer_position_;
+  buffer_position_ = 0u;
+}
+
+const TableWriter::Column& TableWriter::advanceColumn(const ColumnType type) {
+  CHECK_LT(current_column_, columns_.size())
+      << "Too many values for a single row.";
+  const Column& column = columns_[current_column_];
+  CHECK(column.type == type) << "Column " << column.name << " is of type "
+                             << columnTypeToString(column.type) << " but got "
+                             << columnTypeToString(type) << ".";
+  ++current_column_;
+  return column;
+}
+
+void TableWriter::finishRowImpl() {
+  CHECK_EQ(current_column_, columns_.size())
+      << "A row needs a value for every column.";
+  current_column_ = 0u;
+  ++num_rows_;
+}
+
+std::unique_ptr<TableWriter> TableWriter::create(
+    const ExportFormat format, const std::string& base_path,
+    const std::string& table_name, const ColumnList& columns,
+    const size_t buffer_size_bytes) {
+  CHECK(!columns.empty());
+  switch (format) {
+    case ExportFormat::kCsv:
+      return std::unique_ptr<TableWriter>(
+          new CsvTableWriter(
+              common::concatenateFolderAndFileName(
+                  base_path, table_name + ".csv"),
+              columns, buffer_size_bytes));
+    case ExportFormat::kColumnarBinary:
+      return std::unique_ptr<TableWriter>(
+          new ColumnarBinaryTableWriter(
+              common::concatenateFolderAndFileName(base_path, table_name),
+              columns, buffer_size_bytes));
+    default:
+      LOG(FATAL) << "Unknown export format: " << static_cast<int>(format);
+  }
+  return nullptr;
+}
+
+}  // namespace csv_export
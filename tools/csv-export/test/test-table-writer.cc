@@ -0,0 +1,165 @@
+#include <cstdint>
+#include <fstream>  // NOLINT
+#include <string>
+#include <vector>
+
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/stringprintf.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "csv-export/table-writer.h"
+
+namespace csv_export {
+namespace {
+constexpr size_t kNumRows = 1000u;
+constexpr size_t kDescriptorSizeBytes = 2u;
+// Small enough to force many intermediate flushes.
+constexpr size_t kBufferSizeBytes = 100u;
+}  // namespace
+
+class TableWriterTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    typedef TableWriter::Column Column;
+    typedef TableWriter::ColumnType ColumnType;
+    columns_ = {Column("index", "index", ColumnType::kUInt64),
+                Column("timestamp_ns", "timestamp [ns]", ColumnType::kInt64),
+                Column("value", "value [m]", ColumnType::kDouble),
+                Column("descriptor", "descriptor", kDescriptorSizeBytes)};
+    ASSERT_TRUE(common::createPath(kBasePath));
+  }
+
+  void writeTable(const ExportFormat format) {
+    std::unique_ptr<TableWriter> writer = TableWriter::create(
+        format, kBasePath, "table", columns_, kBufferSizeBytes);
+    for (size_t row = 0u; row < kNumRows; ++row) {
+      const unsigned char descriptor[kDescriptorSizeBytes] = {
+          static_cast<unsigned char>(row), 255u};
+      writer->addUInt64(row);
+      writer->addInt64(-static_cast<int64_t>(row));
+      writer->addDouble(0.5 * row);
+      writer->addBytes(descriptor, kDescriptorSizeBytes);
+      writer->finishRow();
+    }
+    writer->close();
+    EXPECT_EQ(kNumRows, writer->getNumRows());
+  }
+
+  static size_t getFileSize(const std::string& file_path) {
+    std::ifstream reader(file_path, std::ios::binary | std::ios::ate);
+    EXPECT_TRUE(reader.good()) << file_path;
+    return reader.good() ? static_cast<size_t>(reader.tellg()) : 0u;
+  }
+
+  const std::string kBasePath = "table_writer_test";
+  TableWriter::ColumnList columns_;
+};
+
+TEST_F(TableWriterTest, CsvOutputIsCorrect) {
+  writeTable(ExportFormat::kCsv);
+
+  std::ifstream reader(
+      common::concatenateFolderAndFileName(kBasePath, "table.csv"));
+  ASSERT_TRUE(reader.good());
+  std::string line;
+  std::getline(reader, line);
+  EXPECT_EQ(
+      "index, timestamp [ns], value [m], descriptor_0, descriptor_1", line);
+  for (size_t row = 0u; row < kNumRows; ++row) {
+    std::getline(reader, line);
+    const std::string expected_line = std::to_string(row) + ", " +
+                                      (row == 0u ? "" : "-") +
+                                      std::to_string(row) + ", " +
+                                      common::StringPrintf("%.10g", 0.5 * row) +
+                                      ", " + std::to_string(row % 256u) +
+                                      ", 255";
+    ASSERT_EQ(expected_line, line);
+  }
+  std::getline(reader, line);
+  EXPECT_TRUE(reader.eof());
+}
+
+TEST_F(TableWriterTest, FullBuffersAreFlushedBeforeClosing) {
+  for (const ExportFormat format :
+       {ExportFormat::kCsv, ExportFormat::kColumnarBinary}) {
+    std::unique_ptr<TableWriter> writer = TableWriter::create(
+        format, kBasePath, "flushed_table", columns_, kBufferSizeBytes);
+    for (size_t row = 0u; row < kNumRows; ++row) {
+      const unsigned char descriptor[kDescriptorSizeBytes] = {0u, 0u};
+      writer->addUInt64(row);
+      writer->addInt64(0);
+      writer->addDouble(0.0);
+      writer->addBytes(descriptor, kDescriptorSizeBytes);
+      writer->finishRow();
+    }
+
+    // At most one buffer per file is still held in memory.
+    const std::string file_path =
+        format == ExportFormat::kCsv
+            ? common::concatenateFolderAndFileName(
+                  kBasePath, "flushed_table.csv")
+            : common::concatenateFolderAndFileName(
+                  common::concatenateFolderAndFileName(
+                      kBasePath, "flushed_table"),
+                  "descriptor.bin");
+    const size_t num_bytes_in_file = getFileSize(file_path);
+    EXPECT_GT(num_bytes_in_file, 0u);
+    writer->close();
+    const size_t num_bytes_after_close = getFileSize(file_path);
+    EXPECT_GT(num_bytes_after_close, num_bytes_in_file);
+    EXPECT_LE(num_bytes_after_close - num_bytes_in_file, kBufferSizeBytes);
+    if (format == ExportFormat::kColumnarBinary) {
+      EXPECT_EQ(kNumRows * kDescriptorSizeBytes, num_bytes_after_close);
+    }
+  }
+}
+
+TEST_F(TableWriterTest, ColumnarOutputIsCorrect) {
+  writeTable(ExportFormat::kColumnarBinary);
+
+  const std::string table_folder =
+      common::concatenateFolderAndFileName(kBasePath, "table");
+  EXPECT_TRUE(common::fileExists(
+      common::concatenateFolderAndFileName(table_folder, "schema.yaml")));
+
+  std::ifstream index_reader(
+      common::concatenateFolderAndFileName(table_folder, "index.bin"),
+      std::ios::binary);
+  std::ifstream value_reader(
+      common::concatenateFolderAndFileName(table_folder, "value.bin"),
+      std::ios::binary);
+  std::ifstream descriptor_reader(
+      common::concatenateFolderAndFileName(table_folder, "descriptor.bin"),
+      std::ios::binary);
+  ASSERT_TRUE(index_reader.good());
+  ASSERT_TRUE(value_reader.good());
+  ASSERT_TRUE(descriptor_reader.good());
+
+  std::vector<uint64_t> indices(kNumRows);
+  index_reader.read(
+      reinterpret_cast<char*>(indices.data()), kNumRows * sizeof(uint64_t));
+  std::vector<double> values(kNumRows);
+  value_reader.read(
+      reinterpret_cast<char*>(values.data()), kNumRows * sizeof(double));
+  std::vector<unsigned char> descriptors(kNumRows * kDescriptorSizeBytes);
+  descriptor_reader.read(
+      reinterpret_cast<char*>(descriptors.data()), descriptors.size());
+  ASSERT_TRUE(index_reader.good());
+  ASSERT_TRUE(value_reader.good());
+  ASSERT_TRUE(descriptor_reader.good());
+
+  for (size_t row = 0u; row < kNumRows; ++row) {
+    EXPECT_EQ(row, indices[row]);
+    EXPECT_EQ(0.5 * row, values[row]);
+    EXPECT_EQ(row % 256u, descriptors[row * kDescriptorSizeBytes]);
+    EXPECT_EQ(255u, descriptors[row * kDescriptorSizeBytes + 1u]);
+  }
+
+  // No trailing data.
+  index_reader.peek();
+  EXPECT_TRUE(index_reader.eof());
+}
+
+}  // namespace csv_export
+
+MAPLAB_UNITTEST_ENTRYPOINT
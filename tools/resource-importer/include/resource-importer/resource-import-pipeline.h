@@ -0,0 +1,102 @@
+#ifndef RESOURCE_IMPORTER_RESOURCE_IMPORT_PIPELINE_H_
+#define RESOURCE_IMPORTER_RESOURCE_IMPORT_PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <aslam/common/thread-pool.h>
+#include <aslam/common/unique-id.h>
+#include <map-resources/resource-map.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <vi-map/vi-map.h>
+
+// Imports image and point cloud messages as optional camera resources into a
+// mission. The messages are passed in by the (sequential) rosbag reader, then
+// converted and written to the resource folder by a pool of workers. A single
+// writer thread attaches the written resources to the map in message order and
+// in batches, such that the map itself is only ever modified by one thread.
+//
+// The number of messages that have been read but not yet attached to the map
+// is bounded, the reader blocks when this limit is reached.
+class ResourceImportPipeline {
+ public:
+  struct Settings {
+    // Number of conversion/encoding workers. If zero, every message is
+    // processed synchronously in the thread that passes it in.
+    size_t num_workers = 4u;
+    // Maximum number of messages in flight before the reader blocks.
+    size_t max_messages_in_flight = 64u;
+    // Number of resources attached to the map at once.
+    size_t write_batch_size = 32u;
+  };
+
+  // The visualizer is optional and is only called in synchronous mode.
+  typedef std::function<void(const cv::Mat&)> ImageVisualizer;
+
+  ResourceImportPipeline(
+      const Settings& settings, const aslam::CameraId& camera_id,
+      const int64_t time_offset_ns, vi_map::VIMission* mission,
+      vi_map::VIMap* map);
+  ~ResourceImportPipeline();
+
+  void setImageVisualizer(const ImageVisualizer& visualizer);
+
+  // Block if the maximum number of messages is in flight.
+  void addImageMessage(sensor_msgs::ImageConstPtr image_message);
+  void addPointCloudMessage(sensor_msgs::PointCloud2ConstPtr point_cloud_msg);
+
+  // Blocks until all messages passed in so far are attached to the map.
+  void finish();
+
+ private:
+  struct ConvertedResource {
+    bool is_valid = false;
+    int64_t timestamp_ns = -1;
+    backend::ResourceMap::PendingResource pending_resource;
+  };
+
+  void waitForFreeSlot();
+  void enqueue(const std::function<ConvertedResource()>& conversion);
+
+  ConvertedResource convertImage(
+      sensor_msgs::ImageConstPtr image_message) const;
+  ConvertedResource convertPointCloud(
+      sensor_msgs::PointCloud2ConstPtr point_cloud_msg) const;
+
+  void addConvertedResource(
+      const size_t sequence_number, const ConvertedResource& resource);
+  void writerThreadWorker();
+
+  const Settings settings_;
+  const aslam::CameraId camera_id_;
+  const int64_t time_offset_ns_;
+  vi_map::VIMission* const mission_;
+  vi_map::VIMap* const map_;
+  ImageVisualizer visualizer_;
+
+  std::unique_ptr<aslam::ThreadPool> worker_pool_;
+  std::thread writer_thread_;
+
+  // Guards all members below.
+  std::mutex mutex_;
+  // Signaled when a converted resource arrives or when finishing.
+  std::condition_variable cv_converted_;
+  // Signaled when a message has been attached to the map.
+  std::condition_variable cv_written_;
+  // Converted resources waiting for their predecessors to be written.
+  std::map<size_t, ConvertedResource> converted_resources_;
+  size_t num_messages_added_;
+  size_t num_messages_written_;
+  bool shutdown_;
+
+  std::atomic<size_t> num_resources_imported_;
+};
+
+#endif  // RESOURCE_IMPORTER_RESOURCE_IMPORT_PIPELINE_H_
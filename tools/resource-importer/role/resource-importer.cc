@@ -1,3 +1,4 @@
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -7,6 +8,7 @@
 #include <map-resources/resource-conversion.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/map-manager-config.h>
+#include <maplab-common/threading-helpers.h>
 #include <opencv2/opencv.hpp>
 #include <rosbag/bag.h>
 #include <rosbag/view.h>
@@ -17,6 +19,7 @@
 #include <vi-map/vi-map-serialization.h>
 
 #include "resource-importer/message-conversion.h"
+#include "resource-importer/resource-import-pipeline.h"
 #include "resource-importer/simple-rosbag-reader.h"
 
 DEFINE_string(map_path, "", "Map input path.");
@@ -52,6 +55,18 @@ DEFINE_int64(
     "Time offset between camera/sensor and the clock of the primary motion "
     "estimation camera. The offset will be added to the resource timestamps.");
 
+DEFINE_int32(
+    resource_importer_num_workers, 0,
+    "Number of threads converting and writing resources. If 0, the number of "
+    "hardware threads is used.");
+DEFINE_int32(
+    resource_importer_max_messages_in_flight, 64,
+    "Maximum number of messages that are read from the bag but not yet "
+    "attached to the map. Bounds the memory consumption of the import.");
+DEFINE_int32(
+    resource_importer_write_batch_size, 32,
+    "Number of resources that are attached to the map at once.");
+
 int main(int argc, char* argv[]) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
@@ -109,103 +124,48 @@ int main(int argc, char* argv[]) {
       FLAGS_rosbag_path, FLAGS_resource_topic, FLAGS_camera_calibration_topic,
       FLAGS_camera_extrinsics_imu_frame, FLAGS_camera_extrinsics_camera_frame);
 
+  ResourceImportPipeline::Settings pipeline_settings;
+  pipeline_settings.num_workers =
+      (FLAGS_resource_importer_num_workers > 0)
+          ? static_cast<size_t>(FLAGS_resource_importer_num_workers)
+          : common::getNumHardwareThreads();
+  CHECK_GT(FLAGS_resource_importer_max_messages_in_flight, 0);
+  pipeline_settings.max_messages_in_flight =
+      static_cast<size_t>(FLAGS_resource_importer_max_messages_in_flight);
+  CHECK_GT(FLAGS_resource_importer_write_batch_size, 0);
+  pipeline_settings.write_batch_size =
+      static_cast<size_t>(FLAGS_resource_importer_write_batch_size);
+
   const std::string window_name =
       "Imported image from '" + FLAGS_resource_topic + "'";
   if (FLAGS_visualize_image_resources) {
+    // OpenCV windows can only be updated from the main thread.
+    LOG(WARNING) << "Image visualization is enabled, the resources will be "
+                 << "imported synchronously.";
+    pipeline_settings.num_workers = 0u;
     cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
   }
 
+  ResourceImportPipeline pipeline(
+      pipeline_settings, camera_id, FLAGS_resource_time_offset_ns,
+      &selected_mission, &map);
+  if (FLAGS_visualize_image_resources) {
+    pipeline.setImageVisualizer([&window_name](const cv::Mat& image) {
+      cv::imshow(window_name, image);
+      constexpr int kDepthMapVisualizationWaitTimeMs = 10;
+      cv::waitKey(kDepthMapVisualizationWaitTimeMs);
+    });
+  }
+
   std::function<void(sensor_msgs::ImageConstPtr)> image_callback =
-      [&](sensor_msgs::ImageConstPtr image_message) {
-        CHECK(image_message);
-        int64_t timestamp_ns = image_message->header.stamp.toNSec();
-        CHECK_GE(timestamp_ns, 0);
-
-        // Apply time offset.
-        timestamp_ns += FLAGS_resource_time_offset_ns;
-
-        if (image_message->encoding ==
-            sensor_msgs::image_encodings::TYPE_16UC1) {
-          LOG(INFO) << "Found depth map at " << timestamp_ns << " ns";
-
-          cv::Mat image;
-          convertDepthImageMessage(image_message, &image);
-
-          if (FLAGS_visualize_image_resources) {
-            cv::imshow(window_name, image);
-            constexpr int kDepthMapVisualizationWaitTimeMs = 10;
-            cv::waitKey(kDepthMapVisualizationWaitTimeMs);
-          }
-
-          map.storeOptionalRawDepthMap(
-              camera_id, timestamp_ns, image, &selected_mission);
-        } else if (
-            image_message->encoding ==
-            sensor_msgs::image_encodings::TYPE_32FC1) {
-          LOG(INFO) << "Found metric depth map at " << timestamp_ns;
-
-          cv::Mat image;
-          convertFloatDepthImageMessage(image_message, &image);
-
-          if (FLAGS_visualize_image_resources) {
-            cv::imshow(window_name, image);
-            constexpr int kDepthMapVisualizationWaitTimeMs = 10;
-            cv::waitKey(kDepthMapVisualizationWaitTimeMs);
-          }
-
-          map.storeOptionalRawDepthMap(
-              camera_id, timestamp_ns, image, &selected_mission);
-        } else if (
-            image_message->encoding ==
-            sensor_msgs::image_encodings::TYPE_8UC3) {
-          LOG(INFO) << "Found color image at " << timestamp_ns;
-
-          cv::Mat image;
-          convertColorImageMessage(image_message, &image);
-
-          cv::imshow(window_name, image);
-          constexpr int kDepthMapVisualizationWaitTimeMs = 10;
-          cv::waitKey(kDepthMapVisualizationWaitTimeMs);
-
-          map.storeOptionalRawColorImage(
-              camera_id, timestamp_ns, image, &selected_mission);
-        } else {
-          LOG(FATAL)
-              << "This image resource type is currently not supported by "
-                 "this importer! encoding: "
-              << image_message->encoding;
-        }
+      [&pipeline](sensor_msgs::ImageConstPtr image_message) {
+        pipeline.addImageMessage(image_message);
       };
   rosbag_source.setImageCallback(image_callback);
 
   std::function<void(sensor_msgs::PointCloud2ConstPtr)> pointcloud_callback =
-      [&](sensor_msgs::PointCloud2ConstPtr point_cloud_msg) {
-        CHECK(point_cloud_msg);
-        int64_t timestamp_ns = point_cloud_msg->header.stamp.toNSec();
-        CHECK_GE(timestamp_ns, 0);
-
-        // Apply time offset.
-        timestamp_ns += FLAGS_resource_time_offset_ns;
-
-        LOG(INFO) << "Found pointcloud at " << timestamp_ns << "ns";
-
-        resources::PointCloud maplab_pointcloud;
-        backend::convertPointCloudType(*point_cloud_msg, &maplab_pointcloud);
-
-        if (maplab_pointcloud.xyz.size() > 0u) {
-          if (backend::hasColorInformation(maplab_pointcloud)) {
-            map.storeOptionalPointCloudXYZRGBN(
-                camera_id, timestamp_ns, maplab_pointcloud, &selected_mission);
-          } else if (backend::hasScalarInformation(maplab_pointcloud)) {
-            map.storeOptionalPointCloudXYZI(
-                camera_id, timestamp_ns, maplab_pointcloud, &selected_mission);
-          } else {
-            map.storeOptionalPointCloudXYZ(
-                camera_id, timestamp_ns, maplab_pointcloud, &selected_mission);
-          }
-        } else {
-          LOG(WARNING) << "Received empty point cloud, ignoring...";
-        }
+      [&pipeline](sensor_msgs::PointCloud2ConstPtr point_cloud_msg) {
+        pipeline.addPointCloudMessage(point_cloud_msg);
       };
   rosbag_source.setPointcloudCallback(pointcloud_callback);
 
@@ -279,7 +239,16 @@ int main(int argc, char* argv[]) {
     return -1;
   }
 
+  const std::chrono::steady_clock::time_point import_start_time =
+      std::chrono::steady_clock::now();
   rosbag_source.readRosbag();
+  pipeline.finish();
+  const double import_duration_s =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - import_start_time)
+          .count();
+  LOG(INFO) << "Reading and importing the resources took "
+            << import_duration_s << " s.";
 
   aslam::Camera::UniquePtr aslam_camera;
   aslam::Transformation T_C_I;
@@ -0,0 +1,232 @@
+#include "resource-importer/resource-import-pipeline.h"
+
+#include <utility>
+
+#include <glog/logging.h>
+#include <map-resources/resource-conversion.h>
+#include <resources-common/point-cloud.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include "resource-importer/message-conversion.h"
+
+ResourceImportPipeline::ResourceImportPipeline(
+    const Settings& settings, const aslam::CameraId& camera_id,
+    const int64_t time_offset_ns, vi_map::VIMission* mission,
+    vi_map::VIMap* map)
+    : settings_(settings),
+      camera_id_(camera_id),
+      time_offset_ns_(time_offset_ns),
+      mission_(CHECK_NOTNULL(mission)),
+      map_(CHECK_NOTNULL(map)),
+      num_messages_added_(0u),
+      num_messages_written_(0u),
+      shutdown_(false),
+      num_resources_imported_(0u) {
+  CHECK(camera_id_.isValid());
+  CHECK_GT(settings_.max_messages_in_flight, 0u);
+  CHECK_GT(settings_.write_batch_size, 0u);
+  if (settings_.num_workers > 0u) {
+    worker_pool_.reset(new aslam::ThreadPool(settings_.num_workers));
+  }
+  writer_thread_ =
+      std::thread(&ResourceImportPipeline::writerThreadWorker, this);
+}
+
+ResourceImportPipeline::~ResourceImportPipeline() {
+  finish();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_converted_.notify_all();
+  writer_thread_.join();
+}
+
+void ResourceImportPipeline::setImageVisualizer(
+    const ImageVisualizer& visualizer) {
+  CHECK(!worker_pool_) << "Images can only be visualized if the messages are "
+                       << "processed synchronously.";
+  visualizer_ = visualizer;
+}
+
+void ResourceImportPipeline::addImageMessage(
+    sensor_msgs::ImageConstPtr image_message) {
+  CHECK(image_message);
+  enqueue([this, image_message]() { return convertImage(image_message); });
+}
+
+void ResourceImportPipeline::addPointCloudMessage(
+    sensor_msgs::PointCloud2ConstPtr point_cloud_msg) {
+  CHECK(point_cloud_msg);
+  enqueue(
+      [this, point_cloud_msg]() { return convertPointCloud(point_cloud_msg); });
+}
+
+void ResourceImportPipeline::finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_written_.wait(
+      lock, [this]() { return num_messages_written_ == num_messages_added_; });
+  LOG(INFO) << "Imported " << num_resources_imported_ << " resources from "
+            << num_messages_written_ << " messages.";
+}
+
+void ResourceImportPipeline::waitForFreeSlot() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_written_.wait(lock, [this]() {
+    return num_messages_added_ - num_messages_written_ <
+           settings_.max_messages_in_flight;
+  });
+}
+
+void ResourceImportPipeline::enqueue(
+    const std::function<ConvertedResource()>& conversion) {
+  CHECK(conversion);
+  waitForFreeSlot();
+
+  size_t sequence_number;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sequence_number = num_messages_added_++;
+  }
+
+  if (worker_pool_) {
+    worker_pool_->enqueue([this, sequence_number, conversion]() {
+      addConvertedResource(sequence_number, conversion());
+    });
+  } else {
+    addConvertedResource(sequence_number, conversion());
+  }
+}
+
+ResourceImportPipeline::ConvertedResource ResourceImportPipeline::convertImage(
+    sensor_msgs::ImageConstPtr image_message) const {
+  CHECK(image_message);
+  ConvertedResource converted_resource;
+  converted_resource.timestamp_ns = image_message->header.stamp.toNSec();
+  CHECK_GE(converted_resource.timestamp_ns, 0);
+
+  // Apply time offset.
+  converted_resource.timestamp_ns += time_offset_ns_;
+
+  cv::Mat image;
+  backend::ResourceType type;
+  if (image_message->encoding == sensor_msgs::image_encodings::TYPE_16UC1) {
+    VLOG(1) << "Found depth map at " << converted_resource.timestamp_ns
+            << " ns";
+    convertDepthImageMessage(image_message, &image);
+    type = backend::ResourceType::kRawDepthMap;
+  } else if (
+      image_message->encoding == sensor_msgs::image_encodings::TYPE_32FC1) {
+    VLOG(1) << "Found metric depth map at " << converted_resource.timestamp_ns
+            << " ns";
+    convertFloatDepthImageMessage(image_message, &image);
+    type = backend::ResourceType::kRawDepthMap;
+  } else if (
+      image_message->encoding == sensor_msgs::image_encodings::TYPE_8UC3) {
+    VLOG(1) << "Found color image at " << converted_resource.timestamp_ns
+            << " ns";
+    convertColorImageMessage(image_message, &image);
+    type = backend::ResourceType::kRawColorImage;
+  } else {
+    LOG(FATAL) << "This image resource type is currently not supported by "
+               << "this importer! encoding: " << image_message->encoding;
+  }
+
+  if (visualizer_) {
+    visualizer_(image);
+  }
+
+  map_->writeOptionalSensorResourceFile(
+      type, image, &converted_resource.pending_resource);
+  converted_resource.is_valid = true;
+  return converted_resource;
+}
+
+ResourceImportPipeline::ConvertedResource
+ResourceImportPipeline::convertPointCloud(
+    sensor_msgs::PointCloud2ConstPtr point_cloud_msg) const {
+  CHECK(point_cloud_msg);
+  ConvertedResource converted_resource;
+  converted_resource.timestamp_ns = point_cloud_msg->header.stamp.toNSec();
+  CHECK_GE(converted_resource.timestamp_ns, 0);
+
+  // Apply time offset.
+  converted_resource.timestamp_ns += time_offset_ns_;
+
+  VLOG(1) << "Found pointcloud at " << converted_resource.timestamp_ns << " ns";
+
+  resources::PointCloud maplab_pointcloud;
+  backend::convertPointCloudType(*point_cloud_msg, &maplab_pointcloud);
+  if (maplab_pointcloud.xyz.empty()) {
+    LOG(WARNING) << "Received empty point cloud, ignoring...";
+    return converted_resource;
+  }
+
+  backend::ResourceType type;
+  if (backend::hasColorInformation(maplab_pointcloud)) {
+    type = backend::ResourceType::kPointCloudXYZRGBN;
+  } else if (backend::hasScalarInformation(maplab_pointcloud)) {
+    type = backend::ResourceType::kPointCloudXYZI;
+  } else {
+    type = backend::ResourceType::kPointCloudXYZ;
+  }
+  map_->writeOptionalSensorResourceFile(
+      type, maplab_pointcloud, &converted_resource.pending_resource);
+  converted_resource.is_valid = true;
+  return converted_resource;
+}
+
+void ResourceImportPipeline::addConvertedResource(
+    const size_t sequence_number, const ConvertedResource& resource) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(converted_resources_.emplace(sequence_number, resource).second);
+  }
+  cv_converted_.notify_all();
+}
+
+void ResourceImportPipeline::writerThreadWorker() {
+  size_t next_sequence_number = 0u;
+  vi_map::VIMap::StampedPendingResourceList batch;
+  while (true) {
+    // Take all resources that are ready and in order, up to the batch size.
+    size_t num_messages_in_batch = 0u;
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_converted_.wait(lock, [&]() {
+        return shutdown_ ||
+               converted_resources_.count(next_sequence_number) > 0u;
+      });
+      std::map<size_t, ConvertedResource>::iterator it =
+          converted_resources_.find(next_sequence_number);
+      if (it == converted_resources_.end()) {
+        CHECK(shutdown_);
+        CHECK(converted_resources_.empty());
+        return;
+      }
+      while (it != converted_resources_.end() &&
+             it->first == next_sequence_number &&
+             num_messages_in_batch < settings_.write_batch_size) {
+        if (it->second.is_valid) {
+          batch.emplace_back(
+              it->second.timestamp_ns, it->second.pending_resource);
+        }
+        it = converted_resources_.erase(it);
+        ++next_sequence_number;
+        ++num_messages_in_batch;
+      }
+    }
+
+    if (!batch.empty()) {
+      map_->addOptionalSensorResources(camera_id_, batch, mission_);
+      num_resources_imported_ += batch.size();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_messages_written_ += num_messages_in_batch;
+    }
+    cv_written_.notify_all();
+  }
+}